@@ -0,0 +1,1073 @@
+/*
+ * agent.c
+ *
+ *  Both ends are one thread. The agent's is job_run()'s, polling the
+ *  coordinator in the tick between waits for its jobs and reading the
+ *  progress of each drive from the --live-stats file the job of it
+ *  writes; the coordinator polls all agents with a one second timeout
+ *  and redoes the budget shares on it. Frames are sent whole, blocking:
+ *  they are small, the plan the only large one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+
+#include "agent.h"
+#include "jobfile.h"
+#include "livestat.h"
+
+#define AGENT_TICK_MS 250 // the agent looks at its jobs this often,
+#define AGENT_STATS_S 1.0 // and sends their progress this often
+#define AGENT_SHARE_MIN 0.01 // a budget change smaller than this is kept
+
+struct wbuf
+{
+	uint8_t *b;
+	size_t n;
+	size_t cap;
+	int err;
+};
+
+struct rbuf
+{
+	const uint8_t *p;
+	size_t n;
+	int err; // read past the end
+};
+
+struct conn
+{
+	int fd; // -1 -> gone
+	uint8_t *rx;
+	size_t len;
+	size_t cap;
+	size_t used; // by the frame taken, dropped on the next take
+};
+
+// Whether a budget of now differs enough from was to be put
+static int
+changed(double now, double was)
+{
+	if ((0 == now) || (0 == was))
+		return now != was;
+	return (now > was * (1 + AGENT_SHARE_MIN)) ||
+	       (now < was * (1 - AGENT_SHARE_MIN));
+}
+
+static double
+now_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+put(struct wbuf *w, const void *p, size_t n)
+{
+	uint8_t *b;
+	size_t cap;
+
+	if (w->n + n > w->cap)
+	{
+		cap = w->cap ? w->cap : 256;
+		while (cap < w->n + n)
+			cap *= 2;
+		b = (uint8_t *)realloc(w->b, cap);
+		if (NULL == b)
+		{
+			w->err = 1;
+			return;
+		}
+		w->b = b;
+		w->cap = cap;
+	}
+	memcpy(w->b + w->n, p, n);
+	w->n += n;
+}
+
+static void
+put_le(struct wbuf *w, uint64_t v, int bytes)
+{
+	uint8_t b[8];
+	int k;
+
+	for (k = 0; k < bytes; ++k)
+		b[k] = (uint8_t)(v >> (8 * k));
+	put(w, b, bytes);
+}
+
+static void
+put_f64(struct wbuf *w, double d)
+{
+	uint64_t v;
+
+	memcpy(&v, &d, sizeof(v));
+	put_le(w, v, 8);
+}
+
+static void
+put_f32(struct wbuf *w, float f)
+{
+	uint32_t v;
+
+	memcpy(&v, &f, sizeof(v));
+	put_le(w, v, 4);
+}
+
+static void
+put_str(struct wbuf *w, const char *s)
+{
+	size_t n = strlen(s);
+
+	if (n > UINT16_MAX)
+		n = UINT16_MAX;
+	put_le(w, n, 2);
+	put(w, s, n);
+}
+
+// Starts a frame of type into w, its length put in by frame_send()
+static void
+frame_begin(struct wbuf *w, int type)
+{
+	w->n = 0;
+	w->err = 0;
+	put_le(w, 0, 4);
+	put_le(w, type, 1);
+}
+
+static int
+send_all(int fd, const uint8_t *buf, size_t len)
+{
+	ssize_t res;
+	size_t off;
+
+	for (off = 0; off < len; off += res)
+	{
+		res = send(fd, buf + off, len - off, MSG_NOSIGNAL);
+		if ((res < 0) && (EINTR == errno))
+			res = 0;
+		else if (res <= 0)
+			return -1;
+	}
+	return 0;
+}
+
+// Returns 0, -1 when the peer is gone
+static int
+frame_send(struct conn *c, struct wbuf *w)
+{
+	uint32_t len = (uint32_t)(w->n - 4);
+	int k;
+
+	if (c->fd < 0)
+		return -1;
+	if (w->err)
+		return 0; // out of memory, this one is lost
+	for (k = 0; k < 4; ++k)
+		w->b[k] = (uint8_t)(len >> (8 * k));
+	return send_all(c->fd, w->b, w->n);
+}
+
+static uint64_t
+get_le(struct rbuf *r, int bytes)
+{
+	uint64_t v = 0;
+	int k;
+
+	if (r->n < (size_t)bytes)
+	{
+		r->err = 1;
+		r->n = 0;
+		return 0;
+	}
+	for (k = 0; k < bytes; ++k)
+		v |= (uint64_t)r->p[k] << (8 * k);
+	r->p += bytes;
+	r->n -= bytes;
+	return v;
+}
+
+static void
+skip(struct rbuf *r, size_t n)
+{
+	if (r->n < n)
+	{
+		r->err = 1;
+		n = r->n;
+	}
+	r->p += n;
+	r->n -= n;
+}
+
+static double
+get_f64(struct rbuf *r)
+{
+	uint64_t v = get_le(r, 8);
+	double d;
+
+	memcpy(&d, &v, sizeof(d));
+	return d;
+}
+
+static float
+get_f32(struct rbuf *r)
+{
+	uint32_t v = (uint32_t)get_le(r, 4);
+	float f;
+
+	memcpy(&f, &v, sizeof(f));
+	return f;
+}
+
+// Into dst, cut to its size
+static void
+get_str(struct rbuf *r, char *dst, size_t size)
+{
+	size_t n = (size_t)get_le(r, 2);
+
+	if (n > r->n)
+	{
+		r->err = 1;
+		n = r->n;
+	}
+	snprintf(dst, size, "%.*s", (int)n, (const char *)r->p);
+	r->p += n;
+	r->n -= n;
+}
+
+// Reads what has come. Returns 0, -1 when the peer is gone
+static int
+conn_read(struct conn *c)
+{
+	uint8_t *b;
+	ssize_t res;
+
+	if (c->len == c->cap)
+	{
+		if (c->cap > AGENT_FRAME_MAX)
+			return -1; // a frame longer than any
+		b = (uint8_t *)realloc(c->rx, c->cap ? 2 * c->cap : 4096);
+		if (NULL == b)
+			return -1;
+		c->rx = b;
+		c->cap = c->cap ? 2 * c->cap : 4096;
+	}
+	res = recv(c->fd, c->rx + c->len, c->cap - c->len, 0);
+	if ((res < 0) && ((EINTR == errno) || (EAGAIN == errno)))
+		return 0;
+	if (res <= 0)
+		return -1;
+	c->len += res;
+	return 0;
+}
+
+// The next whole frame, its fields into r. Returns its type, 0 when
+// none has come in full, -1 for one too long
+static int
+conn_take(struct conn *c, struct rbuf *r)
+{
+	uint32_t len;
+
+	if (c->used)
+	{
+		c->len -= c->used;
+		memmove(c->rx, c->rx + c->used, c->len);
+		c->used = 0;
+	}
+	if (c->len < 4)
+		return 0;
+	len = c->rx[0] | c->rx[1] << 8 | c->rx[2] << 16 | (uint32_t)c->rx[3] << 24;
+	if ((len < 1) || (len > AGENT_FRAME_MAX))
+		return -1;
+	if (c->len < 4 + (size_t)len)
+		return 0;
+	c->used = 4 + len;
+	r->p = c->rx + 5;
+	r->n = len - 1;
+	r->err = 0;
+	return c->rx[4];
+}
+
+static void
+conn_close(struct conn *c)
+{
+	if (c->fd >= 0)
+		close(c->fd);
+	c->fd = -1;
+	free(c->rx);
+	c->rx = NULL;
+	c->len = c->cap = c->used = 0;
+}
+
+// ---- the agent
+
+struct agent
+{
+	struct conn c;
+	struct job_plan *p;
+	struct wbuf w;
+	char dir[64]; // "" -> not made
+	int verbose;
+	double bps, watts; // the budget, 0 -> none
+	double share;	   // put in the rate file, -1 -> nothing yet
+	int plan_par;	   // jobs at once of the plan
+	double stats_t;
+	char *plan;	   // the PLAN, until written
+	size_t plan_len;
+};
+
+// The last record the job of drive d wrote into its --live-stats file.
+// Returns 0, -1 when there is none
+static int
+read_live(const struct agent *a, int d, struct livestat_dev *out)
+{
+	size_t len = sizeof(struct livestat) + sizeof(struct livestat_dev);
+	const struct livestat *ls;
+	char path[96];
+	struct stat st;
+	uint32_t seq;
+	int fd, k, res = -1;
+	void *m;
+
+	snprintf(path, sizeof(path), "%s/dev%d", a->dir, d);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) || ((size_t)st.st_size < len))
+	{
+		close(fd);
+		return -1;
+	}
+	m = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == m)
+		return -1;
+	ls = (const struct livestat *)m;
+	if ((LIVESTAT_MAGIC == ls->magic) && (LIVESTAT_VERSION == ls->version) &&
+	    (ls->ndev >= 1))
+		for (k = 0; (k < 100) && res; ++k)
+		{
+			seq = __atomic_load_n(&ls->dev[0].seq, __ATOMIC_ACQUIRE);
+			if (seq & 1)
+				continue;
+			memcpy(out, &ls->dev[0], sizeof(*out));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (seq == __atomic_load_n(&ls->dev[0].seq, __ATOMIC_RELAXED))
+				res = 0;
+		}
+	munmap(m, len);
+	return res;
+}
+
+// The rate file the jobs re-read every refresh, written whole
+static void
+write_rate(const struct agent *a, double share)
+{
+	char path[96], tmp[104];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/rate", a->dir);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	fp = fopen(tmp, "w");
+	if (NULL == fp)
+		return;
+	if (share >= 0)
+		fprintf(fp, "max-rate %.0f\n", share);
+	if (fclose(fp))
+		unlink(tmp);
+	else
+		rename(tmp, path);
+}
+
+// Puts the budget on the jobs: the rate split over those running, and
+// as many at once as the power allows
+static void
+agent_apply(struct agent *a)
+{
+	struct job_dev_info di;
+	int d, running = 0, par = a->plan_par;
+	double share;
+
+	for (d = 0; d < job_ndev(a->p); ++d)
+	{
+		job_dev_info(a->p, d, &di);
+		if (di.phase)
+			++running;
+	}
+	share = (a->bps > 0) ? a->bps / (running ? running : 1) : 0.0;
+	if ((a->share < 0) ? (share > 0) : changed(share, a->share))
+	{
+		write_rate(a, share);
+		a->share = share;
+	}
+	if (a->watts > 0)
+	{
+		d = (int)(a->watts / job_watts(a->p));
+		if (d < 1)
+			d = 1; // over the budget, else the plan never ends
+		if ((0 == par) || (d < par))
+			par = d;
+	}
+	job_set_parallel(a->p, par);
+}
+
+static void
+agent_stats(struct agent *a)
+{
+	struct livestat_dev ld;
+	struct job_dev_info di;
+	int d, running = 0, left = 0, n = 0;
+	struct wbuf body = {NULL, 0, 0, 0};
+
+	for (d = 0; d < job_ndev(a->p); ++d)
+	{
+		job_dev_info(a->p, d, &di);
+		running += (NULL != di.phase);
+		left += (di.left > 0);
+		if ((NULL == di.phase) || read_live(a, d, &ld))
+			continue;
+		++n;
+		put_le(&body, d, 2);
+		put_le(&body, ld.pass, 4);
+		put_le(&body, ld.passes, 4);
+		put_le(&body, (uint64_t)ld.start, 8);
+		put_le(&body, (uint64_t)ld.end, 8);
+		put_le(&body, (uint64_t)ld.lba, 8);
+		put_le(&body, (uint64_t)ld.bytes_done, 8);
+		put_le(&body, (uint32_t)ld.unrecovered, 4);
+		put_le(&body, (uint32_t)ld.mismatches, 4);
+		put_le(&body, (uint32_t)ld.weak_sectors, 4);
+		put_f32(&body, (float)ld.mbps);
+	}
+	frame_begin(&a->w, AGENT_STATS);
+	put_le(&a->w, running, 2);
+	put_le(&a->w, left, 2);
+	put_le(&a->w, n, 2);
+	if (body.n)
+		put(&a->w, body.b, body.n);
+	a->w.err |= body.err;
+	free(body.b);
+	if (frame_send(&a->c, &a->w))
+		conn_close(&a->c);
+}
+
+// Takes the frames that have come. Returns 0, -1 on a malformed one
+static int
+agent_frames(struct agent *a)
+{
+	struct rbuf r;
+	int type;
+
+	while ((type = conn_take(&a->c, &r)) > 0)
+	{
+		if (AGENT_BUDGET == type)
+		{
+			a->bps = get_f64(&r);
+			a->watts = get_f64(&r);
+			if (a->verbose)
+				fprintf(stderr, "agent: budget %.1f MB/s, %.0f W\n",
+					a->bps / 1e6, a->watts);
+		}
+		else if ((AGENT_PLAN == type) && (NULL == a->plan))
+		{
+			a->plan_len = (size_t)get_le(&r, 4);
+			if (a->plan_len > r.n)
+				return -1;
+			a->plan = (char *)malloc(a->plan_len + 1);
+			if (NULL == a->plan)
+				return -1;
+			memcpy(a->plan, r.p, a->plan_len);
+			a->plan[a->plan_len] = '\0';
+		}
+		if (r.err)
+			return -1;
+	}
+	return type;
+}
+
+// Between waits for the jobs: what the coordinator sent, and progress
+static void
+agent_tick(void *arg)
+{
+	struct agent *a = (struct agent *)arg;
+	struct pollfd pfd = {a->c.fd, POLLIN, 0};
+
+	if (a->c.fd < 0)
+		poll(NULL, 0, AGENT_TICK_MS);
+	else if ((poll(&pfd, 1, AGENT_TICK_MS) > 0) &&
+		 (conn_read(&a->c) || agent_frames(a)))
+	{
+		fprintf(stderr, "agent: lost the coordinator, the plan goes on\n");
+		conn_close(&a->c);
+	}
+	agent_apply(a);
+	if ((a->c.fd >= 0) && (now_secs() - a->stats_t >= AGENT_STATS_S))
+	{
+		agent_stats(a);
+		a->stats_t = now_secs();
+	}
+}
+
+static void
+agent_end(void *arg, int dev, const char *phase, int status, double secs)
+{
+	struct agent *a = (struct agent *)arg;
+	struct livestat_dev ld;
+	struct job_dev_info di;
+
+	memset(&ld, 0, sizeof(ld));
+	read_live(a, dev, &ld); // none for a job that failed to start
+	job_dev_info(a->p, dev, &di);
+	frame_begin(&a->w, AGENT_RESULT);
+	put_str(&a->w, di.name);
+	put_str(&a->w, phase);
+	put_str(&a->w, di.lot);
+	put_le(&a->w, (uint32_t)status, 4);
+	put_f32(&a->w, (float)secs);
+	put_le(&a->w, (uint64_t)ld.bytes_done, 8);
+	put_le(&a->w, (uint32_t)ld.unrecovered, 4);
+	put_le(&a->w, (uint32_t)ld.mismatches, 4);
+	put_le(&a->w, (uint32_t)ld.weak_sectors, 4);
+	if (frame_send(&a->c, &a->w))
+		conn_close(&a->c);
+	agent_apply(a);
+}
+
+static int
+agent_connect(const char *addr)
+{
+	struct addrinfo hints, *res, *ai;
+	char host[256];
+	const char *colon = strrchr(addr, ':');
+	int fd = -1, err;
+
+	if ((NULL == colon) || (colon == addr) ||
+	    ((size_t)(colon - addr) >= sizeof(host)))
+	{
+		fprintf(stderr, "--agent: %s is not host:port\n", addr);
+		return -1;
+	}
+	snprintf(host, sizeof(host), "%.*s", (int)(colon - addr), addr);
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	err = getaddrinfo(host, colon + 1, &hints, &res);
+	if (err)
+	{
+		fprintf(stderr, "--agent: %s: %s\n", addr, gai_strerror(err));
+		return -1;
+	}
+	for (ai = res; ai && (fd < 0); ai = ai->ai_next)
+	{
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+			    ai->ai_protocol);
+		if ((fd >= 0) && connect(fd, ai->ai_addr, ai->ai_addrlen))
+		{
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(res);
+	if (fd < 0)
+		fprintf(stderr, "--agent: %s: %s\n", addr, strerror(errno));
+	return fd;
+}
+
+// The plan into dir and loaded. Returns 0, -1 with the reason in err
+static int
+agent_load(struct agent *a, char *err, int errlen)
+{
+	const char *extra[4];
+	char path[96], live[96], rate[96];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/plan.ini", a->dir);
+	fp = fopen(path, "w");
+	if ((NULL == fp) || (fwrite(a->plan, 1, a->plan_len, fp) != a->plan_len) ||
+	    fclose(fp))
+	{
+		snprintf(err, errlen, "%s: %s", path, strerror(errno));
+		return -1;
+	}
+	a->p = job_load(path, err, errlen);
+	if (NULL == a->p)
+		return -1;
+	snprintf(live, sizeof(live), "%s/dev%%d", a->dir);
+	snprintf(rate, sizeof(rate), "%s/rate", a->dir);
+	extra[0] = "--live-stats";
+	extra[1] = live;
+	extra[2] = "--rate-file";
+	extra[3] = rate;
+	if (job_set_extra(a->p, 4, extra))
+	{
+		snprintf(err, errlen, "out of memory");
+		return -1;
+	}
+	a->plan_par = job_parallel(a->p);
+	job_set_hooks(a->p, agent_tick, agent_end, a);
+	return 0;
+}
+
+static void
+agent_cleanup(struct agent *a)
+{
+	char path[96];
+	int d;
+
+	for (d = 0; a->p && (d < job_ndev(a->p)); ++d)
+	{
+		snprintf(path, sizeof(path), "%s/dev%d", a->dir, d);
+		unlink(path);
+	}
+	snprintf(path, sizeof(path), "%s/rate", a->dir);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/plan.ini", a->dir);
+	unlink(path);
+	rmdir(a->dir);
+}
+
+int agent_run(const char *addr, const char *self, int verbose)
+{
+	struct agent a;
+	char host[256] = "", err[512] = "";
+	int ret = 1;
+
+	memset(&a, 0, sizeof(a));
+	a.verbose = verbose;
+	a.share = -1;
+	a.c.fd = agent_connect(addr);
+	if (a.c.fd < 0)
+		return -1;
+	gethostname(host, sizeof(host) - 1);
+	frame_begin(&a.w, AGENT_HELLO);
+	put_le(&a.w, AGENT_VERSION, 2);
+	put_str(&a.w, host);
+	if (frame_send(&a.c, &a.w))
+		goto lost;
+	while (NULL == a.plan)
+		if (conn_read(&a.c) || agent_frames(&a))
+			goto lost;
+	snprintf(a.dir, sizeof(a.dir), "/tmp/dskread-agent.XXXXXX");
+	if (NULL == mkdtemp(a.dir))
+	{
+		snprintf(err, sizeof(err), "%s: %s", a.dir, strerror(errno));
+		a.dir[0] = '\0';
+	}
+	else if (0 == agent_load(&a, err, sizeof(err)))
+	{
+		printf("agent: %s, %d drives from %s\n", host, job_ndev(a.p), addr);
+		fflush(stdout);
+		write_rate(&a, -1); // there before the first job reads it
+		agent_apply(&a);
+		ret = job_run(a.p, self, verbose);
+		agent_stats(&a);
+	}
+	else
+		fprintf(stderr, "agent: %s\n", err);
+	if (a.dir[0])
+		agent_cleanup(&a);
+	frame_begin(&a.w, AGENT_DONE);
+	put_le(&a.w, (uint32_t)ret, 4);
+	put_str(&a.w, err);
+	frame_send(&a.c, &a.w);
+	job_free(a.p);
+	conn_close(&a.c);
+	free(a.w.b);
+	free(a.plan);
+	return ret;
+lost:
+	fprintf(stderr, "agent: %s went away before its plan came\n", addr);
+	conn_close(&a.c);
+	free(a.w.b);
+	free(a.plan);
+	return -1;
+}
+
+// ---- the coordinator
+
+struct cagent
+{
+	struct conn c;
+	char host[256];
+	int hello;
+	int done;
+	int ret;
+	int running, left; // drives, as of its last STATS
+	double mbps;
+	double bps, watts; // the budget sent,
+	int sent;	   // once it was
+};
+
+struct cdrive // a drive of an agent, its jobs added up
+{
+	char host[256];
+	char dev[256];
+	char lot[256];
+	int failed;
+	int64_t bytes;
+	int64_t unrecovered, mismatches, weak;
+};
+
+struct coord
+{
+	struct cagent *ag;
+	int nag;
+	int ndone;
+	struct cdrive *dr;
+	int ndr;
+	char *plan;
+	size_t plan_len;
+	double bps, watts;
+	int verbose;
+	int ret;
+	struct wbuf w;
+};
+
+static struct cdrive *
+coord_drive(struct coord *co, const char *host, const char *dev,
+	    const char *lot)
+{
+	struct cdrive *dr;
+	int k;
+
+	for (k = 0; k < co->ndr; ++k)
+		if ((0 == strcmp(co->dr[k].host, host)) &&
+		    (0 == strcmp(co->dr[k].dev, dev)))
+			return co->dr + k;
+	dr = (struct cdrive *)realloc(co->dr, (co->ndr + 1) * sizeof(*dr));
+	if (NULL == dr)
+		return NULL;
+	co->dr = dr;
+	dr += co->ndr++;
+	memset(dr, 0, sizeof(*dr));
+	snprintf(dr->host, sizeof(dr->host), "%s", host);
+	snprintf(dr->dev, sizeof(dr->dev), "%s", dev);
+	snprintf(dr->lot, sizeof(dr->lot), "%s", lot);
+	return dr;
+}
+
+static void
+coord_done(struct coord *co, struct cagent *a, int ret)
+{
+	if (a->done)
+		return;
+	a->done = 1;
+	a->ret = ret;
+	++co->ndone;
+	if (ret && (0 == co->ret))
+		co->ret = ret;
+	conn_close(&a->c);
+}
+
+static void coord_budget(struct coord *co);
+
+// Takes the frames that have come from a. Returns 0, -1 on a malformed
+// one
+static int
+coord_frames(struct coord *co, struct cagent *a)
+{
+	char dev[256], phase[256], lot[256], msg[512];
+	struct cdrive *dr;
+	struct rbuf r;
+	int type, status, k, n;
+	double secs;
+
+	while ((type = conn_take(&a->c, &r)) > 0)
+	{
+		if (AGENT_HELLO == type)
+		{
+			if (AGENT_VERSION != get_le(&r, 2))
+				return -1;
+			get_str(&r, a->host, sizeof(a->host));
+			a->hello = 1;
+			printf("coordinator: agent %s\n", a->host);
+			coord_budget(co); // its share before the plan starts
+			frame_begin(&co->w, AGENT_PLAN);
+			put_le(&co->w, co->plan_len, 4);
+			put(&co->w, co->plan, co->plan_len);
+			if (frame_send(&a->c, &co->w))
+				return -1;
+		}
+		else if (a->hello && (AGENT_STATS == type))
+		{
+			a->running = (int)get_le(&r, 2);
+			a->left = (int)get_le(&r, 2);
+			n = (int)get_le(&r, 2);
+			a->mbps = 0;
+			for (k = 0; (k < n) && !r.err; ++k)
+			{
+				skip(&r, 2 + 4 + 4 + 4 * 8 + 3 * 4); // the monitor's
+				a->mbps += get_f32(&r);
+			}
+		}
+		else if (a->hello && (AGENT_RESULT == type))
+		{
+			get_str(&r, dev, sizeof(dev));
+			get_str(&r, phase, sizeof(phase));
+			get_str(&r, lot, sizeof(lot));
+			status = (int32_t)get_le(&r, 4);
+			secs = get_f32(&r);
+			dr = coord_drive(co, a->host, dev, lot);
+			if (dr)
+			{
+				dr->failed |= (0 != status);
+				dr->bytes += (int64_t)get_le(&r, 8);
+				dr->unrecovered += (uint32_t)get_le(&r, 4);
+				dr->mismatches += (uint32_t)get_le(&r, 4);
+				dr->weak += (uint32_t)get_le(&r, 4);
+			}
+			if (co->verbose || status)
+				printf("coordinator: %s %s %s %s in %.1f s\n", a->host,
+				       dev, phase, status ? "failed" : "passed", secs);
+		}
+		else if (a->hello && (AGENT_DONE == type))
+		{
+			status = (int32_t)get_le(&r, 4);
+			get_str(&r, msg, sizeof(msg));
+			printf("coordinator: agent %s done, exit status %d%s%s\n",
+			       a->host, status, msg[0] ? ", " : "", msg);
+			coord_done(co, a, status);
+			return 0;
+		}
+		if (r.err)
+			return -1;
+	}
+	return type;
+}
+
+// The budget shared by the drives each agent has left
+static void
+coord_budget(struct coord *co)
+{
+	struct cagent *a;
+	int k, left = 0;
+	double bps, watts;
+
+	if ((co->bps <= 0) && (co->watts <= 0))
+		return;
+	for (k = 0; k < co->nag; ++k)
+		if (co->ag[k].hello && !co->ag[k].done)
+			left += co->ag[k].left ? co->ag[k].left : 1;
+	for (k = 0; k < co->nag; ++k)
+	{
+		a = co->ag + k;
+		if (!a->hello || a->done)
+			continue;
+		bps = co->bps * (a->left ? a->left : 1) / left;
+		watts = co->watts * (a->left ? a->left : 1) / left;
+		if (a->sent && !changed(bps, a->bps) && !changed(watts, a->watts))
+			continue;
+		a->sent = 1;
+		a->bps = bps;
+		a->watts = watts;
+		frame_begin(&co->w, AGENT_BUDGET);
+		put_f64(&co->w, bps);
+		put_f64(&co->w, watts);
+		if (frame_send(&a->c, &co->w))
+			conn_close(&a->c);
+	}
+}
+
+static void
+coord_summary(const struct coord *co, int n)
+{
+	int k, on = 0, running = 0, left = 0;
+	double mbps = 0;
+
+	for (k = 0; k < co->nag; ++k)
+		if (co->ag[k].hello && !co->ag[k].done)
+		{
+			++on;
+			running += co->ag[k].running;
+			left += co->ag[k].left;
+			mbps += co->ag[k].mbps;
+		}
+	printf("coordinator: %d of %d agents done, %d running, %d drives "
+	       "testing, %d with jobs left, %.1f MB/s\n", co->ndone, n, on,
+	       running, left, mbps);
+	fflush(stdout);
+}
+
+// The results added up per lot, in the order lots first came
+static void
+coord_lots(const struct coord *co)
+{
+	int k, i, drives, failed;
+	int64_t bytes, unrec, mis, weak;
+
+	printf("\n%-24s %6s %6s %6s %12s %11s %10s %8s\n", "lot", "drives",
+	       "passed", "failed", "GB", "unrecovered", "mismatched", "weak");
+	for (k = 0; k < co->ndr; ++k)
+	{
+		for (i = 0; i < k; ++i)
+			if (0 == strcmp(co->dr[i].lot, co->dr[k].lot))
+				break;
+		if (i < k)
+			continue; // its lot is done
+		drives = failed = 0;
+		bytes = unrec = mis = weak = 0;
+		for (i = k; i < co->ndr; ++i)
+			if (0 == strcmp(co->dr[i].lot, co->dr[k].lot))
+			{
+				++drives;
+				failed += co->dr[i].failed;
+				bytes += co->dr[i].bytes;
+				unrec += co->dr[i].unrecovered;
+				mis += co->dr[i].mismatches;
+				weak += co->dr[i].weak;
+			}
+		printf("%-24s %6d %6d %6d %12.1f %11" PRId64 " %10" PRId64 " %8"
+		       PRId64 "\n", co->dr[k].lot, drives, drives - failed,
+		       failed, bytes / 1e9, unrec, mis, weak);
+	}
+	for (k = 0; k < co->ndr; ++k)
+		if (co->dr[k].failed)
+			printf("failed: %s %s (lot %s)\n", co->dr[k].host,
+			       co->dr[k].dev, co->dr[k].lot);
+}
+
+static char *
+read_file(const char *path, size_t *lenp)
+{
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *fp = fopen(path, "r"), *mp;
+	char chunk[4096];
+	size_t n;
+
+	if (NULL == fp)
+		return NULL;
+	mp = open_memstream(&buf, &len);
+	if (mp)
+	{
+		while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+			fwrite(chunk, 1, n, mp);
+		fclose(mp);
+	}
+	fclose(fp);
+	*lenp = len;
+	return buf;
+}
+
+int coord_run(int port, int n, const char *path, double bps, double watts,
+	      int interval_s, int verbose)
+{
+	struct sockaddr_in sa;
+	struct coord co;
+	struct pollfd *pfd = NULL;
+	struct cagent *ag;
+	double tick_t = 0, sum_t = now_secs();
+	int lfd, k, np, one = 1, res;
+
+	memset(&co, 0, sizeof(co));
+	co.bps = bps;
+	co.watts = watts;
+	co.verbose = verbose;
+	co.plan = read_file(path, &co.plan_len);
+	if ((NULL == co.plan) || (co.plan_len > AGENT_FRAME_MAX - 16))
+	{
+		fprintf(stderr, "--coordinator: %s: %s\n", path,
+			co.plan ? "too long" : strerror(errno));
+		free(co.plan);
+		return -1;
+	}
+	lfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (lfd < 0)
+	{
+		free(co.plan);
+		return -1;
+	}
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_ANY);
+	sa.sin_port = htons(port);
+	if (bind(lfd, (struct sockaddr *)&sa, sizeof(sa)) || listen(lfd, 64))
+	{
+		perror("--coordinator");
+		close(lfd);
+		free(co.plan);
+		return -1;
+	}
+	printf("coordinator: port %d, waiting for %d agents\n", port, n);
+	fflush(stdout);
+	while (co.ndone < n)
+	{
+		pfd = (struct pollfd *)realloc(pfd, (co.nag + 1) * sizeof(*pfd));
+		if (NULL == pfd)
+			break;
+		pfd[0].fd = lfd;
+		pfd[0].events = POLLIN;
+		for (k = 0; k < co.nag; ++k)
+		{
+			pfd[k + 1].fd = co.ag[k].c.fd; // < 0 once done: ignored
+			pfd[k + 1].events = POLLIN;
+			pfd[k + 1].revents = 0;
+		}
+		np = co.nag;
+		res = poll(pfd, np + 1, 1000);
+		if ((res < 0) && (EINTR != errno))
+			break;
+		for (k = 0; (res > 0) && (k < np); ++k)
+		{
+			ag = co.ag + k;
+			if ((0 == pfd[k + 1].revents) || (ag->c.fd < 0))
+				continue;
+			if (conn_read(&ag->c) || (coord_frames(&co, ag) < 0))
+			{
+				if (!ag->done)
+					printf("coordinator: lost agent %s\n",
+					       ag->hello ? ag->host : "before its hello");
+				coord_done(&co, ag, 1);
+			}
+		}
+		if ((res > 0) && (pfd[0].revents & POLLIN))
+		{
+			ag = (struct cagent *)realloc(co.ag,
+						      (co.nag + 1) * sizeof(*ag));
+			if (ag)
+			{
+				co.ag = ag;
+				memset(co.ag + co.nag, 0, sizeof(*ag));
+				co.ag[co.nag].c.fd = accept(lfd, NULL, NULL);
+				if (co.ag[co.nag].c.fd >= 0)
+					++co.nag;
+			}
+		}
+		if (now_secs() - tick_t >= 1.0)
+		{
+			coord_budget(&co);
+			tick_t = now_secs();
+		}
+		if ((interval_s > 0) && (now_secs() - sum_t >= interval_s))
+		{
+			coord_summary(&co, n);
+			sum_t = now_secs();
+		}
+	}
+	close(lfd);
+	coord_lots(&co);
+	for (k = 0; k < co.nag; ++k)
+		conn_close(&co.ag[k].c);
+	free(pfd);
+	free(co.ag);
+	free(co.dr);
+	free(co.plan);
+	free(co.w.b);
+	return co.ret;
+}
@@ -0,0 +1,55 @@
+/*
+ * agent.h
+ *
+ *  Burn-in across many hosts: a coordinator hands one job file to every
+ *  agent that connects, shares a lab wide rate and power budget among
+ *  them by the drives each has left to test, and adds up the results
+ *  per drive lot. An agent runs the plan on its own host (the groups
+ *  whose hosts match it) as --job does, streaming the progress of its
+ *  drives back every second.
+ *
+ *  Wire format, TCP, integers little endian: frames of a u32 length of
+ *  what follows, a u8 type (AGENT_*) and its fields. Strings are a u16
+ *  length and the bytes, the plan a u32 length and the bytes.
+ *    HELLO  agent:  u16 version, str hostname
+ *    PLAN   coord:  the job file
+ *    BUDGET coord:  f64 bytes/s, f64 watts the agent may use, 0 -> any
+ *    STATS  agent:  u16 running jobs, u16 drives with jobs left, u16 n,
+ *                   then n drives: u16 index, u32 pass, u32 passes,
+ *                   i64 start, end, lba, bytes, u32 unrecovered,
+ *                   mismatches, weak sectors, f32 MB/s
+ *    RESULT agent:  str device, str phase, str lot, i32 exit status,
+ *                   f32 s, i64 bytes, u32 unrecovered, mismatches, weak
+ *    DONE   agent:  i32 exit status of the plan, str error or ""
+ *  The agent throttles its jobs through a --rate-file of its own, its
+ *  share of the rate split over the jobs running, and starts no more
+ *  jobs at once than its share of the power allows, one at least.
+ */
+
+#ifndef AGENT_H_
+#define AGENT_H_
+
+#define AGENT_VERSION 1
+
+#define AGENT_HELLO 1
+#define AGENT_PLAN 2
+#define AGENT_BUDGET 3
+#define AGENT_STATS 4
+#define AGENT_RESULT 5
+#define AGENT_DONE 6
+
+#define AGENT_FRAME_MAX (16 << 20) // longest frame, the plan bounds it
+
+// Connects to the coordinator at addr, host:port, and runs the plan it
+// sends, each job by execv() of self. Returns the exit status of the
+// plan as job_run() does, -1 when the coordinator could not be reached
+// or went away before the plan came; once it runs it goes on without it
+int agent_run(const char *addr, const char *self, int verbose);
+// Serves the plan at path to agents on port until n of them are done,
+// sharing bps bytes/s and watts among them (0 -> no such budget), a
+// summary every interval_s. Returns 0 when every job passed, else the
+// first failed exit status, -1 on errors
+int coord_run(int port, int n, const char *path, double bps, double watts,
+	      int interval_s, int verbose);
+
+#endif /* AGENT_H_ */
@@ -0,0 +1,310 @@
+/*
+ * badmap.c
+ *
+ *  New extents are appended unsorted, merging with the last one when
+ *  they continue it, which is how a scan finds them. Only when the
+ *  array is full is it sorted and merged, and grown if that did not
+ *  free half of it, so adding stays cheap however many there are.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "badmap.h"
+
+static const char badmap_magic[7] = {'D', 'S', 'K', 'B', 'A', 'D', 'M'};
+
+void badmap_init(struct badmap *m)
+{
+	memset(m, 0, sizeof(*m));
+	pthread_mutex_init(&m->mutex, NULL);
+}
+
+void badmap_free(struct badmap *m)
+{
+	free(m->ext);
+	m->ext = NULL;
+	m->num = m->cap = m->sorted = 0;
+}
+
+static int
+ext_cmp(const void *a, const void *b)
+{
+	const struct badmap_ext *x = a, *y = b;
+
+	if (x->lba != y->lba)
+		return (x->lba < y->lba) ? -1 : 1;
+	return (int)x->kind - (int)y->kind;
+}
+
+static void
+compact_locked(struct badmap *m)
+{
+	size_t last[4] = {0, 0, 0, 0}; // 1 + index of the last of each kind
+	size_t k, out = 0;
+
+	if (m->sorted == m->num)
+		return;
+	qsort(m->ext, m->num, sizeof(*m->ext), ext_cmp);
+	for (k = 0; k < m->num; ++k)
+	{
+		struct badmap_ext e = m->ext[k];
+		struct badmap_ext *p = last[e.kind] ? m->ext + last[e.kind] - 1 : NULL;
+
+		if (p && (p->lba + p->len >= e.lba) &&
+		    (e.lba + e.len - p->lba <= UINT32_MAX))
+		{
+			if (e.lba + e.len > p->lba + p->len)
+				p->len = (uint32_t)(e.lba + e.len - p->lba);
+			continue;
+		}
+		m->ext[out++] = e;
+		last[e.kind] = out;
+	}
+	m->num = m->sorted = out;
+}
+
+void badmap_compact(struct badmap *m)
+{
+	pthread_mutex_lock(&m->mutex);
+	compact_locked(m);
+	pthread_mutex_unlock(&m->mutex);
+}
+
+static int
+add_locked(struct badmap *m, int64_t lba, uint32_t len, int kind)
+{
+	struct badmap_ext *p = m->num ? m->ext + m->num - 1 : NULL;
+
+	if (p && (p->kind == (uint32_t)kind) && (p->lba <= lba) &&
+	    (lba <= p->lba + p->len) && (lba + len - p->lba <= UINT32_MAX))
+	{
+		if (lba + len > p->lba + p->len)
+			p->len = (uint32_t)(lba + len - p->lba);
+		return 0;
+	}
+	if (m->num == m->cap)
+	{
+		compact_locked(m);
+		if (m->num >= m->cap / 2)
+		{
+			size_t cap = m->cap ? 2 * m->cap : 256;
+
+			p = (struct badmap_ext *)realloc(m->ext, cap * sizeof(*p));
+			if (NULL == p)
+				return -1;
+			m->ext = p;
+			m->cap = cap;
+		}
+	}
+	m->ext[m->num].lba = lba;
+	m->ext[m->num].len = len;
+	m->ext[m->num++].kind = kind;
+	return 0;
+}
+
+int badmap_add(struct badmap *m, int64_t lba, int64_t len, int kind)
+{
+	int res = 0;
+
+	if ((kind < BADMAP_BAD) || (kind > BADMAP_MISMATCH))
+		return -1;
+	pthread_mutex_lock(&m->mutex);
+	while ((len > 0) && (0 == res))
+	{
+		uint32_t n = (len > UINT32_MAX) ? UINT32_MAX : (uint32_t)len;
+
+		res = add_locked(m, lba, n, kind);
+		lba += n;
+		len -= n;
+	}
+	pthread_mutex_unlock(&m->mutex);
+	return res;
+}
+
+static void
+put_le(FILE *fp, uint64_t v, int bytes)
+{
+	while (bytes-- > 0)
+	{
+		fputc((int)(v & 0xff), fp);
+		v >>= 8;
+	}
+}
+
+static void
+put_varint(FILE *fp, uint64_t v)
+{
+	while (v >= 0x80)
+	{
+		fputc((int)(v & 0x7f) | 0x80, fp);
+		v >>= 7;
+	}
+	fputc((int)v, fp);
+}
+
+int badmap_save(FILE *fp, const char *name, int blk_sz, int64_t num_sect,
+		struct badmap *m)
+{
+	size_t k, name_len = strlen(name);
+	int64_t prev = 0;
+
+	pthread_mutex_lock(&m->mutex);
+	compact_locked(m);
+	fwrite(badmap_magic, 1, sizeof(badmap_magic), fp);
+	fputc(BADMAP_VERSION, fp);
+	put_le(fp, blk_sz, 4);
+	put_le(fp, name_len, 4);
+	put_le(fp, num_sect, 8);
+	put_le(fp, m->num, 8);
+	fwrite(name, 1, name_len, fp);
+	for (k = 0; k < m->num; ++k)
+	{
+		const struct badmap_ext *e = m->ext + k;
+
+		put_varint(fp, e->lba - prev);
+		put_varint(fp, ((uint64_t)(e->len - 1) << 2) | e->kind);
+		prev = e->lba;
+	}
+	pthread_mutex_unlock(&m->mutex);
+	return ferror(fp) ? -1 : 0;
+}
+
+const char *badmap_kind_str(int kind)
+{
+	switch (kind)
+	{
+	case BADMAP_BAD:
+		return "bad";
+	case BADMAP_WEAK:
+		return "weak";
+	case BADMAP_MISMATCH:
+		return "mismatch";
+	}
+	return "?";
+}
+
+void badmap_text(FILE *fp, const char *name, struct badmap *m)
+{
+	size_t k;
+
+	pthread_mutex_lock(&m->mutex);
+	compact_locked(m);
+	for (k = 0; k < m->num; ++k)
+	{
+		const struct badmap_ext *e = m->ext + k;
+
+		fprintf(fp, "%s\t%s\t%lld\t%lld\t%u\n", name,
+			badmap_kind_str(e->kind), (long long)e->lba,
+			(long long)(e->lba + e->len - 1), e->len);
+	}
+	pthread_mutex_unlock(&m->mutex);
+}
+
+static int
+get_le(FILE *fp, uint64_t *v, int bytes)
+{
+	int k, c;
+
+	*v = 0;
+	for (k = 0; k < bytes; ++k)
+	{
+		c = fgetc(fp);
+		if (EOF == c)
+			return -1;
+		*v |= (uint64_t)c << (8 * k);
+	}
+	return 0;
+}
+
+static int
+get_varint(FILE *fp, uint64_t *v)
+{
+	int c, shift = 0;
+
+	*v = 0;
+	do
+	{
+		c = fgetc(fp);
+		if ((EOF == c) || (shift > 63))
+			return -1;
+		*v |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return 0;
+}
+
+// Reads one record, into m when it is not NULL. Returns 0, 1 at the
+// end of the file, -1 when the file is not a map
+static int
+read_record(FILE *fp, char *name, size_t name_sz, struct badmap *m)
+{
+	char magic[sizeof(badmap_magic)];
+	uint64_t blk_sz, name_len, num_sect, count, gap, v, k;
+	int64_t lba = 0;
+
+	if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic))
+		return feof(fp) ? 1 : -1;
+	if (memcmp(magic, badmap_magic, sizeof(magic)) ||
+	    (BADMAP_VERSION != fgetc(fp)))
+		return -1;
+	if (get_le(fp, &blk_sz, 4) || get_le(fp, &name_len, 4) ||
+	    get_le(fp, &num_sect, 8) || get_le(fp, &count, 8) ||
+	    (name_len >= name_sz) ||
+	    (fread(name, 1, name_len, fp) != name_len))
+		return -1;
+	name[name_len] = '\0';
+	for (k = 0; k < count; ++k)
+	{
+		if (get_varint(fp, &gap) || get_varint(fp, &v))
+			return -1;
+		lba += (int64_t)gap;
+		if (m && badmap_add(m, lba, (int64_t)(v >> 2) + 1, (int)(v & 3)))
+			return -1;
+	}
+	return 0;
+}
+
+int badmap_load(const char *path, const char *name, struct badmap *m)
+{
+	char rname[4096];
+	long at = -1, first = 0, pos;
+	int res, records = 0;
+	FILE *fp = fopen(path, "rb");
+
+	if (NULL == fp)
+		return -1;
+	for (;;)
+	{
+		pos = ftell(fp);
+		res = read_record(fp, rname, sizeof(rname), NULL);
+		if (res)
+			break;
+		if (0 == records++)
+			first = pos;
+		if (0 == strcmp(rname, name))
+		{
+			at = pos;
+			break;
+		}
+	}
+	if (res < 0)
+	{
+		fclose(fp);
+		return -1;
+	}
+	if ((at < 0) && (1 == records))
+		at = first; // a renamed device, /dev/sdb run before as /dev/sdc
+	if (at < 0)
+	{
+		fclose(fp);
+		return 1;
+	}
+	fseek(fp, at, SEEK_SET);
+	res = read_record(fp, rname, sizeof(rname), m);
+	fclose(fp);
+	if (0 == res)
+		badmap_compact(m);
+	return res ? -1 : 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * badmap.h
+ *
+ *  The bad, weak and miscompared blocks of a device as a sorted list of
+ *  extents, runs of one kind merged, so a dying disk with millions of
+ *  bad sectors in runs stays small. Maps are saved to a binary file a
+ *  later run reads back (--retest) to read only those extents again,
+ *  and can be exported as text.
+ *
+ *  File format, one record per device, integers little endian:
+ *    "DSKBADM" and a version byte (1)
+ *    u32 block size, u32 name length, u64 blocks of the device,
+ *    u64 number of extents, the device name (no NUL), then per extent
+ *    two LEB128 varints: lba less the lba of the previous extent (of
+ *    0 for the first) and ((len - 1) << 2 | kind). Extents are sorted
+ *    by lba; those of different kinds may overlap.
+ */
+
+#ifndef BADMAP_H_
+#define BADMAP_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#define BADMAP_VERSION 1
+
+#define BADMAP_BAD 1      // unrecovered read error
+#define BADMAP_WEAK 2     // READ slower than --slow
+#define BADMAP_MISMATCH 3 // data read was not the pattern
+
+struct badmap_ext
+{
+	int64_t lba;
+	uint32_t len;
+	uint32_t kind; // BADMAP_*
+};
+
+struct badmap
+{
+	struct badmap_ext *ext;
+	size_t num;
+	size_t cap;
+	size_t sorted; // ext[0, sorted) is sorted and merged
+	pthread_mutex_t mutex;
+};
+
+void badmap_init(struct badmap *m);
+void badmap_free(struct badmap *m);
+// Safe from several threads at once. Returns 0, -1 when out of memory
+int badmap_add(struct badmap *m, int64_t lba, int64_t len, int kind);
+// Sorts and merges; the extents are then m->ext[0, m->num)
+void badmap_compact(struct badmap *m);
+// Appends a record. Returns 0, -1 on a write error
+int badmap_save(FILE *fp, const char *name, int blk_sz, int64_t num_sect,
+		struct badmap *m);
+// Lines of "device kind first_lba last_lba blocks", tab separated
+void badmap_text(FILE *fp, const char *name, struct badmap *m);
+// The record of name in path, or its only record when it has one.
+// Returns 0, 1 when there is no record for name, -1 on errors
+int badmap_load(const char *path, const char *name, struct badmap *m);
+const char *badmap_kind_str(int kind);
+
+#endif /* BADMAP_H_ */
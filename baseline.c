@@ -0,0 +1,169 @@
+/*
+ * baseline.c
+ *
+ *  A baseline line is parsed whole into a struct baseline; adding a
+ *  drive is a Welford step on each statistic. The file is small, a
+ *  line per model, so an update rewrites all of it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+
+#include "baseline.h"
+
+#define BASELINE_LINE 8192
+
+// Splits a line into its key (first three fields) and baseline
+static int
+parse_line(char *line, struct baseline *b)
+{
+	char *cp = line, *ep;
+	double *v[2 + 2 * BASELINE_ZONES];
+	int k, nv;
+
+	for (k = 0; k < 3; ++k)
+	{
+		cp = strchr(cp, '\t');
+		if (NULL == cp)
+			return -1;
+		++cp;
+	}
+	cp[-1] = '\0';
+	memset(b, 0, sizeof(*b));
+	b->n = (int)strtol(cp, &ep, 10);
+	b->nz = (int)strtol(ep, &ep, 10);
+	if ((b->n < 1) || (b->nz < 1) || (b->nz > BASELINE_ZONES))
+		return -1;
+	v[0] = b->p50;
+	v[1] = b->p99;
+	for (k = 0; k < b->nz; ++k)
+		v[2 + k] = b->zone[k];
+	for (k = 0, nv = 2 + b->nz; k < 2 * nv; ++k)
+	{
+		cp = ep;
+		v[k / 2][k % 2] = strtod(cp, &ep);
+		if (ep == cp)
+			return -1;
+	}
+	return 0;
+}
+
+int baseline_load(const char *path, const char *key, struct baseline *b)
+{
+	char line[BASELINE_LINE];
+	FILE *fp = fopen(path, "r");
+	int res = -1;
+
+	if (NULL == fp)
+		return -1;
+	while (fgets(line, sizeof(line), fp))
+	{
+		struct baseline t;
+
+		line[strcspn(line, "\n")] = '\0';
+		if ((0 == parse_line(line, &t)) && (0 == strcmp(line, key)))
+		{
+			*b = t;
+			res = 0;
+		}
+	}
+	fclose(fp);
+	return res;
+}
+
+static void
+welford(double st[2], int n, double x)
+{
+	double d = x - st[0];
+
+	st[0] += d / n;
+	st[1] += d * (x - st[0]);
+}
+
+static void
+put_line(FILE *fp, const char *key, const struct baseline *b)
+{
+	int k;
+
+	fprintf(fp, "%s\t%d\t%d\t%.6g\t%.6g\t%.6g\t%.6g", key, b->n, b->nz,
+		b->p50[0], b->p50[1], b->p99[0], b->p99[1]);
+	for (k = 0; k < b->nz; ++k)
+		fprintf(fp, "\t%.6g\t%.6g", b->zone[k][0], b->zone[k][1]);
+	fputc('\n', fp);
+}
+
+int baseline_add(const char *path, const char *key, int nz, const double *mbps,
+		 double p50_us, double p99_us)
+{
+	char line[BASELINE_LINE], copy[BASELINE_LINE], tmp[4096];
+	struct baseline b, t;
+	FILE *in, *out;
+	int lfd, k, res = 0;
+
+	if ((nz < 1) || (nz > BASELINE_ZONES))
+		return -1;
+	snprintf(tmp, sizeof(tmp), "%s.lock", path);
+	lfd = open(tmp, O_RDWR | O_CREAT, 0644);
+	if ((lfd < 0) || flock(lfd, LOCK_EX))
+	{
+		if (lfd >= 0)
+			close(lfd);
+		return -1;
+	}
+	memset(&b, 0, sizeof(b));
+	if (0 == baseline_load(path, key, &b) && (b.nz != nz))
+	{
+		close(lfd);
+		return -1;
+	}
+	b.nz = nz;
+	++b.n;
+	welford(b.p50, b.n, p50_us);
+	welford(b.p99, b.n, p99_us);
+	for (k = 0; k < nz; ++k)
+		welford(b.zone[k], b.n, mbps[k]);
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	out = fopen(tmp, "w");
+	if (NULL == out)
+	{
+		close(lfd);
+		return -1;
+	}
+	in = fopen(path, "r");
+	if (in)
+	{
+		while (fgets(line, sizeof(line), in))
+		{
+			memcpy(copy, line, sizeof(copy));
+			copy[strcspn(copy, "\n")] = '\0';
+			if ((0 == parse_line(copy, &t)) && strcmp(copy, key))
+				fputs(line, out);
+		}
+		fclose(in);
+	}
+	put_line(out, key, &b);
+	if (fclose(out) || rename(tmp, path))
+	{
+		unlink(tmp);
+		res = -1;
+	}
+	close(lfd);
+	return res;
+}
+
+double baseline_sigmas(const double st[2], int n, double x, double floor)
+{
+	double sd;
+
+	if (n < 2)
+		return 0.0;
+	sd = sqrt(st[1] / (n - 1));
+	if (sd < floor * fabs(st[0]))
+		sd = floor * fabs(st[0]);
+	return (sd > 0) ? (x - st[0]) / sd : 0.0;
+}
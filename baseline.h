@@ -0,0 +1,43 @@
+/*
+ * baseline.h
+ *
+ *  Fleet baselines: per drive model and firmware, the mean and spread
+ *  of the throughput of each zone of a full scan and of the p50 and p99
+ *  READ latency, over the drives that passed so far. A drive is held
+ *  against the baseline of its model, then added to it, so the first
+ *  drives of a model build it and the later ones are judged.
+ *
+ *  File format, one line per model, fields tab separated: the profile
+ *  key (vendor, product, revision), the number of drives, the number of
+ *  zones, then mean and M2 (sum of squared deviations, as Welford's
+ *  method keeps it) of p50 us, of p99 us and of the MB/s of each zone.
+ *  Updates rewrite the file through a temporary and rename(), under an
+ *  exclusive flock() of path.lock, as the profile cache does.
+ */
+
+#ifndef BASELINE_H_
+#define BASELINE_H_
+
+#define BASELINE_ZONES 64 // most zones a baseline has
+
+struct baseline
+{
+	int n;	// drives
+	int nz; // zones
+	double p50[2]; // mean, M2
+	double p99[2];
+	double zone[BASELINE_ZONES][2];
+};
+
+// The baseline of key in path. Returns 0, -1 when missing or on error
+int baseline_load(const char *path, const char *key, struct baseline *b);
+// Adds a drive of nz zones to the baseline of key. Returns 0, -1 on
+// error, of a baseline of other zones too
+int baseline_add(const char *path, const char *key, int nz, const double *mbps,
+		 double p50_us, double p99_us);
+// How many standard deviations x is from the mean of st over n drives,
+// the deviation at least floor times the mean so drives all alike do
+// not flag noise. 0 with fewer than 2 drives
+double baseline_sigmas(const double st[2], int n, double x, double floor);
+
+#endif /* BASELINE_H_ */
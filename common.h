@@ -13,8 +13,157 @@ typedef unsigned char      BYTE;    // Byte is a char
 typedef unsigned short	   word16;  // 16-bit word is a short int
 typedef unsigned int       word32;  // 32-bit word is an int
 
-unsigned int crc32(unsigned int crc, const void *buf, int size);
-unsigned short checksum(unsigned char *addr, unsigned int count);
 unsigned int xor128(void);
 
+//----- CPU features ----------------------------------------------------------
+#define ISA_SSE2 0x0001
+#define ISA_SSE41 0x0002
+#define ISA_SSE42 0x0004
+#define ISA_PCLMUL 0x0008
+#define ISA_AVX2 0x0010
+#define ISA_AVX512F 0x0020
+#define ISA_AVX512BW 0x0040
+#define ISA_NEON 0x0100
+#define ISA_CRC32 0x0200 // ARMv8 CRC32 instructions
+
+// The ISA_* the kernels may use: those of the CPU, probed once, less any
+// that cpu_force_isa() took away.
+unsigned int cpu_isa(void);
+// Caps the kernels at level name: scalar, sse2, sse4.2, avx2, avx512,
+// neon, armv8-crc or native (all the CPU has). Before cpu_dispatch() and
+// the first kernel call. Returns 0, 1 when the CPU lacks some of the
+// level (it gets what it has of it), -1 for an unknown name
+int cpu_force_isa(const char *name);
+// The best level all of whose ISA_* are in cpu_isa()
+const char *cpu_isa_name(void);
+// Binds every kernel now rather than on its first call
+void cpu_dispatch(void);
+
+//----- Pattern check ---------------------------------------------------------
+#include <stddef.h>
+
+#define PATTERN_WORD_SZ 64 // one cache line, the widest vector compared
+
+// Returns the offset of the first byte of buf that differs from the
+// pattern word repeated, or len if the whole buffer matches.
+size_t pattern_check(const BYTE *buf, size_t len, const BYTE *pat);
+const char *pattern_check_isa(void);
+// The byte every byte of buf is when it is all 0x00 or all 0xff, what
+// sanitized and unmapped blocks read as, else -1; one vector pass that
+// stops at the first byte that is neither.
+int buf_uniform(const BYTE *buf, size_t len);
+
+//----- Buffer compare --------------------------------------------------------
+// Returns the offset of the first byte where a and b differ, or len if
+// they are the same.
+size_t buf_compare(const BYTE *a, const BYTE *b, size_t len);
+
+//----- Streaming checks ------------------------------------------------------
+// pattern_check() and buf_compare() for data read once: the lines ahead
+// are prefetched non-temporally so the check does not evict the rest of
+// the last level cache.
+size_t pattern_check_stream(const BYTE *buf, size_t len, const BYTE *pat);
+size_t buf_compare_stream(const BYTE *a, const BYTE *b, size_t len);
+// The distance ahead they prefetch, bytes, rounded up to a cache line; 0
+// for the default. Before the first check
+void stream_prefetch_set(size_t dist);
+size_t stream_prefetch_dist(void);
+
+//----- Bit flips -------------------------------------------------------------
+#include <stdint.h>
+
+// Bits of got that are 1 where exp has 0 into *up, those 0 where exp has
+// 1 into *down.
+void bit_flips(const BYTE *got, const BYTE *exp, size_t len, uint64_t *up,
+	       uint64_t *down);
+
+//----- CRC32, CRC32C ---------------------------------------------------------
+#include <stdint.h>
+
+// crc32() is the CRC of zlib, crc32c() the Castagnoli one of iSCSI; 0 to
+// start, else the CRC of what came before. Hardware kernels when the CPU
+// has them
+unsigned int crc32(unsigned int crc, const void *buf, int size);
+unsigned int crc32c(unsigned int crc, const void *buf, size_t size);
+// The CRC of a then b from those of a (crc1) and of b, len2 bytes. So
+// chunks hashed in any order, on any thread, make the CRC of them all
+unsigned int crc32_combine(unsigned int crc1, unsigned int crc2,
+			   uint64_t len2);
+unsigned int crc32c_combine(unsigned int crc1, unsigned int crc2,
+			    uint64_t len2);
+// CRC16 T10-DIF, the guard of SCSI protection information; 0 to start,
+// else that of what came before. PCLMULQDQ when the CPU has it
+uint16_t crc16_t10dif(uint16_t crc, const void *buf, size_t size);
+// CRC-64/NVME, the guard of the NVMe 64b guard formats; carried on as
+// crc32() is
+uint64_t crc64_nvme(uint64_t crc, const void *buf, size_t size);
+
+//----- Internet checksum -----------------------------------------------------
+// Of RFC 1071, over the words in host order: stored as is it sums to 0
+word16 checksum(const BYTE *addr, unsigned int count);
+
+// checksum() fed piece by piece, of any lengths
+struct csum
+{
+	uint64_t sum; // not folded
+	uint64_t len; // bytes so far, whether the next is the second of a word
+};
+
+// Adds the len bytes at buf to st, zeroed to start
+void checksum_update(struct csum *st, const void *buf, size_t len);
+word16 checksum_final(const struct csum *st);
+
+//----- XXH3-128 --------------------------------------------------------------
+// The 128 bit hash of xxHash, streamed. The digest is XXH3_128bits() of
+// all that was fed, as xxhsum -H2 has it
+struct xxh3
+{
+	uint64_t acc[8];
+	uint64_t total;      // bytes fed
+	size_t stripes;      // folded since the last scramble
+	size_t nbuf;         // bytes in buf, 1 to 64 once more than 240 came
+	unsigned char buf[64];
+	unsigned char last[64]; // the last stripe folded
+	unsigned char head[240]; // all that came, up to 240 bytes
+};
+
+void xxh3_init(struct xxh3 *st);
+void xxh3_update(struct xxh3 *st, const void *buf, size_t len);
+// hash[0] is the low half, hash[1] the high one
+void xxh3_final(const struct xxh3 *st, uint64_t hash[2]);
+// All of them at once
+void xxh3_128(const void *buf, size_t len, uint64_t hash[2]);
+
+//----- Random pattern --------------------------------------------------------
+// The expected content of any block depends only on (seed, pass, lba)
+uint64_t rand_pattern_key(uint64_t seed, unsigned int pass);
+void rand_pattern_fill(BYTE *buf, size_t blk_sz, int blocks, uint64_t key,
+		       uint64_t lba);
+// Returns the offset of the first byte that differs, or blocks * blk_sz
+size_t rand_pattern_check(const BYTE *buf, size_t blk_sz, int blocks,
+			  uint64_t key, uint64_t lba);
+
+//----- LBA stamped pattern ---------------------------------------------------
+// A block of the random pattern of key whose first STAMP_HDR_SZ bytes are
+// the stamp, little endian: u32 STAMP_MAGIC, u32 pass, u64 lba, u64 run
+// and a u64 hash of them
+#define STAMP_MAGIC 0x504d5453U // "STMP"
+#define STAMP_HDR_SZ 32
+
+struct stamp
+{
+	unsigned int pass;
+	uint64_t lba;
+	uint64_t run;
+};
+
+void stamp_pattern_fill(BYTE *buf, size_t blk_sz, int blocks, uint64_t key,
+			uint64_t run, unsigned int pass, uint64_t lba);
+// Returns the offset of the first byte that differs, or blocks * blk_sz
+size_t stamp_pattern_check(const BYTE *buf, size_t blk_sz, int blocks,
+			   uint64_t key, uint64_t run, unsigned int pass,
+			   uint64_t lba);
+// The stamp of the block at blk into st. Returns 0, -1 when it has none
+int stamp_decode(const BYTE *blk, struct stamp *st);
+
 #endif /* COMMON_H_ */
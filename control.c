@@ -0,0 +1,229 @@
+/*
+ * control.c
+ *
+ *  The thread polls the listening socket, its clients and a pipe that
+ *  wakes it to stop. Input is gathered per client until a newline; the
+ *  reply of a command is rendered into memory and sent whole, blocking,
+ *  as replies are small and clients few.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "control.h"
+
+#define CONTROL_CLIENTS 8 // at once, more wait in the backlog
+#define CONTROL_LINE 1024 // longest command
+
+struct client
+{
+	int fd; // -1 -> free
+	size_t len;
+	char buf[CONTROL_LINE];
+};
+
+static int lfd = -1;
+static char *cpath;
+static control_fn cfn;
+static pthread_t ctid;
+static int cpipe[2] = {-1, -1};
+static struct client clients[CONTROL_CLIENTS];
+
+static int
+send_all(int fd, const char *buf, size_t len)
+{
+	ssize_t res;
+	size_t off;
+
+	for (off = 0; off < len; off += res)
+	{
+		res = send(fd, buf + off, len - off, MSG_NOSIGNAL);
+		if ((res < 0) && (EINTR == errno))
+			res = 0;
+		else if (res <= 0)
+			return -1;
+	}
+	return 0;
+}
+
+// Runs the command in c->buf[0, n). Returns 0, -1 when the client went
+static int
+run_one(struct client *c, size_t n)
+{
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *fp;
+	int res;
+
+	c->buf[n] = '\0';
+	if (n && ('\r' == c->buf[n - 1]))
+		c->buf[n - 1] = '\0';
+	fp = open_memstream(&buf, &len);
+	if (NULL == fp)
+		return 0;
+	cfn(c->buf, fp);
+	fclose(fp);
+	res = send_all(c->fd, buf, len);
+	free(buf);
+	return res;
+}
+
+// Reads what c sent and runs the lines it completes. Returns 0, -1 when
+// it is to be closed
+static int
+client_read(struct client *c)
+{
+	ssize_t res;
+	char *nl;
+	size_t n;
+
+	res = recv(c->fd, c->buf + c->len, sizeof(c->buf) - 1 - c->len, 0);
+	if ((res < 0) && (EINTR == errno))
+		return 0;
+	if (res <= 0)
+		return -1;
+	c->len += res;
+	while ((nl = (char *)memchr(c->buf, '\n', c->len)))
+	{
+		n = nl - c->buf;
+		if (run_one(c, n))
+			return -1;
+		c->len -= n + 1;
+		memmove(c->buf, nl + 1, c->len);
+	}
+	if (c->len == sizeof(c->buf) - 1)
+		return -1; // a line longer than any command
+	return 0;
+}
+
+static void *
+control_thread(void *arg)
+{
+	struct pollfd pfd[2 + CONTROL_CLIENTS];
+	int map[2 + CONTROL_CLIENTS];
+	int k, n, res, cfd;
+
+	(void)arg;
+	for (;;)
+	{
+		pfd[0].fd = cpipe[0];
+		pfd[0].events = POLLIN;
+		pfd[1].fd = lfd;
+		pfd[1].events = POLLIN;
+		n = 2;
+		for (k = 0; k < CONTROL_CLIENTS; ++k)
+			if (clients[k].fd >= 0)
+			{
+				pfd[n].fd = clients[k].fd;
+				pfd[n].events = POLLIN;
+				map[n++] = k;
+			}
+		if (n == 2 + CONTROL_CLIENTS)
+			pfd[1].events = 0; // full: new ones wait
+		res = poll(pfd, n, -1);
+		if ((res < 0) && (EINTR != errno))
+			break;
+		if (res <= 0)
+			continue;
+		if (pfd[0].revents)
+			break;
+		for (k = 2; k < n; ++k)
+			if (pfd[k].revents && client_read(clients + map[k]))
+			{
+				close(clients[map[k]].fd);
+				clients[map[k]].fd = -1;
+			}
+		if (pfd[1].revents & POLLIN)
+		{
+			cfd = accept(lfd, NULL, NULL);
+			for (k = 0; (cfd >= 0) && (k < CONTROL_CLIENTS); ++k)
+				if (clients[k].fd < 0)
+				{
+					clients[k].fd = cfd;
+					clients[k].len = 0;
+					cfd = -1;
+				}
+			if (cfd >= 0)
+				close(cfd);
+		}
+	}
+	return NULL;
+}
+
+int control_start(const char *path, control_fn fn)
+{
+	struct sockaddr_un sa;
+	struct stat st;
+	int k;
+
+	if (strlen(path) >= sizeof(sa.sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	cfn = fn;
+	for (k = 0; k < CONTROL_CLIENTS; ++k)
+		clients[k].fd = -1;
+	// one a run before left behind, never a file of another kind
+	if ((0 == lstat(path, &st)) && S_ISSOCK(st.st_mode))
+		unlink(path);
+	lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (lfd < 0)
+		return -1;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+	if (bind(lfd, (struct sockaddr *)&sa, sizeof(sa)))
+		goto err;
+	cpath = strdup(path);
+	if ((NULL == cpath) || listen(lfd, 8) || pipe(cpipe))
+		goto err_unlink;
+	if (pthread_create(&ctid, NULL, control_thread, NULL))
+	{
+		close(cpipe[0]);
+		close(cpipe[1]);
+		cpipe[0] = cpipe[1] = -1;
+		goto err_unlink;
+	}
+	return 0;
+err_unlink:
+	unlink(path);
+	free(cpath);
+	cpath = NULL;
+err:
+	close(lfd);
+	lfd = -1;
+	return -1;
+}
+
+void control_stop(void)
+{
+	int k;
+
+	if (cpipe[1] < 0)
+		return;
+	if (write(cpipe[1], "x", 1) == 1)
+		pthread_join(ctid, NULL);
+	close(cpipe[0]);
+	close(cpipe[1]);
+	cpipe[0] = cpipe[1] = -1;
+	for (k = 0; k < CONTROL_CLIENTS; ++k)
+		if (clients[k].fd >= 0)
+		{
+			close(clients[k].fd);
+			clients[k].fd = -1;
+		}
+	close(lfd);
+	lfd = -1;
+	unlink(cpath);
+	free(cpath);
+	cpath = NULL;
+}
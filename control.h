@@ -0,0 +1,27 @@
+/*
+ * control.h
+ *
+ *  The control socket: a Unix stream socket taking commands a line at
+ *  a time from any number of clients, each answered before the next is
+ *  read, on one thread of its own. Commands only set state the engines
+ *  look at before every READ, so a run is paused or retuned where it
+ *  is, no signal handler involved. "socat - UNIX-CONNECT:path" is a
+ *  client, as is "echo pause | nc -U path".
+ */
+
+#ifndef CONTROL_H_
+#define CONTROL_H_
+
+#include <stdio.h>
+
+// Handles one command line, without its newline, writing the reply to
+// out
+typedef void (*control_fn)(const char *cmd, FILE *out);
+
+// Listens on path, replacing a socket left there. Returns 0, -1 with
+// errno set
+int control_start(const char *path, control_fn fn);
+// Stops the thread and removes the socket
+void control_stop(void);
+
+#endif /* CONTROL_H_ */
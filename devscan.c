@@ -0,0 +1,411 @@
+/*
+ * devscan.c
+ *
+ *  Disks in use are found by walking from the block device of each
+ *  mounted filesystem and swap area to the disk under it: up from a
+ *  partition, and down the slaves of device-mapper and md devices.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "devscan.h"
+
+#define MAX_IN_USE 64
+
+static char in_use[MAX_IN_USE][32];
+static int num_in_use;
+
+// The first line of a sysfs attribute, without trailing blanks
+static void
+read_attr(const char *path, char *buf, size_t len)
+{
+	FILE *fp = fopen(path, "r");
+	size_t n;
+
+	buf[0] = '\0';
+	if (NULL == fp)
+		return;
+	if (NULL == fgets(buf, (int)len, fp))
+		buf[0] = '\0';
+	fclose(fp);
+	n = strlen(buf);
+	while ((n > 0) && ((unsigned char)buf[n - 1] <= ' '))
+		buf[--n] = '\0';
+}
+
+static int64_t
+block_bytes(const char *disk)
+{
+	char path[PATH_MAX], buf[32];
+
+	snprintf(path, sizeof(path), "/sys/block/%s/size", disk);
+	read_attr(path, buf, sizeof(buf));
+	return buf[0] ? strtoll(buf, NULL, 10) * 512 : -1;
+}
+
+const char *devscan_transport(const char *real)
+{
+	if (NULL == real)
+		return "other";
+	if (strstr(real, "/end_device-"))
+		return "sas";
+	if (strstr(real, "/rport-"))
+		return "fc";
+	if (strstr(real, "/session"))
+		return "iscsi";
+	if (strstr(real, "/usb"))
+		return "usb";
+	if (strstr(real, "/ata"))
+		return "ata";
+	if (strstr(real, "/nvme/"))
+		return "nvme";
+	if (strstr(real, "/virtual/"))
+		return "virtual";
+	return strstr(real, "/host") ? "scsi" : "other";
+}
+
+// Notes the disk under the block device at /sys/block/.../name
+static void
+mark_in_use(const char *sysdir, int depth)
+{
+	char path[PATH_MAX], real[PATH_MAX], *cp;
+	struct dirent *de;
+	DIR *dp;
+	int k;
+
+	if ((depth > 8) || (NULL == realpath(sysdir, real)))
+		return;
+	snprintf(path, sizeof(path), "%s/partition", real);
+	if (0 == access(path, F_OK))
+	{
+		cp = strrchr(real, '/');
+		if (cp)
+			*cp = '\0'; // the disk of the partition
+	}
+	snprintf(path, sizeof(path), "%s/slaves", real);
+	dp = opendir(path);
+	if (dp)
+	{
+		int slaves = 0;
+
+		while ((de = readdir(dp)))
+		{
+			if ('.' == de->d_name[0])
+				continue;
+			snprintf(path, sizeof(path), "%s/slaves/%s", real,
+				 de->d_name);
+			mark_in_use(path, depth + 1);
+			++slaves;
+		}
+		closedir(dp);
+		if (slaves)
+			return;
+	}
+	cp = strrchr(real, '/');
+	if ((NULL == cp) || (num_in_use >= MAX_IN_USE))
+		return;
+	for (k = 0; k < num_in_use; ++k)
+		if (0 == strcmp(in_use[k], cp + 1))
+			return;
+	snprintf(in_use[num_in_use++], sizeof(in_use[0]), "%s", cp + 1);
+}
+
+static void
+mark_dev(const char *dev)
+{
+	char path[64];
+	struct stat st;
+
+	if (stat(dev, &st) || !S_ISBLK(st.st_mode))
+		return;
+	snprintf(path, sizeof(path), "/sys/dev/block/%u:%u",
+		 major(st.st_rdev), minor(st.st_rdev));
+	mark_in_use(path, 0);
+}
+
+static void
+find_in_use(void)
+{
+	char line[1024], dev[512];
+	struct stat st;
+	FILE *fp;
+
+	num_in_use = 0;
+	// "/" by its st_dev, which also covers a root not named in mounts
+	if (0 == stat("/", &st))
+	{
+		snprintf(line, sizeof(line), "/sys/dev/block/%u:%u",
+			 major(st.st_dev), minor(st.st_dev));
+		mark_in_use(line, 0);
+	}
+	fp = fopen("/proc/mounts", "r");
+	if (fp)
+	{
+		while (fgets(line, sizeof(line), fp))
+			if ((1 == sscanf(line, "%511s", dev)) && ('/' == dev[0]))
+				mark_dev(dev);
+		fclose(fp);
+	}
+	fp = fopen("/proc/swaps", "r");
+	if (fp)
+	{
+		while (fgets(line, sizeof(line), fp))
+			if ((1 == sscanf(line, "%511s", dev)) && ('/' == dev[0]))
+				mark_dev(dev);
+		fclose(fp);
+	}
+}
+
+static int
+is_in_use(const char *disk)
+{
+	int k;
+
+	for (k = 0; disk[0] && (k < num_in_use); ++k)
+		if (0 == strcmp(in_use[k], disk))
+			return 1;
+	return 0;
+}
+
+static int
+add_ent(struct devscan_ent **entp, int *nump, int *capp,
+	const struct devscan_ent *e)
+{
+	if (*nump == *capp)
+	{
+		int cap = *capp ? 2 * *capp : 64;
+		struct devscan_ent *p = (struct devscan_ent *)
+			realloc(*entp, cap * sizeof(*p));
+
+		if (NULL == p)
+			return -1;
+		*entp = p;
+		*capp = cap;
+	}
+	(*entp)[(*nump)++] = *e;
+	return 0;
+}
+
+// The SCSI disks of class cls ("scsi_generic" or "bsg"), for their
+// /dev nodes under prefix; those of target ("h:c:t") only unless NULL
+static void
+scan_scsi(const char *cls, const char *prefix, const char *target,
+	  struct devscan_ent **entp, int *nump, int *capp)
+{
+	char dir[PATH_MAX], path[PATH_MAX], real[PATH_MAX], buf[16], *cp;
+	struct devscan_ent e;
+	struct dirent *de, *be;
+	DIR *dp, *bp;
+
+	snprintf(dir, sizeof(dir), "/sys/class/%s", cls);
+	dp = opendir(dir);
+	if (NULL == dp)
+		return;
+	while ((de = readdir(dp)))
+	{
+		if ('.' == de->d_name[0])
+			continue;
+		snprintf(path, sizeof(path), "%s/%s/device/type", dir,
+			 de->d_name);
+		read_attr(path, buf, sizeof(buf));
+		// direct access or host managed zoned block devices only
+		if (!buf[0] || ((0 != atoi(buf)) && (0x14 != atoi(buf))))
+			continue;
+		memset(&e, 0, sizeof(e));
+		snprintf(e.path, sizeof(e.path), "%s%s", prefix, de->d_name);
+		snprintf(path, sizeof(path), "%s/%s/device/vendor", dir,
+			 de->d_name);
+		read_attr(path, e.vendor, sizeof(e.vendor));
+		snprintf(path, sizeof(path), "%s/%s/device/model", dir,
+			 de->d_name);
+		read_attr(path, e.model, sizeof(e.model));
+		snprintf(path, sizeof(path), "%s/%s/device", dir, de->d_name);
+		if (NULL == realpath(path, real))
+			real[0] = '\0';
+		// the device is named h:c:t:l
+		cp = strrchr(real, '/');
+		cp = cp ? cp + 1 : real;
+		if (target && (strncmp(cp, target, strlen(target)) ||
+			       (':' != cp[strlen(target)])))
+			continue;
+		cp = strrchr(cp, ':');
+		e.lun = cp ? strtoull(cp + 1, NULL, 10) : 0;
+		snprintf(e.transport, sizeof(e.transport), "%s",
+			 devscan_transport(real[0] ? real : NULL));
+		snprintf(path, sizeof(path), "%s/%s/device/block", dir,
+			 de->d_name);
+		bp = opendir(path);
+		while (bp && (be = readdir(bp)))
+			if ('.' != be->d_name[0])
+			{
+				snprintf(e.disk, sizeof(e.disk), "%s",
+					 be->d_name);
+				break;
+			}
+		if (bp)
+			closedir(bp);
+		e.bytes = e.disk[0] ? block_bytes(e.disk) : -1;
+		e.in_use = is_in_use(e.disk);
+		if (add_ent(entp, nump, capp, &e))
+			break;
+	}
+	closedir(dp);
+}
+
+// The namespaces of controller ctrl ("nvme0") only unless NULL
+static void
+scan_nvme(const char *ctrl, struct devscan_ent **entp, int *nump, int *capp)
+{
+	char path[PATH_MAX], model[48];
+	struct devscan_ent e;
+	struct dirent *de, *ne;
+	DIR *dp, *np;
+
+	dp = opendir("/sys/class/nvme");
+	if (NULL == dp)
+		return;
+	while ((de = readdir(dp)))
+	{
+		if (('.' == de->d_name[0]) || (ctrl && strcmp(ctrl, de->d_name)))
+			continue;
+		snprintf(path, sizeof(path), "/sys/class/nvme/%s/model",
+			 de->d_name);
+		read_attr(path, model, sizeof(model));
+		snprintf(path, sizeof(path), "/sys/class/nvme/%s", de->d_name);
+		np = opendir(path);
+		while (np && (ne = readdir(np)))
+		{
+			// namespaces: nvme0n1, not nvme0c0n1 paths
+			if (strncmp(ne->d_name, de->d_name, strlen(de->d_name))
+			    || ('n' != ne->d_name[strlen(de->d_name)]))
+				continue;
+			memset(&e, 0, sizeof(e));
+			snprintf(e.disk, sizeof(e.disk), "%s", ne->d_name);
+			snprintf(e.path, sizeof(e.path), "/dev/ng%s",
+				 ne->d_name + 4);
+			if (access(e.path, F_OK))
+				snprintf(e.path, sizeof(e.path), "/dev/%s",
+					 ne->d_name);
+			snprintf(e.vendor, sizeof(e.vendor), "NVMe");
+			snprintf(e.model, sizeof(e.model), "%s", model);
+			snprintf(e.transport, sizeof(e.transport), "nvme");
+			e.bytes = block_bytes(e.disk);
+			e.in_use = is_in_use(e.disk);
+			e.lun = strtoull(ne->d_name + strlen(de->d_name) + 1,
+					 NULL, 10);
+			if (add_ent(entp, nump, capp, &e))
+				break;
+		}
+		if (np)
+			closedir(np);
+	}
+	closedir(dp);
+}
+
+static int
+ent_cmp(const void *a, const void *b)
+{
+	const struct devscan_ent *x = a, *y = b;
+	size_t lx = strlen(x->path), ly = strlen(y->path);
+
+	// sg2 before sg10
+	if (lx != ly)
+		return (lx < ly) ? -1 : 1;
+	return strcmp(x->path, y->path);
+}
+
+int devscan_all(struct devscan_ent **entp)
+{
+	int num = 0, cap = 0;
+	DIR *dp;
+
+	*entp = NULL;
+	find_in_use();
+	dp = opendir("/sys/class/scsi_generic");
+	if (dp)
+	{
+		closedir(dp);
+		scan_scsi("scsi_generic", "/dev/", NULL, entp, &num, &cap);
+	}
+	else
+		scan_scsi("bsg", "/dev/bsg/", NULL, entp, &num, &cap);
+	scan_nvme(NULL, entp, &num, &cap);
+	if ((0 == num) && access("/sys/class", F_OK))
+		return -1;
+	if (num > 1)
+		qsort(*entp, num, sizeof(**entp), ent_cmp);
+	return num;
+}
+
+// The sysfs device of the SCSI node path, its h:c:t:l in real
+static int
+scsi_hctl(const char *path, char *real)
+{
+	const char *name = strrchr(path, '/');
+	char sys[PATH_MAX];
+
+	name = name ? name + 1 : path;
+	if (0 == strncmp(path, "/dev/bsg/", 9))
+		snprintf(sys, sizeof(sys), "/sys/class/bsg/%s/device", name);
+	else if (0 == strncmp(name, "sg", 2))
+		snprintf(sys, sizeof(sys), "/sys/class/scsi_generic/%s/device",
+			 name);
+	else
+		snprintf(sys, sizeof(sys), "/sys/block/%s/device", name);
+	return realpath(sys, real) ? 0 : -1;
+}
+
+int devscan_fanout(const char *path, struct devscan_ent **entp, char *group,
+		   int glen)
+{
+	const char *name = strrchr(path, '/');
+	char real[PATH_MAX], *cp;
+	int num = 0, cap = 0, n;
+	DIR *dp;
+
+	*entp = NULL;
+	group[0] = '\0';
+	name = name ? name + 1 : path;
+	// nvme0, ng0n1 and nvme0n1 are of controller nvme0
+	if ((0 == strncmp(name, "nvme", 4)) || (0 == strncmp(name, "ng", 2)))
+	{
+		cp = (char *)name + (('g' == name[1]) ? 2 : 4);
+		n = (int)strspn(cp, "0123456789");
+		if ((0 == n) || (cp[n] && ('n' != cp[n])))
+			return 0;
+		snprintf(group, glen, "nvme%.*s", n, cp);
+		find_in_use();
+		scan_nvme(group, entp, &num, &cap);
+	}
+	else
+	{
+		if (scsi_hctl(path, real))
+			return access("/sys/class", F_OK) ? -1 : 0;
+		cp = strrchr(real, '/');
+		cp = cp ? cp + 1 : real;
+		n = (int)(strrchr(cp, ':') ? strrchr(cp, ':') - cp : 0);
+		if (0 == n)
+			return 0;
+		snprintf(group, glen, "%.*s", n, cp);
+		find_in_use();
+		dp = opendir("/sys/class/scsi_generic");
+		if (dp)
+		{
+			closedir(dp);
+			scan_scsi("scsi_generic", "/dev/", group, entp, &num,
+				  &cap);
+		}
+		else
+			scan_scsi("bsg", "/dev/bsg/", group, entp, &num, &cap);
+	}
+	if (num > 1)
+		qsort(*entp, num, sizeof(**entp), ent_cmp);
+	return num;
+}
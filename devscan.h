@@ -0,0 +1,44 @@
+/*
+ * devscan.h
+ *
+ *  Finding every disk of the system for --all from sysfs: SCSI disks
+ *  through their sg nodes (their bsg nodes when the sg driver is not
+ *  loaded) and NVMe namespaces through their generic char devices
+ *  (the block devices on older kernels). Disks that hold a mounted
+ *  filesystem or active swap, the boot and root disks among them, are
+ *  marked in use.
+ */
+
+#ifndef DEVSCAN_H_
+#define DEVSCAN_H_
+
+#include <stdint.h>
+
+struct devscan_ent
+{
+	char path[64];	    // /dev/sg3, /dev/ng0n1
+	char disk[32];	    // block device name, sdc, "" -> none
+	char vendor[16];
+	char model[48];
+	char transport[8];
+	int64_t bytes;	    // -1 -> unknown
+	int in_use;	    // holds a mounted filesystem or swap
+	uint64_t lun;	    // SCSI LUN, NVMe namespace id
+};
+
+// Sets *entp to a malloc()ed array sorted by path. Returns the number
+// of entries, -1 when sysfs could not be read
+int devscan_all(struct devscan_ent **entp);
+// The namespaces of the NVMe controller of path (/dev/nvme0, or any
+// of its namespaces), or the disk LUs of the SCSI target of path (an sg,
+// bsg or sd node of any of its LUNs), as devscan_all() has them, with
+// the controller or target in group ("nvme0", "2:0:1"). Returns the
+// number of entries, 0 when path is of neither, -1 when sysfs could not
+// be read
+int devscan_fanout(const char *path, struct devscan_ent **entp, char *group,
+		   int glen);
+// The transport of the device at sysfs path real: "sas", "ata", "fc",
+// "iscsi", "usb", "nvme", "virtual", "scsi" or "other"
+const char *devscan_transport(const char *real);
+
+#endif /* DEVSCAN_H_ */
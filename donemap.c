@@ -0,0 +1,317 @@
+/*
+ * donemap.c
+ *
+ *  A chunk is marked complete by the add that brings its count to its
+ *  length, its bit set with an atomic or; the add that fills a word of
+ *  a level sets the bit of the word in the level above, so a word is
+ *  set with each of its bits. The bits past the last chunk, and past
+ *  the last word of the level under, are set from the start. Reading
+ *  while others add sees a map a moment old: a word that is full
+ *  before its bit above is reads as not done yet, never the other way.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "donemap.h"
+
+static const char donemap_magic[7] = {'D', 'S', 'K', 'D', 'O', 'N', 'E'};
+
+static int64_t
+chunk_start(const struct donemap *m, int64_t i)
+{
+	return m->start + (i << m->shift);
+}
+
+static int64_t
+chunk_len(const struct donemap *m, int64_t i)
+{
+	int64_t lo = chunk_start(m, i), hi = lo + ((int64_t)1 << m->shift);
+
+	return ((hi < m->end) ? hi : m->end) - lo;
+}
+
+// The bits past what each level covers, set
+static void
+pad(struct donemap *m)
+{
+	int64_t n = m->chunks, k;
+	int l;
+
+	for (l = 0; l < DONEMAP_LEVELS; ++l)
+	{
+		for (k = n; k < m->words[l] * 64; ++k)
+			m->bits[l][k >> 6] |= 1ULL << (k & 63);
+		n = m->words[l];
+	}
+}
+
+int donemap_init(struct donemap *m, int64_t start, int64_t end)
+{
+	int64_t n;
+	int l;
+
+	memset(m, 0, sizeof(*m));
+	m->start = start;
+	m->end = (end > start) ? end : start;
+	while (((m->end - start) >> m->shift) >= DONEMAP_MAX_CHUNKS)
+		++m->shift;
+	m->chunks = (m->end - start + ((int64_t)1 << m->shift) - 1) >> m->shift;
+	m->cnt = (uint64_t *)calloc(m->chunks ? m->chunks : 1, sizeof(*m->cnt));
+	for (l = 0, n = m->chunks; l < DONEMAP_LEVELS; ++l)
+	{
+		n = (n + 63) / 64;
+		m->words[l] = n = n ? n : 1;
+		m->bits[l] = (uint64_t *)calloc(n, sizeof(uint64_t));
+		if (NULL == m->bits[l])
+			break;
+	}
+	if ((NULL == m->cnt) || (l < DONEMAP_LEVELS))
+	{
+		donemap_free(m);
+		return -1;
+	}
+	pad(m);
+	return 0;
+}
+
+void donemap_free(struct donemap *m)
+{
+	int l;
+
+	free(m->cnt);
+	m->cnt = NULL;
+	for (l = 0; l < DONEMAP_LEVELS; ++l)
+	{
+		free(m->bits[l]);
+		m->bits[l] = NULL;
+	}
+	m->chunks = 0;
+}
+
+void donemap_clear(struct donemap *m)
+{
+	int l;
+
+	if (NULL == m->cnt)
+		return;
+	memset(m->cnt, 0, m->chunks * sizeof(*m->cnt));
+	for (l = 0; l < DONEMAP_LEVELS; ++l)
+		memset(m->bits[l], 0, m->words[l] * sizeof(uint64_t));
+	pad(m);
+	__atomic_store_n(&m->blocks, 0, __ATOMIC_RELAXED);
+}
+
+// Chunk i complete, and the words it fills up the levels
+static void
+mark(struct donemap *m, int64_t i)
+{
+	uint64_t bit, old;
+	int l;
+
+	for (l = 0; l < DONEMAP_LEVELS; ++l)
+	{
+		bit = 1ULL << (i & 63);
+		old = __atomic_fetch_or(&m->bits[l][i >> 6], bit, __ATOMIC_ACQ_REL);
+		if ((old & bit) || (~(old | bit)))
+			return;
+		i >>= 6;
+	}
+}
+
+void donemap_add(struct donemap *m, int64_t lba, int64_t blocks)
+{
+	int64_t stop = lba + blocks, hi, i, n, len;
+	uint64_t old;
+
+	if (NULL == m->cnt)
+		return;
+	if (lba < m->start)
+		lba = m->start;
+	if (stop > m->end)
+		stop = m->end;
+	for (; lba < stop; lba = hi)
+	{
+		i = (lba - m->start) >> m->shift;
+		hi = chunk_start(m, i + 1);
+		if (hi > stop)
+			hi = stop;
+		n = hi - lba;
+		if (__atomic_load_n(&m->bits[0][i >> 6], __ATOMIC_RELAXED) >>
+			    (i & 63) & 1)
+			continue; // done already, a resumed pass
+		len = chunk_len(m, i);
+		old = __atomic_fetch_add(&m->cnt[i], (uint64_t)n, __ATOMIC_ACQ_REL);
+		if ((old < (uint64_t)len) && (old + n >= (uint64_t)len))
+			mark(m, i);
+		__atomic_fetch_add(&m->blocks, n, __ATOMIC_RELAXED);
+	}
+}
+
+int64_t donemap_low(const struct donemap *m)
+{
+	uint64_t w;
+	int64_t i = 0;
+	int l;
+
+	if (NULL == m->cnt)
+		return m->start;
+	for (l = DONEMAP_LEVELS - 1; l >= 0; --l)
+	{
+		w = __atomic_load_n(&m->bits[l][i], __ATOMIC_ACQUIRE);
+		if (~0ULL == w)
+		{
+			if (DONEMAP_LEVELS - 1 == l)
+				return m->end;
+			// filled as it was read: no lower than its first chunk
+			i <<= 6 * (l + 1);
+			return (i < m->chunks) ? chunk_start(m, i) : m->end;
+		}
+		i = i * 64 + __builtin_ctzll(~w);
+	}
+	return (i < m->chunks) ? chunk_start(m, i) : m->end;
+}
+
+int64_t donemap_next(const struct donemap *m, int64_t lba, int64_t *stop)
+{
+	int64_t i, w, j, k;
+	uint64_t word;
+
+	*stop = m->end;
+	if (NULL == m->cnt)
+		return lba;
+	if (lba < m->start)
+		lba = m->start;
+	if (lba >= m->end)
+		return m->end;
+	i = (lba - m->start) >> m->shift;
+	w = i >> 6;
+	word = __atomic_load_n(&m->bits[0][w], __ATOMIC_ACQUIRE) |
+	       ((1ULL << (i & 63)) - 1);
+	while (~0ULL == word)
+	{
+		if (++w >= m->words[0])
+			return m->end;
+		word = __atomic_load_n(&m->bits[0][w], __ATOMIC_ACQUIRE);
+	}
+	j = w * 64 + __builtin_ctzll(~word);
+	if (j >= m->chunks)
+		return m->end;
+	if (chunk_start(m, j) > lba)
+		lba = chunk_start(m, j);
+	// the next chunk done after j; the padding past the last counts
+	word = __atomic_load_n(&m->bits[0][w], __ATOMIC_ACQUIRE) &
+	       ~((2ULL << (j & 63)) - 1);
+	while (0 == word)
+	{
+		if (++w >= m->words[0])
+			return lba;
+		word = __atomic_load_n(&m->bits[0][w], __ATOMIC_ACQUIRE);
+	}
+	k = w * 64 + __builtin_ctzll(word);
+	if ((k < m->chunks) && (chunk_start(m, k) < m->end))
+		*stop = chunk_start(m, k);
+	return lba;
+}
+
+static void
+put_le(FILE *fp, uint64_t v, int bytes)
+{
+	while (bytes-- > 0)
+	{
+		fputc((int)(v & 0xff), fp);
+		v >>= 8;
+	}
+}
+
+static int
+get_le(FILE *fp, uint64_t *v, int bytes)
+{
+	int k, c;
+
+	*v = 0;
+	for (k = 0; k < bytes; ++k)
+	{
+		c = fgetc(fp);
+		if (EOF == c)
+			return -1;
+		*v |= (uint64_t)c << (8 * k);
+	}
+	return 0;
+}
+
+int donemap_save(FILE *fp, const char *name, const struct donemap *m)
+{
+	size_t name_len = strlen(name);
+	int64_t k;
+
+	fwrite(donemap_magic, 1, sizeof(donemap_magic), fp);
+	fputc(DONEMAP_VERSION, fp);
+	put_le(fp, name_len, 4);
+	put_le(fp, m->shift, 4);
+	put_le(fp, m->start, 8);
+	put_le(fp, m->end, 8);
+	put_le(fp, m->cnt ? m->words[0] : 0, 8);
+	fwrite(name, 1, name_len, fp);
+	for (k = 0; m->cnt && (k < m->words[0]); ++k)
+		put_le(fp, __atomic_load_n(&m->bits[0][k], __ATOMIC_ACQUIRE), 8);
+	return ferror(fp) ? -1 : 0;
+}
+
+int donemap_load(const char *path, const char *name, struct donemap *m)
+{
+	char magic[sizeof(donemap_magic)], rname[4096];
+	uint64_t name_len, shift, start, end, words, v, k, b;
+	FILE *fp = fopen(path, "rb");
+	int res = 1;
+
+	if (NULL == fp)
+		return -1;
+	for (;;)
+	{
+		if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic))
+		{
+			res = feof(fp) ? 1 : -1;
+			break;
+		}
+		if (memcmp(magic, donemap_magic, sizeof(magic)) ||
+		    (DONEMAP_VERSION != fgetc(fp)) || get_le(fp, &name_len, 4) ||
+		    get_le(fp, &shift, 4) || get_le(fp, &start, 8) ||
+		    get_le(fp, &end, 8) || get_le(fp, &words, 8) ||
+		    (name_len >= sizeof(rname)) ||
+		    (fread(rname, 1, name_len, fp) != name_len))
+		{
+			res = -1;
+			break;
+		}
+		rname[name_len] = '\0';
+		if (strcmp(rname, name) || (NULL == m->cnt) ||
+		    ((int64_t)start != m->start) || ((int64_t)end != m->end) ||
+		    ((int)shift != m->shift) || ((int64_t)words != m->words[0]))
+		{
+			if (fseek(fp, (long)(words * 8), SEEK_CUR))
+			{
+				res = -1;
+				break;
+			}
+			continue;
+		}
+		for (k = 0; k < words; ++k)
+		{
+			if (get_le(fp, &v, 8))
+			{
+				res = -1;
+				break;
+			}
+			for (b = 0; b < 64; ++b)
+				if ((v >> b & 1) && (k * 64 + b < (uint64_t)m->chunks))
+					donemap_add(m, chunk_start(m, k * 64 + b),
+						    chunk_len(m, k * 64 + b));
+		}
+		if (k == words)
+			res = 0;
+		break;
+	}
+	fclose(fp);
+	return res;
+}
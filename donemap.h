@@ -0,0 +1,66 @@
+/*
+ * donemap.h
+ *
+ *  Which chunks of a pass are read whole, for engines whose READs
+ *  complete out of order: a count of the blocks done in each chunk and
+ *  a bitmap of the chunks complete, with a level above it of the words
+ *  that are full, and so on up to one word. The lowest chunk not done
+ *  is then found in one word a level, and the blocks above the low
+ *  water mark that are done are kept, so a resumed pass need not read
+ *  them again. The chunk is the smallest power of two blocks that
+ *  keeps the map under DONEMAP_MAX_CHUNKS chunks, so a device of any
+ *  size takes at most 8 bytes and a few bits a chunk: a 20 TB disk of
+ *  512 byte blocks has chunks of 512 MiB. Adding is lock free, from any
+ *  number of threads.
+ *
+ *  File format, one record per device, integers little endian:
+ *    "DSKDONE" and a version byte (1)
+ *    u32 name length, u32 log2 of the blocks of a chunk, u64 first
+ *    lba, u64 lba past the last, u64 words, the device name (no NUL),
+ *    then the words of the bitmap of the chunks complete, bit k of word
+ *    w that of chunk 64 w + k.
+ */
+
+#ifndef DONEMAP_H_
+#define DONEMAP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define DONEMAP_VERSION 1
+#define DONEMAP_MAX_CHUNKS (1 << 16)
+#define DONEMAP_LEVELS 3 // 64^3 words cover DONEMAP_MAX_CHUNKS
+
+struct donemap
+{
+	int64_t start;
+	int64_t end;
+	int shift; // a chunk is 1 << shift blocks
+	int64_t chunks;
+	uint64_t *cnt; // blocks done of each chunk
+	uint64_t *bits[DONEMAP_LEVELS]; // [0] the chunks, [l] full words of [l-1]
+	int64_t words[DONEMAP_LEVELS];
+	int64_t blocks; // done in all
+};
+
+// A map of [start, end), all of it to do. Returns 0, -1 out of memory
+int donemap_init(struct donemap *m, int64_t start, int64_t end);
+void donemap_free(struct donemap *m);
+// All of it to do again
+void donemap_clear(struct donemap *m);
+// [lba, lba + blocks) done, clipped to the map; each block once
+void donemap_add(struct donemap *m, int64_t lba, int64_t blocks);
+// The first lba of the lowest chunk not done, end when all are
+int64_t donemap_low(const struct donemap *m);
+// The first lba at or after lba in a chunk not done, end when none is;
+// *stop is where the run of chunks not done from there ends
+int64_t donemap_next(const struct donemap *m, int64_t lba, int64_t *stop);
+// Appends a record. Returns 0, -1 on a write error
+int donemap_save(FILE *fp, const char *name, const struct donemap *m);
+// The chunks done in the record of name in path into m, when it is of
+// the same range and chunk. Returns 0, 1 when there is none for it, -1
+// on errors
+int donemap_load(const char *path, const char *name, struct donemap *m);
+
+#endif /* DONEMAP_H_ */
@@ -0,0 +1,136 @@
+/*
+ * drift.c
+ *
+ *  The segment learns a sample only while neither side holds it, so a
+ *  step under way does not pull the mean and widen the deviation it is
+ *  measured in. A step too small to keep is merged into the segment
+ *  instead, which lets it follow a slow drift (the MB/s of a disk from
+ *  its outer tracks in) without marking a step every few samples.
+ *
+ *  The samples a side holds when it marks a step may begin with a few
+ *  from before it, noise it had not shed yet, so the next segment is
+ *  learnt over again from the samples after, and the rate after a step
+ *  is the level of that segment once it is known.
+ */
+
+#include <stddef.h>
+#include <math.h>
+
+#include "drift.h"
+
+static void
+side_zero(struct drift_side *sd, double t, int64_t lba)
+{
+	sd->g = 0.0;
+	sd->n = 0;
+	sd->sum = sd->sumsq = 0.0;
+	sd->t = t;
+	sd->lba = lba;
+}
+
+static void
+side_add(struct drift_side *sd, double g, double y, double t, int64_t lba)
+{
+	if (g <= 0.0)
+	{
+		side_zero(sd, t, lba);
+		return;
+	}
+	sd->g = g;
+	++sd->n;
+	sd->sum += y;
+	sd->sumsq += y * y;
+}
+
+// Welford's merge of the samples of sd into the segment
+static void
+seg_merge(struct drift_det *d, const struct drift_side *sd)
+{
+	double m, delta;
+	uint64_t n;
+
+	if (0 == sd->n)
+		return;
+	m = sd->sum / sd->n;
+	n = d->n + sd->n;
+	delta = m - d->mean;
+	d->m2 += sd->sumsq - sd->n * m * m +
+		 delta * delta * d->n * sd->n / n;
+	d->mean += delta * sd->n / n;
+	d->n = n;
+}
+
+static void
+seg_add(struct drift_det *d, double y)
+{
+	double delta = y - d->mean;
+
+	++d->n;
+	d->mean += delta / d->n;
+	d->m2 += delta * (y - d->mean);
+}
+
+void drift_init(struct drift_det *d, double pct)
+{
+	d->min_step = log(1.0 + pct / 100.0);
+	d->n = 0;
+	d->mean = d->m2 = 0.0;
+	side_zero(&d->up, 0.0, 0);
+	side_zero(&d->down, 0.0, 0);
+}
+
+int drift_add(struct drift_det *d, double t, int64_t lba, double x,
+	      struct drift_step *s)
+{
+	struct drift_side *sd;
+	double y, dev, z, m;
+
+	if (!(x > 0.0))
+		return 0;
+	y = log(x);
+	if (d->n < DRIFT_WARMUP)
+	{
+		seg_add(d, y);
+		side_zero(&d->up, t, lba);
+		side_zero(&d->down, t, lba);
+		return 0;
+	}
+	dev = sqrt(d->m2 / (d->n - 1));
+	if (dev < DRIFT_SD_FLOOR)
+		dev = DRIFT_SD_FLOOR;
+	z = (y - d->mean) / dev;
+	side_add(&d->up, d->up.g + z - DRIFT_K, y, t, lba);
+	side_add(&d->down, d->down.g - z - DRIFT_K, y, t, lba);
+	if ((0 == d->up.n) && (0 == d->down.n))
+	{
+		seg_add(d, y);
+		return 0;
+	}
+	sd = (d->up.g > DRIFT_H) ? &d->up
+				 : (d->down.g > DRIFT_H) ? &d->down : NULL;
+	if (NULL == sd)
+		return 0;
+	m = sd->sum / sd->n;
+	if (fabs(m - d->mean) < d->min_step)
+	{
+		// noise, or a drift too slow to be a step
+		seg_merge(d, sd);
+		side_zero(&d->up, t, lba);
+		side_zero(&d->down, t, lba);
+		return 0;
+	}
+	s->t = sd->t;
+	s->lba = sd->lba;
+	s->before = exp(d->mean);
+	s->after = exp(m);
+	d->n = 0; // the next warms up on samples all after the step
+	d->mean = d->m2 = 0.0;
+	side_zero(&d->up, t, lba);
+	side_zero(&d->down, t, lba);
+	return 1;
+}
+
+double drift_level(const struct drift_det *d)
+{
+	return d->n ? exp(d->mean) : 0.0;
+}
@@ -0,0 +1,63 @@
+/*
+ * drift.h
+ *
+ *  Steps of a series within a pass, found online: the MB/s of an SSD
+ *  that falls once its SLC cache fills or it throttles hot, the latency
+ *  that rises with it. Each sample is the log of a rate over a fixed
+ *  interval, so a halving is the same step at any speed. A two sided
+ *  CUSUM holds the samples against the mean and deviation of the
+ *  current segment (Welford), in deviations, with a slack of DRIFT_K of
+ *  them; one side going over DRIFT_H marks a step. It took place where
+ *  that side was last 0, and the next segment starts from there. A
+ *  step of less than the smallest asked for is taken as noise, the
+ *  sides start over and the segment goes on. Memory does not grow with
+ *  the pass: a few sums a series.
+ */
+
+#ifndef DRIFT_H_
+#define DRIFT_H_
+
+#include <stdint.h>
+
+#define DRIFT_K 0.5	   // slack, deviations a sample
+#define DRIFT_H 8.0	   // sum of deviations that marks a step
+#define DRIFT_WARMUP 5	   // samples of a segment before it is tested
+#define DRIFT_SD_FLOOR 0.03 // of the log, the least deviation taken
+
+struct drift_side
+{
+	double g;     // the CUSUM, >= 0
+	uint64_t n;   // samples since it was last 0,
+	double sum;   // their sum
+	double sumsq; // and that of their squares
+	double t;     // where it was last 0
+	int64_t lba;
+};
+
+struct drift_det
+{
+	double min_step; // of the log, smallest step kept
+	uint64_t n;	 // samples of the current segment,
+	double mean;	 // their mean
+	double m2;	 // and sum of squared deviations
+	struct drift_side up, down;
+};
+
+struct drift_step
+{
+	double t;	// where the new segment began
+	int64_t lba;
+	double before;	// the rate of the segment before,
+	double after;	// and of the one after, as of the samples so far
+};
+
+// A series keeping steps of at least pct percent
+void drift_init(struct drift_det *d, double pct);
+// Feeds rate x > 0 of the interval ending at t, lba. Returns 1 with
+// *s set when x marks a step, else 0
+int drift_add(struct drift_det *d, double t, int64_t lba, double x,
+	      struct drift_step *s);
+// The rate of the current segment, 0 before any sample
+double drift_level(const struct drift_det *d);
+
+#endif /* DRIFT_H_ */
@@ -0,0 +1,89 @@
+/*
+ * dskread.h
+ *
+ *  libdskread: the engine of dskread, the same code as the program, run
+ *  in the calling process. A run is configured with the words of a
+ *  command line, devices included, and runs on a thread of its own;
+ *  its progress is polled and its end, and that of each device, comes
+ *  as a callback the caller's event loop dispatches when the fd of
+ *  dskread_event_fd() is readable. The report lines still go to stdout
+ *  as the program prints them.
+ *
+ *  The options are one set for the process, so there is one run at a
+ *  time; a second dskread_open() fails with EBUSY until the first is
+ *  closed. -? and a malformed --pattern exit the process as they do
+ *  the program; the other option errors are the result of the run.
+ */
+
+#ifndef DSKREAD_H_
+#define DSKREAD_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DSKREAD_EV_DEVICE 1 // a device is done, dev its index
+#define DSKREAD_EV_RUN 2    // the run is, dev -1; dskread_wait() returns
+
+#define DSKREAD_BAD 1      // unrecovered read error
+#define DSKREAD_WEAK 2     // READ slower than --slow
+#define DSKREAD_MISMATCH 3 // data read was not the pattern
+
+struct dskread;
+
+struct dskread_dev
+{
+	char name[256];
+	int done;	      // the device is
+	int result;	      // 0, else an SG_LIB_CAT_* exit status, once done
+	unsigned int pass;    // in progress, 0 -> none
+	unsigned int passes;  // done
+	unsigned int total;   // passes of the run
+	int64_t start, end;   // lba range
+	int64_t lba;	      // reached in the pass
+	int64_t bytes;	      // read and checked
+	int64_t unrecovered;  // read errors
+	int64_t mismatched;   // blocks not the pattern
+	int weak;	      // weak sectors
+};
+
+typedef void (*dskread_cb)(void *arg, int event, int dev);
+typedef void (*dskread_ext_fn)(void *arg, int64_t lba, int64_t len, int kind);
+
+// A context for one run, NULL with errno set, EBUSY while another is
+// open
+struct dskread *dskread_open(void);
+// The options of the run as argv[1..] of the program, copied. 0, -1
+// once started
+int dskread_configure(struct dskread *d, int argc, char *const argv[]);
+void dskread_set_callback(struct dskread *d, dskread_cb cb, void *arg);
+// Starts the run. 0, -1 with errno set
+int dskread_start(struct dskread *d);
+// Readable while callbacks are due
+int dskread_event_fd(const struct dskread *d);
+// Runs the callbacks due, on the calling thread
+void dskread_dispatch(struct dskread *d);
+// The state of up to max devices into st, returns how many devices the
+// run has, 0 before they are known
+int dskread_poll(struct dskread *d, struct dskread_dev *st, int max);
+// A command of the --control socket ("pause", "qd 4 /dev/sdb", ...)
+// while the run goes, its reply into reply, truncated to len. 0, -1
+// when the devices are not there
+int dskread_control(struct dskread *d, const char *cmd, char *reply, int len);
+// Stops every device at its next READ; they end as failed
+void dskread_cancel(struct dskread *d);
+// Waits for the run to end, returns its exit status
+int dskread_wait(struct dskread *d);
+// The bad, weak and miscompared extents of device dev after the run,
+// sorted by lba. 0, -1 before the end or for no such device
+int dskread_badmap(struct dskread *d, int dev, dskread_ext_fn fn, void *arg);
+// Waits for the run if it was started, then frees d
+void dskread_close(struct dskread *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DSKREAD_H_ */
@@ -0,0 +1,179 @@
+#!/bin/sh
+#
+# e2e.sh
+#
+#  End to end cases of the dskread binary, run by ctest: e2e.sh dskread
+#  case. The sim- cases read a sim: disk and run anywhere. The sd- cases
+#  read a scsi_debug disk through the kernel's SG_IO path. They need
+#  root and a scsi_debug module that is not loaded yet, and they exit
+#  77 (skipped) without those. Each case loads the module with its own
+#  block size, delay and medium errors and unloads it when done.
+#
+#    rate    the pass reads at no less than a floor of MB/s,
+#            $DSKREAD_E2E_MBPS when set
+#    badmap  --coe 1 --bad-map-text holds exactly the injected errors
+#    resume  a run stopped by SIGINT after a checkpoint, then --resume,
+#            reads only the rest and keeps the errors found before
+#    trace   --trace-export of a device whose name holds commas quotes
+#            it, so each CSV row still has its 9 fields
+#
+
+SKIP=77
+
+B=$1
+CASE=$2
+T=${TMPDIR:-/tmp}/dskread-e2e.$$
+SD_LOADED=
+
+fail()
+{
+	echo "$CASE: $*" >&2
+	exit 1
+}
+
+skip()
+{
+	echo "$CASE: skipped, $*" >&2
+	exit $SKIP
+}
+
+cleanup()
+{
+	rm -rf "$T"
+	if [ -n "$SD_LOADED" ]; then
+		rmmod scsi_debug 2>/dev/null
+	fi
+}
+
+# the value of key of the pass record in the --json file $1
+pass_field()
+{
+	sed -n "s/.*\"type\":\"pass\".*\"$2\":\([0-9.]*\).*/\1/p" "$1" | tail -1
+}
+
+# the extents of the --bad-map-text file $1, without its device column
+extents()
+{
+	sed 1d "$1" | cut -f2- | sort -t '	' -k2,2n
+}
+
+# loads scsi_debug with the parameters given, sets DEV to its sg node
+sd_load()
+{
+	[ "$(id -u)" = 0 ] || skip "scsi_debug needs root"
+	[ -d /sys/module/scsi_debug ] && skip "scsi_debug is loaded already"
+	modprobe scsi_debug "$@" 2>/dev/null || skip "no scsi_debug module"
+	SD_LOADED=1
+	DEV=
+	n=0
+	while [ -z "$DEV" ] && [ $n -lt 50 ]; do
+		for g in /sys/bus/pseudo/drivers/scsi_debug/adapter*/host*/target*/*:*/scsi_generic/sg*; do
+			[ -e "/dev/${g##*/}" ] && DEV=/dev/${g##*/}
+		done
+		[ -n "$DEV" ] || sleep 0.1
+		n=$((n + 1))
+	done
+	[ -n "$DEV" ] || fail "no sg node for scsi_debug"
+}
+
+run_rate()
+{
+	floor=${DSKREAD_E2E_MBPS:-$1}
+
+	"$B" "$DEV" --json "$T/j" >"$T/out" 2>&1 || fail "exit $?"
+	mbps=$(pass_field "$T/j" mbps)
+	[ -n "$mbps" ] || fail "no pass record in the --json file"
+	awk -v r="$mbps" -v f="$floor" 'BEGIN { exit !(r >= f) }' ||
+		fail "$mbps MB/s, under the floor of $floor"
+	echo "$CASE: $mbps MB/s, floor $floor"
+}
+
+# $1: the extents expected, as lines of kind first last blocks
+run_badmap()
+{
+	"$B" "$DEV" --coe 1 --bad-map-text "$T/bm" >"$T/out" 2>&1 ||
+		fail "exit $?"
+	printf "$1" >"$T/want"
+	extents "$T/bm" >"$T/got"
+	cmp -s "$T/want" "$T/got" ||
+		fail "bad map is $(cat "$T/got"), not $(cat "$T/want")"
+}
+
+# $1: blocks of the disk, $2: the extents expected, $3: --max-rate of
+# the first run, slow enough for it to checkpoint before it is stopped
+run_resume()
+{
+	timeout -s INT 7 "$B" "$DEV" --coe 1 --max-rate "$3" \
+		--checkpoint "$T/ck" >"$T/out1" 2>&1
+	[ $? -eq 124 ] || fail "the first run ended before it was stopped"
+	[ -s "$T/ck" ] || fail "no checkpoint after the first run"
+	"$B" "$DEV" --coe 1 --checkpoint "$T/ck" --resume --json "$T/j" \
+		--bad-map-text "$T/bm" >"$T/out2" 2>&1 || fail "resume exit $?"
+	rin=$(pass_field "$T/j" records_in)
+	[ -n "$rin" ] || fail "no pass record in the --json file"
+	[ "$rin" -gt 0 ] && [ "$rin" -lt "$1" ] ||
+		fail "resumed pass read $rin of $1 blocks"
+	printf "$2" >"$T/want"
+	extents "$T/bm" >"$T/got"
+	cmp -s "$T/want" "$T/got" ||
+		fail "bad map is $(cat "$T/got"), not $(cat "$T/want")"
+	echo "$CASE: resumed for $rin of $1 blocks"
+}
+
+run_trace()
+{
+	"$B" "$DEV" --coe 1 --trace "$T/tr" >"$T/out" 2>&1 || fail "exit $?"
+	"$B" --trace-export "$T/tr" >"$T/csv" 2>"$T/out" ||
+		fail "--trace-export exit $?"
+	q=$(printf '%s' "$DEV" | sed 's/"/""/g')
+	sed 1d "$T/csv" >"$T/rows"
+	[ -s "$T/rows" ] || fail "no rows in the CSV"
+	# the device field as RFC 4180 has it, then 8 more
+	awk -v d="\"$q\"," -F, '
+		index($0, d) != 1 { exit 1 }
+		{ $0 = substr($0, length(d) + 1) }
+		NF != 8 { exit 1 }' "$T/rows" ||
+		fail "rows not of $DEV quoted and 8 fields: $(head -1 "$T/rows")"
+}
+
+[ -x "$B" ] || fail "usage: e2e.sh dskread case"
+mkdir -p "$T" || fail "no $T"
+trap cleanup EXIT
+
+case $CASE in
+sim-rate)
+	DEV='sim:blocks=400000,bs=4096'
+	run_rate 100
+	;;
+sim-badmap)
+	DEV='sim:blocks=100000,bad=500+3,bad=9000,bad=99999'
+	run_badmap 'bad\t500\t502\t3\nbad\t9000\t9000\t1\nbad\t99999\t99999\t1\n'
+	;;
+sim-resume)
+	DEV='sim:blocks=200000,bad=10,bad=150000+2'
+	run_resume 200000 'bad\t10\t10\t1\nbad\t150000\t150001\t2\n' 10M
+	;;
+sim-trace)
+	DEV='sim:blocks=20000,bad=100,rec=5000'
+	run_trace
+	;;
+sd-rate)
+	# 64 MiB of 4096 byte blocks, 50 us a command
+	sd_load dev_size_mb=64 sector_size=4096 delay=0 ndelay=50000
+	run_rate 50
+	;;
+sd-badmap)
+	sd_load dev_size_mb=64 sector_size=4096 delay=0 \
+		medium_error_start=4000 medium_error_count=3 opts=2
+	run_badmap 'bad\t4000\t4002\t3\n'
+	;;
+sd-resume)
+	sd_load dev_size_mb=64 sector_size=512 delay=0 \
+		medium_error_start=1000 medium_error_count=2 opts=2
+	run_resume 131072 'bad\t1000\t1001\t2\n' 4M
+	;;
+*)
+	fail "no case $CASE"
+	;;
+esac
+exit 0
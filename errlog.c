@@ -0,0 +1,221 @@
+/*
+ * errlog.c
+ *
+ *  The ring is a bounded queue of slots with a sequence number each:
+ *  a producer claims a slot by moving the head with a compare and swap
+ *  and marks it full with the sequence, the logger takes slots in order
+ *  and hands each back a lap ahead. An event the ring has no room for
+ *  is counted as lost.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <scsi/sg.h>
+
+#include "sg_lib.h"
+#include "sg_pr2serr.h"
+#include "sg_io_linux.h"
+#include "errlog.h"
+
+#define CATS 128 // error classes told apart, the others share the last
+
+struct ev
+{
+	const char *fmt;
+	const char *what;
+	int64_t a, b;
+	int cat;
+	bool raw;
+	struct sg_io_hdr hdr; // sbp pointing nowhere,
+	uint8_t sb[64];	      // its sense here
+};
+
+struct slot
+{
+	uint64_t seq;
+	struct ev ev;
+};
+
+static struct slot ring[ERRLOG_RING];
+static uint64_t head; // the producers'
+static uint64_t tail; // the logger's
+static uint64_t lost;
+static int running;
+static int stop;
+static pthread_t logger;
+static int shown[CATS];	     // in this second, per class
+static int64_t held[CATS];   // not shown in it
+static int64_t held_all;     // in the run
+static uint64_t second;	     // CLOCK_MONOTONIC s of shown[]
+
+static void
+print_ev(struct ev *e)
+{
+	if (e->fmt)
+		pr2serr(e->fmt, e->a, e->b);
+	if (e->what)
+	{
+		e->hdr.sbp = e->sb;
+		sg_chk_n_print3(e->what, &e->hdr, e->raw);
+	}
+}
+
+static uint64_t
+now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+// The line of what the second just over held back
+static void
+second_end(void)
+{
+	char b[80];
+	int k;
+
+	for (k = 0; k < CATS; ++k)
+	{
+		if (held[k])
+			pr2serr("%" PRId64 " more '%s' errors not shown\n", held[k],
+				sg_get_category_sense_str(k, sizeof(b), b, 0));
+		held_all += held[k];
+		held[k] = 0;
+		shown[k] = 0;
+	}
+}
+
+// Prints or counts what the ring holds
+static void
+drain(void)
+{
+	struct slot *s;
+	uint64_t t = now_s();
+	int c;
+
+	if (t != second)
+	{
+		second_end();
+		second = t;
+	}
+	for (;;)
+	{
+		s = ring + (tail & (ERRLOG_RING - 1));
+		if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != tail + 1)
+			break;
+		c = ((s->ev.cat < 0) || (s->ev.cat >= CATS)) ? CATS - 1
+							      : s->ev.cat;
+		if (shown[c] < ERRLOG_BURST)
+		{
+			++shown[c];
+			print_ev(&s->ev);
+		}
+		else
+			++held[c];
+		__atomic_store_n(&s->seq, tail + ERRLOG_RING, __ATOMIC_RELEASE);
+		++tail;
+	}
+}
+
+static void *
+logger_thread(void *arg)
+{
+	struct timespec ts = {0, ERRLOG_MS * 1000000L};
+
+	(void)arg;
+	while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE))
+	{
+		nanosleep(&ts, NULL);
+		drain();
+	}
+	return NULL;
+}
+
+int errlog_start(void)
+{
+	uint64_t k;
+
+	head = tail = lost = 0;
+	held_all = 0;
+	for (k = 0; k < ERRLOG_RING; ++k)
+		ring[k].seq = k;
+	memset(shown, 0, sizeof(shown));
+	memset(held, 0, sizeof(held));
+	second = now_s();
+	stop = 0;
+	errno = pthread_create(&logger, NULL, logger_thread, NULL);
+	if (errno)
+		return -1;
+	__atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void errlog_stop(void)
+{
+	if (!running)
+		return;
+	__atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+	pthread_join(logger, NULL);
+	drain(); // the device threads are done, nothing is put now
+	second_end();
+	if (held_all || lost)
+		pr2serr("errors: %" PRId64 " messages not shown, %" PRIu64
+			" lost\n", held_all, lost);
+}
+
+void errlog_put(int cat, const char *fmt, int64_t a, int64_t b,
+		const char *what, const struct sg_io_hdr *hp, bool raw)
+{
+	struct ev e, *p;
+	struct slot *s;
+	uint64_t pos;
+	int64_t dif;
+
+	e.fmt = fmt;
+	e.what = what;
+	e.a = a;
+	e.b = b;
+	e.cat = cat;
+	e.raw = raw;
+	if (what)
+	{
+		e.hdr = *hp;
+		e.hdr.sb_len_wr = (hp->sb_len_wr > sizeof(e.sb)) ? sizeof(e.sb)
+								 : hp->sb_len_wr;
+		memcpy(e.sb, hp->sbp, e.hdr.sb_len_wr);
+		e.hdr.sbp = NULL;
+	}
+	if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE))
+	{
+		print_ev(&e);
+		return;
+	}
+	pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+	for (;;)
+	{
+		s = ring + (pos & (ERRLOG_RING - 1));
+		dif = (int64_t)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) - pos);
+		if ((0 == dif) &&
+		    __atomic_compare_exchange_n(&head, &pos, pos + 1, true,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+		if (dif < 0)
+		{
+			__atomic_fetch_add(&lost, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		if (dif > 0)
+			pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+	}
+	p = &s->ev;
+	*p = e;
+	__atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,37 @@
+/*
+ * errlog.h
+ *
+ *  The messages of failed commands, off the I/O threads. A thread that
+ *  sees an error puts the line and the status and sense of its command
+ *  into a ring many threads share, no lock and no formatting; one
+ *  logger thread prints them. Each error class gets up to ERRLOG_BURST
+ *  messages a second, the rest are counted and said in one line when
+ *  the second is over, so a failing drive's errors do not slow the scan
+ *  down with writes to stderr. While the logger is not running events
+ *  are printed where they happen, as before.
+ */
+
+#ifndef ERRLOG_H_
+#define ERRLOG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ERRLOG_RING 4096 // events
+#define ERRLOG_BURST 10	 // messages of an error class a second
+#define ERRLOG_MS 20	 // the logger looks every
+
+struct sg_io_hdr;
+
+// Starts the logger thread. Returns 0, -1 with errno set
+int errlog_start(void);
+// Prints what is left, and how many were not, and stops the thread
+void errlog_stop(void);
+// An event of error class cat (SG_LIB_CAT_*): the line fmt, a literal
+// taking the int64_t a and b in that order, NULL -> none; then when
+// what is not NULL, the status and sense of hp as sg_chk_n_print3(what,
+// hp, raw) prints them
+void errlog_put(int cat, const char *fmt, int64_t a, int64_t b,
+		const char *what, const struct sg_io_hdr *hp, bool raw);
+
+#endif /* ERRLOG_H_ */
@@ -0,0 +1,401 @@
+/*
+ * fsmap.c
+ *
+ *  A GPT header is in block 1: "EFI PART", the first and last usable
+ *  blocks at bytes 40 and 48, the block of the entries at 72, their
+ *  number and size at 80 and 84, all little endian; an entry of a zero
+ *  type GUID is unused, else its first and last block are at 32 and
+ *  40. An MBR has four 16 byte entries at 446, the type at 4 and first
+ *  block and length at 8 and 12; an extended partition is a chain of
+ *  EBRs, each with a logical partition relative to itself and the next
+ *  EBR relative to the extended partition.
+ *
+ *  The ext2/3/4 superblock is 1024 bytes in, little endian; its group
+ *  descriptors follow in the block after the one it is in, each with
+ *  the block of its bitmap, a bit a block of the group set when the
+ *  block is allocated. A group still BLOCK_UNINIT has no bitmap: what
+ *  it uses, the backup superblock and descriptors, is at its start.
+ *  The XFS superblock is at 0, big endian; each allocation group has
+ *  its AGF in its second sector with the root and height of the b-tree
+ *  of its free extents by block. What is not free in the group is
+ *  allocated, the logs, inodes and b-trees with it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsmap.h"
+
+#define GPT_MIN_ENTRY 128
+#define GPT_MAX_ENTRIES 4096
+#define MBR_EXTENDED(t) ((0x05 == (t)) || (0x0f == (t)) || (0x85 == (t)))
+#define MBR_GPT 0xee // protective
+#define EBR_MAX 256  // logical partitions followed, at most
+
+#define EXT4_MAGIC 0xef53
+#define EXT4_INCOMPAT_META_BG 0x10
+#define EXT4_INCOMPAT_64BIT 0x80
+#define EXT4_BG_BLOCK_UNINIT 0x2
+
+#define XFS_SB_MAGIC 0x58465342  // "XFSB"
+#define XFS_AGF_MAGIC 0x58414746 // "XAGF"
+#define XFS_ABTB_MAGIC 0x41425442 // "ABTB", v4 free space by block
+#define XFS_AB3B_MAGIC 0x41423342 // "AB3B", v5
+#define XFS_NULLAGBLOCK 0xffffffffU
+#define XFS_MAX_LEVELS 9
+
+static uint64_t
+get_le(const uint8_t *p, int len)
+{
+	uint64_t v = 0;
+
+	while (len-- > 0)
+		v = (v << 8) | p[len];
+	return v;
+}
+
+static uint64_t
+get_be(const uint8_t *p, int len)
+{
+	uint64_t v = 0;
+
+	while (len-- > 0)
+		v = (v << 8) | *p++;
+	return v;
+}
+
+static int
+add_part(struct fsmap_part *p, int n, int max, uint64_t off, uint64_t len)
+{
+	if (len && (n < max))
+	{
+		p[n].off = off;
+		p[n].len = len;
+		++n;
+	}
+	return n;
+}
+
+// The GPT of header h, in block 1. Returns as fsmap_parts()
+static int
+gpt_parts(fsmap_read_fn rd, fsmap_use_fn use, void *ctx, const uint8_t *h,
+	  int blk_sz, int64_t num_sect, struct fsmap_part *p, int max)
+{
+	uint64_t first = get_le(h + 40, 8), last = get_le(h + 48, 8);
+	uint64_t at = get_le(h + 72, 8), lo, hi;
+	uint32_t num = (uint32_t)get_le(h + 80, 4);
+	uint32_t esz = (uint32_t)get_le(h + 84, 4);
+	uint8_t *e;
+	uint32_t k;
+	int n = 0;
+
+	if ((esz < GPT_MIN_ENTRY) || (esz & 7) || (num > GPT_MAX_ENTRIES) ||
+	    (last >= (uint64_t)num_sect) || (first > last))
+		return -1;
+	e = (uint8_t *)malloc((size_t)num * esz + 1);
+	if (NULL == e)
+		return -1;
+	if (rd(ctx, at * blk_sz, e, (size_t)num * esz) ||
+	    use(ctx, 0, first * blk_sz) ||
+	    use(ctx, (last + 1) * blk_sz, (num_sect - last - 1) * blk_sz))
+	{
+		free(e);
+		return -1;
+	}
+	for (k = 0; k < num; ++k)
+	{
+		const uint8_t *ep = e + (size_t)k * esz;
+		static const uint8_t unused[16];
+
+		if (0 == memcmp(ep, unused, sizeof(unused)))
+			continue;
+		lo = get_le(ep + 32, 8);
+		hi = get_le(ep + 40, 8);
+		if ((lo > hi) || (hi >= (uint64_t)num_sect))
+			continue;
+		n = add_part(p, n, max, lo * blk_sz, (hi - lo + 1) * blk_sz);
+	}
+	free(e);
+	return n;
+}
+
+int fsmap_parts(fsmap_read_fn rd, fsmap_use_fn use, void *ctx, int blk_sz,
+		int64_t num_sect, struct fsmap_part *p, int max)
+{
+	uint8_t *b = (uint8_t *)malloc(blk_sz);
+	uint64_t ext = 0, ebr, lo, len;
+	int k, j, n = 0, type;
+
+	if (NULL == b)
+		return -1;
+	if ((num_sect > 2) && (0 == rd(ctx, blk_sz, b, blk_sz)) &&
+	    (0 == memcmp(b, "EFI PART", 8)))
+	{
+		n = gpt_parts(rd, use, ctx, b, blk_sz, num_sect, p, max);
+		free(b);
+		return n;
+	}
+	if (rd(ctx, 0, b, blk_sz))
+	{
+		free(b);
+		return -1;
+	}
+	if ((0x55 != b[510]) || (0xaa != b[511]))
+	{
+		free(b);
+		return 0;
+	}
+	if (use(ctx, 0, blk_sz))
+	{
+		free(b);
+		return -1;
+	}
+	for (k = 0; k < 4; ++k)
+	{
+		const uint8_t *ep = b + 446 + 16 * k;
+
+		type = ep[4];
+		lo = get_le(ep + 8, 4);
+		len = get_le(ep + 12, 4);
+		if ((0 == type) || (MBR_GPT == type) || (0 == len) ||
+		    (lo + len > (uint64_t)num_sect))
+			continue;
+		if (MBR_EXTENDED(type))
+		{
+			if (0 == ext)
+				ext = lo;
+			continue;
+		}
+		n = add_part(p, n, max, lo * blk_sz, len * blk_sz);
+	}
+	/* the logical partitions, one an EBR */
+	for (ebr = ext, j = 0; ebr && (j < EBR_MAX); ++j)
+	{
+		if (rd(ctx, ebr * blk_sz, b, blk_sz) || (0x55 != b[510]) ||
+		    (0xaa != b[511]) || use(ctx, ebr * blk_sz, blk_sz))
+			break;
+		lo = ebr + get_le(b + 446 + 8, 4);
+		len = get_le(b + 446 + 12, 4);
+		if (b[446 + 4] && len && (lo + len <= (uint64_t)num_sect))
+			n = add_part(p, n, max, lo * blk_sz, len * blk_sz);
+		lo = get_le(b + 462 + 8, 4);
+		ebr = (MBR_EXTENDED(b[462 + 4]) && lo) ? ext + lo : 0;
+	}
+	free(b);
+	return n;
+}
+
+// The runs of set bits of bitmap, nbits of it, passed to use as the
+// blocks of bs from off
+static int
+bitmap_runs(fsmap_use_fn use, void *ctx, const uint8_t *bitmap,
+	    uint64_t nbits, uint64_t off, uint64_t bs)
+{
+	uint64_t i, run;
+
+	for (i = 0; i < nbits;)
+	{
+		if (!(bitmap[i >> 3] & (1 << (i & 7))))
+		{
+			/* a byte of free blocks at a time */
+			i = ((0 == (i & 7)) && !bitmap[i >> 3]) ? i + 8 : i + 1;
+			continue;
+		}
+		run = i;
+		while ((run < nbits) && (bitmap[run >> 3] & (1 << (run & 7))))
+			++run;
+		if (use(ctx, off + i * bs, (run - i) * bs))
+			return -1;
+		i = run;
+	}
+	return 0;
+}
+
+// Returns as fsmap_used()
+static int
+ext4_used(fsmap_read_fn rd, fsmap_use_fn use, void *ctx, uint64_t off,
+	  uint64_t len)
+{
+	uint8_t sb[1024], *gdt, *bitmap, *d;
+	uint64_t blocks, first, bpg, groups, g, gstart, glen, bbm, nfree, bs;
+	uint32_t incompat, logbs, dsz;
+	int res = FSMAP_EXT4;
+
+	if (len < 2048)
+		return 0;
+	if (rd(ctx, off + 1024, sb, sizeof(sb)))
+		return -1;
+	if (EXT4_MAGIC != get_le(sb + 56, 2))
+		return 0;
+	logbs = (uint32_t)get_le(sb + 24, 4);
+	incompat = (uint32_t)get_le(sb + 96, 4);
+	if ((logbs > 6) || (incompat & EXT4_INCOMPAT_META_BG))
+		return -1; /* descriptors spread over the groups */
+	bs = 1024ULL << logbs;
+	blocks = get_le(sb + 4, 4);
+	dsz = 32;
+	if (incompat & EXT4_INCOMPAT_64BIT)
+	{
+		blocks |= get_le(sb + 0x150, 4) << 32;
+		dsz = (uint32_t)get_le(sb + 254, 2);
+	}
+	first = get_le(sb + 20, 4);
+	bpg = get_le(sb + 32, 4);
+	if ((dsz < 32) || (dsz > 1024) || (0 == bpg) || (bpg > 8 * bs) ||
+	    (first >= blocks) || (blocks * bs > len))
+		return -1;
+	groups = (blocks - first + bpg - 1) / bpg;
+	gdt = (uint8_t *)malloc(groups * dsz);
+	bitmap = (uint8_t *)malloc(bs);
+	if ((NULL == gdt) || (NULL == bitmap) ||
+	    rd(ctx, off + (first + 1) * bs, gdt, groups * dsz) ||
+	    (first && use(ctx, off, first * bs)))
+	{
+		free(gdt);
+		free(bitmap);
+		return -1;
+	}
+	for (g = 0; g < groups; ++g)
+	{
+		d = gdt + g * dsz;
+		gstart = first + g * bpg;
+		glen = (blocks - gstart < bpg) ? blocks - gstart : bpg;
+		if (EXT4_BG_BLOCK_UNINIT & get_le(d + 18, 2))
+		{
+			nfree = get_le(d + 12, 2);
+			if (dsz >= 64)
+				nfree |= get_le(d + 0x2c, 2) << 16;
+			if ((nfree < glen) &&
+			    use(ctx, off + gstart * bs, (glen - nfree) * bs))
+				break;
+			continue;
+		}
+		bbm = get_le(d, 4);
+		if (dsz >= 64)
+			bbm |= get_le(d + 0x20, 4) << 32;
+		if ((bbm >= blocks) || rd(ctx, off + bbm * bs, bitmap, bs) ||
+		    bitmap_runs(use, ctx, bitmap, glen, off + gstart * bs, bs))
+			break;
+	}
+	if (g < groups)
+		res = -1;
+	free(gdt);
+	free(bitmap);
+	return res;
+}
+
+// The free extents of the b-tree of root, level levels of an AG at
+// agoff of aglen blocks; what is between them is passed to use
+static int
+xfs_ag_used(fsmap_read_fn rd, fsmap_use_fn use, void *ctx, uint8_t *blk,
+	    uint32_t bs, int hdr, uint64_t agoff, uint32_t aglen,
+	    uint32_t root, uint32_t levels)
+{
+	uint32_t b = root, maxrecs = (bs - hdr) / 12, nrecs, r, start, cnt;
+	uint64_t at = 0, magic, hops = 0;
+
+	if ((0 == levels) || (levels > XFS_MAX_LEVELS))
+		return -1;
+	for (; levels > 1; --levels)
+	{
+		if ((b >= aglen) ||
+		    rd(ctx, agoff + (uint64_t)b * bs, blk, bs) ||
+		    (0 == get_be(blk + 6, 2)))
+			return -1;
+		/* the leftmost pointer, after the keys */
+		b = (uint32_t)get_be(blk + hdr + maxrecs * 8, 4);
+	}
+	while (XFS_NULLAGBLOCK != b)
+	{
+		if ((b >= aglen) || (++hops > aglen) ||
+		    rd(ctx, agoff + (uint64_t)b * bs, blk, bs))
+			return -1;
+		magic = get_be(blk, 4);
+		if (((XFS_ABTB_MAGIC != magic) && (XFS_AB3B_MAGIC != magic)) ||
+		    get_be(blk + 4, 2))
+			return -1;
+		nrecs = (uint32_t)get_be(blk + 6, 2);
+		if (nrecs > (bs - hdr) / 8)
+			return -1;
+		for (r = 0; r < nrecs; ++r)
+		{
+			start = (uint32_t)get_be(blk + hdr + 8 * r, 4);
+			cnt = (uint32_t)get_be(blk + hdr + 8 * r + 4, 4);
+			if ((start > at) &&
+			    use(ctx, agoff + at * bs, (start - at) * bs))
+				return -1;
+			if (start + (uint64_t)cnt > at)
+				at = start + (uint64_t)cnt;
+		}
+		b = (uint32_t)get_be(blk + 12, 4);
+	}
+	if ((at < aglen) && use(ctx, agoff + at * bs, (aglen - at) * bs))
+		return -1;
+	return 0;
+}
+
+// Returns as fsmap_used()
+static int
+xfs_used(fsmap_read_fn rd, fsmap_use_fn use, void *ctx, uint64_t off,
+	 uint64_t len)
+{
+	uint8_t sb[512], agf[512], *blk;
+	uint64_t dblocks, agoff;
+	uint32_t bs, agblocks, agcount, sectsz, ag, aglen;
+	int hdr, res = FSMAP_XFS;
+
+	if ((len < sizeof(sb)) || rd(ctx, off, sb, sizeof(sb)))
+		return -1;
+	if (XFS_SB_MAGIC != get_be(sb, 4))
+		return 0;
+	bs = (uint32_t)get_be(sb + 4, 4);
+	dblocks = get_be(sb + 8, 8);
+	agblocks = (uint32_t)get_be(sb + 84, 4);
+	agcount = (uint32_t)get_be(sb + 88, 4);
+	sectsz = (uint32_t)get_be(sb + 102, 2);
+	hdr = (5 == (get_be(sb + 100, 2) & 0xf)) ? 56 : 16;
+	if ((bs < 512) || (bs > 65536) || (bs & (bs - 1)) || (sectsz < 512) ||
+	    (sectsz > bs) || (0 == agblocks) || (0 == agcount) ||
+	    (dblocks * bs > len))
+		return -1;
+	blk = (uint8_t *)malloc(bs);
+	if (NULL == blk)
+		return -1;
+	for (ag = 0; ag < agcount; ++ag)
+	{
+		agoff = off + (uint64_t)ag * agblocks * bs;
+		if (rd(ctx, agoff + sectsz, agf, sizeof(agf)) ||
+		    (XFS_AGF_MAGIC != get_be(agf, 4)))
+			break;
+		aglen = (uint32_t)get_be(agf + 12, 4);
+		if ((aglen > agblocks) ||
+		    xfs_ag_used(rd, use, ctx, blk, bs, hdr, agoff, aglen,
+				(uint32_t)get_be(agf + 16, 4),
+				(uint32_t)get_be(agf + 28, 4)))
+			break;
+	}
+	if (ag < agcount)
+		res = -1;
+	free(blk);
+	return res;
+}
+
+int fsmap_used(fsmap_read_fn rd, fsmap_use_fn use, void *ctx, uint64_t off,
+	       uint64_t len)
+{
+	int res = ext4_used(rd, use, ctx, off, len);
+
+	return res ? res : xfs_used(rd, use, ctx, off, len);
+}
+
+const char *fsmap_fs_str(int fs)
+{
+	switch (fs)
+	{
+	case FSMAP_EXT4:
+		return "ext4";
+	case FSMAP_XFS:
+		return "xfs";
+	}
+	return "?";
+}
@@ -0,0 +1,53 @@
+/*
+ * fsmap.h
+ *
+ *  What of a device is in use, for --allocated: the partitions of its
+ *  GPT or MBR and, in each, the blocks its filesystem has allocated,
+ *  from the block bitmaps of an ext2/3/4 filesystem or the free space
+ *  b-trees (by block) of the allocation groups of an XFS one. Only the
+ *  structures are decoded here; they are read through a callback, so
+ *  dskread reads them with the same READs as the scan. Offsets and
+ *  lengths are bytes from the start of the device. The blocks of the
+ *  tables and of the filesystem metadata are in use as well, a
+ *  partition without a filesystem known here is in use whole and the
+ *  space outside the partitions is not.
+ */
+
+#ifndef FSMAP_H_
+#define FSMAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FSMAP_EXT4 1 // ext2, ext3 or ext4
+#define FSMAP_XFS 2
+
+#define FSMAP_MAX_PARTS 128 // partitions of a device, at most
+
+struct fsmap_part
+{
+	uint64_t off;
+	uint64_t len;
+};
+
+// Reads len bytes at off into buf. Returns 0, -1 when they can not be
+typedef int (*fsmap_read_fn)(void *ctx, uint64_t off, void *buf, size_t len);
+// [off, off + len) is in use. Returns 0, -1 to stop
+typedef int (*fsmap_use_fn)(void *ctx, uint64_t off, uint64_t len);
+
+// The partitions of a device of num_sect blocks of blk_sz, from its GPT
+// or else its MBR (with the logical ones of an extended partition),
+// into p, at most max; the blocks the tables are in are passed to use.
+// Returns how many, 0 when there is no partition table, -1 when it can
+// not be read
+int fsmap_parts(fsmap_read_fn rd, fsmap_use_fn use, void *ctx, int blk_sz,
+		int64_t num_sect, struct fsmap_part *p, int max);
+// The blocks the filesystem in [off, off + len) has allocated, passed to
+// use in order. Returns FSMAP_EXT4 or FSMAP_XFS, 0 when it is neither
+// (nothing passed), -1 on a read error or a filesystem that can not be
+// followed, some of it perhaps passed already
+int fsmap_used(fsmap_read_fn rd, fsmap_use_fn use, void *ctx, uint64_t off,
+	       uint64_t len);
+const char *fsmap_fs_str(int fs);
+
+#endif /* FSMAP_H_ */
@@ -0,0 +1,415 @@
+/*
+ * health.c
+ *
+ *  A log page is a four byte header, the page code in the low six bits
+ *  of byte 0 and the length of the rest in bytes 2 and 3, then
+ *  parameters: a two byte code, a control byte, a length byte and that
+ *  many bytes of value, big endian. The NVMe log is little endian at
+ *  fixed offsets. A defect list is a four byte header, the format in
+ *  the low three bits of byte 1 and the length of the list in bytes 2
+ *  and 3, then descriptors of four bytes (short block) or eight.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "health.h"
+
+#define LOG_READ_ERRORS 0x03
+#define LOG_TEMPERATURE 0x0d
+#define LOG_SELF_TEST 0x10
+#define LOG_BACKGROUND_SCAN 0x15
+#define LOG_PROTOCOL_PORT 0x18
+
+#define GLIST_SHORT 0 // short block format, 32 bit LBAs
+#define GLIST_LONG 3  // long block format, 64 bit LBAs
+
+#define PARAM_TEMP 0x0000	 // current temperature
+#define PARAM_CORRECTED 0x0003	 // total errors corrected
+#define PARAM_UNCORRECTED 0x0006 // total uncorrected errors
+#define PARAM_LATEST 0x0001	 // most recent self-test
+#define PARAM_BMS_STATUS 0x0000	 // background scan status
+
+#define SK_MEDIUM_ERROR 0x3
+
+#define PROTO_SAS 0x6	  // protocol identifier of a port parameter
+#define PHY_DESC_LEN 48 // SAS phy log descriptor, up to the counters
+
+void health_init(struct health_log *hl)
+{
+	memset(hl, 0, sizeof(*hl));
+	pthread_mutex_init(&hl->mutex, NULL);
+}
+
+void health_free(struct health_log *hl)
+{
+	free(hl->s);
+	hl->s = NULL;
+	hl->num = hl->cap = 0;
+}
+
+int health_add(struct health_log *hl, const struct health_sample *s)
+{
+	struct health_sample *n;
+	int res = 0;
+
+	pthread_mutex_lock(&hl->mutex);
+	if (hl->num == hl->cap)
+	{
+		n = (struct health_sample *)realloc(
+			hl->s, (hl->cap ? 2 * hl->cap : 64) * sizeof(*n));
+		if (n)
+		{
+			hl->s = n;
+			hl->cap = hl->cap ? 2 * hl->cap : 64;
+		}
+	}
+	if (hl->num < hl->cap)
+		hl->s[hl->num++] = *s;
+	else
+		res = -1;
+	pthread_mutex_unlock(&hl->mutex);
+	return res;
+}
+
+int health_temp(struct health_log *hl, uint64_t from, uint64_t to)
+{
+	int k, temp = HEALTH_NONE, before = HEALTH_NONE;
+
+	pthread_mutex_lock(&hl->mutex);
+	for (k = 0; k < hl->num; ++k)
+	{
+		const struct health_sample *s = hl->s + k;
+
+		if (HEALTH_NONE == s->temp)
+			continue;
+		if (s->t < from)
+			before = s->temp;
+		else if (s->t > to)
+			break;
+		else if (s->temp > temp)
+			temp = s->temp;
+	}
+	pthread_mutex_unlock(&hl->mutex);
+	return (HEALTH_NONE == temp) ? before : temp;
+}
+
+int health_temp_max(struct health_log *hl)
+{
+	int k, temp = HEALTH_NONE;
+
+	pthread_mutex_lock(&hl->mutex);
+	for (k = 0; k < hl->num; ++k)
+		if (hl->s[k].temp > temp)
+			temp = hl->s[k].temp;
+	pthread_mutex_unlock(&hl->mutex);
+	return temp;
+}
+
+static int
+cmp_mbps(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+void health_link_dips(struct health_log *hl, int pct, int *errs, int *dips,
+		      int *both)
+{
+	const struct health_sample *s;
+	double *v, med;
+	int k, dip;
+
+	*errs = *dips = *both = 0;
+	pthread_mutex_lock(&hl->mutex);
+	v = (hl->num > 1) ? (double *)malloc((hl->num - 1) * sizeof(double))
+			  : NULL;
+	if (NULL == v)
+	{
+		pthread_mutex_unlock(&hl->mutex);
+		return;
+	}
+	for (k = 1; k < hl->num; ++k)
+		v[k - 1] = hl->s[k].mbps;
+	qsort(v, hl->num - 1, sizeof(double), cmp_mbps);
+	med = v[(hl->num - 1) / 2];
+	free(v);
+	for (k = 1; k < hl->num; ++k)
+	{
+		s = hl->s + k;
+		dip = (s->mbps * 100.0 < med * pct) || (s->stalls > 0);
+		if (s->link_errors > 0)
+			++*errs;
+		if (dip)
+			++*dips;
+		if (dip && (s->link_errors > 0))
+			++*both;
+	}
+	pthread_mutex_unlock(&hl->mutex);
+}
+
+static uint64_t
+get_be(const uint8_t *p, int len)
+{
+	uint64_t v = 0;
+
+	while (len-- > 0)
+		v = (v << 8) | *p++;
+	return v;
+}
+
+// The parameters of page pg_code in pg; the end of them in *endp.
+// NULL when pg is not that page
+static const uint8_t *
+params(const uint8_t *pg, int len, int pg_code, const uint8_t **endp)
+{
+	int pg_len;
+
+	if ((len < 4) || ((pg[0] & 0x3f) != pg_code))
+		return NULL;
+	pg_len = (pg[2] << 8) | pg[3];
+	*endp = pg + ((4 + pg_len < len) ? 4 + pg_len : len);
+	return pg + 4;
+}
+
+int health_scsi_temp(const uint8_t *pg, int len, int *temp)
+{
+	const uint8_t *p, *end;
+
+	for (p = params(pg, len, LOG_TEMPERATURE, &end); p && (p + 4 <= end);
+	     p += 4 + p[3])
+	{
+		// byte 5 in degrees C, 0xff when the sensor has no value
+		if ((PARAM_TEMP == get_be(p, 2)) && (p[3] >= 2) && (p + 6 <= end) &&
+		    (0xff != p[5]))
+		{
+			*temp = p[5];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int health_scsi_read_errors(const uint8_t *pg, int len, int64_t *corrected,
+			    int64_t *uncorrected)
+{
+	const uint8_t *p, *end;
+	int code, plen;
+
+	*corrected = *uncorrected = -1;
+	p = params(pg, len, LOG_READ_ERRORS, &end);
+	if (NULL == p)
+		return -1;
+	for (; p + 4 <= end; p += 4 + plen)
+	{
+		code = (int)get_be(p, 2);
+		plen = p[3];
+		if ((p + 4 + plen > end) || (plen < 1) || (plen > 8))
+			continue;
+		if (PARAM_CORRECTED == code)
+			*corrected = (int64_t)get_be(p + 4, plen);
+		else if (PARAM_UNCORRECTED == code)
+			*uncorrected = (int64_t)get_be(p + 4, plen);
+	}
+	return 0;
+}
+
+int health_sas_phys(const uint8_t *pg, int len, struct health_phy *phy,
+		    int max)
+{
+	const uint8_t *p, *d, *end, *pend;
+	int k, c, n = 0;
+
+	p = params(pg, len, LOG_PROTOCOL_PORT, &end);
+	if (NULL == p)
+		return -1;
+	for (; p + 4 <= end; p += 4 + p[3])
+	{
+		// a port: byte 4 its protocol, byte 7 how many phy
+		// descriptors follow from byte 8
+		pend = p + 4 + p[3];
+		if ((pend > end) || (p[3] < 4) || (PROTO_SAS != (p[4] & 0xf)))
+			continue;
+		for (d = p + 8, k = 0; (k < p[7]) && (d + 4 <= pend);
+		     ++k, d += 4 + d[3])
+		{
+			if ((d + PHY_DESC_LEN > pend) || (4 + d[3] < PHY_DESC_LEN))
+				continue;
+			if (n == max)
+				return n;
+			phy[n].port = (int)get_be(p, 2);
+			phy[n].phy = d[1];
+			phy[n].attached = get_be(d + 16, 8);
+			for (c = 0; c < HEALTH_PHY_CTRS; ++c)
+				phy[n].cnt[c] = (uint32_t)get_be(d + 32 + 4 * c, 4);
+			++n;
+		}
+	}
+	return n;
+}
+
+static uint64_t
+get_le(const uint8_t *p, int len)
+{
+	uint64_t v = 0;
+
+	while (len-- > 0)
+		v = (v << 8) | p[len];
+	return v;
+}
+
+void health_nvme_smart(const uint8_t *log, int *temp, int64_t *media_errors)
+{
+	int kelvin = (int)get_le(log + 1, 2); // Composite Temperature
+
+	*temp = kelvin ? kelvin - 273 : HEALTH_NONE;
+	// Media and Data Integrity Errors, 16 bytes; the low 8 are plenty
+	*media_errors = (int64_t)(get_le(log + 160, 8) & INT64_MAX);
+}
+
+// The bytes of a descriptor of format fmt, 0 when SBC defines none
+static int
+glist_desc_len(int fmt)
+{
+	switch (fmt)
+	{
+	case GLIST_SHORT:
+		return 4;
+	case 1: // extended bytes from index
+	case 2: // extended physical sector
+	case GLIST_LONG:
+	case 4: // bytes from index
+	case 5: // physical sector
+		return 8;
+	case 6: // vendor specific
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+int64_t health_glist_count(const uint8_t *d, int len, int *fmt)
+{
+	int dl;
+
+	if (len < HEALTH_GLIST_HDR)
+		return -1;
+	*fmt = d[1] & 0x7;
+	dl = glist_desc_len(*fmt);
+	if (0 == dl)
+		return -1;
+	return (int64_t)get_be(d + 2, 2) / dl;
+}
+
+static int
+cmp_lba(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+int health_glist_lbas(const uint8_t *d, int len, int64_t *lba, int max)
+{
+	const uint8_t *p, *end;
+	int fmt, dl, n = 0;
+
+	if (health_glist_count(d, len, &fmt) < 0)
+		return -1;
+	if ((GLIST_SHORT != fmt) && (GLIST_LONG != fmt))
+		return -1;
+	dl = glist_desc_len(fmt);
+	end = d + HEALTH_GLIST_HDR + get_be(d + 2, 2);
+	if (end > d + len)
+		end = d + len;
+	for (p = d + HEALTH_GLIST_HDR; (p + dl <= end) && (n < max); p += dl)
+		lba[n++] = (int64_t)(get_be(p, dl) & INT64_MAX);
+	qsort(lba, n, sizeof(*lba), cmp_lba);
+	return n;
+}
+
+int health_glist_new(const int64_t *was, int nwas, const int64_t *now,
+		     int nnow, int64_t *out, int max)
+{
+	int j = 0, k, n = 0;
+
+	for (k = 0; k < nnow; ++k)
+	{
+		while ((j < nwas) && (was[j] < now[k]))
+			++j;
+		if ((j < nwas) && (was[j] == now[k]))
+			continue;
+		if (n < max)
+			out[n] = now[k];
+		++n;
+	}
+	return n;
+}
+
+int health_selftest(const uint8_t *pg, int len, int *result, int *hours,
+		    int64_t *lba)
+{
+	const uint8_t *p, *end;
+	uint64_t addr;
+
+	for (p = params(pg, len, LOG_SELF_TEST, &end); p && (p + 4 <= end);
+	     p += 4 + p[3])
+	{
+		if ((PARAM_LATEST != get_be(p, 2)) || (p[3] < 0x10) ||
+		    (p + 20 > end))
+			continue;
+		// a parameter never used is all zeros
+		if (0 == (p[4] | p[5] | p[6] | p[7]))
+			return -1;
+		*result = p[4] & 0xf;
+		*hours = (int)get_be(p + 6, 2);
+		addr = get_be(p + 8, 8);
+		*lba = (UINT64_MAX == addr) ? -1 : (int64_t)(addr & INT64_MAX);
+		return 0;
+	}
+	return -1;
+}
+
+int health_bms_status(const uint8_t *pg, int len, int *status, int *progress,
+		      int *scans, int64_t *minutes)
+{
+	const uint8_t *p, *end;
+
+	for (p = params(pg, len, LOG_BACKGROUND_SCAN, &end); p && (p + 4 <= end);
+	     p += 4 + p[3])
+	{
+		if ((PARAM_BMS_STATUS != get_be(p, 2)) || (p[3] < 0x0c) ||
+		    (p + 16 > end))
+			continue;
+		*minutes = (int64_t)get_be(p + 4, 4);
+		*status = p[9];
+		*scans = (int)get_be(p + 14, 2);
+		*progress = (int)get_be(p + 12, 2);
+		return 0;
+	}
+	return -1;
+}
+
+int health_bms_lbas(const uint8_t *pg, int len, int64_t since, int64_t *lba,
+		    int max)
+{
+	const uint8_t *p, *end;
+	int n = 0;
+
+	for (p = params(pg, len, LOG_BACKGROUND_SCAN, &end); p && (p + 4 <= end);
+	     p += 4 + p[3])
+	{
+		// medium scan parameters are 0x0001 to 0x0800, 20 bytes each
+		if ((PARAM_BMS_STATUS == get_be(p, 2)) || (p[3] < 0x14) ||
+		    (p + 24 > end))
+			continue;
+		if (((int64_t)get_be(p + 4, 4) < since) ||
+		    (SK_MEDIUM_ERROR != (p[8] & 0xf)))
+			continue;
+		if (n < max)
+			lba[n] = (int64_t)(get_be(p + 16, 8) & INT64_MAX);
+		++n;
+	}
+	return n;
+}
@@ -0,0 +1,126 @@
+/*
+ * health.h
+ *
+ *  Drive health sampled while a scan runs: the temperature and the read
+ *  error counters, from the Temperature (0x0d) and Read Error Counter
+ *  (0x03) log pages of a SCSI drive or the SMART / Health Information
+ *  log of an NVMe controller. The pages are decoded here; dskread's
+ *  health thread asks for them through a file descriptor of its own,
+ *  so a log page never waits in the data path's queue. A sample keeps
+ *  where the scan was and how fast it went since the one before, which
+ *  puts a drop in throughput next to the temperature that came with it.
+ *  The grown defect list, READ DEFECT DATA (10), is decoded here too:
+ *  the number of defects from its header and, of a block format list,
+ *  their LBAs. So are the Self-Test Results (0x10) and Background
+ *  Scan Results (0x15) pages --offload watches a drive scan itself by.
+ *  Of a SAS drive the Protocol Specific Port page (0x18) gives the
+ *  error counters of each phy; what they gained between samples, set
+ *  against the dips in throughput, tells a marginal cable or expander
+ *  port from a drive that is slow by itself.
+ */
+
+#ifndef HEALTH_H_
+#define HEALTH_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define HEALTH_NONE INT32_MIN // temperature the drive did not report
+#define HEALTH_SMART_LEN 512  // NVMe SMART / Health Information log
+#define HEALTH_GLIST_HDR 4     // READ DEFECT DATA (10) header
+#define HEALTH_ST_RUNNING 0xf  // self-test result: in progress
+#define HEALTH_PORT_LEN 2048   // Protocol Specific Port page read
+#define HEALTH_PHYS 16	       // phys of it kept
+#define HEALTH_PHY_CTRS 4      // error counters of a phy
+
+struct health_sample
+{
+	uint64_t t;	     // lat_now_ns()
+	int64_t lba;	     // the scan had got to
+	double mbps;	     // since the sample before, 0 for the first
+	int temp;	     // degrees C, HEALTH_NONE
+	int64_t corrected;   // read errors corrected, -1 not reported
+	int64_t uncorrected; // read errors uncorrected (NVMe: media errors), -1
+	int64_t link_errors; // SAS phy errors since the sample before, -1
+	int64_t stalls;	     // READs timed out or aborted since then
+};
+
+struct health_phy
+{
+	int port;	   // relative target port identifier
+	int phy;	   // phy identifier
+	uint64_t attached; // SAS address of what it is attached to
+	// invalid DWORD, running disparity error, loss of DWORD
+	// synchronization and phy reset problem counts
+	uint32_t cnt[HEALTH_PHY_CTRS];
+};
+
+struct health_log
+{
+	struct health_sample *s;
+	int num;
+	int cap;
+	pthread_mutex_t mutex;
+};
+
+void health_init(struct health_log *hl);
+void health_free(struct health_log *hl);
+// Safe from several threads at once. Returns 0, -1 when out of memory
+int health_add(struct health_log *hl, const struct health_sample *s);
+// The highest temperature sampled in [from, to], else that of the last
+// sample before from; HEALTH_NONE when there is neither
+int health_temp(struct health_log *hl, uint64_t from, uint64_t to);
+// The highest temperature of the log, HEALTH_NONE when none
+int health_temp_max(struct health_log *hl);
+// Of the samples after the first: into *errs those that gained SAS phy
+// errors, into *dips those read at under pct % of their median MB/s or
+// that had READs stall, into *both the dips that gained phy errors too
+void health_link_dips(struct health_log *hl, int pct, int *errs, int *dips,
+		      int *both);
+
+// LOG SENSE Temperature page pg of len bytes. Returns 0, -1 when it
+// holds no current temperature
+int health_scsi_temp(const uint8_t *pg, int len, int *temp);
+// LOG SENSE Read Error Counter page: total errors corrected and
+// uncorrected, -1 each one the page lacks. Returns 0, -1 when it is not
+// that page
+int health_scsi_read_errors(const uint8_t *pg, int len, int64_t *corrected,
+			    int64_t *uncorrected);
+// NVMe SMART / Health Information log of HEALTH_SMART_LEN bytes: the
+// composite temperature and the media and data integrity errors
+void health_nvme_smart(const uint8_t *log, int *temp, int64_t *media_errors);
+// LOG SENSE Protocol Specific Port page: the SAS phys of each port, at
+// most max, into phy. Returns how many, -1 when it is not that page
+int health_sas_phys(const uint8_t *pg, int len, struct health_phy *phy,
+		    int max);
+
+// READ DEFECT DATA (10) of len bytes, at least the header: the number of
+// defects the list holds, at most 0xffff bytes of them, and its format
+// into *fmt. Returns -1 when the format is not one SBC defines
+int64_t health_glist_count(const uint8_t *d, int len, int *fmt);
+// The LBAs of a short or long block format list d of len bytes, sorted,
+// into lba, at most max. Returns how many, -1 when not a block format
+int health_glist_lbas(const uint8_t *d, int len, int64_t *lba, int max);
+// The LBAs of sorted now[] not in sorted was[] into out, at most max.
+// Returns how many there are, those that did not fit too
+int health_glist_new(const int64_t *was, int nwas, const int64_t *now,
+		     int nnow, int64_t *out, int max);
+
+// LOG SENSE Self-Test Results page: of the most recent self-test its
+// result code (0 passed, 3 to 7 failed, HEALTH_ST_RUNNING), the power
+// on hours it was at and the LBA of the first failure, -1 none. Returns
+// 0, -1 when the log holds no self-test
+int health_selftest(const uint8_t *pg, int len, int *result, int *hours,
+		    int64_t *lba);
+// LOG SENSE Background Scan Results page: the scan status (0 none
+// active, 1 and 2 scanning, 3 and above halted), its progress of 65536,
+// the medium scans done and the power on minutes. Returns 0, -1 when it
+// is not that page
+int health_bms_status(const uint8_t *pg, int len, int *status, int *progress,
+		      int *scans, int64_t *minutes);
+// The LBAs of the medium errors that page records at or after power on
+// minute since, into lba, at most max. Returns how many there are
+int health_bms_lbas(const uint8_t *pg, int len, int64_t since, int64_t *lba,
+		    int max);
+
+#endif /* HEALTH_H_ */
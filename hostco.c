@@ -0,0 +1,289 @@
+/*
+ * hostco.c
+ *
+ *  The segment is a header and HOSTCO_PROCS slots, zeroed when created
+ *  and never truncated, as other processes have it mapped. A slot is
+ *  free when its pid is 0 or no longer exists; pid reuse can keep one
+ *  taken until the process now holding that pid exits, which only
+ *  makes the shares smaller for a while. The threads of this process
+ *  are kept apart by a mutex, as they all hold the one flock().
+ *
+ *  Lock files are never removed: one unlinked while another process
+ *  waits on it would let a third lock a new file of the same name.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hostco.h"
+
+#define HOSTCO_DIR "/dev/shm" // where shm_open() puts its segments
+
+struct hostco_link
+{
+	char key[HOSTCO_KEY_SZ];
+	double cap[2]; // bytes/s, READs/s, 0 -> none
+};
+
+struct hostco_proc
+{
+	int32_t pid; // 0 -> free
+	int32_t nlinks;
+	struct hostco_link link[HOSTCO_LINKS];
+};
+
+struct hostco_seg
+{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t procs;
+	struct hostco_proc proc[HOSTCO_PROCS];
+};
+
+struct hostco_hold
+{
+	char *path;
+	int fd;
+};
+
+static pthread_mutex_t hc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct hostco_seg *hc_seg;
+static struct hostco_proc *hc_self;
+static int hc_fd = -1;
+static char hc_name[64];
+static struct hostco_hold *hc_holds;
+static int hc_num_holds;
+
+static int
+proc_live(const struct hostco_proc *p)
+{
+	return p->pid && ((0 == kill(p->pid, 0)) || (ESRCH != errno));
+}
+
+int hostco_open(const char *name)
+{
+	struct stat st;
+	int k, res = -1;
+
+	if (NULL == name)
+		name = HOSTCO_NAME;
+	pthread_mutex_lock(&hc_mutex);
+	if (hc_seg)
+	{
+		pthread_mutex_unlock(&hc_mutex);
+		return 0;
+	}
+	snprintf(hc_name, sizeof(hc_name), "%s", name);
+	hc_fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	if (hc_fd < 0)
+		goto out;
+	flock(hc_fd, LOCK_EX);
+	if (fstat(hc_fd, &st) ||
+	    ((0 == st.st_size) && ftruncate(hc_fd, sizeof(*hc_seg))))
+		goto fail;
+	if ((size_t)st.st_size && ((size_t)st.st_size < sizeof(*hc_seg)))
+	{
+		errno = EPROTO;
+		goto fail;
+	}
+	hc_seg = (struct hostco_seg *)mmap(NULL, sizeof(*hc_seg),
+					   PROT_READ | PROT_WRITE, MAP_SHARED,
+					   hc_fd, 0);
+	if (MAP_FAILED == hc_seg)
+	{
+		hc_seg = NULL;
+		goto fail;
+	}
+	if (0 == hc_seg->magic)
+	{
+		hc_seg->version = HOSTCO_VERSION;
+		hc_seg->procs = HOSTCO_PROCS;
+		hc_seg->magic = HOSTCO_MAGIC;
+	}
+	if ((HOSTCO_MAGIC != hc_seg->magic) ||
+	    (HOSTCO_VERSION != hc_seg->version))
+	{
+		errno = EPROTO;
+		goto fail;
+	}
+	for (k = 0; k < HOSTCO_PROCS; ++k)
+		if (!proc_live(hc_seg->proc + k))
+			break;
+	if (HOSTCO_PROCS == k)
+	{
+		errno = EUSERS;
+		goto fail;
+	}
+	hc_self = hc_seg->proc + k;
+	memset(hc_self, 0, sizeof(*hc_self));
+	hc_self->pid = getpid();
+	flock(hc_fd, LOCK_UN);
+	res = 0;
+	goto out;
+fail:
+	k = errno;
+	if (hc_seg)
+		munmap(hc_seg, sizeof(*hc_seg));
+	hc_seg = NULL;
+	close(hc_fd);
+	hc_fd = -1;
+	errno = k;
+out:
+	pthread_mutex_unlock(&hc_mutex);
+	return res;
+}
+
+int hostco_share(const char *key, const double *cap, double *share)
+{
+	struct hostco_proc *p;
+	double low[2] = {0.0, 0.0};
+	int k, j, c, n = 0;
+
+	share[0] = share[1] = 0.0;
+	pthread_mutex_lock(&hc_mutex);
+	if (NULL == hc_seg)
+	{
+		pthread_mutex_unlock(&hc_mutex);
+		errno = EBADF;
+		return -1;
+	}
+	flock(hc_fd, LOCK_EX);
+	for (j = 0; j < hc_self->nlinks; ++j)
+		if (0 == strncmp(hc_self->link[j].key, key, HOSTCO_KEY_SZ))
+			break;
+	if (j == hc_self->nlinks)
+	{
+		if (HOSTCO_LINKS == j)
+		{
+			flock(hc_fd, LOCK_UN);
+			pthread_mutex_unlock(&hc_mutex);
+			errno = ENOSPC;
+			return -1;
+		}
+		snprintf(hc_self->link[j].key, HOSTCO_KEY_SZ, "%s", key);
+		++hc_self->nlinks;
+	}
+	hc_self->link[j].cap[0] = cap[0];
+	hc_self->link[j].cap[1] = cap[1];
+	for (k = 0; k < HOSTCO_PROCS; ++k)
+	{
+		p = hc_seg->proc + k;
+		if (!proc_live(p))
+		{
+			p->pid = 0; // reaped
+			continue;
+		}
+		for (j = 0; j < p->nlinks; ++j)
+			if (0 == strncmp(p->link[j].key, key, HOSTCO_KEY_SZ))
+				break;
+		if (j == p->nlinks)
+			continue;
+		++n;
+		for (c = 0; c < 2; ++c)
+			if ((p->link[j].cap[c] > 0) &&
+			    ((0 == low[c]) || (p->link[j].cap[c] < low[c])))
+				low[c] = p->link[j].cap[c];
+	}
+	flock(hc_fd, LOCK_UN);
+	pthread_mutex_unlock(&hc_mutex);
+	share[0] = low[0] / n;
+	share[1] = low[1] / n;
+	return n;
+}
+
+int hostco_claim(const char *id, long *holderp)
+{
+	struct hostco_hold *hp;
+	char path[256], buf[32], *cp;
+	ssize_t len;
+	int k, fd;
+
+	snprintf(path, sizeof(path), HOSTCO_DIR "%s.%s",
+		 hc_name[0] ? hc_name : HOSTCO_NAME, id);
+	for (cp = path + strlen(HOSTCO_DIR) + 1; *cp; ++cp)
+		if (('/' == *cp) || (' ' == *cp))
+			*cp = '_';
+	pthread_mutex_lock(&hc_mutex);
+	for (k = 0; k < hc_num_holds; ++k)
+		if (0 == strcmp(hc_holds[k].path, path))
+		{
+			pthread_mutex_unlock(&hc_mutex);
+			return 0; // reopened
+		}
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		goto fail;
+	if (flock(fd, LOCK_EX | LOCK_NB))
+	{
+		if (EWOULDBLOCK != errno)
+			goto fail;
+		len = pread(fd, buf, sizeof(buf) - 1, 0);
+		buf[(len > 0) ? len : 0] = '\0';
+		*holderp = strtol(buf, NULL, 10);
+		close(fd);
+		pthread_mutex_unlock(&hc_mutex);
+		return 1;
+	}
+	hp = (struct hostco_hold *)realloc(hc_holds,
+					   (hc_num_holds + 1) * sizeof(*hp));
+	if (NULL == hp)
+		goto fail;
+	hc_holds = hp;
+	hp += hc_num_holds;
+	hp->path = strdup(path);
+	if (NULL == hp->path)
+		goto fail;
+	hp->fd = fd;
+	++hc_num_holds;
+	len = snprintf(buf, sizeof(buf), "%ld\n", (long)getpid());
+	if (ftruncate(fd, 0) || (pwrite(fd, buf, len, 0) != len))
+	{
+		// the claim holds, only its pid is not told
+	}
+	pthread_mutex_unlock(&hc_mutex);
+	return 0;
+fail:
+	k = errno;
+	if (fd >= 0)
+		close(fd);
+	pthread_mutex_unlock(&hc_mutex);
+	errno = k;
+	return -1;
+}
+
+void hostco_close(void)
+{
+	int k;
+
+	pthread_mutex_lock(&hc_mutex);
+	for (k = 0; k < hc_num_holds; ++k)
+	{
+		close(hc_holds[k].fd);
+		free(hc_holds[k].path);
+	}
+	free(hc_holds);
+	hc_holds = NULL;
+	hc_num_holds = 0;
+	if (hc_seg)
+	{
+		flock(hc_fd, LOCK_EX);
+		memset(hc_self, 0, sizeof(*hc_self));
+		flock(hc_fd, LOCK_UN);
+		munmap(hc_seg, sizeof(*hc_seg));
+		close(hc_fd);
+	}
+	hc_seg = NULL;
+	hc_self = NULL;
+	hc_fd = -1;
+	pthread_mutex_unlock(&hc_mutex);
+}
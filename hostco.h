@@ -0,0 +1,43 @@
+/*
+ * hostco.h
+ *
+ *  Coordination of the dskread processes of one host. A POSIX shm
+ *  segment holds a slot per process with the links it reads through
+ *  (a host adapter "host3", "*" for the host as a whole) and the caps
+ *  it was given for them. The cap of a link is the lowest any live
+ *  process states, and each of the processes on it gets an equal
+ *  share, capped or not, so independent runs split what the link
+ *  carries instead of each taking it all. Slots of processes that are
+ *  gone are reaped by whoever looks next; the segment is locked with
+ *  flock(), which a crash releases.
+ *
+ *  A device is claimed by flock() on a lock file of its identity next
+ *  to the segment, held until the process exits, so two processes
+ *  never scan one drive, by whatever path each named it.
+ */
+
+#ifndef HOSTCO_H_
+#define HOSTCO_H_
+
+#define HOSTCO_MAGIC 0x6f637473686b7364ULL // "dskhstco"
+#define HOSTCO_VERSION 1
+#define HOSTCO_PROCS 64
+#define HOSTCO_LINKS 16 // of one process
+#define HOSTCO_KEY_SZ 32
+#define HOSTCO_NAME "/dskread-host"
+
+// Attaches to segment name (HOSTCO_NAME when NULL), creating it, and
+// takes a slot. Returns 0, -1 with errno set on errors
+int hostco_open(const char *name);
+// This process reads through link key with caps cap[2], bytes/s and
+// READs/s, 0 when it has none. Sets share[2] to its equal part of the
+// lowest cap of the live processes on key, 0 when none has one. Returns
+// how many they are, -1 on errors
+int hostco_share(const char *key, const double *cap, double *share);
+// Claims device id. Returns 0 when it is this process's now, 1 when
+// another holds it, its pid in *holderp, -1 with errno set on errors
+int hostco_claim(const char *id, long *holderp);
+// Frees the slot and the claims
+void hostco_close(void);
+
+#endif /* HOSTCO_H_ */
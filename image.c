@@ -0,0 +1,450 @@
+/*
+ * image.c
+ *
+ *  Blocks are classified a grain of at least 4 KiB at a time, the page
+ *  and file system block a hole can be, with the pattern check against
+ *  a zero and a 0xff word. Zero and 0xff runs are held open across the
+ *  puts until data ends them, so a mostly empty disk is a few records.
+ *  The record stream goes through buffers handed to the writer thread,
+ *  so compression and a slow pipe hold up the reading only once they
+ *  are all full.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "common.h"
+#include "image.h"
+
+#define IMAGE_GRAIN 4096
+#define IMAGE_BUFS 4
+#define IMAGE_BUF_SZ (4 * 1024 * 1024)
+#define IMAGE_HDR_SZ 13 // of a record
+
+static const char image_magic[6] = {'D', 'S', 'K', 'I', 'M', 'G'};
+
+struct image
+{
+	int fd;
+	int blk_sz;
+	int64_t num_sect;
+	int records;     // the record stream, else raw
+	int grain;       // blocks classified at a time
+	int64_t end;     // 1 + the last lba put
+	int64_t blocks;  // in the records so far
+	int run_kind;    // the zero or 0xff record held open, -1 none
+	int64_t run_lba;
+	int64_t run_len;
+	struct image_stats st;
+	// the stage: buf[cur] is filled, nq from qhead queued to the thread
+	uint8_t *buf[IMAGE_BUFS];
+	size_t len[IMAGE_BUFS];
+	int cur;
+	int qhead;
+	int nq;
+	int closing;
+	int err;         // errno of the first write that failed
+	pthread_t tid;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+#ifdef HAVE_ZSTD
+	ZSTD_CCtx *cctx;
+	uint8_t *zout;
+	size_t zout_sz;
+#endif
+};
+
+static int
+write_all(int fd, const uint8_t *p, size_t len)
+{
+	ssize_t res;
+
+	while (len > 0)
+	{
+		res = write(fd, p, len);
+		if ((res < 0) && (EINTR == errno))
+			continue;
+		if (res <= 0)
+			return res ? errno : EIO;
+		p += res;
+		len -= res;
+	}
+	return 0;
+}
+
+static int
+pwrite_all(int fd, const uint8_t *p, size_t len, off_t off)
+{
+	ssize_t res;
+
+	while (len > 0)
+	{
+		res = pwrite(fd, p, len, off);
+		if ((res < 0) && (EINTR == errno))
+			continue;
+		if (res <= 0)
+			return res ? errno : EIO;
+		p += res;
+		len -= res;
+		off += res;
+	}
+	return 0;
+}
+
+// The thread's output of len bytes of the stream at p, compressed
+// first when it is. flush ends the zstd frame. Returns 0, else errno
+static int
+stage_out(struct image *im, const uint8_t *p, size_t len, int flush)
+{
+#ifdef HAVE_ZSTD
+	if (im->cctx)
+	{
+		ZSTD_inBuffer in = {p, len, 0};
+		size_t left;
+		int res;
+
+		do
+		{
+			ZSTD_outBuffer out = {im->zout, im->zout_sz, 0};
+
+			left = ZSTD_compressStream2(im->cctx, &out, &in,
+						    flush ? ZSTD_e_end : ZSTD_e_continue);
+			if (ZSTD_isError(left))
+			{
+				fprintf(stderr, "zstd: %s\n", ZSTD_getErrorName(left));
+				return EIO;
+			}
+			res = write_all(im->fd, im->zout, out.pos);
+			if (res)
+				return res;
+			__atomic_fetch_add(&im->st.out, (int64_t)out.pos,
+					   __ATOMIC_RELAXED);
+		} while ((in.pos < in.size) || (flush && left));
+		return 0;
+	}
+#endif
+	(void)flush;
+	__atomic_fetch_add(&im->st.out, (int64_t)len, __ATOMIC_RELAXED);
+	return write_all(im->fd, p, len);
+}
+
+static void *
+stage_thread(void *arg)
+{
+	struct image *im = (struct image *)arg;
+	int k, res;
+
+	pthread_mutex_lock(&im->mutex);
+	for (;;)
+	{
+		while ((0 == im->nq) && !im->closing)
+			pthread_cond_wait(&im->cond, &im->mutex);
+		if (0 == im->nq)
+			break;
+		k = im->qhead;
+		pthread_mutex_unlock(&im->mutex);
+		res = im->err ? 0 : stage_out(im, im->buf[k], im->len[k], 0);
+		pthread_mutex_lock(&im->mutex);
+		if (res && !im->err)
+			im->err = res;
+		im->qhead = (im->qhead + 1) % IMAGE_BUFS;
+		--im->nq;
+		pthread_cond_broadcast(&im->cond);
+	}
+	pthread_mutex_unlock(&im->mutex);
+	if (!im->err)
+		im->err = stage_out(im, NULL, 0, 1);
+	return NULL;
+}
+
+// Queues the buffer being filled and takes the next, once free
+static int
+stage_queue(struct image *im)
+{
+	pthread_mutex_lock(&im->mutex);
+	++im->nq;
+	pthread_cond_broadcast(&im->cond);
+	while ((IMAGE_BUFS == im->nq) && !im->err)
+		pthread_cond_wait(&im->cond, &im->mutex);
+	im->cur = (im->qhead + im->nq) % IMAGE_BUFS;
+	im->len[im->cur] = 0;
+	pthread_mutex_unlock(&im->mutex);
+	if (im->err)
+	{
+		errno = im->err;
+		return -1;
+	}
+	return 0;
+}
+
+// Appends len bytes at p to the stream
+static int
+emit(struct image *im, const void *p, size_t len)
+{
+	const uint8_t *q = (const uint8_t *)p;
+	size_t n;
+
+	while (len > 0)
+	{
+		n = IMAGE_BUF_SZ - im->len[im->cur];
+		if (n > len)
+			n = len;
+		memcpy(im->buf[im->cur] + im->len[im->cur], q, n);
+		im->len[im->cur] += n;
+		q += n;
+		len -= n;
+		if ((IMAGE_BUF_SZ == im->len[im->cur]) && stage_queue(im))
+			return -1;
+	}
+	return 0;
+}
+
+static void
+put_le(uint8_t *p, uint64_t v, int bytes)
+{
+	while (bytes-- > 0)
+	{
+		*p++ = (uint8_t)(v & 0xff);
+		v >>= 8;
+	}
+}
+
+static int
+emit_record(struct image *im, int kind, int64_t lba, uint32_t blocks)
+{
+	uint8_t hdr[IMAGE_HDR_SZ];
+
+	hdr[0] = (uint8_t)kind;
+	put_le(hdr + 1, (uint64_t)lba, 8);
+	put_le(hdr + 9, blocks, 4);
+	return emit(im, hdr, sizeof(hdr));
+}
+
+// Ends the zero or 0xff record held open
+static int
+run_end(struct image *im)
+{
+	int res = 0;
+
+	while ((im->run_kind >= 0) && (im->run_len > 0) && (0 == res))
+	{
+		uint32_t n = (im->run_len > UINT32_MAX) ? UINT32_MAX
+							: (uint32_t)im->run_len;
+
+		res = emit_record(im, im->run_kind, im->run_lba, n);
+		im->run_lba += n;
+		im->run_len -= n;
+		im->blocks += n;
+	}
+	im->run_kind = -1;
+	return res;
+}
+
+// A run within one put: data, or a zero or 0xff run to hold open
+static int
+run_out(struct image *im, int kind, int64_t lba, const uint8_t *p, int n)
+{
+	int64_t bytes = (int64_t)n * im->blk_sz;
+
+	if (IMAGE_DATA == kind)
+		im->st.data += bytes;
+	else if (IMAGE_ZERO == kind)
+		im->st.zero += bytes;
+	else
+		im->st.ff += bytes;
+	if (!im->records)
+	{
+		int res;
+
+		if (IMAGE_ZERO == kind)
+			return 0; // a hole
+		res = pwrite_all(im->fd, p, bytes, (off_t)lba * im->blk_sz);
+		__atomic_fetch_add(&im->st.out, res ? 0 : bytes, __ATOMIC_RELAXED);
+		errno = res;
+		return res ? -1 : 0;
+	}
+	if (IMAGE_DATA != kind)
+	{
+		if ((kind == im->run_kind) && (im->run_lba + im->run_len == lba))
+		{
+			im->run_len += n;
+			return 0;
+		}
+		if (run_end(im))
+			return -1;
+		im->run_kind = kind;
+		im->run_lba = lba;
+		im->run_len = n;
+		return 0;
+	}
+	if (run_end(im) || emit_record(im, IMAGE_DATA, lba, n) ||
+	    emit(im, p, bytes))
+		return -1;
+	im->blocks += n;
+	return 0;
+}
+
+static int
+grain_kind(const struct image *im, const uint8_t *p, size_t len)
+{
+	int uni = buf_uniform(p, len);
+
+	if (0x00 == uni)
+		return IMAGE_ZERO;
+	if (im->records && (0xff == uni))
+		return IMAGE_FF;
+	return IMAGE_DATA; // 0xff is data in a raw image
+}
+
+int image_put(struct image *im, int64_t lba, const uint8_t *buf, int blocks)
+{
+	int k, n, kind, run = 0, run_kind = -1;
+
+	for (k = 0; k < blocks; k += n)
+	{
+		n = (blocks - k < im->grain) ? blocks - k : im->grain;
+		kind = grain_kind(im, buf + (size_t)k * im->blk_sz,
+				  (size_t)n * im->blk_sz);
+		if ((kind != run_kind) && run &&
+		    run_out(im, run_kind, lba + k - run,
+			    buf + (size_t)(k - run) * im->blk_sz, run))
+			return -1;
+		if (kind != run_kind)
+			run = 0;
+		run_kind = kind;
+		run += n;
+	}
+	if (run && run_out(im, run_kind, lba + blocks - run,
+			   buf + (size_t)(blocks - run) * im->blk_sz, run))
+		return -1;
+	if (lba + blocks > im->end)
+		im->end = lba + blocks;
+	return 0;
+}
+
+int image_records(const struct image *im)
+{
+	return im->records;
+}
+
+void image_get_stats(const struct image *im, struct image_stats *st)
+{
+	*st = im->st;
+	st->out = __atomic_load_n(&im->st.out, __ATOMIC_RELAXED);
+}
+
+static void
+image_free(struct image *im)
+{
+	int k;
+
+	for (k = 0; k < IMAGE_BUFS; ++k)
+		free(im->buf[k]);
+#ifdef HAVE_ZSTD
+	if (im->cctx)
+		ZSTD_freeCCtx(im->cctx);
+	free(im->zout);
+#endif
+	free(im);
+}
+
+struct image *image_open(int fd, int blk_sz, int64_t num_sect, int records,
+			 int level, int threads)
+{
+	struct image *im;
+	struct stat st;
+	uint8_t hdr[20];
+	int k;
+
+#ifndef HAVE_ZSTD
+	if (level > 0)
+	{
+		errno = ENOTSUP;
+		return NULL;
+	}
+#endif
+	im = (struct image *)calloc(1, sizeof(*im));
+	if (NULL == im)
+		return NULL;
+	im->fd = fd;
+	im->blk_sz = blk_sz;
+	im->num_sect = num_sect;
+	im->records = records || (level > 0) || fstat(fd, &st) ||
+		      !S_ISREG(st.st_mode);
+	im->grain = (blk_sz >= IMAGE_GRAIN) ? 1 : IMAGE_GRAIN / blk_sz;
+	im->run_kind = -1;
+	pthread_mutex_init(&im->mutex, NULL);
+	pthread_cond_init(&im->cond, NULL);
+	if (!im->records)
+		return im;
+	for (k = 0; k < IMAGE_BUFS; ++k)
+		if (NULL == (im->buf[k] = (uint8_t *)malloc(IMAGE_BUF_SZ)))
+			goto err;
+#ifdef HAVE_ZSTD
+	if (level > 0)
+	{
+		im->zout_sz = ZSTD_CStreamOutSize();
+		im->zout = (uint8_t *)malloc(im->zout_sz);
+		im->cctx = ZSTD_createCCtx();
+		if ((NULL == im->zout) || (NULL == im->cctx) ||
+		    ZSTD_isError(ZSTD_CCtx_setParameter(
+			    im->cctx, ZSTD_c_compressionLevel, level)))
+			goto err;
+		if ((threads > 0) &&
+		    ZSTD_isError(ZSTD_CCtx_setParameter(im->cctx,
+							ZSTD_c_nbWorkers, threads)))
+			fprintf(stderr, "zstd: no worker threads in this "
+				"libzstd, compressing on one\n");
+	}
+#else
+	(void)threads;
+#endif
+	memcpy(hdr, image_magic, sizeof(image_magic));
+	hdr[6] = IMAGE_VERSION;
+	hdr[7] = 0;
+	put_le(hdr + 8, blk_sz, 4);
+	put_le(hdr + 12, (uint64_t)num_sect, 8);
+	emit(im, hdr, sizeof(hdr));
+	if (pthread_create(&im->tid, NULL, stage_thread, im))
+		goto err;
+	return im;
+err:
+	image_free(im);
+	errno = ENOMEM;
+	return NULL;
+}
+
+int image_close(struct image *im)
+{
+	int res = 0;
+
+	if (im->records)
+	{
+		if (run_end(im) || emit_record(im, IMAGE_END, im->blocks, 0))
+			res = errno;
+		pthread_mutex_lock(&im->mutex);
+		if (im->len[im->cur])
+			++im->nq;
+		im->closing = 1;
+		pthread_cond_broadcast(&im->cond);
+		pthread_mutex_unlock(&im->mutex);
+		pthread_join(im->tid, NULL);
+		if (im->err && !res)
+			res = im->err;
+	}
+	else if (ftruncate(im->fd, (off_t)im->end * im->blk_sz))
+		res = errno; // the zero blocks at the end, hole as well
+	if (close(im->fd) && !res)
+		res = errno;
+	image_free(im);
+	errno = res;
+	return res ? -1 : 0;
+}
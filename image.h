@@ -0,0 +1,59 @@
+/*
+ * image.h
+ *
+ *  Capture of a device to an image, runs of zero blocks and of all
+ *  0xff blocks not stored as data. To a regular file the image is raw,
+ *  block l at byte l * block size, zero runs left as holes that
+ *  SEEK_HOLE finds. To a pipe, or when asked, it is a stream of records
+ *  instead, which can be compressed by zstd. The stream is written, and
+ *  compressed, by a thread of its own, zstd adding workers of its own.
+ *
+ *  Record stream, integers little endian:
+ *    "DSKIMG" and a version byte (1) and a zero byte,
+ *    u32 block size, u64 blocks of the device, then per record
+ *    u8 kind (IMAGE_*), u64 lba, u32 blocks and, of IMAGE_DATA only,
+ *    the blocks. Records are in lba order, the gaps between them not
+ *    imaged; the last is IMAGE_END, of no blocks, its lba the number
+ *    of blocks in all the records before it.
+ */
+
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+#include <stdint.h>
+
+#define IMAGE_VERSION 1
+
+#define IMAGE_DATA 0
+#define IMAGE_ZERO 1 // blocks of all zeros
+#define IMAGE_FF 2   // blocks of all 0xff
+#define IMAGE_END 3
+
+struct image;
+
+struct image_stats
+{
+	int64_t data; // bytes of the device stored as data
+	int64_t zero; // as zero runs
+	int64_t ff;   // as 0xff runs
+	int64_t out;  // bytes written out, after compression
+};
+
+// Images to fd, which it then owns, a device of num_sect blocks of
+// blk_sz. records forces the record stream onto a regular file; level
+// > 0 compresses it with zstd at that level on threads workers, 0 ->
+// on the writer thread alone. NULL with errno set on errors, ENOTSUP
+// for level > 0 when built without zstd
+struct image *image_open(int fd, int blk_sz, int64_t num_sect, int records,
+			 int level, int threads);
+// Adds blocks at lba from buf, lba above those added before. Returns 0,
+// -1 with errno set on a write error
+int image_put(struct image *im, int64_t lba, const uint8_t *buf, int blocks);
+// Whether im is the record stream
+int image_records(const struct image *im);
+void image_get_stats(const struct image *im, struct image_stats *st);
+// Ends the image and closes its fd. Returns 0, -1 with errno set when
+// it could not be written in full
+int image_close(struct image *im);
+
+#endif /* IMAGE_H_ */
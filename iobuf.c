@@ -0,0 +1,518 @@
+/*
+ * iobuf.c
+ *
+ *  The pool is a list searched under one mutex: buffers are taken and
+ *  given back per pass and per recovered error, not per READ, and there
+ *  are at most as many as READs in flight. Placement is a preferred
+ *  policy set with mbind() before the pages are faulted in, so a node
+ *  that is full still gives memory from another. Small buffers are not
+ *  placed, they share pages with the heap.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "iobuf.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#define HUGE_2M (21 << MAP_HUGE_SHIFT)
+#define HUGE_1G (30 << MAP_HUGE_SHIFT)
+#define MPOL_PREFERRED 1
+#define MAX_NODES 1024
+
+// A buffer of the pool; class is its rounded length
+struct slot
+{
+	void *addr;
+	size_t len;
+	int node;
+	int mapped; // munmap(), else free()
+	int busy;
+	int dma; // taken by dma_map
+};
+
+static struct slot *slots;
+static size_t num_slots, cap_slots;
+static size_t pool_bytes;
+static int lock_pages, lock_failed;
+static int (*dma_map)(void *addr, size_t len);
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Size classes: powers of two up to IOBUF_HUGE_MIN, 2 MiB multiples
+// above, the hugepage the buffer is mapped in
+static size_t
+class_len(size_t len)
+{
+	size_t c = 4096, m = (size_t)2 << 20;
+
+	if (len >= IOBUF_HUGE_MIN)
+		return (len + m - 1) & ~(m - 1);
+	while (c < len)
+		c *= 2;
+	return c;
+}
+
+static void *
+map_huge(size_t len)
+{
+	int base = MAP_PRIVATE | MAP_ANONYMOUS;
+	size_t g = (size_t)1 << 30;
+	void *p;
+
+	// reserved hugepages first, 1 GiB ones only for whole 1 GiB
+	if (0 == (len & (g - 1)))
+	{
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			 base | MAP_HUGETLB | HUGE_1G, -1, 0);
+		if (MAP_FAILED != p)
+			return p;
+	}
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		 base | MAP_HUGETLB | HUGE_2M, -1, 0);
+	if (MAP_FAILED != p)
+		return p;
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE, base, -1, 0);
+	if (MAP_FAILED == p)
+		return NULL;
+	madvise(p, len, MADV_HUGEPAGE);
+	return p;
+}
+
+// A new buffer of class len, placed and faulted in
+static int
+slot_new(struct slot *sp, size_t len, int node)
+{
+	unsigned long mask[MAX_NODES / (8 * sizeof(unsigned long))];
+	size_t k, page = sysconf(_SC_PAGESIZE);
+
+	memset(sp, 0, sizeof(*sp));
+	sp->len = len;
+	sp->node = node;
+	if (len < IOBUF_HUGE_MIN)
+	{
+		if (posix_memalign(&sp->addr, page, len))
+			return -1;
+	}
+	else
+	{
+		sp->addr = map_huge(len);
+		if (NULL == sp->addr)
+			return -1;
+		sp->mapped = 1;
+		if ((node >= 0) && (node < MAX_NODES))
+		{
+			memset(mask, 0, sizeof(mask));
+			mask[node / (8 * sizeof(long))] |=
+				1UL << (node % (8 * sizeof(long)));
+			syscall(SYS_mbind, sp->addr, len, MPOL_PREFERRED, mask,
+				MAX_NODES, 0);
+		}
+	}
+	for (k = 0; k < len; k += page)
+		((volatile char *)sp->addr)[k] = 0;
+	if (lock_pages && !lock_failed && mlock(sp->addr, len))
+	{
+		lock_failed = 1;
+		perror("iobuf: mlock, buffers stay pageable");
+	}
+	return 0;
+}
+
+void *iobuf_alloc(size_t len, int node, void **freep)
+{
+	size_t k, c = class_len(len);
+	struct slot s;
+
+	*freep = NULL;
+	pthread_mutex_lock(&pool_mutex);
+	// an idle buffer of the class, on the node if there is one
+	for (k = 0; k < num_slots; ++k)
+		if (!slots[k].busy && (slots[k].len == c) &&
+		    ((slots[k].node == node) || (c < IOBUF_HUGE_MIN)))
+			break;
+	if (k < num_slots)
+	{
+		slots[k].busy = 1;
+		*freep = slots[k].addr;
+		pthread_mutex_unlock(&pool_mutex);
+		return *freep;
+	}
+	pthread_mutex_unlock(&pool_mutex);
+
+	if (slot_new(&s, c, node))
+		return NULL;
+	s.busy = 1;
+	pthread_mutex_lock(&pool_mutex);
+	if (num_slots == cap_slots)
+	{
+		size_t cap = cap_slots ? 2 * cap_slots : 64;
+		struct slot *p = (struct slot *)realloc(slots, cap * sizeof(*p));
+
+		if (NULL == p)
+		{
+			pthread_mutex_unlock(&pool_mutex);
+			if (s.mapped)
+				munmap(s.addr, s.len);
+			else
+				free(s.addr);
+			return NULL;
+		}
+		slots = p;
+		cap_slots = cap;
+	}
+	// under the mutex, so iobuf_set_dma() passes it or it is passed here
+	if (s.mapped && dma_map)
+		s.dma = (0 == dma_map(s.addr, s.len));
+	slots[num_slots++] = s;
+	pool_bytes += c;
+	pthread_mutex_unlock(&pool_mutex);
+	*freep = s.addr;
+	return s.addr;
+}
+
+void iobuf_free(void *freep)
+{
+	size_t k;
+
+	if (NULL == freep)
+		return;
+	pthread_mutex_lock(&pool_mutex);
+	for (k = 0; k < num_slots; ++k)
+		if (slots[k].addr == freep)
+		{
+			slots[k].busy = 0;
+			break;
+		}
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+int iobuf_sgl_alloc(struct iobuf_sgl *sgl, size_t len, size_t chunk, int node)
+{
+	size_t off, n;
+	void *freep;
+
+	sgl->n = 0;
+	sgl->len = len;
+	if ((0 == chunk) || ((len + chunk - 1) / chunk > IOBUF_SGL_MAX))
+		return -1;
+	for (off = 0; off < len; off += n)
+	{
+		n = (len - off < chunk) ? len - off : chunk;
+		sgl->iov[sgl->n].iov_base = iobuf_alloc(n, node, &freep);
+		if (NULL == sgl->iov[sgl->n].iov_base)
+		{
+			iobuf_sgl_free(sgl);
+			return -1;
+		}
+		sgl->iov[sgl->n++].iov_len = n;
+	}
+	return 0;
+}
+
+void iobuf_sgl_free(struct iobuf_sgl *sgl)
+{
+	int k;
+
+	// a pool buffer is its own free pointer
+	for (k = 0; k < sgl->n; ++k)
+		iobuf_free(sgl->iov[k].iov_base);
+	sgl->n = 0;
+}
+
+const void *iobuf_ref(const void *data, size_t dlen, size_t len)
+{
+	size_t c = class_len(len), k, n;
+	void *p;
+
+	if (c < IOBUF_HUGE_MIN)
+	{
+		// whole pages, for mprotect()
+		p = mmap(NULL, c, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (MAP_FAILED == p)
+			p = NULL;
+	}
+	else
+		p = map_huge(c);
+	if ((NULL == p) || (0 == dlen))
+		return p;
+	for (k = 0; k < c; k += n)
+	{
+		n = (c - k < dlen) ? c - k : dlen;
+		memcpy((char *)p + k, data, n);
+	}
+	mprotect(p, c, PROT_READ);
+	return p;
+}
+
+void iobuf_set_mlock(int on)
+{
+	lock_pages = on;
+}
+
+void iobuf_set_dma(int (*map)(void *addr, size_t len))
+{
+	size_t k;
+
+	pthread_mutex_lock(&pool_mutex);
+	dma_map = map;
+	for (k = 0; map && (k < num_slots); ++k)
+		if (slots[k].mapped && !slots[k].dma)
+			slots[k].dma = (0 == map(slots[k].addr, slots[k].len));
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+size_t iobuf_pool_bytes(void)
+{
+	size_t n;
+
+	pthread_mutex_lock(&pool_mutex);
+	n = pool_bytes;
+	pthread_mutex_unlock(&pool_mutex);
+	return n;
+}
+
+int iobuf_node_of(const char *real)
+{
+	char path[PATH_MAX], buf[16];
+	FILE *fp;
+	char *cp;
+	int node;
+
+	if ((NULL == real) || access("/sys/devices/system/node/node1", F_OK))
+		return -1;
+	snprintf(path, sizeof(path), "%s", real);
+	for (;;)
+	{
+		size_t n = strlen(path);
+
+		snprintf(path + n, sizeof(path) - n, "/numa_node");
+		fp = fopen(path, "r");
+		path[n] = '\0';
+		if (fp)
+		{
+			node = fgets(buf, sizeof(buf), fp) ? atoi(buf) : -1;
+			fclose(fp);
+			if (node >= 0)
+				return node;
+		}
+		cp = strrchr(path, '/');
+		if ((NULL == cp) || (cp == path))
+			break;
+		*cp = '\0';
+	}
+	return -1;
+}
+
+// The CPUs of cpulist file path ("0-3,8-11") into *set. Returns 0, -1
+// when it is missing or empty
+static int
+cpulist_read(const char *path, cpu_set_t *set)
+{
+	char list[4096], *cp, *ep;
+	long lo, hi;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (NULL == fp)
+		return -1;
+	cp = fgets(list, sizeof(list), fp);
+	fclose(fp);
+	if (NULL == cp)
+		return -1;
+	CPU_ZERO(set);
+	while (*cp && ('\n' != *cp))
+	{
+		lo = strtol(cp, &ep, 10);
+		if (ep == cp)
+			return -1;
+		hi = ('-' == *ep) ? strtol(ep + 1, &ep, 10) : lo;
+		for (; (lo <= hi) && (lo < CPU_SETSIZE); ++lo)
+			CPU_SET(lo, set);
+		cp = (',' == *ep) ? ep + 1 : ep;
+	}
+	return CPU_COUNT(set) ? 0 : -1;
+}
+
+int iobuf_bind_thread(int node)
+{
+	char path[64];
+	cpu_set_t set;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+		 node);
+	if (cpulist_read(path, &set))
+		return -1;
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) ? -1 : 0;
+}
+
+// The CPUs interrupt irq is taken on into *set: where the kernel put it,
+// else where it may go. Returns 0, -1 when unknown
+static int
+irq_affinity(int irq, cpu_set_t *set)
+{
+	char path[64];
+
+	snprintf(path, sizeof(path), "/proc/irq/%d/effective_affinity_list", irq);
+	if (0 == cpulist_read(path, set))
+		return 0;
+	snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity_list", irq);
+	return cpulist_read(path, set);
+}
+
+// The CPUs the interrupts of the closest ancestor of sysfs directory
+// real that has any are taken on, MSI or the one line of INTx, into
+// *set. Returns 0, -1 when there are none
+static int
+irq_cpus(const char *real, cpu_set_t *set)
+{
+	char path[PATH_MAX];
+	struct dirent *de;
+	cpu_set_t one;
+	DIR *dir;
+	FILE *fp;
+	char *cp;
+	int irq;
+
+	CPU_ZERO(set);
+	snprintf(path, sizeof(path), "%s", real);
+	for (;;)
+	{
+		size_t n = strlen(path);
+
+		snprintf(path + n, sizeof(path) - n, "/msi_irqs");
+		dir = opendir(path);
+		path[n] = '\0';
+		if (dir)
+		{
+			while ((de = readdir(dir)))
+			{
+				irq = atoi(de->d_name);
+				if ((irq > 0) && (0 == irq_affinity(irq, &one)))
+					CPU_OR(set, set, &one);
+			}
+			closedir(dir);
+			return CPU_COUNT(set) ? 0 : -1;
+		}
+		snprintf(path + n, sizeof(path) - n, "/irq");
+		fp = fopen(path, "r");
+		path[n] = '\0';
+		if (fp)
+		{
+			if (1 != fscanf(fp, "%d", &irq))
+				irq = 0;
+			fclose(fp);
+			if (irq > 0)
+				return irq_affinity(irq, set);
+		}
+		cp = strrchr(path, '/');
+		if ((NULL == cp) || (cp == path))
+			break;
+		*cp = '\0';
+	}
+	return -1;
+}
+
+// The CPUs sharing the last level cache of cpu into *set. Returns 0, -1
+// when sysfs does not say
+static int
+llc_cpus(int cpu, cpu_set_t *set)
+{
+	char path[96];
+	int k, level, best = -1;
+	FILE *fp;
+
+	for (k = 0;; ++k)
+	{
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, k);
+		fp = fopen(path, "r");
+		if (NULL == fp)
+			break;
+		if ((1 == fscanf(fp, "%d", &level)) && (level > best))
+			best = level;
+		fclose(fp);
+	}
+	for (--k; k >= 0; --k)
+	{
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, k);
+		fp = fopen(path, "r");
+		if (NULL == fp)
+			continue;
+		level = (1 == fscanf(fp, "%d", &level)) ? level : -1;
+		fclose(fp);
+		if (level != best)
+			continue;
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",
+			 cpu, k);
+		return cpulist_read(path, set);
+	}
+	return -1;
+}
+
+// The NUMA node of cpu, -1 when unknown or the system has a single node
+static int
+cpu_node(int cpu)
+{
+	char path[64];
+	cpu_set_t set;
+	int node;
+
+	if (access("/sys/devices/system/node/node1", F_OK))
+		return -1;
+	for (node = 0;; ++node)
+	{
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d",
+			 node);
+		if (access(path, F_OK))
+			return -1;
+		snprintf(path + strlen(path), sizeof(path) - strlen(path),
+			 "/cpulist");
+		if ((0 == cpulist_read(path, &set)) && CPU_ISSET(cpu, &set))
+			return node;
+	}
+}
+
+int iobuf_irq_domain(const char *real, cpu_set_t *set, int *node)
+{
+	cpu_set_t irqs, dom, in;
+	int cpu, best = -1, most = 0;
+
+	*node = -1;
+	if (irq_cpus(real, &irqs))
+		return -1;
+	for (cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+	{
+		if (!CPU_ISSET(cpu, &irqs) || llc_cpus(cpu, &dom))
+			continue;
+		CPU_AND(&in, &dom, &irqs);
+		if (CPU_COUNT(&in) > most)
+		{
+			most = CPU_COUNT(&in);
+			best = cpu;
+			*set = dom;
+		}
+	}
+	// the managed queues of NVMe and of many HBAs are spread over every
+	// CPU; no domain is the one that completes the commands
+	if ((best < 0) || (2 * most <= CPU_COUNT(&irqs)))
+		return -1;
+	*node = cpu_node(best);
+	return 0;
+}
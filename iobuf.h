@@ -0,0 +1,72 @@
+/*
+ * iobuf.h
+ *
+ *  Transfer buffers on the NUMA node of the adapter a device hangs
+ *  off, in 1 GiB or 2 MiB hugepages when the system has them reserved,
+ *  else in transparent hugepages, so that multi-MiB direct transfers
+ *  cost few TLB entries and no traffic across sockets.
+ *
+ *  Buffers come from one pool for the process, in size classes: a
+ *  buffer freed goes back to its class for the next device, pass or
+ *  error recovery to take, so the memory held is what was in use at
+ *  once, at most the queue depths of the devices running together,
+ *  and a scan allocates only while the pool grows to that.
+ */
+
+#ifndef IOBUF_H_
+#define IOBUF_H_
+
+#include <stddef.h>
+#include <sched.h>
+#include <sys/uio.h>
+
+// Buffers this large or larger get hugepages
+#define IOBUF_HUGE_MIN (2 * 1024 * 1024)
+#define IOBUF_SGL_MAX 256 // segments of a scatter list
+
+// A transfer buffer in separate segments of the pool, none larger than
+// the chunk it was allocated with; iov matches sg_iovec_t
+struct iobuf_sgl
+{
+	int n;
+	size_t len;
+	struct iovec iov[IOBUF_SGL_MAX];
+};
+
+// Page aligned, node -1 -> any node, the pages faulted in. The contents
+// are those of the last user. *freep is what iobuf_free() takes.
+// Returns NULL when out of memory
+void *iobuf_alloc(size_t len, int node, void **freep);
+// Back to the pool
+void iobuf_free(void *freep);
+// len in segments of chunk bytes, the last one shorter. Returns 0, -1
+// when out of memory or len needs more than IOBUF_SGL_MAX segments
+int iobuf_sgl_alloc(struct iobuf_sgl *sgl, size_t len, size_t chunk, int node);
+// Its segments back to the pool
+void iobuf_sgl_free(struct iobuf_sgl *sgl);
+// mlock() the buffers the pool allocates from now on
+void iobuf_set_mlock(int on);
+// Passes every hugepage buffer of the pool to map, those it holds and
+// those it maps from now on, until map takes it, for a user space
+// driver to DMA to (spdkdev_dma_map())
+void iobuf_set_dma(int (*map)(void *addr, size_t len));
+// A read only region of len bytes, data of dlen repeated over it, in
+// hugepages as a large buffer is, outside the pool and shared by every
+// device: the reference the patterns are written from and compared to.
+// Returns NULL when out of memory
+const void *iobuf_ref(const void *data, size_t dlen, size_t len);
+// The bytes the pool holds, in use or not
+size_t iobuf_pool_bytes(void);
+// The node of the closest ancestor of sysfs directory real that has a
+// numa_node, -1 when unknown or the system has a single node
+int iobuf_node_of(const char *real);
+// Pins the calling thread to the CPUs of node. Returns 0, -1 on errors
+int iobuf_bind_thread(int node);
+// The CPUs sharing the last level cache with most of those the
+// interrupts of sysfs directory real (its adapter, or the NVMe
+// controller) are taken on, into *set, and their node into *node, -1
+// when the system has a single node. Returns 0, -1 when they are
+// unknown or spread over every domain alike, as managed queues are
+int iobuf_irq_domain(const char *real, cpu_set_t *set, int *node);
+
+#endif /* IOBUF_H_ */
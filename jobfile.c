@@ -0,0 +1,762 @@
+/*
+ * jobfile.c
+ *
+ *  The plan is read whole, a flat list of groups and phases, and each
+ *  job is a child process: the options, parsed into one global set for
+ *  all devices, cannot differ between two jobs of one process. The
+ *  scheduler starts what is ready and then waits for any child, so
+ *  no device waits on another.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "jobfile.h"
+
+#define JOB_NAME_SZ 64
+
+enum
+{
+	JOB_PENDING,
+	JOB_RUNNING,
+	JOB_PASSED,
+	JOB_FAILED,
+	JOB_SKIPPED,
+	JOB_NONE // the device's group is not in the phase
+};
+
+struct strv
+{
+	char **v;
+	int n;
+};
+
+struct jgroup
+{
+	char name[JOB_NAME_SZ];
+	char lot[JOB_NAME_SZ]; // "" -> name
+	struct strv devs;
+	struct strv args;
+	struct strv hosts; // globs, none -> any
+};
+
+struct jphase
+{
+	char name[JOB_NAME_SZ];
+	struct strv args;
+	int *after; // phase indices, all before this one
+	int nafter;
+	int *groups; // group indices, NULL -> all
+	int ngroups;
+};
+
+struct jdev
+{
+	const char *name;
+	int group;
+	int busy; // a job of it is running
+};
+
+struct job
+{
+	int dev;
+	int phase;
+	int state;
+	pid_t pid;
+	int status;
+	double t0;
+	double secs;
+};
+
+struct job_plan
+{
+	int parallel;
+	double watts;
+	char log[4096];
+	struct strv extra; // words after the group's, see job_set_extra()
+	job_tick_fn tick;
+	job_end_fn end;
+	void *arg;
+	struct jgroup *g;
+	int ng;
+	struct jphase *ph;
+	int nph;
+	struct jdev *dev;
+	int ndev;
+	struct job *job; // ndev * nph, those of a device in phase order
+};
+
+static double
+now_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+strv_add(struct strv *sv, const char *s, size_t len)
+{
+	char **v = (char **)realloc(sv->v, (sv->n + 2) * sizeof(char *));
+
+	if (NULL == v)
+		return -1;
+	sv->v = v;
+	v[sv->n] = (char *)malloc(len + 1);
+	if (NULL == v[sv->n])
+		return -1;
+	memcpy(v[sv->n], s, len);
+	v[sv->n][len] = '\0';
+	v[++sv->n] = NULL;
+	return 0;
+}
+
+static void
+strv_free(struct strv *sv)
+{
+	int k;
+
+	for (k = 0; k < sv->n; ++k)
+		free(sv->v[k]);
+	free(sv->v);
+	sv->v = NULL;
+	sv->n = 0;
+}
+
+// Splits s into words as sh does: blanks between them, '' and ""
+// quoting, \ escaping one character. Returns 0, -1 on an open quote
+// or out of memory
+static int
+split_words(const char *s, struct strv *sv)
+{
+	char word[4096];
+	size_t len;
+	char quote;
+
+	while (*s)
+	{
+		while (isspace((unsigned char)*s))
+			++s;
+		if ('\0' == *s)
+			break;
+		for (len = 0, quote = 0; *s && (quote || !isspace((unsigned char)*s));
+		     ++s)
+		{
+			if (quote && (*s == quote))
+				quote = 0;
+			else if (!quote && (('\'' == *s) || ('"' == *s)))
+				quote = *s;
+			else if (('\\' == *s) && s[1] && ('\'' != quote))
+				word[len++] = *++s;
+			else
+				word[len++] = *s;
+			if (len >= sizeof(word) - 1)
+				return -1;
+		}
+		if (quote || strv_add(sv, word, len))
+			return -1;
+	}
+	return 0;
+}
+
+static int
+find_name(const char *name, const void *base, size_t size, int n)
+{
+	int k;
+
+	for (k = 0; k < n; ++k)
+		if (0 == strcmp(name, (const char *)base + k * size))
+			return k; // name is the first member of both structs
+	return -1;
+}
+
+// A name list of after or groups into indices, each of a name in
+// [0, limit) of base, what it names. Returns 0, else -1 with the name
+// not found in err
+static int
+name_list(const char *val, const void *base, size_t size, int limit,
+	  const char *what, int **idxp, int *np, char *err, int errlen)
+{
+	struct strv sv = {NULL, 0};
+	int k, i;
+
+	free(*idxp);
+	*idxp = NULL;
+	*np = 0;
+	if (split_words(val, &sv))
+	{
+		snprintf(err, errlen, "bad list '%s'", val);
+		return -1;
+	}
+	*idxp = (int *)calloc(sv.n + 1, sizeof(int));
+	for (k = 0; *idxp && (k < sv.n); ++k)
+	{
+		i = find_name(sv.v[k], base, size, limit);
+		if (i < 0)
+		{
+			snprintf(err, errlen, "'%s' is not a %s before it", sv.v[k],
+				 what);
+			strv_free(&sv);
+			return -1;
+		}
+		(*idxp)[(*np)++] = i;
+	}
+	strv_free(&sv);
+	return *idxp ? 0 : -1;
+}
+
+static char *
+trim(char *s)
+{
+	char *e;
+
+	while (isspace((unsigned char)*s))
+		++s;
+	for (e = s + strlen(s); (e > s) && isspace((unsigned char)e[-1]); --e)
+		;
+	*e = '\0';
+	return s;
+}
+
+// One "key = value" of the section being read. Returns 0, -1 with err
+static int
+set_key(struct job_plan *p, int sect, char *key, char *val, char *err,
+	int errlen)
+{
+	struct jgroup *g = p->ng ? p->g + p->ng - 1 : NULL;
+	struct jphase *ph = p->nph ? p->ph + p->nph - 1 : NULL;
+	char *ep;
+
+	if ((0 == sect) && (0 == strcmp(key, "parallel")))
+	{
+		p->parallel = (int)strtol(val, &ep, 10);
+		if (*ep || (p->parallel < 0))
+		{
+			snprintf(err, errlen, "parallel takes a number of jobs");
+			return -1;
+		}
+		return 0;
+	}
+	if ((0 == sect) && (0 == strcmp(key, "log")))
+	{
+		snprintf(p->log, sizeof(p->log), "%s", val);
+		return 0;
+	}
+	if ((0 == sect) && (0 == strcmp(key, "watts")))
+	{
+		p->watts = strtod(val, &ep);
+		if (*ep || (p->watts <= 0))
+		{
+			snprintf(err, errlen, "watts takes the watts of a drive");
+			return -1;
+		}
+		return 0;
+	}
+	if ((1 == sect) && (0 == strcmp(key, "lot")))
+	{
+		if (strlen(val) >= JOB_NAME_SZ)
+		{
+			snprintf(err, errlen, "lot name too long");
+			return -1;
+		}
+		snprintf(g->lot, JOB_NAME_SZ, "%s", val);
+		return 0;
+	}
+	if (((1 == sect) && (0 == strcmp(key, "devices")) &&
+	     split_words(val, &g->devs)) ||
+	    ((1 == sect) && (0 == strcmp(key, "args")) &&
+	     split_words(val, &g->args)) ||
+	    ((1 == sect) && (0 == strcmp(key, "hosts")) &&
+	     split_words(val, &g->hosts)) ||
+	    ((2 == sect) && (0 == strcmp(key, "args")) &&
+	     split_words(val, &ph->args)))
+	{
+		snprintf(err, errlen, "bad %s, an open quote", key);
+		return -1;
+	}
+	if ((0 != sect) && (0 == strcmp(key, "args")))
+		return 0;
+	if ((1 == sect) && ((0 == strcmp(key, "devices")) ||
+			    (0 == strcmp(key, "hosts"))))
+		return 0;
+	if ((2 == sect) && (0 == strcmp(key, "after")))
+		return name_list(val, p->ph, sizeof(struct jphase), p->nph - 1,
+				 "phase", &ph->after, &ph->nafter, err, errlen);
+	if ((2 == sect) && (0 == strcmp(key, "groups")))
+		return name_list(val, p->g, sizeof(struct jgroup), p->ng, "group",
+				 &ph->groups, &ph->ngroups, err, errlen);
+	snprintf(err, errlen, "unknown key '%s'", key);
+	return -1;
+}
+
+// A new [group name] or [phase name]. Returns 0, -1 with err
+static int
+new_section(struct job_plan *p, int sect, const char *name, char *err,
+	    int errlen)
+{
+	void *v;
+
+	if ('\0' == name[0] || (strlen(name) >= JOB_NAME_SZ) ||
+	    ((1 == sect) && (find_name(name, p->g, sizeof(struct jgroup),
+				       p->ng) >= 0)) ||
+	    ((2 == sect) && (find_name(name, p->ph, sizeof(struct jphase),
+				       p->nph) >= 0)))
+	{
+		snprintf(err, errlen, "section needs a name of its own");
+		return -1;
+	}
+	if (1 == sect)
+	{
+		v = realloc(p->g, (p->ng + 1) * sizeof(struct jgroup));
+		if (NULL == v)
+			return -1;
+		p->g = (struct jgroup *)v;
+		memset(p->g + p->ng, 0, sizeof(struct jgroup));
+		snprintf(p->g[p->ng++].name, JOB_NAME_SZ, "%s", name);
+		return 0;
+	}
+	v = realloc(p->ph, (p->nph + 1) * sizeof(struct jphase));
+	if (NULL == v)
+		return -1;
+	p->ph = (struct jphase *)v;
+	memset(p->ph + p->nph, 0, sizeof(struct jphase));
+	snprintf(p->ph[p->nph].name, JOB_NAME_SZ, "%s", name);
+	if (p->nph) // after the phase before it unless told otherwise
+	{
+		p->ph[p->nph].after = (int *)malloc(sizeof(int));
+		if (NULL == p->ph[p->nph].after)
+			return -1;
+		p->ph[p->nph].after[0] = p->nph - 1;
+		p->ph[p->nph].nafter = 1;
+	}
+	++p->nph;
+	return 0;
+}
+
+// Whether group g runs on this host
+static int
+on_host(const struct jgroup *g)
+{
+	char host[256] = "";
+	int k;
+
+	if (0 == g->hosts.n)
+		return 1;
+	gethostname(host, sizeof(host) - 1);
+	for (k = 0; k < g->hosts.n; ++k)
+		if (0 == fnmatch(g->hosts.v[k], host, 0))
+			return 1;
+	return 0;
+}
+
+// The devices of the groups and a job for each of them and each phase
+static int
+plan_jobs(struct job_plan *p, char *err, int errlen)
+{
+	int gi, k, d, ph, n = 0;
+
+	for (gi = 0; gi < p->ng; ++gi)
+		n += p->g[gi].devs.n;
+	p->dev = (struct jdev *)calloc(n ? n : 1, sizeof(struct jdev));
+	if (NULL == p->dev)
+		return -1;
+	for (gi = 0; gi < p->ng; ++gi)
+		for (k = 0; on_host(p->g + gi) && (k < p->g[gi].devs.n); ++k)
+		{
+			for (d = 0; d < p->ndev; ++d)
+				if (0 == strcmp(p->dev[d].name, p->g[gi].devs.v[k]))
+				{
+					snprintf(err, errlen, "%s is in two groups",
+						 p->dev[d].name);
+					return -1;
+				}
+			p->dev[p->ndev].name = p->g[gi].devs.v[k];
+			p->dev[p->ndev++].group = gi;
+		}
+	if ((0 == p->ndev) || (0 == p->nph))
+	{
+		snprintf(err, errlen, "no %s", p->ndev ? "phases"
+						       : "devices on this host");
+		return -1;
+	}
+	p->job = (struct job *)calloc(p->ndev * p->nph, sizeof(struct job));
+	if (NULL == p->job)
+		return -1;
+	for (d = 0; d < p->ndev; ++d)
+		for (ph = 0; ph < p->nph; ++ph)
+		{
+			struct job *j = p->job + d * p->nph + ph;
+
+			j->dev = d;
+			j->phase = ph;
+			j->state = JOB_NONE;
+			if (NULL == p->ph[ph].groups)
+				j->state = JOB_PENDING;
+			for (k = 0; k < p->ph[ph].ngroups; ++k)
+				if (p->ph[ph].groups[k] == p->dev[d].group)
+					j->state = JOB_PENDING;
+		}
+	return 0;
+}
+
+struct job_plan *job_load(const char *path, char *err, int errlen)
+{
+	struct job_plan *p = (struct job_plan *)calloc(1, sizeof(*p));
+	FILE *fp = fopen(path, "r");
+	char line[8192], *cp, *eq;
+	int lineno = 0, sect = -1, res = 0;
+
+	if ((NULL == p) || (NULL == fp))
+	{
+		snprintf(err, errlen, "%s: %s", path, strerror(errno));
+		if (fp)
+			fclose(fp);
+		free(p);
+		return NULL;
+	}
+	while ((0 == res) && fgets(line, sizeof(line), fp))
+	{
+		++lineno;
+		cp = line + strcspn(line, "#;");
+		if (strchr(line, '"') || strchr(line, '\''))
+			cp = line + strcspn(line, "\n"); // quotes may hold them
+		*cp = '\0';
+		cp = trim(line);
+		if ('\0' == *cp)
+			continue;
+		if ('[' == *cp)
+		{
+			eq = strchr(cp, ']');
+			if (eq)
+				*eq = '\0';
+			cp = trim(cp + 1);
+			if (NULL == eq)
+				res = -1, snprintf(err, errlen, "no ']'");
+			else if (0 == strcmp(cp, "global"))
+				sect = 0;
+			else if (0 == strncmp(cp, "group ", 6))
+				res = new_section(p, sect = 1, trim(cp + 6), err,
+						  errlen);
+			else if (0 == strncmp(cp, "phase ", 6))
+				res = new_section(p, sect = 2, trim(cp + 6), err,
+						  errlen);
+			else
+				res = -1, snprintf(err, errlen,
+						   "unknown section [%s]", cp);
+		}
+		else if ((NULL == (eq = strchr(cp, '='))) || (sect < 0))
+		{
+			res = -1;
+			snprintf(err, errlen, "%s", (sect < 0) ? "outside a section"
+							       : "no '='");
+		}
+		else
+		{
+			*eq = '\0';
+			res = set_key(p, sect, trim(cp), trim(eq + 1), err, errlen);
+		}
+	}
+	fclose(fp);
+	if (res)
+	{
+		char msg[256];
+
+		snprintf(msg, sizeof(msg), "%s", err);
+		snprintf(err, errlen, "%s:%d: %s", path, lineno, msg);
+	}
+	else if (plan_jobs(p, err, errlen))
+		res = -1;
+	if (res)
+	{
+		job_free(p);
+		return NULL;
+	}
+	return p;
+}
+
+// Forks the job and execs self on it. Returns 0, -1 with errno set
+static int
+job_start(struct job_plan *p, struct job *j, const char *self, int verbose)
+{
+	const struct jphase *ph = p->ph + j->phase;
+	const struct jgroup *g = p->g + p->dev[j->dev].group;
+	int n = 1 + ph->args.n + g->args.n + p->extra.n + 2, k = 0, i, fd;
+	char **argv = (char **)calloc(n, sizeof(char *));
+	char log[8192], *cp;
+	struct strv extra = {NULL, 0};
+
+	if (NULL == argv)
+		return -1;
+	argv[k++] = (char *)self;
+	for (i = 0; i < ph->args.n; ++i)
+		argv[k++] = ph->args.v[i];
+	for (i = 0; i < g->args.n; ++i)
+		argv[k++] = g->args.v[i]; // after the phase's, so they win
+	for (i = 0; i < p->extra.n; ++i)
+	{
+		// "%d" the device index, what job_set_extra() promises
+		cp = strstr(p->extra.v[i], "%d");
+		if (cp)
+			snprintf(log, sizeof(log), "%.*s%d%s",
+				 (int)(cp - p->extra.v[i]), p->extra.v[i], j->dev,
+				 cp + 2);
+		if (strv_add(&extra, cp ? log : p->extra.v[i],
+			     strlen(cp ? log : p->extra.v[i])))
+		{
+			strv_free(&extra);
+			free(argv);
+			return -1;
+		}
+		argv[k++] = extra.v[i];
+	}
+	argv[k++] = (char *)p->dev[j->dev].name;
+	if (verbose)
+	{
+		fprintf(stderr, "job: %s %s:", p->dev[j->dev].name, ph->name);
+		for (i = 1; i < k; ++i)
+			fprintf(stderr, " %s", argv[i]);
+		fprintf(stderr, "\n");
+	}
+	fflush(stdout);
+	fflush(stderr);
+	j->pid = fork();
+	if (j->pid < 0)
+	{
+		strv_free(&extra);
+		free(argv);
+		return -1;
+	}
+	if (0 == j->pid)
+	{
+		if (p->log[0])
+		{
+			snprintf(log, sizeof(log), "%s/%s.%s.log", p->log,
+				 p->dev[j->dev].name + ('/' == p->dev[j->dev].name[0]),
+				 ph->name);
+			for (cp = log + strlen(p->log) + 1; *cp; ++cp)
+				if ('/' == *cp)
+					*cp = '_';
+			fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0)
+			{
+				perror(log);
+				_exit(126);
+			}
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+			close(fd);
+		}
+		execv(self, argv);
+		perror(self);
+		_exit(127);
+	}
+	strv_free(&extra);
+	free(argv);
+	j->t0 = now_secs();
+	j->state = JOB_RUNNING;
+	p->dev[j->dev].busy = 1;
+	return 0;
+}
+
+// The first job of device d not done yet, jobs after a failure skipped
+// on the way. NULL when there is none
+static struct job *
+job_next(struct job_plan *p, int d)
+{
+	struct job *jobs = p->job + d * p->nph, *j;
+	int ph, k, st;
+
+	for (ph = 0; ph < p->nph; ++ph)
+	{
+		j = jobs + ph;
+		if (JOB_PENDING != j->state)
+			continue;
+		for (k = 0; k < p->ph[ph].nafter; ++k)
+		{
+			st = jobs[p->ph[ph].after[k]].state;
+			if ((JOB_FAILED == st) || (JOB_SKIPPED == st))
+				break;
+		}
+		if (k == p->ph[ph].nafter)
+			return j;
+		j->state = JOB_SKIPPED;
+		printf("job: %s %s skipped, %s did not pass\n", p->dev[d].name,
+		       p->ph[ph].name, p->ph[p->ph[ph].after[k]].name);
+	}
+	return NULL;
+}
+
+int job_run(struct job_plan *p, const char *self, int verbose)
+{
+	int running = 0, ret = 0, d, k, status, counts[JOB_NONE + 1] = {0};
+	struct job *j;
+	pid_t pid;
+
+	for (;;)
+	{
+		for (d = 0; d < p->ndev; ++d)
+		{
+			if (p->dev[d].busy || (p->parallel && (running >= p->parallel)))
+				continue;
+			j = job_next(p, d);
+			if (NULL == j)
+				continue;
+			if (job_start(p, j, self, verbose))
+			{
+				perror("job: fork");
+				j->state = JOB_FAILED;
+				j->status = 127;
+				if (0 == ret)
+					ret = 127;
+				--d; // its next job instead
+				continue;
+			}
+			++running;
+		}
+		if (0 == running)
+			break;
+		if (p->tick)
+		{
+			pid = waitpid(-1, &status, WNOHANG);
+			if (0 == pid)
+			{
+				p->tick(p->arg); // waits a while of its own
+				continue;
+			}
+		}
+		else
+			pid = wait(&status);
+		if (pid < 0)
+		{
+			if (EINTR == errno)
+				continue;
+			perror("job: wait");
+			break;
+		}
+		for (k = 0; k < p->ndev * p->nph; ++k)
+			if ((JOB_RUNNING == p->job[k].state) && (p->job[k].pid == pid))
+				break;
+		if (k == p->ndev * p->nph)
+			continue; // not one of ours
+		j = p->job + k;
+		j->secs = now_secs() - j->t0;
+		j->status = WIFEXITED(status)	? WEXITSTATUS(status)
+			    : WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+						  : 1;
+		j->state = j->status ? JOB_FAILED : JOB_PASSED;
+		p->dev[j->dev].busy = 0;
+		--running;
+		if (j->status && (0 == ret))
+			ret = j->status;
+		printf("job: %s %s %s in %.1f s", p->dev[j->dev].name,
+		       p->ph[j->phase].name, j->status ? "failed" : "passed",
+		       j->secs);
+		if (j->status)
+			printf(", exit status %d", j->status);
+		printf("\n");
+		fflush(stdout);
+		if (p->end)
+			p->end(p->arg, j->dev, p->ph[j->phase].name, j->status,
+			       j->secs);
+	}
+	for (k = 0; k < p->ndev * p->nph; ++k)
+		++counts[p->job[k].state];
+	printf("jobs: %d passed, %d failed, %d skipped of %d devices and %d "
+	       "phases\n", counts[JOB_PASSED], counts[JOB_FAILED],
+	       counts[JOB_SKIPPED], p->ndev, p->nph);
+	return ret;
+}
+
+void job_free(struct job_plan *p)
+{
+	int k;
+
+	if (NULL == p)
+		return;
+	for (k = 0; k < p->ng; ++k)
+	{
+		strv_free(&p->g[k].devs);
+		strv_free(&p->g[k].args);
+		strv_free(&p->g[k].hosts);
+	}
+	strv_free(&p->extra);
+	for (k = 0; k < p->nph; ++k)
+	{
+		strv_free(&p->ph[k].args);
+		free(p->ph[k].after);
+		free(p->ph[k].groups);
+	}
+	free(p->g);
+	free(p->ph);
+	free(p->dev);
+	free(p->job);
+	free(p);
+}
+
+int job_set_extra(struct job_plan *p, int n, const char *const *words)
+{
+	int k;
+
+	strv_free(&p->extra);
+	for (k = 0; k < n; ++k)
+		if (strv_add(&p->extra, words[k], strlen(words[k])))
+			return -1;
+	return 0;
+}
+
+void job_set_hooks(struct job_plan *p, job_tick_fn tick, job_end_fn end,
+		   void *arg)
+{
+	p->tick = tick;
+	p->end = end;
+	p->arg = arg;
+}
+
+void job_set_parallel(struct job_plan *p, int n)
+{
+	p->parallel = (n > 0) ? n : 0;
+}
+
+int job_parallel(const struct job_plan *p)
+{
+	return p->parallel;
+}
+
+double job_watts(const struct job_plan *p)
+{
+	return (p->watts > 0) ? p->watts : JOB_WATTS;
+}
+
+int job_ndev(const struct job_plan *p)
+{
+	return p->ndev;
+}
+
+void job_dev_info(const struct job_plan *p, int d, struct job_dev_info *di)
+{
+	const struct jgroup *g = p->g + p->dev[d].group;
+	const struct job *jobs = p->job + d * p->nph;
+	int ph;
+
+	di->name = p->dev[d].name;
+	di->lot = g->lot[0] ? g->lot : g->name;
+	di->phase = NULL;
+	di->left = 0;
+	for (ph = 0; ph < p->nph; ++ph)
+	{
+		if (JOB_RUNNING == jobs[ph].state)
+			di->phase = p->ph[ph].name;
+		if ((JOB_RUNNING == jobs[ph].state) ||
+		    (JOB_PENDING == jobs[ph].state))
+			++di->left;
+	}
+}
@@ -0,0 +1,71 @@
+/*
+ * jobfile.h
+ *
+ *  A test plan of several devices and phases in one INI file, run as a
+ *  job per device and phase. A job is this program again with the
+ *  options of the phase, then of the device's group, then the device,
+ *  so a group overrides the phase. A job starts as soon as the phases
+ *  it comes after are done on its own device: drive A is verifying
+ *  while drive B is still wiping.
+ *
+ *  File format, '#' or ';' starts a comment:
+ *    [global]       parallel = n, jobs at once (0, the default, any)
+ *                   log = dir, each job's output to dir/<dev>.<phase>.log
+ *                   watts = w, a drive draws under test, for --power
+ *    [group name]   devices = the devices, blank separated
+ *                   args = options of its jobs, quoted as sh does
+ *                   hosts = globs of the hostnames it is on, any when left
+ *                   out, so one plan serves a lab of agents
+ *                   lot = the drive lot results add up in, its name when
+ *                   left out
+ *    [phase name]   args = options of the phase
+ *                   after = phases before it in the file that must have
+ *                   passed on the device, the one just before when left
+ *                   out; "after =" for none
+ *                   groups = the groups it runs on, all when left out
+ *  The jobs of one device run one at a time, in file order, a job
+ *  whose after phases did not all pass skipped; a phase a device does
+ *  not run counts as passed for it.
+ */
+
+#ifndef JOBFILE_H_
+#define JOBFILE_H_
+
+#define JOB_WATTS 10.0 // a drive under test when the plan does not say
+
+struct job_plan;
+
+struct job_dev_info
+{
+	const char *name;
+	const char *lot;
+	const char *phase; // running now, NULL -> none
+	int left;	   // jobs not done, that one included
+};
+
+// While jobs run, in place of waiting for them; it waits a little of
+// its own, polling what it serves
+typedef void (*job_tick_fn)(void *arg);
+// A job of device index dev ended with exit status status
+typedef void (*job_end_fn)(void *arg, int dev, const char *phase, int status,
+			   double secs);
+
+// The plan in path. NULL with a message in err on errors
+struct job_plan *job_load(const char *path, char *err, int errlen);
+// Runs the plan, each job by execv() of self. Returns 0 when every job
+// exited 0, else the exit status of the first job that did not
+int job_run(struct job_plan *p, const char *self, int verbose);
+void job_free(struct job_plan *p);
+// Words for every job after those of its group, "%d" in one the index
+// of its device. Returns 0, -1 when out of memory
+int job_set_extra(struct job_plan *p, int n, const char *const *words);
+void job_set_hooks(struct job_plan *p, job_tick_fn tick, job_end_fn end,
+		   void *arg);
+// Jobs at once from now on, 0 -> any
+void job_set_parallel(struct job_plan *p, int n);
+int job_parallel(const struct job_plan *p);
+double job_watts(const struct job_plan *p);
+int job_ndev(const struct job_plan *p);
+void job_dev_info(const struct job_plan *p, int d, struct job_dev_info *di);
+
+#endif /* JOBFILE_H_ */
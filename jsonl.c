@@ -0,0 +1,95 @@
+/*
+ * jsonl.c
+ *
+ *  The records go through an output sink of their own (outsink.h):
+ *  producers only take its mutex long enough to copy a record in, its
+ *  thread does the write(2)s. A record is dropped whole, never cut.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "jsonl.h"
+#include "outsink.h"
+
+static struct outsink *jsink;
+
+int jsonl_open(const char *path)
+{
+	int fd;
+
+	if (0 == strcmp(path, "-"))
+		fd = dup(STDOUT_FILENO); // the caller may point stdout elsewhere
+	else
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -1;
+	jsink = outsink_open(fd, JSONL_BUF_SZ, OUTSINK_DROP);
+	if (NULL == jsink)
+	{
+		close(fd);
+		return -1;
+	}
+	return 0;
+}
+
+void jsonl_close(void)
+{
+	outsink_close(jsink);
+	jsink = NULL;
+}
+
+int jsonl_enabled(void)
+{
+	return NULL != jsink;
+}
+
+void jsonl_printf(const char *fmt, ...)
+{
+	char rec[JSONL_REC_SZ];
+	va_list ap;
+	int len;
+
+	if (NULL == jsink)
+		return;
+	va_start(ap, fmt);
+	len = vsnprintf(rec, sizeof(rec) - 1, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+	if (len > (int)sizeof(rec) - 2)
+		len = sizeof(rec) - 2; // truncated, still one line
+	rec[len++] = '\n';
+	outsink_write(jsink, rec, len);
+}
+
+unsigned long jsonl_dropped(void)
+{
+	return jsink ? outsink_dropped(jsink, NULL) : 0;
+}
+
+char *jsonl_escape(char *dst, int len, const char *src)
+{
+	int n = 0;
+
+	for (; *src && (n < len - 7); ++src)
+	{
+		unsigned char c = (unsigned char)*src;
+
+		if (('"' == c) || ('\\' == c))
+		{
+			dst[n++] = '\\';
+			dst[n++] = c;
+		}
+		else if (c < 0x20)
+			n += snprintf(dst + n, len - n, "\\u%04x", c);
+		else
+			dst[n++] = c;
+	}
+	dst[n] = '\0';
+	return dst;
+}
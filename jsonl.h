@@ -0,0 +1,28 @@
+/*
+ * jsonl.h
+ *
+ *  JSON lines output: one record per line, formatted by the caller and
+ *  written out by a thread of its own, so a slow reader of the stream
+ *  never holds up the I/O. Records that do not fit in the buffer are
+ *  dropped and counted.
+ */
+
+#ifndef JSONL_H_
+#define JSONL_H_
+
+#define JSONL_BUF_SZ (1024 * 1024)
+#define JSONL_REC_SZ 4096 // longest record
+
+// path "-" is stdout. Return 0 on success, -1 on error
+int jsonl_open(const char *path);
+// Writes out what is buffered, then stops the writer thread
+void jsonl_close(void);
+int jsonl_enabled(void);
+// One record, the newline is added. Never blocks on the reader.
+void jsonl_printf(const char *fmt, ...)
+	__attribute__((format(printf, 1, 2)));
+unsigned long jsonl_dropped(void);
+// Copies src into dst as the inside of a JSON string
+char *jsonl_escape(char *dst, int len, const char *src);
+
+#endif /* JSONL_H_ */
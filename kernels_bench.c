@@ -0,0 +1,319 @@
+/*
+ * kernels_bench.c
+ *
+ *  dskread_kernels_bench: the speed of each data path kernel of util.c
+ *  at each ISA level the CPU has, buffers from a block to past the
+ *  caches, in GB/s and cycles a byte (the TSC on x86, none elsewhere).
+ *  A kernel is bound on its first call, some of them once for the
+ *  process, so each level runs in a child of its own with --force-isa
+ *  taken as cpu_force_isa() wants it, before any kernel is called.
+ *
+ *    dskread_kernels_bench [level...]   (default: all of them)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "common.h"
+
+#define BENCH_MIN_NS 50000000ULL // timed per kernel and size, at least
+#define BENCH_MAX_BYTES (4 << 20) // largest buffer
+#define BENCH_BLK 512
+
+static const char *levels[] = {"scalar", "sse2", "sse4.2",   "avx2",
+			       "avx512", "neon", "armv8-crc"};
+static const size_t sizes[] = {512, 4096, 65536, 1 << 20, BENCH_MAX_BYTES};
+
+static BYTE *buf, *buf2;
+static BYTE pat[PATTERN_WORD_SZ];
+static BYTE zero[PATTERN_WORD_SZ];
+static volatile uint64_t sink; // keeps the results from being optimised out
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t
+cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void
+k_pattern(size_t len)
+{
+	sink += pattern_check(buf, len, pat);
+}
+
+static void
+k_zero(size_t len)
+{
+	sink += pattern_check(buf2, len, zero);
+}
+
+static void
+k_compare(size_t len)
+{
+	sink += buf_compare(buf, buf + BENCH_MAX_BYTES, len);
+}
+
+static void
+k_pattern_stream(size_t len)
+{
+	sink += pattern_check_stream(buf, len, pat);
+}
+
+static void
+k_compare_stream(size_t len)
+{
+	sink += buf_compare_stream(buf, buf + BENCH_MAX_BYTES, len);
+}
+
+static void
+k_flips(size_t len)
+{
+	uint64_t up, down;
+
+	bit_flips(buf, buf + BENCH_MAX_BYTES, len, &up, &down);
+	sink += up + down;
+}
+
+static void
+k_rand_fill(size_t len)
+{
+	rand_pattern_fill(buf2 + BENCH_MAX_BYTES, BENCH_BLK, len / BENCH_BLK,
+			  0x1234, 0);
+}
+
+static void
+k_rand_check(size_t len)
+{
+	sink += rand_pattern_check(buf2 + BENCH_MAX_BYTES, BENCH_BLK,
+				   len / BENCH_BLK, 0x1234, 0);
+}
+
+static void
+k_stamp_check(size_t len)
+{
+	sink += stamp_pattern_check(buf2 + 2 * BENCH_MAX_BYTES, BENCH_BLK,
+				    len / BENCH_BLK, 0x1234, 1, 1, 0);
+}
+
+static void
+k_crc32(size_t len)
+{
+	sink += crc32(0, buf, (int)len);
+}
+
+static void
+k_crc32c(size_t len)
+{
+	sink += crc32c(0, buf, len);
+}
+
+static void
+k_checksum(size_t len)
+{
+	struct csum st = {0, 0};
+
+	checksum_update(&st, buf, len);
+	sink += checksum_final(&st);
+}
+
+static void
+k_xxh3(size_t len)
+{
+	uint64_t h[2];
+
+	xxh3_128(buf, len, h);
+	sink += h[0];
+}
+
+static void
+k_t10dif(size_t len)
+{
+	size_t off;
+
+	// a guard a block, as protection information is
+	for (off = 0; off < len; off += BENCH_BLK)
+		sink += crc16_t10dif(0, buf + off, BENCH_BLK);
+}
+
+static void
+k_crc64(size_t len)
+{
+	size_t off;
+
+	for (off = 0; off < len; off += BENCH_BLK)
+		sink += crc64_nvme(0, buf + off, BENCH_BLK);
+}
+
+static const struct
+{
+	const char *name;
+	void (*fn)(size_t len);
+} kernels[] = {
+	{"pattern_check", k_pattern},
+	{"zero_detect", k_zero},
+	{"buf_compare", k_compare},
+	{"pattern_strm", k_pattern_stream},
+	{"compare_strm", k_compare_stream},
+	{"bit_flips", k_flips},
+	{"rand_fill", k_rand_fill},
+	{"rand_check", k_rand_check},
+	{"stamp_check", k_stamp_check},
+	{"crc32", k_crc32},
+	{"crc32c", k_crc32c},
+	{"checksum", k_checksum},
+	{"xxh3_128", k_xxh3},
+	{"t10dif_guard", k_t10dif},
+	{"crc64_guard", k_crc64},
+};
+
+// The buffers: pattern words, two copies that compare equal to the
+// end, zeros, and the random and stamped patterns their checks pass.
+// In the child, filling them binds the pattern kernels
+static int
+setup(void)
+{
+	size_t k;
+
+	buf = (BYTE *)aligned_alloc(64, 2 * BENCH_MAX_BYTES);
+	buf2 = (BYTE *)aligned_alloc(64, 3 * BENCH_MAX_BYTES);
+	if ((NULL == buf) || (NULL == buf2))
+		return -1;
+	for (k = 0; k < PATTERN_WORD_SZ; ++k)
+		pat[k] = (BYTE)(0xa5 ^ k);
+	for (k = 0; k < BENCH_MAX_BYTES; ++k)
+		buf[k] = pat[k % PATTERN_WORD_SZ];
+	memcpy(buf + BENCH_MAX_BYTES, buf, BENCH_MAX_BYTES);
+	memset(zero, 0, sizeof(zero));
+	memset(buf2, 0, BENCH_MAX_BYTES);
+	rand_pattern_fill(buf2 + BENCH_MAX_BYTES, BENCH_BLK,
+			  BENCH_MAX_BYTES / BENCH_BLK, 0x1234, 0);
+	stamp_pattern_fill(buf2 + 2 * BENCH_MAX_BYTES, BENCH_BLK,
+			   BENCH_MAX_BYTES / BENCH_BLK, 0x1234, 1, 1, 0);
+	return 0;
+}
+
+// Every kernel at every size, at the level cpu_force_isa() was given
+static void
+run_level(const char *level)
+{
+	uint64_t t0, c0, ns, cyc, n, bytes;
+	size_t k, s;
+
+	for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k)
+	{
+		for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+		{
+			kernels[k].fn(sizes[s]); // bound, and in the cache
+			n = 0;
+			t0 = now_ns();
+			c0 = cycles();
+			do
+			{
+				kernels[k].fn(sizes[s]);
+				++n;
+			} while ((ns = now_ns() - t0) < BENCH_MIN_NS);
+			cyc = cycles() - c0;
+			bytes = n * sizes[s];
+			if (cyc)
+				printf("%-9s %-13s %8zu %9.2f %8.3f\n", level,
+				       kernels[k].name, sizes[s], bytes / (double)ns,
+				       cyc / (double)bytes);
+			else
+				printf("%-9s %-13s %8zu %9.2f %8s\n", level,
+				       kernels[k].name, sizes[s], bytes / (double)ns,
+				       "-");
+		}
+	}
+	fflush(stdout);
+}
+
+// In a child, level name. Returns 0, 1 when the CPU lacks it, -1 error
+static int
+fork_level(const char *name)
+{
+	int status;
+	pid_t pid;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0)
+	{
+		perror("fork");
+		return -1;
+	}
+	if (0 == pid)
+	{
+		int res = cpu_force_isa(name);
+
+		if (res)
+			_exit((res > 0) ? 1 : 2);
+		cpu_dispatch();
+		if (setup())
+		{
+			fprintf(stderr, "out of memory\n");
+			_exit(2);
+		}
+		run_level(name);
+		_exit(0);
+	}
+	if ((waitpid(pid, &status, 0) < 0) || !WIFEXITED(status) ||
+	    (WEXITSTATUS(status) > 1))
+		return -1;
+	return WEXITSTATUS(status);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t k;
+	int i, res = 0;
+
+	printf("cpu %s\n", cpu_isa_name());
+	printf("%-9s %-13s %8s %9s %8s\n", "level", "kernel", "bytes", "GB/s",
+	       "cyc/B");
+	if (argc > 1)
+	{
+		for (i = 1; i < argc; ++i)
+		{
+			switch (fork_level(argv[i]))
+			{
+			case 0:
+				break;
+			case 1:
+				fprintf(stderr, "%s: not all of it on this cpu\n",
+					argv[i]);
+				break;
+			default:
+				fprintf(stderr, "%s: unknown level or failed\n",
+					argv[i]);
+				res = 1;
+			}
+		}
+		return res;
+	}
+	for (k = 0; k < sizeof(levels) / sizeof(levels[0]); ++k)
+		if (fork_level(levels[k]) < 0)
+			res = 1;
+	return res;
+}
@@ -0,0 +1,226 @@
+/*
+ * latency.c
+ *
+ *  Log-linear latency histogram. Values below 16 ns get a bucket each;
+ *  above, bucket ((s + 1) << 4) + m holds the values whose top five bits
+ *  are 1m once shifted right by s.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "latency.h"
+
+#define LAT_SUB (1 << LAT_SUB_BITS)
+
+uint64_t lat_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int
+lat_index(uint64_t v)
+{
+	int shift;
+
+	if (v < LAT_SUB)
+		return (int)v;
+	shift = 63 - __builtin_clzll(v) - LAT_SUB_BITS;
+	return ((shift + 1) << LAT_SUB_BITS) + (int)((v >> shift) & (LAT_SUB - 1));
+}
+
+// Highest value that lands in bucket idx
+static uint64_t
+lat_bucket_top(int idx)
+{
+	int shift = (idx >> LAT_SUB_BITS) - 1;
+	uint64_t m = idx & (LAT_SUB - 1);
+
+	if (shift < 0)
+		return (uint64_t)idx;
+	return ((LAT_SUB + m + 1) << shift) - 1;
+}
+
+void lat_record(struct lat_hist *h, uint64_t ns)
+{
+	uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+	__atomic_fetch_add(&h->bucket[lat_index(ns)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->sum, ns, __ATOMIC_RELAXED);
+	while ((ns > max) &&
+	       !__atomic_compare_exchange_n(&h->max, &max, ns, 1,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void lat_reset(struct lat_hist *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+void lat_merge(struct lat_hist *dst, const struct lat_hist *src)
+{
+	int k;
+
+	for (k = 0; k < LAT_BUCKETS; ++k)
+		dst->bucket[k] += src->bucket[k];
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+uint64_t lat_percentile(const struct lat_hist *h, double pct)
+{
+	uint64_t want, seen = 0, top;
+	int k;
+
+	if (0 == h->count)
+		return 0;
+	want = (uint64_t)(pct / 100.0 * h->count + 0.5);
+	if (want < 1)
+		want = 1;
+	for (k = 0; k < LAT_BUCKETS; ++k)
+	{
+		seen += h->bucket[k];
+		if (seen >= want)
+		{
+			top = lat_bucket_top(k);
+			return (top < h->max) ? top : h->max;
+		}
+	}
+	return h->max;
+}
+
+uint64_t lat_count_le(const struct lat_hist *h, uint64_t ns)
+{
+	uint64_t n = 0;
+	int k;
+
+	for (k = 0; (k < LAT_BUCKETS) && (lat_bucket_top(k) <= ns); ++k)
+		n += h->bucket[k];
+	return n;
+}
+
+char *lat_str(uint64_t ns, char *buf, int len)
+{
+	if (ns < 10000)
+		snprintf(buf, len, "%luns", (unsigned long)ns);
+	else if (ns < 10000000)
+		snprintf(buf, len, "%luus", (unsigned long)(ns / 1000));
+	else if (ns < 10000000000ULL)
+		snprintf(buf, len, "%.1fms", ns / 1e6);
+	else
+		snprintf(buf, len, "%.2fs", ns / 1e9);
+	return buf;
+}
+
+int lat_map_init(struct lat_map *m, int cells, int64_t start, int64_t end)
+{
+	int64_t span = end - start;
+
+	if (span < cells)
+		cells = (span > 0) ? (int)span : 1;
+	m->start = start;
+	m->width = (span + cells - 1) / cells;
+	if (m->width < 1)
+		m->width = 1;
+	m->cells = cells;
+	m->cell = (struct lat_cell *)malloc(cells * sizeof(struct lat_cell));
+	if (NULL == m->cell)
+		return -1;
+	lat_map_reset(m);
+	return 0;
+}
+
+void lat_map_free(struct lat_map *m)
+{
+	free(m->cell);
+	m->cell = NULL;
+	m->cells = 0;
+}
+
+void lat_map_reset(struct lat_map *m)
+{
+	int k;
+
+	memset(m->cell, 0, m->cells * sizeof(struct lat_cell));
+	for (k = 0; k < m->cells; ++k)
+	{
+		m->cell[k].min = UINT64_MAX;
+		m->cell[k].first = UINT64_MAX;
+	}
+}
+
+static inline void
+atomic_min(uint64_t *p, uint64_t v)
+{
+	uint64_t cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+	while ((v < cur) &&
+	       !__atomic_compare_exchange_n(p, &cur, v, 1, __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+static inline void
+atomic_max(uint64_t *p, uint64_t v)
+{
+	uint64_t cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+	while ((v > cur) &&
+	       !__atomic_compare_exchange_n(p, &cur, v, 1, __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+void lat_map_record(struct lat_map *m, int64_t lba, uint64_t bytes,
+		    uint64_t ns, uint64_t done)
+{
+	int64_t k = (lba - m->start) / m->width;
+	struct lat_cell *c;
+
+	if ((k < 0) || (k >= m->cells))
+		return;
+	c = m->cell + k;
+	__atomic_fetch_add(&c->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&c->bytes, bytes, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&c->sum, ns, __ATOMIC_RELAXED);
+	atomic_min(&c->min, ns);
+	atomic_max(&c->max, ns);
+	atomic_min(&c->first, done - ns);
+	atomic_max(&c->last, done);
+}
+
+void lat_map_csv(FILE *fp, const char *device, unsigned int pass,
+		 const struct lat_map *m,
+		 int (*temp)(void *arg, uint64_t from, uint64_t to), void *arg)
+{
+	const struct lat_cell *c;
+	int k, t;
+
+	for (k = 0; k < m->cells; ++k)
+	{
+		c = m->cell + k;
+		if (0 == c->count)
+			continue;
+		// MB/s over the cell's wall time, so queued READs count once
+		fprintf(fp, "%s,%u,%lld,%lld,%llu,%.1f,%.1f,%.1f,%.2f", device,
+			pass, (long long)(m->start + k * m->width),
+			(long long)m->width, (unsigned long long)c->count,
+			c->min / 1e3, c->sum / 1e3 / c->count, c->max / 1e3,
+			(c->last > c->first) ? c->bytes * 1e3 / (c->last - c->first)
+					     : 0.0);
+		if (temp && (INT32_MIN != (t = temp(arg, c->first, c->last))))
+			fprintf(fp, ",%d", t);
+		else if (temp)
+			fputc(',', fp);
+		fputc('\n', fp);
+	}
+}
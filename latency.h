@@ -0,0 +1,75 @@
+/*
+ * latency.h
+ *
+ *  Per device I/O latency histograms: log-linear buckets (HDR style),
+ *  16 per power of two, so any value is kept to within 1/16 of itself.
+ *  Recording is a few instructions and lock free so every lane of a
+ *  device can share one histogram.
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define LAT_SUB_BITS 4
+#define LAT_BUCKETS ((64 - LAT_SUB_BITS + 1) << LAT_SUB_BITS)
+
+struct lat_hist
+{
+	uint64_t count;
+	uint64_t max; // ns
+	uint64_t sum; // ns
+	uint64_t bucket[LAT_BUCKETS];
+};
+
+// CLOCK_MONOTONIC in ns
+uint64_t lat_now_ns(void);
+// Safe from several threads at once
+void lat_record(struct lat_hist *h, uint64_t ns);
+void lat_reset(struct lat_hist *h);
+void lat_merge(struct lat_hist *dst, const struct lat_hist *src);
+// pct in [0, 100], returns ns, 0 when empty
+uint64_t lat_percentile(const struct lat_hist *h, double pct);
+// Commands that took at most ns, to the resolution of the buckets
+uint64_t lat_count_le(const struct lat_hist *h, uint64_t ns);
+// "850us", "12.3ms", "2.10s"
+char *lat_str(uint64_t ns, char *buf, int len);
+
+// Latency and throughput across the LBA space: a fixed number of
+// buckets, so the size of the map does not depend on the device's.
+struct lat_cell
+{
+	uint64_t count;
+	uint64_t bytes;
+	uint64_t sum;	// ns
+	uint64_t min;	// ns, UINT64_MAX when empty
+	uint64_t max;	// ns
+	uint64_t first; // lat_now_ns() of the first submission
+	uint64_t last;	// and of the last completion
+};
+
+struct lat_map
+{
+	int64_t start; // lba
+	int64_t width; // lbas per cell
+	int cells;
+	struct lat_cell *cell;
+};
+
+// Return 0 on success, -1 when out of memory
+int lat_map_init(struct lat_map *m, int cells, int64_t start, int64_t end);
+void lat_map_free(struct lat_map *m);
+void lat_map_reset(struct lat_map *m);
+// Safe from several threads at once; done is lat_now_ns() at completion
+void lat_map_record(struct lat_map *m, int64_t lba, uint64_t bytes,
+		    uint64_t ns, uint64_t done);
+// CSV rows: device,pass,lba,lbas,commands,min_us,avg_us,max_us,mbps and
+// when temp is not NULL ,temp_c: temp(arg, first, last) of the cell, left
+// empty for INT32_MIN
+void lat_map_csv(FILE *fp, const char *device, unsigned int pass,
+		 const struct lat_map *m,
+		 int (*temp)(void *arg, uint64_t from, uint64_t to), void *arg);
+
+#endif /* LATENCY_H_ */
@@ -0,0 +1,67 @@
+/*
+ * livestat.c
+ *
+ *  Creating and removing the live statistics segment. The segment is
+ *  sized once for all devices and left in place on exit only when it
+ *  is a file, so a monitor can still read the final state.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "livestat.h"
+
+static size_t ls_len;
+static char ls_name[256];
+static int ls_is_shm;
+
+struct livestat *livestat_open(const char *name, int ndev)
+{
+	struct livestat *ls;
+	struct timespec ts;
+	int fd;
+
+	ls_is_shm = (NULL == strchr(name + 1, '/'));
+	snprintf(ls_name, sizeof(ls_name), "%s", name);
+	ls_len = sizeof(struct livestat) + ndev * sizeof(struct livestat_dev);
+	if (ls_is_shm)
+		fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	else
+		fd = open(name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, ls_len))
+	{
+		close(fd);
+		return NULL;
+	}
+	ls = (struct livestat *)mmap(NULL, ls_len, PROT_READ | PROT_WRITE,
+				     MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == ls)
+		return NULL;
+	memset(ls, 0, ls_len);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ls->version = LIVESTAT_VERSION;
+	ls->dev_size = sizeof(struct livestat_dev);
+	ls->ndev = ndev;
+	ls->pid = getpid();
+	ls->start_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	// readers check the magic last, once the rest is there
+	__atomic_store_n(&ls->magic, LIVESTAT_MAGIC, __ATOMIC_RELEASE);
+	return ls;
+}
+
+void livestat_close(struct livestat *ls)
+{
+	if (NULL == ls)
+		return;
+	munmap(ls, ls_len);
+	if (ls_is_shm)
+		shm_unlink(ls_name);
+}
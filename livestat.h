@@ -0,0 +1,76 @@
+/*
+ * livestat.h
+ *
+ *  Live per device counters in shared memory, for monitors that want
+ *  the status of many drives without parsing output or sending signals.
+ *  The segment is a struct livestat followed by ndev struct livestat_dev.
+ *  Each device's record is guarded by a sequence lock. The writer makes
+ *  seq odd, updates, then makes it even again. A reader copies the
+ *  record between two loads of seq and keeps the copy only if both
+ *  loads returned the same even value.
+ */
+
+#ifndef LIVESTAT_H_
+#define LIVESTAT_H_
+
+#include <stdint.h>
+
+#define LIVESTAT_MAGIC 0x7461747364736b64ULL // "dksdstat"
+#define LIVESTAT_VERSION 1
+
+struct livestat_dev
+{
+	uint32_t seq;
+	uint32_t pass;	 // 1 based, 0 before the first
+	uint32_t passes;
+	int32_t state;	 // LIVESTAT_*
+	int32_t result;	 // exit status of the device once done
+	int32_t recovered;
+	int32_t unrecovered;
+	int32_t mismatches;
+	int32_t weak_sectors;
+	int32_t pad;
+	int64_t start;	 // lba range scanned
+	int64_t end;
+	int64_t lba;	 // position in the current pass
+	int64_t bytes_done;
+	double mbps;	 // over the run
+	double pass_mbps;
+	uint64_t update_ns; // CLOCK_MONOTONIC of the last update
+	char device[64];
+};
+
+#define LIVESTAT_STARTING 0
+#define LIVESTAT_RUNNING 1
+#define LIVESTAT_DONE 2
+
+struct livestat
+{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t dev_size; // sizeof(struct livestat_dev)
+	uint32_t ndev;
+	int32_t pid;
+	uint64_t start_ns;
+	struct livestat_dev dev[];
+};
+
+// name with a '/' past its first character is a file to mmap, else a
+// POSIX shm object. Returns NULL on error.
+struct livestat *livestat_open(const char *name, int ndev);
+void livestat_close(struct livestat *ls);
+
+static inline void
+livestat_begin(struct livestat_dev *d)
+{
+	__atomic_store_n(&d->seq, d->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void
+livestat_end(struct livestat_dev *d)
+{
+	__atomic_store_n(&d->seq, d->seq + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* LIVESTAT_H_ */
@@ -0,0 +1,322 @@
+/*
+ * manifest.c
+ *
+ *  One extent is hashed at a time, its line written when a block of the
+ *  next one comes. The old manifest is read alongside, a line ahead,
+ *  both in lba order, so checking is a merge of the two files.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "common.h"
+#include "manifest.h"
+
+#define MANIFEST_MAGIC "dskread-manifest"
+
+struct mline
+{
+	int64_t lba;
+	int64_t blocks;
+	uint64_t hash[2];
+};
+
+struct mfile
+{
+	FILE *fp;
+	int blk_sz;
+	int64_t num_sect;
+	int64_t extent;
+	struct mline next; // the line ahead,
+	int have;          // when there is one
+};
+
+struct manifest
+{
+	FILE *out;
+	struct mfile old; // fp NULL without one
+	int blk_sz;
+	int64_t extent;
+	struct xxh3 h;
+	int64_t cur;    // extent hashed, -1 before the first
+	int64_t first;  // lba of its first block
+	int64_t blocks; // put of it
+	manifest_fn fn;
+	void *arg;
+	struct manifest_stats st;
+};
+
+// The next extent line into f->next. Returns 0, -1 on a malformed line
+static int
+mfile_next(struct mfile *f)
+{
+	char line[256], hex[40];
+	long long lba, blocks;
+
+	f->have = 0;
+	if (NULL == fgets(line, sizeof(line), f->fp) ||
+	    (0 == strncmp(line, "end\t", 4)))
+		return 0;
+	if ((3 != sscanf(line, "%lld\t%lld\t%39s", &lba, &blocks, hex)) ||
+	    (32 != strlen(hex)) || (lba < 0) || (blocks < 1) ||
+	    (1 != sscanf(hex + 16, "%16" SCNx64, &f->next.hash[0])))
+		return -1;
+	hex[16] = '\0';
+	if (1 != sscanf(hex, "%16" SCNx64, &f->next.hash[1]))
+		return -1;
+	f->next.lba = lba;
+	f->next.blocks = blocks;
+	f->have = 1;
+	return 0;
+}
+
+// Opens path and reads its header and first line. Returns 0, -1 with
+// errno set
+static int
+mfile_open(struct mfile *f, const char *path)
+{
+	char line[4352];
+	long long num, extent;
+	int version = 0;
+
+	memset(f, 0, sizeof(*f));
+	f->fp = fopen(path, "r");
+	if (NULL == f->fp)
+		return -1;
+	if (!fgets(line, sizeof(line), f->fp) ||
+	    (1 != sscanf(line, MANIFEST_MAGIC "\t%d\txxh3-128", &version)) ||
+	    (MANIFEST_VERSION != version) ||
+	    !fgets(line, sizeof(line), f->fp) ||
+	    strncmp(line, "device\t", 7) ||
+	    !fgets(line, sizeof(line), f->fp) ||
+	    (1 != sscanf(line, "block_size\t%d", &f->blk_sz)) ||
+	    !fgets(line, sizeof(line), f->fp) ||
+	    (1 != sscanf(line, "blocks\t%lld", &num)) ||
+	    !fgets(line, sizeof(line), f->fp) ||
+	    (1 != sscanf(line, "extent\t%lld", &extent)) ||
+	    (f->blk_sz < 1) || (extent < 1) || mfile_next(f))
+	{
+		fclose(f->fp);
+		f->fp = NULL;
+		errno = EINVAL;
+		return -1;
+	}
+	f->num_sect = num;
+	f->extent = extent;
+	return 0;
+}
+
+static int
+same(const struct mline *a, const struct mline *b)
+{
+	return (a->lba == b->lba) && (a->blocks == b->blocks) &&
+	       (a->hash[0] == b->hash[0]) && (a->hash[1] == b->hash[1]);
+}
+
+// The line of the extent hashed, and its check against the old one
+static int
+extent_end(struct manifest *m)
+{
+	struct mline e;
+	struct mfile *f = &m->old;
+
+	e.lba = m->first;
+	e.blocks = m->blocks;
+	xxh3_final(&m->h, e.hash);
+	++m->st.extents;
+	if (m->out)
+		fprintf(m->out, "%" PRId64 "\t%" PRId64 "\t%016" PRIx64 "%016"
+				PRIx64 "\n", e.lba, e.blocks, e.hash[1], e.hash[0]);
+	if (f->fp)
+	{
+		// extents of the old one this run did not read are passed over
+		while (f->have && (f->next.lba / m->extent < m->cur))
+			if (mfile_next(f))
+				f->have = 0; // the rest of it unreadable
+		if (f->have && (f->next.lba / m->extent == m->cur))
+		{
+			++m->st.checked;
+			if (!same(&e, &f->next))
+			{
+				++m->st.differ;
+				m->fn(m->arg, e.lba, e.blocks, MANIFEST_CHANGED);
+			}
+			if (mfile_next(f))
+				f->have = 0;
+		}
+		else
+		{
+			++m->st.differ;
+			m->fn(m->arg, e.lba, e.blocks, MANIFEST_NEW);
+		}
+	}
+	m->cur = -1;
+	if (m->out && ferror(m->out))
+	{
+		if (0 == errno)
+			errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+struct manifest *manifest_open(const char *out, const char *old,
+			       const char *name, int blk_sz, int64_t num_sect,
+			       int64_t extent, manifest_fn fn, void *arg)
+{
+	struct manifest *m = (struct manifest *)calloc(1, sizeof(*m));
+
+	if (NULL == m)
+		return NULL;
+	m->blk_sz = blk_sz;
+	m->cur = -1;
+	m->fn = fn;
+	m->arg = arg;
+	if (old && mfile_open(&m->old, old))
+	{
+		free(m);
+		return NULL;
+	}
+	if (old && ((m->old.blk_sz != blk_sz) ||
+		    (extent && (extent != m->old.extent))))
+	{
+		fclose(m->old.fp);
+		free(m);
+		errno = EINVAL;
+		return NULL;
+	}
+	m->extent = extent ? extent
+		    : old  ? m->old.extent
+			   : MANIFEST_EXTENT / blk_sz;
+	if (out)
+	{
+		m->out = fopen(out, "w");
+		if (NULL == m->out)
+		{
+			if (m->old.fp)
+				fclose(m->old.fp);
+			free(m);
+			return NULL;
+		}
+		fprintf(m->out, MANIFEST_MAGIC "\t%d\txxh3-128\ndevice\t%s\n"
+				"block_size\t%d\nblocks\t%" PRId64 "\nextent\t%"
+				PRId64 "\n", MANIFEST_VERSION, name, blk_sz,
+			num_sect, m->extent);
+	}
+	return m;
+}
+
+int manifest_put(struct manifest *m, int64_t lba, const uint8_t *buf,
+		 int blocks)
+{
+	int64_t idx, n;
+
+	while (blocks > 0)
+	{
+		idx = lba / m->extent;
+		if ((idx != m->cur) && (m->cur >= 0) && extent_end(m))
+			return -1;
+		if (m->cur < 0)
+		{
+			m->cur = idx;
+			m->first = lba;
+			m->blocks = 0;
+			xxh3_init(&m->h);
+		}
+		n = (idx + 1) * m->extent - lba;
+		if (n > blocks)
+			n = blocks;
+		xxh3_update(&m->h, buf, (size_t)n * m->blk_sz);
+		m->blocks += n;
+		buf += (size_t)n * m->blk_sz;
+		lba += n;
+		blocks -= (int)n;
+	}
+	return 0;
+}
+
+void manifest_get_stats(const struct manifest *m, struct manifest_stats *st)
+{
+	*st = m->st;
+	st->extent = m->extent;
+}
+
+int manifest_close(struct manifest *m, struct manifest_stats *st)
+{
+	int res = 0;
+
+	if ((m->cur >= 0) && extent_end(m))
+		res = -1;
+	if (st)
+		manifest_get_stats(m, st);
+	if (m->out)
+	{
+		fprintf(m->out, "end\t%" PRId64 "\n", m->st.extents);
+		if ((fclose(m->out) || res) && (0 == res))
+			res = -1;
+	}
+	if (m->old.fp)
+		fclose(m->old.fp);
+	free(m);
+	return res;
+}
+
+int manifest_diff(const char *a, const char *b, manifest_fn fn, void *arg,
+		  struct manifest_stats *st)
+{
+	struct mfile fa, fb;
+	int64_t ia, ib;
+	int res = 0;
+
+	memset(st, 0, sizeof(*st));
+	if (mfile_open(&fa, a))
+		return -1;
+	if (mfile_open(&fb, b))
+	{
+		fclose(fa.fp);
+		return -1;
+	}
+	st->extent = fb.extent;
+	if ((fa.blk_sz != fb.blk_sz) || (fa.extent != fb.extent))
+	{
+		errno = EINVAL;
+		res = -1;
+	}
+	while ((0 == res) && (fa.have || fb.have))
+	{
+		ia = fa.have ? fa.next.lba / fa.extent : INT64_MAX;
+		ib = fb.have ? fb.next.lba / fb.extent : INT64_MAX;
+		if (ib <= ia)
+			++st->extents; // of b
+		if (ia == ib)
+		{
+			++st->checked;
+			if (!same(&fa.next, &fb.next))
+			{
+				++st->differ;
+				fn(arg, fb.next.lba, fb.next.blocks,
+				   MANIFEST_CHANGED);
+			}
+		}
+		else
+		{
+			++st->differ;
+			if (ia < ib)
+				fn(arg, fa.next.lba, fa.next.blocks, MANIFEST_GONE);
+			else
+				fn(arg, fb.next.lba, fb.next.blocks, MANIFEST_NEW);
+		}
+		if ((ia <= ib) && mfile_next(&fa))
+			res = -1;
+		if ((ib <= ia) && mfile_next(&fb))
+			res = -1;
+		if (res)
+			errno = EINVAL;
+	}
+	fclose(fa.fp);
+	fclose(fb.fp);
+	return res;
+}
@@ -0,0 +1,69 @@
+/*
+ * manifest.h
+ *
+ *  The XXH3-128 of every extent of a device, fixed size runs of blocks
+ *  from lba 0, written as the device is read and checked against one a
+ *  run before wrote: arbitrary content, a golden image, verified with no
+ *  pattern. Two manifests can be diffed with no device at all. Both are
+ *  streamed, a line at a time, so memory does not grow with the device.
+ *
+ *  File format, text, one line each, fields tab separated:
+ *    "dskread-manifest", version (1), "xxh3-128"
+ *    "device", the device name
+ *    "block_size", bytes; "blocks", of the device; "extent", blocks
+ *    then per extent: its first lba read, the blocks read of it and the
+ *    XXH3-128 of them in 32 hex digits, high half first as xxhsum -H2
+ *    prints it, in lba order; and last "end", the number of extents.
+ *  An extent not read in full has the blocks that were, the lba of the
+ *  first of them.
+ */
+
+#ifndef MANIFEST_H_
+#define MANIFEST_H_
+
+#include <stdint.h>
+
+#define MANIFEST_VERSION 1
+#define MANIFEST_EXTENT (64 << 20) // bytes, the default
+
+#define MANIFEST_CHANGED 1 // the hash, or the blocks hashed, differ
+#define MANIFEST_NEW 2     // hashed, not in the old manifest
+#define MANIFEST_GONE 3    // in the old manifest only, for manifest_diff()
+
+// An extent that differs from the old manifest, lba and blocks of the
+// new one (the old one for MANIFEST_GONE)
+typedef void (*manifest_fn)(void *arg, int64_t lba, int64_t blocks, int how);
+
+struct manifest;
+
+struct manifest_stats
+{
+	int64_t extent;  // blocks per extent
+	int64_t extents; // hashed
+	int64_t checked; // of them, found in the old manifest
+	int64_t differ;  // reported to fn
+};
+
+// Writes the manifest of device name to out, hashes checked against the
+// manifest at old, either NULL. extent is in blocks of blk_sz, 0 for
+// that of old, else MANIFEST_EXTENT. NULL with errno set on errors,
+// EINVAL when old is not a manifest or is of other blocks
+struct manifest *manifest_open(const char *out, const char *old,
+			       const char *name, int blk_sz, int64_t num_sect,
+			       int64_t extent, manifest_fn fn, void *arg);
+// Hashes blocks at lba from buf, lba above those put before. Returns 0,
+// -1 with errno set on a write error
+int manifest_put(struct manifest *m, int64_t lba, const uint8_t *buf,
+		 int blocks);
+void manifest_get_stats(const struct manifest *m, struct manifest_stats *st);
+// Ends the last extent and the file, its stats then into st unless it
+// is NULL. Returns 0, -1 with errno set when it could not be written in
+// full
+int manifest_close(struct manifest *m, struct manifest_stats *st);
+// Reports to fn the extents of a and b that differ. Returns 0, else -1
+// with errno set, EINVAL when one is not a manifest or their extents do
+// not line up
+int manifest_diff(const char *a, const char *b, manifest_fn fn, void *arg,
+		  struct manifest_stats *st);
+
+#endif /* MANIFEST_H_ */
@@ -0,0 +1,188 @@
+/*
+ * metrics.c
+ *
+ *  The exporter thread polls the listening socket with the file
+ *  interval as timeout. A scrape is answered in full before the next
+ *  is accepted; responses are small and scrapes seconds apart.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "metrics.h"
+
+#define CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+static int lfd = -1;
+static const char *mpath;
+static int minterval;
+static metrics_render_fn mrender;
+static pthread_t mtid;
+static int mpipe[2] = {-1, -1}; // wakes the thread to stop
+
+// Renders into a heap buffer, which the caller frees
+static char *
+render(size_t *lenp)
+{
+	char *buf = NULL;
+	FILE *fp = open_memstream(&buf, lenp);
+
+	if (NULL == fp)
+		return NULL;
+	mrender(fp);
+	fputs("# EOF\n", fp);
+	fclose(fp);
+	return buf;
+}
+
+static void
+write_file(void)
+{
+	char tmp[4096];
+	size_t len;
+	char *buf;
+	FILE *fp;
+
+	if (NULL == mpath)
+		return;
+	buf = render(&len);
+	if (NULL == buf)
+		return;
+	snprintf(tmp, sizeof(tmp), "%s.tmp", mpath);
+	fp = fopen(tmp, "w");
+	if (fp)
+	{
+		// the collector never sees a half written file
+		if ((fwrite(buf, 1, len, fp) == len) && (0 == fclose(fp)))
+			rename(tmp, mpath);
+		else
+			unlink(tmp);
+	}
+	free(buf);
+}
+
+static void
+serve_one(int cfd)
+{
+	char req[2048], hdr[256];
+	size_t len = 0, off;
+	ssize_t res;
+	char *buf;
+	int hlen;
+
+	// the request is not looked at, every path gets the metrics
+	while (((res = recv(cfd, req, sizeof(req), 0)) < 0) && (EINTR == errno))
+		;
+	buf = render(&len);
+	if (NULL == buf)
+		return;
+	hlen = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Type: "
+			CONTENT_TYPE "\r\nContent-Length: %zu\r\n"
+			"Connection: close\r\n\r\n", len);
+	if (send(cfd, hdr, hlen, MSG_NOSIGNAL) == hlen)
+		for (off = 0; off < len; off += res)
+		{
+			res = send(cfd, buf + off, len - off, MSG_NOSIGNAL);
+			if ((res < 0) && (EINTR == errno))
+				res = 0;
+			else if (res <= 0)
+				break;
+		}
+	free(buf);
+}
+
+static void *
+metrics_thread(void *arg)
+{
+	struct pollfd pfd[2];
+	int res, cfd;
+
+	(void)arg;
+	pfd[0].fd = mpipe[0];
+	pfd[0].events = POLLIN;
+	pfd[1].fd = lfd;
+	pfd[1].events = POLLIN;
+	for (;;)
+	{
+		res = poll(pfd, (lfd >= 0) ? 2 : 1, minterval * 1000);
+		if ((res < 0) && (EINTR != errno))
+			break;
+		if (pfd[0].revents)
+			break;
+		if ((res > 0) && (lfd >= 0) && (pfd[1].revents & POLLIN))
+		{
+			cfd = accept(lfd, NULL, NULL);
+			if (cfd >= 0)
+			{
+				serve_one(cfd);
+				close(cfd);
+			}
+			continue;
+		}
+		if (0 == res)
+			write_file();
+	}
+	return NULL;
+}
+
+int metrics_start(int port, const char *path, int interval_s,
+		  metrics_render_fn fn)
+{
+	struct sockaddr_in sa;
+	int one = 1;
+
+	mpath = path;
+	minterval = (interval_s > 0) ? interval_s : 1;
+	mrender = fn;
+	if (port > 0)
+	{
+		lfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (lfd < 0)
+			return -1;
+		setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		memset(&sa, 0, sizeof(sa));
+		sa.sin_family = AF_INET;
+		sa.sin_addr.s_addr = htonl(INADDR_ANY);
+		sa.sin_port = htons(port);
+		if (bind(lfd, (struct sockaddr *)&sa, sizeof(sa)) ||
+		    listen(lfd, 8))
+			goto err;
+	}
+	if (pipe(mpipe))
+		goto err;
+	if (pthread_create(&mtid, NULL, metrics_thread, NULL))
+	{
+		close(mpipe[0]);
+		close(mpipe[1]);
+		mpipe[0] = mpipe[1] = -1;
+		goto err;
+	}
+	return 0;
+err:
+	if (lfd >= 0)
+		close(lfd);
+	lfd = -1;
+	return -1;
+}
+
+void metrics_stop(void)
+{
+	if (mpipe[1] < 0)
+		return;
+	if (write(mpipe[1], "x", 1) == 1)
+		pthread_join(mtid, NULL);
+	close(mpipe[0]);
+	close(mpipe[1]);
+	mpipe[0] = mpipe[1] = -1;
+	if (lfd >= 0)
+		close(lfd);
+	lfd = -1;
+	write_file();
+}
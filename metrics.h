@@ -0,0 +1,23 @@
+/*
+ * metrics.h
+ *
+ *  OpenMetrics export: an HTTP endpoint that renders the metrics on
+ *  every scrape, and/or a file rewritten every interval for a textfile
+ *  collector. Both run on one thread of their own.
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdio.h>
+
+// Writes the metric families, without the trailing "# EOF"
+typedef void (*metrics_render_fn)(FILE *fp);
+
+// port 0 -> no HTTP, path NULL -> no file. Return 0 on success, -1 on error
+int metrics_start(int port, const char *path, int interval_s,
+		  metrics_render_fn fn);
+// Writes the file one last time and stops the thread
+void metrics_stop(void);
+
+#endif /* METRICS_H_ */
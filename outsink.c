@@ -0,0 +1,216 @@
+/*
+ * outsink.c
+ *
+ *  The ring of jsonl.c, one per sink: producers hold the mutex only to
+ *  copy a write in, the writer thread does the write(2)s outside of it.
+ *  The stream is a fopencookie() one, line buffered, so each line of a
+ *  printf() reaches the ring as one write and is kept or dropped whole.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "outsink.h"
+
+#define OUTSINK_STACK (64 * 1024) // the writer only loops on write(2)
+
+struct outsink
+{
+	int fd;
+	int policy;
+	char *ring;
+	size_t size;
+	size_t head, tail; // head - tail bytes pending, both grow forever
+	int closing;
+	unsigned long dropped;
+	size_t dropped_bytes;
+	FILE *fp;
+	pthread_t tid;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+static void *
+sink_writer(void *arg)
+{
+	struct outsink *s = (struct outsink *)arg;
+	size_t off, len;
+	ssize_t res;
+
+	pthread_mutex_lock(&s->mutex);
+	for (;;)
+	{
+		while ((s->head == s->tail) && !s->closing)
+			pthread_cond_wait(&s->cond, &s->mutex);
+		if (s->head == s->tail)
+			break;
+		off = s->tail % s->size;
+		len = s->head - s->tail;
+		if (off + len > s->size)
+			len = s->size - off;
+		pthread_mutex_unlock(&s->mutex);
+		res = write(s->fd, s->ring + off, len);
+		pthread_mutex_lock(&s->mutex);
+		if (res > 0)
+			s->tail += res;
+		else if ((res < 0) && (EINTR != errno) && (EAGAIN != errno))
+			s->tail = s->head; // reader is gone, discard
+	}
+	pthread_mutex_unlock(&s->mutex);
+	return NULL;
+}
+
+struct outsink *outsink_open(int fd, size_t size, int policy)
+{
+	struct outsink *s = (struct outsink *)calloc(1, sizeof(*s));
+	pthread_attr_t attr;
+	int res;
+
+	if (NULL == s)
+		return NULL;
+	s->fd = fd;
+	s->policy = policy;
+	s->size = size ? size : OUTSINK_BUF_SZ;
+	s->ring = (char *)malloc(s->size);
+	if (NULL == s->ring)
+	{
+		free(s);
+		return NULL;
+	}
+	pthread_mutex_init(&s->mutex, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, OUTSINK_STACK);
+	res = pthread_create(&s->tid, &attr, sink_writer, s);
+	pthread_attr_destroy(&attr);
+	if (res)
+	{
+		pthread_mutex_destroy(&s->mutex);
+		pthread_cond_destroy(&s->cond);
+		free(s->ring);
+		free(s);
+		errno = res;
+		return NULL;
+	}
+	return s;
+}
+
+struct outsink *outsink_file(const char *path, size_t size, int policy)
+{
+	struct outsink *s;
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (fd < 0)
+		return NULL;
+	s = outsink_open(fd, size, policy);
+	if (NULL == s)
+		close(fd);
+	return s;
+}
+
+void outsink_write(struct outsink *s, const char *buf, size_t len)
+{
+	size_t off, first;
+
+	if ((NULL == s) || (0 == len))
+		return;
+	pthread_mutex_lock(&s->mutex);
+	if (s->size - (s->head - s->tail) < len)
+	{
+		if ((OUTSINK_DROP == s->policy) || ('\r' != buf[len - 1]))
+		{
+			++s->dropped;
+			s->dropped_bytes += len;
+		}
+	}
+	else
+	{
+		off = s->head % s->size;
+		first = s->size - off;
+		if (first > len)
+			first = len;
+		memcpy(s->ring + off, buf, first);
+		memcpy(s->ring, buf + first, len - first);
+		s->head += len;
+		pthread_cond_signal(&s->cond);
+	}
+	pthread_mutex_unlock(&s->mutex);
+}
+
+void outsink_printf(struct outsink *s, const char *fmt, ...)
+{
+	char rec[4096];
+	va_list ap;
+	int len;
+
+	if (NULL == s)
+		return;
+	va_start(ap, fmt);
+	len = vsnprintf(rec, sizeof(rec), fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+	if (len >= (int)sizeof(rec))
+		len = sizeof(rec) - 1; // truncated
+	outsink_write(s, rec, len);
+}
+
+static ssize_t
+stream_write(void *cookie, const char *buf, size_t len)
+{
+	outsink_write((struct outsink *)cookie, buf, len);
+	return len; // taken, or dropped and counted
+}
+
+FILE *outsink_stream(struct outsink *s)
+{
+	cookie_io_functions_t io = {NULL, stream_write, NULL, NULL};
+
+	if (NULL == s->fp)
+	{
+		s->fp = fopencookie(s, "w", io);
+		if (s->fp)
+			setvbuf(s->fp, NULL, _IOLBF, BUFSIZ);
+	}
+	return s->fp;
+}
+
+unsigned long outsink_dropped(struct outsink *s, size_t *bytesp)
+{
+	unsigned long n;
+
+	pthread_mutex_lock(&s->mutex);
+	n = s->dropped;
+	if (bytesp)
+		*bytesp = s->dropped_bytes;
+	pthread_mutex_unlock(&s->mutex);
+	return n;
+}
+
+void outsink_close(struct outsink *s)
+{
+	if (NULL == s)
+		return;
+	if (s->fp)
+		fclose(s->fp); // its last line into the ring
+	pthread_mutex_lock(&s->mutex);
+	s->closing = 1;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->mutex);
+	pthread_join(s->tid, NULL);
+	close(s->fd);
+	pthread_mutex_destroy(&s->mutex);
+	pthread_cond_destroy(&s->cond);
+	free(s->ring);
+	free(s);
+}
@@ -0,0 +1,44 @@
+/*
+ * outsink.h
+ *
+ *  Output sinks: a bounded ring of bytes in front of a file descriptor,
+ *  written out by a thread of its own, so whoever reports never waits
+ *  on a slow pipe, terminal or disk. A write that does not fit is not
+ *  waited for: under OUTSINK_DROP it is dropped and counted, under
+ *  OUTSINK_COALESCE a line ending in '\r' (a progress line the next one
+ *  overwrites) is dropped without a count, as nothing of it is lost.
+ *  A sink can be given a stdio stream, so printf() and perror() of the
+ *  code as it is go through it when it stands in for stdout or stderr.
+ */
+
+#ifndef OUTSINK_H_
+#define OUTSINK_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define OUTSINK_BUF_SZ (1024 * 1024)
+
+#define OUTSINK_DROP 0
+#define OUTSINK_COALESCE 1
+
+struct outsink;
+
+// A sink writing to fd, which it closes when closed; size bytes of
+// ring, 0 for OUTSINK_BUF_SZ. Returns NULL, errno set, on errors
+struct outsink *outsink_open(int fd, size_t size, int policy);
+// Of the file path, created or truncated
+struct outsink *outsink_file(const char *path, size_t size, int policy);
+// Copies len bytes in, whole or not at all. Never blocks on the writer
+void outsink_write(struct outsink *s, const char *buf, size_t len);
+void outsink_printf(struct outsink *s, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+// A line buffered stream whose writes go to outsink_write(); closed
+// with the sink. NULL on errors
+FILE *outsink_stream(struct outsink *s);
+// Writes of OUTSINK_DROP dropped so far, and their bytes
+unsigned long outsink_dropped(struct outsink *s, size_t *bytesp);
+// Writes out what is buffered, stops the writer thread, closes the fd
+void outsink_close(struct outsink *s);
+
+#endif /* OUTSINK_H_ */
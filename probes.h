@@ -0,0 +1,40 @@
+/*
+ * probes.h
+ *
+ *  USDT probes of provider dskread, for bpftrace and SystemTap to attach
+ *  to a running scan, when built with <sys/sdt.h> (HAVE_SDT). A probe is
+ *  a nop where it is and a note in the ELF saying where its arguments
+ *  are; nothing else runs until a tracer puts a breakpoint on it.
+ *  Without the header the probes are not there at all.
+ *
+ *  Probes, dev the device name (str(arg0) in bpftrace):
+ *    submit(dev, lba, blocks)    a command is sent
+ *    complete(dev, op, lba, blocks, ns, res)  it ended, op TRACE_*, res 0
+ *                                or its SG_LIB_CAT_* error class
+ *    retry(dev, lba, blocks, res)  sg_read() sends it again after res
+ *    error(dev, lba, blocks, cat)  the status of a command classified,
+ *                                not clean
+ *    mismatch(dev, lba)          a block read is not the pattern
+ *
+ *    bpftrace -e 'usdt:./dskread:dskread:complete /arg4 > 100000000/
+ *        { printf("%s %d %d ms\n", str(arg0), arg2, arg4 / 1000000); }'
+ */
+
+#ifndef PROBES_H_
+#define PROBES_H_
+
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+
+#define PROBE2(n, a, b) DTRACE_PROBE2(dskread, n, a, b)
+#define PROBE3(n, a, b, c) DTRACE_PROBE3(dskread, n, a, b, c)
+#define PROBE4(n, a, b, c, d) DTRACE_PROBE4(dskread, n, a, b, c, d)
+#define PROBE6(n, a, b, c, d, e, f) DTRACE_PROBE6(dskread, n, a, b, c, d, e, f)
+#else
+#define PROBE2(n, a, b) do { } while (0)
+#define PROBE3(n, a, b, c) do { } while (0)
+#define PROBE4(n, a, b, c, d) do { } while (0)
+#define PROBE6(n, a, b, c, d, e, f) do { } while (0)
+#endif
+
+#endif /* PROBES_H_ */
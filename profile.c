@@ -0,0 +1,185 @@
+/*
+ * profile.c
+ *
+ *  On-disk cache of tuning profiles, one line per drive model:
+ *  vendor<TAB>product<TAB>revision<TAB>bpt<TAB>qd<TAB>MB/s<TAB>link MB/s
+ *  <TAB>curve<TAB>cache KiB<TAB>read-ahead KiB, the curve PROFILE_CURVE
+ *  percentages joined by commas, "-" when it is not known but the cache
+ *  is; the fields after link MB/s are each left out when not known
+ *  Stores rewrite the whole file through a temporary and rename(), under
+ *  an exclusive flock() so several dskread processes can share it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+
+#include "profile.h"
+
+static int
+copy_field(char *dst, int room, const char *src, int len)
+{
+	int k, n = 0;
+
+	while ((len > 0) && ((' ' == src[len - 1]) || ('\0' == src[len - 1])))
+		--len;
+	for (k = 0; (k < len) && (n < room - 1); ++k)
+	{
+		char c = src[k];
+
+		if ('\0' == c)
+			break;
+		dst[n++] = (('\t' == c) || ('\n' == c)) ? ' ' : c;
+	}
+	dst[n] = '\0';
+	return n;
+}
+
+void
+profile_key(char *key, const char *vendor, int vlen, const char *product,
+	    int plen, const char *rev, int rlen)
+{
+	int n;
+
+	n = copy_field(key, PROFILE_KEY_SZ, vendor, vlen);
+	key[n++] = '\t';
+	n += copy_field(key + n, PROFILE_KEY_SZ - n, product, plen);
+	key[n++] = '\t';
+	copy_field(key + n, PROFILE_KEY_SZ - n, rev, rlen);
+}
+
+// Splits a cache line into its key (first three fields) and profile
+static int
+parse_line(char *line, char **valp, struct profile *pp)
+{
+	char *cp = line;
+	int k, n;
+
+	for (k = 0; k < 3; ++k)
+	{
+		cp = strchr(cp, '\t');
+		if (NULL == cp)
+			return -1;
+		++cp;
+	}
+	cp[-1] = '\0';
+	*valp = cp;
+	// the link throughput came later, lines without it are still good
+	pp->link_mbps = 0.0;
+	n = sscanf(cp, "%d\t%d\t%lf\t%lf", &pp->bpt, &pp->qd, &pp->mbps,
+		   &pp->link_mbps);
+	if (n < 3)
+		return -1;
+	// and the curve later still
+	memset(pp->curve, 0, sizeof(pp->curve));
+	for (k = 0; cp && (k < 4); ++k)
+		if ((cp = strchr(cp, '\t')))
+			++cp;
+	for (k = 0; cp && (k < PROFILE_CURVE); ++k)
+	{
+		char *end;
+		long v = strtol(cp, &end, 10);
+
+		if ((end == cp) || (v < 1) || (v > 100))
+		{
+			memset(pp->curve, 0, sizeof(pp->curve));
+			break;
+		}
+		pp->curve[k] = (unsigned char)v;
+		cp = (',' == *end) ? end + 1 : NULL;
+	}
+	if (k < PROFILE_CURVE)
+		memset(pp->curve, 0, sizeof(pp->curve));
+	// and the cache after it
+	pp->cache_kib = pp->ra_kib = 0;
+	for (k = 0, cp = *valp; cp && (k < 5); ++k)
+		if ((cp = strchr(cp, '\t')))
+			++cp;
+	if (cp && (2 != sscanf(cp, "%d\t%d", &pp->cache_kib, &pp->ra_kib)))
+		pp->cache_kib = pp->ra_kib = 0;
+	if ((0 == pp->bpt) && (0 == pp->qd))
+		return 0; // not tuned
+	return ((pp->bpt > 0) && (pp->qd > 0)) ? 0 : -1;
+}
+
+int
+profile_load(const char *path, const char *key, struct profile *pp)
+{
+	char line[512], *val;
+	FILE *fp = fopen(path, "r");
+	int res = -1;
+
+	if (NULL == fp)
+		return -1;
+	while (fgets(line, sizeof(line), fp))
+	{
+		struct profile p;
+
+		line[strcspn(line, "\n")] = '\0';
+		if ((0 == parse_line(line, &val, &p)) && (0 == strcmp(line, key)))
+		{
+			*pp = p;
+			res = 0; // the last entry wins
+		}
+	}
+	fclose(fp);
+	return res;
+}
+
+int
+profile_store(const char *path, const char *key, const struct profile *pp)
+{
+	char line[512], tmp[4096], *val;
+	FILE *in, *out;
+	int k, lfd, res = 0;
+
+	// the lock file outlives the renames of the cache itself
+	snprintf(tmp, sizeof(tmp), "%s.lock", path);
+	lfd = open(tmp, O_RDWR | O_CREAT, 0644);
+	if ((lfd < 0) || flock(lfd, LOCK_EX))
+	{
+		if (lfd >= 0)
+			close(lfd);
+		return -1;
+	}
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	out = fopen(tmp, "w");
+	if (NULL == out)
+	{
+		close(lfd);
+		return -1;
+	}
+	in = fopen(path, "r");
+	if (in)
+	{
+		while (fgets(line, sizeof(line), in))
+		{
+			char copy[512];
+			struct profile p;
+
+			memcpy(copy, line, sizeof(copy));
+			copy[strcspn(copy, "\n")] = '\0';
+			if ((0 == parse_line(copy, &val, &p)) && strcmp(copy, key))
+				fputs(line, out);
+		}
+		fclose(in);
+	}
+	fprintf(out, "%s\t%d\t%d\t%.1f\t%.1f", key, pp->bpt, pp->qd, pp->mbps,
+		pp->link_mbps);
+	for (k = 0; pp->curve[0] && (k < PROFILE_CURVE); ++k)
+		fprintf(out, "%c%d", k ? ',' : '\t', pp->curve[k]);
+	if (pp->cache_kib || pp->ra_kib)
+		fprintf(out, "%s\t%d\t%d", pp->curve[0] ? "" : "\t-", pp->cache_kib,
+			pp->ra_kib);
+	fputc('\n', out);
+	if (fclose(out) || rename(tmp, path))
+	{
+		unlink(tmp);
+		res = -1;
+	}
+	close(lfd);
+	return res;
+}
@@ -0,0 +1,36 @@
+/*
+ * profile.h
+ *
+ *  Per drive model tuning profiles, cached on disk so that a rack of
+ *  identical drives is calibrated once. A model measured by --cache-probe
+ *  but not tuned yet has a profile of bpt and qd 0.
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#define PROFILE_KEY_SZ 96
+#define PROFILE_CURVE 16 // points of the throughput curve, outer to inner
+
+struct profile
+{
+	int bpt;     // blocks per READ
+	int qd;      // READs in flight
+	double mbps; // throughput measured when tuned, the model's baseline
+	double link_mbps; // READ BUFFER throughput then, 0 -> not measured
+	// MB/s of each PROFILE_CURVE-th of the LBA space, percent of the
+	// fastest, from a pass over all of it; all 0 -> not known
+	unsigned char curve[PROFILE_CURVE];
+	int cache_kib; // effective read cache, -1 -> none seen, 0 -> not probed
+	int ra_kib;    // strides read-ahead serves, -1 -> none, 0 -> not probed
+};
+
+// Builds the cache key from INQUIRY style identification strings;
+// trailing blanks are dropped, tabs and newlines replaced.
+void profile_key(char *key, const char *vendor, int vlen, const char *product,
+		 int plen, const char *rev, int rlen);
+// Return 0 on success, -1 when missing or on error
+int profile_load(const char *path, const char *key, struct profile *pp);
+int profile_store(const char *path, const char *key, const struct profile *pp);
+
+#endif /* PROFILE_H_ */
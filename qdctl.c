@@ -0,0 +1,102 @@
+/*
+ * qdctl.c
+ *
+ *  The window is a latency histogram of its own, so its p99 is that of
+ *  the current depth only. Completions of commands queued at an older
+ *  depth still land in the first window after a change; windows are
+ *  long enough that they are a small part of it.
+ */
+
+#include <string.h>
+
+#include "qdctl.h"
+
+void qdctl_init(struct qdctl *c, int max, uint64_t target_ns)
+{
+	memset(c, 0, sizeof(*c));
+	pthread_mutex_init(&c->mutex, NULL);
+	c->max = (max > 0) ? max : 1;
+	c->target_ns = target_ns;
+	c->slow_start = 1;
+	c->win_t0 = lat_now_ns();
+	__atomic_store_n(&c->qd, 1, __ATOMIC_RELEASE);
+}
+
+// Where the window that just closed, of p99 and bps, takes the depth
+static int
+decide(struct qdctl *c, uint64_t p99, double bps)
+{
+	int qd = c->qd;
+
+	if (p99 > c->target_ns)
+	{
+		c->slow_start = 0;
+		c->probe = 0;
+		c->hold = QDCTL_HOLD;
+		c->base_bps = 0; // measured again at the new depth
+		return (qd > 1) ? qd / 2 : 1;
+	}
+	if (c->probe)
+	{
+		if (bps >= c->base_bps * (1.0 + QDCTL_GAIN))
+			c->probe = 0; // paid off, keep on raising
+		else
+		{
+			qd = c->probe;
+			c->probe = 0;
+			c->slow_start = 0;
+			c->hold = QDCTL_HOLD;
+			return qd;
+		}
+	}
+	c->base_bps = bps;
+	if (c->hold > 0)
+	{
+		--c->hold;
+		return qd;
+	}
+	if (qd >= c->max)
+		return qd;
+	c->probe = qd;
+	qd = c->slow_start ? 2 * qd : qd + 1;
+	return (qd > c->max) ? c->max : qd;
+}
+
+int qdctl_done(struct qdctl *c, uint64_t ns, uint64_t bytes,
+	       uint64_t *p99p, double *bpsp)
+{
+	uint64_t now, p99;
+	double bps;
+	int qd, changed = 0;
+
+	pthread_mutex_lock(&c->mutex);
+	lat_record(&c->win, ns);
+	c->win_bytes += bytes;
+	now = lat_now_ns();
+	if ((c->win.count >= QDCTL_WINDOW_MIN) &&
+	    (now - c->win_t0 >= QDCTL_WINDOW_NS))
+	{
+		p99 = lat_percentile(&c->win, 99.0);
+		bps = c->win_bytes * 1e9 / (now - c->win_t0);
+		qd = decide(c, p99, bps);
+		if (qd != c->qd)
+		{
+			__atomic_store_n(&c->qd, qd, __ATOMIC_RELEASE);
+			changed = qd;
+			*p99p = p99;
+			*bpsp = bps;
+		}
+		lat_reset(&c->win);
+		c->win_bytes = 0;
+		c->win_t0 = now;
+	}
+	pthread_mutex_unlock(&c->mutex);
+	return changed;
+}
+
+int qdctl_qd(const struct qdctl *c)
+{
+	int qd = __atomic_load_n(&c->qd, __ATOMIC_ACQUIRE);
+
+	return qd ? qd : INT32_MAX;
+}
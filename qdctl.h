@@ -0,0 +1,51 @@
+/*
+ * qdctl.h
+ *
+ *  Adaptive queue depth, AIMD style: the completions of a device are
+ *  gathered in windows and after each the depth is raised while the
+ *  throughput grows with it and p99 latency stays under the target,
+ *  and halved when p99 goes over. The first raises double it, as in
+ *  TCP slow start, until one does not pay off. A raise that brings no
+ *  throughput is taken back and the depth held before probing again,
+ *  so an SMR disk settles where a deeper queue only adds latency.
+ */
+
+#ifndef QDCTL_H_
+#define QDCTL_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "latency.h"
+
+#define QDCTL_WINDOW_NS 250000000ULL // a window is at least this long
+#define QDCTL_WINDOW_MIN 16	     // and has this many completions
+#define QDCTL_GAIN 0.03		     // a raise must add this much throughput
+#define QDCTL_HOLD 8		     // windows to hold after a back off
+
+struct qdctl
+{
+	int qd;		    // current depth, 0 -> not running
+	int max;
+	uint64_t target_ns; // p99
+	int slow_start;
+	int probe;	    // depth before a raise being tried, else 0
+	int hold;
+	double base_bps;    // throughput at the current depth
+	uint64_t win_t0;
+	uint64_t win_bytes;
+	struct lat_hist win;
+	pthread_mutex_t mutex;
+};
+
+// Starts at 1, up to max, keeping p99 under target_ns
+void qdctl_init(struct qdctl *c, int max, uint64_t target_ns);
+// Safe from several threads at once. One command of bytes took ns.
+// Returns the new depth when it changed, else 0; *p99p and *bpsp are
+// then what the window that changed it measured
+int qdctl_done(struct qdctl *c, uint64_t ns, uint64_t bytes,
+	       uint64_t *p99p, double *bpsp);
+// The depth to keep, or INT32_MAX when c is not running
+int qdctl_qd(const struct qdctl *c);
+
+#endif /* QDCTL_H_ */
@@ -0,0 +1,339 @@
+/*
+ * reczone.c
+ *
+ *  Bucket 0 holds what took under 1 us; above, bucket 1 + 4 o + m the
+ *  values whose top three bits are 1m once shifted right by o + 8, the
+ *  last one all that took longer. The MB/s a cell is read at is its
+ *  timed bytes over its busy time, cleared of single cell outliers (a
+ *  retried READ, a pause) by a median of three before it is segmented.
+ *  A cell goes to the zone its middle is in, so the zones of a table
+ *  need not fall on cells.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reczone.h"
+
+#define RECZONE_MIN_SHIFT 10 // bucket 0 ends at 1024 ns
+
+static int
+bucket_of(uint64_t ns)
+{
+	int msb, idx;
+
+	if (ns < (1ULL << RECZONE_MIN_SHIFT))
+		return 0;
+	msb = 63 - __builtin_clzll(ns);
+	idx = 1 + 4 * (msb - RECZONE_MIN_SHIFT) + (int)((ns >> (msb - 2)) & 3);
+	return (idx < RECZONE_BUCKETS) ? idx : RECZONE_BUCKETS - 1;
+}
+
+// Highest value that lands in bucket idx
+static uint64_t
+bucket_top(int idx)
+{
+	int msb = RECZONE_MIN_SHIFT + (idx - 1) / 4;
+
+	if (0 == idx)
+		return (1ULL << RECZONE_MIN_SHIFT) - 1;
+	return ((uint64_t)(5 + (idx - 1) % 4) << (msb - 2)) - 1;
+}
+
+int reczone_init(struct reczone_map *m, int64_t start, int64_t end)
+{
+	int64_t range = (end > start) ? end - start : 1;
+
+	m->start = start;
+	m->end = start + range;
+	m->width = (range + RECZONE_CELLS - 1) / RECZONE_CELLS;
+	m->cells = (int)((range + m->width - 1) / m->width);
+	m->cell = (struct reczone_cell *)calloc(m->cells, sizeof(*m->cell));
+	return m->cell ? 0 : -1;
+}
+
+void reczone_free(struct reczone_map *m)
+{
+	free(m->cell);
+	m->cell = NULL;
+	m->cells = 0;
+}
+
+void reczone_reset(struct reczone_map *m)
+{
+	if (m->cell)
+		memset(m->cell, 0, m->cells * sizeof(*m->cell));
+}
+
+static struct reczone_cell *
+cell_of(struct reczone_map *m, int64_t lba)
+{
+	int64_t k = (lba - m->start) / m->width;
+
+	if ((NULL == m->cell) || (lba < m->start) || (k >= m->cells))
+		return NULL;
+	return m->cell + k;
+}
+
+void reczone_record(struct reczone_map *m, int64_t lba, uint64_t bytes,
+		    uint64_t ns, uint64_t busy)
+{
+	struct reczone_cell *c = cell_of(m, lba);
+	uint64_t max;
+
+	if (NULL == c)
+		return;
+	__atomic_fetch_add(&c->bytes, bytes, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&c->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&c->bucket[bucket_of(ns)], 1, __ATOMIC_RELAXED);
+	if (busy)
+	{
+		__atomic_fetch_add(&c->timed, bytes, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&c->busy, busy, __ATOMIC_RELAXED);
+	}
+	max = __atomic_load_n(&c->max, __ATOMIC_RELAXED);
+	while ((ns > max) &&
+	       !__atomic_compare_exchange_n(&c->max, &max, ns, 1,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void reczone_error(struct reczone_map *m, int64_t lba, int64_t blocks,
+		   bool recovered)
+{
+	struct reczone_cell *c = cell_of(m, lba);
+
+	if (NULL == c)
+		return;
+	if (recovered)
+		__atomic_fetch_add(&c->recovered, 1, __ATOMIC_RELAXED);
+	else
+		__atomic_fetch_add(&c->unrecovered, (uint32_t)blocks,
+				   __ATOMIC_RELAXED);
+}
+
+static double
+median3(double a, double b, double c)
+{
+	if (a > b)
+	{
+		double t = a;
+
+		a = b;
+		b = t;
+	}
+	return (c < a) ? a : (c > b) ? b : c;
+}
+
+// The best split of x[a, c) into two runs of at least RECZONE_MIN_CELLS,
+// when it is a step: its gain in *gain, else -1
+static int
+best_split(const double *s, const double *q, int a, int c, double *gain)
+{
+	double n = c - a, tot = s[c] - s[a], g, best = 0.0, m1, m2, ss, sd;
+	int k, at = -1;
+
+	for (k = a + RECZONE_MIN_CELLS; k <= c - RECZONE_MIN_CELLS; ++k)
+	{
+		double n1 = k - a, s1 = s[k] - s[a];
+
+		g = s1 / n1 - (tot - s1) / (n - n1);
+		g = n1 * (n - n1) / n * g * g;
+		if (g > best)
+		{
+			best = g;
+			at = k;
+		}
+	}
+	if (at < 0)
+		return -1;
+	m1 = (s[at] - s[a]) / (at - a);
+	m2 = (s[c] - s[at]) / (c - at);
+	if (fabs(m1 - m2) * 100.0 < RECZONE_STEP_PCT * fmax(m1, m2))
+		return -1;
+	// and well out of the noise: 3 standard errors of the difference
+	ss = (q[c] - q[a]) - (s[at] - s[a]) * m1 - (s[c] - s[at]) * m2;
+	sd = sqrt(fmax(ss, 0.0) / fmax(n - 2, 1));
+	if (fabs(m1 - m2) <= 3 * sd * sqrt(1.0 / (at - a) + 1.0 / (c - at)))
+		return -1;
+	*gain = best;
+	return at;
+}
+
+int reczone_infer(const struct reczone_map *m, int64_t *first, int max)
+{
+	double *x = (double *)malloc((m->cells + 1) * 3 * sizeof(double));
+	double *s, *q, gain, best;
+	int *idx = (int *)malloc((m->cells + 1) * sizeof(int));
+	int *bnd = (int *)malloc((max + 1) * sizeof(int));
+	int k, n = 0, nb, z, at, bz, bat;
+
+	first[0] = m->start;
+	if ((NULL == x) || (NULL == idx) || (NULL == bnd) || (max < 2))
+	{
+		free(x);
+		free(idx);
+		free(bnd);
+		return 1;
+	}
+	s = x + m->cells + 1;
+	q = s + m->cells + 1;
+	for (k = 0; k < m->cells; ++k)
+		if (m->cell[k].busy && m->cell[k].timed)
+		{
+			x[n] = m->cell[k].timed * 1e3 / m->cell[k].busy;
+			idx[n++] = k;
+		}
+	s[0] = q[0] = 0.0;
+	for (k = 0; k < n; ++k)
+	{
+		double v = ((k > 0) && (k < n - 1))
+				   ? median3(x[k - 1], x[k], x[k + 1])
+				   : x[k];
+
+		s[k + 1] = s[k] + v;
+		q[k + 1] = q[k] + v * v;
+	}
+	bnd[0] = 0;
+	bnd[1] = n;
+	for (nb = 1; nb < max; ++nb)
+	{
+		// the zone whose best split gains the most is split first
+		bz = bat = -1;
+		best = 0.0;
+		for (z = 0; z < nb; ++z)
+		{
+			at = best_split(s, q, bnd[z], bnd[z + 1], &gain);
+			if ((at >= 0) && (gain > best))
+			{
+				best = gain;
+				bz = z;
+				bat = at;
+			}
+		}
+		if (bz < 0)
+			break;
+		memmove(bnd + bz + 2, bnd + bz + 1, (nb - bz) * sizeof(int));
+		bnd[bz + 1] = bat;
+	}
+	for (z = 1; z < nb; ++z)
+		first[z] = m->start + idx[bnd[z]] * m->width;
+	free(x);
+	free(idx);
+	free(bnd);
+	return nb;
+}
+
+// The key of a table line, up to the third tab; the revision "*" in it
+// matching any, the line pointing past it
+static bool
+key_match(char **linep, const char *key)
+{
+	char *line = *linep, *cp = line;
+	const char *kp = key;
+	int k;
+
+	for (k = 0; k < 3; ++k)
+	{
+		cp = strchr(cp, '\t');
+		if (NULL == cp)
+			return false;
+		if (k < 2)
+		{
+			kp = strchr(kp, '\t');
+			if (NULL == kp)
+				return false;
+			++kp;
+		}
+		++cp;
+	}
+	*linep = cp;
+	if ((cp - line == kp - key + 2) && ('*' == cp[-2]) &&
+	    (0 == strncmp(line, key, kp - key)))
+		return true;
+	return (strlen(key) == (size_t)(cp - 1 - line)) &&
+	       (0 == strncmp(line, key, cp - 1 - line));
+}
+
+int reczone_table(const char *path, const char *key,
+		  const struct reczone_map *m, int64_t *first, int max)
+{
+	char line[4096], *cp, *end;
+	FILE *fp = fopen(path, "r");
+	long long lba;
+	int n = 0;
+
+	if (NULL == fp)
+		return -1;
+	while (fgets(line, sizeof(line), fp))
+	{
+		line[strcspn(line, "\n")] = '\0';
+		cp = line;
+		if (('#' == line[0]) || !key_match(&cp, key))
+			continue;
+		// the last line of the model wins
+		first[0] = m->start;
+		for (n = 1; n < max; cp = end)
+		{
+			lba = strtoll(cp, &end, 0);
+			if (end == cp)
+				break;
+			if ((lba > first[n - 1]) && (lba < m->end))
+				first[n++] = lba;
+		}
+	}
+	fclose(fp);
+	return n;
+}
+
+void reczone_sum(const struct reczone_map *m, const int64_t *first, int n,
+		 struct reczone *z)
+{
+	uint32_t hist[RECZONE_BUCKETS];
+	uint64_t timed, busy, want[3], pct[3], seen, top;
+	const struct reczone_cell *c;
+	int k, b, i, j = 0, p;
+
+	for (i = 0; i < n; ++i)
+	{
+		memset(&z[i], 0, sizeof(z[i]));
+		memset(hist, 0, sizeof(hist));
+		z[i].start = first[i];
+		z[i].end = (i + 1 < n) ? first[i + 1] : m->end;
+		timed = busy = 0;
+		for (; j < m->cells; ++j)
+		{
+			c = m->cell + j;
+			if (m->start + j * m->width + m->width / 2 >= z[i].end)
+				break;
+			z[i].bytes += c->bytes;
+			z[i].count += c->count;
+			z[i].recovered += c->recovered;
+			z[i].unrecovered += c->unrecovered;
+			if (c->max > z[i].max)
+				z[i].max = c->max;
+			timed += c->timed;
+			busy += c->busy;
+			for (b = 0; b < RECZONE_BUCKETS; ++b)
+				hist[b] += c->bucket[b];
+		}
+		z[i].mbps = busy ? timed * 1e3 / busy : 0.0;
+		if (0 == z[i].count)
+			continue;
+		want[0] = (uint64_t)(0.5 * z[i].count + 0.5);
+		want[1] = (uint64_t)(0.99 * z[i].count + 0.5);
+		want[2] = (uint64_t)(0.999 * z[i].count + 0.5);
+		for (k = p = 0, seen = 0; (k < RECZONE_BUCKETS) && (p < 3); ++k)
+		{
+			seen += hist[k];
+			top = bucket_top(k);
+			for (; (p < 3) && (seen >= (want[p] ? want[p] : 1)); ++p)
+				pct[p] = (top < z[i].max) ? top : z[i].max;
+		}
+		z[i].p50 = pct[0];
+		z[i].p99 = pct[1];
+		z[i].p999 = pct[2];
+	}
+}
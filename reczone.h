@@ -0,0 +1,96 @@
+/*
+ * reczone.h
+ *
+ *  A pass summed up by the recording zones of a disk: the bands of
+ *  tracks of one number of sectors each, whose MB/s steps down from the
+ *  outer diameter in. The LBA space is kept in RECZONE_CELLS cells, each
+ *  with the bytes and busy time of its READs, a coarse histogram of
+ *  their latency and its recovered and unrecovered errors. At the end of
+ *  a pass the cells are grouped into zones, either at boundaries given
+ *  for the model or where the MB/s steps, found by binary segmentation:
+ *  the split of a run of cells that best separates their means is kept
+ *  while the two sides differ by over RECZONE_STEP_PCT percent and by
+ *  more than the noise within them. A drive then comes down to at most
+ *  RECZONE_MAX zones, whatever its size, each with its MB/s, latency
+ *  percentiles and error density, to hold against others of its model.
+ *
+ *  The latency histogram is log linear, 4 buckets a power of two from
+ *  1 us to 17 s, so a percentile is to within a quarter of itself.
+ *
+ *  Zone table format, one line per model, fields tab separated: the
+ *  profile key (vendor, product, revision; a revision of * for any),
+ *  then the first lba of each zone after the first, blank separated.
+ */
+
+#ifndef RECZONE_H_
+#define RECZONE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RECZONE_CELLS 1024
+#define RECZONE_MAX 64	     // most zones of a summary
+#define RECZONE_MIN_CELLS 4  // fewest cells of an inferred zone
+#define RECZONE_STEP_PCT 2.0 // MB/s step that makes a new zone
+#define RECZONE_OCTAVES 24
+#define RECZONE_BUCKETS (1 + 4 * RECZONE_OCTAVES)
+
+struct reczone_cell
+{
+	uint64_t bytes;
+	uint64_t timed; // bytes that busy counts the time of
+	uint64_t busy;	// ns
+	uint64_t count;
+	uint64_t max; // ns
+	uint32_t recovered;
+	uint32_t unrecovered; // blocks
+	uint32_t bucket[RECZONE_BUCKETS];
+};
+
+struct reczone_map
+{
+	int64_t start; // lba
+	int64_t end;
+	int64_t width; // lbas per cell
+	int cells;
+	struct reczone_cell *cell;
+};
+
+struct reczone
+{
+	int64_t start; // lba
+	int64_t end;
+	uint64_t bytes;
+	double mbps; // 0 when not timed
+	uint64_t count;
+	uint64_t p50; // ns
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t max;
+	uint64_t recovered;
+	uint64_t unrecovered;
+};
+
+// Return 0 on success, -1 when out of memory
+int reczone_init(struct reczone_map *m, int64_t start, int64_t end);
+void reczone_free(struct reczone_map *m);
+void reczone_reset(struct reczone_map *m);
+// A READ of bytes at lba that took ns, busy the time the device spent on
+// it (0 not known). Safe from several threads at once
+void reczone_record(struct reczone_map *m, int64_t lba, uint64_t bytes,
+		    uint64_t ns, uint64_t busy);
+// Errors at lba: one recovered, or blocks unrecovered
+void reczone_error(struct reczone_map *m, int64_t lba, int64_t blocks,
+		   bool recovered);
+// The first lba of each zone where the MB/s of the cells steps, from
+// m->start; returns how many zones, at most max
+int reczone_infer(const struct reczone_map *m, int64_t *first, int max);
+// The zones key has in the table at path, clipped to the map, as the
+// first lba of each. Returns how many, 0 none for key, -1 on errors
+int reczone_table(const char *path, const char *key,
+		  const struct reczone_map *m, int64_t *first, int max);
+// The n zones from first[] summed up into z
+void reczone_sum(const struct reczone_map *m, const int64_t *first, int n,
+		 struct reczone *z);
+
+#endif /* RECZONE_H_ */
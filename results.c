@@ -0,0 +1,472 @@
+/*
+ * results.c
+ *
+ *  A record is written to a memory stream first, so its length is
+ *  known before it goes to the file, then appended with one write()
+ *  while the data file is locked; its offset is the size of the file
+ *  under that lock. A query reads the index alone to find the records
+ *  of a drive, keeping the offsets of the last max in a ring, and then
+ *  reads those records and no others.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "results.h"
+
+static const char results_magic[7] = {'D', 'S', 'K', 'R', 'S', 'L', 'T'};
+static const char results_idx_magic[7] = {'D', 'S', 'K', 'R', 'I', 'D', 'X'};
+
+#define RESULTS_HDR 12 // magic, version, u32 length
+#define RESULTS_MAX_LEN (64 << 20) // longer is not a record of ours
+#define BODY_FIELDS 22
+
+// Bytes of the integers a body begins with, as write_body() puts them
+static const int body_widths[BODY_FIELDS] = {8, 4, 4, 8, 8, 8, 8, 4, 4, 4, 4,
+					     4, 8, 4, 8, 8, 8, 8, 8, 8, 8, 8};
+
+static void
+put_le(FILE *fp, uint64_t v, int bytes)
+{
+	while (bytes-- > 0)
+	{
+		fputc((int)(v & 0xff), fp);
+		v >>= 8;
+	}
+}
+
+static void
+put_varint(FILE *fp, uint64_t v)
+{
+	while (v >= 0x80)
+	{
+		fputc((int)(v & 0x7f) | 0x80, fp);
+		v >>= 7;
+	}
+	fputc((int)v, fp);
+}
+
+static int
+get_le(FILE *fp, uint64_t *v, int bytes)
+{
+	int k, c;
+
+	*v = 0;
+	for (k = 0; k < bytes; ++k)
+	{
+		c = fgetc(fp);
+		if (EOF == c)
+			return -1;
+		*v |= (uint64_t)c << (8 * k);
+	}
+	return 0;
+}
+
+static int
+get_varint(FILE *fp, uint64_t *v)
+{
+	int c, shift = 0;
+
+	*v = 0;
+	do
+	{
+		c = fgetc(fp);
+		if ((EOF == c) || (shift > 63))
+			return -1;
+		*v |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return 0;
+}
+
+static uint64_t
+le(const uint8_t *p, int bytes)
+{
+	uint64_t v = 0;
+
+	while (bytes-- > 0)
+		v = v << 8 | p[bytes];
+	return v;
+}
+
+static void
+put_le_buf(uint8_t *p, uint64_t v, int bytes)
+{
+	while (bytes-- > 0)
+	{
+		*p++ = (uint8_t)(v & 0xff);
+		v >>= 8;
+	}
+}
+
+// The key the index keeps r under
+static const char *
+rec_key(const struct results_rec *r)
+{
+	return r->id[0] ? r->id : r->name;
+}
+
+// The body of r, after the length, into fp
+static void
+write_body(FILE *fp, const struct results_rec *r)
+{
+	size_t k, id_len = strlen(r->id), name_len = strlen(r->name);
+	size_t cfg_len = strlen(r->config);
+	int64_t prev = 0;
+	int b, last = -1, nb = 0;
+
+	for (b = 0; b < LAT_BUCKETS; ++b)
+		nb += (0 != r->lat.bucket[b]);
+	put_le(fp, r->time, 8);
+	put_le(fp, r->pass, 4);
+	put_le(fp, r->blk_sz, 4);
+	put_le(fp, r->start, 8);
+	put_le(fp, r->end, 8);
+	put_le(fp, r->bytes, 8);
+	put_le(fp, r->ns, 8);
+	put_le(fp, id_len, 4);
+	put_le(fp, name_len, 4);
+	put_le(fp, cfg_len, 4);
+	put_le(fp, r->zones, 4);
+	put_le(fp, nb, 4);
+	put_le(fp, r->next, 8);
+	put_le(fp, (uint32_t)r->temp_max, 4);
+	put_le(fp, r->corrected, 8);
+	put_le(fp, r->uncorrected, 8);
+	put_le(fp, r->recovered, 8);
+	put_le(fp, r->unrecovered, 8);
+	put_le(fp, r->grown, 8);
+	put_le(fp, r->lat.count, 8);
+	put_le(fp, r->lat.max, 8);
+	put_le(fp, r->lat.sum, 8);
+	fwrite(r->id, 1, id_len, fp);
+	fwrite(r->name, 1, name_len, fp);
+	fwrite(r->config, 1, cfg_len, fp);
+	for (b = 0; b < r->zones; ++b)
+	{
+		put_le(fp, r->zone_bytes[b], 8);
+		put_le(fp, r->zone_ns[b], 8);
+	}
+	for (b = 0; b < LAT_BUCKETS; ++b)
+	{
+		if (0 == r->lat.bucket[b])
+			continue;
+		put_varint(fp, b - last);
+		put_varint(fp, r->lat.bucket[b]);
+		last = b;
+	}
+	for (k = 0; k < r->next; ++k)
+	{
+		const struct badmap_ext *e = r->ext + k;
+
+		put_varint(fp, e->lba - prev);
+		put_varint(fp, ((uint64_t)(e->len - 1) << 2) | e->kind);
+		prev = e->lba;
+	}
+}
+
+// Writes all of len bytes of buf to fd. Returns 0, -1 with errno
+static int
+write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t n;
+
+	while (len)
+	{
+		n = write(fd, p, len);
+		if ((n < 0) && (EINTR == errno))
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int results_append(const char *path, const struct results_rec *r)
+{
+	uint8_t ent[RESULTS_IDX_SZ];
+	char ipath[4096];
+	const char *key = rec_key(r);
+	char *body = NULL;
+	size_t len = 0, klen = strlen(key);
+	struct stat st;
+	FILE *mem;
+	int fd, ifd = -1, res = -1, err;
+
+	if ((r->zones < 0) || (r->zones > RESULTS_ZONES))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	mem = open_memstream(&body, &len);
+	if (NULL == mem)
+		return -1;
+	fwrite(results_magic, 1, sizeof(results_magic), mem);
+	fputc(RESULTS_VERSION, mem);
+	put_le(mem, 0, 4);
+	write_body(mem, r);
+	if (fclose(mem) || (len - RESULTS_HDR > RESULTS_MAX_LEN))
+	{
+		free(body);
+		errno = ENOMEM;
+		return -1;
+	}
+	put_le_buf((uint8_t *)body + 8, len - RESULTS_HDR, 4);
+	fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if (fd < 0)
+	{
+		free(body);
+		return -1;
+	}
+	snprintf(ipath, sizeof(ipath), "%s.idx", path);
+	if (flock(fd, LOCK_EX) || fstat(fd, &st))
+		goto out;
+	ifd = open(ipath, O_RDWR | O_APPEND | O_CREAT, 0644);
+	if (ifd < 0)
+		goto out;
+	if (write_all(fd, body, len))
+		goto out;
+	if (0 == lseek(ifd, 0, SEEK_END))
+	{
+		uint8_t hdr[8];
+
+		memcpy(hdr, results_idx_magic, sizeof(results_idx_magic));
+		hdr[7] = RESULTS_VERSION;
+		if (write_all(ifd, hdr, sizeof(hdr)))
+			goto out;
+	}
+	memset(ent, 0, sizeof(ent));
+	put_le_buf(ent, r->time, 8);
+	put_le_buf(ent + 8, st.st_size, 8);
+	put_le_buf(ent + 16, len, 4);
+	put_le_buf(ent + 20, r->pass, 4);
+	memcpy(ent + 24, key, (klen < RESULTS_ID_SZ) ? klen : RESULTS_ID_SZ - 1);
+	// an entry lost here is found again from the records by a query
+	if (0 == write_all(ifd, ent, sizeof(ent)))
+		res = 0;
+out:
+	err = errno;
+	if (ifd >= 0)
+		close(ifd);
+	close(fd);
+	free(body);
+	errno = err;
+	return res;
+}
+
+// Reads the record of len bytes at off of fp into r. Returns 0, -1 when
+// it is not a record
+static int
+read_record(FILE *fp, int64_t off, size_t len, struct results_rec *r)
+{
+	uint64_t v[BODY_FIELDS], c, d;
+	uint8_t *buf;
+	FILE *mem;
+	size_t k;
+	int b, res = -1;
+
+	if ((len < RESULTS_HDR) || (len - RESULTS_HDR > RESULTS_MAX_LEN))
+		return -1;
+	buf = (uint8_t *)malloc(len);
+	if (NULL == buf)
+		return -1;
+	if (fseeko(fp, off, SEEK_SET) || (fread(buf, 1, len, fp) != len) ||
+	    memcmp(buf, results_magic, sizeof(results_magic)) ||
+	    (RESULTS_VERSION != buf[7]) || (le(buf + 8, 4) != len - RESULTS_HDR))
+	{
+		free(buf);
+		return -1;
+	}
+	mem = fmemopen(buf + RESULTS_HDR, len - RESULTS_HDR, "r");
+	if (NULL == mem)
+	{
+		free(buf);
+		return -1;
+	}
+	memset(r, 0, sizeof(*r));
+	for (b = 0; b < BODY_FIELDS; ++b)
+		if (get_le(mem, &v[b], body_widths[b]))
+			goto out;
+	// id, name and config lengths; zones
+	if ((v[7] >= RESULTS_ID_SZ) || (v[8] >= RESULTS_NAME_SZ) ||
+	    (v[9] >= RESULTS_CONFIG_SZ) || (v[10] > RESULTS_ZONES) ||
+	    (v[11] > LAT_BUCKETS) || (v[12] > len))
+		goto out;
+	r->time = (int64_t)v[0];
+	r->pass = (unsigned int)v[1];
+	r->blk_sz = (int)v[2];
+	r->start = (int64_t)v[3];
+	r->end = (int64_t)v[4];
+	r->bytes = (int64_t)v[5];
+	r->ns = v[6];
+	r->zones = (int)v[10];
+	r->temp_max = (int32_t)(uint32_t)v[13];
+	r->corrected = (int64_t)v[14];
+	r->uncorrected = (int64_t)v[15];
+	r->recovered = (int64_t)v[16];
+	r->unrecovered = (int64_t)v[17];
+	r->grown = (int64_t)v[18];
+	r->lat.count = v[19];
+	r->lat.max = v[20];
+	r->lat.sum = v[21];
+	if ((fread(r->id, 1, v[7], mem) != v[7]) ||
+	    (fread(r->name, 1, v[8], mem) != v[8]) ||
+	    (fread(r->config, 1, v[9], mem) != v[9]))
+		goto out;
+	for (b = 0; b < r->zones; ++b)
+	{
+		if (get_le(mem, &c, 8) || get_le(mem, &d, 8))
+			goto out;
+		r->zone_bytes[b] = (int64_t)c;
+		r->zone_ns[b] = d;
+	}
+	for (k = 0, b = -1; k < v[11]; ++k)
+	{
+		if (get_varint(mem, &c) || get_varint(mem, &d) || (0 == c) ||
+		    (c > (uint64_t)(LAT_BUCKETS - 1 - b)))
+			goto out;
+		b += (int)c;
+		r->lat.bucket[b] = d;
+	}
+	if (v[12])
+	{
+		int64_t prev = 0;
+
+		r->ext = (struct badmap_ext *)calloc(v[12], sizeof(*r->ext));
+		if (NULL == r->ext)
+			goto out;
+		for (k = 0; k < v[12]; ++k)
+		{
+			if (get_varint(mem, &c) || get_varint(mem, &d))
+				goto out;
+			prev += (int64_t)c;
+			r->ext[k].lba = prev;
+			r->ext[k].len = (uint32_t)(d >> 2) + 1;
+			r->ext[k].kind = (uint32_t)(d & 3);
+		}
+		r->next = (size_t)v[12];
+	}
+	res = 0;
+out:
+	fclose(mem);
+	free(buf);
+	if (res)
+	{
+		free(r->ext);
+		r->ext = NULL;
+		r->next = 0;
+	}
+	return res;
+}
+
+struct hit
+{
+	int64_t off;
+	uint32_t len;
+};
+
+// An entry of key at off, len into the ring of the last max
+static void
+ring_add(struct hit *ring, int max, int *n, int64_t off, uint32_t len)
+{
+	ring[*n % max].off = off;
+	ring[*n % max].len = len;
+	++*n;
+}
+
+static int
+key_match(const char *a, const char *key)
+{
+	return 0 == strncmp(a, key, RESULTS_ID_SZ - 1);
+}
+
+int results_query(const char *path, const char *id, int max,
+		  struct results_rec *recs)
+{
+	uint8_t ent[RESULTS_IDX_SZ], hdr[RESULTS_HDR];
+	char ipath[4096], key[RESULTS_ID_SZ];
+	struct results_rec *r;
+	struct hit *ring;
+	int64_t off = 0;
+	FILE *fp, *ifp;
+	int n = 0, k, got = 0, first;
+
+	if (max < 1)
+		return 0;
+	fp = fopen(path, "rb");
+	if (NULL == fp)
+		return -1;
+	ring = (struct hit *)calloc(max, sizeof(*ring));
+	r = (struct results_rec *)malloc(sizeof(*r));
+	if ((NULL == ring) || (NULL == r))
+	{
+		free(ring);
+		free(r);
+		fclose(fp);
+		errno = ENOMEM;
+		return -1;
+	}
+	snprintf(ipath, sizeof(ipath), "%s.idx", path);
+	ifp = fopen(ipath, "rb");
+	if (ifp && (fread(hdr, 1, 8, ifp) == 8) &&
+	    (0 == memcmp(hdr, results_idx_magic, sizeof(results_idx_magic))) &&
+	    (RESULTS_VERSION == hdr[7]))
+	{
+		while (fread(ent, 1, sizeof(ent), ifp) == sizeof(ent))
+		{
+			memcpy(key, ent + 24, RESULTS_ID_SZ);
+			key[RESULTS_ID_SZ - 1] = '\0';
+			if ((int64_t)le(ent + 8, 8) < off)
+				continue; // an entry written twice
+			off = (int64_t)le(ent + 8, 8) + (int64_t)le(ent + 16, 4);
+			if (key_match(key, id))
+				ring_add(ring, max, &n, (int64_t)le(ent + 8, 8),
+					 (uint32_t)le(ent + 16, 4));
+		}
+	}
+	if (ifp)
+		fclose(ifp);
+	// records after the last the index has, read for their key
+	while ((0 == fseeko(fp, off, SEEK_SET)) &&
+	       (fread(hdr, 1, sizeof(hdr), fp) == sizeof(hdr)) &&
+	       (0 == memcmp(hdr, results_magic, sizeof(results_magic))))
+	{
+		uint32_t len = (uint32_t)le(hdr + 8, 4) + RESULTS_HDR;
+
+		if (read_record(fp, off, len, r))
+			break;
+		if (key_match(rec_key(r), id))
+			ring_add(ring, max, &n, off, len);
+		free(r->ext);
+		off += len;
+	}
+	first = (n > max) ? n - max : 0;
+	for (k = first; k < n; ++k)
+		if (0 == read_record(fp, ring[k % max].off, ring[k % max].len,
+				     &recs[got]))
+			++got;
+	free(ring);
+	free(r);
+	fclose(fp);
+	return got;
+}
+
+void results_free(struct results_rec *recs, int n)
+{
+	int k;
+
+	for (k = 0; k < n; ++k)
+	{
+		free(recs[k].ext);
+		recs[k].ext = NULL;
+		recs[k].next = 0;
+	}
+}
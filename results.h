@@ -0,0 +1,85 @@
+/*
+ * results.h
+ *
+ *  A store of the results of past runs: each pass of each device adds a
+ *  record to a file that is only ever appended to, and an entry to an
+ *  index next to it, so the history of a drive is found from its WWN
+ *  without reading the records of the others. A record holds what the
+ *  pass was (device identity, range, block size, engine and settings),
+ *  the bytes and time of each zone, the latency histogram without its
+ *  empty buckets, the bad, weak and miscompared extents so far and how
+ *  the drive's own counters moved over it.
+ *
+ *  Data file format, records one after another, integers little endian:
+ *    "DSKRSLT" and a version byte (1), u32 length of the rest, then
+ *    u64 time() the pass ended, u32 pass, u32 block size, u64 first lba,
+ *    u64 lba past the last, u64 bytes read, u64 ns it took, u32 lengths
+ *    of the id, the name and the config, u32 zones, u32 latency buckets
+ *    not empty, u64 extents, i32 hottest C (INT32_MIN none), i64 each of
+ *    read errors corrected and uncorrected by the drive's log (-1 not
+ *    reported), recovered and unrecovered by the sense of the READs and
+ *    grown defects at the end (-1 not read), u64 latency count, max and
+ *    sum, the id, name and config (no NULs), per zone u64 bytes and u64
+ *    ns, per bucket two LEB128 varints (the index less the one before
+ *    plus 1, the count), then per extent two as badmap.h has them.
+ *  Index, path with ".idx" added: "DSKRIDX" and a version byte (1),
+ *  then entries of RESULTS_IDX_SZ bytes: u64 time, u64 offset of the
+ *  record, u32 its length, u32 pass, the id NUL padded (the name when
+ *  the id is unknown, cut to fit). An index that is missing or behind
+ *  the data file is caught up from the records.
+ *  Both are appended under an exclusive flock() of the data file, so
+ *  the processes of a --job plan can share one store.
+ */
+
+#ifndef RESULTS_H_
+#define RESULTS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "badmap.h"
+#include "latency.h"
+
+#define RESULTS_VERSION 1
+#define RESULTS_ZONES 64     // most zones a record has
+#define RESULTS_ID_SZ 80     // as DEV_ID_SZ of sg_dd.c
+#define RESULTS_NAME_SZ 256
+#define RESULTS_CONFIG_SZ 256
+#define RESULTS_IDX_SZ (24 + RESULTS_ID_SZ)
+
+struct results_rec
+{
+	int64_t time;
+	unsigned int pass;
+	int blk_sz;
+	int64_t start;
+	int64_t end;
+	int64_t bytes;
+	uint64_t ns;
+	char id[RESULTS_ID_SZ];		// WWN, else serial number, "" unknown
+	char name[RESULTS_NAME_SZ];
+	char config[RESULTS_CONFIG_SZ]; // "engine=sync qd=1 ..."
+	int zones;
+	int64_t zone_bytes[RESULTS_ZONES];
+	uint64_t zone_ns[RESULTS_ZONES];
+	struct lat_hist lat;
+	struct badmap_ext *ext; // loaded ones are the record's, results_free()
+	size_t next;
+	int temp_max;
+	int64_t corrected;
+	int64_t uncorrected;
+	int64_t recovered;
+	int64_t unrecovered;
+	int64_t grown;
+};
+
+// Appends r to path and its index. Returns 0, -1 with errno
+int results_append(const char *path, const struct results_rec *r);
+// The last max records of id, or of the device name of those without
+// one, oldest first, into recs. Returns how many, -1 with errno
+int results_query(const char *path, const char *id, int max,
+		  struct results_rec *recs);
+// The extents of recs[0, n) a query loaded
+void results_free(struct results_rec *recs, int n);
+
+#endif /* RESULTS_H_ */
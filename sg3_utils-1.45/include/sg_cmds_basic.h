@@ -90,6 +90,12 @@ int sg_ll_log_sense_v2(int sg_fd, bool ppc, bool sp, int pc, int pg_code,
                        int mx_resp_len, int timeout_secs, int * residp,
                        bool noisy, int verbose);
 
+/* Similar to sg_ll_log_sense_v2(). See note above about "_pt" suffix. */
+int sg_ll_log_sense_pt(struct sg_pt_base * ptp, bool ppc, bool sp, int pc,
+                       int pg_code, int subpg_code, int paramp,
+                       uint8_t * resp, int mx_resp_len, int timeout_secs,
+                       int * residp, bool noisy, int verbose);
+
 /* Invokes a SCSI MODE SELECT (6) command.  Return of 0 -> success,
  * SG_LIB_CAT_INVALID_OP -> invalid opcode, SG_LIB_CAT_ILLEGAL_REQ ->
  * bad field in cdb, * SG_LIB_CAT_NOT_READY -> device not ready,
@@ -139,6 +145,12 @@ int sg_ll_mode_sense10_v2(int sg_fd, bool llbaa, bool dbd, int pc,
                           int mx_resp_len, int timeout_secs, int * residp,
                           bool noisy, int verbose);
 
+/* Similar to sg_ll_mode_sense10_v2(). See note above about "_pt" suffix. */
+int sg_ll_mode_sense10_pt(struct sg_pt_base * ptp, bool llbaa, bool dbd,
+                          int pc, int pg_code, int sub_pg_code, void * resp,
+                          int mx_resp_len, int timeout_secs, int * residp,
+                          bool noisy, int verbose);
+
 /* Invokes a SCSI PREVENT ALLOW MEDIUM REMOVAL command (SPC-3)
  * prevent==0 allows removal, prevent==1 prevents removal ...
  * Return of 0 -> success,
@@ -156,6 +168,11 @@ int sg_ll_prevent_allow(int sg_fd, int prevent, bool noisy, int verbose);
 int sg_ll_readcap_10(int sg_fd, bool pmi, unsigned int lba, void * resp,
                      int mx_resp_len, bool noisy, int verbose);
 
+/* Similar to sg_ll_readcap_10(). See note above about "_pt" suffix. */
+int sg_ll_readcap_10_pt(struct sg_pt_base * ptp, bool pmi, unsigned int lba,
+                        void * resp, int mx_resp_len, bool noisy,
+                        int verbose);
+
 /* Invokes a SCSI READ CAPACITY (16) command. Returns 0 -> success,
  * SG_LIB_CAT_UNIT_ATTENTION -> media changed??, SG_LIB_CAT_INVALID_OP
  *  -> cdb not supported, SG_LIB_CAT_IlLEGAL_REQ -> bad field in cdb
@@ -164,6 +181,11 @@ int sg_ll_readcap_10(int sg_fd, bool pmi, unsigned int lba, void * resp,
 int sg_ll_readcap_16(int sg_fd, bool pmi, uint64_t llba, void * resp,
                      int mx_resp_len, bool noisy, int verbose);
 
+/* Similar to sg_ll_readcap_16(). See note above about "_pt" suffix. */
+int sg_ll_readcap_16_pt(struct sg_pt_base * ptp, bool pmi, uint64_t llba,
+                        void * resp, int mx_resp_len, bool noisy,
+                        int verbose);
+
 /* Invokes a SCSI REPORT LUNS command. Return of 0 -> success,
  * SG_LIB_CAT_INVALID_OP -> Report Luns not supported,
  * SG_LIB_CAT_ILLEGAL_REQ -> bad field in cdb, SG_LIB_CAT_ABORTED_COMMAND,
@@ -183,6 +183,10 @@ int sg_err_category_new(int scsi_status, int host_status, int driver_status,
 /* The following function declaration is for the sg version 3 driver. */
 int sg_err_category3(struct sg_io_hdr * hp);
 
+/* As sg_err_category3(), its sense data decoded into 'sdp' on the way so
+ * callers need not parse it again (see sg_decode_sense()). */
+int sg_err_category3_dec(struct sg_io_hdr * hp, struct sg_sense_dec * sdp);
+
 
 /* Note about SCSI status codes found in older versions of Linux.
    Linux has traditionally used a 1 bit right shifted and masked
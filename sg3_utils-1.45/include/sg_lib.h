@@ -243,6 +243,28 @@ bool sg_get_sense_filemark_eom_ili(const uint8_t * sensep, int sb_len,
 bool sg_get_sense_progress_fld(const uint8_t * sensep, int sb_len,
                                int * progress_outp);
 
+/* The fields of a sense buffer, fixed or descriptor format, decoded in one
+ * pass for callers that want several of them. Each is what the function
+ * named beside it yields for the same buffer. */
+struct sg_sense_dec {
+    struct sg_scsi_sense_hdr ssh;   /* sg_scsi_normalize_sense() */
+    bool valid;                     /* its return value */
+    bool info_valid;                /* sg_get_sense_info_fld() returns, */
+    uint64_t info;                  /* and its information field */
+    bool progress_valid;            /* sg_get_sense_progress_fld() */
+    int progress;
+    bool fm_eom_ili;                /* sg_get_sense_filemark_eom_ili() */
+    bool filemark;
+    bool eom;
+    bool ili;
+    int category;                   /* sg_err_category_sense() */
+};
+
+/* Decodes sense buffer 'sensep' into 'sdp' walking it once, where the
+ * functions above each parse it again. Returns sdp->valid. */
+bool sg_decode_sense(const uint8_t * sensep, int sb_len,
+                     struct sg_sense_dec * sdp);
+
 /* Closely related to sg_print_sense(). Puts decoded sense data in 'buff'.
  * Usually multiline with multiple '\n' including one trailing. If
  * 'raw_sinfo' set appends sense buffer in hex. 'leadin' is string prepended
@@ -121,6 +121,7 @@ extern struct sg_lib_value_name_t sg_lib_read_attr_arr[];
 extern struct sg_lib_value_name_t sg_lib_read_pos_arr[];
 extern struct sg_lib_asc_ascq_range_t sg_lib_asc_ascq_range[];
 extern struct sg_lib_asc_ascq_t sg_lib_asc_ascq[];
+extern const int sg_lib_asc_ascq_count;
 extern struct sg_lib_value_name_t sg_lib_scsi_feature_sets[];
 extern const char * sg_lib_sense_key_desc[];
 extern const char * sg_lib_pdt_strs[];
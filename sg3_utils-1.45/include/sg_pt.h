@@ -245,6 +245,41 @@ uint32_t get_pt_nvme_nsid(const struct sg_pt_base * objp);
  * scsi_pt_close_device() ).  */
 void destruct_scsi_pt_obj(struct sg_pt_base * objp);
 
+/* Like construct_scsi_pt_obj_with_fd() (dev_fd may be -1) but hands out
+ * the object this thread last gave to put_scsi_pt_obj(), set up anew for
+ * dev_fd, when there is one; so commands issued one after another by a
+ * thread do not allocate. Pair each call with one put_scsi_pt_obj(), not
+ * destruct_scsi_pt_obj(). On Linux; elsewhere these two construct and
+ * destruct. */
+struct sg_pt_base * get_scsi_pt_obj(int dev_fd, int verbose);
+
+/* Gives back an object from get_scsi_pt_obj(), kept for the next one of
+ * this thread or destructed. dev_fd is not closed. */
+void put_scsi_pt_obj(struct sg_pt_base * objp);
+
+/* What the pass-through makes of a file descriptor */
+struct sg_pt_fd_info {
+    bool is_sg;         /* Linux sg char device */
+    bool is_bsg;        /* Linux bsg char device */
+    bool is_nvme;       /* NVMe char device, or block device when nsid */
+    int sg_version;     /* of the sg driver when is_sg, else 0 */
+    uint32_t nvme_nsid; /* of a NVMe block device, else 0 */
+};
+
+/* Fills *fip for dev_fd. On Linux looks at it (fstat, ioctls) the first
+ * time only; later calls, and pt objects bound to dev_fd, take it from a
+ * process wide cache. Thread safe. Returns 0 or an errno value, ENOSYS
+ * elsewhere. */
+int sg_pt_fd_info(int dev_fd, struct sg_pt_fd_info * fip, int verbose);
+
+/* Drops what the cache holds of dev_fd. To be called before an fd given
+ * to the pass-through is closed, unless by scsi_pt_close_device() */
+void sg_pt_forget_fd(int dev_fd);
+
+/* The character major of Linux bsg devices, 0 when there are none or
+ * elsewhere. /proc/devices is read once per process. */
+int sg_pt_bsg_major(int verbose);
+
 #ifdef SG_LIB_WIN32
 #define SG_LIB_WIN32_DIRECT 1
 
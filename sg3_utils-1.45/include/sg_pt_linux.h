@@ -178,6 +178,8 @@ extern volatile int sg_nvme_char_major;
 extern long sg_lin_page_size;
 
 void sg_find_bsg_nvme_char_major(int verbose);
+/* sg_find_bsg_nvme_char_major() once per process, safe from any thread */
+void sg_pt_linux_majors(int verbose);
 int sg_do_nvme_pt(struct sg_pt_base * vp, int fd, int time_secs, int vb);
 int sg_linux_get_sg_version(const struct sg_pt_base * vp);
 
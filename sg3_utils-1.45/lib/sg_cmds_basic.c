@@ -355,7 +355,7 @@ sg_cmds_is_nvme(const struct sg_pt_base * ptvp)
 static struct sg_pt_base *
 create_pt_obj(const char * cname)
 {
-    struct sg_pt_base * ptvp = construct_scsi_pt_obj();
+    struct sg_pt_base * ptvp = get_scsi_pt_obj(-1, 0);
     if (NULL == ptvp)
         pr2ws("%s: out of memory\n", cname);
     return ptvp;
@@ -453,12 +453,12 @@ sg_ll_inquiry(int sg_fd, bool cmddt, bool evpd, int pg_op, void * resp,
     int ret;
     struct sg_pt_base * ptvp;
 
-    ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+    ptvp = get_scsi_pt_obj(sg_fd, verbose);
     if (NULL == ptvp)
         return sg_convert_errno(ENOMEM);
     ret = sg_ll_inquiry_com(ptvp, cmddt, evpd, pg_op, resp, mx_resp_len,
                             0 /* timeout_sec */, NULL, noisy, verbose);
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -481,12 +481,12 @@ sg_ll_inquiry_v2(int sg_fd, bool evpd, int pg_op, void * resp,
     int ret;
     struct sg_pt_base * ptvp;
 
-    ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+    ptvp = get_scsi_pt_obj(sg_fd, verbose);
     if (NULL == ptvp)
         return sg_convert_errno(ENOMEM);
     ret = sg_ll_inquiry_com(ptvp, false, evpd, pg_op, resp, mx_resp_len,
                             timeout_secs, residp, noisy, verbose);
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -646,12 +646,12 @@ sg_ll_test_unit_ready_progress(int sg_fd, int pack_id, int * progress,
     int ret;
     struct sg_pt_base * ptvp;
 
-    ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+    ptvp = get_scsi_pt_obj(sg_fd, verbose);
     if (NULL == ptvp)
         return sg_convert_errno(ENOMEM);
     ret = sg_ll_test_unit_ready_progress_pt(ptvp, pack_id, progress, noisy,
                                             verbose);
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -665,12 +665,12 @@ sg_ll_test_unit_ready(int sg_fd, int pack_id, bool noisy, int verbose)
     int ret;
     struct sg_pt_base * ptvp;
 
-    ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+    ptvp = get_scsi_pt_obj(sg_fd, verbose);
     if (NULL == ptvp)
         return sg_convert_errno(ENOMEM);
     ret = sg_ll_test_unit_ready_progress_pt(ptvp, pack_id, NULL, noisy,
                                             verbose);
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -712,7 +712,7 @@ sg_ll_request_sense_com(struct sg_pt_base * ptvp, int sg_fd, bool desc,
     if (ptvp)
         ptvp_given = true;
     else {
-        ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+        ptvp = get_scsi_pt_obj(sg_fd, verbose);
         if (NULL == ptvp)
             return sg_convert_errno(ENOMEM);
     }
@@ -743,7 +743,7 @@ sg_ll_request_sense_com(struct sg_pt_base * ptvp, int sg_fd, bool desc,
             ret = 0;
     }
     if ((! ptvp_given) && ptvp)
-        destruct_scsi_pt_obj(ptvp);
+        put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -811,7 +811,7 @@ sg_ll_report_luns_com(struct sg_pt_base * ptvp, int sg_fd, int select_report,
     } else
         ret = 0;
     if ((! ptvp_given) && ptvp)
-        destruct_scsi_pt_obj(ptvp);
+        put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -76,7 +76,7 @@
 static struct sg_pt_base *
 create_pt_obj(const char * cname)
 {
-    struct sg_pt_base * ptvp = construct_scsi_pt_obj();
+    struct sg_pt_base * ptvp = get_scsi_pt_obj(-1, 0);
     if (NULL == ptvp)
         pr2ws("%s: out of memory\n", cname);
     return ptvp;
@@ -136,23 +136,24 @@ sg_ll_sync_cache_10(int sg_fd, bool sync_nv, bool immed, int group,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
 /* Invokes a SCSI READ CAPACITY (16) command. Returns 0 -> success,
  * various SG_LIB_CAT_* positive values or -1 -> other errors */
-int
-sg_ll_readcap_16(int sg_fd, bool pmi, uint64_t llba, void * resp,
-                 int mx_resp_len, bool noisy, int verbose)
+static int
+sg_ll_readcap_16_com(struct sg_pt_base * ptvp, int sg_fd, bool pmi,
+                     uint64_t llba, void * resp, int mx_resp_len, bool noisy,
+                     int verbose)
 {
     static const char * const cdb_s = "read capacity(16)";
+    bool ptvp_given = (NULL != ptvp);
     int ret, res, sense_cat;
     uint8_t rc_cdb[SERVICE_ACTION_IN_16_CMDLEN] =
                         {SERVICE_ACTION_IN_16_CMD, READ_CAPACITY_16_SA,
                          0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
     uint8_t sense_b[SENSE_BUFF_LEN];
-    struct sg_pt_base * ptvp;
 
     if (pmi) { /* lbs only valid when pmi set */
         rc_cdb[14] |= 1;
@@ -167,7 +168,7 @@ sg_ll_readcap_16(int sg_fd, bool pmi, uint64_t llba, void * resp,
               sg_get_command_str(rc_cdb, SERVICE_ACTION_IN_16_CMDLEN, false,
                                  sizeof(b), b));
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if ((! ptvp_given) && (NULL == ((ptvp = create_pt_obj(cdb_s)))))
         return -1;
     set_scsi_pt_cdb(ptvp, rc_cdb, sizeof(rc_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -189,22 +190,41 @@ sg_ll_readcap_16(int sg_fd, bool pmi, uint64_t llba, void * resp,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    if (! ptvp_given)
+        put_scsi_pt_obj(ptvp);
     return ret;
 }
 
-/* Invokes a SCSI READ CAPACITY (10) command. Returns 0 -> success,
- * various SG_LIB_CAT_* positive values or -1 -> other errors */
 int
-sg_ll_readcap_10(int sg_fd, bool pmi, unsigned int lba, void * resp,
+sg_ll_readcap_16(int sg_fd, bool pmi, uint64_t llba, void * resp,
                  int mx_resp_len, bool noisy, int verbose)
+{
+    return sg_ll_readcap_16_com(NULL, sg_fd, pmi, llba, resp, mx_resp_len,
+                                noisy, verbose);
+}
+
+int
+sg_ll_readcap_16_pt(struct sg_pt_base * ptvp, bool pmi, uint64_t llba,
+                    void * resp, int mx_resp_len, bool noisy, int verbose)
+{
+    clear_scsi_pt_obj(ptvp);
+    return sg_ll_readcap_16_com(ptvp, -1, pmi, llba, resp, mx_resp_len,
+                                noisy, verbose);
+}
+
+/* Invokes a SCSI READ CAPACITY (10) command. Returns 0 -> success,
+ * various SG_LIB_CAT_* positive values or -1 -> other errors */
+static int
+sg_ll_readcap_10_com(struct sg_pt_base * ptvp, int sg_fd, bool pmi,
+                     unsigned int lba, void * resp, int mx_resp_len,
+                     bool noisy, int verbose)
 {
     static const char * const cdb_s = "read capacity(10)";
+    bool ptvp_given = (NULL != ptvp);
     int ret, res, sense_cat;
     uint8_t rc_cdb[READ_CAPACITY_10_CMDLEN] =
                          {READ_CAPACITY_10_CMD, 0, 0, 0, 0, 0, 0, 0, 0, 0};
     uint8_t sense_b[SENSE_BUFF_LEN];
-    struct sg_pt_base * ptvp;
 
     if (pmi) { /* lbs only valid when pmi set */
         rc_cdb[8] |= 1;
@@ -217,7 +237,7 @@ sg_ll_readcap_10(int sg_fd, bool pmi, unsigned int lba, void * resp,
               sg_get_command_str(rc_cdb, READ_CAPACITY_10_CMDLEN, false,
                                  sizeof(b), b));
     }
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if ((! ptvp_given) && (NULL == ((ptvp = create_pt_obj(cdb_s)))))
         return -1;
     set_scsi_pt_cdb(ptvp, rc_cdb, sizeof(rc_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -239,10 +259,28 @@ sg_ll_readcap_10(int sg_fd, bool pmi, unsigned int lba, void * resp,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    if (! ptvp_given)
+        put_scsi_pt_obj(ptvp);
     return ret;
 }
 
+int
+sg_ll_readcap_10(int sg_fd, bool pmi, unsigned int lba, void * resp,
+                 int mx_resp_len, bool noisy, int verbose)
+{
+    return sg_ll_readcap_10_com(NULL, sg_fd, pmi, lba, resp, mx_resp_len,
+                                noisy, verbose);
+}
+
+int
+sg_ll_readcap_10_pt(struct sg_pt_base * ptvp, bool pmi, unsigned int lba,
+                    void * resp, int mx_resp_len, bool noisy, int verbose)
+{
+    clear_scsi_pt_obj(ptvp);
+    return sg_ll_readcap_10_com(ptvp, -1, pmi, lba, resp, mx_resp_len,
+                                noisy, verbose);
+}
+
 /* Invokes a SCSI MODE SENSE (6) command. Return of 0 -> success,
  * various SG_LIB_CAT_* positive values or -1 -> other errors */
 int
@@ -305,7 +343,7 @@ sg_ll_mode_sense6(int sg_fd, bool dbd, int pc, int pg_code, int sub_pg_code,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
 
     if (resid > 0) {
         if (resid > mx_resp_len) {
@@ -339,14 +377,15 @@ sg_ll_mode_sense10(int sg_fd, bool llbaa, bool dbd, int pc, int pg_code,
  * points. A residual value of 0 implies mx_resp_len bytes have be written
  * where resp points. If the residual value equals mx_resp_len then no
  * bytes have been written. */
-int
-sg_ll_mode_sense10_v2(int sg_fd, bool llbaa, bool dbd, int pc, int pg_code,
-                      int sub_pg_code, void * resp, int mx_resp_len,
-                      int timeout_secs, int * residp, bool noisy, int verbose)
+static int
+sg_ll_mode_sense10_com(struct sg_pt_base * ptvp, int sg_fd, bool llbaa,
+                       bool dbd, int pc, int pg_code, int sub_pg_code,
+                       void * resp, int mx_resp_len, int timeout_secs,
+                       int * residp, bool noisy, int verbose)
 {
+    bool ptvp_given = (NULL != ptvp);
     int res, ret, sense_cat, resid;
     static const char * const cdb_s = "mode sense(10)";
-    struct sg_pt_base * ptvp;
     uint8_t modes_cdb[MODE_SENSE10_CMDLEN] =
         {MODE_SENSE10_CMD, 0, 0, 0, 0, 0, 0, 0, 0, 0};
     uint8_t sense_b[SENSE_BUFF_LEN];
@@ -369,7 +408,7 @@ sg_ll_mode_sense10_v2(int sg_fd, bool llbaa, bool dbd, int pc, int pg_code,
     if (timeout_secs <= 0)
         timeout_secs = DEF_PT_TIMEOUT;
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if ((! ptvp_given) && (NULL == ((ptvp = create_pt_obj(cdb_s)))))
         goto gen_err;
     set_scsi_pt_cdb(ptvp, modes_cdb, sizeof(modes_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -405,7 +444,8 @@ sg_ll_mode_sense10_v2(int sg_fd, bool llbaa, bool dbd, int pc, int pg_code,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    if (! ptvp_given)
+        put_scsi_pt_obj(ptvp);
 
     if (resid > 0) {
         if (resid > mx_resp_len) {
@@ -423,6 +463,28 @@ gen_err:
     return -1;
 }
 
+int
+sg_ll_mode_sense10_v2(int sg_fd, bool llbaa, bool dbd, int pc, int pg_code,
+                      int sub_pg_code, void * resp, int mx_resp_len,
+                      int timeout_secs, int * residp, bool noisy, int verbose)
+{
+    return sg_ll_mode_sense10_com(NULL, sg_fd, llbaa, dbd, pc, pg_code,
+                                  sub_pg_code, resp, mx_resp_len,
+                                  timeout_secs, residp, noisy, verbose);
+}
+
+int
+sg_ll_mode_sense10_pt(struct sg_pt_base * ptvp, bool llbaa, bool dbd, int pc,
+                      int pg_code, int sub_pg_code, void * resp,
+                      int mx_resp_len, int timeout_secs, int * residp,
+                      bool noisy, int verbose)
+{
+    clear_scsi_pt_obj(ptvp);
+    return sg_ll_mode_sense10_com(ptvp, -1, llbaa, dbd, pc, pg_code,
+                                  sub_pg_code, resp, mx_resp_len,
+                                  timeout_secs, residp, noisy, verbose);
+}
+
 /* Invokes a SCSI MODE SELECT (6) command.  Return of 0 -> success,
  * various SG_LIB_CAT_* positive values or -1 -> other errors */
 int
@@ -478,7 +540,7 @@ sg_ll_mode_select6_v2(int sg_fd, bool pf, bool rtd, bool sp, void * paramp,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -546,7 +608,7 @@ sg_ll_mode_select10_v2(int sg_fd, bool pf, bool rtd, bool sp, void * paramp,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -787,18 +849,18 @@ sg_ll_log_sense(int sg_fd, bool ppc, bool sp, int pc, int pg_code,
  * points. A residual value of 0 implies mx_resp_len bytes have be written
  * where resp points. If the residual value equals mx_resp_len then no
  * bytes have been written. */
-int
-sg_ll_log_sense_v2(int sg_fd, bool ppc, bool sp, int pc, int pg_code,
-                   int subpg_code, int paramp, uint8_t * resp,
-                   int mx_resp_len, int timeout_secs, int * residp,
-                   bool noisy, int verbose)
+static int
+sg_ll_log_sense_com(struct sg_pt_base * ptvp, int sg_fd, bool ppc, bool sp,
+                    int pc, int pg_code, int subpg_code, int paramp,
+                    uint8_t * resp, int mx_resp_len, int timeout_secs,
+                    int * residp, bool noisy, int verbose)
 {
     static const char * const cdb_s = "log sense";
+    bool ptvp_given = (NULL != ptvp);
     int res, ret, sense_cat, resid;
     uint8_t logs_cdb[LOG_SENSE_CMDLEN] =
         {LOG_SENSE_CMD, 0, 0, 0, 0, 0, 0, 0, 0, 0};
     uint8_t sense_b[SENSE_BUFF_LEN];
-    struct sg_pt_base * ptvp;
 
     if (mx_resp_len > 0xffff) {
         pr2ws("mx_resp_len too big\n");
@@ -819,7 +881,7 @@ sg_ll_log_sense_v2(int sg_fd, bool ppc, bool sp, int pc, int pg_code,
     if (timeout_secs <= 0)
         timeout_secs = DEF_PT_TIMEOUT;
 
-    if (NULL == ((ptvp = create_pt_obj(cdb_s))))
+    if ((! ptvp_given) && (NULL == ((ptvp = create_pt_obj(cdb_s)))))
         goto gen_err;
     set_scsi_pt_cdb(ptvp, logs_cdb, sizeof(logs_cdb));
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
@@ -849,7 +911,8 @@ sg_ll_log_sense_v2(int sg_fd, bool ppc, bool sp, int pc, int pg_code,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    if (! ptvp_given)
+        put_scsi_pt_obj(ptvp);
 
     if (resid > 0) {
         if (resid > mx_resp_len) {
@@ -867,6 +930,29 @@ gen_err:
     return -1;
 }
 
+int
+sg_ll_log_sense_v2(int sg_fd, bool ppc, bool sp, int pc, int pg_code,
+                   int subpg_code, int paramp, uint8_t * resp,
+                   int mx_resp_len, int timeout_secs, int * residp,
+                   bool noisy, int verbose)
+{
+    return sg_ll_log_sense_com(NULL, sg_fd, ppc, sp, pc, pg_code, subpg_code,
+                               paramp, resp, mx_resp_len, timeout_secs,
+                               residp, noisy, verbose);
+}
+
+int
+sg_ll_log_sense_pt(struct sg_pt_base * ptvp, bool ppc, bool sp, int pc,
+                   int pg_code, int subpg_code, int paramp, uint8_t * resp,
+                   int mx_resp_len, int timeout_secs, int * residp,
+                   bool noisy, int verbose)
+{
+    clear_scsi_pt_obj(ptvp);
+    return sg_ll_log_sense_com(ptvp, -1, ppc, sp, pc, pg_code, subpg_code,
+                               paramp, resp, mx_resp_len, timeout_secs,
+                               residp, noisy, verbose);
+}
+
 /* Invokes a SCSI LOG SELECT command. Return of 0 -> success,
  * various SG_LIB_CAT_* positive values or -1 -> other errors */
 int
@@ -923,7 +1009,7 @@ sg_ll_log_select(int sg_fd, bool pcr, bool sp, int pc, int pg_code,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -935,12 +1021,12 @@ sg_ll_start_stop_unit(int sg_fd, bool immed, int pc_mod__fl_num,
     int ret;
     struct sg_pt_base * ptvp;
 
-    ptvp = construct_scsi_pt_obj_with_fd(sg_fd, verbose);
+    ptvp = get_scsi_pt_obj(sg_fd, verbose);
     if (NULL == ptvp)
         return sg_convert_errno(ENOMEM);
     ret = sg_ll_start_stop_unit_pt(ptvp, immed, pc_mod__fl_num, power_cond,
                                    noflush__fl, loej, start, noisy, verbose);
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -1050,6 +1136,6 @@ sg_ll_prevent_allow(int sg_fd, int prevent, bool noisy, int verbose)
         }
     } else
             ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
@@ -109,7 +109,7 @@
 static struct sg_pt_base *
 create_pt_obj(const char * cname)
 {
-    struct sg_pt_base * ptvp = construct_scsi_pt_obj();
+    struct sg_pt_base * ptvp = get_scsi_pt_obj(-1, 0);
     if (NULL == ptvp)
         pr2ws("%s: out of memory\n", cname);
     return ptvp;
@@ -176,7 +176,7 @@ sg_ll_get_lba_status16(int sg_fd, uint64_t start_llba, uint8_t rt,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -252,7 +252,7 @@ sg_ll_get_lba_status32(int sg_fd, uint64_t start_llba, uint32_t scan_len,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -322,7 +322,7 @@ sg_ll_report_tgt_prt_grp2(int sg_fd, void * resp, int mx_resp_len,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -374,7 +374,7 @@ sg_ll_set_tgt_prt_grp(int sg_fd, void * paramp, int param_len, bool noisy,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -438,7 +438,7 @@ sg_ll_report_referrals(int sg_fd, uint64_t start_llba, bool one_seg,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -520,13 +520,13 @@ sg_ll_send_diag(int sg_fd, int st_code, bool pf_bit, bool st_bit,
     int ret;
     struct sg_pt_base * ptvp;
 
-    ptvp = construct_scsi_pt_obj_with_fd(sg_fd, vb);
+    ptvp = get_scsi_pt_obj(sg_fd, vb);
     if (NULL == ptvp)
         return sg_convert_errno(ENOMEM);
     ret = sg_ll_send_diag_pt(ptvp, st_code, pf_bit, st_bit, devofl_bit,
                              unitofl_bit, long_duration, paramp, param_len,
                              noisy, vb);
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -606,12 +606,12 @@ sg_ll_receive_diag(int sg_fd, bool pcv, int pg_code, void * resp,
     int ret;
     struct sg_pt_base * ptvp;
 
-    ptvp = construct_scsi_pt_obj_with_fd(sg_fd, vb);
+    ptvp = get_scsi_pt_obj(sg_fd, vb);
     if (NULL == ptvp)
         return sg_convert_errno(ENOMEM);
     ret = sg_ll_receive_diag_pt(ptvp, pcv, pg_code, resp, mx_resp_len, 0,
                                 NULL, noisy, vb);
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -623,12 +623,12 @@ sg_ll_receive_diag_v2(int sg_fd, bool pcv, int pg_code, void * resp,
     int ret;
     struct sg_pt_base * ptvp;
 
-    ptvp = construct_scsi_pt_obj_with_fd(sg_fd, vb);
+    ptvp = get_scsi_pt_obj(sg_fd, vb);
     if (NULL == ptvp)
         return sg_convert_errno(ENOMEM);
     ret = sg_ll_receive_diag_pt(ptvp, pcv, pg_code, resp, mx_resp_len,
                                 timeout_secs, residp, noisy, vb);
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -696,7 +696,7 @@ sg_ll_read_defect10(int sg_fd, bool req_plist, bool req_glist, int dl_format,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -756,7 +756,7 @@ sg_ll_read_media_serial_num(int sg_fd, void * resp, int mx_resp_len,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -819,7 +819,7 @@ sg_ll_report_id_info(int sg_fd, int itype, void * resp, int max_resp_len,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -874,7 +874,7 @@ sg_ll_set_id_info(int sg_fd, int itype, void * paramp, int param_len,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -967,7 +967,7 @@ sg_ll_format_unit_v2(int sg_fd, int fmtpinfo, bool longlist, bool fmtdata,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -1022,7 +1022,7 @@ sg_ll_reassign_blocks(int sg_fd, bool longlba, bool longlist, void * paramp,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -1085,7 +1085,7 @@ sg_ll_persistent_reserve_in(int sg_fd, int rq_servact, void * resp,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -1143,7 +1143,7 @@ sg_ll_persistent_reserve_out(int sg_fd, int rq_servact, int rq_scope,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -1250,7 +1250,7 @@ sg_ll_read_long10(int sg_fd, bool pblock, bool correct, unsigned int lba,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -1340,7 +1340,7 @@ sg_ll_read_long16(int sg_fd, bool pblock, bool correct, uint64_t llba,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -1419,7 +1419,7 @@ sg_ll_write_long10(int sg_fd, bool cor_dis, bool wr_uncor, bool pblock,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -1500,7 +1500,7 @@ sg_ll_write_long16(int sg_fd, bool cor_dis, bool wr_uncor, bool pblock,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -1578,7 +1578,7 @@ sg_ll_verify10(int sg_fd, int vrprotect, bool dpo, int bytchk,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -1656,7 +1656,7 @@ sg_ll_verify16(int sg_fd, int vrprotect, bool dpo, int bytchk, uint64_t llba,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -1830,7 +1830,7 @@ sg_ll_ata_pt(int sg_fd, const uint8_t * cdbp, int cdb_len,
     }
 
 out:
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -1892,7 +1892,7 @@ sg_ll_read_buffer(int sg_fd, int mode, int buffer_id, int buffer_offset,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -1954,7 +1954,7 @@ sg_ll_write_buffer(int sg_fd, int mode, int buffer_id, int buffer_offset,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -2006,7 +2006,7 @@ sg_ll_write_buffer_v2(int sg_fd, int mode, int m_specific, int buffer_id,
     if (timeout_secs <= 0)
         timeout_secs = DEF_PT_TIMEOUT;
 
-    ptvp = construct_scsi_pt_obj();
+    ptvp = get_scsi_pt_obj(-1, 0);
     if (NULL == ptvp) {
         pr2ws("%s: out of memory\n", __func__);
         return -1;
@@ -2031,7 +2031,7 @@ sg_ll_write_buffer_v2(int sg_fd, int mode, int m_specific, int buffer_id,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -2096,7 +2096,7 @@ sg_ll_unmap_v2(int sg_fd, bool anchor, int group_num, int timeout_secs,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -2154,7 +2154,7 @@ sg_ll_read_block_limits(int sg_fd, void * resp, int mx_resp_len,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -2209,7 +2209,7 @@ sg_ll_receive_copy_results(int sg_fd, int sa, int list_id, void * resp,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -2268,7 +2268,7 @@ sg_ll_extended_copy(int sg_fd, void * paramp, int param_len, bool noisy,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -2345,7 +2345,7 @@ sg_ll_3party_copy_out(int sg_fd, int sa, unsigned int list_id, int group_num,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -2450,6 +2450,6 @@ sg_ll_pre_fetch_x(int sg_fd, bool do_seek10, bool cdb16, bool immed,
     } else
         ret = 0;
 fini:
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
@@ -44,7 +44,7 @@
 static struct sg_pt_base *
 create_pt_obj(const char * cname)
 {
-    struct sg_pt_base * ptvp = construct_scsi_pt_obj();
+    struct sg_pt_base * ptvp = get_scsi_pt_obj(-1, 0);
     if (NULL == ptvp)
         pr2ws("%s: out of memory\n", cname);
     return ptvp;
@@ -104,7 +104,7 @@ sg_ll_set_cd_speed(int sg_fd, int rot_control, int drv_read_speed,
     } else
         ret = 0;
 
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -193,7 +193,7 @@ sg_ll_get_config(int sg_fd, int rt, int starting, void * resp,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -284,7 +284,7 @@ sg_ll_get_performance(int sg_fd, int data_type, unsigned int starting_lba,
         }
         ret = 0;
     }
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
 
@@ -345,6 +345,6 @@ sg_ll_set_streaming(int sg_fd, int type, void * paramp, int param_len,
         }
     } else
         ret = 0;
-    destruct_scsi_pt_obj(ptvp);
+    put_scsi_pt_obj(ptvp);
     return ret;
 }
@@ -197,6 +197,24 @@ sg_err_category3(struct sg_io_hdr * hp)
     return sg_err_category_new(hp->status, hp->host_status,
                                hp->driver_status, hp->sbp, hp->sb_len_wr);
 }
+
+int
+sg_err_category3_dec(struct sg_io_hdr * hp, struct sg_sense_dec * sdp)
+{
+    int scsi_status = hp->status & 0x7e;
+    int masked_driver_status = (SG_LIB_DRIVER_MASK & hp->driver_status);
+
+    sg_decode_sense(hp->sbp, hp->sb_len_wr, sdp);
+    if ((0 == scsi_status) && (0 == hp->host_status) &&
+        (0 == masked_driver_status))
+        return SG_LIB_CAT_CLEAN;
+    if ((SAM_STAT_CHECK_CONDITION == scsi_status) ||
+        (SAM_STAT_COMMAND_TERMINATED == scsi_status) ||
+        (SG_LIB_DRIVER_SENSE == masked_driver_status))
+        return sdp->category;
+    return sg_err_category_new(hp->status, hp->host_status,
+                               hp->driver_status, NULL, 0);
+}
 #endif
 
 int
@@ -123,7 +123,8 @@ sg_get_initial_dsense(void)
 
 /* Searches 'arr' for match on 'value' then 'peri_type'. If matches
    'value' but not 'peri_type' then yields first 'value' match entry.
-   Last element of 'arr' has NULL 'name'. If no match returns NULL. */
+   Last element of 'arr' has NULL 'name'. If no match returns NULL.
+   The arrays are sorted by 'value', so the search stops past it. */
 static const struct sg_lib_value_name_t *
 get_value_name(const struct sg_lib_value_name_t * arr, int value,
                int peri_type)
@@ -133,7 +134,7 @@ get_value_name(const struct sg_lib_value_name_t * arr, int value,
 
     if (peri_type < 0)
         peri_type = 0;
-    for (; vp->name; ++vp) {
+    for (; vp->name && (vp->value <= value); ++vp) {
         if (value == vp->value) {
             if (peri_type == vp->peri_dev_type)
                 return vp;
@@ -317,8 +318,7 @@ sg_get_sense_key_str(int sense_key, int buff_len, char * buff)
 char *
 sg_get_asc_ascq_str(int asc, int ascq, int buff_len, char * buff)
 {
-    int k, num, rlen;
-    bool found = false;
+    int k, num, rlen, lo, hi, key, v;
     struct sg_lib_asc_ascq_t * eip;
     struct sg_lib_asc_ascq_range_t * ei2p;
 
@@ -331,33 +331,36 @@ sg_get_asc_ascq_str(int asc, int ascq, int buff_len, char * buff)
         if ((ei2p->asc == asc) &&
             (ascq >= ei2p->ascq_min)  &&
             (ascq <= ei2p->ascq_max)) {
-            found = true;
             num = sg_scnpr(buff, buff_len, "Additional sense: ");
             rlen = buff_len - num;
             sg_scnpr(buff + num, ((rlen > 0) ? rlen : 0), ei2p->text, ascq);
+            return buff;
         }
     }
-    if (found)
-        return buff;
 
-    for (k = 0; sg_lib_asc_ascq[k].text; ++k) {
+    /* sg_lib_asc_ascq[] is sorted by asc then ascq: search it by halves */
+    key = (asc << 8) | ascq;
+    for (lo = 0, hi = sg_lib_asc_ascq_count; lo < hi; ) {
+        k = (lo + hi) / 2;
         eip = &sg_lib_asc_ascq[k];
-        if (eip->asc == asc &&
-            eip->ascq == ascq) {
-            found = true;
+        v = (eip->asc << 8) | eip->ascq;
+        if (v == key) {
             sg_scnpr(buff, buff_len, "Additional sense: %s", eip->text);
+            return buff;
         }
-    }
-    if (! found) {
-        if (asc >= 0x80)
-            sg_scnpr(buff, buff_len, "vendor specific ASC=%02x, ASCQ=%02x "
-                     "(hex)", asc, ascq);
-        else if (ascq >= 0x80)
-            sg_scnpr(buff, buff_len, "ASC=%02x, vendor specific qualification "
-                     "ASCQ=%02x (hex)", asc, ascq);
+        if (v < key)
+            lo = k + 1;
         else
-            sg_scnpr(buff, buff_len, "ASC=%02x, ASCQ=%02x (hex)", asc, ascq);
-    }
+            hi = k;
+    }
+    if (asc >= 0x80)
+        sg_scnpr(buff, buff_len, "vendor specific ASC=%02x, ASCQ=%02x "
+                 "(hex)", asc, ascq);
+    else if (ascq >= 0x80)
+        sg_scnpr(buff, buff_len, "ASC=%02x, vendor specific qualification "
+                 "ASCQ=%02x (hex)", asc, ascq);
+    else
+        sg_scnpr(buff, buff_len, "ASC=%02x, ASCQ=%02x (hex)", asc, ascq);
     return buff;
 }
 
@@ -2153,6 +2156,53 @@ sg_scsi_normalize_sense(const uint8_t * sbp, int sb_len,
     return true;
 }
 
+/* The SG_LIB_CAT_* value of normalized sense data, SG_LIB_CAT_SENSE for a
+ * less common sense key */
+static int
+sense_category(const struct sg_scsi_sense_hdr * sshp)
+{
+    switch (sshp->sense_key) {        /* 0 to 0x1f */
+    case SPC_SK_NO_SENSE:
+        return SG_LIB_CAT_NO_SENSE;
+    case SPC_SK_RECOVERED_ERROR:
+        return SG_LIB_CAT_RECOVERED;
+    case SPC_SK_NOT_READY:
+        return SG_LIB_CAT_NOT_READY;
+    case SPC_SK_MEDIUM_ERROR:
+    case SPC_SK_HARDWARE_ERROR:
+    case SPC_SK_BLANK_CHECK:
+        return SG_LIB_CAT_MEDIUM_HARD;
+    case SPC_SK_UNIT_ATTENTION:
+        return SG_LIB_CAT_UNIT_ATTENTION;
+        /* used to return SG_LIB_CAT_MEDIA_CHANGED when ssh.asc==0x28 */
+    case SPC_SK_ILLEGAL_REQUEST:
+        if ((0x20 == sshp->asc) && (0x0 == sshp->ascq))
+            return SG_LIB_CAT_INVALID_OP;
+        else if ((0x21 == sshp->asc) && (0x0 == sshp->ascq))
+            return SG_LIB_LBA_OUT_OF_RANGE;
+        else
+            return SG_LIB_CAT_ILLEGAL_REQ;
+        break;
+    case SPC_SK_ABORTED_COMMAND:
+        if (0x10 == sshp->asc)
+            return SG_LIB_CAT_PROTECTION;
+        else
+            return SG_LIB_CAT_ABORTED_COMMAND;
+    case SPC_SK_MISCOMPARE:
+        return SG_LIB_CAT_MISCOMPARE;
+    case SPC_SK_DATA_PROTECT:
+        return SG_LIB_CAT_DATA_PROTECT;
+    case SPC_SK_COPY_ABORTED:
+        return SG_LIB_CAT_COPY_ABORTED;
+    case SPC_SK_COMPLETED:
+    case SPC_SK_VOLUME_OVERFLOW:
+        return SG_LIB_CAT_SENSE;
+    default:
+        ;   /* reserved and vendor specific sense keys fall through */
+    }
+    return SG_LIB_CAT_SENSE;
+}
+
 /* Returns a SG_LIB_CAT_* value. If cannot decode sense buffer (sbp) or a
  * less common sense key then return SG_LIB_CAT_SENSE .*/
 int
@@ -2161,48 +2211,92 @@ sg_err_category_sense(const uint8_t * sbp, int sb_len)
     struct sg_scsi_sense_hdr ssh;
 
     if ((sbp && (sb_len > 2)) &&
-        (sg_scsi_normalize_sense(sbp, sb_len, &ssh))) {
-        switch (ssh.sense_key) {        /* 0 to 0x1f */
-        case SPC_SK_NO_SENSE:
-            return SG_LIB_CAT_NO_SENSE;
-        case SPC_SK_RECOVERED_ERROR:
-            return SG_LIB_CAT_RECOVERED;
-        case SPC_SK_NOT_READY:
-            return SG_LIB_CAT_NOT_READY;
-        case SPC_SK_MEDIUM_ERROR:
-        case SPC_SK_HARDWARE_ERROR:
-        case SPC_SK_BLANK_CHECK:
-            return SG_LIB_CAT_MEDIUM_HARD;
-        case SPC_SK_UNIT_ATTENTION:
-            return SG_LIB_CAT_UNIT_ATTENTION;
-            /* used to return SG_LIB_CAT_MEDIA_CHANGED when ssh.asc==0x28 */
-        case SPC_SK_ILLEGAL_REQUEST:
-            if ((0x20 == ssh.asc) && (0x0 == ssh.ascq))
-                return SG_LIB_CAT_INVALID_OP;
-            else if ((0x21 == ssh.asc) && (0x0 == ssh.ascq))
-                return SG_LIB_LBA_OUT_OF_RANGE;
-            else
-                return SG_LIB_CAT_ILLEGAL_REQ;
-            break;
-        case SPC_SK_ABORTED_COMMAND:
-            if (0x10 == ssh.asc)
-                return SG_LIB_CAT_PROTECTION;
-            else
-                return SG_LIB_CAT_ABORTED_COMMAND;
-        case SPC_SK_MISCOMPARE:
-            return SG_LIB_CAT_MISCOMPARE;
-        case SPC_SK_DATA_PROTECT:
-            return SG_LIB_CAT_DATA_PROTECT;
-        case SPC_SK_COPY_ABORTED:
-            return SG_LIB_CAT_COPY_ABORTED;
-        case SPC_SK_COMPLETED:
-        case SPC_SK_VOLUME_OVERFLOW:
-            return SG_LIB_CAT_SENSE;
-        default:
-            ;   /* reserved and vendor specific sense keys fall through */
+        (sg_scsi_normalize_sense(sbp, sb_len, &ssh)))
+        return sense_category(&ssh);
+    return SG_LIB_CAT_SENSE;
+}
+
+/* One walk of the buffer for what sg_get_sense_info_fld(),
+ * sg_get_sense_progress_fld(), sg_get_sense_filemark_eom_ili() and
+ * sg_err_category_sense() yield; the descriptors each looks for are the
+ * first of their type, as sg_scsi_sense_desc_find() finds them. */
+bool
+sg_decode_sense(const uint8_t * sbp, int sb_len, struct sg_sense_dec * sdp)
+{
+    int add_sb_len, add_d_len, desc_len, k, sk;
+    const uint8_t * descp;
+    const uint8_t * d_info = NULL;
+    const uint8_t * d_sks = NULL;
+    const uint8_t * d_stream = NULL;
+    const uint8_t * d_prog = NULL;
+
+    memset(sdp, 0, sizeof(*sdp));
+    sdp->category = SG_LIB_CAT_SENSE;
+    sdp->valid = sg_scsi_normalize_sense(sbp, sb_len, &sdp->ssh);
+    if (! sdp->valid)
+        return false;
+    if (sb_len > 2)
+        sdp->category = sense_category(&sdp->ssh);
+    if (sb_len < 7)
+        return true;
+    sk = sdp->ssh.sense_key;
+    if (sdp->ssh.response_code < 0x72) {        /* fixed format */
+        sdp->info = sg_get_unaligned_be32(sbp + 3);
+        sdp->info_valid = !!(sbp[0] & 0x80);
+        if (sbp[2] & 0xe0) {
+            sdp->fm_eom_ili = true;
+            sdp->filemark = !!(sbp[2] & 0x80);
+            sdp->eom = !!(sbp[2] & 0x40);
+            sdp->ili = !!(sbp[2] & 0x20);
+        }
+        if ((sb_len >= 18) &&
+            ((SPC_SK_NO_SENSE == sk) || (SPC_SK_NOT_READY == sk)) &&
+            (sbp[15] & 0x80)) {        /* SKSV bit set */
+            sdp->progress_valid = true;
+            sdp->progress = sg_get_unaligned_be16(sbp + 16);
         }
+        return true;
     }
-    return SG_LIB_CAT_SENSE;
+    if ((sb_len < 8) || (0 == (add_sb_len = sbp[7])) ||
+        (sbp[0] < 0x72) || (sbp[0] > 0x73))
+        return true;
+    add_sb_len = (add_sb_len < (sb_len - 8)) ?  add_sb_len : (sb_len - 8);
+    descp = &sbp[8];
+    for (desc_len = 0, k = 0; k < add_sb_len; k += desc_len) {
+        descp += desc_len;
+        add_d_len = (k < (add_sb_len - 1)) ? descp[1]: -1;
+        desc_len = add_d_len + 2;
+        if ((0 == descp[0]) && (NULL == d_info))
+            d_info = descp;
+        else if ((2 == descp[0]) && (NULL == d_sks))
+            d_sks = descp;
+        else if ((4 == descp[0]) && (NULL == d_stream))
+            d_stream = descp;
+        else if ((0xa == descp[0]) && (NULL == d_prog))
+            d_prog = descp;
+        if (add_d_len < 0) /* short descriptor ?? */
+            break;
+    }
+    if (d_info && (0xa == d_info[1])) {
+        sdp->info = sg_get_unaligned_be64(d_info + 4);
+        sdp->info_valid = !!(d_info[2] & 0x80);
+    }
+    if (d_stream && (d_stream[1] >= 2) && (d_stream[3] & 0xe0)) {
+        sdp->fm_eom_ili = true;
+        sdp->filemark = !!(d_stream[3] & 0x80);
+        sdp->eom = !!(d_stream[3] & 0x40);
+        sdp->ili = !!(d_stream[3] & 0x20);
+    }
+    /* sense key specific progress (0x2) or progress descriptor (0xa) */
+    if (((SPC_SK_NO_SENSE == sk) || (SPC_SK_NOT_READY == sk)) && d_sks &&
+        (0x6 == d_sks[1]) && (0x80 & d_sks[4])) {
+        sdp->progress_valid = true;
+        sdp->progress = sg_get_unaligned_be16(d_sks + 5);
+    } else if (d_prog && (0x6 == d_prog[1])) {
+        sdp->progress_valid = true;
+        sdp->progress = sg_get_unaligned_be16(d_prog + 6);
+    }
+    return true;
 }
 
 /* Beware: gives wrong answer for variable length command (opcode=0x7f) */
@@ -2765,6 +2859,8 @@ trimTrailingSpaces(char * b)
  *     > 0     each line has address then up to 16 ASCII-hex bytes
  *     = 0     in addition, the bytes are listed in ASCII to the right
  *     < 0     only the ASCII-hex bytes are listed (i.e. without address) */
+static const char hex_digits[] = "0123456789abcdef";
+
 static void
 dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
 {
@@ -2795,7 +2891,8 @@ dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
             c = *p++;
             if (bpos == (bpstart + (8 * 3)))
                 bpos++;
-            sg_scnpr(&buff[bpos], blen - bpos, "%.2x", (int)(uint8_t)c);
+            buff[bpos] = hex_digits[c >> 4];
+            buff[bpos + 1] = hex_digits[c & 0xf];
             buff[bpos + 2] = ' ';
             if ((k > 0) && (0 == ((k + 1) % 16))) {
                 trimTrailingSpaces(buff);
@@ -2821,7 +2918,8 @@ dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
         bpos += 3;
         if (bpos == (bpstart + (9 * 3)))
             bpos++;
-        sg_scnpr(&buff[bpos], blen - bpos, "%.2x", (int)(uint8_t)c);
+        buff[bpos] = hex_digits[c >> 4];
+        buff[bpos + 1] = hex_digits[c & 0xf];
         buff[bpos + 2] = ' ';
         if (no_ascii)
             buff[cpos++] = ' ';
@@ -2866,23 +2964,38 @@ dStrHexErr(const char* str, int len, int no_ascii)
 #define DSHS_LINE_BLEN 160
 #define DSHS_BPL 16
 
+/* Copies 'len' bytes of 'src' to 'cp' and a trailing '\0', as
+ * sg_scnpr(cp, cp_max_len, "%s", src) would, without the format. */
+static int
+scnpr_copy(char * cp, int cp_max_len, const char * src, int len)
+{
+    if (cp_max_len < 2)
+        return 0;
+    if (len > (cp_max_len - 1))
+        len = cp_max_len - 1;
+    memcpy(cp, src, len);
+    cp[len] = '\0';
+    return len;
+}
+
 /* Read 'len' bytes from 'str' and output as ASCII-Hex bytes (space
  * separated) to 'b' not to exceed 'b_len' characters. Each line
  * starts with 'leadin' (NULL for no leadin) and there are 16 bytes
  * per line with an extra space between the 8th and 9th bytes. 'format'
  * is 0 for repeat in printable ASCII ('.' for non printable) to
  * right of each line; 1 don't (so just output ASCII hex). Returns
- * number of bytes written to 'b' excluding the trailing '\0'. */
+ * number of bytes written to 'b' excluding the trailing '\0'.
+ * Each line is built in place from a digit table and copied to 'b'
+ * whole, the output that of formatting it byte by byte. */
 int
 dStrHexStr(const char * str, int len, const char * leadin, int format,
            int b_len, char * b)
 {
     uint8_t c;
-    int bpstart, bpos, k, n, prior_ascii_len;
+    int bpstart, bpos, k, j, m, n, prior_ascii_len;
     bool want_ascii;
     char buff[DSHS_LINE_BLEN + 2];
-    char a[DSHS_BPL + 1];
-    const char * p = str;
+    const uint8_t * p = (const uint8_t *)str;
 
     if (len <= 0) {
         if (b_len > 0)
@@ -2892,10 +3005,6 @@ dStrHexStr(const char * str, int len, const char * leadin, int format,
     if (b_len <= 0)
         return 0;
     want_ascii = !format;
-    if (want_ascii) {
-        memset(a, ' ', DSHS_BPL);
-        a[DSHS_BPL] = '\0';
-    }
     if (leadin) {
         bpstart = strlen(leadin);
         /* Cap leadin at (DSHS_LINE_BLEN - 70) characters */
@@ -2903,46 +3012,34 @@ dStrHexStr(const char * str, int len, const char * leadin, int format,
             bpstart = DSHS_LINE_BLEN - 70;
     } else
         bpstart = 0;
-    bpos = bpstart;
     prior_ascii_len = bpstart + (DSHS_BPL * 3) + 1;
-    n = 0;
-    memset(buff, ' ', DSHS_LINE_BLEN);
-    buff[DSHS_LINE_BLEN] = '\0';
     if (bpstart > 0)
         memcpy(buff, leadin, bpstart);
-    for (k = 0; k < len; k++) {
-        c = *p++;
-        if (bpos == (bpstart + ((DSHS_BPL / 2) * 3)))
-            bpos++;     /* for extra space in middle of each line's hex */
-        sg_scnpr(buff + bpos, (int)sizeof(buff) - bpos, "%.2x",
-                 (int)(uint8_t)c);
-        buff[bpos + 2] = ' ';
-        if (want_ascii)
-            a[k % DSHS_BPL] = my_isprint(c) ? c : '.';
-        if ((k > 0) && (0 == ((k + 1) % DSHS_BPL))) {
-            trimTrailingSpaces(buff);
-            if (want_ascii) {
-                n += sg_scnpr(b + n, b_len - n, "%-*s   %s\n",
-                              prior_ascii_len, buff, a);
-                memset(a, ' ', DSHS_BPL);
-            } else
-                n += sg_scnpr(b + n, b_len - n, "%s\n", buff);
-            if (n >= (b_len - 1))
-                return n;
-            memset(buff, ' ', DSHS_LINE_BLEN);
-            bpos = bpstart;
-            if (bpstart > 0)
-                memcpy(buff, leadin, bpstart);
-        } else
-            bpos += 3;
-    }
-    if (bpos > bpstart) {
-        trimTrailingSpaces(buff);
-        if (want_ascii)
-            n += sg_scnpr(b + n, b_len - n, "%-*s   %s\n", prior_ascii_len,
-                          buff, a);
-        else
-            n += sg_scnpr(b + n, b_len - n, "%s\n", buff);
+    n = 0;
+    for (k = 0; k < len; k += m) {
+        m = ((len - k) < DSHS_BPL) ? (len - k) : DSHS_BPL;
+        bpos = bpstart;
+        for (j = 0; j < m; ++j) {
+            if ((DSHS_BPL / 2) == j)
+                buff[bpos++] = ' ';   /* extra space in middle of line */
+            c = p[k + j];
+            buff[bpos++] = hex_digits[c >> 4];
+            buff[bpos++] = hex_digits[c & 0xf];
+            buff[bpos++] = ' ';
+        }
+        --bpos;         /* the trailing space trimmed */
+        if (want_ascii) {
+            while (bpos < (prior_ascii_len + 3))
+                buff[bpos++] = ' ';
+            for (j = 0; j < DSHS_BPL; ++j) {
+                c = (j < m) ? p[k + j] : ' ';
+                buff[bpos++] = my_isprint(c) ? c : '.';
+            }
+        }
+        buff[bpos++] = '\n';
+        n += scnpr_copy(b + n, b_len - n, buff, bpos);
+        if (n >= (b_len - 1))
+            return n;
     }
     return n;
 }
@@ -2982,28 +3079,41 @@ sg_is_big_endian()
                                     the most significant byte */
 }
 
-bool
-sg_all_zeros(const uint8_t * bp, int b_len)
+/* Both scan 64 bytes a step, OR-ing (AND-ing) eight words together, a
+ * loop the compiler turns into vector loads; the byte loop only takes
+ * the tail. */
+static bool
+all_bytes(const uint8_t * bp, int b_len, uint64_t want)
 {
+    uint64_t w[8], acc;
+    int k, j;
+
     if ((NULL == bp) || (b_len <= 0))
         return false;
-    for (--b_len; b_len >= 0; --b_len) {
-        if (0x0 != bp[b_len])
+    for (k = 0; k + 64 <= b_len; k += 64) {
+        memcpy(w, bp + k, sizeof(w));
+        for (acc = want ? ~(uint64_t)0 : 0, j = 0; j < 8; ++j)
+            acc = want ? (acc & w[j]) : (acc | w[j]);
+        if (acc != want)
+            return false;
+    }
+    for (; k < b_len; ++k) {
+        if ((uint8_t)want != bp[k])
             return false;
     }
     return true;
 }
 
+bool
+sg_all_zeros(const uint8_t * bp, int b_len)
+{
+    return all_bytes(bp, b_len, 0);
+}
+
 bool
 sg_all_ffs(const uint8_t * bp, int b_len)
 {
-    if ((NULL == bp) || (b_len <= 0))
-        return false;
-    for (--b_len; b_len >= 0; --b_len) {
-        if (0xff != bp[b_len])
-            return false;
-    }
-    return true;
+    return all_bytes(bp, b_len, ~(uint64_t)0);
 }
 
 static uint16_t
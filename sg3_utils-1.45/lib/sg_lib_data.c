@@ -35,6 +35,8 @@ int sg_lib_pdt_decay_arr[32] = {
 };
 
 #ifdef SG_SCSI_STRINGS
+/* The sg_lib_value_name_t arrays are sorted by value, get_value_name()
+ * stops past it */
 struct sg_lib_value_name_t sg_lib_normal_opcodes[] = {
     {0, 0, "Test Unit Ready"},
     {0x1, 0, "Rezero Unit"},
@@ -634,7 +636,8 @@ struct sg_lib_value_name_t sg_lib_read_attr_arr[] = {
 
 /* A conveniently formatted list of SCSI ASC/ASCQ codes and their
  * corresponding text can be found at: www.t10.org/lists/asc-num.txt
- * The following should match asc-num.txt dated 20191014 */
+ * The following should match asc-num.txt dated 20191014. sg_lib_asc_ascq[]
+ * is kept sorted by asc then ascq, it is searched by halves */
 
 #ifdef SG_SCSI_STRINGS
 struct sg_lib_asc_ascq_range_t sg_lib_asc_ascq_range[] =
@@ -972,14 +975,14 @@ struct sg_lib_asc_ascq_t sg_lib_asc_ascq[] =
     {0x2A,0x07,"Implicit asymmetric access state transition failed"},
     {0x2A,0x08,"Priority changed"},
     {0x2A,0x09,"Capacity data has changed"},
+    {0x2A,0x0a,"Error history i_t nexus cleared"},
+    {0x2A,0x0b,"Error history snapshot released"},
     {0x2A,0x0c, "Error recovery attributes have changed"},
     {0x2A,0x0d, "Data encryption capabilities changed"},
     {0x2A,0x10,"Timestamp changed"},
     {0x2A,0x11,"Data encryption parameters changed by another i_t nexus"},
     {0x2A,0x12,"Data encryption parameters changed by vendor specific event"},
     {0x2A,0x13,"Data encryption key instance counter has changed"},
-    {0x2A,0x0a,"Error history i_t nexus cleared"},
-    {0x2A,0x0b,"Error history snapshot released"},
     {0x2A,0x14,"SA creation capabilities data has changed"},
     {0x2A,0x15,"Medium removal prevention preempted"},
     {0x2A,0x16,"Zone reset write pointer recommended"},
@@ -1451,6 +1454,10 @@ struct sg_lib_asc_ascq_t sg_lib_asc_ascq[] =
 };
 #endif /* SG_SCSI_STRINGS */
 
+/* Entries of sg_lib_asc_ascq[] before its sentinel */
+const int sg_lib_asc_ascq_count =
+        (int)(sizeof(sg_lib_asc_ascq) / sizeof(sg_lib_asc_ascq[0])) - 1;
+
 const char * sg_lib_sense_key_desc[] = {
     "No Sense",                 /* Filemark, ILI and/or EOM; progress
                                    indication (during FORMAT); power
@@ -1527,8 +1534,8 @@ const char * sg_lib_transport_proto_strs[] =
 struct sg_lib_value_name_t sg_lib_scsi_feature_sets[] =
 {
     {SCSI_FS_SPC_DISCOVERY_2016, -1, "Discovery 2016"},
-    {SCSI_FS_SBC_BASE_2010, PDT_DISK, "SBC Base 2010"},
     {SCSI_FS_SBC_BASE_2016, PDT_DISK, "SBC Base 2016"},
+    {SCSI_FS_SBC_BASE_2010, PDT_DISK, "SBC Base 2010"},
     {SCSI_FS_SBC_BASIC_PROV_2016, PDT_DISK, "Basic provisioning 2016"},
     {SCSI_FS_SBC_DRIVE_MAINT_2016, PDT_DISK, "Drive maintenance 2016"},
     {0x0, 0, NULL},     /* 0x0 is reserved sfs; trailing sentinel */
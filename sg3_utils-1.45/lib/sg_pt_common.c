@@ -13,6 +13,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 
@@ -46,6 +47,45 @@ sg_pt_version()
     return scsi_pt_version_str;
 }
 
+#ifndef SG_LIB_LINUX
+/* No per-thread cache here, one object made and freed per call */
+struct sg_pt_base *
+get_scsi_pt_obj(int dev_fd, int verbose)
+{
+    if (dev_fd < 0)
+        return construct_scsi_pt_obj();
+    return construct_scsi_pt_obj_with_fd(dev_fd, verbose);
+}
+
+void
+put_scsi_pt_obj(struct sg_pt_base * objp)
+{
+    if (objp)
+        destruct_scsi_pt_obj(objp);
+}
+
+int
+sg_pt_fd_info(int dev_fd, struct sg_pt_fd_info * fip, int verbose)
+{
+    if (dev_fd || verbose) { ; }        /* suppress warning */
+    memset(fip, 0, sizeof(*fip));
+    return ENOSYS;
+}
+
+void
+sg_pt_forget_fd(int dev_fd)
+{
+    if (dev_fd) { ; }   /* suppress warning */
+}
+
+int
+sg_pt_bsg_major(int verbose)
+{
+    if (verbose) { ; }  /* suppress warning */
+    return 0;
+}
+#endif
+
 
 #if (HAVE_NVME && (! IGNORE_NVME))
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
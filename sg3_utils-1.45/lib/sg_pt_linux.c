@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>      /* to define 'major' */
@@ -172,6 +173,34 @@ sg_find_bsg_nvme_char_major(int verbose)
     fclose(fp);
 }
 
+static pthread_once_t majors_once = PTHREAD_ONCE_INIT;
+static int majors_verbose = 0;
+
+static void
+majors_init(void)
+{
+    sg_find_bsg_nvme_char_major(majors_verbose);
+    sg_bsg_nvme_char_major_checked = true;
+}
+
+/* Calls sg_find_bsg_nvme_char_major() the first time, from whichever
+ * thread gets here first; the others wait for it to finish. */
+void
+sg_pt_linux_majors(int verbose)
+{
+    if (! sg_bsg_nvme_char_major_checked) {
+        majors_verbose = verbose;
+        pthread_once(&majors_once, majors_init);
+    }
+}
+
+int
+sg_pt_bsg_major(int verbose)
+{
+    sg_pt_linux_majors(verbose);
+    return sg_bsg_major;
+}
+
 /* Assumes that sg_find_bsg_nvme_char_major() has already been called. Returns
  * true if dev_fd is a scsi generic pass-through device. If yields
  * *is_nvme_p = true with *nsid_p = 0 then dev_fd is a NVMe char device.
@@ -268,27 +297,21 @@ check_pt_file_handle(int dev_fd, const char * device_name, int verbose)
         pr2ws("%s: dev_fd=%d, device_name: %s\n", __func__, dev_fd,
               device_name);
     /* Linux doesn't need device_name to determine which pass-through */
-    if (! sg_bsg_nvme_char_major_checked) {
-        sg_bsg_nvme_char_major_checked = true;
-        sg_find_bsg_nvme_char_major(verbose);
-    }
+    sg_pt_linux_majors(verbose);
     if (dev_fd >= 0) {
-        bool is_sg, is_bsg, is_nvme;
         int err;
-        uint32_t nsid;
-        struct stat a_stat;
+        struct sg_pt_fd_info fi;
 
-        is_sg = check_file_type(dev_fd, &a_stat, &is_bsg, &is_nvme, &nsid,
-                                &err, verbose);
+        err = sg_pt_fd_info(dev_fd, &fi, verbose);
         if (err)
             return -err;
-        else if (is_sg)
+        else if (fi.is_sg)
             return 1;
-        else if (is_bsg)
+        else if (fi.is_bsg)
             return 2;
-        else if (is_nvme && (0 == nsid))
+        else if (fi.is_nvme && (0 == fi.nvme_nsid))
             return 3;
-        else if (is_nvme)
+        else if (fi.is_nvme)
             return 4;
         else
             return 0;
@@ -336,10 +359,7 @@ scsi_pt_open_flags(const char * device_name, int flags, int verbose)
 {
     int fd;
 
-    if (! sg_bsg_nvme_char_major_checked) {
-        sg_bsg_nvme_char_major_checked = true;
-        sg_find_bsg_nvme_char_major(verbose);
-    }
+    sg_pt_linux_majors(verbose);
     if (verbose > 1) {
         pr2ws("open %s with flags=0x%x\n", device_name, flags);
     }
@@ -369,6 +389,7 @@ scsi_pt_close_device(int device_fd)
 {
     int res;
 
+    sg_pt_forget_fd(device_fd);
     res = close(device_fd);
     if (res < 0)
         res = -errno;
@@ -381,35 +402,43 @@ static bool ev_dsense = false;
 #endif
 
 
-/* Caller should additionally call get_scsi_pt_os_err() after this call */
-struct sg_pt_base *
-construct_scsi_pt_obj_with_fd(int dev_fd, int verbose)
+/* Sets up *ptp, all zeros, as a new object for dev_fd */
+static void
+init_pt_obj(struct sg_pt_linux_scsi * ptp, int dev_fd, int verbose)
 {
     int err;
-    struct sg_pt_linux_scsi * ptp;
 
-    ptp = (struct sg_pt_linux_scsi *)
-          calloc(1, sizeof(struct sg_pt_linux_scsi));
-    if (ptp) {
 #if (HAVE_NVME && (! IGNORE_NVME))
-        sntl_init_dev_stat(&ptp->dev_stat);
-        if (! checked_ev_dsense) {
-            ev_dsense = sg_get_initial_dsense();
-            checked_ev_dsense = true;
-        }
-        ptp->dev_stat.scsi_dsense = ev_dsense;
+    sntl_init_dev_stat(&ptp->dev_stat);
+    if (! checked_ev_dsense) {
+        ev_dsense = sg_get_initial_dsense();
+        checked_ev_dsense = true;
+    }
+    ptp->dev_stat.scsi_dsense = ev_dsense;
 #endif
-        err = set_pt_file_handle((struct sg_pt_base *)ptp, dev_fd, verbose);
-        if ((0 == err) && (! ptp->is_nvme)) {
-            ptp->io_hdr.guard = 'Q';
+    err = set_pt_file_handle((struct sg_pt_base *)ptp, dev_fd, verbose);
+    if ((0 == err) && (! ptp->is_nvme)) {
+        ptp->io_hdr.guard = 'Q';
 #ifdef BSG_PROTOCOL_SCSI
-            ptp->io_hdr.protocol = BSG_PROTOCOL_SCSI;
+        ptp->io_hdr.protocol = BSG_PROTOCOL_SCSI;
 #endif
 #ifdef BSG_SUB_PROTOCOL_SCSI_CMD
-            ptp->io_hdr.subprotocol = BSG_SUB_PROTOCOL_SCSI_CMD;
+        ptp->io_hdr.subprotocol = BSG_SUB_PROTOCOL_SCSI_CMD;
 #endif
-        }
-    } else if (verbose)
+    }
+}
+
+/* Caller should additionally call get_scsi_pt_os_err() after this call */
+struct sg_pt_base *
+construct_scsi_pt_obj_with_fd(int dev_fd, int verbose)
+{
+    struct sg_pt_linux_scsi * ptp;
+
+    ptp = (struct sg_pt_linux_scsi *)
+          calloc(1, sizeof(struct sg_pt_linux_scsi));
+    if (ptp)
+        init_pt_obj(ptp, dev_fd, verbose);
+    else if (verbose)
         pr2ws("%s: calloc() failed, out of memory?\n", __func__);
 
     return (struct sg_pt_base *)ptp;
@@ -440,6 +469,56 @@ destruct_scsi_pt_obj(struct sg_pt_base * vp)
     }
 }
 
+/* Each thread keeps the last object given back to put_scsi_pt_obj() and
+ * sets it up anew for the next get_scsi_pt_obj(), so the sg_ll_* helpers
+ * issued one after another do not go to the heap. The key's destructor
+ * frees it when the thread exits. */
+static pthread_key_t pt_cache_key;
+static pthread_once_t pt_cache_once = PTHREAD_ONCE_INIT;
+static bool pt_cache_ok = false;
+
+static void
+pt_cache_free(void * vp)
+{
+    destruct_scsi_pt_obj((struct sg_pt_base *)vp);
+}
+
+static void
+pt_cache_init(void)
+{
+    pt_cache_ok = (0 == pthread_key_create(&pt_cache_key, pt_cache_free));
+}
+
+/* Caller should additionally call get_scsi_pt_os_err() after this call */
+struct sg_pt_base *
+get_scsi_pt_obj(int dev_fd, int verbose)
+{
+    struct sg_pt_linux_scsi * ptp = NULL;
+
+    pthread_once(&pt_cache_once, pt_cache_init);
+    if (pt_cache_ok)
+        ptp = (struct sg_pt_linux_scsi *)pthread_getspecific(pt_cache_key);
+    if (NULL == ptp)
+        return construct_scsi_pt_obj_with_fd(dev_fd, verbose);
+    pthread_setspecific(pt_cache_key, NULL);
+    if (ptp->free_nvme_id_ctlp)
+        free(ptp->free_nvme_id_ctlp);
+    memset(ptp, 0, sizeof(struct sg_pt_linux_scsi));
+    init_pt_obj(ptp, dev_fd, verbose);
+    return (struct sg_pt_base *)ptp;
+}
+
+void
+put_scsi_pt_obj(struct sg_pt_base * vp)
+{
+    if (NULL == vp)
+        return;
+    if (pt_cache_ok && (NULL == pthread_getspecific(pt_cache_key)) &&
+        (0 == pthread_setspecific(pt_cache_key, vp)))
+        return;
+    destruct_scsi_pt_obj(vp);
+}
+
 /* Remembers previous device file descriptor */
 void
 clear_scsi_pt_obj(struct sg_pt_base * vp)
@@ -507,6 +586,128 @@ struct sg_extended_info {
 
 #endif
 
+/* What set_pt_file_handle() finds out about a file descriptor is kept here,
+ * indexed by it, for the next object bound to it; until the fd is closed
+ * with scsi_pt_close_device() or given to sg_pt_forget_fd(). Descriptors
+ * beyond the table are looked at every time. */
+#define PT_FD_CACHE 1024
+
+static struct sg_pt_fd_info pt_fd_cache[PT_FD_CACHE];
+static bool pt_fd_cached[PT_FD_CACHE];
+static pthread_mutex_t pt_fd_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* The sg driver version from dev_fd, asked once per process */
+static int
+sg_version_of(int dev_fd, int verbose)
+{
+    int ver;
+
+    if (sg_checked_version_num)
+        return sg_driver_version_num;
+    if (ioctl(dev_fd, SG_GET_VERSION_NUM, &ver) < 0) {
+        if (verbose > 3)
+            pr2ws("%s: ioctl(SG_GET_VERSION_NUM) failed: errno: %d "
+                  "[%s]\n", __func__, errno, safe_strerror(errno));
+        return 0;
+    }
+    sg_driver_version_num = ver;
+    sg_checked_version_num = true;
+    if (verbose > 4) {
+        if (ver >= SG_LINUX_SG_VER_V4_BASE) {
+#ifdef IGNORE_LINUX_SGV4
+            pr2ws("%s: sg driver version %d.%02d.%02d but config "
+                  "override back to v3\n", __func__, ver / 10000,
+                  (ver / 100) % 100, ver % 100);
+#else
+            pr2ws("%s: sg driver version %d.%02d.%02d so choose v4\n",
+                  __func__, ver / 10000, (ver / 100) % 100, ver % 100);
+#endif
+        } else if (verbose > 5)
+            pr2ws("%s: sg driver version %d.%02d.%02d so choose v3\n",
+                  __func__, ver / 10000, (ver / 100) % 100, ver % 100);
+    }
+    return ver;
+}
+
+/* Asks a sg v4 driver for durations in nanoseconds, set per fd */
+static void
+sg_set_nano(int dev_fd, int sg_version, int verbose)
+{
+    if ((sg_version >= SG_LINUX_SG_VER_V4_FULL) &&
+        getenv("SG3_UTILS_LINUX_NANO")) {
+        struct sg_extended_info sei;
+        struct sg_extended_info * seip = &sei;
+
+        memset(seip, 0, sizeof(*seip));
+        /* try to override default of milliseconds */
+        seip->sei_wr_mask |= SG_SEIM_CTL_FLAGS;
+        seip->ctl_flags_wr_mask |= SG_CTL_FLAGM_TIME_IN_NS;
+        seip->ctl_flags |= SG_CTL_FLAGM_TIME_IN_NS;
+        if (ioctl(dev_fd, SG_SET_GET_EXTENDED, seip) < 0) {
+            if (verbose > 2)
+                pr2ws("%s: unable to override milli --> nanoseconds: "
+                      "%s\n", __func__, safe_strerror(errno));
+        } else {
+            if (! sg_duration_set_nano)
+                sg_duration_set_nano = true;
+            if (verbose > 5)
+                pr2ws("%s: dev_fd=%d, succeeding in setting durations "
+                      "to nanoseconds\n", __func__, dev_fd);
+        }
+    } else if ((sg_version >= SG_LINUX_SG_VER_V4_BASE) &&
+               getenv("SG3_UTILS_LINUX_NANO")) {
+        if (verbose > 2)
+            pr2ws("%s: dev_fd=%d, ignored SG3_UTILS_LINUX_NANO\nbecause "
+                  "base version sg version 4 driver\n", __func__, dev_fd);
+    }
+}
+
+int
+sg_pt_fd_info(int dev_fd, struct sg_pt_fd_info * fip, int verbose)
+{
+    bool cacheable = ((dev_fd >= 0) && (dev_fd < PT_FD_CACHE));
+    int os_err;
+    struct stat a_stat;
+
+    if (cacheable) {
+        pthread_mutex_lock(&pt_fd_mutex);
+        if (pt_fd_cached[dev_fd]) {
+            *fip = pt_fd_cache[dev_fd];
+            pthread_mutex_unlock(&pt_fd_mutex);
+            return 0;
+        }
+        pthread_mutex_unlock(&pt_fd_mutex);
+    }
+    sg_pt_linux_majors(verbose);
+    memset(fip, 0, sizeof(*fip));
+    fip->is_sg = check_file_type(dev_fd, &a_stat, &fip->is_bsg,
+                                 &fip->is_nvme, &fip->nvme_nsid, &os_err,
+                                 verbose);
+    if (os_err)
+        return os_err;
+    if (fip->is_sg) {
+        fip->sg_version = sg_version_of(dev_fd, verbose);
+        sg_set_nano(dev_fd, fip->sg_version, verbose);
+    }
+    if (cacheable) {
+        pthread_mutex_lock(&pt_fd_mutex);
+        pt_fd_cache[dev_fd] = *fip;
+        pt_fd_cached[dev_fd] = true;
+        pthread_mutex_unlock(&pt_fd_mutex);
+    }
+    return 0;
+}
+
+void
+sg_pt_forget_fd(int dev_fd)
+{
+    if ((dev_fd >= 0) && (dev_fd < PT_FD_CACHE)) {
+        pthread_mutex_lock(&pt_fd_mutex);
+        pt_fd_cached[dev_fd] = false;
+        pthread_mutex_unlock(&pt_fd_mutex);
+    }
+}
+
 /* Forget any previous dev_fd and install the one given. May attempt to
  * find file type (e.g. if pass-though) from OS so there could be an error.
  * Returns 0 for success or the same value as get_scsi_pt_os_err()
@@ -515,75 +716,17 @@ int
 set_pt_file_handle(struct sg_pt_base * vp, int dev_fd, int verbose)
 {
     struct sg_pt_linux_scsi * ptp = &vp->impl;
-    struct stat a_stat;
 
-    if (! sg_bsg_nvme_char_major_checked) {
-        sg_bsg_nvme_char_major_checked = true;
-        sg_find_bsg_nvme_char_major(verbose);
-    }
     ptp->dev_fd = dev_fd;
     if (dev_fd >= 0) {
-        ptp->is_sg = check_file_type(dev_fd, &a_stat, &ptp->is_bsg,
-                                     &ptp->is_nvme, &ptp->nvme_nsid,
-                                     &ptp->os_err, verbose);
-        if (ptp->is_sg && (! sg_checked_version_num)) {
-            if (ioctl(dev_fd, SG_GET_VERSION_NUM, &ptp->sg_version) < 0) {
-                ptp->sg_version = 0;
-                if (verbose > 3)
-                    pr2ws("%s: ioctl(SG_GET_VERSION_NUM) failed: errno: %d "
-                          "[%s]\n", __func__, errno, safe_strerror(errno));
-            } else {    /* got version number */
-                sg_driver_version_num = ptp->sg_version;
-                sg_checked_version_num = true;
-            }
-            if (verbose > 4) {
-                int ver = ptp->sg_version;
-
-                if (ptp->sg_version >= SG_LINUX_SG_VER_V4_BASE) {
-#ifdef IGNORE_LINUX_SGV4
-                    pr2ws("%s: sg driver version %d.%02d.%02d but config "
-                          "override back to v3\n", __func__, ver / 10000,
-                          (ver / 100) % 100, ver % 100);
-#else
-                    pr2ws("%s: sg driver version %d.%02d.%02d so choose v4\n",
-                          __func__, ver / 10000, (ver / 100) % 100,
-                          ver % 100);
-#endif
-                } else if (verbose > 5)
-                    pr2ws("%s: sg driver version %d.%02d.%02d so choose v3\n",
-                          __func__, ver / 10000, (ver / 100) % 100,
-                          ver % 100);
-            }
-        } else if (ptp->is_sg)
-            ptp->sg_version = sg_driver_version_num;
-
-        if (ptp->is_sg && (ptp->sg_version >= SG_LINUX_SG_VER_V4_FULL) &&
-            getenv("SG3_UTILS_LINUX_NANO")) {
-            struct sg_extended_info sei;
-            struct sg_extended_info * seip = &sei;
-
-            memset(seip, 0, sizeof(*seip));
-            /* try to override default of milliseconds */
-            seip->sei_wr_mask |= SG_SEIM_CTL_FLAGS;
-            seip->ctl_flags_wr_mask |= SG_CTL_FLAGM_TIME_IN_NS;
-            seip->ctl_flags |= SG_CTL_FLAGM_TIME_IN_NS;
-            if (ioctl(dev_fd, SG_SET_GET_EXTENDED, seip) < 0) {
-                if (verbose > 2)
-                    pr2ws("%s: unable to override milli --> nanoseconds: "
-                          "%s\n", __func__, safe_strerror(errno));
-            } else {
-                if (! sg_duration_set_nano)
-                    sg_duration_set_nano = true;
-                if (verbose > 5)
-                    pr2ws("%s: dev_fd=%d, succeeding in setting durations "
-                          "to nanoseconds\n", __func__, dev_fd);
-            }
-        } else if (ptp->is_sg && (ptp->sg_version >= SG_LINUX_SG_VER_V4_BASE)
-                   && getenv("SG3_UTILS_LINUX_NANO")) {
-            if (verbose > 2)
-                pr2ws("%s: dev_fd=%d, ignored SG3_UTILS_LINUX_NANO\nbecause "
-                      "base version sg version 4 driver\n", __func__, dev_fd);
-        }
+        struct sg_pt_fd_info fi;
+
+        ptp->os_err = sg_pt_fd_info(dev_fd, &fi, verbose);
+        ptp->is_sg = fi.is_sg;
+        ptp->is_bsg = fi.is_bsg;
+        ptp->is_nvme = fi.is_nvme;
+        ptp->nvme_nsid = fi.nvme_nsid;
+        ptp->sg_version = fi.sg_version;
     } else {
         ptp->is_sg = false;
         ptp->is_bsg = false;
@@ -1089,10 +1232,7 @@ do_scsi_pt(struct sg_pt_base * vp, int fd, int time_secs, int verbose)
     struct sg_pt_linux_scsi * ptp = &vp->impl;
     bool have_checked_for_type = (ptp->dev_fd >= 0);
 
-    if (! sg_bsg_nvme_char_major_checked) {
-        sg_bsg_nvme_char_major_checked = true;
-        sg_find_bsg_nvme_char_major(verbose);
-    }
+    sg_pt_linux_majors(verbose);
     if (ptp->in_err) {
         if (verbose)
             pr2ws("Replicated or unused set_scsi_pt... functions\n");
@@ -0,0 +1,309 @@
+/*
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_io_linux.h"
+
+/*
+ * A utility program to time the sg_lib sense decoding helpers that run on
+ * every failed command of an error storm, in ns per call. The sense
+ * buffers come from files given as arguments, one buffer a line in ASCII
+ * hex ("72 03 11 00 ..."), everything from a '#' on ignored; without any
+ * a built-in corpus of medium, recovered, unit attention, not ready and
+ * aborted command sense in both formats is used. Each helper is called
+ * round robin over the corpus so its branches are taken in the mix the
+ * drives produced.
+ */
+
+static const char * version_str = "1.00 20261014";
+
+#define MAX_LINE_LEN 1024
+#define MAX_SENSE_LEN 252
+#define MAX_CORPUS 4096
+
+static struct option long_options[] = {
+        {"help", no_argument, 0, 'h'},
+        {"num",  required_argument, 0, 'n'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0},   /* sentinel */
+};
+
+struct sense_ent {
+    uint8_t sb[MAX_SENSE_LEN];
+    int len;
+};
+
+static struct sense_ent corpus[MAX_CORPUS];
+static int num_corpus;
+
+static const char * builtin_corpus[] = {
+    /* medium error, unrecovered read error, fixed, info valid */
+    "f0 00 03 00 12 34 56 0a 00 00 00 00 11 00 00 00 00 00",
+    /* the same in descriptor format, 64 bit information */
+    "72 03 11 00 00 00 00 0c 00 0a 80 00 00 00 00 01 23 45 67 89",
+    /* medium error, unrecovered read error - auto reallocate failed */
+    "72 03 11 04 00 00 00 0c 00 0a 80 00 00 00 00 00 00 9a bc de",
+    /* recovered error, data recovered with retries and ECC, fixed */
+    "f0 00 01 00 00 12 34 0a 00 00 00 00 18 01 00 00 00 00",
+    /* unit attention, power on or reset */
+    "70 00 06 00 00 00 00 0a 00 00 00 00 29 00 00 00 00 00",
+    /* not ready, becoming ready */
+    "70 00 02 00 00 00 00 0a 00 00 00 00 04 01 00 00 00 00",
+    /* aborted command, ack/nak timeout */
+    "72 0b 4b 03 00 00 00 00",
+    /* hardware error, internal target failure */
+    "72 04 44 00 00 00 00 00",
+    /* not ready, format in progress with progress indication */
+    "70 00 02 00 00 00 00 0a 00 00 00 00 04 04 00 80 12 34",
+    /* medium error with an ATA status return descriptor (SATL) */
+    "72 03 11 00 00 00 00 0e 09 0c 01 40 00 00 00 00 00 00 00 00 00 51",
+};
+
+static void
+usage()
+{
+    fprintf(stderr,
+            "Usage: bench_sg_lib [--help] [--num=NUM] [--verbose] "
+            "[--version]\n"
+            "                    [SENSE_FILE...]\n"
+            "  where:\n"
+            "    --help|-h          print out usage message\n"
+            "    --num=NUM|-n NUM    calls of each helper (def=1m)\n"
+            "    --verbose|-v       increase verbosity\n"
+            "    --version|-V       print version string and exit\n\n"
+            "Time the sg_lib sense decoding helpers in ns per call, over "
+            "the sense\nbuffers of SENSE_FILE (ASCII hex, one a line) or a "
+            "built-in corpus.\n"
+           );
+}
+
+/* Parses ASCII hex line 'lp', as many bytes as it holds up to '#'.
+ * Returns how many, -1 when it is not hex. */
+static int
+parse_hex_line(const char * lp, uint8_t * b, int max_len)
+{
+    int n = 0;
+    unsigned int h;
+    char * endp;
+
+    while (*lp && ('#' != *lp)) {
+        if (isspace((unsigned char)*lp) || (',' == *lp)) {
+            ++lp;
+            continue;
+        }
+        h = (unsigned int)strtoul(lp, &endp, 16);
+        if ((endp == lp) || (h > 0xff) || (n >= max_len))
+            return -1;
+        b[n++] = (uint8_t)h;
+        lp = endp;
+    }
+    return n;
+}
+
+static int
+add_sense(const char * lp, const char * where, int lineno)
+{
+    int len;
+
+    if (num_corpus >= MAX_CORPUS) {
+        fprintf(stderr, "%s: more than %d sense buffers, ignoring the "
+                "rest\n", where, MAX_CORPUS);
+        return 1;
+    }
+    len = parse_hex_line(lp, corpus[num_corpus].sb, MAX_SENSE_LEN);
+    if (len < 0) {
+        fprintf(stderr, "%s:%d: not ASCII hex sense\n", where, lineno);
+        return -1;
+    }
+    if (len < 8)
+        return 0;       /* blank, a comment or too short to be sense */
+    corpus[num_corpus++].len = len;
+    return 0;
+}
+
+static int
+load_file(const char * fname)
+{
+    FILE * fp;
+    char line[MAX_LINE_LEN];
+    int lineno = 0;
+    int res = 0;
+
+    fp = fopen(fname, "r");
+    if (NULL == fp) {
+        perror(fname);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        ++lineno;
+        res = add_sense(line, fname, lineno);
+        if (res)
+            break;
+    }
+    fclose(fp);
+    return (res < 0) ? -1 : 0;
+}
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static volatile uint64_t sink;  /* keeps the calls from being optimised out */
+
+static void
+report(const char * name, uint64_t ns, int num)
+{
+    printf("%-28s %10.1f ns/op\n", name, (double)ns / num);
+}
+
+int
+main(int argc, char * argv[])
+{
+    int k, c, j, n;
+    int do_num = 1000000;
+    int vb = 0;
+    uint64_t t0, info;
+    const struct sense_ent * sep;
+    struct sg_io_hdr io_hdr;
+    struct sg_sense_dec sd;
+    char b[2048];
+    const int b_len = sizeof(b);
+
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "hn:vV", long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'n':
+            do_num = sg_get_num(optarg);
+            if (do_num < 1) {
+                fprintf(stderr, "--num= unable decode argument as number\n");
+                return 1;
+            }
+            break;
+        case 'v':
+            ++vb;
+            break;
+        case 'V':
+            fprintf(stderr, "version: %s\n", version_str);
+            return 0;
+        default:
+            fprintf(stderr, "unrecognised switch code 0x%x ??\n", c);
+            usage();
+            return 1;
+        }
+    }
+    for (; optind < argc; ++optind) {
+        if (load_file(argv[optind]))
+            return 1;
+    }
+    if (0 == num_corpus) {
+        n = (int)(sizeof(builtin_corpus) / sizeof(builtin_corpus[0]));
+        for (k = 0; k < n; ++k)
+            add_sense(builtin_corpus[k], "built-in", k + 1);
+    }
+    if (0 == num_corpus) {
+        fprintf(stderr, "no sense buffers to time\n");
+        return 1;
+    }
+    printf("%d sense buffers, %d calls each\n", num_corpus, do_num);
+    if (vb) {
+        for (k = 0; k < num_corpus; ++k) {
+            sg_get_sense_str("  ", corpus[k].sb, corpus[k].len, false,
+                             b_len, b);
+            printf("%s", b);
+        }
+    }
+
+    memset(&io_hdr, 0, sizeof(io_hdr));
+    io_hdr.interface_id = 'S';
+    io_hdr.status = SAM_STAT_CHECK_CONDITION;
+    io_hdr.masked_status = SAM_STAT_CHECK_CONDITION >> 1;
+    io_hdr.info = SG_INFO_CHECK;
+
+    t0 = now_ns();
+    for (k = 0, j = 0; k < do_num; ++k, j = (j + 1) % num_corpus) {
+        sep = corpus + j;
+        io_hdr.sbp = (unsigned char *)sep->sb;
+        io_hdr.sb_len_wr = sep->len;
+        sink += sg_err_category3(&io_hdr);
+    }
+    report("sg_err_category3()", now_ns() - t0, do_num);
+
+    t0 = now_ns();
+    for (k = 0, j = 0; k < do_num; ++k, j = (j + 1) % num_corpus) {
+        sep = corpus + j;
+        io_hdr.sbp = (unsigned char *)sep->sb;
+        io_hdr.sb_len_wr = sep->len;
+        sink += sg_err_category3_dec(&io_hdr, &sd);
+        sink += sd.info;
+    }
+    report("sg_err_category3_dec()", now_ns() - t0, do_num);
+
+    t0 = now_ns();
+    for (k = 0, j = 0; k < do_num; ++k, j = (j + 1) % num_corpus) {
+        sep = corpus + j;
+        info = 0;
+        sink += sg_get_sense_info_fld(sep->sb, sep->len, &info);
+        sink += info;
+    }
+    report("sg_get_sense_info_fld()", now_ns() - t0, do_num);
+
+    t0 = now_ns();
+    for (k = 0, j = 0; k < do_num; ++k, j = (j + 1) % num_corpus) {
+        struct sg_scsi_sense_hdr ssh;
+
+        sep = corpus + j;
+        if (! sg_scsi_normalize_sense(sep->sb, sep->len, &ssh))
+            continue;
+        sink += (uintptr_t)sg_get_asc_ascq_str(ssh.asc, ssh.ascq, b_len, b);
+    }
+    report("sg_get_asc_ascq_str()", now_ns() - t0, do_num);
+
+    t0 = now_ns();
+    for (k = 0, j = 0; k < do_num; ++k, j = (j + 1) % num_corpus) {
+        sep = corpus + j;
+        sink += sg_get_sense_str(NULL, sep->sb, sep->len, false, b_len, b);
+    }
+    report("sg_get_sense_str()", now_ns() - t0, do_num);
+
+    t0 = now_ns();
+    for (k = 0, j = 0; k < do_num; ++k, j = (j + 1) % num_corpus) {
+        sep = corpus + j;
+        sink += hex2str(sep->sb, sep->len, NULL, 1, b_len, b);
+    }
+    report("hex2str()", now_ns() - t0, do_num);
+    return 0;
+}
@@ -34,6 +34,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <signal.h>
 #include <ctype.h>
@@ -47,10 +48,27 @@
 #include <sys/sysmacros.h>
 #include <sys/time.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <dirent.h>
+#include <fnmatch.h>
 #include <linux/major.h>
 #include <linux/fs.h> /* <sys/mount.h> */
+#include <linux/bsg.h>
+#include <linux/nvme_ioctl.h>
+#include <linux/blkzoned.h>
+#include <linux/perf_event.h>
 #include <time.h>
+#include <math.h>
 #include <stdbool.h>
+#include <pthread.h>
+#ifdef DSKREAD_LIB
+#include <sys/eventfd.h>
+#endif
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -59,11 +77,45 @@
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
 #include "sg_io_linux.h"
+#include "sg_pt.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 #include "getopt.h"
 
 #include "common.h"
+#include "uring.h"
+#include "profile.h"
+#include "latency.h"
+#include "jsonl.h"
+#include "livestat.h"
+#include "metrics.h"
+#include "badmap.h"
+#include "donemap.h"
+#include "reczone.h"
+#include "outsink.h"
+#include "hostco.h"
+#include "results.h"
+#include "throttle.h"
+#include "qdctl.h"
+#include "devscan.h"
+#include "iobuf.h"
+#include "image.h"
+#include "manifest.h"
+#include "jobfile.h"
+#include "control.h"
+#include "agent.h"
+#include "baseline.h"
+#include "trace.h"
+#include "health.h"
+#include "sim.h"
+#include "spdkdev.h"
+#include "fsmap.h"
+#include "probes.h"
+#include "errlog.h"
+#include "drift.h"
+#ifdef DSKREAD_LIB
+#include "dskread.h"
+#endif
 
 static const char *version_str = "5.87 20201124";
 
@@ -85,7 +137,7 @@ static char *progname = APPNAME;
 #define DEF_BLOCKS_PER_TRANSFER 128
 #define DEF_BLOCKS_PER_2048TRANSFER 32
 #define DEF_SCSI_CDBSZ 10
-#define MAX_SCSI_CDBSZ 16
+#define MAX_SCSI_CDBSZ 32 /* READ(32) of type 2 protection */
 
 #define DEF_MODE_CDB_SZ 10
 #define DEF_MODE_RESP_LEN 252
@@ -99,6 +151,7 @@ static char *progname = APPNAME;
 #define READ_LONG_OPCODE 0x3E
 #define READ_LONG_CMD_LEN 10
 #define READ_LONG_DEF_BLK_INC 8
+#define READ_LONG_BATCH 16 /* READ LONGs of bad blocks in flight at once */
 
 #define DEF_TIMEOUT 60000 /* 60,000 millisecs == 60 seconds */
 
@@ -117,6 +170,9 @@ static char *progname = APPNAME;
 #define FT_BLOCK 32   /* filetype is block device */
 #define FT_FIFO 64    /* filetype is a fifo (name pipe) */
 #define FT_ERROR 128  /* couldn't "stat" file */
+#define FT_NVME 256   /* NVMe namespace, read with native NVM commands */
+#define FT_SIM 512    /* "sim:...", a disk simulated in memory */
+#define FT_FILE 1024  /* regular file, as a block device of 512 byte blocks */
 
 #define DEV_NULL_MINOR_NUM 3
 
@@ -125,29 +181,251 @@ static char *progname = APPNAME;
 #define O_DIRECT 0
 #endif
 
+/* glibc's <scsi/sg.h> lags the kernel's, which has had this since 3.1.x */
+#ifndef SG_FLAG_MMAP_IO
+#define SG_FLAG_MMAP_IO 4
+#endif
+
 #define MIN_RESERVED_SIZE 8192
 
 #define MAX_UNIT_ATTENTIONS 10
 #define MAX_ABORTED_CMDS 256
 
-static int64_t dd_count = -1;
-static int64_t in_full = 0;
-static int in_partial = 0;
-static int64_t out_full = 0;
-static int out_partial = 0;
-static int64_t out_sparse = 0;
-static int recovered_errs = 0;
-static int unrecovered_errs = 0;
-static int read_longs = 0;
-static int num_retries = 0;
+#define DEF_QUEUE_DEPTH 1
+#define MAX_QUEUE_DEPTH 16 /* SG_MAX_QUEUE of the sg v3 driver */
+
+/* A READ answered TASK SET FULL or BUSY is queued again, not retried: */
+#define QFULL_PROBE_CMDS 256 /* clean ones before the cap is raised by one */
+#define QFULL_SYNC_TRIES 100 /* of one SG_IO, */
+#define QFULL_SYNC_MS 10     /* this long apart */
+
+/* sg v4 driver multiple requests (mrq), see testing/uapi_sg.h */
+#ifndef SGV4_FLAG_DIRECT_IO
+#define SGV4_FLAG_DIRECT_IO SG_FLAG_DIRECT_IO
+#endif
+#ifndef SGV4_FLAG_MULTIPLE_REQS
+#define SGV4_FLAG_MULTIPLE_REQS 0x20000
+#endif
+#ifndef SGV4_FLAG_HIPRI
+#define SGV4_FLAG_HIPRI 0x800 /* completion polled for, sg 4.0.47 */
+#endif
+#define SG_MRQ_MIN_VERSION 40030 /* sg 4.0.30 */
+/* sg v4 driver buffer sharing between a READ fd and a WRITE fd (--clone),
+ * see testing/uapi_sg.h */
+#ifndef SGV4_FLAG_SHARE
+#define SGV4_FLAG_SHARE 0x2000
+#endif
+#ifndef SGV4_FLAG_NO_DXFER
+#define SGV4_FLAG_NO_DXFER SG_FLAG_NO_DXFER
+#endif
+#ifndef SG_SET_GET_EXTENDED
+struct sg_extended_info
+{
+    uint32_t sei_wr_mask;
+    uint32_t sei_rd_mask;
+    uint32_t ctl_flags_wr_mask;
+    uint32_t ctl_flags_rd_mask;
+    uint32_t ctl_flags;
+    uint32_t read_value;
+    uint32_t reserved_sz;
+    uint32_t tot_fd_thresh;
+    uint32_t minor_index;
+    uint32_t share_fd;
+    uint32_t sgat_elem_sz;
+    uint8_t pad_to_96[52];
+};
+#define SG_SEIM_CTL_FLAGS 0x1
+#define SG_SEIM_SHARE_FD 0x20
+#define SG_CTL_FLAGM_UNSHARE 0x80
+#define SG_SET_GET_EXTENDED _IOWR(0x22, 0x51, struct sg_extended_info)
+#endif
+#define SG_SHARE_MIN_VERSION 40000 /* sg 4.0 */
+#ifndef SG_IOABORT
+#define SG_IOABORT _IOW(0x22, 0x43, struct sg_io_v4)
+#endif
+#define DEF_DEADLINE_RESETS 8 /* missed deadlines per LU reset */
+#define IOPRIO_IDLE ((3 << 13) | 0) /* IOPRIO_PRIO_VALUE(CLASS_IDLE, 0) */
+#define SAM_PRIORITY_LOW 0xf /* lowest command priority of SAM-5 */
+#define MAX_MRQ_REQS 64
+#define MAX_RINGS 64 /* io_uring lanes per device */
+#define MAX_EVENT_THREADS 64 /* --event-threads */
+#define MAX_PATHS 16 /* --multipath sg nodes of one LU, or --sg-fds */
+#define MPATH_OFF 0 /* --multipath off: each node scanned on its own */
+#define MPATH_LQ 1  /* the path with the fewest commands in flight */
+#define MPATH_RR 2  /* round robin */
+#define MAX_ACTUATORS 8 /* Concurrent Positioning Ranges a device may have */
+#define CHUNK_BYTES (64 << 20) /* io_uring lanes steal work in these */
+#define DEF_PROBE_JOBS 16     /* devices opened and probed at once */
+#define BURST_DEF 8           /* --burst of a sampled HDD on a shared link */
+#define SPIN_POLL_MS 500      /* TEST UNIT READY while a drive spins up */
+#define SPIN_TIMEOUT_S 120
+#define EV_TICK_MS 10        /* throttle and --deadline checks of a loop */
+#define GONE_POLL_MS 200     /* sg async: a removal is looked for this often */
+#define EV_BATCH 64          /* readiness events taken per epoll_wait() */
+#define CTR_SHARDS (MAX_RINGS + 1) /* a lane each and the side queue */
+#define ISO_SHARD MAX_RINGS
+#define VERIFY_BLOCKS 65536 /* blocks per VERIFY(16) of the device modes */
+#define VERIFY_FALLBACK (-3) /* BYTCHK=3 rejected, compare on the host */
+#define NVME_OP_WZ 0x08       /* NVM Write Zeroes */
+#define NVME_OP_VERIFY 0x0c   /* NVM Verify */
+#define NVME_ONCS_WZ (1u << 3)     /* Identify Controller ONCS bits */
+#define NVME_ONCS_VERIFY (1u << 7)
+#define NVME_OP_FORMAT 0x80   /* admin Format NVM */
+#define NVME_OP_SANITIZE 0x84 /* admin Sanitize */
+#define NVME_LOG_SANITIZE 0x81 /* Sanitize Status log page */
+#define NVME_SANICAP_CES (1u << 0) /* Identify Controller SANICAP bits */
+#define NVME_SANICAP_BES (1u << 1)
+#define NVME_SANICAP_OWS (1u << 2)
+#define NVME_FNA_ALL (1u << 0)    /* Format NVM: of all namespaces */
+#define NVME_FNA_CRYPTO (1u << 2) /* Format NVM: cryptographic erase */
+#define NVME_FORMAT_MS (600 * 1000) /* a Format NVM is waited for */
+#define TUNE_MIN_BYTES (64 * 1024)
+#define TUNE_MAX_BYTES (4 * 1024 * 1024)
+#define TUNE_WINDOW_BYTES (32 * 1024 * 1024) /* read per combination */
+#define BENCH_QD_STEP 4 /* --bench queue depths 1, 4, 16 */
+#define SEEK_RANDOM 1 /* --seek-probe lbas */
+#define SEEK_STRIDE 2
+#define SEEK_SWEEP 3
+#define SEEK_DEF_CMDS 500 /* timed commands of a line */
+#define SEEK_HIST_BINS 20
+#define CACHE_IO_BYTES (64 * 1024) /* --cache-probe READs of working sets, */
+#define CACHE_SMALL_BYTES 4096     /* and of the read-ahead probe */
+#define CACHE_MIN_BYTES (256 * 1024)         /* working sets from, */
+#define CACHE_MAX_BYTES (1024 * 1024 * 1024) /* doubling up to */
+#define CACHE_RA_MAX (16 * 1024 * 1024)      /* read-ahead strides up to */
+#define CACHE_SAMPLES 128          /* timed READs of a measurement */
+#define CACHE_LINE_SZ 64 /* --cost: bytes of memory a cache miss moves */
+#define DEF_STREAM_MBPS 2000 /* --stream: all devices, the checks stream above */
+#define DEF_SCRUB_BPS 20e6   /* --scrub: --max-rate when none is given */
+#define DIRTY_SETTLE_S 5     /* --dirty: after the write, before the READ */
+#define DIRTY_MAX 65536      /* extents a device's --dirty queue holds */
+#define DIRTY_POLL_MS 200    /* the feed looked at again once at its end */
+#define DEF_DRIFT_PCT 20     /* --drift: smallest step of MB/s or latency, */
+#define DRIFT_SAMPLE_S 1.0   /* the interval of a sample, */
+#define DRIFT_STEPS 32       /* and the steps of a pass kept */
+#define STREAM_WINDOW_S 1.0  /* the aggregate rate is taken over */
+#define STREAM_OFF_PCT 75    /* of --stream, back to the cached checks below */
+#define TRIAGE_BYTES (4 * 1024 * 1024) /* --triage coarse READs, at most */
+#define TRIAGE_BLOCKS 8                 /* --triage fine READs */
+#define TRIAGE_RD_RETRIES 1             /* drive retries of coarse READs */
+#define TRIAGE_RECOVERY_MS 100          /* their recovery time limit */
+#define TRIAGE_RETRIES 3
+
+#define LBA_STATUS_MAPPED 1
+#define LBA_STATUS_DEALLOC 2
+#define MEDIA_FUA 1 /* --media: DPO and FUA on the READs */
+#define MEDIA_DRA 2 /* and read-ahead disabled in the Caching page */
+#define MEDIA_RCD 3 /* and the read cache disabled */
+#define MEDIA_MP_LEN 64 /* MODE SENSE(10) header and Caching page */
+#define CDL_MAX 7          /* --cdl: duration limit descriptors 1 to 7 */
+#define CDL_MP_LEN 256     /* MODE SENSE(10) header and a T2 CDL page */
+#define CDL_ASC 0x2e       /* COMMAND TIMEOUT ..., a limit ran out */
+#define CDL_MAX_MS 655350  /* 65535 of the 10 ms unit */
+#define CDL_A_SPG 0x3      /* CDL mode subpages of the Control page */
+#define CDL_B_SPG 0x4
+#define CDL_T2A_SPG 0x7
+#define CDL_T2B_SPG 0x8
+#define LBA_STATUS_RESP_SZ (8 + 16 * 1024) /* 1024 descriptors per call */
+#define ELEM_FLAG 1 /* --elements flag: failed storage elements reported */
+#define ELEM_SKIP 2 /* --elements skip: and their lbas not read */
+#define ELEM_STATUS_RESP_SZ (32 + 32 * 256) /* 256 elements per call */
+
+#define SLOW_WARMUP 64 /* commands before --slow Nx compares to the median */
+#define SLOW_SPLIT 8   /* pieces a slow READ is re-read in */
+#define HEATMAP_CELLS 4096
+#define DEF_POLL_US 50 /* --poll spin per wait, us */
+#define WRITE_LAG 1  /* --write: READs trail the WRITEs */
+#define WRITE_PASS 2 /* --write=pass: a read pass after the writing */
+#define WRITE_WV 3 /* --write=verify: WRITE AND VERIFY, no READs */
+#define DEF_WRITE_LAG (256 * 1024 * 1024) /* bytes the READs stay behind */
+#define DEF_PIPE_DIST (1024 * 1024 * 1024) /* --pipeline: a pass behind */
+#define MAX_PIPE 16 /* passes --pipeline runs at once */
+#define DEF_WS_BLOCKS 65536 /* per WRITE SAME when the drive gives no limit */
+#define FLUSH_END 0   /* --flush=end: one SYNCHRONIZE CACHE after the WRITEs */
+#define FLUSH_FUA 1   /* --flush=fua: every WRITE with FUA, no flushes */
+#define FLUSH_EVERY 2 /* --flush=bytes: also every opt.flush_every written */
+#define MAX_STREAMS 16 /* --streams=n, regions of a pass */
+#define CLONE_COPY 0  /* --clone through buffers of the host */
+#define CLONE_SHARE 1 /* the sg driver's buffer shared by both fds */
+#define CLONE_XCOPY 2 /* EXTENDED COPY, the devices move the data */
+#define CLONE_AUTO 3  /* --clone-via=auto: the cheapest of them there is */
+#define XCOPY_SEGS 8  /* segment descriptors per EXTENDED COPY */
+#define XCOPY_TIMEOUT_S 600
+#define STABLE_MAX_GRAINS (1 << 22) /* --stable: hashes per pass, larger
+                                     * grains than a transfer past that */
+#define ERASE_UNMAP 1     /* --erase=unmap */
+#define ERASE_BLOCK 2     /* --erase=sanitize[:block] */
+#define ERASE_CRYPTO 3    /* --erase=sanitize:crypto */
+#define ERASE_OVERWRITE 4 /* --erase=sanitize:overwrite */
+#define ERASE_SAMPLES 1024 /* READs spread over the device after --erase */
+#define ERASE_SHOWN 10     /* blocks that survived a crypto erase told of */
+#define OFFLOAD_SELFTEST 1 /* --offload=selftest, extended in the background */
+#define OFFLOAD_BMS 2      /* --offload=bms, background medium scan */
+#define OFFLOAD_POLL_S 5   /* --offload: seconds between looks at the drive */
+#define OFFLOAD_START_S 60 /* the drive takes to say it started, at most */
+#define OFFLOAD_LOG_LEN 0xfffc /* LOG SENSE of --offload, bytes */
+#define DEF_SAMPLE_CONF 0.95 /* --sample confidence */
+#define TL_ZONES 16 /* --time-limit: zones the range is striped over, and
+                    * throughput is kept of, outer to inner */
+#define TL_STRIPE (64 << 20) /* bytes each zone reads in a round, */
+#define TL_MIN_ROUNDS 8      /* less for a range of fewer of them */
+#define DEF_COARSE 1024 /* --coarse stride, MiB */
+#define STRESS_SIZES 16 /* --bs-split entries */
+#define STRESS_MAP_MAX (256 << 20) /* bytes of the map of grains written */
+#define STRESS_SALT 0x737472657373ULL /* "stress": its PRNG apart from the
+                                       * pass keys of the same --seed */
+#define COARSE_WIN (1 << 20) /* bytes each --coarse window reads, */
+#define COARSE_FILL 8        /* the rest read once the stride is this many */
+#define SAMPLE_SALT 0x73616d706c65ULL /* "sample": window places apart from
+                                       * the pass keys of the same --seed */
+#define SEEK_SALT 0x7365656bULL /* "seek": the --seek-probe lbas */
+#define CACHE_SALT 0x6361636865ULL /* "cache": the --cache-probe lbas */
+#define CTL_PAUSE_NS 20000000ULL /* --control pause: a held READ looks again */
+#define DEF_IDLE_MS 10  /* --idle: the foreground sampled this often */
+#define IDLE_QUIET 5    /* samples under the threshold before READs go on */
+#define IDLE_HOLD_NS 2000000ULL /* a READ held by --idle looks again */
+#define MAX_MDS 16              /* md arrays --array follows */
+#define ARRAY_LEAD 64           /* chunks a member reads ahead of the last */
+#define ARRAY_HOLD_NS 1000000ULL /* a READ held for the others looks again */
+#define ARRAY_ROW 128           /* sectors a row of an array without chunks */
+#define ARRAY_REPORT_MAX 50     /* bad extents listed an array */
+#define ARRAY_KEYS_MAX (1 << 20) /* stripes of bad extents counted */
+
+#define ZONING_IN_CMD 0x95
+#define ZONES_RESP_SZ (64 + 64 * 1024) /* 1024 zones per call */
+/* zone types and conditions, the same in ZBC, ZNS and <linux/blkzoned.h> */
+#define ZONE_TYPE_CONVENTIONAL 0x1
+#define ZONE_COND_NOT_WP 0x0
+#define ZONE_COND_EMPTY 0x1
+#define ZONE_COND_READ_ONLY 0xd
+#define ZONE_COND_FULL 0xe
+#define ZONE_COND_OFFLINE 0xf
+
+#define DEV_ID_SZ 80 /* "naa.<32 hex digits>", "eui.", "sn.<serial>" */
+#define CHECKPOINT_MAGIC "dskread-checkpoint 1"
+
+#define DEF_PROFILE_FILE ".dskread_profiles"   /* in $HOME */
+#define DEF_BASELINE_K 3.0   /* --baseline sigmas a drive may be off */
+#define RESULTS_QUERY_DEF 20 /* --results-query passes shown */
+#define PLAN_NONE 0 /* --plan: a device not scheduled, */
+#define PLAN_WAIT 1 /* waiting for its --per-host slot, */
+#define PLAN_RUN 2  /* in a pass */
+#define PLAN_DONE 3 /* or through them all */
+#define MAX_HEALTH_S 3600    /* --health longest interval, seconds */
+#define DEFECT_REC_LBAS 64   /* --defects recovered error LBAs kept a pass */
+#define DEFECT_SHOW 16       /* --defects LBAs printed of each kind */
+#define BASELINE_MIN 3       /* drives of a baseline before it judges */
+#define BASELINE_FLOOR 0.02  /* a spread of at least this much of the mean */
+#define PROFILE_SLOW_PCT 70 /* flag passes below this % of the baseline */
+#define LINK_PROBE_NS 250000000ULL   /* --tune READ BUFFER probe, per drive */
+#define LINK_PROBE_MAX (1024 * 1024) /* bytes one READ BUFFER asks for */
 
-static int do_time = 1;
 static int verbose = 0;
+#ifndef DSKREAD_LIB /* of the signal handlers */
+static int do_time = 1;
 static int start_tm_valid = 0;
 static struct timeval start_tm;
-static int blk_sz = 512;
-static int max_uas = MAX_UNIT_ATTENTIONS;
-static int max_aborted = MAX_ABORTED_CMDS;
+#endif
 
 //          1         2         3         4         5         6         7         8         9
 // 123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890
@@ -164,14 +442,162 @@ static int max_aborted = MAX_ABORTED_CMDS;
 #endif
 
 #define BYTES_PER_ELEMENT (3)
+#define MISMATCH_LINE 96 /* bytes of a hex2str() line of 16, leadin of 13 */
 
 #define SECTORS_PER_READ (128)
 
 #define RANDOMDATAFLAG -1
-#define CHECKDATAFLAG -2
+#define CHECKDATAFLAG -2 /* "any": read, the data not compared */
+#define STAMPDATAFLAG -3 /* random bytes under a stamp of lba, pass, run */
+#define FILEDATAFLAG -4  /* --pattern-file, repeated from byte 0 */
+#define PATFILE_SPAN (64 << 10) /* a shorter file is repeated in memory */
+
+#define MAX_PATTERNS 64
+#define DEF_RANDOM_SEED 0x64736b72656164ULL /* "dskread" */
+#define DEF_DIFF_SECTORS 16 /* mismatched blocks shown and dumped */
+#define DIFF_MAGIC "DSKDIFF\1" /* --diff-dump, version 1 */
+#define PI_TUPLE_SZ 8 /* guard, application and reference tags */
+#define PI_TUPLE64_SZ 16 /* NVMe 64b guard formats, 48 bit reference tag */
+
+/* One pass worth of expected data. 'word' holds the pattern repeated
+ * to PATTERN_WORD_SZ bytes so the check kernel compares whole vectors. */
+struct _pattern
+{
+    int flag; /* 0 -> word, else one of the *DATAFLAG, by block or file */
+    int len;  /* bytes in one period: 1, 2, 4 .. PATTERN_WORD_SZ / 2 */
+    char label[5];
+    uint64_t key; /* per block passes: rand_pattern_key(seed, pass) */
+    unsigned int pass; /* stamped passes: the pass, */
+    uint64_t run;      /* and --run-id */
+    const unsigned char *data; /* file passes: the file mapped, shared */
+    size_t period;             /* by all devices; bytes of the file */
+    size_t span;               /* of data, a multiple of period */
+    const unsigned char *ref;  /* word passes: the word repeated over */
+    size_t ref_len;            /* ref_len bytes, shared, pattern_ref() */
+    unsigned char word[PATTERN_WORD_SZ] __attribute__((aligned(64)));
+};
+
+typedef struct _pattern t_pattern;
+
+static t_pattern patterns[MAX_PATTERNS];
+static int num_patterns = 0;
+
+/* How the side queue retries a failed READ of each error class
+ * (--retry) before sg_read() or direct_read() reads it for the last
+ * time: attempts, each after a backoff doubling from backoff_ms. Block
+ * and NVMe errors are medium (EIO, an NVMe status), aborted (EAGAIN,
+ * EBUSY) or other. */
+struct _retry_policy
+{
+    const char *name;
+    int cat; /* SG_LIB_CAT_* */
+    int attempts;
+    int backoff_ms;
+};
 
-static char *short_options = "V:n:p:vk?";
-static int read_long_blk_inc = READ_LONG_DEF_BLK_INC;
+static struct _retry_policy retry_policy[] = {
+    {"ua", SG_LIB_CAT_UNIT_ATTENTION, 3, 10},
+    {"aborted", SG_LIB_CAT_ABORTED_COMMAND, 3, 20},
+    {"not-ready", SG_LIB_CAT_NOT_READY, 3, 500},
+    {"medium", SG_LIB_CAT_MEDIUM_HARD, 1, 50},
+    {"other", SG_LIB_CAT_OTHER, 1, 50}, /* the last, any other class */
+};
+
+#define NUM_RETRY_POLICIES \
+    ((int)(sizeof(retry_policy) / sizeof(retry_policy[0])))
+
+static char *short_options = "V:n:p:q:s:e:vk?";
+
+/* Long options without a letter of their own. */
+enum
+{
+    OPT_ALL = 256,
+    OPT_VENDOR,
+    OPT_MODEL,
+    OPT_TRANSPORT,
+    OPT_SIZE,
+    OPT_MEDIA,
+    OPT_PREFETCH,
+    OPT_MLOCK,
+    OPT_DIO,
+    OPT_SGL,
+    OPT_POLL,
+    OPT_WRITE,
+    OPT_YES,
+    OPT_ERASE,
+    OPT_OFFLOAD,
+    OPT_FLUSH,
+    OPT_STREAMS,
+    OPT_CLONE,
+    OPT_CLONE_QD,
+    OPT_CLONE_VERIFY,
+    OPT_CLONE_VIA,
+    OPT_COMPARE,
+    OPT_IMAGE,
+    OPT_IMAGE_RLE,
+    OPT_IMAGE_ZSTD,
+    OPT_CRC,
+    OPT_MANIFEST,
+    OPT_MANIFEST_CHECK,
+    OPT_MANIFEST_EXTENT,
+    OPT_MANIFEST_DIFF,
+    OPT_STABLE,
+    OPT_RUN_ID,
+    OPT_PATTERN_FILE,
+    OPT_DIFF_DUMP,
+    OPT_DIFF_SECTORS,
+    OPT_PI,
+    OPT_FORCE_ISA,
+    OPT_SAMPLE,
+    OPT_TIME_LIMIT,
+    OPT_COARSE,
+    OPT_MAX_ERRORS,
+    OPT_STRESS,
+    OPT_MIX,
+    OPT_BS_SPLIT,
+    OPT_JOB,
+    OPT_CONTROL,
+    OPT_AGENT,
+    OPT_COORDINATOR,
+    OPT_POWER,
+    OPT_BASELINE,
+    OPT_TRACE,
+    OPT_TRACE_EXPORT,
+    OPT_HEALTH,
+    OPT_DEFECTS,
+    OPT_SAT,
+    OPT_BENCH,
+    OPT_COST,
+    OPT_STREAM,
+    OPT_MULTIPATH,
+    OPT_ACTUATORS,
+    OPT_ELEMENTS,
+    OPT_SG_FDS,
+    OPT_RETEST_GAP,
+    OPT_SCRUB,
+    OPT_DIRTY,
+    OPT_IDLE,
+    OPT_RANGES,
+    OPT_ALLOCATED,
+    OPT_ARRAY,
+    OPT_CDL,
+    OPT_PIPELINE,
+    OPT_RESULTS,
+    OPT_RESULTS_QUERY,
+    OPT_PLAN,
+    OPT_REC_ZONES,
+    OPT_FAN_OUT,
+    OPT_TARGET_RATE,
+    OPT_LOG_DIR,
+    OPT_SYNC_OUTPUT,
+    OPT_OUTPUT_BUF,
+    OPT_COORDINATE,
+    OPT_MEDIA_TYPE,
+    OPT_SEEK_PROBE,
+    OPT_CACHE_PROBE,
+    OPT_BURST,
+    OPT_DRIFT,
+};
 
 static struct option long_options[] = {
     {"verbose", required_argument, 0, 'V'},
@@ -182,8 +608,245 @@ static struct option long_options[] = {
     {"start", required_argument, 0, 's'},
     {"version", no_argument, 0, 'v'},
     {"patten", required_argument, 0, 'p'}, // gdisk compatible
+    {"dod", no_argument, 0, 'D'},
+    {"qd", required_argument, 0, 'q'},
+    {"mrq", required_argument, 0, 'M'},
+    {"mmap", no_argument, 0, 'm'},
+    {"nvme", no_argument, 0, 'N'},
+    {"rings", required_argument, 0, 'R'},
+    {"sqpoll", no_argument, 0, 'P'},
+    {"iopoll", no_argument, 0, 'I'},
+    {"tune", no_argument, 0, 'T'},
+    {"profiles", required_argument, 0, 'F'},
+    {"device-verify", no_argument, 0, 'Y'},
+    {"device-compare", no_argument, 0, 'C'},
+    {"lba-status", required_argument, 0, 'L'},
+    {"zones", no_argument, 0, 'Z'},
+    {"coe", required_argument, 0, 'c'},
+    {"triage", no_argument, 0, 'a'},
+    {"retry", required_argument, 0, 'W'},
+    {"deadline", required_argument, 0, 'd'},
+    {"background", no_argument, 0, 'g'},
+    {"max-rate", required_argument, 0, 'r'},
+    {"adaptive-qd", required_argument, 0, 'A'},
+    {"event-threads", required_argument, 0, 'j'},
+    {"per-host", required_argument, 0, 'o'},
+    {"host-rate", required_argument, 0, 'x'},
+    {"spin-up", required_argument, 0, 'y'},
+    {"probe-jobs", required_argument, 0, 'l'},
+    {"total-rate", required_argument, 0, 't'},
+    {"rate-file", required_argument, 0, 'f'},
+    {"deadline-resets", required_argument, 0, 'Q'},
+    {"slow", required_argument, 0, 'w'},
+    {"weak-report", required_argument, 0, 'O'},
+    {"heatmap", required_argument, 0, 'H'},
+    {"json", required_argument, 0, 'J'},
+    {"live-stats", required_argument, 0, 'X'},
+    {"metrics-port", required_argument, 0, 'E'},
+    {"metrics-file", required_argument, 0, 'G'},
+    {"bad-map", required_argument, 0, 'b'},
+    {"bad-map-text", required_argument, 0, 'B'},
+    {"retest", required_argument, 0, 'u'},
+    {"checkpoint", required_argument, 0, 'K'},
+    {"resume", no_argument, 0, 'U'},
+    {"seed", required_argument, 0, 'S'},
+    {"all", no_argument, 0, OPT_ALL},
+    {"vendor", required_argument, 0, OPT_VENDOR},
+    {"model", required_argument, 0, OPT_MODEL},
+    {"transport", required_argument, 0, OPT_TRANSPORT},
+    {"size", required_argument, 0, OPT_SIZE},
+    {"media", optional_argument, 0, OPT_MEDIA},
+    {"prefetch", no_argument, 0, OPT_PREFETCH},
+    {"mlock", no_argument, 0, OPT_MLOCK},
+    {"dio", no_argument, 0, OPT_DIO},
+    {"sgl", no_argument, 0, OPT_SGL},
+    {"poll", optional_argument, 0, OPT_POLL},
+    {"write", optional_argument, 0, OPT_WRITE},
+    {"yes", no_argument, 0, OPT_YES},
+    {"erase", required_argument, 0, OPT_ERASE},
+    {"offload", required_argument, 0, OPT_OFFLOAD},
+    {"flush", required_argument, 0, OPT_FLUSH},
+    {"streams", optional_argument, 0, OPT_STREAMS},
+    {"clone", required_argument, 0, OPT_CLONE},
+    {"clone-qd", required_argument, 0, OPT_CLONE_QD},
+    {"clone-verify", no_argument, 0, OPT_CLONE_VERIFY},
+    {"clone-via", required_argument, 0, OPT_CLONE_VIA},
+    {"compare", required_argument, 0, OPT_COMPARE},
+    {"image", required_argument, 0, OPT_IMAGE},
+    {"image-rle", no_argument, 0, OPT_IMAGE_RLE},
+    {"image-zstd", optional_argument, 0, OPT_IMAGE_ZSTD},
+    {"crc", no_argument, 0, OPT_CRC},
+    {"manifest", required_argument, 0, OPT_MANIFEST},
+    {"manifest-check", required_argument, 0, OPT_MANIFEST_CHECK},
+    {"manifest-extent", required_argument, 0, OPT_MANIFEST_EXTENT},
+    {"manifest-diff", required_argument, 0, OPT_MANIFEST_DIFF},
+    {"stable", no_argument, 0, OPT_STABLE},
+    {"run-id", required_argument, 0, OPT_RUN_ID},
+    {"pattern-file", required_argument, 0, OPT_PATTERN_FILE},
+    {"diff-dump", required_argument, 0, OPT_DIFF_DUMP},
+    {"diff-sectors", required_argument, 0, OPT_DIFF_SECTORS},
+    {"pi", optional_argument, 0, OPT_PI},
+    {"force-isa", required_argument, 0, OPT_FORCE_ISA},
+    {"sample", required_argument, 0, OPT_SAMPLE},
+    {"time-limit", required_argument, 0, OPT_TIME_LIMIT},
+    {"coarse", required_argument, 0, OPT_COARSE},
+    {"max-errors", required_argument, 0, OPT_MAX_ERRORS},
+    {"stress", required_argument, 0, OPT_STRESS},
+    {"mix", required_argument, 0, OPT_MIX},
+    {"bs-split", required_argument, 0, OPT_BS_SPLIT},
+    {"job", required_argument, 0, OPT_JOB},
+    {"control", required_argument, 0, OPT_CONTROL},
+    {"agent", required_argument, 0, OPT_AGENT},
+    {"coordinator", required_argument, 0, OPT_COORDINATOR},
+    {"power", required_argument, 0, OPT_POWER},
+    {"baseline", required_argument, 0, OPT_BASELINE},
+    {"trace", required_argument, 0, OPT_TRACE},
+    {"trace-export", required_argument, 0, OPT_TRACE_EXPORT},
+    {"health", required_argument, 0, OPT_HEALTH},
+    {"defects", no_argument, 0, OPT_DEFECTS},
+    {"sat", no_argument, 0, OPT_SAT},
+    {"bench", required_argument, 0, OPT_BENCH},
+    {"cost", no_argument, 0, OPT_COST},
+    {"stream", required_argument, 0, OPT_STREAM},
+    {"multipath", required_argument, 0, OPT_MULTIPATH},
+    {"actuators", required_argument, 0, OPT_ACTUATORS},
+    {"elements", required_argument, 0, OPT_ELEMENTS},
+    {"sg-fds", required_argument, 0, OPT_SG_FDS},
+    {"retest-gap", required_argument, 0, OPT_RETEST_GAP},
+    {"scrub", no_argument, 0, OPT_SCRUB},
+    {"dirty", required_argument, 0, OPT_DIRTY},
+    {"idle", required_argument, 0, OPT_IDLE},
+    {"ranges", required_argument, 0, OPT_RANGES},
+    {"allocated", no_argument, 0, OPT_ALLOCATED},
+    {"array", no_argument, 0, OPT_ARRAY},
+    {"cdl", required_argument, 0, OPT_CDL},
+    {"pipeline", optional_argument, 0, OPT_PIPELINE},
+    {"results", required_argument, 0, OPT_RESULTS},
+    {"results-query", required_argument, 0, OPT_RESULTS_QUERY},
+    {"plan", no_argument, 0, OPT_PLAN},
+    {"rec-zones", optional_argument, 0, OPT_REC_ZONES},
+    {"drift", optional_argument, 0, OPT_DRIFT},
+    {"fan-out", no_argument, 0, OPT_FAN_OUT},
+    {"target-rate", required_argument, 0, OPT_TARGET_RATE},
+    {"log-dir", required_argument, 0, OPT_LOG_DIR},
+    {"sync-output", no_argument, 0, OPT_SYNC_OUTPUT},
+    {"output-buf", required_argument, 0, OPT_OUTPUT_BUF},
+    {"coordinate", optional_argument, 0, OPT_COORDINATE},
+    {"media-type", required_argument, 0, OPT_MEDIA_TYPE},
+    {"seek-probe", required_argument, 0, OPT_SEEK_PROBE},
+    {"cache-probe", no_argument, 0, OPT_CACHE_PROBE},
+    {"burst", required_argument, 0, OPT_BURST},
     {NULL, 0, 0, 0}};
 
+/* A number of bytes with an optional k, M, G, T (powers of 1000) or
+ * Ki, Mi, Gi, Ti suffix. *endp is set past it. Returns 0, -1 when
+ * malformed. */
+static int
+parse_bytes(const char *arg, char **endp, double *vp)
+{
+    static const char sfx[] = "kMGT";
+    const char *cp;
+    char *ep;
+    double v, mult = 1.0;
+
+    v = strtod(arg, &ep);
+    if ((ep == arg) || (v < 0))
+        return -1;
+    cp = *ep ? strchr(sfx, *ep) : NULL;
+    if (cp)
+    {
+        bool bin = ('i' == ep[1]);
+
+        for (; cp >= sfx; --cp)
+            mult *= bin ? 1024.0 : 1000.0;
+        ep += bin ? 2 : 1;
+    }
+    *vp = v * mult;
+    *endp = ep;
+    return 0;
+}
+
+/* "r[:n]" of --max-rate and --total-rate: r bytes/s as parse_bytes()
+ * takes them, n READs/s. Either may be 0 for no cap, and n may be left
+ * out. Returns 0, -1 when malformed. */
+static int
+parse_rate(const char *arg, double *bpsp, double *iopsp)
+{
+    char *ep;
+
+    if (parse_bytes(arg, &ep, bpsp))
+        return -1;
+    *iopsp = 0;
+    if (':' == *ep)
+    {
+        *iopsp = strtod(ep + 1, &ep);
+        if (*iopsp < 0)
+            return -1;
+    }
+    return *ep ? -1 : 0;
+}
+
+/* --bs-split size/weight[:size/weight ...], sizes as parse_bytes()
+ * takes them, a weight of 1 when left out. Returns 0, -1 when
+ * malformed. */
+static int
+parse_bs_split(const char *arg, double *sizes, int *weights, int *np)
+{
+    const char *cp = arg;
+    char *ep;
+    long w;
+    int n = 0;
+
+    do
+    {
+        if ((n >= STRESS_SIZES) || parse_bytes(cp, &ep, sizes + n) ||
+            !(sizes[n] > 0))
+            return -1;
+        w = 1;
+        if ('/' == *ep)
+        {
+            w = strtol(ep + 1, &ep, 10);
+            if (w < 1)
+                return -1;
+        }
+        weights[n++] = (int)w;
+        cp = ep + 1;
+    } while (':' == *ep);
+    *np = n;
+    return *ep ? -1 : 0;
+}
+
+/* --retry class=attempts[:backoff_ms]. Returns 0, -1 when malformed. */
+static int
+retry_policy_set(const char *arg)
+{
+    const char *eq = strchr(arg, '=');
+    char *cp;
+    long n, ms;
+    int k;
+
+    if (NULL == eq)
+        return -1;
+    for (k = 0; k < NUM_RETRY_POLICIES; ++k)
+        if ((strlen(retry_policy[k].name) == (size_t)(eq - arg)) &&
+            (0 == strncmp(arg, retry_policy[k].name, eq - arg)))
+            break;
+    if (k == NUM_RETRY_POLICIES)
+        return -1;
+    n = strtol(eq + 1, &cp, 10);
+    if (cp == eq + 1)
+        return -1;
+    ms = retry_policy[k].backoff_ms;
+    if (':' == *cp)
+        ms = strtol(cp + 1, &cp, 10);
+    if (*cp || (n < 0) || (n > 16) || (ms < 0) ||
+        (ms > 60000))
+        return -1;
+    retry_policy[k].attempts = (int)n;
+    retry_policy[k].backoff_ms = (int)ms;
+    return 0;
+}
+
 void version()
 {
     printf(APPNAME " " APPVERSION " - " __DATE__ "\n");
@@ -194,9 +857,24 @@ void _usage()
 {
     fprintf(stderr, "Usage: %s [options] device(s) -p 0xff\n"
                     " bytes can be one or more numbers between 0 to 255, use 0xNN for hexidecimal,\n"
-                    "  0NNN for octal, r for random bytes, default is 0\n"
+                    "  0NNN for octal, r for random bytes, s for random bytes under a stamp\n"
+                    "  of the lba, pass and run in each block, default is 0\n"
+                    " a device named sim:key=value,... is a disk simulated in memory,\n"
+                    "  keys blocks, bs, lat (us), dist=fixed|uniform|exp, qd, fill, seed,\n"
+                    "  bad=lba[+n], rec=, timeout=, sense=lba[+n]:k/asc/ascq and ua=n\n"
+                    " a device named spdk:<PCI address>[/nsid] is an NVMe controller bound\n"
+                    "  to vfio-pci, driven from user space with SPDK (when built with it)\n"
+                    " a path with a / to a regular file, an image, is read as a block device\n"
+                    "  of 512 byte blocks, with O_DIRECT; its holes are not read when the\n"
+                    "  passes only read, with \"any\" or zeros\n"
                     "\nOptions:\n"
                     " -k | --kilobyte  Use 1024 for kilobyte (default is 1000)\n"
+                    "    | --all       Also read every SCSI and NVMe disk that holds no\n"
+                    "                  mounted filesystem or swap (the boot and root disks)\n"
+                    "    | --vendor p  With --all only disks whose vendor matches glob p,\n"
+                    "                  or with !p all others; likewise --model p and\n"
+                    "                  --transport t (sas, ata, nvme, usb, ...)\n"
+                    "    | --size min[:max]  With --all only disks of min to max bytes\n"
                     //          1         2         3         4         5         6         7
                     // 12345678901234567890123456789012345678901234567890123456789012345678901234567890
 
@@ -204,9 +882,348 @@ void _usage()
                     " -s | --start   n Start at relative sector n (default is 0)\n"
                     " -e | --end     n End at relative sector n (default is last sector)\n"
                     " -v | --version   Show version and copyright information and quit\n"
-                    " -p | --patten n  check buffer\n"
+                    " -p | --patten n  Add a pass checking for byte n, word 0xNNNN.. (up to 32\n"
+                    "                  bytes), r for random or s for stamped; may be repeated\n"
+                    "    | --pattern-file f  Add a pass checking for the contents of f\n"
+                    "                  repeated from the first byte of the device\n"
+                    "    | --dod       Passes of DoD 5220.22-M (0, 0xff, r)\n"
+                    " -q | --qd      n Queue n reads per device (1-%d, default is %d)\n"
+                    "    | --adaptive-qd t  Vary the depth up to --qd, keeping p99\n"
+                    "                  latency under t ms (sg async and io_uring)\n"
+                    "    | --event-threads n  Drive the sg devices from n threads\n"
+                    "                  polling their fds, for hundreds of devices (1-%d)\n"
+                    "    | --mrq     n Submit n reads per syscall with sg v4 mrq (2-%d)\n"
+                    "    | --mmap      Check data in place in the mmap-ed sg reserved buffer\n"
+                    "    | --nvme      Read nvmeXnY with native NVMe commands (ngXnY always are)\n"
+                    "    | --rings   n Block/NVMe: n io_uring lanes (spdk: queue pairs),\n"
+                    "                  one per CPU (1-%d)\n"
+                    "    | --sqpoll    Block/NVMe: kernel thread polls the submission queues\n"
+                    "    | --iopoll    Block/NVMe: poll for completions (needs poll queues)\n"
+                    "    | --tune      Pick -n and --qd per device by timing reads first, or\n"
+                    "                  take them from the profile cached for the drive model\n"
+                    "                  and time READ BUFFER, the link alone, flagging a\n"
+                    "                  drive whose link is well below the model's\n"
+                    "    | --profiles f Tuning profile cache (default is ~/" DEF_PROFILE_FILE ")\n"
+                    "    | --media-type t  Take the -n, --qd and timeout defaults of t\n"
+                    "                  (hdd, smr, ssd, nvme, or none for the plain ones)\n"
+                    "                  instead of those of what each device reports\n"
+                    "    | --baseline f[:k]  Hold the zone MB/s and latency of each drive\n"
+                    "                  that passes a full scan against the fleet of its\n"
+                    "                  model in f, flagging it k (3) sigma slower\n"
+                    "    | --device-verify  SCSI: the drive verifies the media with VERIFY(16),\n"
+                    "                  NVMe: the controller with Verify at the queue depth;\n"
+                    "                  no data is transferred and the pattern is not checked\n"
+                    "    | --sat       With --device-verify, SATA drives behind a SCSI to ATA\n"
+                    "                  layer (ATA Information VPD page) verify with ATA READ\n"
+                    "                  VERIFY SECTORS EXT through ATA PASS-THROUGH(16)\n"
+                    "    | --device-compare  SCSI: the drive compares the media to one block\n"
+                    "                  of the pattern (VERIFY BYTCHK=3), r and s passes read\n"
+                    "    | --media[=dra|rcd]  Time the media, not the drive cache: DPO and\n"
+                    "                  FUA on the READs (sg, NVMe); dra also turns read-ahead\n"
+                    "                  off, rcd the read cache, in the Caching mode page\n"
+                    "                  until the scan ends\n"
+                    "    | --prefetch  SCSI: PRE-FETCH the window after the READs in flight,\n"
+                    "                  kept with --tune only when faster than a deeper queue\n"
+                    "    | --lba-status m  SCSI: GET LBA STATUS first, then read only the\n"
+                    "                  mapped extents (m = mapped) or check that the\n"
+                    "                  deallocated ones are zero (m = dealloc)\n"
+                    "    | --allocated  Read only what is in use: the partition tables,\n"
+                    "                  and in each GPT or MBR partition the blocks its\n"
+                    "                  ext2/3/4 or XFS filesystem has allocated (any\n"
+                    "                  other partition whole), found with the same READs\n"
+                    "    | --array     Members of an md array (from sysfs) are read in\n"
+                    "                  lockstep, at most %d chunks apart, their READs\n"
+                    "                  ending on chunk boundaries; at the end their bad\n"
+                    "                  blocks are reported as array stripes and sectors\n"
+                    "    | --elements m  SCSI: GET PHYSICAL ELEMENT STATUS first and\n"
+                    "                  report the storage elements (heads) outside\n"
+                    "                  their limits or depopulated with their lbas\n"
+                    "                  (m = flag), or leave those lbas out (m = skip)\n"
+                    "    | --zones     Zoned (ZBC/ZNS) devices: read each zone only up to its\n"
+                    "                  write pointer, empty zones by their condition\n"
+                    "    | --coe     n Go on past unreadable blocks, read as zeros (1), or as\n"
+                    "                  READ LONG returns them (2, 3 with CORRCT), SCSI disks\n"
+                    "    | --triage    Read with large fast READs first, then again only\n"
+                    "                  the extents that failed, in small READs with retries.\n"
+                    "                  SCSI drives recover less in the first, PER set\n"
+                    "    | --retry c=n[:ms]  Retry READs failing with class c (ua, aborted,\n"
+                    "                  not-ready, medium, other) n times aside, after ms\n"
+                    "                  doubling each time (3:10, 3:20, 3:500, 1:50, 1:50)\n"
+                    "    | --deadline t  SCSI: abort READs queued longer than t ms and\n"
+                    "                  retry them aside (SG_IOABORT needs the sg v4 driver)\n"
+                    "    | --deadline-resets n  Reset the logical unit every n missed\n"
+                    "                  deadlines (default is %d, 0 = never)\n"
+                    "    | --cdl i[:ms]  SCSI: READ(16) and READ(32) carry command duration\n"
+                    "                  limit descriptor i (1 to 7); with ms its active\n"
+                    "                  time is set to ms, abort past it, in the CDL mode\n"
+                    "                  page until the scan ends. A READ past its limit\n"
+                    "                  is read again aside, without one\n"
+                    "    | --background  Yield to other I/O: idle I/O priority, and the\n"
+                    "                  lowest command priority on sg v4 mrq READs\n"
+                    "    | --max-rate r[:n]  Read each device at most r bytes/s (k, M, G,\n"
+                    "                  Ki, Mi, Gi suffixes) and n READs/s, 0 = no cap\n"
+                    "    | --total-rate r[:n]  The same caps for all devices together\n"
+                    "    | --per-host n  At most n devices of one SCSI host adapter in\n"
+                    "                  a pass at once, the others wait their turn\n"
+                    "    | --host-rate r[:n]  The --max-rate caps for all devices of one\n"
+                    "                  host adapter together, e.g. its link bandwidth\n"
+                    "    | --burst n   Each take of the caps covers n READs of a device,\n"
+                    "                  n nearby windows of a sampled HDD before the next\n"
+                    "                  drive of the adapter gets a turn (default is %d for\n"
+                    "                  HDDs sharing one with --sample or a range list, else\n"
+                    "                  1, each READ in turn)\n"
+                    "    | --fan-out   Read every namespace of an NVMe controller named\n"
+                    "                  (/dev/nvme0, or one of its namespaces) and every\n"
+                    "                  disk LUN of a SCSI target named (any of its LUNs),\n"
+                    "                  all at once\n"
+                    "    | --target-rate r[:n]  With --fan-out, the --max-rate caps for\n"
+                    "                  all of one controller or target together\n"
+                    "    | --coordinate[=n]  Share the --host-rate and --total-rate caps\n"
+                    "                  with the other dskread runs of this host, each an\n"
+                    "                  equal part, and skip devices one of them reads\n"
+                    "                  (shm segment n, default is %s)\n"
+                    "    | --probe-jobs n  Open and probe at most n devices at once\n"
+                    "                  (default is %d), each scan starting after its own\n"
+                    "    | --spin-up n[:ms]  Start drives that are not ready, at most n\n"
+                    "                  of one enclosure at once and ms apart\n"
+                    "    | --rate-file f  Take max-rate, total-rate and host-rate lines\n"
+                    "                  from f, re-read every refresh when it changed\n"
+                    "    | --slow    t Re-read READs slower than t ms, or than t times the\n"
+                    "                  median with tx, in pieces to find the weak sectors\n"
+                    "    | --weak-report f  Append weak sectors to f (default is stderr)\n"
+                    "    | --heatmap f  Write latency and MB/s of %d buckets across the\n"
+                    "                  lbas of each device and pass to CSV file f\n"
+                    "    | --json    f Stream JSON lines to f (- is stdout): progress every\n"
+                    "                  refresh, a summary per pass and per device\n"
+                    "    | --live-stats n  Publish the counters of each device in POSIX shm\n"
+                    "                  object n (/dskread), or in file n if it is a path\n"
+                    "    | --log-dir d  Also write the table of each device to file\n"
+                    "                  d/<device>.log, a line a refresh\n"
+                    "    | --sync-output  Print to stdout and stderr where it happens;\n"
+                    "                  by default both go through a buffer a thread\n"
+                    "                  writes out, so a slow pipe does not stall the\n"
+                    "                  reads (progress lines are dropped when it is\n"
+                    "                  full, other output dropped and counted)\n"
+                    "    | --output-buf n  Bytes of each such buffer (1Mi)\n"
+                    "    | --metrics-port n  Serve OpenMetrics over HTTP on port n\n"
+                    "    | --metrics-file f  Rewrite f with OpenMetrics every refresh, for\n"
+                    "                  a textfile collector\n"
+                    "    | --control s  Take commands on Unix socket s while running: pause,\n"
+                    "                  resume, qd, bpt, max-rate, total-rate, host-rate,\n"
+                    "                  stats, metrics; help lists them\n"
+                    "    | --trace   f Record every command to binary file f: when, lba,\n"
+                    "                  blocks, latency, queue depth, status (trace.h)\n"
+                    "    | --trace-export f[,chrome]  Print trace f as CSV, or as Chrome\n"
+                    "                  trace JSON for chrome://tracing or Perfetto\n"
+                    "    | --plan      Probe the devices and print the schedule of the\n"
+                    "                  passes: when each is done at the rate of its\n"
+                    "                  profile (--tune) or last --results pass, capped\n"
+                    "                  by the link and the rate caps; the peak MB/s of\n"
+                    "                  each adapter and the buffers, no scan\n"
+                    "    | --results f Append a record of each pass of each drive to the\n"
+                    "                  results store f (results.h): zone MB/s, latency,\n"
+                    "                  error extents, health counters, indexed by WWN\n"
+                    "    | --results-query id[,n]  The last n (20) passes of drive id (WWN,\n"
+                    "                  else serial, else device name) in the --results\n"
+                    "                  store, MB/s and its trend, no device read\n"
+                    "    | --rec-zones[=f]  Sum up each pass by recording zone: MB/s,\n"
+                    "                  latency p50/p99/p99.9 and errors a TB of each,\n"
+                    "                  the zones of the model in table f (reczone.h)\n"
+                    "                  or found where the MB/s steps\n"
+                    "    | --drift[=p]  Find where the MB/s or the mean latency of a\n"
+                    "                  pass steps by p%% (%d) or more and stays there (SLC\n"
+                    "                  cache full, thermal throttling), from a sample\n"
+                    "                  each second; each step's time, lba and rates\n"
+                    "                  before and after at the end of the pass\n"
+                    "    | --health  s Sample the temperature and read error counters of\n"
+                    "                  each drive every s seconds, by a fd of their own:\n"
+                    "                  \"health\" JSON records and --heatmap temp_c; of a\n"
+                    "                  SAS drive the phy errors, against throughput dips\n"
+                    "    | --defects   Read the grown defect list of each SCSI drive before\n"
+                    "                  and after each pass and report what it grew by,\n"
+                    "                  with the recovered errors of the pass and their LBAs\n"
+                    "    | --bad-map f  Append the bad, weak and miscompared extents of each\n"
+                    "                  device to binary map f\n"
+                    "    | --bad-map-text f  Write the same extents to f as text\n"
+                    "    | --retest  f Read only the extents of map f (from --bad-map)\n"
+                    "    | --retest-gap n  Extents of the map at most n blocks apart\n"
+                    "                  are read as one window, gap and all (default\n"
+                    "                  one transfer, 0 only the extents)\n"
+                    "    | --ranges f  Read only the extents listed in f, one a line as\n"
+                    "                  lba, lba+n or first-last, or the lines of\n"
+                    "                  --bad-map-text, or a --bad-map map; sorted and\n"
+                    "                  merged, within --start and --end\n"
+                    "    | --checkpoint f  Save where each device is to f every refresh\n"
+                    "    | --scrub     Read every device over and over until stopped\n"
+                    "                  (SIGINT, SIGTERM), at idle priority, under a\n"
+                    "                  --max-rate of 20 MB/s unless given, the data\n"
+                    "                  not compared unless patterns are given; with\n"
+                    "                  --checkpoint it resumes where it stopped and\n"
+                    "                  tracks when each device was last read in full\n"
+                    "    | --dirty f[:s]  With --scrub, verify the extents f says were\n"
+                    "                  written s seconds (%d) after it says so, ahead of\n"
+                    "                  the sweep and under its caps: f is followed as it\n"
+                    "                  grows (a file, or a FIFO a write tracker feeds),\n"
+                    "                  a line [device] lba, lba+n or first-last, the\n"
+                    "                  device its name, basename or major:minor\n"
+                    "    | --idle pct[:ms]  Hold the READs of a device while other I/O\n"
+                    "                  keeps it over pct%% busy, from its /sys/block\n"
+                    "                  stat sampled every ms (%d), going on after %d\n"
+                    "                  samples under it\n"
+                    "    | --resume    Continue the scan saved in the --checkpoint file\n"
+                    "    | --mlock     Lock the transfer buffers in memory\n"
+                    "    | --dio       sg: direct I/O into locked buffers, counting the\n"
+                    "                  READs the driver copied instead\n"
+                    "    | --sgl       sg: READs larger than 2 MiB into a list of 2 MiB\n"
+                    "                  buffers instead of one contiguous buffer\n"
+                    "    | --poll[=us] Poll for completions: io_uring IOPOLL, sg v4 HIPRI,\n"
+                    "                  spinning up to us per wait (default is %d)\n"
+                    "                  before sleeping; reports both latencies\n"
+                    "    | --write[=pass|bytes]  Write the pass pattern first, then read\n"
+                    "                  it back: bytes (256Mi) behind the writer, or in a\n"
+                    "                  pass of its own. Destroys the data, needs --yes.\n"
+                    "                  Zeros go as WRITE SAME, BLKZEROOUT or NVMe Write\n"
+                    "                  Zeroes (queued, deallocating where that reads 0)\n"
+                    "    | --write=verify[:1]  Write with WRITE AND VERIFY, the drive\n"
+                    "                  checking the medium (:1 the data too), no READs\n"
+                    "    | --pipeline[=bytes]  sg: the passes of --write or --write=verify\n"
+                    "                  at once, up to %d, each writing only what the one\n"
+                    "                  before has written and read back, bytes (1Gi)\n"
+                    "                  behind it\n"
+                    "    | --flush   f Cache flushes of --write: end (one after the\n"
+                    "                  WRITEs, the default), fua (every WRITE with\n"
+                    "                  FUA) or bytes (1Gi) between SYNCHRONIZE CACHEs\n"
+                    "    | --streams[=n]  sg: --write with WRITE STREAM, a stream opened\n"
+                    "                  per pass, or per n regions of it (up to %d)\n"
+                    "    | --clone   d Copy the range to the same lbas of d instead of\n"
+                    "                  testing it. Destroys the data on d, needs --yes\n"
+                    "    | --clone-qd n  Queue depth of the other side of --clone or\n"
+                    "                  --compare (--qd)\n"
+                    "    | --clone-verify  Read every WRITE of --clone back and compare\n"
+                    "    | --clone-via m  auto (the default), xcopy (EXTENDED COPY),\n"
+                    "                  share (sg v4 shared buffers) or copy (through\n"
+                    "                  the host); auto takes the first of them there is\n"
+                    "    | --compare f Compare the range with the same lbas of f, a\n"
+                    "                  device or an image file, instead of testing it\n"
+                    "    | --image   f Capture the range to f, - for stdout: zero blocks\n"
+                    "                  left as holes, to a pipe records (see image.h)\n"
+                    "    | --image-rle  Records into a regular file too, 0xff runs as\n"
+                    "                  records as well\n"
+                    "    | --image-zstd[=l[:t]]  Compress the records with zstd at level\n"
+                    "                  l (3) on t worker threads (one per CPU)\n"
+                    "    | --crc       The CRC32C of what each pass reads of the range\n"
+                    "    | --pi[=a[:m]]  Read the protection information too (SCSI\n"
+                    "                  RDPROTECT=1, NVMe metadata) and check each\n"
+                    "                  guard CRC and reference tag, and with a the\n"
+                    "                  application tag (bits m of it, default all)\n"
+                    "    | --diff-sectors n  Show the bytes and bits that differ of the\n"
+                    "                  first n blocks not the pattern (default %d)\n"
+                    "    | --diff-dump f  Write those blocks, as expected and as read,\n"
+                    "                  to f\n"
+                    "    | --stable    Check the passes read the same data: a hash\n"
+                    "                  per transfer of the first, compared later\n"
+                    "    | --manifest f  Write the XXH3-128 of each extent of the range\n"
+                    "                  to f instead of testing it (see manifest.h)\n"
+                    "    | --manifest-check f  Check the extents read against the\n"
+                    "                  manifest f, with or without --manifest\n"
+                    "    | --manifest-extent n  Bytes per extent (64Mi, or as in the\n"
+                    "                  --manifest-check file)\n"
+                    "    | --manifest-diff a,b  The extents that differ between two\n"
+                    "                  manifests, no device read\n"
+                    "    | --yes       Do not ask, the devices may be overwritten\n"
+                    "    | --erase   m Erase first, m unmap or sanitize[:block|crypto|\n"
+                    "                  overwrite], then read samples of the device\n"
+                    "                  (or what --lba-status selects). Needs --yes.\n"
+                    "                  crypto reads the samples before too and checks\n"
+                    "                  none reads back the same. NVMe: Sanitize (every\n"
+                    "                  namespace), else Format NVM for crypto\n"
+                    "    | --offload m Have each SCSI drive scan itself instead, m selftest\n"
+                    "                  (extended self-test) or bms (background medium\n"
+                    "                  scan); its progress in the table, the LBAs it failed\n"
+                    "                  at into the bad map\n"
+                    "    | --seed    n Seed of the random passes, data of pass p at lba l\n"
+                    "                  depends only on (n, p, l)\n"
+                    "    | --run-id  n Run stamped in s blocks (default 0), a block of\n"
+                    "                  another run, pass or lba is told apart on a mismatch\n"
+                    "    | --sample x[:c]  Read only a window of -n blocks at a random\n"
+                    "                  place (by --seed) in each of enough strata to\n"
+                    "                  bound the bad fraction below x at confidence c\n"
+                    "                  (0.95) when none fail, and report the bound got\n"
+                    "    | --time-limit m  Stop after m minutes, the range read in\n"
+                    "                  rounds of a stripe of each of 16 zones so every\n"
+                    "                  zone is sampled, and estimate the full run from\n"
+                    "                  the rate of each zone\n"
+                    "    | --coarse  m Read a 1 MiB window every m MiB (%d, to a power\n"
+                    "                  of two windows) first, then those halfway\n"
+                    "                  between, and so on, the rest last\n"
+                    "    | --max-errors n  Stop the device once more than n of its\n"
+                    "                  blocks are bad or miscompared (with --coe)\n"
+                    "    | --bench b Instead of the passes time every backend the device\n"
+                    "                  takes, -n 64 KiB to 4 MiB, --qd 1, 4 and 16, sg\n"
+                    "                  indirect, --dio and --mmap buffers, with and\n"
+                    "                  without checking the first pattern, b bytes each:\n"
+                    "                  MB/s, IOPS, latency and CPU seconds per GB\n"
+                    "    | --seek-probe p[:n]  Instead of the passes time the media\n"
+                    "                  alone: n (%d) VERIFYs of 1 block, BYTCHK=0 (else\n"
+                    "                  READs with no data moved; NVMe Verify), at lbas\n"
+                    "                  p of random (by --seed), stride=b blocks apart (0\n"
+                    "                  the same, a revolution each) or sweep, seeks of\n"
+                    "                  1, 2, 4 .. blocks: latency histogram, seek curve\n"
+                    "    | --cache-probe  Instead of the passes find the drive's read\n"
+                    "                  cache, re-reading working sets of 256 KiB to 1 GiB\n"
+                    "                  until they time as the media, and its read-ahead,\n"
+                    "                  small READs ever further apart; kept in the\n"
+                    "                  model's --profiles entry, with whether -n and --qd\n"
+                    "                  time the media or the cache\n"
+                    "    | --cost    After each pass the CPU seconds per TB its threads\n"
+                    "                  took, and with perf_event_open the cycles and\n"
+                    "                  last level cache misses, as bytes of memory\n"
+                    "                  traffic per byte verified (the event loop\n"
+                    "                  threads of sg-event are shared, not counted)\n"
+                    "    | --stream r[,d]  Check the data with the lines d bytes ahead\n"
+                    "                  (2 KiB) prefetched non-temporally, keeping it\n"
+                    "                  out of the last level cache, while all the\n"
+                    "                  devices read over r MB/s (2000, 0 never)\n"
+                    "    | --multipath m  sg nodes of one LU (the same Device\n"
+                    "                  Identification designator) are scanned once,\n"
+                    "                  the READs split over them: lq to the path with\n"
+                    "                  the fewest in flight (default), rr in turn, off\n"
+                    "                  scans each node\n"
+                    "    | --sg-fds n  Open an sg node n times (1), or auto once per\n"
+                    "                  --qd, each fd with a reserved buffer of one\n"
+                    "                  transfer, the READs in flight spread over them\n"
+                    "    | --actuators m  auto (default): a drive with more than one\n"
+                    "                  actuator (Concurrent Positioning Ranges) is\n"
+                    "                  read as a sequential stream per actuator, each\n"
+                    "                  with its share of the queue; off as one\n"
+                    "    | --stress s  Each pass is s seconds of random READs of the\n"
+                    "                  range by --qd threads instead, through the same\n"
+                    "                  retries and sense handling; IOPS and latency\n"
+                    "    | --mix p   With --stress, p percent of the commands WRITEs\n"
+                    "                  stamped with their lba, checked when read back\n"
+                    "                  (needs --yes)\n"
+                    "    | --bs-split b/w[:b/w...]  With --stress, sizes b bytes (k, M,\n"
+                    "                  Ki, Mi..) each w of the time (default -n blocks)\n"
+                    "    | --job     f Run the test plan of job file f, its phases on\n"
+                    "                  each device of its groups in turn, the devices\n"
+                    "                  side by side, no device arguments\n"
+                    "    | --coordinator p[:n]  Serve the --job plan to n agents (1) on\n"
+                    "                  TCP port p, sharing --total-rate and --power\n"
+                    "                  among them; results added up per drive lot\n"
+                    "    | --agent   h:p Run the plan of the coordinator at host h, port\n"
+                    "                  p, on the drives of this host, streaming progress\n"
+                    "    | --power   w Watts the agents may draw together, by the plan's\n"
+                    "                  watts a drive\n"
+                    "    | --force-isa l  Data kernels of level l at most: scalar,\n"
+                    "                  sse2, sse4.2, avx2, avx512, neon, armv8-crc or\n"
+                    "                  native (the default, all the CPU has)\n"
                     " -? | --help      Show this help message and quit (-?? = more help, etc.)\n",
-            progname, SECTORS_PER_READ);
+            progname, SECTORS_PER_READ, MAX_QUEUE_DEPTH, DEF_QUEUE_DEPTH,
+            MAX_EVENT_THREADS, MAX_MRQ_REQS, MAX_RINGS, ARRAY_LEAD,
+            DEF_DEADLINE_RESETS, BURST_DEF, HOSTCO_NAME, DEF_PROBE_JOBS,
+            HEATMAP_CELLS, DEF_DRIFT_PCT, DIRTY_SETTLE_S, DEF_IDLE_MS,
+            IDLE_QUIET, DEF_POLL_US, MAX_PIPE, MAX_STREAMS, DEF_DIFF_SECTORS,
+            DEF_COARSE, SEEK_DEF_CMDS);
 }
 
 // void examples() {
@@ -236,6 +1253,173 @@ void usage(int exit_code)
     exit(exit_code);
 }
 
+/* Parses one pass pattern: any for data that is only read, r for
+ * random, s for random stamped with the lba, 0xNN.. in hex (more than two digits give a multi-byte word, most
+ * significant byte first), 0NNN in octal or a decimal byte. Returns 0 on
+ * success. */
+static int
+parse_pattern(const char *arg, t_pattern *pp)
+{
+    int k, n, byte;
+    unsigned char w[PATTERN_WORD_SZ / 2];
+
+    memset(pp, 0, sizeof(*pp));
+    if (0 == strcasecmp(arg, "any"))
+    {
+        pp->flag = CHECKDATAFLAG;
+        pp->len = 1;
+        snprintf(pp->label, sizeof(pp->label), "any");
+        return 0;
+    }
+    if ((0 == strcasecmp(arg, "r")) || (0 == strcasecmp(arg, "random")))
+    {
+        pp->flag = RANDOMDATAFLAG;
+        pp->len = 1;
+        snprintf(pp->label, sizeof(pp->label), "rand");
+        return 0;
+    }
+    if ((0 == strcasecmp(arg, "s")) || (0 == strcasecmp(arg, "stamp")))
+    {
+        pp->flag = STAMPDATAFLAG;
+        pp->len = 1;
+        snprintf(pp->label, sizeof(pp->label), "stmp");
+        return 0;
+    }
+    if (strncasecmp(arg, "0x", 2) == 0)
+    {
+        const char *cp = arg + 2;
+
+        n = strlen(cp);
+        if ((n < 1) || (n > 2 * (int)sizeof(w)) || strspn(cp, "0123456789abcdefABCDEF") != (size_t)n)
+            return -1;
+        if (n <= 2)
+        {
+            sscanf(cp, "%x", &byte);
+            w[0] = (unsigned char)byte;
+            pp->len = 1;
+        }
+        else
+        {
+            if (n & 1)
+                return -1;
+            pp->len = n / 2;
+            if (pp->len & (pp->len - 1))
+                return -1; /* period must divide the pattern word */
+            for (k = 0; k < pp->len; ++k)
+            {
+                sscanf(cp + 2 * k, "%2x", &byte);
+                w[k] = (unsigned char)byte;
+            }
+        }
+    }
+    else
+    {
+        char *endp;
+
+        byte = (int)strtol(arg, &endp, (arg[0] == '0') ? 8 : 10);
+        if (('\0' == arg[0]) || ('\0' != *endp) || (byte < 0) || (byte > 255))
+            return -1;
+        w[0] = (unsigned char)byte;
+        pp->len = 1;
+    }
+    for (k = 0; k < PATTERN_WORD_SZ; ++k)
+        pp->word[k] = w[k % pp->len];
+    if (1 == pp->len)
+        snprintf(pp->label, sizeof(pp->label), "0x%02X", w[0]);
+    else
+        snprintf(pp->label, sizeof(pp->label), "%02X%02X", w[0], w[1]);
+    return 0;
+}
+
+static void
+add_pattern(const char *arg)
+{
+    if (num_patterns >= MAX_PATTERNS)
+    {
+        pr2serr("%s: too many patterns, at most %d passes\n", progname,
+                MAX_PATTERNS);
+        usage(1);
+    }
+    if (parse_pattern(arg, patterns + num_patterns))
+    {
+        pr2serr("%s: bad pattern '%s'\n", progname, arg);
+        usage(1);
+    }
+    ++num_patterns;
+}
+
+/* --pattern-file: adds a pass of the contents of path, repeated from
+ * byte 0 of the device. The file is mapped once for every device, a
+ * file shorter than PATFILE_SPAN repeated into one buffer instead so
+ * the checks compare long runs. Returns 0, -1 when it cannot be read. */
+static int
+add_pattern_file(const char *path)
+{
+    t_pattern *pp = patterns + num_patterns;
+    struct stat st;
+    unsigned char *data;
+    size_t k;
+    int fd;
+
+    if (num_patterns >= MAX_PATTERNS)
+    {
+        pr2serr("%s: too many patterns, at most %d passes\n", progname,
+                MAX_PATTERNS);
+        usage(1);
+    }
+    fd = open(path, O_RDONLY);
+    if ((fd < 0) || fstat(fd, &st))
+    {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    if ((!S_ISREG(st.st_mode)) || (st.st_size < 1))
+    {
+        pr2serr("--pattern-file: %s is not a file of one byte or more\n",
+                path);
+        close(fd);
+        return -1;
+    }
+    memset(pp, 0, sizeof(*pp));
+    pp->flag = FILEDATAFLAG;
+    pp->len = 1;
+    pp->period = (size_t)st.st_size;
+    pp->span = pp->period;
+    if (pp->period < PATFILE_SPAN)
+        pp->span = (PATFILE_SPAN + pp->period - 1) / pp->period * pp->period;
+    data = (unsigned char *)mmap(NULL, pp->period, PROT_READ,
+                                 MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == data)
+    {
+        perror("--pattern-file: mmap");
+        return -1;
+    }
+    if (pp->span > pp->period)
+    {
+        unsigned char *rep = (unsigned char *)malloc(pp->span);
+
+        if (NULL == rep)
+        {
+            pr2serr(">> heap problems, --pattern-file %s\n", path);
+            munmap(data, pp->period);
+            return -1;
+        }
+        for (k = 0; k < pp->span; k += pp->period)
+            memcpy(rep + k, data, pp->period);
+        munmap(data, pp->period);
+        data = rep;
+    }
+    else
+        madvise(data, pp->span, MADV_WILLNEED);
+    pp->data = data;
+    snprintf(pp->label, sizeof(pp->label), "file");
+    ++num_patterns;
+    return 0;
+}
+
 struct flags_t
 {
     int append;
@@ -248,171 +1432,897 @@ struct flags_t
     int excl;
     int fua;
     int flock;
+    int mmap;
+    int nvme;
     int nocache;
     int sgio;
     int pdt;
     int sparse;
     int retries;
+    int write;
 };
 
 static struct flags_t iflag;
 static struct flags_t oflag;
 
-static void calc_duration_throughput(int contin);
+struct _stats
+{
+    char *device_name;
+    unsigned int bytes_per_sector;
 
-static void
-install_handler(int sig_num, void (*sig_handler)(int sig))
+    int64_t start_ticks;
+    struct tm lpStartTime;
+    char start_time[20];
+    int64_t wiping_ticks;
+
+    int64_t all_start_ticks;
+    int64_t all_wiping_ticks;
+
+    int64_t passwiping_ticks;
+};
+
+typedef struct _stats t_stats;
+
+/* A run of blocks a pass reads, from the GET LBA STATUS walk. */
+struct _extent
 {
-    struct sigaction sigact;
-    sigaction(sig_num, NULL, &sigact);
-    if (sigact.sa_handler != SIG_IGN)
-    {
-        sigact.sa_handler = sig_handler;
-        sigemptyset(&sigact.sa_mask);
-        sigact.sa_flags = 0;
-        sigaction(sig_num, &sigact, NULL);
-    }
-}
+    int64_t lba;
+    int64_t len;
+};
 
-static void
-print_stats_sg(const char *str)
+typedef struct _extent t_extent;
+
+/* The READ counters of one submitting thread of a device, a cache line
+ * to itself so the io_uring lanes of one device never write the same
+ * line. A thread only adds to its own shard, with relaxed atomics, and
+ * readers sum the shards without a lock (CTR_GET()). */
+struct _ctr
 {
-    if (0 != dd_count)
-        pr2serr("  remaining block count=%" PRId64 "\n", dd_count);
-    pr2serr("%s%" PRId64 "+%d records in\n", str, in_full - in_partial,
-            in_partial);
-    pr2serr("%s%" PRId64 "+%d records out\n", str, out_full - out_partial,
-            out_partial);
-    if (oflag.sparse)
-        pr2serr("%s%" PRId64 " bypassed records out\n", str, out_sparse);
-    if (recovered_errs > 0)
-        pr2serr("%s%d recovered errors\n", str, recovered_errs);
-    if (num_retries > 0)
-        pr2serr("%s%d retries attempted\n", str, num_retries);
-    if (iflag.coe || oflag.coe)
-    {
-        pr2serr("%s%d unrecovered errors\n", str, unrecovered_errs);
-        pr2serr("%s%d read_longs fetched part of unrecovered read errors\n",
-                str, read_longs);
-    }
-    else if (unrecovered_errs)
-        pr2serr("%s%d unrecovered error(s)\n", str, unrecovered_errs);
-}
+    int64_t in_full;
+    int64_t in_partial;
+    int64_t recovered;
+    int64_t unrecovered;
+    int64_t retries;
+    int64_t read_longs;
+    int64_t uas;     /* unit attentions, against ua_budget */
+    int64_t aborted; /* aborted commands, against aborted_budget */
+    int64_t timeouts; /* READs past the --deadline */
+    int64_t cdl;      /* READs past their --cdl duration limit */
+    int64_t qfull;    /* answered TASK SET FULL or BUSY, queued again */
+} __attribute__((aligned(64)));
 
-static void
-interrupt_handler(int sig)
+typedef struct _ctr t_ctr;
+
+/* A failed READ waiting on the side queue of its device. */
+struct _iso
 {
-    struct sigaction sigact;
+    int64_t lba;
+    int blocks;
+    int cls;         /* retry_policy[] of the last error */
+    int attempts;    /* tries on the side queue so far */
+    uint64_t due_ns; /* lat_now_ns() of the next */
+};
 
-    sigact.sa_handler = SIG_DFL;
-    sigemptyset(&sigact.sa_mask);
-    sigact.sa_flags = 0;
-    sigaction(sig, &sigact, NULL);
-    pr2serr("Interrupted by signal,");
-    if (do_time)
-        calc_duration_throughput(0);
-    print_stats_sg("");
-    kill(getpid(), sig);
-}
+typedef struct _iso t_iso;
 
-static void
-siginfo_handler(int sig)
+/* At most some devices of a group at once, let in in the order they
+ * asked so that none starves, and optionally some time apart. */
+struct _gate
 {
-    if (sig)
-    {
-        ;
-    } /* unused, dummy to suppress warning */
-    pr2serr("Progress report, continuing ...\n");
-    if (do_time)
-        calc_duration_throughput(1);
-    print_stats_sg("  ");
-}
+    int active;           /* devices in */
+    unsigned int ticket;  /* next one handed out */
+    unsigned int serving; /* the ticket let in next */
+    uint64_t last_ns;     /* lat_now_ns() of the last one let in */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
 
-static int bsg_major_checked = 0;
-static int bsg_major = 0;
+typedef struct _gate t_gate;
 
-static void
-find_bsg_major(void)
+/* A SCSI host adapter (HBA) devices hang off, from sysfs. With
+ * --per-host n at most n of its devices are in a pass at once;
+ * --host-rate caps what they read together to what its link carries. */
+struct _host
 {
-    const char *proc_devices = "/proc/devices";
-    FILE *fp;
-    char a[128];
-    char b[128];
-    char *cp;
-    int n;
+    int host_no;
+    int devices;
+    t_gate gate;             /* --per-host */
+    struct tbucket tb_bytes; /* --host-rate */
+    struct tbucket tb_reads;
+    double rate_taken[2];
+};
 
-    if (NULL == (fp = fopen(proc_devices, "r")))
-    {
-        if (verbose)
-            pr2serr("fopen %s failed: %s\n", proc_devices, strerror(errno));
-        return;
-    }
-    while ((cp = fgets(b, sizeof(b), fp)))
-    {
-        if ((1 == sscanf(b, "%126s", a)) &&
-            (0 == memcmp(a, "Character", 9)))
-            break;
-    }
-    while (cp && (cp = fgets(b, sizeof(b), fp)))
-    {
-        if (2 == sscanf(b, "%d %126s", &n, a))
-        {
-            if (0 == strcmp("bsg", a))
-            {
-                bsg_major = n;
-                break;
-            }
-        }
-        else
-            break;
-    }
-    if (verbose > 5)
-    {
-        if (cp)
-            pr2serr("found bsg_major=%d\n", bsg_major);
-        else
-            pr2serr("found no bsg char device in %s\n", proc_devices);
-    }
-    fclose(fp);
-}
+typedef struct _host t_host;
 
-static int
-dd_filetype(const char *filename)
+/* An enclosure, from the enclosure_device links the ses driver puts
+ * in sysfs, or the devices that are in none. --spin-up staggers the
+ * start of the drives of each. */
+struct _encl
 {
-    struct stat st;
-    size_t len = strlen(filename);
+    char name[64]; /* "" -> no enclosure */
+    t_gate gate;
+};
 
-    if ((1 == len) && ('.' == filename[0]))
-        return FT_DEV_NULL;
-    if (stat(filename, &st) < 0)
-        return FT_ERROR;
-    if (S_ISCHR(st.st_mode))
-    {
-        /* major() and minor() defined in sys/sysmacros.h */
-        if ((MEM_MAJOR == major(st.st_rdev)) &&
-            (DEV_NULL_MINOR_NUM == minor(st.st_rdev)))
-            return FT_DEV_NULL;
-        if (RAW_MAJOR == major(st.st_rdev))
-            return FT_RAW;
-        if (SCSI_GENERIC_MAJOR == major(st.st_rdev))
-            return FT_SG;
-        if (SCSI_TAPE_MAJOR == major(st.st_rdev))
-            return FT_ST;
-        if (!bsg_major_checked)
-        {
-            bsg_major_checked = 1;
-            find_bsg_major();
-        }
-        if (bsg_major == (int)major(st.st_rdev))
-            return FT_SG;
-    }
-    else if (S_ISBLK(st.st_mode))
-        return FT_BLOCK;
+typedef struct _encl t_encl;
+
+/* An NVMe controller or SCSI target that --fan-out turned into all its
+ * namespaces or LUNs, scanned at once; --target-rate caps what they
+ * read together, the backend they share. */
+struct _ctrl
+{
+    char name[32]; /* nvme0, 2:0:1 */
+    int devices;
+    struct tbucket tb_bytes; /* --target-rate */
+    struct tbucket tb_reads;
+    double rate_taken[2];
+};
+
+typedef struct _ctrl t_ctrl;
+
+/* Per-device context. Everything a scan mutates lives here (the old
+ * process-wide dd counters included) so that several devices can be
+ * verified concurrently, one worker thread each. */
+/* What a device holds only while it is scanned, apart from its t_dev:
+ * the devs[] array of a few thousand drives, most of them waiting on a
+ * --per-host slot or done, is then their identity, plan and counters.
+ * Allocated when the device is first let in, by dev_run_get(), and
+ * freed once its summary is printed; only what --poll and --adaptive-qd
+ * need, so a run without them never allocates it. */
+struct _dev_run
+{
+    struct lat_hist lat_polled; /* --poll: commands reaped by polling */
+    struct lat_hist lat_irq;    /* and those the thread slept for */
+    struct qdctl qdc;           /* --adaptive-qd, running once .qd is set */
+};
+
+typedef struct _dev_run t_run;
+
+/* --dirty: an extent the feed says was written, and when it said so. */
+struct _dirty_ext
+{
+    int64_t lba;
+    int64_t len;
+    uint64_t noted_ns; /* lat_now_ns() */
+};
+
+typedef struct _dirty_ext t_dirty_ext;
+
+/* --dirty: the extents of a device waiting to be verified, a ring in the
+ * order they were written, and its thread verifying them while the
+ * device is scanned. Allocated with the first extent the feed has for
+ * it, which may be before its scan starts; under dirty_mutex. The last
+ * extent of the ring takes the writes that overlap or touch it, other
+ * than the first, which the thread may be reading. */
+struct _dirty
+{
+    t_dirty_ext *q;
+    int cap;
+    int head;
+    int num;
+    bool started;      /* its thread, */
+    bool stop;         /* asked to end by dirty_finish() */
+    pthread_t tid;
+    uint64_t extents;  /* verified, */
+    uint64_t blocks;   /* their blocks, */
+    uint64_t failed;   /* READs of them that failed, */
+    uint64_t dropped;  /* extents not taken, the ring full */
+    double lag_sum;    /* seconds from noted to verified, */
+    double lag_max;
+};
+
+typedef struct _dirty t_dirty;
+
+/* --drift: the MB/s and mean latency of each DRIFT_SAMPLE_S of a pass,
+ * sampled by the reporter under report_mutex, and the steps found in
+ * them. An interval that read nothing (paused, held) is no sample. */
+struct _drift
+{
+    unsigned int pass;   /* the pass sampled, 0 -> none yet */
+    double t0;           /* mono_secs() of its first sample, */
+    double last_t;       /* and of the last, */
+    int64_t bytes;       /* bytes_done then, */
+    uint64_t count;      /* and lat_pass count */
+    uint64_t sum;        /* and sum */
+    struct drift_det rate; /* MB/s */
+    struct drift_det lat;  /* us */
+    struct drift_step step[DRIFT_STEPS];
+    bool is_lat[DRIFT_STEPS];
+    int num;
+    int lost;            /* steps found with step[] full */
+    int last_rate;       /* step[] of the latest MB/s step, -1 -> none, */
+    int last_lat;        /* and of the latency one */
+};
+
+typedef struct _drift t_drift;
+
+struct _dev
+{
+    char *device_name;
+    int fd;
+    int out_type;
+    int sg_version;
+    int mrq; /* READs per sg v4 mrq batch, 0 -> v3 only */
+    struct
+    {
+        int fd;        /* path 0 is dp->fd */
+        int in_flight; /* commands on it now, atomic */
+        int64_t cmds;  /* and all it took, atomic */
+        int64_t bytes;
+        struct _dev *dev; /* the node, whose own worker does not scan */
+    } path[MAX_PATHS];
+    int npaths;             /* --multipath: paths READs go down, 0 -> dp->fd */
+    int path_pol;           /* MPATH_* choosing among them */
+    unsigned int path_rr;   /* atomic */
+    struct _dev *path_of;   /* this node is a further path of that LU */
+    struct
+    {
+        int64_t lba;   /* first lba of the range */
+        int64_t end;   /* and one past its last */
+        int64_t bytes; /* read in it, atomic */
+    } act[MAX_ACTUATORS];
+    int nact;               /* actuators with a READ stream each, 0 -> one */
+    uint8_t *mmap_buf; /* sg reserved buffer, when mapped */
+    int mmap_len;
+    unsigned int uring_flags; /* setup flags of the block/NVMe rings */
+    int uring; /* rings can be set up, else synchronous reads */
+    unsigned int nsid; /* NVMe namespace id */
+    char model_key[PROFILE_KEY_SZ]; /* vendor/product/rev, "" -> unknown */
+    char dev_id[DEV_ID_SZ]; /* WWN, else serial number, "" -> unknown */
+    int pblk_sz;            /* physical block size, bytes */
+    int64_t align_lba;      /* first lba on a physical block boundary */
+    int pblk;               /* logical blocks per physical, 1 -> none */
+    uint8_t cache_mp[MEDIA_MP_LEN]; /* Caching page before --media */
+    bool prefetch;                  /* --prefetch, as --tune left it */
+    int64_t pf_lba;                 /* end of the window hinted last */
+    int cache_mp_len;               /* 0 -> left as it was */
+    int dld;                        /* --cdl descriptor the READs carry */
+    int cdl_spg;                    /* its CDL mode subpage, 0 -> none */
+    uint8_t cdl_mp[CDL_MP_LEN];     /* that page before --cdl :ms */
+    int cdl_mp_len;                 /* 0 -> left as it was */
+    uint8_t rwr_mp[MEDIA_MP_LEN];   /* Read-Write Error Recovery page */
+    int rwr_mp_len;                 /* before --triage, 0 -> as it was */
+    int max_xfer;           /* transfer limits, bytes, 0 -> unknown */
+    int opt_xfer;
+    char transport[8];      /* "sas", "ata", "nvme", ... */
+    int numa_node;          /* of the adapter, -1 -> unknown or one node */
+    cpu_set_t irq_cpus;     /* the cache domain its interrupts are taken in, */
+    bool irq_dom;           /* when they have one */
+    int64_t dio_done;       /* --dio READs the sg driver did direct */
+    int64_t dio_copied;     /* and those it copied instead */
+    struct profile profile; /* tuned values of the model, when known */
+    bool have_profile;
+    struct lat_hist lat_pass; /* every command of the current pass */
+    struct lat_hist lat_run;  /* the passes so far */
+    t_run *run;                 /* NULL -> not let in yet, or done */
+    t_dirty *dirty;             /* --dirty, NULL -> no extents noted yet */
+    uint64_t spin_ns;           /* CPU time spent spinning for them */
+    uint64_t cpu_ns;  /* CPU time of its lanes and helpers that ended, atomic */
+    int perf_fd[2];   /* --cost: cycles, LLC misses of its threads, */
+    bool perf;        /* when both opened */
+    int64_t stream_bytes; /* checked by the streaming kernels, atomic */
+    uint64_t slow_median;     /* of lat_pass, for --slow Nx */
+    int weak_sectors;
+    int mismatches; /* READs whose data was not the pattern */
+    int64_t mis_blocks; /* blocks of them that were not, */
+    int64_t flips_up;   /* their bits read 1 for 0 */
+    int64_t flips_down; /* and 0 for 1 */
+    int pi_type; /* --pi: protection type 1-3 checked on the host, 0 -> off */
+    int pi_ms;   /* metadata bytes read with each block, */
+    bool pi_ext; /* right after it, else all after the blocks of a READ */
+    int pi_off;  /* of the tuple in them, the guard covering those before */
+    int pi_guard_sz; /* 2: CRC16 T10-DIF, 8: CRC64 NVMe */
+    int pi_ref_bits; /* of the reference tag, less the storage tag */
+    int64_t pi_ok;    /* tuples that were right, */
+    int64_t pi_guard; /* tuples whose guard was not the CRC of the block, */
+    int64_t pi_ref;   /* whose reference tag was not the lba */
+    int64_t pi_app;   /* and whose application tag was not --pi's */
+    int64_t sample_n; /* --sample: windows of the plan, 0 -> none, */
+    int sample_w;     /* of blocks each */
+    int64_t sample_read; /* then of them, those read */
+    int64_t sample_bad;  /* and those with bad or miscompared blocks */
+    double sample_ub;    /* the bound they give the bad fraction */
+    int64_t rounds;      /* --time-limit, --coarse: rounds of a pass, 0 ->
+                          * lba order */
+    int64_t tl_stripe;   /* blocks of each zone a round reads */
+    int64_t co_stride;   /* --coarse: blocks between the first windows, */
+    int64_t co_win;      /* blocks of each, */
+    int co_levels;       /* rounds halving the stride before the fill */
+    int64_t fail_blocks; /* bad and miscompared blocks, for --max-errors */
+    bool err_hit;        /* range_next() stopped on them */
+    bool cancelled;      /* or on dskread_cancel() */
+    bool gone;           /* or removed, its link lost: dev_gone() */
+    int64_t scrub_full;  /* --scrub: time() it was last read in full, 0 ->
+                          * never */
+    unsigned int scrub_cycles; /* and how often this run */
+    int idle_fd;         /* --idle: the /sys/block stat, -1 -> none */
+    int idle_busy;       /* the foreground is over it, READs held */
+    int idle_calm;       /* samples under it since */
+    uint64_t idle_cmds;  /* commands of the scan done, atomic */
+    uint64_t idle_last[3]; /* ios, io_ticks and idle_cmds of the last sample */
+    bool idle_primed;    /* idle_last holds one */
+    uint64_t idle_held_ns; /* READs held in all */
+    dev_t rdev;          /* of its node, for the removal uevents */
+    int paused;          /* --control: READs held, */
+    int qd_cap;          /* at most this many in flight, 0 -> dp->qd, */
+    int bpt_cap;         /* and of at most this many blocks, 0 -> bpt */
+    int qfull_cap;       /* what the LUN took before a queue full, 0 -> */
+    int qfull_ok;        /* no limit; clean READs since it was set */
+    uint64_t tl_end_ns;  /* range_next() stops past it, 0 -> never */
+    bool tl_hit;         /* and did */
+    uint64_t zone_last_ns;        /* the last READ completed, */
+    int64_t zone_bytes[TL_ZONES]; /* bytes read of each zone, */
+    uint64_t zone_ns[TL_ZONES];   /* the time it took, */
+    int64_t zone_pass[TL_ZONES];  /* and those of the pass */
+    int64_t plan_blocks; /* --plan: blocks of a pass, */
+    double plan_bps;     /* bytes a second they are read at, 0 -> unknown, */
+    const char *plan_src; /* where that is from, */
+    int64_t plan_mem;    /* bytes of buffers the passes take */
+    struct badmap bad; /* bad, weak and miscompared extents of the run */
+    bool tuning;              /* tune_device() is timing reads */
+    bool coarse;              /* --triage: READs that fail go to suspect */
+    struct badmap suspect;    /* what the coarse phase could not read */
+    struct lat_map heat;      /* --heatmap, of the current pass */
+    struct reczone_map rz;    /* --rec-zones, of the current pass */
+    t_drift drift;            /* --drift, of the current pass */
+    /* --health: its fd and the samples of the run, the fd under
+     * health_mutex; -1 -> the health thread passes dp by */
+    int health_fd;
+    struct sg_pt_base *health_pt; /* LOG SENSE through health_fd */
+    struct health_log health;
+    struct health_sample health_last; /* the sample before */
+    double health_t0;                 /* mono_secs() of health_open() */
+    /* the SAS phys of its port page at the sample before and the errors
+     * each gained over the run; -1 -> the drive has no such page */
+    int health_nphys;
+    struct health_phy health_phy[HEALTH_PHYS];
+    int64_t health_phy_gain[HEALTH_PHYS];
+    int64_t health_stalls; /* timeouts and aborts at the sample before */
+    /* --defects: the grown defect list when the pass began, -1 -> not
+     * read yet; its LBAs sorted, NULL -> not a block format list */
+    int64_t glist_n;
+    int64_t *glist;
+    int glist_lbas;
+    bool glist_none;                  /* no READ DEFECT DATA */
+    int64_t rec_lba[DEFECT_REC_LBAS]; /* of recovered errors this pass */
+    int rec_n;                        /* recovered errors with an LBA */
+    bool rec_track;                   /* rec_lba[] is kept */
+    int64_t rec0, unrec0;             /* the counters when it began */
+    bool no_dcompare; /* drive rejected VERIFY BYTCHK=3 */
+    bool sat;         /* --sat: SATA behind a SATL, VERIFY through ATA */
+    uint16_t nvme_oncs;  /* Optional NVM Command Support of the controller */
+    uint8_t nvme_dlfeat; /* how the namespace deallocates (DLFEAT) */
+    uint8_t nvme_flbas;  /* its LBA format and protection, as Format NVM */
+    uint8_t nvme_dps;    /* takes them */
+    uint8_t nvme_fna;    /* Format NVM Attributes of the controller */
+    uint32_t nvme_sanicap; /* the Sanitize actions it has */
+    struct sim_dev *sim; /* FT_SIM: sg_read_low() and sg_start_io() */
+    struct spdkdev *spdk; /* FT_NVME "spdk:...": takes the NVMe commands */
+    int ws_blocks;    /* --write: blocks per WRITE SAME, 0 -> plain WRITEs */
+    bool ws_probed;
+    uint8_t *rd_data;    /* the buffer of read_pass_sync(), or the mmap */
+    int sync_blocks;     /* its READs, fewer than bpt after ENOMEM */
+    bool no_abort;    /* sg driver has no SG_IOABORT (before v4) */
+    t_extent *ext; /* sorted, NULL -> the whole [start, end) is read */
+    int num_ext;
+    int ext_cap;
+    int blk_sz;
+    int bpt; /* blocks per READ: -n, or what --tune picked */
+    int qd;  /* READs in flight: --qd, or what --tune picked */
+    int mtype;      /* MTYPE_*, what its defaults were taken for */
+    int timeout_ms; /* of its READs, by the media type */
+    int64_t num_sect;
+    int64_t start;
+    int64_t end;
+    int64_t from; /* first lba of this pass, past start after --resume */
+    struct flags_t flags;
+    uint8_t rd_cdb[MAX_SCSI_CDBSZ]; /* READ template, lba and length 0 */
+    uint8_t wr_cdb[MAX_SCSI_CDBSZ]; /* and WRITE, with --write */
+    struct sg_io_hdr rd_hdr;        /* sg v3 header template of a READ */
+    struct sg_io_v4 rd_h4;          /* and of an mrq READ */
+    t_stats stats;
+
+    int64_t dd_count;
+    int64_t out_full;
+    int out_partial;
+    int64_t out_sparse;
+    t_ctr ctr[CTR_SHARDS]; /* shard ctr_shard: one per io_uring lane, and
+                            * ISO_SHARD of the side queue */
+    int ua_budget;      /* unit attentions retried before giving up */
+    int aborted_budget; /* aborted commands retried before giving up */
+    int read_long_blk_inc; /* bytes past a block READ LONG returns */
+    bool read_long_ok;     /* and that length has been accepted */
+    int rl_fd;             /* READ LONGs queued on it, -1 not open */
+    uint8_t *rl_pool;      /* READ_LONG_BATCH buffers of two blocks */
+    uint8_t *rl_pool_free;
+    pthread_mutex_t rl_mutex; /* the above, one batch at a time */
+
+    int64_t bytes_done; /* read by the aggregate reporter */
+    int64_t bytes_written; /* --write, this pass */
+    int flushes;           /* --write: cache flushes of this pass, */
+    uint64_t flush_ns;     /* the time they took */
+    uint64_t flush_max_ns; /* and the longest */
+    int nstreams;          /* --streams open this pass, */
+    struct
+    {
+        uint16_t id;       /* ASSIGNED_STR_ID */
+        int64_t bytes;     /* written through it */
+        uint64_t t0_ns;    /* lat_now_ns() of its first WRITE */
+        uint64_t t1_ns;    /* and of its last completion */
+    } stream[MAX_STREAMS];
+    struct tbucket tb_bytes; /* --max-rate caps of the device */
+    struct tbucket tb_reads;
+    double rate_taken[2];    /* tb_taken() of both at the last report */
+    bool resbuf_park;        /* --per-host: its sg reserved buffers are cut */
+    int burst;               /* --burst READs a take of the buckets covers */
+    int burst_left;          /* of the last one, atomic */
+    bool resbuf_parked;      /* to a block while it waits, and are now */
+    t_host *host;            /* NULL -> not behind a SCSI host */
+    t_ctrl *ctrl;            /* --fan-out, NULL -> named alone */
+    t_encl *encl;            /* NULL -> not mapped */
+    char slot[64];           /* in the enclosure, "" -> unknown */
+    struct _clone *clone;    /* --clone, the copy this is the source of */
+    uint32_t crc_acc;        /* --crc: chunk CRCs moved to the end, xored */
+    int64_t crc_bytes;       /* and the bytes in them, this pass */
+    uint64_t *stab_ref;      /* --stable: a hash per grain of the first */
+    uint64_t *stab_cur;      /* pass read in full, and of this one */
+    int64_t stab_grain;      /* blocks per grain, from start */
+    uint64_t stab_uni[2][2]; /* XXH3-128 of a block of 0x00s, of 0xffs */
+    struct outsink *log;     /* --log-dir: its table, a line each */
+    int64_t stab_n;          /* grains */
+    unsigned int stab_pass;  /* the pass of stab_ref, 0 -> none yet */
+    /* --erase sanitize:crypto: an XXH3 per block of the samples as they
+     * read before the erase, bit 0 set; 0 -> none (unread, uniform) or
+     * read back already. Sample k is erase_len blocks at start + k *
+     * erase_step. */
+    uint64_t *erase_fp;
+    int64_t erase_step;
+    int64_t erase_n;
+    int erase_len;
+    int64_t erase_before[2]; /* blocks uniform, unread before the erase */
+    int64_t erase_checked;   /* blocks read back since, atomic */
+    int64_t erase_survived;  /* and of them those as before, atomic */
+    const char *erase_how;   /* "sanitize", "nvme-sanitize", ... */
+    /* Where the pass is, for the reporter thread. The engines only
+     * store cur_lba; the rest is set at pass boundaries. */
+    int64_t cur_lba;
+    unsigned int cur_pass; /* 0 -> between passes, nothing to report */
+    char cur_label[5];
+    int64_t pass_start_ticks; /* get_ticks() when the pass began */
+    int64_t base_ticks;       /* wiping_ticks of the earlier passes */
+    pthread_mutex_t report_mutex; /* one print_stats() at a time */
+    unsigned int passes_done; /* for --checkpoint, under report_mutex */
+    int64_t resume_lba;       /* --resume: the first pass starts here */
+    bool ck_ready;            /* resumed or not, the checkpoint may say */
+    /* What of the pass the queued READ engines have read whole, in
+     * chunks; dmap_pass is the pass it is of. dmap_on while an engine
+     * feeds it, dmap_skip when it came from --resume and range_next()
+     * steps over what it says is done. */
+    struct donemap dmap;
+    unsigned int dmap_pass;
+    bool dmap_on;
+    bool dmap_skip;
+    /* The side queue: READs of the queued engines that failed are
+     * re-read and their bad blocks isolated on iso_tid, started with
+     * the first, while the pass goes on. Under iso_mutex. */
+    pthread_mutex_t iso_mutex;
+    pthread_cond_t iso_cond;
+    t_iso *iso_q;
+    int iso_num, iso_cap; /* iso_q[0, iso_num) waiting, in no order */
+    int64_t iso_low;  /* lowest lba queued or in work, else INT64_MAX */
+    int64_t iso_work; /* lba of the READ in work, else -1 */
+    const t_pattern *iso_pat;
+    bool iso_started;
+    bool iso_stop;
+    int iso_res; /* first error of the pass */
+    pthread_t iso_tid;
+    int md_id;         /* --array: of mds[], -1 -> not a member */
+    int md_slot;       /* its role, -1 -> a spare */
+    int64_t md_offset; /* start of its data, 512 byte sectors */
+    int64_t md_chunk;  /* chunk and first chunk boundary in blocks of */
+    int64_t md_lba;    /* the device; READs end on one, 0 -> no chunks */
+    int done;
+    int res;
+    pthread_t tid;
+};
+
+typedef struct _dev t_dev;
+
+/* Which t_dev.ctr shard the calling thread adds to: its lane. */
+static __thread int ctr_shard;
+
+#define CTR_ADD(dp, f, n) \
+    __atomic_fetch_add(&(dp)->ctr[ctr_shard].f, (n), __ATOMIC_RELAXED)
+#define CTR_GET(dp, f) ctr_total((dp), offsetof(t_ctr, f))
+
+/* One counter of dp summed over its shards. A shard is read while its
+ * thread adds to it, so the sum can lag by the READs in flight. */
+static int64_t
+ctr_total(const t_dev *dp, size_t off)
+{
+    int64_t sum = 0;
+    int k;
+
+    for (k = 0; k < CTR_SHARDS; ++k)
+        sum += __atomic_load_n((const int64_t *)((const char *)(dp->ctr + k) +
+                                                 off), __ATOMIC_RELAXED);
+    return sum;
+}
+
+/* Counts one unit attention or aborted command (f) against its budget
+ * of the device. True while the device has budget left to retry. */
+#define CTR_BUDGET(dp, f, budget) \
+    (CTR_ADD(dp, f, 1), CTR_GET(dp, f) < (budget))
+
+/* One READ queued on the sg v3 asynchronous (write/read) interface, or
+ * on the block device's io_uring. --write queues WRITEs the same way. */
+struct _rq
+{
+    int64_t lba;
+    int blocks;
+    bool busy;
+    uint8_t *buffp;
+    uint8_t *free_buffp;
+    struct iobuf_sgl *sgl; /* --sgl, in place of buffp */
+    int buf_idx; /* io_uring registered buffer of buffp */
+    uint64_t t_ns; /* lat_now_ns() when submitted */
+    int qd;        /* in flight when submitted, itself included */
+    bool aborted;  /* past the --deadline, SG_IOABORT sent */
+    bool write;    /* --write: a WRITE of buffp, not a READ into it */
+    bool same;     /* a WRITE SAME of its first block over blocks */
+    int stream;    /* --streams: 1 + dp->stream[] of a WRITE STREAM */
+    int path;      /* --multipath: the path it was queued on */
+    int pass;      /* --pipeline: its pass of write_pass_async() */
+    bool requeue;  /* refused by a full queue, to be queued again as is */
+    struct sg_io_hdr io_hdr;
+    uint8_t cmd[MAX_SCSI_CDBSZ];
+    uint8_t sb[SENSE_BUFF_LEN];
+};
+
+typedef struct _rq t_rq;
+
+static t_dev *devs;
+static int num_devs;
+
+/* --array: an md array some of the devices are members of. */
+typedef struct _md
+{
+    char name[32];         /* md0, as in /sys/block */
+    int level;             /* 0, 1, 4, 5, 6 or 10, -1 -> other */
+    int layout;
+    int disks;             /* raid_disks */
+    int64_t chunk_sectors; /* 512 bytes, ARRAY_ROW without chunks */
+    bool chunks;           /* it has them, READs end on them */
+} t_md;
+
+static t_md mds[MAX_MDS];
+static int num_mds;
+
+/* --array: whether dp has read ARRAY_LEAD chunks more than the member
+ * of its array furthest behind, ended ones aside, and waits. */
+static bool
+array_ahead(const t_dev *dp)
+{
+    int64_t me = __atomic_load_n(&dp->bytes_done, __ATOMIC_RELAXED);
+    int64_t low = INT64_MAX, b;
+    int k;
+
+    for (k = 0; k < num_devs; ++k)
+    {
+        const t_dev *m = devs + k;
+
+        if ((m == dp) || (m->md_id != dp->md_id) ||
+            __atomic_load_n(&m->done, __ATOMIC_ACQUIRE) ||
+            __atomic_load_n(&m->gone, __ATOMIC_RELAXED))
+            continue;
+        b = __atomic_load_n(&m->bytes_done, __ATOMIC_RELAXED);
+        if (b < low)
+            low = b;
+    }
+    return (INT64_MAX != low) &&
+           (me - low > ARRAY_LEAD * mds[dp->md_id].chunk_sectors * 512);
+}
+static int run_cancel; /* dskread_cancel(): every device stops */
+static int uevent_fd = -1; /* the kernel's uevents, -1 -> not watched */
+static pthread_mutex_t lib_mutex = PTHREAD_MUTEX_INITIALIZER; /* devs */
+/* the rate caps of opt, that --control and --rate-file change as the
+ * devices run, see rate_set() */
+static pthread_mutex_t rate_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void (*lib_dev_done)(int dev); /* libdskread: a device is done, */
+static void (*lib_run_end)(void);     /* the run, its devs still there */
+static t_host *hosts; /* of devs, num_hosts of them */
+static int num_hosts;
+static t_ctrl *ctrls; /* --fan-out, num_ctrls of them */
+static int num_ctrls;
+static int *fanout_ctrl; /* of each device named, index in ctrls or -1 */
+static t_encl *encls; /* num_encls of them */
+static int num_encls;
+static t_gate probe_gate; /* --probe-jobs devices opened and probed at once */
+static pthread_mutex_t out_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int check_stream; /* the checks stream, set by the reporter */
+static pthread_mutex_t weak_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *weak_fp; /* --weak-report */
+static pthread_mutex_t heat_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *heat_fp; /* --heatmap */
+static struct livestat *live; /* --live-stats */
+static pthread_mutex_t bad_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *bad_fp;      /* --bad-map */
+static FILE *bad_text_fp; /* --bad-map-text */
+static int image_fd = -1; /* --image, until its image_open() */
+static pthread_mutex_t diff_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *diff_fp; /* --diff-dump */
+static int diff_shown; /* mismatched blocks shown, of --diff-sectors */
+
+#ifndef DSKREAD_LIB
+static void calc_duration_throughput(int contin);
+static void media_restore_all(void);
+#endif
+static void lat_done(t_dev *dp, int64_t lba, int blocks, uint64_t ns);
+static void io_trace(const t_dev *dp, int op, int64_t lba, int blocks,
+                     uint64_t ns, int qd, int res);
+static int isolate_split(t_dev *dp, uint8_t *buff, int64_t lba, int blocks);
+static int direct_read(t_dev *dp, uint8_t *buff, int blocks, int64_t lba);
+static int isolate_read(t_dev *dp, uint8_t *buff, int blocks, int64_t lba);
+static void pattern_fill(const t_dev *dp, const t_pattern *pat, uint8_t *buf,
+                         int64_t lba, int blocks);
+
+static struct tbucket tb_all_bytes; /* --total-rate */
+static struct tbucket tb_all_reads;
+static double rate_all_taken[2];    /* tb_taken() of both, last report */
+static int throttle_on;             /* some cap is set */
+static int hostco_on;               /* --coordinate, the segment is open */
+
+/* Takes a READ of bytes from the buckets of dp, of its host adapter
+ * and of the process. Returns 0 when it may be submitted, else the ns
+ * to wait for it. */
+static uint64_t
+throttle_ns(t_dev *dp, int64_t bytes)
+{
+    struct tbucket *b[8] = {&dp->tb_bytes, &dp->tb_reads, &tb_all_bytes,
+                            &tb_all_reads, NULL, NULL, NULL, NULL};
+    double n[8] = {(double)bytes, 1.0, (double)bytes, 1.0, (double)bytes,
+                   1.0, (double)bytes, 1.0};
+    uint64_t w;
+    int nb = 4, k;
+
+    if (__atomic_load_n(&dp->paused, __ATOMIC_RELAXED))
+        return CTL_PAUSE_NS; /* held as by an empty bucket */
+    if (__atomic_load_n(&dp->idle_busy, __ATOMIC_RELAXED))
+        return IDLE_HOLD_NS; /* --idle, the foreground first */
+    if ((dp->md_id >= 0) && array_ahead(dp))
+        return ARRAY_HOLD_NS; /* --array, the slowest member first */
+    if (!__atomic_load_n(&throttle_on, __ATOMIC_RELAXED))
+        return 0;
+    k = __atomic_load_n(&dp->burst_left, __ATOMIC_RELAXED);
+    while ((k > 0) &&
+           !__atomic_compare_exchange_n(&dp->burst_left, &k, k - 1, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    if (k > 0)
+        return 0; /* paid for by the take of its burst */
+    if (dp->host)
+    {
+        b[nb++] = &dp->host->tb_bytes;
+        b[nb++] = &dp->host->tb_reads;
+    }
+    if (dp->ctrl)
+    {
+        b[nb++] = &dp->ctrl->tb_bytes;
+        b[nb++] = &dp->ctrl->tb_reads;
+    }
+    if (dp->burst < 2)
+        return tb_take(b, n, nb);
+    for (k = 0; k < nb; ++k)
+        n[k] *= dp->burst;
+    w = tb_take(b, n, nb);
+    if (0 == w)
+        __atomic_fetch_add(&dp->burst_left, dp->burst - 1, __ATOMIC_RELAXED);
+    return w;
+}
+
+static void
+throttle_sleep(uint64_t ns)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    nanosleep(&ts, NULL);
+}
+
+/* --stable: the grains of blocks at lba have not all been read this
+ * pass, bit 0 of their hashes set so they are not compared. */
+static void
+stable_taint(t_dev *dp, int64_t lba, int64_t blocks)
+{
+    int64_t g = (lba - dp->start) / dp->stab_grain;
+    int64_t last = (lba + blocks - 1 - dp->start) / dp->stab_grain;
+
+    for (; (g <= last) && (g < dp->stab_n); ++g)
+        if (g >= 0)
+            __atomic_fetch_or(dp->stab_cur + g, 1, __ATOMIC_RELAXED);
+}
+
+/* Keeps blocks at lba in the device's map for --bad-map, except while
+ * tune_device() is timing reads. */
+static void
+bad_block(t_dev *dp, int kind, int64_t lba, int64_t blocks)
+{
+    if (!dp->tuning && badmap_add(&dp->bad, lba, blocks, kind))
+        pr2serr(">> heap problems, %s extent at lba=%" PRId64 " not kept\n",
+                badmap_kind_str(kind), lba);
+    if ((BADMAP_BAD == kind) && dp->stab_cur && !dp->tuning)
+        stable_taint(dp, lba, blocks);
+    if ((BADMAP_WEAK != kind) && !dp->tuning)
+        __atomic_fetch_add(&dp->fail_blocks, blocks, __ATOMIC_RELAXED);
+    if ((BADMAP_BAD == kind) && dp->rz.cell && !dp->tuning)
+        reczone_error(&dp->rz, lba, blocks, false);
+}
+
+/* A READ at lba came back with a recovered error: counted, and kept by
+ * the recording zone of lba for --rec-zones. */
+static void
+rec_error(t_dev *dp, int64_t lba)
+{
+    CTR_ADD(dp, recovered, 1);
+    if (dp->rz.cell && !dp->tuning)
+        reczone_error(&dp->rz, lba, 1, true);
+}
+
+#ifndef DSKREAD_LIB
+static void
+install_handler(int sig_num, void (*sig_handler)(int sig))
+{
+    struct sigaction sigact;
+    sigaction(sig_num, NULL, &sigact);
+    if (sigact.sa_handler != SIG_IGN)
+    {
+        sigact.sa_handler = sig_handler;
+        sigemptyset(&sigact.sa_mask);
+        sigact.sa_flags = 0;
+        sigaction(sig_num, &sigact, NULL);
+    }
+}
+#endif
+
+/* the dskread binary's, libdskread leaves the signals to its caller */
+#ifndef DSKREAD_LIB
+static void
+print_stats_sg(const t_dev *dp, const char *str)
+{
+    if (0 != dp->dd_count)
+        pr2serr("  remaining block count=%" PRId64 "\n", dp->dd_count);
+    int64_t in_full = CTR_GET(dp, in_full), in_partial = CTR_GET(dp, in_partial);
+    int64_t recovered = CTR_GET(dp, recovered);
+    int64_t unrecovered = CTR_GET(dp, unrecovered);
+    int64_t retries = CTR_GET(dp, retries);
+
+    pr2serr("%s%" PRId64 "+%" PRId64 " records in\n", str,
+            in_full - in_partial, in_partial);
+    pr2serr("%s%" PRId64 "+%d records out\n", str,
+            dp->out_full - dp->out_partial, dp->out_partial);
+    if (dp->flags.sparse)
+        pr2serr("%s%" PRId64 " bypassed records out\n", str, dp->out_sparse);
+    if (recovered > 0)
+        pr2serr("%s%" PRId64 " recovered errors\n", str, recovered);
+    if (retries > 0)
+        pr2serr("%s%" PRId64 " retries attempted\n", str, retries);
+    if (dp->flags.coe)
+    {
+        pr2serr("%s%" PRId64 " unrecovered errors\n", str, unrecovered);
+        pr2serr("%s%" PRId64 " read_longs fetched part of unrecovered read "
+                "errors\n", str, CTR_GET(dp, read_longs));
+    }
+    else if (unrecovered)
+        pr2serr("%s%" PRId64 " unrecovered error(s)\n", str, unrecovered);
+}
+
+static void
+print_stats_all(const char *str)
+{
+    int k;
+
+    for (k = 0; k < num_devs; ++k)
+    {
+        if (num_devs > 1)
+            pr2serr("%s%s:\n", str, devs[k].device_name);
+        print_stats_sg(devs + k, str);
+    }
+}
+
+static void
+interrupt_handler(int sig)
+{
+    struct sigaction sigact;
+
+    sigact.sa_handler = SIG_DFL;
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigaction(sig, &sigact, NULL);
+    pr2serr("Interrupted by signal,");
+    media_restore_all();
+    if (do_time)
+        calc_duration_throughput(0);
+    print_stats_all("");
+    kill(getpid(), sig);
+}
+
+/* --scrub: SIGINT and SIGTERM stop every device at its next READ, so
+ * that the run ends with the --checkpoint where they got to. */
+static void
+scrub_stop_handler(int sig)
+{
+    (void)sig;
+    __atomic_store_n(&run_cancel, 1, __ATOMIC_RELAXED);
+}
+
+static void
+siginfo_handler(int sig)
+{
+    if (sig)
+    {
+        ;
+    } /* unused, dummy to suppress warning */
+    pr2serr("Progress report, continuing ...\n");
+    if (do_time)
+        calc_duration_throughput(1);
+    print_stats_all("  ");
+}
+#endif
+
+static int
+dd_filetype(const char *filename)
+{
+    struct stat st;
+    size_t len = strlen(filename);
+
+    if ((1 == len) && ('.' == filename[0]))
+        return FT_DEV_NULL;
+    if (stat(filename, &st) < 0)
+        return FT_ERROR;
+    if (S_ISCHR(st.st_mode))
+    {
+        /* major() and minor() defined in sys/sysmacros.h */
+        if ((MEM_MAJOR == major(st.st_rdev)) &&
+            (DEV_NULL_MINOR_NUM == minor(st.st_rdev)))
+            return FT_DEV_NULL;
+        if (RAW_MAJOR == major(st.st_rdev))
+            return FT_RAW;
+        if (SCSI_GENERIC_MAJOR == major(st.st_rdev))
+            return FT_SG;
+        if (SCSI_TAPE_MAJOR == major(st.st_rdev))
+            return FT_ST;
+        if (sg_pt_bsg_major(verbose) == (int)major(st.st_rdev))
+            return FT_SG;
+    }
+    else if (S_ISBLK(st.st_mode))
+        return FT_BLOCK;
     else if (S_ISFIFO(st.st_mode))
         return FT_FIFO;
+    else if (S_ISREG(st.st_mode))
+        return FT_FILE;
     return FT_OTHER;
 }
 
+/* Whether a command line argument names a regular file to read, an
+ * image or a capture: a path with a / in it, so patterns are not taken
+ * for files of the working directory. */
+static bool
+file_arg(const char *arg)
+{
+    struct stat st;
+
+    return strchr(arg, '/') && (0 == stat(arg, &st)) && S_ISREG(st.st_mode);
+}
+
+/* Closes a device fd, dropping what the pass-through has cached of it
+ * first, so the next device opened on the same fd number is looked at. */
+static void
+dev_close(int fd)
+{
+    sg_pt_forget_fd(fd);
+    close(fd);
+}
+
 static char *
 dd_filetype_str(int ft, char *buff)
 {
@@ -424,6 +2334,12 @@ dd_filetype_str(int ft, char *buff)
         off += snprintf(buff + off, 32, "SCSI generic (sg) device ");
     if (FT_BLOCK & ft)
         off += snprintf(buff + off, 32, "block device ");
+    if (FT_NVME & ft)
+        off += snprintf(buff + off, 32, "NVMe namespace ");
+    if (FT_SIM & ft)
+        off += snprintf(buff + off, 32, "simulated device ");
+    if (FT_FILE & ft)
+        off += snprintf(buff + off, 32, "regular file ");
     if (FT_FIFO & ft)
         off += snprintf(buff + off, 32, "fifo (named pipe) ");
     if (FT_ST & ft)
@@ -437,6 +2353,21 @@ dd_filetype_str(int ft, char *buff)
     return buff;
 }
 
+/* A transfer buffer of dp, on the NUMA node of its adapter and in
+ * hugepages when large, from the pool of iobuf.c; given back with
+ * iobuf_free(*freep). With --pi, len of blocks also holds their
+ * metadata. */
+static uint8_t *
+io_buf(t_dev *dp, size_t len, uint8_t **freep)
+{
+    if (dp->pi_ms)
+        len += (len + dp->blk_sz - 1) / dp->blk_sz * dp->pi_ms;
+    /* spdk: DMAs from the registered hugepages, smaller ones bounce */
+    if (dp->spdk && (len < IOBUF_HUGE_MIN))
+        len = IOBUF_HUGE_MIN;
+    return (uint8_t *)iobuf_alloc(len, dp->numa_node, (void **)freep);
+}
+
 /* Return of 0 -> success, see sg_ll_read_capacity*() otherwise */
 static int
 scsi_read_capacity(int sg_fd, int64_t *num_sect, int *sect_sz)
@@ -478,9 +2409,12 @@ scsi_read_capacity(int sg_fd, int64_t *num_sect, int *sect_sz)
     return 0;
 }
 
+/* dld is the command duration limit descriptor (DLD2:0) the command
+ * carries, 0 -> none; only the 16 and 32 byte commands have room. */
 static int
 sg_build_scsi_cdb(unsigned char *cdbp, int cdb_sz, unsigned int blocks,
-                  int64_t start_block, int write_true, int fua, int dpo)
+                  int64_t start_block, int write_true, int fua, int dpo,
+                  int dld)
 {
     int rd_opcode[] = {0x8, 0x28, 0xa8, 0x88};
     int wr_opcode[] = {0xa, 0x2a, 0xaa, 0x8a};
@@ -542,148 +2476,367 @@ sg_build_scsi_cdb(unsigned char *cdbp, int cdb_sz, unsigned int blocks,
         cdbp[0] = (unsigned char)(write_true ? wr_opcode[sz_ind] : rd_opcode[sz_ind]);
         sg_put_unaligned_be64(start_block, cdbp + 2);
         sg_put_unaligned_be32(blocks, cdbp + 10);
+        cdbp[1] |= (dld >> 2) & 0x1;  /* DLD2 */
+        cdbp[14] |= (dld & 0x3) << 6; /* DLD1, DLD0 */
+        break;
+    case 32:
+        cdbp[0] = 0x7f; /* variable length */
+        cdbp[7] = 0x18;
+        sg_put_unaligned_be16(write_true ? 0xb : 0x9, cdbp + 8);
+        cdbp[10] = cdbp[1]; /* DPO and FUA */
+        cdbp[1] = 0;
+        sg_put_unaligned_be64(start_block, cdbp + 12);
+        /* expected initial logical block reference tag */
+        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 20);
+        sg_put_unaligned_be32(blocks, cdbp + 28);
+        cdbp[11] = dld & 0x7;
         break;
     default:
-        pr2serr(ME "expected cdb size of 6, 10, 12, or 16 but got %d\n",
+        pr2serr(ME "expected cdb size of 6, 10, 12, 16 or 32 but got %d\n",
+                cdb_sz);
+        return 1;
+    }
+    if (dld && (cdb_sz < 16))
+    {
+        pr2serr(ME "for %d byte commands, no duration limit descriptor\n",
                 cdb_sz);
         return 1;
     }
     return 0;
 }
 
-/* 0 -> successful, SG_LIB_SYNTAX_ERROR -> unable to build cdb,
-   SG_LIB_CAT_UNIT_ATTENTION -> try again,
-   SG_LIB_CAT_MEDIUM_HARD_WITH_INFO -> 'io_addrp' written to,
-   SG_LIB_CAT_MEDIUM_HARD -> no info field,
-   SG_LIB_CAT_NOT_READY, SG_LIB_CAT_ABORTED_COMMAND,
-   -2 -> ENOMEM
-   -1 other errors */
-static int
-sg_read_low(int sg_fd, uint8_t *buff, int blocks, int64_t from_block,
-            int bs, const struct flags_t *ifp, bool *diop,
-            uint64_t *io_addrp)
-{
-    bool info_valid;
-    int res, slen;
-    const uint8_t *sbp;
-    uint8_t rdCmd[MAX_SCSI_CDBSZ];
-    uint8_t senseBuff[SENSE_BUFF_LEN];
-    struct sg_io_hdr io_hdr;
+#define RD_CDB_PUT(cdb, lba, blocks, lba_put, lba_off, len_put, len_off) \
+    do                                                                 \
+    {                                                                  \
+        lba_put(lba, (cdb) + (lba_off));                               \
+        len_put(blocks, (cdb) + (len_off));                            \
+    } while (0)
 
-    if (sg_build_scsi_cdb(rdCmd, ifp->cdbsz, blocks, from_block, 0,
-                          ifp->fua, ifp->dpo))
+/* The READ of blocks at lba into cdb: the template of dp with only the
+ * lba and the length put in. */
+static inline void
+rd_cdb_put(const t_dev *dp, uint8_t *cdb, int blocks, int64_t lba)
+{
+    memcpy(cdb, dp->rd_cdb, MAX_SCSI_CDBSZ);
+    if (32 == dp->flags.cdbsz)
     {
-        pr2serr(ME "bad rd cdb build, from_block=%" PRId64 ", blocks=%d\n",
-                from_block, blocks);
-        return SG_LIB_SYNTAX_ERROR;
+        RD_CDB_PUT(cdb, (uint64_t)lba, (uint32_t)blocks,
+                   sg_put_unaligned_be64, 12, sg_put_unaligned_be32, 28);
+        sg_put_unaligned_be32((uint32_t)lba, cdb + 20); /* reference tag */
     }
+    else if (16 == dp->flags.cdbsz)
+        RD_CDB_PUT(cdb, (uint64_t)lba, (uint32_t)blocks,
+                   sg_put_unaligned_be64, 2, sg_put_unaligned_be32, 10);
+    else
+        RD_CDB_PUT(cdb, (uint32_t)lba, (uint16_t)blocks,
+                   sg_put_unaligned_be32, 2, sg_put_unaligned_be16, 7);
+}
 
-    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
-    io_hdr.interface_id = 'S';
-    io_hdr.cmd_len = ifp->cdbsz;
-    io_hdr.cmdp = rdCmd;
-    io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
-    io_hdr.dxfer_len = bs * blocks;
-    io_hdr.dxferp = buff;
-    io_hdr.mx_sb_len = SENSE_BUFF_LEN;
-    io_hdr.sbp = senseBuff;
-    io_hdr.timeout = DEF_TIMEOUT;
-    io_hdr.pack_id = (int)from_block;
-    if (diop && *diop)
-        io_hdr.flags |= SG_FLAG_DIRECT_IO;
+/* And the WRITE of blocks at lba. */
+static inline void
+wr_cdb_put(const t_dev *dp, uint8_t *cdb, int blocks, int64_t lba)
+{
+    memcpy(cdb, dp->wr_cdb, MAX_SCSI_CDBSZ);
+    if (16 == dp->flags.cdbsz)
+        RD_CDB_PUT(cdb, (uint64_t)lba, (uint32_t)blocks,
+                   sg_put_unaligned_be64, 2, sg_put_unaligned_be32, 10);
+    else
+        RD_CDB_PUT(cdb, (uint32_t)lba, (uint16_t)blocks,
+                   sg_put_unaligned_be32, 2, sg_put_unaligned_be16, 7);
+}
 
-    if (verbose > 2)
-        sg_print_command_len(rdCmd, ifp->cdbsz);
+/* Bytes of data a READ of blocks of dp transfers, with --pi the
+ * metadata after each block too; metadata apart is not counted. */
+static inline size_t
+xfer_len(const t_dev *dp, int blocks)
+{
+    return (size_t)blocks * (dp->blk_sz + (dp->pi_ext ? dp->pi_ms : 0));
+}
 
-    while (((res = ioctl(sg_fd, SG_IO, &io_hdr)) < 0) &&
-           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
-        ;
-    if (res < 0)
-    {
-        if (ENOMEM == errno)
-            return -2;
-        perror("reading (SG_IO) on sg device, error");
-        return -1;
-    }
-    if (verbose > 2)
-        pr2serr("      duration=%u ms\n", io_hdr.duration);
-    res = sg_err_category3(&io_hdr);
-    sbp = io_hdr.sbp;
-    slen = io_hdr.sb_len_wr;
-    switch (res)
-    {
-    case SG_LIB_CAT_CLEAN:
-    case SG_LIB_CAT_CONDITION_MET:
-        break;
-    case SG_LIB_CAT_RECOVERED:
-        ++recovered_errs;
-        info_valid = sg_get_sense_info_fld(sbp, slen, io_addrp);
-        if (info_valid)
-        {
-            pr2serr("    lba of last recovered error in this READ=0x%" PRIx64
-                    "\n",
-                    *io_addrp);
-            if (verbose > 1)
-                sg_chk_n_print3("reading", &io_hdr, true);
-        }
-        else
-        {
-            pr2serr("Recovered error: [no info] reading from block=0x%" PRIx64
-                    ", num=%d\n",
-                    from_block, blocks);
-            sg_chk_n_print3("reading", &io_hdr, verbose > 1);
+static int pi_check(t_dev *dp, uint8_t *buf, int64_t lba, int blocks);
+
+/* --dio: counts a READ that asked for direct I/O by whether the sg
+ * driver did it or fell back to copying through its own buffers. */
+static void
+dio_count(t_dev *dp, unsigned int info)
+{
+    if ((info & SG_INFO_DIRECT_IO_MASK) == SG_INFO_DIRECT_IO)
+        __atomic_fetch_add(&dp->dio_done, 1, __ATOMIC_RELAXED);
+    else
+        __atomic_fetch_add(&dp->dio_copied, 1, __ATOMIC_RELAXED);
+}
+
+/* --multipath: the path of dp the next command goes down, counted in
+ * flight until path_end(). 0 with a single path. */
+static int
+path_start(t_dev *dp)
+{
+    unsigned int rr;
+    int k, j, n, best = 0, least = INT_MAX;
+
+    if (dp->npaths < 2)
+        return 0;
+    rr = __atomic_fetch_add(&dp->path_rr, 1, __ATOMIC_RELAXED);
+    if (MPATH_RR == dp->path_pol)
+        best = rr % dp->npaths;
+    else
+        for (k = 0; k < dp->npaths; ++k)
+        {
+            j = (rr + k) % dp->npaths; /* ties go round */
+            n = __atomic_load_n(&dp->path[j].in_flight, __ATOMIC_RELAXED);
+            if (n < least)
+            {
+                least = n;
+                best = j;
+            }
+        }
+    __atomic_fetch_add(&dp->path[best].in_flight, 1, __ATOMIC_RELAXED);
+    return best;
+}
+
+static void
+path_end(t_dev *dp, int k, int64_t bytes)
+{
+    if (dp->npaths < 2)
+        return;
+    __atomic_fetch_sub(&dp->path[k].in_flight, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dp->path[k].cmds, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dp->path[k].bytes, bytes, __ATOMIC_RELAXED);
+}
+
+static int
+path_fd(const t_dev *dp, int k)
+{
+    return (dp->npaths < 2) ? dp->fd : dp->path[k].fd;
+}
+
+/* dp is no longer there: removed, or the transport lost it. Every
+ * engine stops at its next range_next(), the sg READs still queued are
+ * aborted and what fails after it is not taken for bad blocks. */
+static void
+dev_gone(t_dev *dp, const char *why)
+{
+    if (__atomic_exchange_n(&dp->gone, true, __ATOMIC_RELAXED))
+        return;
+    pr2serr("%s: %s, stopping\n", dp->device_name, why);
+}
+
+/* Whether a READ of dp ended for running past its --cdl duration
+ * limit, as sense sb says (COMMAND TIMEOUT ...); counted when it did. */
+static bool
+cdl_expired(t_dev *dp, const uint8_t *sb, int sb_len)
+{
+    struct sg_scsi_sense_hdr ssh;
+
+    if ((0 == dp->dld) || !sg_scsi_normalize_sense(sb, sb_len, &ssh) ||
+        (CDL_ASC != ssh.asc))
+        return false;
+    CTR_ADD(dp, cdl, 1);
+    return true;
+}
+
+/* Takes the duration limit descriptor out of READ cdb of cdb_sz bytes.
+ * Returns whether it had one. */
+static bool
+cdl_clear(uint8_t *cdb, int cdb_sz)
+{
+    bool had;
+
+    if (16 == cdb_sz)
+    {
+        had = (cdb[1] & 0x1) || (cdb[14] & 0xc0);
+        cdb[1] &= ~0x1;
+        cdb[14] &= ~0xc0;
+    }
+    else
+    {
+        had = (32 == cdb_sz) && (cdb[11] & 0x7);
+        if (32 == cdb_sz)
+            cdb[11] &= ~0x7;
+    }
+    return had;
+}
+
+/* Whether hp came back with the status of a LUN whose queue is full,
+   TASK SET FULL, or of one too busy for it. */
+static bool
+qfull_status(const struct sg_io_hdr *hp)
+{
+    int st = hp->status & 0x7e;
+
+    return (SAM_STAT_TASK_SET_FULL == st) || (SAM_STAT_BUSY == st);
+}
+
+/* The CDB and header are the templates of rd_template(). A READ past
+   its --cdl limit is issued again at once without it, recovering as
+   long as the drive takes, and one a full queue refused after a pause,
+   QFULL_SYNC_TRIES times, neither counted as a retry.
+   0 -> successful,
+   SG_LIB_CAT_UNIT_ATTENTION -> try again,
+   SG_LIB_CAT_MEDIUM_HARD_WITH_INFO -> 'io_addrp' written to,
+   SG_LIB_CAT_MEDIUM_HARD -> no info field,
+   SG_LIB_CAT_NOT_READY, SG_LIB_CAT_ABORTED_COMMAND,
+   -2 -> ENOMEM
+   -1 other errors */
+static int
+sg_read_low(t_dev *dp, uint8_t *buff, int blocks, int64_t from_block,
+            bool *diop, uint64_t *io_addrp)
+{
+    int path = path_start(dp);
+    int sg_fd = path_fd(dp, path);
+    const struct flags_t *ifp = &dp->flags;
+    int res, full = 0;
+    uint8_t rdCmd[MAX_SCSI_CDBSZ];
+    uint8_t senseBuff[SENSE_BUFF_LEN];
+    struct sg_io_hdr io_hdr;
+    struct sg_sense_dec sd;
+
+    rd_cdb_put(dp, rdCmd, blocks, from_block);
+    io_hdr = dp->rd_hdr;
+    io_hdr.cmdp = rdCmd;
+    io_hdr.dxfer_len = xfer_len(dp, blocks);
+    io_hdr.dxferp = buff;
+    io_hdr.sbp = senseBuff;
+    io_hdr.pack_id = (int)from_block;
+    /* mmap-ed IO always lands at the start of the reserved buffer, so
+     * only a transfer into exactly that address can use it */
+    if (dp->mmap_buf && (buff == dp->mmap_buf))
+    {
+        io_hdr.dxferp = NULL;
+        io_hdr.flags |= SG_FLAG_MMAP_IO;
+    }
+    else if (diop && *diop)
+        io_hdr.flags |= SG_FLAG_DIRECT_IO;
+
+    if (verbose > 2)
+        sg_print_command_len(rdCmd, ifp->cdbsz);
+
+submit:
+    PROBE3(submit, dp->device_name, from_block, blocks);
+    while (((res = (dp->sim ? sim_io(dp->sim, &io_hdr)
+                            : ioctl(sg_fd, SG_IO, &io_hdr))) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)) &&
+           !__atomic_load_n(&dp->gone, __ATOMIC_RELAXED))
+        ;
+    path_end(dp, path, (res < 0) ? 0 : io_hdr.dxfer_len - io_hdr.resid);
+    if (res < 0)
+    {
+        if (ENOMEM == errno)
+            return -2;
+        if ((ENODEV == errno) || (ENXIO == errno))
+            dev_gone(dp, "device removed");
+        else if (!dp->gone)
+            perror("reading (SG_IO) on sg device, error");
+        return -1;
+    }
+    if (SG_LIB_DID_NO_CONNECT == io_hdr.host_status)
+    {
+        dev_gone(dp, "no connection to the device");
+        return -1;
+    }
+    if (qfull_status(&io_hdr) && (++full < QFULL_SYNC_TRIES))
+    {
+        CTR_ADD(dp, qfull, 1);
+        throttle_sleep(QFULL_SYNC_MS * 1000000ULL);
+        path = path_start(dp);
+        sg_fd = path_fd(dp, path);
+        goto submit;
+    }
+    if (verbose > 2)
+        pr2serr("      duration=%u ms\n", io_hdr.duration);
+    /* the sense is parsed once, here, for all that is looked up in it */
+    res = sg_err_category3_dec(&io_hdr, &sd);
+    if ((SG_LIB_CAT_CLEAN != res) && (SG_LIB_CAT_CONDITION_MET != res))
+        PROBE4(error, dp->device_name, from_block, blocks, res);
+    switch (res)
+    {
+    case SG_LIB_CAT_CLEAN:
+    case SG_LIB_CAT_CONDITION_MET:
+        break;
+    case SG_LIB_CAT_RECOVERED:
+        rec_error(dp, sd.info_valid ? (int64_t)sd.info : from_block);
+        *io_addrp = sd.info;
+        if (dp->rec_track && sd.info_valid)
+        {
+            int k = __atomic_fetch_add(&dp->rec_n, 1, __ATOMIC_RELAXED);
+
+            if (k < DEFECT_REC_LBAS)
+                dp->rec_lba[k] = sd.info;
+        }
+        if (sd.info_valid)
+        {
+            errlog_put(res, "    lba of last recovered error in this READ=0x%"
+                       PRIx64 "\n", *io_addrp, 0,
+                       (verbose > 1) ? "reading" : NULL, &io_hdr, true);
+        }
+        else
+        {
+            errlog_put(res, "Recovered error: [no info] reading from block=0x%"
+                       PRIx64 ", num=%" PRId64 "\n", from_block, blocks,
+                       "reading", &io_hdr, verbose > 1);
         }
         break;
     case SG_LIB_CAT_ABORTED_COMMAND:
+        if (cdl_expired(dp, senseBuff, io_hdr.sb_len_wr) &&
+            cdl_clear(rdCmd, ifp->cdbsz))
+        {
+            if (verbose > 1)
+                pr2serr("%s: READ at lba=%" PRId64 " past its duration "
+                        "limit, again without one\n", dp->device_name,
+                        from_block);
+            path = path_start(dp);
+            sg_fd = path_fd(dp, path);
+            goto submit;
+        }
+#if defined(__GNUC__)
+#if (__GNUC__ >= 7)
+        __attribute__((fallthrough));
+        /* FALL THROUGH */
+#endif
+#endif
     case SG_LIB_CAT_UNIT_ATTENTION:
-        sg_chk_n_print3("reading", &io_hdr, verbose > 1);
+        errlog_put(res, NULL, 0, 0, "reading", &io_hdr, verbose > 1);
         return res;
     case SG_LIB_CAT_MEDIUM_HARD:
         if (verbose > 1)
-            sg_chk_n_print3("reading", &io_hdr, verbose > 1);
-        ++unrecovered_errs;
-        info_valid = sg_get_sense_info_fld(sbp, slen, io_addrp);
+            errlog_put(res, NULL, 0, 0, "reading", &io_hdr, true);
+        CTR_ADD(dp, unrecovered, 1);
+        *io_addrp = sd.info;
         /* MMC devices don't necessarily set VALID bit */
-        if (info_valid || ((5 == ifp->pdt) && (*io_addrp > 0)))
+        if (sd.info_valid || ((5 == ifp->pdt) && (*io_addrp > 0)))
             return SG_LIB_CAT_MEDIUM_HARD_WITH_INFO;
         else
         {
-            pr2serr("Medium, hardware or blank check error but no lba of "
-                    "failure in sense\n");
+            errlog_put(res, "Medium, hardware or blank check error but no lba "
+                       "of failure in sense\n", 0, 0, NULL, NULL, false);
             return res;
         }
         break;
     case SG_LIB_CAT_NOT_READY:
-        ++unrecovered_errs;
+        CTR_ADD(dp, unrecovered, 1);
         if (verbose > 0)
-            sg_chk_n_print3("reading", &io_hdr, verbose > 1);
+            errlog_put(res, NULL, 0, 0, "reading", &io_hdr, verbose > 1);
         return res;
     case SG_LIB_CAT_ILLEGAL_REQ:
         if (5 == ifp->pdt)
         { /* MMC READs can go down this path */
-            bool ili;
-            struct sg_scsi_sense_hdr ssh;
-
             if (verbose > 1)
-                sg_chk_n_print3("reading", &io_hdr, verbose > 1);
-            if (sg_scsi_normalize_sense(sbp, slen, &ssh) &&
-                (0x64 == ssh.asc) && (0x0 == ssh.ascq))
+                errlog_put(res, NULL, 0, 0, "reading", &io_hdr, true);
+            if (sd.valid && (0x64 == sd.ssh.asc) && (0x0 == sd.ssh.ascq))
             {
-                if (sg_get_sense_filemark_eom_ili(sbp, slen, NULL, NULL,
-                                                  &ili) &&
-                    ili)
+                if (sd.fm_eom_ili && sd.ili)
                 {
-                    sg_get_sense_info_fld(sbp, slen, io_addrp);
+                    *io_addrp = sd.info;
                     if (*io_addrp > 0)
                     {
-                        ++unrecovered_errs;
+                        CTR_ADD(dp, unrecovered, 1);
                         return SG_LIB_CAT_MEDIUM_HARD_WITH_INFO;
                     }
                     else
                         pr2serr("MMC READ gave 'illegal mode for this track' "
                                 "and ILI but no LBA of failure\n");
                 }
-                ++unrecovered_errs;
+                CTR_ADD(dp, unrecovered, 1);
                 return SG_LIB_CAT_MEDIUM_HARD;
             }
         }
@@ -694,1077 +2847,19596 @@ sg_read_low(int sg_fd, uint8_t *buff, int blocks, int64_t from_block,
 #endif
 #endif
     default:
-        ++unrecovered_errs;
+        CTR_ADD(dp, unrecovered, 1);
         if (verbose > 0)
-            sg_chk_n_print3("reading", &io_hdr, verbose > 1);
+            errlog_put(res, NULL, 0, 0, "reading", &io_hdr, verbose > 1);
         return res;
     }
+    if (SG_FLAG_DIRECT_IO & io_hdr.flags)
+        dio_count(dp, io_hdr.info);
     if (diop && *diop &&
         ((io_hdr.info & SG_INFO_DIRECT_IO_MASK) != SG_INFO_DIRECT_IO))
         *diop = false; /* flag that dio not done (completely) */
     // sum_of_resids += io_hdr.resid;
+    if (dp->pi_type)
+        pi_check(dp, buff, from_block, blocks);
     return 0;
 }
 
-/* 0 -> successful, SG_LIB_SYNTAX_ERROR -> unable to build cdb,
-   SG_LIB_CAT_UNIT_ATTENTION -> try again, SG_LIB_CAT_NOT_READY,
-   SG_LIB_CAT_MEDIUM_HARD, SG_LIB_CAT_ABORTED_COMMAND,
-   -2 -> ENOMEM, -1 other errors */
+/* READ LONG of lba, len bytes into buf on fd: the 10 byte cdb while
+ * 32 bits address it, else the 16 byte one. Returns as
+ * sg_ll_read_long10() does. */
 static int
-sg_read(int sg_fd, uint8_t *buff, int blocks, int64_t from_block,
-        int bs, struct flags_t *ifp, bool *diop, int *blks_readp)
+read_long_cmd(int fd, bool corrct, int64_t lba, uint8_t *buf, int len,
+              int *offsetp)
 {
-    bool may_coe = false;
-    bool repeat;
-    int res, blks, xferred;
-    int ret = 0;
-    int retries_tmp;
-    uint64_t io_addr;
-    int64_t lba;
-    uint8_t *bp;
+    if (lba < UINT_MAX)
+        return sg_ll_read_long10(fd, false, corrct, (unsigned int)lba, buf,
+                                 len, offsetp, true, verbose);
+    return sg_ll_read_long16(fd, false, corrct, (uint64_t)lba, buf, len,
+                             offsetp, true, verbose);
+}
+
+/* READ LONG of the bad block lba into bp on fd, buf a scratch of two
+ * blocks; zeros when the drive does not return it. A length the drive
+ * refuses is corrected by what it says, and kept for the device.
+ * Under rl_mutex. Returns true when bp has the block. */
+static bool
+read_long_one(t_dev *dp, int fd, int64_t lba, uint8_t *buf, uint8_t *bp)
+{
+    int bs = dp->blk_sz;
+    bool corrct = (dp->flags.coe > 2), ok = false;
+    int offset = 0, nl, res;
 
-    retries_tmp = ifp->retries;
-    for (xferred = 0, blks = blocks, lba = from_block, bp = buff;
-         blks > 0; blks = blocks - xferred)
+    res = read_long_cmd(fd, corrct, lba, buf, bs + dp->read_long_blk_inc,
+                        &offset);
+    switch (res)
     {
-        io_addr = 0;
-        repeat = false;
-        may_coe = false;
-        res = sg_read_low(sg_fd, bp, blks, lba, bs, ifp, diop, &io_addr);
-        switch (res)
+    case 0:
+        ok = true;
+        break;
+    case SG_LIB_CAT_ILLEGAL_REQ_WITH_INFO:
+        nl = bs + dp->read_long_blk_inc - offset;
+        if ((nl < 32) || (nl > (bs * 2)))
         {
-        case 0:
-            if (blks_readp)
-                *blks_readp = xferred + blks;
-            // if (coe_limit > 0)
-            //     coe_count = 0;  /* good read clears coe_count */
-            return 0;
-        case -2: /* ENOMEM */
-            return res;
-        case SG_LIB_CAT_NOT_READY:
-            pr2serr("Device (r) not ready\n");
-            return res;
-        case SG_LIB_CAT_ABORTED_COMMAND:
-            if (--max_aborted > 0)
-            {
-                pr2serr("Aborted command, continuing (r)\n");
-                repeat = true;
-            }
-            else
-            {
-                pr2serr("Aborted command, too many (r)\n");
-                return res;
-            }
+            pr2serr(">> read_long len=%d unexpected\n", nl);
             break;
-        case SG_LIB_CAT_UNIT_ATTENTION:
-            if (--max_uas > 0)
-            {
-                pr2serr("Unit attention, continuing (r)\n");
-                repeat = true;
-            }
-            else
-            {
-                pr2serr("Unit attention, too many (r)\n");
-                return res;
-            }
-            break;
-        case SG_LIB_CAT_MEDIUM_HARD_WITH_INFO:
-            if (retries_tmp > 0)
-            {
-                pr2serr(">>> retrying a sgio read, lba=0x%" PRIx64 "\n",
-                        (uint64_t)lba);
-                --retries_tmp;
-                ++num_retries;
-                if (unrecovered_errs > 0)
-                    --unrecovered_errs;
-                repeat = true;
-            }
-            ret = SG_LIB_CAT_MEDIUM_HARD;
-            break; /* unrecovered read error at lba=io_addr */
-        case SG_LIB_SYNTAX_ERROR:
-            ifp->coe = 0;
-            ret = res;
-            goto err_out;
-        case -1:
-            ret = res;
-            goto err_out;
-        case SG_LIB_CAT_MEDIUM_HARD:
-            may_coe = true;
-#if defined(__GNUC__)
-#if (__GNUC__ >= 7)
-            __attribute__((fallthrough));
-            /* FALL THROUGH */
-#endif
-#endif
-        default:
-            if (retries_tmp > 0)
-            {
-                pr2serr(">>> retrying a sgio read, lba=0x%" PRIx64 "\n",
-                        (uint64_t)lba);
-                --retries_tmp;
-                ++num_retries;
-                if (unrecovered_errs > 0)
-                    --unrecovered_errs;
-                repeat = true;
-                break;
-            }
-            ret = res;
-            goto err_out;
-        }
-        if (repeat)
-            continue;
-        if ((io_addr < (uint64_t)lba) ||
-            (io_addr >= (uint64_t)(lba + blks)))
-        {
-            pr2serr("  Unrecovered error lba 0x%" PRIx64 " not in "
-                    "correct range:\n\t[0x%" PRIx64 ",0x%" PRIx64 "]\n",
-                    io_addr, (uint64_t)lba,
-                    (uint64_t)(lba + blks - 1));
-            may_coe = true;
-            goto err_out;
-        }
-        blks = (int)(io_addr - (uint64_t)lba);
-        if (blks > 0)
-        {
-            if (verbose)
-                pr2serr("  partial read of %d blocks prior to medium error\n",
-                        blks);
-            res = sg_read_low(sg_fd, bp, blks, lba, bs, ifp, diop, &io_addr);
-            switch (res)
-            {
-            case 0:
-                break;
-            case -1:
-                ifp->coe = 0;
-                ret = res;
-                goto err_out;
-            case -2:
-                pr2serr("ENOMEM again, unexpected (r)\n");
-                return -1;
-            case SG_LIB_CAT_NOT_READY:
-                pr2serr("device (r) not ready\n");
-                return res;
-            case SG_LIB_CAT_UNIT_ATTENTION:
-                pr2serr("Unit attention, unexpected (r)\n");
-                return res;
-            case SG_LIB_CAT_ABORTED_COMMAND:
-                pr2serr("Aborted command, unexpected (r)\n");
-                return res;
-            case SG_LIB_CAT_MEDIUM_HARD_WITH_INFO:
-            case SG_LIB_CAT_MEDIUM_HARD:
-                ret = SG_LIB_CAT_MEDIUM_HARD;
-                goto err_out;
-            case SG_LIB_SYNTAX_ERROR:
-            default:
-                pr2serr(">> unexpected result=%d from sg_read_low() 2\n",
-                        res);
-                ret = res;
-                goto err_out;
-            }
-        }
-        xferred += blks;
-        if (0 == ifp->coe)
-        {
-            /* give up at block before problem unless 'coe' */
-            if (blks_readp)
-                *blks_readp = xferred;
-            return ret;
-        }
-        if (bs < 32)
-        {
-            pr2serr(">> bs=%d too small for read_long\n", bs);
-            return -1; /* nah, block size can't be that small */
-        }
-        bp += (blks * bs);
-        lba += blks;
-        if ((0 != ifp->pdt) || (ifp->coe < 2))
-        {
-            pr2serr(">> unrecovered read error at blk=%" PRId64 ", pdt=%d, "
-                    "use zeros\n",
-                    lba, ifp->pdt);
-            memset(bp, 0, bs);
-        }
-        else if (io_addr < UINT_MAX)
-        {
-            bool corrct, ok;
-            int offset, nl, r;
-            uint8_t *buffp;
-            uint8_t *free_buffp;
-
-            buffp = sg_memalign(bs * 2, 0, &free_buffp, false);
-            if (NULL == buffp)
-            {
-                pr2serr(">> heap problems\n");
-                return -1;
-            }
-            corrct = (ifp->coe > 2);
-            res = sg_ll_read_long10(sg_fd, /* pblock */ false, corrct, lba,
-                                    buffp, bs + read_long_blk_inc, &offset,
-                                    true, verbose);
-            ok = false;
-            switch (res)
-            {
-            case 0:
-                ok = true;
-                ++read_longs;
-                break;
-            case SG_LIB_CAT_ILLEGAL_REQ_WITH_INFO:
-                nl = bs + read_long_blk_inc - offset;
-                if ((nl < 32) || (nl > (bs * 2)))
-                {
-                    pr2serr(">> read_long(10) len=%d unexpected\n", nl);
-                    break;
-                }
-                /* remember for next read_long attempt, if required */
-                read_long_blk_inc = nl - bs;
-
-                if (verbose)
-                    pr2serr("read_long(10): adjusted len=%d\n", nl);
-                r = sg_ll_read_long10(sg_fd, false, corrct, lba, buffp, nl,
-                                      &offset, true, verbose);
-                if (0 == r)
-                {
-                    ok = true;
-                    ++read_longs;
-                    break;
-                }
-                else
-                    pr2serr(">> unexpected result=%d on second "
-                            "read_long(10)\n",
-                            r);
-                break;
-            case SG_LIB_CAT_INVALID_OP:
-                pr2serr(">> read_long(10); not supported\n");
-                break;
-            case SG_LIB_CAT_ILLEGAL_REQ:
-                pr2serr(">> read_long(10): bad cdb field\n");
-                break;
-            case SG_LIB_CAT_NOT_READY:
-                pr2serr(">> read_long(10): device not ready\n");
-                break;
-            case SG_LIB_CAT_UNIT_ATTENTION:
-                pr2serr(">> read_long(10): unit attention\n");
-                break;
-            case SG_LIB_CAT_ABORTED_COMMAND:
-                pr2serr(">> read_long(10): aborted command\n");
-                break;
-            default:
-                pr2serr(">> read_long(10): problem (%d)\n", res);
-                break;
-            }
-            if (ok)
-                memcpy(bp, buffp, bs);
-            else
-                memset(bp, 0, bs);
-            free(free_buffp);
         }
+        /* remember for next read_long attempt, if required */
+        dp->read_long_blk_inc = nl - bs;
+        if (verbose)
+            pr2serr("read_long: adjusted len=%d\n", nl);
+        res = read_long_cmd(fd, corrct, lba, buf, nl, &offset);
+        if (0 == res)
+            ok = true;
         else
-        {
-            pr2serr(">> read_long(10) cannot handle blk=%" PRId64 ", use "
-                    "zeros\n",
-                    lba);
-            memset(bp, 0, bs);
-        }
-        ++xferred;
-        bp += bs;
-        ++lba;
+            pr2serr(">> unexpected result=%d on second read_long\n", res);
+        break;
+    case SG_LIB_CAT_INVALID_OP:
+        pr2serr(">> read_long; not supported\n");
+        break;
+    case SG_LIB_CAT_ILLEGAL_REQ:
+        pr2serr(">> read_long: bad cdb field\n");
+        break;
+    case SG_LIB_CAT_NOT_READY:
+        pr2serr(">> read_long: device not ready\n");
+        break;
+    case SG_LIB_CAT_UNIT_ATTENTION:
+        pr2serr(">> read_long: unit attention\n");
+        break;
+    case SG_LIB_CAT_ABORTED_COMMAND:
+        pr2serr(">> read_long: aborted command\n");
+        break;
+    default:
+        pr2serr(">> read_long: problem (%d)\n", res);
+        break;
     }
-    if (blks_readp)
-        *blks_readp = xferred;
-    return 0;
-
-err_out:
-    if (ifp->coe)
+    if (ok)
     {
-        memset(bp, 0, bs * blks);
-        pr2serr(">> unable to read at blk=%" PRId64 " for %d bytes, use "
-                "zeros\n",
-                lba, bs * blks);
-        if (blks > 1)
-            pr2serr(">>   try reducing bpt to limit number of zeros written "
-                    "near bad block(s)\n");
-        /* fudge success */
-        if (blks_readp)
-            *blks_readp = xferred + blks;
-        return may_coe ? 0 : ret;
+        dp->read_long_ok = true;
+        CTR_ADD(dp, read_longs, 1);
+        memcpy(bp, buf, bs);
     }
     else
-        return ret;
+        memset(bp, 0, bs);
+    return ok;
 }
 
-/* 0 -> successful, SG_LIB_SYNTAX_ERROR -> unable to build cdb,
-   SG_LIB_CAT_NOT_READY, SG_LIB_CAT_UNIT_ATTENTION, SG_LIB_CAT_MEDIUM_HARD,
-   SG_LIB_CAT_ABORTED_COMMAND, -2 -> recoverable (ENOMEM),
-   -1 -> unrecoverable error + others */
-/*static int
-sg_write(int sg_fd, unsigned char * buff, int blocks, int64_t to_block,
-         int bs, const struct flags_t * ofp, int * diop)
+/* Queues a READ LONG of lba, its length known, on dp->rl_fd as slot k
+ * of the batch. Returns 0, -1 when write() refused it. */
+static int
+read_long_start(t_dev *dp, struct sg_io_hdr *hp, uint8_t *cdb, uint8_t *sbp,
+                int64_t lba, uint8_t *buf, int k)
 {
-    unsigned char wrCmd[MAX_SCSI_CDBSZ];
-    unsigned char senseBuff[SENSE_BUFF_LEN];
-    struct sg_io_hdr io_hdr;
-    int res, k, info_valid;
-    uint64_t io_addr = 0;
-    if (sg_build_scsi_cdb(wrCmd, ofp->cdbsz, blocks, to_block, 1, ofp->fua,
-                          ofp->dpo)) {
-        pr2serr(ME "bad wr cdb build, to_block=%" PRId64 ", blocks=%d\n",
-                to_block, blocks);
-        return SG_LIB_SYNTAX_ERROR;
+    int len = dp->blk_sz + dp->read_long_blk_inc;
+    int res;
+
+    memset(cdb, 0, 16);
+    if (lba < UINT_MAX)
+    {
+        cdb[0] = 0x3e; /* READ LONG(10) */
+        cdb[1] = (dp->flags.coe > 2) ? 0x2 : 0;
+        sg_put_unaligned_be32((uint32_t)lba, cdb + 2);
+        sg_put_unaligned_be16((uint16_t)len, cdb + 7);
     }
-    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
-    io_hdr.interface_id = 'S';
-    io_hdr.cmd_len = ofp->cdbsz;
-    io_hdr.cmdp = wrCmd;
-    io_hdr.dxfer_direction = SG_DXFER_TO_DEV;
-    io_hdr.dxfer_len = bs * blocks;
-    io_hdr.dxferp = buff;
-    io_hdr.mx_sb_len = SENSE_BUFF_LEN;
-    io_hdr.sbp = senseBuff;
-    io_hdr.timeout = DEF_TIMEOUT;
-    io_hdr.pack_id = (int)to_block;
-    if (diop && *diop)
-        io_hdr.flags |= SG_FLAG_DIRECT_IO;
-
-    if (verbose > 2) {
-        pr2serr("    write cdb: ");
-        for (k = 0; k < ofp->cdbsz; ++k)
-            pr2serr("%02x ", wrCmd[k]);
-        pr2serr("\n");
-    }
-    while (((res = ioctl(sg_fd, SG_IO, &io_hdr)) < 0) &&
-           ((EINTR == errno) || (EAGAIN == errno)))
-        ;
-    if (res < 0) {
-        if (ENOMEM == errno)
-            return -2;
-        perror("writing (SG_IO) on sg device, error");
-        return -1;
+    else
+    {
+        cdb[0] = 0x9e; /* SERVICE ACTION IN(16), READ LONG(16) */
+        cdb[1] = 0x11;
+        sg_put_unaligned_be64((uint64_t)lba, cdb + 2);
+        sg_put_unaligned_be16((uint16_t)len, cdb + 12);
+        cdb[14] = (dp->flags.coe > 2) ? 0x1 : 0;
     }
-
+    memset(hp, 0, sizeof(*hp));
+    hp->interface_id = 'S';
+    hp->cmd_len = (lba < UINT_MAX) ? 10 : 16;
+    hp->cmdp = cdb;
+    hp->dxfer_direction = SG_DXFER_FROM_DEV;
+    hp->dxfer_len = len;
+    hp->dxferp = buf;
+    hp->mx_sb_len = SENSE_BUFF_LEN;
+    hp->sbp = sbp;
+    hp->timeout = DEF_TIMEOUT;
+    hp->pack_id = k;
     if (verbose > 2)
-        pr2serr("      duration=%u ms\n", io_hdr.duration);
-    res = sg_err_category3(&io_hdr);
-    switch (res) {
-    case SG_LIB_CAT_CLEAN:
-        break;
-    case SG_LIB_CAT_RECOVERED:
-        ++recovered_errs;
-        info_valid = sg_get_sense_info_fld(io_hdr.sbp, io_hdr.sb_len_wr,
-                                           &io_addr);
-        if (info_valid) {
-            pr2serr("    lba of last recovered error in this WRITE=0x%" PRIx64
-                    "\n", io_addr);
-            if (verbose > 1)
-                sg_chk_n_print3("writing", &io_hdr, 1);
-        } else {
-            pr2serr("Recovered error: [no info] writing to block=0x%" PRIx64
-                    ", num=%d\n", to_block, blocks);
-            sg_chk_n_print3("writing", &io_hdr, verbose > 1);
-        }
-        break;
-    case SG_LIB_CAT_ABORTED_COMMAND:
-    case SG_LIB_CAT_UNIT_ATTENTION:
-        sg_chk_n_print3("writing", &io_hdr, verbose > 1);
-        return res;
-    case SG_LIB_CAT_NOT_READY:
-        ++unrecovered_errs;
-        pr2serr("device not ready (w)\n");
-        return res;
-    case SG_LIB_CAT_MEDIUM_HARD:
-    default:
-        sg_chk_n_print3("writing", &io_hdr, verbose > 1);
-        ++unrecovered_errs;
-        if (ofp->coe) {
-            pr2serr(">> ignored errors for out blk=%" PRId64 " for %d "
-                    "bytes\n", to_block, bs * blocks);
-            return 0; // fudge success 
-        } else
-            return res;
-    }
-    if (diop && *diop &&
-        ((io_hdr.info & SG_INFO_DIRECT_IO_MASK) != SG_INFO_DIRECT_IO))
-        *diop = 0;      // flag that dio not done (completely) 
-    return 0;
+        sg_print_command_len(cdb, hp->cmd_len);
+    while (((res = write(dp->rl_fd, hp, sizeof(*hp))) < 0) && (EINTR == errno))
+        ;
+    return (res < 0) ? -1 : 0;
 }
-*/
 
+/* coe 2 and 3: the READ LONGs of the n bad blocks lbas into bps. Once
+ * the drive has taken a length they go queued on an fd of their own,
+ * apart from the READs of the engine, all in flight at once, into
+ * buffers of a pool kept for the device. The first of a device, and
+ * any that do not come back clean, are sent one by one. */
 static void
-calc_duration_throughput(int contin)
+read_long_batch(t_dev *dp, const int64_t *lbas, uint8_t *const *bps, int n)
 {
-    struct timeval end_tm, res_tm;
-    double a, b;
-    int64_t blks;
+    struct sg_io_hdr hdr[READ_LONG_BATCH], io_hdr;
+    uint8_t cdb[READ_LONG_BATCH][16], sb[READ_LONG_BATCH][SENSE_BUFF_LEN];
+    bool queued[READ_LONG_BATCH], done[READ_LONG_BATCH];
+    int bs = dp->blk_sz, k, j, q = 0, flags, res;
 
-    if (start_tm_valid && (start_tm.tv_sec || start_tm.tv_usec))
+    if (n <= 0)
+        return;
+    pthread_mutex_lock(&dp->rl_mutex);
+    if (NULL == dp->rl_pool)
+        dp->rl_pool = io_buf(dp, READ_LONG_BATCH * 2 * bs, &dp->rl_pool_free);
+    if (NULL == dp->rl_pool)
     {
-        blks = (in_full > out_full) ? in_full : out_full;
-        gettimeofday(&end_tm, NULL);
-        res_tm.tv_sec = end_tm.tv_sec - start_tm.tv_sec;
-        res_tm.tv_usec = end_tm.tv_usec - start_tm.tv_usec;
-        if (res_tm.tv_usec < 0)
-        {
-            --res_tm.tv_sec;
-            res_tm.tv_usec += 1000000;
-        }
-        a = res_tm.tv_sec;
-        a += (0.000001 * res_tm.tv_usec);
-        b = (double)blk_sz * blks;
-        pr2serr("time to transfer data%s: %d.%06d secs",
-                (contin ? " so far" : ""), (int)res_tm.tv_sec,
-                (int)res_tm.tv_usec);
-        if ((a > 0.00001) && (b > 511))
-            pr2serr(" at %.2f MB/sec\n", b / (a * 1000000.0));
-        else
-            pr2serr("\n");
+        pr2serr(">> heap problems\n");
+        for (k = 0; k < n; ++k)
+            memset(bps[k], 0, bs);
+        pthread_mutex_unlock(&dp->rl_mutex);
+        return;
     }
-}
-
-/* Returns open output file descriptor (>= 0), -1 for don't
- * bother opening (e.g. /dev/null), or a more negative value
- * (-SG_LIB_FILE_ERROR or -SG_LIB_CAT_OTHER) if error.
- */
-static int
-open_of(const char *outf, int64_t seek, int bpt, struct flags_t *ofp,
-        int *out_typep, int verbose)
-{
-    int outfd, flags, t, verb, res;
-    char ebuff[EBUFF_SZ];
-    struct sg_simple_inquiry_resp sir;
-
-    verb = (verbose ? verbose - 1 : 0);
-    *out_typep = dd_filetype(outf);
-    if (verbose)
-        pr2serr(" >> Output file type: %s\n",
-                dd_filetype_str(*out_typep, ebuff));
-
-    if ((FT_BLOCK & *out_typep) && ofp->sgio)
-        *out_typep |= FT_SG;
-
-    if (FT_SG & *out_typep)
+    if ((dp->rl_fd < 0) && ((flags = fcntl(dp->fd, F_GETFL)) >= 0))
+        dp->rl_fd = open(dp->device_name, flags & (O_ACCMODE | O_DIRECT));
+    for (k = 0; k < n; ++k)
     {
-        flags = O_RDONLY | O_NONBLOCK;
-        //        if (ofp->direct)
-        //            flags |= O_DIRECT;
-        //        if (ofp->excl)
-        //            flags |= O_EXCL;
-        //        if (ofp->dsync)
-        //            flags |= O_SYNC;
-        if ((outfd = open(outf, flags)) < 0)
-        {
-            snprintf(ebuff, EBUFF_SZ,
-                     ME "could not open %s for sg reading", outf);
-            perror(ebuff);
-            goto file_err;
-        }
-        if (verbose)
-            pr2serr("        open output(sg_io), flags=0x%x\n", flags);
-        if (sg_simple_inquiry(outfd, &sir, 0, verb))
-        {
-            pr2serr("INQUIRY failed on %s\n", outf);
-            goto other_err;
-        }
-        ofp->pdt = sir.peripheral_type;
-        if (verbose)
-            pr2serr("    %s: %.8s  %.16s  %.4s  [pdt=%d]\n", outf, sir.vendor,
-                    sir.product, sir.revision, ofp->pdt);
-        if (!(FT_BLOCK & *out_typep))
-        {
-            t = blk_sz * bpt;
-            res = ioctl(outfd, SG_SET_RESERVED_SIZE, &t);
-            if (res < 0)
-                perror(ME "SG_SET_RESERVED_SIZE error");
-            res = ioctl(outfd, SG_GET_VERSION_NUM, &t);
-            if ((res < 0) || (t < 30000))
-            {
-                pr2serr(ME "sg driver prior to 3.x.y\n");
-                goto file_err;
-            }
-        }
+        done[k] = false;
+        queued[k] = dp->read_long_ok && (dp->rl_fd >= 0) &&
+                    (0 == read_long_start(dp, hdr + k, cdb[k], sb[k], lbas[k],
+                                          dp->rl_pool + k * 2 * bs, k));
+        q += queued[k];
     }
-    else
-        outfd = -1;
-    if (ofp->flock)
+    for (; q > 0; --q)
     {
-        res = flock(outfd, LOCK_EX | LOCK_NB);
-        if (res < 0)
+        memset(&io_hdr, 0, sizeof(io_hdr));
+        io_hdr.interface_id = 'S';
+        io_hdr.pack_id = -1; /* whichever is done first */
+        while (((res = read(dp->rl_fd, &io_hdr, sizeof(io_hdr))) < 0) &&
+               (EINTR == errno))
+            ;
+        j = io_hdr.pack_id;
+        if ((res < 0) || (j < 0) || (j >= n) || !queued[j])
         {
-            close(outfd);
-            snprintf(ebuff, EBUFF_SZ, ME "flock(LOCK_EX | LOCK_NB) on %s "
-                                         "failed",
-                     outf);
-            perror(ebuff);
-            return -SG_LIB_FLOCK_ERR;
+            /* lost track: what is left goes one by one on a new fd */
+            dev_close(dp->rl_fd);
+            dp->rl_fd = -1;
+            break;
+        }
+        queued[j] = false;
+        res = sg_err_category3(&io_hdr);
+        if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res))
+        {
+            CTR_ADD(dp, read_longs, 1);
+            memcpy(bps[j], dp->rl_pool + j * 2 * bs, bs);
+            done[j] = true;
         }
     }
-    return outfd;
-
-file_err:
-    return -SG_LIB_FILE_ERROR;
-other_err:
-    return -SG_LIB_CAT_OTHER;
+    for (k = 0; k < n; ++k)
+        if (!done[k])
+            read_long_one(dp, (dp->rl_fd >= 0) ? dp->rl_fd : dp->fd, lbas[k],
+                          dp->rl_pool + k * 2 * bs, bps[k]);
+    pthread_mutex_unlock(&dp->rl_mutex);
 }
 
-typedef enum
+/* The READ LONG fd and pool of dp. */
+static void
+read_long_close(t_dev *dp)
 {
-    WIPEMODE_NORMAL,
-    WIPEMODE_JEFFERY
-} WipeMode;
+    if (dp->rl_fd >= 0)
+        dev_close(dp->rl_fd);
+    dp->rl_fd = -1;
+    iobuf_free(dp->rl_pool_free);
+    dp->rl_pool = dp->rl_pool_free = NULL;
+    dp->read_long_ok = false;
+}
 
-struct _opt
+/* The lifecycle of one sg_read() as a state machine, so that what issues
+ * its READs need not wait on each: the READ to issue next is bp, blks
+ * and lba while state is not RD_DONE, rd_done() takes its result and
+ * moves on (retry, the blocks before the medium error, the skip over
+ * the bad one, coe) to the next READ or to the end. sg_read() drives one
+ * with sg_read_low(); an engine keeps one with each request in recovery
+ * and calls rd_done() as completions come. The READ LONGs and
+ * isolate_split() of a failed range are still issued from inside a
+ * step, synchronously. */
+enum rd_state
 {
-    unsigned int passes;
-    WipeMode mode;
-    bool yes;
-    unsigned int sectors;
-    int64_t start;
-    int64_t end;
-    bool read;
-    unsigned int help;
-    bool kilobyte;
-    unsigned int refresh;
-    bool ignore;
-    bool checksum;
-    int nretries;
-};
-
-typedef struct _opt t_opt;
-
-static t_opt opt = {
-    0,                       /* passes */
-    WIPEMODE_NORMAL,         /* normal, dod, dod7, gutmann */
-    false,                   /* yes */
-    DEF_BLOCKS_PER_TRANSFER, /* sectors */
-    0,                       /* start */
-    0,                       /* end */
-    false,                   /* read */
-    0,                       /* help */
-    false,                   /* kilobyte */
-    5,                       /* refresh */
-    false,                   /* ignore */
-    false,                   /* check sum calc */
-    2,                       /* nRetry if write error.*/
+    RD_READ,    /* what is left of the request */
+    RD_PARTIAL, /* the blocks before the medium error in it */
+    RD_DONE,
 };
 
-struct _stats
+typedef struct
 {
-    char *device_name;
-    unsigned int bytes_per_sector;
-
-    int64_t start_ticks;
-    struct tm lpStartTime;
-    char start_time[20];
-    int64_t wiping_ticks;
-
-    int64_t all_start_ticks;
-    int64_t all_wiping_ticks;
-
-    int64_t passwiping_ticks;
-};
-
-typedef struct _stats t_stats;
+    t_dev *dp;
+    enum rd_state state;
+    int blocks;       /* of the request */
+    int xferred;      /* of them done, read or skipped over */
+    int blks;         /* of the READ to issue, or in err_out */
+    int64_t lba;
+    uint8_t *bp;
+    int retries;      /* of ifp->retries left */
+    int ret;          /* the medium error kept for the end */
+    bool may_coe;     /* isolate or zero fill instead of failing */
+    int nrl;          /* bad blocks READ LONG is still to fetch */
+    int64_t rl_lba[READ_LONG_BATCH];
+    uint8_t *rl_bp[READ_LONG_BATCH];
+    int res;          /* RD_DONE: what sg_read() returns */
+    int blks_read;    /* RD_DONE: its *blks_readp, -1 -> left alone */
+} t_rd;
 
-static int64_t
-get_ticks(t_stats *stats)
+static void
+rd_finish(t_rd *rq, int res, int blks_read)
 {
-    struct timeval tm;
-    tm.tv_sec = 0;
-    tm.tv_usec = 0;
-    gettimeofday(&tm, NULL);
-    return tm.tv_sec;
+    rq->state = RD_DONE;
+    rq->res = res;
+    rq->blks_read = blks_read;
 }
 
-static char *seconds_to_hhmmss(uint seconds, char *rv, int bufsiz)
+/* The next READ of what is left, or the end when nothing is. */
+static void
+rd_loop(t_rd *rq)
 {
-    uint hours = seconds / 3600;
-    seconds -= hours * 3600;
-
-    uint minutes = seconds / 60;
-    seconds -= minutes * 60;
-
-    if (hours > 99)
+    rq->blks = rq->blocks - rq->xferred;
+    rq->may_coe = false;
+    rq->state = RD_READ;
+    if (rq->blks <= 0)
     {
-        uint days = hours / 24;
-        hours -= days * 24;
-        if (days > 99)
-        {
-            snprintf(rv, bufsiz, "%03dd %02dh", days, hours);
-            return rv;
-        }
-        snprintf(rv, bufsiz, "%02dd%02d%02d", days, hours, minutes);
-        return rv;
+        read_long_batch(rq->dp, rq->rl_lba, rq->rl_bp, rq->nrl);
+        rd_finish(rq, 0, rq->xferred);
     }
-
-    snprintf(rv, bufsiz, "%02d:%02d:%02d", hours, minutes, seconds);
-
-    return rv;
 }
 
-static void print_stats(unsigned int pass, char *s_byte, int64_t sector, t_stats *stats, int passescnt)
+static void
+rd_init(t_rd *rq, t_dev *dp, uint8_t *buff, int blocks, int64_t from_block)
 {
-    int64_t starting_sector = opt.start;
-    int64_t ending_sector = opt.end;
-
-    int64_t done_sectors = (ending_sector * ((int64_t)pass - 1)) + sector;
-    int64_t total_sectors = ending_sector * (passescnt);
-
-    int64_t single_sectors = sector;
-    //int64_t single_total_sectors = ending_sector * 1;
-
-    double all_pct = (double)(int64_t)done_sectors / (double)(int64_t)total_sectors * 100.0;
-    //double single_pct = (double)(int64_t)single_sectors / (double)(int64_t)single_total_sectors * 100.0;
-
-    int64_t remaining_ticks = 0;
+    rq->dp = dp;
+    rq->blocks = blocks;
+    rq->xferred = 0;
+    rq->lba = from_block;
+    rq->bp = buff;
+    rq->retries = dp->flags.retries;
+    rq->ret = 0;
+    rq->nrl = 0;
+    rq->res = 0;
+    rq->blks_read = -1;
+    if (__atomic_load_n(&dp->gone, __ATOMIC_RELAXED))
+        rd_finish(rq, -1, -1); /* no retries, isolation or READ LONG */
+    else
+        rd_loop(rq);
+}
 
-    int64_t elapsed_ticks = get_ticks(stats) - stats->start_ticks;
+/* The READ failed for good: isolate the bad blocks in it, or zero fill
+ * them with coe. */
+static void
+rd_err(t_rd *rq)
+{
+    t_dev *dp = rq->dp;
+    struct flags_t *ifp = &dp->flags;
+    int bs = dp->blk_sz, blks = rq->blks, res;
 
-    if (done_sectors)
+    read_long_batch(dp, rq->rl_lba, rq->rl_bp, rq->nrl);
+    if (rq->may_coe && (blks > 1))
     {
-        remaining_ticks = (int64_t)(((double)(int64_t)((total_sectors - done_sectors) / (double)(int64_t)done_sectors) * elapsed_ticks));
+        /* find the bad blocks instead of losing all blks of the READ */
+        CTR_ADD(dp, unrecovered, -1); /* counted per bad block instead */
+        res = isolate_split(dp, rq->bp, rq->lba, blks);
+        if ((0 == res) || ((res > 0) && ifp->coe))
+            rd_finish(rq, 0, rq->xferred + blks);
+        else
+            rd_finish(rq, rq->ret, -1);
+        return;
     }
-
-    double kilo = opt.kilobyte ? 1024.0 : 1000.0;
-
-    double mb_sec = 0;
-    double mb_sec_single = 0;
-    double secondspass = 0;
-
-    if (stats->wiping_ticks)
+    if (SG_LIB_CAT_MEDIUM_HARD == rq->ret)
+        bad_block(dp, BADMAP_BAD, rq->lba, blks);
+    if (ifp->coe)
     {
-        int64_t bytes = done_sectors * stats->bytes_per_sector;
-        double megabytes = (double)(int64_t)bytes / (kilo * kilo);
-        double seconds = (double)(int64_t)stats->wiping_ticks;
+        memset(rq->bp, 0, bs * blks);
+        pr2serr(">> unable to read at blk=%" PRId64 " for %d bytes, use "
+                "zeros\n",
+                rq->lba, bs * blks);
+        if (blks > 1)
+            pr2serr(">>   try reducing bpt to limit number of zeros written "
+                    "near bad block(s)\n");
+        /* fudge success */
+        rd_finish(rq, rq->may_coe ? 0 : rq->ret, rq->xferred + blks);
+    }
+    else
+        rd_finish(rq, rq->ret, -1);
+}
 
-        int64_t bytessingle = single_sectors * stats->bytes_per_sector;
-        double megabytessingle = (double)(int64_t)bytessingle / (kilo * kilo);
-        secondspass = (double)(int64_t)stats->passwiping_ticks;
+/* Past the blks read before the medium error: the bad block after them
+ * zeroed, its READ LONG queued with coe 2 and 3, then what is left. */
+static void
+rd_skip(t_rd *rq)
+{
+    t_dev *dp = rq->dp;
+    struct flags_t *ifp = &dp->flags;
+    int bs = dp->blk_sz;
 
-        //printf("\nsector=%20I64d done_sectors=%20I64d bytes=%20I64d megabytes=%20.10f seconds=%20.10f\n", sector, done_sectors, bytes, megabytes, seconds);
-        if (seconds > 0)
-        {
-            mb_sec = megabytes / seconds;
-        }
-        if (secondspass > 0)
+    rq->xferred += rq->blks;
+    if (0 == ifp->coe)
+    {
+        /* give up at block before problem unless 'coe' */
+        bad_block(dp, BADMAP_BAD, rq->lba + rq->blks, 1);
+        rd_finish(rq, rq->ret, rq->xferred);
+        return;
+    }
+    if (bs < 32)
+    {
+        pr2serr(">> bs=%d too small for read_long\n", bs);
+        rd_finish(rq, -1, -1); /* nah, block size can't be that small */
+        return;
+    }
+    rq->bp += (rq->blks * bs);
+    rq->lba += rq->blks;
+    bad_block(dp, BADMAP_BAD, rq->lba, 1);
+    if ((0 != ifp->pdt) || (ifp->coe < 2) || dp->pi_type)
+    {
+        pr2serr(">> unrecovered read error at blk=%" PRId64 ", pdt=%d, "
+                "use zeros\n",
+                rq->lba, ifp->pdt);
+        memset(rq->bp, 0, bs);
+    }
+    else
+    {
+        /* its READ LONG waits for the batch, the READs go on */
+        if (rq->nrl == READ_LONG_BATCH)
         {
-            mb_sec_single = megabytessingle / secondspass;
+            read_long_batch(dp, rq->rl_lba, rq->rl_bp, rq->nrl);
+            rq->nrl = 0;
         }
+        memset(rq->bp, 0, bs);
+        rq->rl_lba[rq->nrl] = rq->lba;
+        rq->rl_bp[rq->nrl++] = rq->bp;
     }
+    ++rq->xferred;
+    rq->bp += bs;
+    ++rq->lba;
+    rd_loop(rq);
+}
 
-    sector -= starting_sector;
-    ending_sector -= starting_sector;
-
-    double this_pct = (double)(int64_t)sector / (double)(int64_t)ending_sector * 100.0;
+/* The result of the READ of what is left, io_addr the INFO LBA of a
+ * medium error. */
+static void
+rd_read_done(t_rd *rq, int res, uint64_t io_addr)
+{
+    t_dev *dp = rq->dp;
+    struct flags_t *ifp = &dp->flags;
+    bool repeat = false;
 
-    if (sector >= ending_sector)
+    switch (res)
     {
-        this_pct = 100.0;
-        all_pct = (double)(pass)*100.0 / (double)passescnt;
-        if (pass >= opt.passes)
+    case 0:
+        read_long_batch(dp, rq->rl_lba, rq->rl_bp, rq->nrl);
+        rd_finish(rq, 0, rq->xferred + rq->blks);
+        return;
+    case -2: /* ENOMEM */
+        rd_finish(rq, res, -1);
+        return;
+    case SG_LIB_CAT_NOT_READY:
+        errlog_put(res, "Device (r) not ready\n", 0, 0, NULL, NULL,
+                   false);
+        rd_finish(rq, res, -1);
+        return;
+    case SG_LIB_CAT_ABORTED_COMMAND:
+        if (CTR_BUDGET(dp, aborted, dp->aborted_budget))
         {
-            this_pct = 100.0;
-            all_pct = 100.0;
-            remaining_ticks = 0;
+            errlog_put(res, "Aborted command, continuing (r)\n", 0, 0, NULL, NULL, false);
+            repeat = true;
+        }
+        else
+        {
+            errlog_put(res, "Aborted command, too many (r)\n", 0, 0, NULL, NULL, false);
+            rd_finish(rq, res, -1);
+            return;
+        }
+        break;
+    case SG_LIB_CAT_UNIT_ATTENTION:
+        if (CTR_BUDGET(dp, uas, dp->ua_budget))
+        {
+            errlog_put(res, "Unit attention, continuing (r)\n", 0, 0, NULL, NULL, false);
+            repeat = true;
+        }
+        else
+        {
+            errlog_put(res, "Unit attention, too many (r)\n", 0, 0, NULL, NULL, false);
+            rd_finish(rq, res, -1);
+            return;
+        }
+        break;
+    case SG_LIB_CAT_MEDIUM_HARD_WITH_INFO:
+        if (rq->retries > 0)
+        {
+            errlog_put(res, ">>> retrying a sgio read, lba=0x%" PRIx64 "\n",
+                       rq->lba, 0, NULL, NULL, false);
+            --rq->retries;
+            CTR_ADD(dp, retries, 1);
+            if (dp->ctr[ctr_shard].unrecovered > 0)
+                CTR_ADD(dp, unrecovered, -1);
+            repeat = true;
+        }
+        rq->ret = SG_LIB_CAT_MEDIUM_HARD;
+        break; /* unrecovered read error at lba=io_addr */
+    case SG_LIB_SYNTAX_ERROR:
+        ifp->coe = 0;
+        rq->ret = res;
+        rd_err(rq);
+        return;
+    case -1:
+        rq->ret = res;
+        rd_err(rq);
+        return;
+    case SG_LIB_CAT_MEDIUM_HARD:
+        rq->may_coe = true;
+#if defined(__GNUC__)
+#if (__GNUC__ >= 7)
+        __attribute__((fallthrough));
+        /* FALL THROUGH */
+#endif
+#endif
+    default:
+        if (rq->retries > 0)
+        {
+            errlog_put(res, ">>> retrying a sgio read, lba=0x%" PRIx64 "\n",
+                       rq->lba, 0, NULL, NULL, false);
+            --rq->retries;
+            CTR_ADD(dp, retries, 1);
+            if (dp->ctr[ctr_shard].unrecovered > 0)
+                CTR_ADD(dp, unrecovered, -1);
+            repeat = true;
+            break;
         }
+        rq->ret = res;
+        rd_err(rq);
+        return;
     }
+    if (repeat)
+    {
+        PROBE4(retry, dp->device_name, rq->lba, rq->blks, res);
+        rd_loop(rq);
+        return;
+    }
+    if ((io_addr < (uint64_t)rq->lba) ||
+        (io_addr >= (uint64_t)(rq->lba + rq->blks)))
+    {
+        pr2serr("  Unrecovered error lba 0x%" PRIx64 " not in "
+                "correct range:\n\t[0x%" PRIx64 ",0x%" PRIx64 "]\n",
+                io_addr, (uint64_t)rq->lba,
+                (uint64_t)(rq->lba + rq->blks - 1));
+        rq->may_coe = true;
+        rd_err(rq);
+        return;
+    }
+    rq->blks = (int)(io_addr - (uint64_t)rq->lba);
+    if (rq->blks > 0)
+    {
+        if (verbose)
+            pr2serr("  partial read of %d blocks prior to medium error\n",
+                    rq->blks);
+        rq->state = RD_PARTIAL;
+        return;
+    }
+    rd_skip(rq);
+}
 
-    char consume_time[255];
-    seconds_to_hhmmss((uint)secondspass, consume_time, sizeof(consume_time));
-
-    uint remaining_seconds = (uint)(remaining_ticks);
+/* The result of the READ of the blocks before the medium error. */
+static void
+rd_partial_done(t_rd *rq, int res)
+{
+    switch (res)
+    {
+    case 0:
+        rd_skip(rq);
+        return;
+    case -1:
+        rq->dp->flags.coe = 0;
+        rq->ret = res;
+        break;
+    case -2:
+        pr2serr("ENOMEM again, unexpected (r)\n");
+        rd_finish(rq, -1, -1);
+        return;
+    case SG_LIB_CAT_NOT_READY:
+        pr2serr("device (r) not ready\n");
+        rd_finish(rq, res, -1);
+        return;
+    case SG_LIB_CAT_UNIT_ATTENTION:
+        pr2serr("Unit attention, unexpected (r)\n");
+        rd_finish(rq, res, -1);
+        return;
+    case SG_LIB_CAT_ABORTED_COMMAND:
+        pr2serr("Aborted command, unexpected (r)\n");
+        rd_finish(rq, res, -1);
+        return;
+    case SG_LIB_CAT_MEDIUM_HARD_WITH_INFO:
+    case SG_LIB_CAT_MEDIUM_HARD:
+        rq->ret = SG_LIB_CAT_MEDIUM_HARD;
+        break;
+    case SG_LIB_SYNTAX_ERROR:
+    default:
+        pr2serr(">> unexpected result=%d from sg_read_low() 2\n", res);
+        rq->ret = res;
+        break;
+    }
+    rd_err(rq);
+}
 
-    char remaining_time[255];
-    seconds_to_hhmmss(remaining_seconds, remaining_time, sizeof(remaining_time));
+/* res and io_addr of the READ rq asked for, from sg_read_low() or a
+ * completion of an engine. */
+static void
+rd_done(t_rd *rq, int res, uint64_t io_addr)
+{
+    if (RD_READ == rq->state)
+        rd_read_done(rq, res, io_addr);
+    else if (RD_PARTIAL == rq->state)
+        rd_partial_done(rq, res);
+}
 
-    uint elapsed_seconds = (uint)(elapsed_ticks);
+/* 0 -> successful, SG_LIB_SYNTAX_ERROR -> unable to build cdb,
+   SG_LIB_CAT_UNIT_ATTENTION -> try again, SG_LIB_CAT_NOT_READY,
+   SG_LIB_CAT_MEDIUM_HARD, SG_LIB_CAT_ABORTED_COMMAND,
+   -2 -> ENOMEM, -1 other errors */
+static int
+sg_read(t_dev *dp, uint8_t *buff, int blocks, int64_t from_block,
+        bool *diop, int *blks_readp)
+{
+    t_rd rq;
+    uint64_t io_addr;
+    int res;
 
-    char elapsed_time[255];
-    seconds_to_hhmmss(elapsed_seconds, elapsed_time, sizeof(elapsed_time));
+    rd_init(&rq, dp, buff, blocks, from_block);
+    while (RD_DONE != rq.state)
+    {
+        io_addr = 0;
+        res = sg_read_low(dp, rq.bp, rq.blks, rq.lba, diop, &io_addr);
+        rd_done(&rq, res, io_addr);
+    }
+    if (blks_readp && (rq.blks_read >= 0))
+        *blks_readp = rq.blks_read;
+    return rq.res;
+}
 
-    double dbsec = mb_sec;
-    if (dbsec < 1)
-        dbsec = 1;
-    int64_t tems = (int64_t)((double)(int64_t)(total_sectors * stats->bytes_per_sector) / (kilo * kilo) / (dbsec));
+/* The number of segments of sgl that hold len bytes, the length of the
+ * last one set to what is left of len: a READ cut short by range_next()
+ * transfers less than the list holds. */
+static int
+sg_iovec_cut(struct iobuf_sgl *sgl, size_t len)
+{
+    size_t chunk = IOBUF_HUGE_MIN;
+    int k, n = (int)((len + chunk - 1) / chunk);
 
-    char finish_time[255] = {0};
-    snprintf(finish_time, sizeof(finish_time), "%08" PRId64, tems);
+    for (k = 0; k < sgl->n; ++k)
+        sgl->iov[k].iov_len = (sgl->len - k * chunk < chunk)
+                                  ? sgl->len - k * chunk : chunk;
+    if (n > 0)
+        sgl->iov[n - 1].iov_len = len - (n - 1) * chunk;
+    return n;
+}
 
-    char buf[1024];
-    snprintf(buf, sizeof(buf), "%.3f%% - %s - %s - %s", all_pct, remaining_time, stats->device_name, progname);
+/* sg_read() of the blocks at lba into the segments of sgl one by one,
+ * for the recovery of a scatter list READ that failed. */
+static int
+sg_read_sgl(t_dev *dp, struct iobuf_sgl *sgl, int blocks, int64_t lba)
+{
+    int k, n, res, blks_readp;
+    bool diop = false;
 
-    printf(FORMAT_STRING,
-           pass,
-           passescnt,
-           s_byte,
-           this_pct,
-           all_pct,
-           elapsed_time,
-           consume_time, //remaining_time,
-           stats->start_time,
-           finish_time,
-           mb_sec,
-           mb_sec_single);
-    fflush(stdout);
+    for (k = 0; (k < sgl->n) && (blocks > 0); ++k)
+    {
+        n = (int)(sgl->iov[k].iov_len / dp->blk_sz);
+        if (n > blocks)
+            n = blocks;
+        blks_readp = 0;
+        res = sg_read(dp, sgl->iov[k].iov_base, n, lba, &diop, &blks_readp);
+        if (res)
+            return res;
+        lba += n;
+        blocks -= n;
+    }
+    return 0;
 }
 
+/* Queues one READ (a WRITE when rqp->write) with write(2) on the sg v3
+   asynchronous interface, from the templates of rd_template().
+   0 -> queued, -2 -> ENOMEM, -1 other errors */
 static int
-read_verify_device(char *device_name, int bytes, int *byte, t_stats *stats)
+sg_start_io(t_dev *dp, t_rq *rqp)
 {
-    stats->start_ticks = get_ticks(stats);
-    stats->wiping_ticks = 0;
+    struct sg_io_hdr *hp = &rqp->io_hdr;
+    const struct flags_t *ifp = &dp->flags;
+    int res;
 
-    stats->device_name = device_name;
+    rd_cdb_put(dp, rqp->cmd, rqp->blocks, rqp->lba);
+    *hp = dp->rd_hdr;
+    if (rqp->write)
+    {
+        wr_cdb_put(dp, rqp->cmd, rqp->blocks, rqp->lba);
+        hp->dxfer_direction = SG_DXFER_TO_DEV;
+    }
+    if (rqp->same)
+    {
+        memset(rqp->cmd, 0, MAX_SCSI_CDBSZ);
+        rqp->cmd[0] = 0x93; /* WRITE SAME(16) */
+        sg_put_unaligned_be64((uint64_t)rqp->lba, rqp->cmd + 2);
+        sg_put_unaligned_be32((uint32_t)rqp->blocks, rqp->cmd + 10);
+        hp->cmd_len = 16;
+    }
+    else if (rqp->stream)
+    {
+        memset(rqp->cmd, 0, MAX_SCSI_CDBSZ);
+        rqp->cmd[0] = 0x9a; /* WRITE STREAM(16) */
+        rqp->cmd[1] = dp->wr_cdb[1] & 0x08; /* FUA */
+        sg_put_unaligned_be64((uint64_t)rqp->lba, rqp->cmd + 2);
+        sg_put_unaligned_be16(dp->stream[rqp->stream - 1].id, rqp->cmd + 10);
+        sg_put_unaligned_be16((uint16_t)rqp->blocks, rqp->cmd + 12);
+        hp->cmd_len = 16;
+    }
+    hp->cmdp = rqp->cmd;
+    hp->dxfer_len = xfer_len(dp, rqp->same ? 1 : rqp->blocks);
+    hp->dxferp = rqp->buffp;
+    hp->sbp = rqp->sb;
+    hp->usr_ptr = rqp;
+    hp->pack_id = (int)rqp->lba;
+    if (rqp->sgl)
+    {
+        /* the segments of transfer, the last one cut to dxfer_len */
+        hp->iovec_count = sg_iovec_cut(rqp->sgl, hp->dxfer_len);
+        hp->dxferp = rqp->sgl->iov;
+    }
+    else if (dp->flags.dio)
+        hp->flags |= SG_FLAG_DIRECT_IO;
 
-    stats->bytes_per_sector = DEF_BLOCK_SIZE;
+    if (verbose > 2)
+        sg_print_command_len(rqp->cmd, ifp->cdbsz);
 
-    int bpt = DEF_BLOCKS_PER_TRANSFER;
-    int out_type = FT_OTHER;
-    int outfd, retries_tmp = 5;
-    int64_t out_num_sect = -1;
-    int out_sect_sz;
-    int res = 0;
+    PROBE3(submit, dp->device_name, rqp->lba, rqp->blocks);
+    rqp->t_ns = lat_now_ns();
+    rqp->aborted = false;
+    rqp->path = path_start(dp);
+    if (dp->sim)
+        res = sim_submit(dp->sim, hp);
+    else
+        while (((res = write(path_fd(dp, rqp->path), hp,
+                             sizeof(struct sg_io_hdr))) < 0) &&
+               ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
+            ;
+    if (res < 0)
+    {
+        path_end(dp, rqp->path, 0);
+        if (ENOMEM == errno)
+            return -2;
+        perror("starting io on sg device, error");
+        return -1;
+    }
+    return 0;
+}
 
-    outfd = open_of(device_name, opt.start, bpt, &oflag, &out_type, verbose);
-    if (outfd < 0)
+/* Waits for the next READ queued by sg_start_io() to complete, whichever
+   one that is, and sets *rqpp to it. Returns the sg_err_category3() of
+   the response or -1 if the read(2) itself failed; with nowait -3 when
+   none has completed yet. */
+static int
+sg_finish_io(t_dev *dp, t_rq **rqpp, bool nowait)
+{
+    int res, k, n = dp->npaths ? dp->npaths : 1, j = 0;
+    t_rq *rqp;
+    struct pollfd pfd[MAX_PATHS];
+    struct sg_io_hdr io_hdr;
+
+    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+    io_hdr.interface_id = 'S';
+    io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+    io_hdr.pack_id = -1; /* any completed request */
+    for (k = 0; k < n; ++k)
     {
-        pr2serr("outfd=%d\n", outfd);
-        return -outfd;
+        pfd[k].fd = path_fd(dp, k);
+        pfd[k].events = POLLIN;
     }
 
-    out_num_sect = -1;
-    out_sect_sz = -1;
-    if (FT_SG & out_type)
+    if (dp->sim)
     {
-        res = scsi_read_capacity(outfd, &out_num_sect, &out_sect_sz);
-        if (SG_LIB_CAT_UNIT_ATTENTION == res)
-        {
-            pr2serr("Unit attention (readcap out), continuing\n");
-            res = scsi_read_capacity(outfd, &out_num_sect, &out_sect_sz);
-        }
-        else if (SG_LIB_CAT_ABORTED_COMMAND == res)
-        {
-            pr2serr("Aborted command (readcap out), continuing\n");
-            res = scsi_read_capacity(outfd, &out_num_sect, &out_sect_sz);
-        }
-        if (0 != res)
-        {
-            if (res == SG_LIB_CAT_INVALID_OP)
-                pr2serr("read capacity not supported on %s\n", device_name);
-            else
-                pr2serr("Unable to read capacity on %s\n", device_name);
-            out_num_sect = -1;
-        }
-        else if (blk_sz != out_sect_sz)
-        {
-            pr2serr(">> warning: block size on %s confusion: bs=%d, "
-                    "device claims=%d\n",
-                    device_name, blk_sz, out_sect_sz);
-            blk_sz = out_sect_sz;
-            stats->bytes_per_sector = blk_sz;
+        struct sg_io_hdr *hp;
+
+        res = sim_reap(dp->sim, &hp, nowait);
+        if ((res < 0) && (EAGAIN == errno))
+            return -3;
+        if (0 == res)
+            io_hdr = *hp;
+    }
+    else /* with paths, each is tried in turn before waiting on them all */
+    while ((res = read(pfd[j].fd, &io_hdr, sizeof(struct sg_io_hdr))) < 0)
+    {
+        if ((EAGAIN == errno) && (++j < n))
+            continue;
+        j = 0;
+        if ((EAGAIN == errno) && nowait)
+            return -3;
+        if (EAGAIN == errno)
+        { /* fd is O_NONBLOCK, wait until something completes */
+            if ((poll(pfd, n, -1) < 0) && (EINTR != errno))
+                break;
+            for (k = 0; k < n; ++k)
+                if (pfd[k].revents)
+                    j = k;
         }
-    } //MUST is FT_SG support. other not support
+        else if ((EINTR != errno) && (EBUSY != errno))
+            break;
+    }
+    if (res < 0)
+    {
+        if ((ENODEV == errno) || (ENXIO == errno))
+            dev_gone(dp, "device removed");
+        else
+            perror("finishing io on sg device, error");
+        return -1;
+    }
+    rqp = (t_rq *)io_hdr.usr_ptr;
+    path_end(dp, rqp->path, io_hdr.dxfer_len - io_hdr.resid);
+    rqp->t_ns = lat_now_ns() - rqp->t_ns; /* now the latency */
+    memcpy(&rqp->io_hdr, &io_hdr, sizeof(struct sg_io_hdr));
+    if (SG_FLAG_DIRECT_IO & io_hdr.flags)
+        dio_count(dp, io_hdr.info);
+    *rqpp = rqp;
+    if (verbose > 2)
+        pr2serr("      duration=%u ms\n", io_hdr.duration);
+    res = sg_err_category3(&rqp->io_hdr);
+    if ((SG_LIB_CAT_CLEAN != res) && (SG_LIB_CAT_CONDITION_MET != res))
+        PROBE4(error, dp->device_name, rqp->lba, rqp->blocks, res);
+    if (SG_LIB_DID_NO_CONNECT == io_hdr.host_status)
+        dev_gone(dp, "no connection to the device");
+    return res;
+}
+
+/* 0 -> successful, SG_LIB_SYNTAX_ERROR -> unable to build cdb,
+   SG_LIB_CAT_NOT_READY, SG_LIB_CAT_UNIT_ATTENTION, SG_LIB_CAT_MEDIUM_HARD,
+   SG_LIB_CAT_ABORTED_COMMAND, -2 -> recoverable (ENOMEM),
+   -1 -> unrecoverable error + others */
+/*static int
+sg_write(int sg_fd, unsigned char * buff, int blocks, int64_t to_block,
+         int bs, const struct flags_t * ofp, int * diop)
+{
+    unsigned char wrCmd[MAX_SCSI_CDBSZ];
+    unsigned char senseBuff[SENSE_BUFF_LEN];
+    struct sg_io_hdr io_hdr;
+    int res, k, info_valid;
+    uint64_t io_addr = 0;
+    if (sg_build_scsi_cdb(wrCmd, ofp->cdbsz, blocks, to_block, 1, ofp->fua,
+                          ofp->dpo, 0)) {
+        pr2serr(ME "bad wr cdb build, to_block=%" PRId64 ", blocks=%d\n",
+                to_block, blocks);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+    io_hdr.interface_id = 'S';
+    io_hdr.cmd_len = ofp->cdbsz;
+    io_hdr.cmdp = wrCmd;
+    io_hdr.dxfer_direction = SG_DXFER_TO_DEV;
+    io_hdr.dxfer_len = bs * blocks;
+    io_hdr.dxferp = buff;
+    io_hdr.mx_sb_len = SENSE_BUFF_LEN;
+    io_hdr.sbp = senseBuff;
+    io_hdr.timeout = DEF_TIMEOUT;
+    io_hdr.pack_id = (int)to_block;
+    if (diop && *diop)
+        io_hdr.flags |= SG_FLAG_DIRECT_IO;
+
+    if (verbose > 2) {
+        pr2serr("    write cdb: ");
+        for (k = 0; k < ofp->cdbsz; ++k)
+            pr2serr("%02x ", wrCmd[k]);
+        pr2serr("\n");
+    }
+    while (((res = ioctl(sg_fd, SG_IO, &io_hdr)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno)))
+        ;
+    if (res < 0) {
+        if (ENOMEM == errno)
+            return -2;
+        perror("writing (SG_IO) on sg device, error");
+        return -1;
+    }
+
+    if (verbose > 2)
+        pr2serr("      duration=%u ms\n", io_hdr.duration);
+    res = sg_err_category3(&io_hdr);
+    switch (res) {
+    case SG_LIB_CAT_CLEAN:
+        break;
+    case SG_LIB_CAT_RECOVERED:
+        ++recovered_errs;
+        info_valid = sg_get_sense_info_fld(io_hdr.sbp, io_hdr.sb_len_wr,
+                                           &io_addr);
+        if (info_valid) {
+            pr2serr("    lba of last recovered error in this WRITE=0x%" PRIx64
+                    "\n", io_addr);
+            if (verbose > 1)
+                sg_chk_n_print3("writing", &io_hdr, 1);
+        } else {
+            pr2serr("Recovered error: [no info] writing to block=0x%" PRIx64
+                    ", num=%d\n", to_block, blocks);
+            sg_chk_n_print3("writing", &io_hdr, verbose > 1);
+        }
+        break;
+    case SG_LIB_CAT_ABORTED_COMMAND:
+    case SG_LIB_CAT_UNIT_ATTENTION:
+        sg_chk_n_print3("writing", &io_hdr, verbose > 1);
+        return res;
+    case SG_LIB_CAT_NOT_READY:
+        ++unrecovered_errs;
+        pr2serr("device not ready (w)\n");
+        return res;
+    case SG_LIB_CAT_MEDIUM_HARD:
+    default:
+        sg_chk_n_print3("writing", &io_hdr, verbose > 1);
+        ++unrecovered_errs;
+        if (ofp->coe) {
+            pr2serr(">> ignored errors for out blk=%" PRId64 " for %d "
+                    "bytes\n", to_block, bs * blocks);
+            return 0; // fudge success 
+        } else
+            return res;
+    }
+    if (diop && *diop &&
+        ((io_hdr.info & SG_INFO_DIRECT_IO_MASK) != SG_INFO_DIRECT_IO))
+        *diop = 0;      // flag that dio not done (completely) 
+    return 0;
+}
+*/
+
+#ifndef DSKREAD_LIB
+static void
+calc_duration_throughput(int contin)
+{
+    struct timeval end_tm, res_tm;
+    double a, b;
+    int64_t blks;
+    int k;
+
+    if (start_tm_valid && (start_tm.tv_sec || start_tm.tv_usec))
+    {
+        for (k = 0, b = 0.0; k < num_devs; ++k)
+        {
+            blks = CTR_GET(devs + k, in_full);
+            if (blks < devs[k].out_full)
+                blks = devs[k].out_full;
+            b += (double)devs[k].blk_sz * blks;
+        }
+        gettimeofday(&end_tm, NULL);
+        res_tm.tv_sec = end_tm.tv_sec - start_tm.tv_sec;
+        res_tm.tv_usec = end_tm.tv_usec - start_tm.tv_usec;
+        if (res_tm.tv_usec < 0)
+        {
+            --res_tm.tv_sec;
+            res_tm.tv_usec += 1000000;
+        }
+        a = res_tm.tv_sec;
+        a += (0.000001 * res_tm.tv_usec);
+        pr2serr("time to transfer data%s: %d.%06d secs",
+                (contin ? " so far" : ""), (int)res_tm.tv_sec,
+                (int)res_tm.tv_usec);
+        if ((a > 0.00001) && (b > 511))
+            pr2serr(" at %.2f MB/sec\n", b / (a * 1000000.0));
+        else
+            pr2serr("\n");
+    }
+}
+#endif
+
+/* Returns open output file descriptor (>= 0), -1 for don't
+ * bother opening (e.g. /dev/null), or a more negative value
+ * (-SG_LIB_FILE_ERROR or -SG_LIB_CAT_OTHER) if error.
+ */
+/* Opens dp->device_name as an NVMe namespace. A /dev/nvmeXnY block
+ * device is swapped for its /dev/ngXnY generic char device, which takes
+ * queued passthrough commands on io_uring. Returns the fd, else -1 if
+ * the device is not an NVMe namespace. */
+static int
+nvme_open(t_dev *dp)
+{
+    char ng[64];
+    int ctl, ns, fd = -1, nsid;
+
+    if (2 == sscanf(dp->device_name, "/dev/nvme%dn%d", &ctl, &ns))
+    {
+        snprintf(ng, sizeof(ng), "/dev/ng%dn%d", ctl, ns);
+        fd = open(ng, dp->flags.write ? O_RDWR : O_RDONLY);
+        if ((fd >= 0) && verbose)
+            pr2serr("        using %s for %s\n", ng, dp->device_name);
+    }
+    if (fd < 0)
+        fd = open(dp->device_name, dp->flags.write ? O_RDWR : O_RDONLY);
+    if (fd < 0)
+        return -1;
+    nsid = ioctl(fd, NVME_IOCTL_ID);
+    if (nsid <= 0)
+    {
+        close(fd);
+        return -1;
+    }
+    dp->nsid = nsid;
+    return fd;
+}
+
+/* An NVMe admin command on dp: NVME_IOCTL_ADMIN_CMD, or the admin queue
+ * of its spdk: controller. Returns as the ioctl does. */
+static int
+nvme_admin(t_dev *dp, struct nvme_admin_cmd *cmd)
+{
+    return dp->spdk ? spdkdev_admin(dp->spdk, cmd)
+                    : ioctl(dp->fd, NVME_IOCTL_ADMIN_CMD, cmd);
+}
+
+/* An NVMe I/O command on dp, NVME_IOCTL_IO64_CMD tried again when
+ * interrupted, or on a queue pair of the calling thread of its spdk:
+ * controller. Returns as the ioctl does. */
+static int
+nvme_io(t_dev *dp, struct nvme_passthru_cmd64 *cmd)
+{
+    int res;
+
+    if (dp->spdk)
+        return spdkdev_io(dp->spdk, cmd);
+    while (((res = ioctl(dp->fd, NVME_IOCTL_IO64_CMD, cmd)) < 0) &&
+           (EINTR == errno))
+        ;
+    return res;
+}
+
+/* "<prefix><hex of len bytes>" into dp->dev_id, unless they are all
+ * zero. Returns true when set. */
+static bool
+dev_id_hex(t_dev *dp, const char *prefix, const uint8_t *bp, int len)
+{
+    int k, n;
+
+    for (k = 0; (k < len) && (0 == bp[k]); ++k)
+        ;
+    if (k == len)
+        return false;
+    n = snprintf(dp->dev_id, sizeof(dp->dev_id), "%s", prefix);
+    for (k = 0; (k < len) && (n < (int)sizeof(dp->dev_id) - 2); ++k)
+        n += snprintf(dp->dev_id + n, sizeof(dp->dev_id) - n, "%02x", bp[k]);
+    return true;
+}
+
+/* "sn.<serial>" into dp->dev_id, spaces trimmed. */
+static void
+dev_id_serial(t_dev *dp, const char *sn, int len)
+{
+    int n = 3;
+
+    while ((len > 0) && (' ' == *sn))
+        ++sn, --len;
+    while ((len > 0) && ((' ' == sn[len - 1]) || ('\0' == sn[len - 1])))
+        --len;
+    if (len <= 0)
+        return;
+    memcpy(dp->dev_id, "sn.", 3);
+    for (; (len > 0) && (n < (int)sizeof(dp->dev_id) - 1); ++sn, --len)
+        dp->dev_id[n++] = isgraph((unsigned char)*sn) ? *sn : '_';
+    dp->dev_id[n] = '\0';
+}
+
+/* --pi: the end-to-end protection of LBA format lbaf from Identify
+ * Namespace id, ms bytes of metadata a block, and its guard format from
+ * the NVM Command Set Identify Namespace (CNS 5), which cmd then reads
+ * into id; without one the guard is 16 bits. A namespace formatted
+ * without PI, or with the 32b guard, is read without. */
+static void
+nvme_pi_probe(t_dev *dp, struct nvme_admin_cmd *cmd, uint8_t *id, int lbaf,
+              int ms)
+{
+    bool ext = !!(id[26] & 0x10);
+    int dps = id[29];
+    int pif = 0, sts = 0, tsz;
+    uint32_t elbaf;
+
+    if ((0 == ms) || (0 == (dps & 0x7)) || ((dps & 0x7) > 3))
+    {
+        pr2serr("%s: not formatted with protection information, reading "
+                "without\n", dp->device_name);
+        return;
+    }
+    cmd->cdw10 = 5; /* CNS 5: I/O command set namespace */
+    cmd->cdw11 = 0; /* CSI 0: NVM */
+    if (0 == nvme_admin(dp, cmd))
+    {
+        elbaf = sg_get_unaligned_le32(id + 12 + 4 * lbaf);
+        sts = elbaf & 0x7f;
+        pif = (elbaf >> 7) & 0x3;
+    }
+    tsz = pif ? PI_TUPLE64_SZ : PI_TUPLE_SZ;
+    if ((1 == pif) || (3 == pif) || (ms < tsz))
+    {
+        pr2serr("%s: protection information format not supported, reading "
+                "without\n", dp->device_name);
+        return;
+    }
+    dp->pi_type = dps & 0x7;
+    dp->pi_ms = ms;
+    dp->pi_ext = ext;
+    dp->pi_off = (dps & 0x8) ? 0 : ms - tsz; /* PIP: in the first bytes */
+    dp->pi_guard_sz = pif ? 8 : 2;
+    dp->pi_ref_bits = (pif ? 48 : 32) - sts;
+    if (verbose)
+        pr2serr("%s: protection type %d, %d bytes of metadata %s, %d bit "
+                "guard\n", dp->device_name, dp->pi_type, ms,
+                ext ? "in the data" : "apart", 8 * dp->pi_guard_sz);
+}
+
+/* Identify Namespace: capacity and the data size of the LBA format in
+ * use, with pi (--pi) its protection. Returns 0, else -1 once
+ * reported. */
+static int
+nvme_identify_ns(t_dev *dp, int64_t *num_sectp, int *sect_szp, bool pi)
+{
+    struct nvme_admin_cmd cmd;
+    uint8_t *free_id;
+    uint8_t *id = sg_memalign(4096, 0, &free_id, false);
+    int res, flbas, lbaf, ms;
+
+    if (NULL == id)
+        return -1;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = 0x06; /* Identify */
+    cmd.nsid = dp->nsid;
+    cmd.addr = (uint64_t)(uintptr_t)id;
+    cmd.data_len = 4096;
+    cmd.cdw10 = 0; /* CNS 0: namespace */
+    res = nvme_admin(dp, &cmd);
+    if (res)
+    {
+        pr2serr("%s: NVMe Identify Namespace failed, %s 0x%x\n",
+                dp->device_name, (res < 0) ? "errno" : "status",
+                (res < 0) ? errno : res);
+        free(free_id);
+        return -1;
+    }
+    flbas = id[26];
+    lbaf = (flbas & 0xf) | (((flbas >> 5) & 0x3) << 4);
+    ms = sg_get_unaligned_le16(id + 128 + 4 * lbaf);
+    *num_sectp = (int64_t)sg_get_unaligned_le64(id); /* NSZE */
+    *sect_szp = 1 << id[128 + 4 * lbaf + 2];          /* LBADS */
+    dp->nvme_dlfeat = id[33];
+    dp->nvme_flbas = flbas;
+    dp->nvme_dps = id[29];
+    dp->dev_id[0] = '\0';
+    if (!dev_id_hex(dp, "eui.", id + 104, 16)) /* NGUID */
+        dev_id_hex(dp, "eui.", id + 120, 8);   /* EUI64 */
+    if (pi)
+        nvme_pi_probe(dp, &cmd, id, lbaf, ms);
+    if ((flbas & 0x10) && ms && !dp->pi_type)
+    {
+        pr2serr("%s: extended LBA (metadata in data) format not supported "
+                "without --pi\n", dp->device_name);
+        free(free_id);
+        return -1;
+    }
+
+    /* Identify Controller: model number and firmware for the profiles */
+    cmd.nsid = 0;
+    cmd.cdw10 = 1; /* CNS 1: controller */
+    cmd.cdw11 = 0;
+    if (0 == nvme_admin(dp, &cmd))
+    {
+        profile_key(dp->model_key, "NVMe", 4, (const char *)id + 24, 40,
+                    (const char *)id + 64, 8);
+        dp->nvme_oncs = sg_get_unaligned_le16(id + 520);
+        dp->nvme_fna = id[524];
+        dp->nvme_sanicap = sg_get_unaligned_le32(id + 328);
+        if ('\0' == dp->dev_id[0])
+            dev_id_serial(dp, (const char *)id + 4, 20);
+    }
+    free(free_id);
+    return 0;
+}
+
+/* The logical unit's NAA or EUI-64 designator from the Device
+ * Identification VPD page, else its Unit Serial Number, so that a
+ * checkpoint follows the disk and not the /dev name. */
+static void
+scsi_dev_id(t_dev *dp, int fd)
+{
+    uint8_t vpd[512];
+    int k, len, dlen, type;
+
+    dp->dev_id[0] = '\0';
+    if (0 == sg_ll_inquiry(fd, false, true, 0x83, vpd, sizeof(vpd), false,
+                           0))
+    {
+        len = sg_get_unaligned_be16(vpd + 2) + 4;
+        if (len > (int)sizeof(vpd))
+            len = sizeof(vpd);
+        for (k = 4; k + 4 <= len; k += 4 + dlen)
+        {
+            dlen = vpd[k + 3];
+            type = vpd[k + 1] & 0xf;
+            if ((k + 4 + dlen > len) || (vpd[k + 1] & 0x30) ||
+                (1 != (vpd[k] & 0xf)))
+                continue; /* not of the lu, or not binary */
+            if ((3 == type) && dev_id_hex(dp, "naa.", vpd + k + 4, dlen))
+                return;
+            if ((2 == type) && dev_id_hex(dp, "eui.", vpd + k + 4, dlen))
+                return;
+        }
+    }
+    if ((0 == sg_ll_inquiry(fd, false, true, 0x80, vpd, sizeof(vpd), false,
+                            0)) && (vpd[3] > 0))
+        dev_id_serial(dp, (const char *)vpd + 4,
+                      (vpd[3] < sizeof(vpd) - 4) ? vpd[3] : sizeof(vpd) - 4);
+}
+
+/* --coordinate: claims dp, open on fd, for this process, by its WWN or
+ * serial number when it has one, else by what fd is. Returns 0 when it
+ * is ours, -1 when another dskread of the host is reading it. */
+static int
+dev_claim(t_dev *dp, int fd)
+{
+    char id[DEV_ID_SZ + 32];
+    struct stat st;
+    long pid = 0;
+    int res;
+
+    if (dp->dev_id[0])
+        snprintf(id, sizeof(id), "%s", dp->dev_id);
+    else if (dp->sim || dp->spdk || fstat(fd, &st))
+        snprintf(id, sizeof(id), "%s", dp->device_name);
+    else if (S_ISREG(st.st_mode))
+        snprintf(id, sizeof(id), "ino-%lu-%lu", (unsigned long)st.st_dev,
+                 (unsigned long)st.st_ino);
+    else
+        snprintf(id, sizeof(id), "dev-%u-%u", major(st.st_rdev),
+                 minor(st.st_rdev));
+    res = hostco_claim(id, &pid);
+    if (res > 0)
+        pr2serr(ME "%s (%s) is being read by dskread pid %ld, skipping\n",
+                dp->device_name, id, pid);
+    else if (res < 0)
+        perror(ME "--coordinate claim");
+    return res ? -1 : 0;
+}
+
+/* Sizes the reserved buffer of sg fd to one transfer of bytes, the
+ * READ that has it then never waits on the kernel for memory. Returns
+ * what the driver granted, -1 on errors. */
+static int
+sg_resbuf(int fd, int bytes)
+{
+    int t = bytes;
+    int psz = getpagesize();
+
+    if (t % psz)
+        t = (t / psz + 1) * psz;
+    if (ioctl(fd, SG_SET_RESERVED_SIZE, &t) < 0)
+    {
+        perror(ME "SG_SET_RESERVED_SIZE error");
+        return -1;
+    }
+    return (ioctl(fd, SG_GET_RESERVED_SIZE, &t) < 0) ? -1 : t;
+}
+
+static int
+open_of(t_dev *dp, int64_t seek, int bpt, int verbose)
+{
+    const char *outf = dp->device_name;
+    struct flags_t *ofp = &dp->flags;
+    int *out_typep = &dp->out_type;
+    int outfd, flags, t, verb, res;
+    char ebuff[EBUFF_SZ];
+    struct sg_simple_inquiry_resp sir;
+
+    verb = (verbose ? verbose - 1 : 0);
+    if (sim_name(outf))
+    {
+        dp->sim = (struct sim_dev *)calloc(1, sizeof(*dp->sim));
+        if (NULL == dp->sim)
+            goto other_err;
+        if (sim_parse(outf, dp->sim, ebuff, EBUFF_SZ))
+        {
+            pr2serr(ME "%s: %s\n", outf, ebuff);
+            free(dp->sim);
+            dp->sim = NULL;
+            goto file_err;
+        }
+        /* a descriptor for what takes one, flock and close */
+        if ((outfd = open("/dev/null", O_RDONLY)) < 0)
+        {
+            perror(ME "could not open /dev/null");
+            goto file_err;
+        }
+        *out_typep = FT_SIM;
+        dp->mrq = 0;
+        if (verbose)
+            pr2serr("        open output(sim), %" PRId64 " blocks of %d "
+                    "bytes\n", dp->sim->blocks, dp->sim->bs);
+        goto lock;
+    }
+    if (spdkdev_name(outf))
+    {
+        dp->spdk = spdkdev_open(outf, ebuff, EBUFF_SZ);
+        if (NULL == dp->spdk)
+        {
+            pr2serr(ME "%s: %s\n", outf, ebuff);
+            goto file_err;
+        }
+        if ((outfd = open("/dev/null", O_RDONLY)) < 0)
+        {
+            perror(ME "could not open /dev/null");
+            goto file_err;
+        }
+        /* the pool's hugepages, mapped already and to come, take the DMA */
+        iobuf_set_dma(spdkdev_dma_map);
+        *out_typep = FT_NVME;
+        dp->nsid = spdkdev_nsid(dp->spdk);
+        dp->mrq = 0;
+        if (verbose)
+            pr2serr("        open output(spdk), nsid=%u\n", dp->nsid);
+        goto lock;
+    }
+    *out_typep = dd_filetype(outf);
+    if (verbose)
+        pr2serr(" >> Output file type: %s\n",
+                dd_filetype_str(*out_typep, ebuff));
+
+    if ((FT_BLOCK & *out_typep) && ofp->sgio)
+        *out_typep |= FT_SG;
+    if (FT_FILE & *out_typep)
+        *out_typep |= FT_BLOCK; /* through the block engines, O_DIRECT */
+
+    if ((FT_OTHER & *out_typep) ||
+        ((FT_BLOCK & *out_typep) && ofp->nvme &&
+         !((FT_SG | FT_FILE) & *out_typep)))
+    {
+        outfd = nvme_open(dp);
+        if (outfd >= 0)
+        {
+            *out_typep = FT_NVME;
+            dp->mrq = 0;
+            if (verbose)
+                pr2serr("        open output(nvme), nsid=%u\n", dp->nsid);
+            goto lock;
+        }
+        if (FT_BLOCK & *out_typep)
+            pr2serr(ME "%s is not an NVMe namespace, reading it as a "
+                       "block device\n", outf);
+    }
+
+    if (FT_SG & *out_typep)
+    {
+        flags = (ofp->write ? O_RDWR : O_RDONLY) | O_NONBLOCK;
+        //        if (ofp->direct)
+        //            flags |= O_DIRECT;
+        //        if (ofp->excl)
+        //            flags |= O_EXCL;
+        //        if (ofp->dsync)
+        //            flags |= O_SYNC;
+        if ((outfd = open(outf, flags)) < 0)
+        {
+            snprintf(ebuff, EBUFF_SZ,
+                     ME "could not open %s for sg reading", outf);
+            perror(ebuff);
+            goto file_err;
+        }
+        if (verbose)
+            pr2serr("        open output(sg_io), flags=0x%x\n", flags);
+        if (sg_simple_inquiry(outfd, &sir, 0, verb))
+        {
+            pr2serr("INQUIRY failed on %s\n", outf);
+            goto other_err;
+        }
+        ofp->pdt = sir.peripheral_type;
+        profile_key(dp->model_key, sir.vendor, 8, sir.product, 16,
+                    sir.revision, 4);
+        scsi_dev_id(dp, outfd);
+        if (verbose)
+            pr2serr("    %s: %.8s  %.16s  %.4s  [pdt=%d]\n", outf, sir.vendor,
+                    sir.product, sir.revision, ofp->pdt);
+        if (!(FT_BLOCK & *out_typep))
+        {
+            sg_resbuf(outfd, dp->blk_sz * bpt);
+            res = ioctl(outfd, SG_GET_VERSION_NUM, &t);
+            if ((res < 0) || (t < 30000))
+            {
+                pr2serr(ME "sg driver prior to 3.x.y\n");
+                goto file_err;
+            }
+            dp->sg_version = t;
+            if (dp->mrq && (t < SG_MRQ_MIN_VERSION))
+            {
+                pr2serr(ME "%s: sg driver %d.%d.%d has no multiple request "
+                           "support, using v3 interface\n", outf, t / 10000,
+                        (t / 100) % 100, t % 100);
+                dp->mrq = 0;
+            }
+        }
+        else
+            dp->mrq = 0; /* SG_IO on a block device: v3 only */
+    }
+    else if (FT_BLOCK & *out_typep)
+    {
+        flags = (ofp->write ? O_RDWR : O_RDONLY) | O_DIRECT;
+        outfd = open(outf, flags);
+        if ((outfd < 0) && (EINVAL == errno) && (FT_FILE & *out_typep))
+        {
+            /* tmpfs and some FUSE filesystems take no O_DIRECT */
+            flags &= ~O_DIRECT;
+            outfd = open(outf, flags);
+            if (outfd >= 0)
+                pr2serr("%s: no O_DIRECT on its filesystem, reading "
+                        "through the page cache\n", outf);
+        }
+        if (outfd < 0)
+        {
+            snprintf(ebuff, EBUFF_SZ,
+                     ME "could not open %s for direct reading", outf);
+            perror(ebuff);
+            goto file_err;
+        }
+        if (verbose)
+            pr2serr("        open output(%s), flags=0x%x\n",
+                    (FT_FILE & *out_typep) ? "file" : "block", flags);
+        dp->mrq = 0;
+        /* SCSI disks answer INQUIRY through SG_IO on the block device */
+        if (!(FT_FILE & *out_typep) &&
+            (0 == sg_simple_inquiry(outfd, &sir, false, 0)))
+        {
+            profile_key(dp->model_key, sir.vendor, 8, sir.product, 16,
+                        sir.revision, 4);
+            scsi_dev_id(dp, outfd);
+        }
+    }
+    else
+        outfd = -1;
+lock:
+    if (__atomic_load_n(&hostco_on, __ATOMIC_RELAXED) && dev_claim(dp, outfd))
+    {
+        dev_close(outfd);
+        return -SG_LIB_FLOCK_ERR;
+    }
+    if (ofp->flock)
+    {
+        res = flock(outfd, LOCK_EX | LOCK_NB);
+        if (res < 0)
+        {
+            dev_close(outfd);
+            snprintf(ebuff, EBUFF_SZ, ME "flock(LOCK_EX | LOCK_NB) on %s "
+                                         "failed",
+                     outf);
+            perror(ebuff);
+            return -SG_LIB_FLOCK_ERR;
+        }
+    }
+    return outfd;
+
+file_err:
+    return -SG_LIB_FILE_ERROR;
+other_err:
+    return -SG_LIB_CAT_OTHER;
+}
+
+typedef enum
+{
+    WIPEMODE_NORMAL,
+    WIPEMODE_JEFFERY
+} WipeMode;
+
+struct _opt
+{
+    unsigned int passes;
+    WipeMode mode;
+    bool yes;
+    unsigned int sectors;
+    int64_t start;
+    int64_t end;
+    bool read;
+    unsigned int help;
+    bool kilobyte;
+    unsigned int refresh;
+    bool ignore;
+    bool checksum;
+    int nretries;
+    int qd;
+    int mrq;
+    uint64_t seed;
+    int rings;
+    unsigned int uring_setup;
+    bool tune;
+    char *profile_path;
+    bool dverify;
+    bool dcompare;
+    int lba_status;
+    bool zones;
+    bool allocated;       /* --allocated: in use by partitions and filesystems */
+    bool array;           /* --array: md members in lockstep */
+    double slow_ms;
+    double slow_mult;
+    char *weak_path;
+    char *heat_path;
+    char *json_path;
+    char *log_dir;       /* --log-dir, a file of each device's table */
+    bool sync_output;    /* --sync-output: no sinks for stdout, stderr */
+    size_t output_buf;   /* --output-buf bytes of each sink, 0 default */
+    bool coordinate;     /* --coordinate: with the other runs of the host */
+    int mtype;           /* --media-type MTYPE_*, -1 -> each device's own */
+    bool sectors_set;    /* -n given, over the media type's */
+    bool qd_set;         /* --qd given */
+    char *coord_name;    /* its shm segment, NULL -> HOSTCO_NAME */
+    char *live_path;
+    int metrics_port;
+    char *metrics_path;
+    char *bad_path;
+    char *bad_text_path;
+    char *retest_path;
+    char *ranges_path;    /* --ranges, extents to read */
+    char *ck_path;
+    bool resume;
+    bool triage;
+    int deadline_ms;     /* a READ still queued this long is aborted */
+    int deadline_resets; /* missed deadlines per LU reset, 0 -> none */
+    int cdl;             /* --cdl duration limit descriptor, 0 -> none */
+    int cdl_ms;          /* its active time set, 0 -> as the drive has it */
+    bool background;     /* idle I/O priority, lowest command priority */
+    double max_bps;      /* --max-rate per device, 0 -> no cap */
+    double max_iops;
+    double total_bps;    /* --total-rate of all devices */
+    double total_iops;
+    char *rate_path;     /* --rate-file, re-read when it changes */
+    uint64_t qd_target_ns; /* --adaptive-qd p99, 0 -> the depth is fixed */
+    int event_threads;   /* --event-threads, 0 -> a thread per device */
+    int per_host;        /* --per-host devices in a pass, 0 -> all */
+    int burst;           /* --burst READs a device takes caps for, 0 -> auto */
+    double host_bps;     /* --host-rate of the devices of one adapter */
+    double host_iops;
+    bool fan_out;        /* --fan-out: controllers and targets, all of them */
+    double target_bps;   /* --target-rate of those of one of them */
+    double target_iops;
+    int spin_up;         /* --spin-up drives of an enclosure at once */
+    int spin_gap_ms;     /* between two of them */
+    int probe_jobs;      /* --probe-jobs devices probed at once */
+    bool all;            /* --all disks of the system */
+    char *vendor_pat;    /* --vendor, --model, --transport glob, !glob */
+    char *model_pat;
+    char *transport_pat;
+    double size_min;     /* --size bytes, 0 -> any */
+    double size_max;
+    int media;           /* MEDIA_*, 0 -> the drive cache may serve READs */
+    bool prefetch;       /* --prefetch hints ahead of the READs */
+    bool sgl;            /* --sgl scatter lists for large READs */
+    int poll_us;         /* --poll spin per wait, 0 -> sleep at once */
+    int write;           /* WRITE_*, 0 -> only read */
+    int64_t write_lag;   /* --write bytes the READs trail by */
+    int write_bytchk;    /* --write=verify:1, the drive compares the data */
+    bool pipe;           /* --pipeline: the write passes one behind the other */
+    int64_t pipe_dist;   /* bytes a pass of --pipeline keeps behind */
+    int erase;           /* ERASE_*, 0 -> none */
+    int offload;         /* OFFLOAD_*, 0 -> the host reads */
+    int flush;           /* FLUSH_* of the write modes */
+    int64_t flush_every; /* FLUSH_EVERY: bytes between flushes */
+    int streams;         /* --streams, regions per pass, 0 -> none */
+    char *clone_path;    /* --clone, the destination */
+    int clone_qd;        /* --clone-qd, 0 -> as --qd */
+    bool clone_verify;   /* --clone-verify */
+    int clone_via;       /* --clone-via, CLONE_* */
+    char *compare_path;  /* --compare, the other side */
+    char *image_path;    /* --image, - -> stdout */
+    bool image_rle;      /* --image-rle */
+    int image_level;     /* --image-zstd level, 0 -> no zstd */
+    int image_threads;   /* and worker threads */
+    bool crc;            /* --crc */
+    char *manifest_path; /* --manifest */
+    char *manifest_old;  /* --manifest-check */
+    int64_t manifest_extent; /* --manifest-extent bytes, 0 -> default */
+    char *manifest_diff; /* --manifest-diff a,b */
+    bool stable;         /* --stable */
+    char *diff_path;     /* --diff-dump */
+    int diff_sectors;    /* --diff-sectors */
+    bool pi;             /* --pi */
+    uint16_t pi_app;     /* application tag expected, */
+    uint16_t pi_mask;    /* of these bits, 0 -> not checked */
+    uint64_t run_id;     /* --run-id, in the stamp of s passes */
+    double sample;       /* --sample: bad fraction to bound, 0 -> off, */
+    double sample_conf;  /* at this confidence */
+    double time_limit;   /* --time-limit, seconds, 0 -> none */
+    int64_t coarse;      /* --coarse, MiB between the first windows, 0 ->
+                          * lba order */
+    int64_t max_errors;  /* --max-errors, blocks, 0 -> no limit */
+    double stress;       /* --stress, seconds a pass, 0 -> verify passes */
+    int stress_mix;      /* --mix, percent of them WRITEs */
+    int bs_n;            /* --bs-split: sizes, 0 -> -n blocks, */
+    double bs_size[STRESS_SIZES]; /* bytes each, */
+    int bs_weight[STRESS_SIZES];  /* and how often */
+    const char *job_path; /* --job */
+    const char *ctl_path; /* --control socket */
+    const char *agent;    /* --agent host:port of the coordinator */
+    int coord_port;       /* --coordinator, 0 -> none, */
+    int coord_agents;     /* and the agents it waits for */
+    double power;         /* --power watts of the lab, 0 -> no budget */
+    const char *baseline_path; /* --baseline fleet file, NULL -> none */
+    double baseline_k;    /* sigmas off it a drive is flagged */
+    const char *trace_path; /* --trace binary record of every command */
+    char *trace_export;   /* --trace-export f[,chrome] */
+    bool plan;            /* --plan: probe and print the schedule, no scan */
+    const char *results_path; /* --results store, NULL -> none */
+    char *results_query;  /* --results-query id[,n] */
+    bool rec_zones;       /* --rec-zones: a summary by recording zone */
+    const char *rz_table; /* --rec-zones=f zone table, NULL -> inferred */
+    double drift_pct;     /* --drift: smallest step kept, 0 -> off */
+    int health_s;         /* --health seconds between samples, 0 -> none */
+    bool defects;         /* --defects grown list and recoveries a pass */
+    bool sat;             /* --sat: ATA READ VERIFY for --device-verify */
+    int64_t bench;        /* --bench bytes read per setting, 0 -> scan */
+    int seek;             /* --seek-probe SEEK_*, 0 -> scan */
+    int64_t seek_stride;  /* blocks, of stride=b */
+    int seek_cmds;        /* timed commands of a line */
+    bool cache_probe;     /* --cache-probe instead of the passes */
+    bool cost;            /* --cost: CPU and memory traffic a pass */
+    double stream_mbps;   /* --stream MB/s of all devices, 0 -> never */
+    int multipath;        /* MPATH_* */
+    bool actuators;       /* --actuators: a READ stream per actuator */
+    int elements;         /* ELEM_*, 0 -> not asked for */
+    int sg_fds;           /* --sg-fds of an sg node, -1 -> one per --qd */
+    int64_t retest_gap;   /* --retest-gap blocks, -1 -> a transfer */
+    bool scrub;           /* --scrub: the passes again until stopped */
+    char *dirty_path;     /* --dirty feed of the extents written */
+    int dirty_settle_s;   /* and the seconds each is left to settle */
+    double idle_pct;      /* --idle: foreground busy % READs yield to */
+    int idle_ms;          /* and how often it is sampled */
+};
+
+typedef struct _opt t_opt;
+
+static t_opt opt = {
+    0,                       /* passes */
+    WIPEMODE_NORMAL,         /* normal, dod, dod7, gutmann */
+    false,                   /* yes */
+    DEF_BLOCKS_PER_TRANSFER, /* sectors */
+    0,                       /* start */
+    0,                       /* end */
+    false,                   /* read */
+    0,                       /* help */
+    false,                   /* kilobyte */
+    5,                       /* refresh */
+    false,                   /* ignore */
+    false,                   /* check sum calc */
+    2,                       /* nRetry if write error.*/
+    DEF_QUEUE_DEPTH,         /* qd: reads in flight per device */
+    0,                       /* mrq: reads per sg v4 batch, 0 -> off */
+    DEF_RANDOM_SEED,         /* seed of the random pattern passes */
+    1,                       /* rings: io_uring lanes per device */
+    0,                       /* uring_setup: --sqpoll, --iopoll */
+    false,                   /* tune: calibrate bpt and qd per device */
+    NULL,                    /* profile_path: $HOME/DEF_PROFILE_FILE */
+    false,                   /* dverify: VERIFY(16) the media, no data in */
+    false,                   /* dcompare: VERIFY(16) BYTCHK=3 with the pattern */
+    0,                       /* lba_status: LBA_STATUS_MAPPED, _DEALLOC */
+    false,                   /* zones: read only below the write pointers */
+    false,                   /* allocated: --allocated */
+    false,                   /* array: --array */
+    0,                       /* slow_ms: --slow n, a READ slower is hunted */
+    0,                       /* slow_mult: --slow Nx, of the running median */
+    NULL,                    /* weak_path: --weak-report, else stderr */
+    NULL,                    /* heat_path: --heatmap CSV */
+    NULL,                    /* json_path: --json records */
+    NULL,                    /* log_dir: --log-dir */
+    false,                   /* sync_output: --sync-output */
+    0,                       /* output_buf: --output-buf */
+    false,                   /* coordinate: --coordinate */
+    -1,                      /* mtype: --media-type */
+    false,                   /* sectors_set: -n */
+    false,                   /* qd_set: --qd */
+    NULL,                    /* coord_name: --coordinate=n */
+    NULL,                    /* live_path: --live-stats shm name or file */
+    0,                       /* metrics_port: --metrics-port, 0 -> off */
+    NULL,                    /* metrics_path: --metrics-file textfile */
+    NULL,                    /* bad_path: --bad-map binary map */
+    NULL,                    /* bad_text_path: --bad-map-text */
+    NULL,                    /* retest_path: --retest, map to re-read */
+    NULL,                    /* ranges_path: --ranges */
+    NULL,                    /* ck_path: --checkpoint file */
+    false,                   /* resume: continue from ck_path */
+    false,                   /* triage: coarse pass, then the failed extents */
+    0,                       /* deadline_ms: --deadline, 0 -> none */
+    DEF_DEADLINE_RESETS,     /* deadline_resets: --deadline-resets */
+    0,                       /* cdl: --cdl descriptor */
+    0,                       /* cdl_ms: --cdl :ms */
+    false,                   /* background: --background */
+    0,                       /* max_bps: --max-rate bytes/s */
+    0,                       /* max_iops: --max-rate :READs/s */
+    0,                       /* total_bps: --total-rate bytes/s */
+    0,                       /* total_iops: --total-rate :READs/s */
+    NULL,                    /* rate_path: --rate-file */
+    0,                       /* qd_target_ns: --adaptive-qd */
+    0,                       /* event_threads: --event-threads */
+    0,                       /* per_host: --per-host */
+    0,                       /* burst: --burst */
+    0,                       /* host_bps: --host-rate bytes/s */
+    0,                       /* host_iops: --host-rate :READs/s */
+    false,                   /* fan_out: --fan-out */
+    0,                       /* target_bps: --target-rate bytes/s */
+    0,                       /* target_iops: --target-rate :READs/s */
+    0,                       /* spin_up: --spin-up n, 0 -> no START */
+    0,                       /* spin_gap_ms: --spin-up :ms */
+    DEF_PROBE_JOBS,          /* probe_jobs: --probe-jobs */
+    false,                   /* all: --all */
+    NULL,                    /* vendor_pat: --vendor */
+    NULL,                    /* model_pat: --model */
+    NULL,                    /* transport_pat: --transport */
+    0,                       /* size_min: --size min */
+    0,                       /* size_max: --size :max, 0 -> any */
+    0,                       /* media: --media */
+    false,                   /* prefetch: --prefetch */
+    false,                   /* sgl: --sgl */
+    0,                       /* poll_us: --poll */
+    0,                       /* write: --write */
+    DEF_WRITE_LAG,           /* write_lag: --write=bytes */
+    0,                       /* write_bytchk: --write=verify:1 */
+    false,                   /* pipe: --pipeline */
+    DEF_PIPE_DIST,           /* pipe_dist: --pipeline=bytes */
+    0,                       /* erase: --erase */
+    0,                       /* offload: --offload */
+    FLUSH_END,               /* flush: --flush */
+    0,                       /* flush_every: --flush=bytes */
+    0,                       /* streams: --streams */
+    NULL,                    /* clone_path: --clone */
+    0,                       /* clone_qd: --clone-qd */
+    false,                   /* clone_verify: --clone-verify */
+    CLONE_AUTO,              /* clone_via: --clone-via */
+    NULL,                    /* compare_path: --compare */
+    NULL,                    /* image_path: --image */
+    false,                   /* image_rle: --image-rle */
+    0,                       /* image_level: --image-zstd */
+    0,                       /* image_threads: --image-zstd */
+    false,                   /* crc: --crc */
+    NULL,                    /* manifest_path: --manifest */
+    NULL,                    /* manifest_old: --manifest-check */
+    0,                       /* manifest_extent: --manifest-extent */
+    NULL,                    /* manifest_diff: --manifest-diff */
+    false,                   /* stable: --stable */
+    NULL,                    /* diff_path: --diff-dump */
+    DEF_DIFF_SECTORS,        /* diff_sectors: --diff-sectors */
+    false,                   /* pi: --pi */
+    0,                       /* pi_app */
+    0,                       /* pi_mask */
+    0,                       /* run_id: --run-id */
+    0.0,                     /* sample: --sample */
+    DEF_SAMPLE_CONF,         /* sample_conf */
+    0.0,                     /* time_limit: --time-limit */
+    0,                       /* coarse: --coarse */
+    0,                       /* max_errors: --max-errors */
+    0.0,                     /* stress: --stress */
+    0,                       /* stress_mix: --mix */
+    0,                       /* bs_n: --bs-split */
+    {0},                     /* bs_size */
+    {0},                     /* bs_weight */
+    NULL,                    /* job_path: --job */
+    NULL,                    /* ctl_path: --control */
+    NULL,                    /* agent: --agent */
+    0,                       /* coord_port: --coordinator */
+    1,                       /* coord_agents */
+    0.0,                     /* power: --power */
+    NULL,                    /* baseline_path: --baseline */
+    DEF_BASELINE_K,          /* baseline_k */
+    NULL,                    /* trace_path: --trace */
+    NULL,                    /* trace_export: --trace-export */
+    false,                   /* plan: --plan */
+    NULL,                    /* results_path: --results */
+    NULL,                    /* results_query: --results-query */
+    false,                   /* rec_zones: --rec-zones */
+    NULL,                    /* rz_table: --rec-zones=f */
+    0,                       /* drift_pct: --drift */
+    0,                       /* health_s: --health */
+    false,                   /* defects: --defects */
+    false,                   /* sat: --sat */
+    0,                       /* bench: --bench, 0 -> scan */
+    0,                       /* seek: --seek-probe, 0 -> scan */
+    0,                       /* seek_stride: --seek-probe stride=b */
+    SEEK_DEF_CMDS,           /* seek_cmds: --seek-probe p:n */
+    false,                   /* cache_probe: --cache-probe */
+    false,                   /* cost: --cost */
+    DEF_STREAM_MBPS,         /* stream_mbps: --stream */
+    MPATH_LQ,                /* multipath: --multipath */
+    true,                    /* actuators: --actuators */
+    0,                       /* elements: --elements */
+    1,                       /* sg_fds: --sg-fds */
+    -1,                      /* retest_gap: --retest-gap */
+    false,                   /* scrub: --scrub */
+    NULL,                    /* dirty_path: --dirty */
+    DIRTY_SETTLE_S,          /* dirty_settle_s: --dirty :s */
+    0,                       /* idle_pct: --idle, 0 -> never held */
+    DEF_IDLE_MS,             /* idle_ms: --idle pct:ms */
+};
+
+/* The *_ticks of t_stats and t_dev: CLOCK_MONOTONIC ns, of which a
+ * pass of under a second still has its MB/s. */
+#define TICKS_PER_SEC 1000000000LL
+
+static int64_t
+get_ticks(t_stats *stats)
+{
+    return (int64_t)lat_now_ns();
+}
+
+static char *seconds_to_hhmmss(uint seconds, char *rv, int bufsiz)
+{
+    uint hours = seconds / 3600;
+    seconds -= hours * 3600;
+
+    uint minutes = seconds / 60;
+    seconds -= minutes * 60;
+
+    if (hours > 99)
+    {
+        uint days = hours / 24;
+        hours -= days * 24;
+        if (days > 99)
+        {
+            snprintf(rv, bufsiz, "%03dd %02dh", days, hours);
+            return rv;
+        }
+        snprintf(rv, bufsiz, "%02dd%02d%02d", days, hours, minutes);
+        return rv;
+    }
+
+    snprintf(rv, bufsiz, "%02d:%02d:%02d", hours, minutes, seconds);
+
+    return rv;
+}
+
+/* Publishes dp's counters in its --live-stats record. */
+static void
+live_update(t_dev *dp, int state, unsigned int pass, int64_t lba,
+            double mbps, double pass_mbps)
+{
+    struct livestat_dev *d;
+
+    if (NULL == live)
+        return;
+    d = live->dev + (dp - devs);
+    livestat_begin(d);
+    d->state = state;
+    d->result = dp->res;
+    d->pass = pass;
+    d->passes = opt.passes;
+    d->start = dp->start;
+    d->end = dp->end;
+    d->lba = lba;
+    d->bytes_done = __atomic_load_n(&dp->bytes_done, __ATOMIC_RELAXED);
+    d->mbps = mbps;
+    d->pass_mbps = pass_mbps;
+    d->recovered = CTR_GET(dp, recovered);
+    d->unrecovered = CTR_GET(dp, unrecovered);
+    d->mismatches = dp->mismatches;
+    d->weak_sectors = dp->weak_sectors;
+    d->update_ns = lat_now_ns();
+    snprintf(d->device, sizeof(d->device), "%s", dp->device_name);
+    livestat_end(d);
+}
+
+/* Upper bounds of the OpenMetrics latency histogram buckets, in s. */
+static const double metrics_le[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025,
+                                    0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5,
+                                    1, 2.5, 5, 10};
+
+/* One OpenMetrics family of an int64 per device. */
+#define METRIC_FAMILY(fp, name, type, help, expr)                              \
+    do                                                                         \
+    {                                                                          \
+        int k_;                                                                \
+        fprintf(fp, "# TYPE dskread_%s %s\n# HELP dskread_%s %s\n", name,     \
+                type, name, help);                                             \
+        for (k_ = 0; k_ < num_devs; ++k_)                                      \
+        {                                                                      \
+            const t_dev *dp = devs + k_;                                       \
+            char name_[PATH_MAX];                                              \
+                                                                               \
+            fprintf(fp, "dskread_%s%s{device=\"%s\"} %" PRId64 "\n", name,    \
+                    strcmp(type, "counter") ? "" : "_total",                   \
+                    jsonl_escape(name_, sizeof(name_), dp->device_name),       \
+                    (int64_t)(expr));                                          \
+        }                                                                      \
+    } while (0)
+
+/* Renders every device for --metrics-port/--metrics-file. Counters are
+ * read without locks, a scrape may be a command behind. */
+static void
+metrics_render(FILE *fp)
+{
+    double now = get_ticks(NULL);
+    int k, b;
+
+    METRIC_FAMILY(fp, "read_bytes", "counter", "Bytes read and checked.",
+                  __atomic_load_n(&dp->bytes_done, __ATOMIC_RELAXED));
+    METRIC_FAMILY(fp, "recovered_errors", "counter",
+                  "Recovered errors reported by the device.",
+                  CTR_GET(dp, recovered));
+    METRIC_FAMILY(fp, "unrecovered_errors", "counter",
+                  "Unrecovered read errors.", CTR_GET(dp, unrecovered));
+    METRIC_FAMILY(fp, "retries", "counter", "READs retried.",
+                  CTR_GET(dp, retries));
+    METRIC_FAMILY(fp, "mismatches", "counter",
+                  "READs whose data was not the pattern.", dp->mismatches);
+    METRIC_FAMILY(fp, "weak_sectors", "counter",
+                  "Blocks slower than --slow.", dp->weak_sectors);
+    METRIC_FAMILY(fp, "passes", "gauge", "Passes of the run.", opt.passes);
+    METRIC_FAMILY(fp, "done", "gauge", "1 once the device is finished.",
+                  __atomic_load_n(&dp->done, __ATOMIC_ACQUIRE));
+    if (opt.scrub)
+    {
+        METRIC_FAMILY(fp, "scrub_cycles", "counter",
+                      "Times --scrub read the device in full.",
+                      dp->scrub_cycles);
+        METRIC_FAMILY(fp, "scrub_coverage_age_seconds", "gauge",
+                      "Since --scrub last read the device in full, -1 "
+                      "never.",
+                      dp->scrub_full ? (int64_t)time(NULL) - dp->scrub_full
+                                     : -1);
+    }
+
+    fprintf(fp, "# TYPE dskread_progress_ratio gauge\n# HELP dskread_progress_"
+                "ratio Share of all passes read.\n");
+    for (k = 0; k < num_devs; ++k)
+    {
+        const t_dev *dp = devs + k;
+        char name[PATH_MAX];
+        double total = (double)(dp->end - dp->start) * dp->blk_sz * opt.passes;
+
+        fprintf(fp, "dskread_progress_ratio{device=\"%s\"} %.6f\n",
+                jsonl_escape(name, sizeof(name), dp->device_name),
+                (total > 0) ? __atomic_load_n(&dp->bytes_done,
+                                              __ATOMIC_RELAXED) / total
+                            : 0.0);
+    }
+    fprintf(fp, "# TYPE dskread_throughput_bytes_per_second gauge\n# HELP "
+                "dskread_throughput_bytes_per_second Average since the start."
+                "\n");
+    for (k = 0; k < num_devs; ++k)
+    {
+        const t_dev *dp = devs + k;
+        char name[PATH_MAX];
+        double secs = (now - dp->stats.start_ticks) / TICKS_PER_SEC;
+
+        fprintf(fp, "dskread_throughput_bytes_per_second{device=\"%s\"} "
+                "%.0f\n", jsonl_escape(name, sizeof(name), dp->device_name),
+                (dp->stats.start_ticks && (secs > 0))
+                    ? __atomic_load_n(&dp->bytes_done, __ATOMIC_RELAXED) / secs
+                    : 0.0);
+    }
+
+    fprintf(fp, "# TYPE dskread_command_latency_seconds histogram\n# HELP "
+                "dskread_command_latency_seconds Time from submission to "
+                "completion of each command.\n");
+    for (k = 0; k < num_devs; ++k)
+    {
+        const t_dev *dp = devs + k;
+        char name[PATH_MAX];
+        uint64_t count = dp->lat_run.count + dp->lat_pass.count;
+
+        jsonl_escape(name, sizeof(name), dp->device_name);
+        for (b = 0; b < (int)(sizeof(metrics_le) / sizeof(metrics_le[0])); ++b)
+        {
+            uint64_t ns = (uint64_t)(metrics_le[b] * 1e9);
+
+            fprintf(fp, "dskread_command_latency_seconds_bucket{device=\"%s\","
+                    "le=\"%g\"} %" PRIu64 "\n", name, metrics_le[b],
+                    lat_count_le(&dp->lat_run, ns) +
+                    lat_count_le(&dp->lat_pass, ns));
+        }
+        fprintf(fp, "dskread_command_latency_seconds_bucket{device=\"%s\","
+                "le=\"+Inf\"} %" PRIu64 "\n", name, count);
+        fprintf(fp, "dskread_command_latency_seconds_count{device=\"%s\"} %"
+                PRIu64 "\n", name, count);
+        fprintf(fp, "dskread_command_latency_seconds_sum{device=\"%s\"} %.6f"
+                "\n", name, (dp->lat_run.sum + dp->lat_pass.sum) / 1e9);
+    }
+}
+
+/* The print_stats_sg() counters of dp as JSON members. */
+static char *
+json_counters(const t_dev *dp, char *buf, int len)
+{
+    int64_t in_full = CTR_GET(dp, in_full), in_partial = CTR_GET(dp, in_partial);
+
+    snprintf(buf, len, "\"records_in\":%" PRId64 ",\"partial_in\":%" PRId64
+             ",\"recovered\":%" PRId64 ",\"unrecovered\":%" PRId64
+             ",\"retries\":%" PRId64 ",\"read_longs\":%" PRId64
+             ",\"unit_attentions\":%" PRId64 ",\"aborted\":%" PRId64
+             ",\"deadlines_missed\":%" PRId64 ",\"cdl_expired\":%" PRId64
+             ",\"queue_full\":%" PRId64
+             ",\"mismatches\":%d,\"mismatched_blocks\":%" PRId64
+             ",\"bits_up\":%" PRId64 ",\"bits_down\":%" PRId64
+             ",\"pi_ok\":%" PRId64
+             ",\"pi_guard\":%" PRId64 ",\"pi_ref\":%" PRId64
+             ",\"pi_app\":%" PRId64
+             ",\"weak_sectors\":%d"
+             ",\"dio_direct\":%" PRId64 ",\"dio_copied\":%" PRId64,
+             in_full - in_partial, in_partial, CTR_GET(dp, recovered),
+             CTR_GET(dp, unrecovered), CTR_GET(dp, retries),
+             CTR_GET(dp, read_longs), CTR_GET(dp, uas), CTR_GET(dp, aborted),
+             CTR_GET(dp, timeouts), CTR_GET(dp, cdl), CTR_GET(dp, qfull),
+             dp->mismatches, dp->mis_blocks, dp->flips_up, dp->flips_down,
+             dp->pi_ok, dp->pi_guard, dp->pi_ref, dp->pi_app,
+             dp->weak_sectors, dp->dio_done, dp->dio_copied);
+    return buf;
+}
+
+/* Latency percentiles of h as JSON members, in us. */
+static char *
+json_latency(const struct lat_hist *h, char *buf, int len)
+{
+    snprintf(buf, len, "\"commands\":%" PRIu64 ",\"p50_us\":%.1f,"
+             "\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f",
+             h->count, lat_percentile(h, 50.0) / 1e3,
+             lat_percentile(h, 99.0) / 1e3, lat_percentile(h, 99.9) / 1e3,
+             h->max / 1e3);
+    return buf;
+}
+
+/* What a pass or a run of a device cost the host. */
+typedef struct
+{
+    uint64_t cpu_ns; /* of the worker, its lanes, side queue and helpers */
+    uint64_t cycles; /* --cost perf counters of them, when dp->perf */
+    uint64_t misses; /* last level cache misses */
+    int64_t streamed; /* bytes checked by the streaming kernels */
+} t_cost;
+
+static uint64_t
+thread_cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Adds the CPU time of the calling lane or helper thread of dp to it,
+ * as the thread ends. */
+static void
+cpu_charge(t_dev *dp)
+{
+    __atomic_fetch_add(&dp->cpu_ns, thread_cpu_ns(), __ATOMIC_RELAXED);
+}
+
+static int
+perf_open(uint64_t config, bool user_only)
+{
+    struct perf_event_attr pa;
+
+    memset(&pa, 0, sizeof(pa));
+    pa.size = sizeof(pa);
+    pa.type = PERF_TYPE_HARDWARE;
+    pa.config = config;
+    pa.inherit = 1; /* threads started later, folded in as they exit */
+    pa.exclude_kernel = user_only;
+    pa.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &pa, 0, -1, -1,
+                        PERF_FLAG_FD_CLOEXEC);
+}
+
+/* --cost: cycles and cache misses of the calling worker thread and the
+ * threads it starts from now on. Without them, CPU time only. */
+static void
+cost_open(t_dev *dp)
+{
+    static int warned;
+    bool user_only;
+
+    dp->perf = false;
+    dp->perf_fd[0] = dp->perf_fd[1] = -1;
+    if (!opt.cost)
+        return;
+    /* perf_event_paranoid 2 leaves the user side, the copies of the sg
+     * driver and the page cache are then not in it */
+    for (user_only = false; !dp->perf; user_only = true)
+    {
+        dp->perf_fd[0] = perf_open(PERF_COUNT_HW_CPU_CYCLES, user_only);
+        dp->perf_fd[1] = perf_open(PERF_COUNT_HW_CACHE_MISSES, user_only);
+        dp->perf = (dp->perf_fd[0] >= 0) && (dp->perf_fd[1] >= 0);
+        if (!dp->perf)
+        {
+            if (dp->perf_fd[0] >= 0)
+                close(dp->perf_fd[0]);
+            if (dp->perf_fd[1] >= 0)
+                close(dp->perf_fd[1]);
+            dp->perf_fd[0] = dp->perf_fd[1] = -1;
+        }
+        if (user_only)
+            break;
+    }
+    if (!dp->perf && !__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED))
+        pr2serr("--cost: perf_event_open: %s, CPU time only\n",
+                safe_strerror(errno));
+}
+
+static void
+cost_close(t_dev *dp)
+{
+    if (!dp->perf)
+        return;
+    close(dp->perf_fd[0]);
+    close(dp->perf_fd[1]);
+    dp->perf = false;
+}
+
+/* The cost of dp so far into *c. Called on its worker thread. */
+static void
+cost_sample(t_dev *dp, t_cost *c)
+{
+    uint64_t v;
+
+    c->cpu_ns = thread_cpu_ns() + __atomic_load_n(&dp->cpu_ns,
+                                                  __ATOMIC_RELAXED);
+    c->streamed = __atomic_load_n(&dp->stream_bytes, __ATOMIC_RELAXED);
+    c->cycles = c->misses = 0;
+    if (!dp->perf)
+        return;
+    if (sizeof(v) == read(dp->perf_fd[0], &v, sizeof(v)))
+        c->cycles = v;
+    if (sizeof(v) == read(dp->perf_fd[1], &v, sizeof(v)))
+        c->misses = v;
+}
+
+/* What is done with the blocks read, the mode a cost is of. */
+static const char *
+cost_mode(void)
+{
+    if (opt.stress > 0)
+        return "stress";
+    if (opt.compare_path)
+        return "compare";
+    if (opt.clone_path || opt.image_path)
+        return "clone";
+    if (WRITE_WV == opt.write)
+        return "write-verify";
+    if (opt.write)
+        return "write";
+    if (opt.dcompare)
+        return "device-compare";
+    if (opt.dverify)
+        return "device-verify";
+    return "read";
+}
+
+/* The cost from c0 to c1 of bytes verified, as JSON members. A cache
+ * miss is taken as a line of memory traffic. */
+static char *
+json_cost(const t_dev *dp, const t_cost *c0, const t_cost *c1, int64_t bytes,
+          char *buf, int len)
+{
+    double secs = (c1->cpu_ns - c0->cpu_ns) / 1e9;
+    int n;
+
+    n = snprintf(buf, len, "\"cost\":{\"mode\":\"%s\",\"cpu_seconds\":%.3f,"
+                 "\"cpu_s_per_tb\":%.2f", cost_mode(), secs,
+                 (bytes > 0) ? secs * 1e12 / bytes : 0.0);
+    if (dp->perf && (n < len))
+        n += snprintf(buf + n, len - n, ",\"cycles\":%" PRIu64 ",\"llc_misses"
+                      "\":%" PRIu64 ",\"mem_bytes_per_byte\":%.3f",
+                      c1->cycles - c0->cycles, c1->misses - c0->misses,
+                      (bytes > 0) ? (double)(c1->misses - c0->misses) *
+                                        CACHE_LINE_SZ / bytes
+                                  : 0.0);
+    if (n < len)
+        snprintf(buf + n, len - n, ",\"streamed_bytes\":%" PRId64 "}",
+                 c1->streamed - c0->streamed);
+    return buf;
+}
+
+/* --cost: the line of what of dp which cost, from c0 to c1 over secs. */
+static void
+print_cost(const t_dev *dp, const char *what, const char *which,
+           const t_cost *c0, const t_cost *c1, int64_t bytes, double secs)
+{
+    double cpu = (c1->cpu_ns - c0->cpu_ns) / 1e9;
+
+    if (!opt.cost)
+        return;
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: %s %s %s cost %.3f CPU s, %.2f CPU s/TB, %.0f%% of a "
+           "core", dp->device_name, what, which, cost_mode(), cpu,
+           (bytes > 0) ? cpu * 1e12 / bytes : 0.0,
+           (secs > 0) ? 100.0 * cpu / secs : 0.0);
+    if (dp->perf && (bytes > 0))
+        printf(", %.2f cycles/B, %.3f B of memory traffic per B verified",
+               (double)(c1->cycles - c0->cycles) / bytes,
+               (double)(c1->misses - c0->misses) * CACHE_LINE_SZ / bytes);
+    if ((c1->streamed > c0->streamed) && (bytes > 0))
+        printf(", %.0f%% checked streaming", 100.0 *
+               (c1->streamed - c0->streamed) / bytes);
+    printf("\n");
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* The zone of lba, TL_ZONES of them over [start, end). */
+static int
+zone_of(const t_dev *dp, int64_t lba)
+{
+    int64_t range = dp->end - dp->start;
+    int z;
+
+    if (range <= 0)
+        return 0;
+    z = (int)((__int128)(lba - dp->start) * TL_ZONES / range);
+    return (z < 0) ? 0 : (z >= TL_ZONES) ? TL_ZONES - 1 : z;
+}
+
+/* Blocks of zone z. */
+static int64_t
+zone_len(const t_dev *dp, int z)
+{
+    int64_t range = dp->end - dp->start;
+
+    return (int64_t)((__int128)range * (z + 1) / TL_ZONES -
+                     (__int128)range * z / TL_ZONES);
+}
+
+/* A READ of blocks at lba done: the time since the one before, of any
+ * thread, goes to its zone. With READs queued that is the rate the zone
+ * is read at, not one command's latency. Gaps of over a second, a pause
+ * or a pass starting, are not counted. Returns the time counted, 0 when
+ * none was. */
+static uint64_t
+zone_done(t_dev *dp, int64_t lba, int blocks)
+{
+    uint64_t now = lat_now_ns();
+    uint64_t last = __atomic_exchange_n(&dp->zone_last_ns, now,
+                                        __ATOMIC_RELAXED);
+    int64_t bytes = (int64_t)blocks * dp->blk_sz;
+    int z = zone_of(dp, lba);
+
+    __atomic_fetch_add(&dp->zone_pass[z], bytes, __ATOMIC_RELAXED);
+    if ((0 == last) || (now < last) || (now - last > 1000000000ULL))
+        return 0;
+    __atomic_fetch_add(&dp->zone_bytes[z], bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dp->zone_ns[z], now - last, __ATOMIC_RELAXED);
+    return now - last;
+}
+
+/* The bytes zone_done() counted of zone z so far, *ns the time they
+ * took; the I/O threads may be adding to both. */
+static int64_t
+zone_read(const t_dev *dp, int z, uint64_t *ns)
+{
+    *ns = __atomic_load_n(&dp->zone_ns[z], __ATOMIC_RELAXED);
+    return __atomic_load_n(&dp->zone_bytes[z], __ATOMIC_RELAXED);
+}
+
+/* The point of the model's throughput curve at the middle of zone z,
+ * percent of its fastest; 0 when the profile has no curve. */
+static double
+zone_curve(const t_dev *dp, int z)
+{
+    int64_t mid = dp->start + (int64_t)((__int128)(dp->end - dp->start) *
+                                        (2 * z + 1) / (2 * TL_ZONES));
+    int k;
+
+    if (!dp->have_profile || (0 == dp->profile.curve[0]) ||
+        (dp->num_sect <= 0))
+        return 0.0;
+    k = (int)((__int128)mid * PROFILE_CURVE / dp->num_sect);
+    return dp->profile.curve[(k < 0) ? 0
+                             : (k >= PROFILE_CURVE) ? PROFILE_CURVE - 1 : k];
+}
+
+/* Bytes a second zone z is read at. One not read yet takes the rate of
+ * the nearest that was, scaled by the model's throughput curve between
+ * the two when the profile has one, so that the inner tracks of a disk
+ * read on its outer ones are not taken as fast; before any zone was
+ * read, the profile's baseline on its curve. 0 when nothing is known. */
+static double
+zone_rate(const t_dev *dp, int z)
+{
+    double cz = zone_curve(dp, z), cy;
+    int64_t bytes;
+    uint64_t ns;
+    int d, y;
+
+    for (d = 0; d < TL_ZONES; ++d)
+        for (y = z - d; y <= z + d; y += d ? 2 * d : 1)
+            if ((y >= 0) && (y < TL_ZONES) &&
+                ((bytes = zone_read(dp, y, &ns)) > 0) && ns)
+            {
+                cy = zone_curve(dp, y);
+                return bytes * 1e9 / ns * ((d && (cy > 0)) ? cz / cy : 1.0);
+            }
+    if ((cz > 0) && (dp->profile.mbps > 0))
+        return dp->profile.mbps * 1e6 * cz / 100.0; /* tuned on the outer */
+    return 0.0;
+}
+
+/* A pass over the whole device read every zone: their rates become the
+ * throughput curve of the model in the profile cache, for the estimates
+ * of the next drive of the model. Only a profile already cached, tuned
+ * or loaded, takes one. */
+static void
+zone_curve_learn(t_dev *dp)
+{
+    double rate[TL_ZONES], top = 0.0;
+    int64_t bytes;
+    uint64_t ns;
+    int z;
+
+    if (!dp->have_profile || (0 != dp->start) ||
+        (dp->end != dp->num_sect) || (TL_ZONES != PROFILE_CURVE))
+        return;
+    for (z = 0; z < TL_ZONES; ++z)
+    {
+        bytes = zone_read(dp, z, &ns);
+        if ((0 == ns) || (bytes <= 0))
+            return;
+        rate[z] = bytes * 1e9 / ns;
+        if (rate[z] > top)
+            top = rate[z];
+    }
+    for (z = 0; z < TL_ZONES; ++z)
+    {
+        int pct = (int)(100.0 * rate[z] / top + 0.5);
+
+        dp->profile.curve[z] = (unsigned char)((pct < 1) ? 1 : pct);
+    }
+    if (profile_store(opt.profile_path, dp->model_key, &dp->profile))
+        pr2serr("%s: could not update profile cache %s\n", dp->device_name,
+                opt.profile_path);
+}
+
+/* Seconds the rest of pass pass and the passes after it take at the
+ * rate of each zone, so inner tracks slower than the outer ones are
+ * not averaged away; -1 before anything was read. *fullp, when not
+ * NULL, is set to those of one whole pass. */
+static double
+zone_remaining(const t_dev *dp, unsigned int pass, double *fullp)
+{
+    double full = 0.0, left = 0.0, rate, zb;
+    int64_t got;
+    int z;
+
+    for (z = 0; z < TL_ZONES; ++z)
+    {
+        rate = zone_rate(dp, z);
+        if (rate <= 0)
+            return -1.0;
+        zb = (double)zone_len(dp, z) * dp->blk_sz;
+        got = __atomic_load_n(&dp->zone_pass[z], __ATOMIC_RELAXED);
+        full += zb / rate;
+        left += ((got < zb) ? zb - got : 0.0) / rate;
+    }
+    if (fullp)
+        *fullp = full;
+    return left + full * (((unsigned int)opt.passes > pass)
+                              ? opt.passes - pass : 0);
+}
+
+static void print_stats(t_dev *dp, unsigned int pass, char *s_byte, int64_t sector, int passescnt)
+{
+    t_stats *stats = &dp->stats;
+    int64_t starting_sector = dp->start;
+    int64_t ending_sector = dp->end;
+
+    int64_t done_sectors = (ending_sector * ((int64_t)pass - 1)) + sector;
+    int64_t total_sectors = ending_sector * (passescnt);
+
+    int64_t single_sectors = sector;
+    //int64_t single_total_sectors = ending_sector * 1;
+
+    double all_pct = (double)(int64_t)done_sectors / (double)(int64_t)total_sectors * 100.0;
+    //double single_pct = (double)(int64_t)single_sectors / (double)(int64_t)single_total_sectors * 100.0;
+
+    double remaining = 0;
+
+    double elapsed = (double)(get_ticks(stats) - stats->start_ticks) /
+                     TICKS_PER_SEC;
+
+    if (done_sectors)
+    {
+        remaining = (double)(total_sectors - done_sectors) / (double)done_sectors * elapsed;
+    }
+    double zone_secs = zone_remaining(dp, pass, NULL);
+
+    if (zone_secs >= 0)
+        remaining = zone_secs; /* per zone, not one average */
+
+    double kilo = opt.kilobyte ? 1024.0 : 1000.0;
+
+    double mb_sec = 0;
+    double mb_sec_single = 0;
+    double secondspass = 0;
+
+    if (stats->wiping_ticks)
+    {
+        int64_t bytes = done_sectors * stats->bytes_per_sector;
+        double megabytes = (double)(int64_t)bytes / (kilo * kilo);
+        double seconds = (double)stats->wiping_ticks / TICKS_PER_SEC;
+
+        int64_t bytessingle = single_sectors * stats->bytes_per_sector;
+        double megabytessingle = (double)(int64_t)bytessingle / (kilo * kilo);
+        secondspass = (double)stats->passwiping_ticks / TICKS_PER_SEC;
+
+        //printf("\nsector=%20I64d done_sectors=%20I64d bytes=%20I64d megabytes=%20.10f seconds=%20.10f\n", sector, done_sectors, bytes, megabytes, seconds);
+        if (seconds > 0)
+        {
+            mb_sec = megabytes / seconds;
+        }
+        if (secondspass > 0)
+        {
+            mb_sec_single = megabytessingle / secondspass;
+        }
+    }
+
+    sector -= starting_sector;
+    ending_sector -= starting_sector;
+
+    double this_pct = (double)(int64_t)sector / (double)(int64_t)ending_sector * 100.0;
+
+    if (sector >= ending_sector)
+    {
+        this_pct = 100.0;
+        all_pct = (double)(pass)*100.0 / (double)passescnt;
+        if (pass >= opt.passes)
+        {
+            this_pct = 100.0;
+            all_pct = 100.0;
+            remaining = 0;
+        }
+    }
+
+    char consume_time[255];
+    seconds_to_hhmmss((uint)secondspass, consume_time, sizeof(consume_time));
+
+    uint remaining_seconds = (uint)(remaining);
+
+    char remaining_time[255];
+    seconds_to_hhmmss(remaining_seconds, remaining_time, sizeof(remaining_time));
+
+    uint elapsed_seconds = (uint)(elapsed);
+
+    char elapsed_time[255];
+    seconds_to_hhmmss(elapsed_seconds, elapsed_time, sizeof(elapsed_time));
+
+    double dbsec = mb_sec;
+    if (dbsec < 1)
+        dbsec = 1;
+    int64_t tems = (int64_t)((double)(int64_t)(total_sectors * stats->bytes_per_sector) / (kilo * kilo) / (dbsec));
+
+    /* the time of day it ends, on the zone model; before that is known
+     * the total at the average rate so far */
+    char finish_time[255] = {0};
+    time_t finish = time(NULL) + (time_t)remaining;
+    struct tm ftm;
+
+    if ((zone_secs >= 0) && localtime_r(&finish, &ftm))
+        strftime(finish_time, sizeof(finish_time), "%H:%M:%S", &ftm);
+    else
+        snprintf(finish_time, sizeof(finish_time), "%08" PRId64, tems);
+
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "%.3f%% - %s - %s - %s", all_pct, remaining_time, stats->device_name, progname);
+
+    live_update(dp, LIVESTAT_RUNNING, pass, sector + starting_sector, mb_sec,
+                mb_sec_single);
+    if (jsonl_enabled())
+    {
+        char name[PATH_MAX];
+
+        jsonl_printf("{\"type\":\"progress\",\"device\":\"%s\",\"pass\":%u,"
+                     "\"passes\":%d,\"pattern\":\"%s\",\"lba\":%" PRId64 ","
+                     "\"pass_pct\":%.3f,\"all_pct\":%.3f,\"bytes\":%" PRId64 ","
+                     "\"mbps\":%.2f,\"pass_mbps\":%.2f,\"elapsed_s\":%.3f"
+                     ",\"remaining_s\":%" PRId64 ",\"finish\":%" PRId64
+                     ",%s}",
+                     jsonl_escape(name, sizeof(name), stats->device_name),
+                     pass, passescnt, s_byte, sector + starting_sector,
+                     this_pct, all_pct,
+                     __atomic_load_n(&dp->bytes_done, __ATOMIC_RELAXED),
+                     mb_sec, mb_sec_single, elapsed, (int64_t)remaining,
+                     (int64_t)finish, json_counters(dp, buf, sizeof(buf)));
+    }
+
+    pthread_mutex_lock(&out_mutex);
+    if (num_devs > 1)
+        printf("%s:\n", stats->device_name);
+    char line[256];
+    int n = snprintf(line, sizeof(line), FORMAT_STRING,
+                     pass,
+                     passescnt,
+                     s_byte,
+                     this_pct,
+                     all_pct,
+                     elapsed_time,
+                     consume_time, //remaining_time,
+                     stats->start_time,
+                     finish_time,
+                     mb_sec,
+                     mb_sec_single);
+    fputs(line, stdout);
+    fflush(stdout);
+    pthread_mutex_unlock(&out_mutex);
+    if (dp->log && (n > 0) && (n < (int)sizeof(line)))
+    {
+        line[n - 1] = '\n'; /* a line each in the file, not one redrawn */
+        outsink_write(dp->log, line, n);
+    }
+}
+
+/* Maps the sg reserved buffer, sized for one transfer of dp->bpt
+ * blocks, so READ data can be checked where the driver put it instead
+ * of being copied out to user memory first. Returns 0 on success. */
+static int
+sg_mmap_setup(t_dev *dp)
+{
+    int t, res_sz;
+    int psz = getpagesize();
+    char ebuff[EBUFF_SZ];
+    uint8_t *mp;
+
+    res_sz = dp->bpt * dp->blk_sz;
+    if (0 != (res_sz % psz)) /* round up to next page */
+        res_sz = ((res_sz / psz) + 1) * psz;
+    if (ioctl(dp->fd, SG_GET_RESERVED_SIZE, &t) < 0)
+    {
+        perror(ME "SG_GET_RESERVED_SIZE error");
+        return -1;
+    }
+    if (res_sz > t)
+    {
+        if (ioctl(dp->fd, SG_SET_RESERVED_SIZE, &res_sz) < 0)
+        {
+            perror(ME "SG_SET_RESERVED_SIZE error");
+            return -1;
+        }
+        if ((ioctl(dp->fd, SG_GET_RESERVED_SIZE, &t) < 0) || (t < res_sz))
+        {
+            pr2serr(ME "%s: reserved buffer only %d bytes, %d needed for "
+                       "mmap\n", dp->device_name, t, res_sz);
+            return -1;
+        }
+    }
+    mp = (uint8_t *)mmap(NULL, res_sz, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         dp->fd, 0);
+    if (MAP_FAILED == mp)
+    {
+        snprintf(ebuff, EBUFF_SZ, ME "error using mmap() on file: %s",
+                 dp->device_name);
+        perror(ebuff);
+        return -1;
+    }
+    dp->mmap_buf = mp;
+    dp->mmap_len = res_sz;
+    if (verbose)
+        pr2serr("      mmap-ed %d byte reserved buffer\n", res_sz);
+    return 0;
+}
+
+/* The CRC32C of len bytes of uni (0x00 or 0xff), the last length asked
+ * for each kept with its CRC in one word, so a wiped drive's chunks take
+ * it from there rather than from their data. */
+static uint32_t
+crc_uniform(int uni, size_t len)
+{
+    static uint64_t last[2]; /* len << 32 | crc, 0 none */
+    uint64_t *lp = last + (uni & 1);
+    uint64_t v = __atomic_load_n(lp, __ATOMIC_RELAXED);
+    unsigned char buf[4096];
+    uint32_t crc = 0;
+    size_t k, n;
+
+    if ((v >> 32) == len)
+        return (uint32_t)v;
+    memset(buf, uni, sizeof(buf));
+    for (k = 0; k < len; k += n)
+    {
+        n = (len - k < sizeof(buf)) ? len - k : sizeof(buf);
+        crc = crc32c(crc, buf, n);
+    }
+    if (len <= UINT32_MAX)
+        __atomic_store_n(lp, ((uint64_t)len << 32) | crc, __ATOMIC_RELAXED);
+    return crc;
+}
+
+/* --crc: adds a chunk read to the CRC32C of the pass. Its CRC is moved
+ * to the end of the range, where those of all the chunks xor to the CRC
+ * of the range, so they can come in any order and from any thread. uni
+ * is the byte a uniform chunk is all of, else -1. */
+static void
+crc_chunk(t_dev *dp, const unsigned char *data, int64_t lba, int blocks,
+          int uni)
+{
+    size_t len = (size_t)blocks * dp->blk_sz;
+    uint32_t crc = (uni >= 0) ? crc_uniform(uni, len) : crc32c(0, data, len);
+
+    crc = crc32c_combine(crc, 0, (uint64_t)(dp->end - lba - blocks) *
+                                     dp->blk_sz);
+    __atomic_fetch_xor(&dp->crc_acc, crc, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dp->crc_bytes, (int64_t)len, __ATOMIC_RELAXED);
+}
+
+/* --stable: adds a chunk read to the hashes of its grains. A block adds
+ * the XXH3-128 of its data mixed with its lba, so the sum of a grain
+ * is the same whichever pieces, threads and order it was read in, and
+ * blocks swapped within it still change it. Bit 0 stays clear for
+ * stable_taint(). A uniform chunk, uni its byte, takes the hash of its
+ * blocks from stable_begin(). */
+static void
+stable_chunk(t_dev *dp, const unsigned char *data, int64_t lba, int blocks,
+             int uni)
+{
+    int64_t g = -1, ng;
+    uint64_t sum = 0, h[2], v;
+    int k;
+
+    for (k = 0; k < blocks; ++k, ++lba, data += dp->blk_sz)
+    {
+        ng = (lba - dp->start) / dp->stab_grain;
+        if ((ng != g) && (g >= 0))
+        {
+            __atomic_fetch_add(dp->stab_cur + g, sum, __ATOMIC_RELAXED);
+            sum = 0;
+        }
+        g = ng;
+        if (uni >= 0)
+            memcpy(h, dp->stab_uni[uni & 1], sizeof(h));
+        else
+            xxh3_128(data, dp->blk_sz, h);
+        v = (h[0] ^ (uint64_t)lba) * 0x9E3779B97F4A7C15ULL;
+        sum += ((v ^ (v >> 32)) + h[1]) << 1;
+    }
+    if (g >= 0)
+        __atomic_fetch_add(dp->stab_cur + g, sum, __ATOMIC_RELAXED);
+}
+
+/* --stable: the hashes of the pass that starts, those of the first read
+ * in full kept to compare the later ones with. Returns 0, -1 when out
+ * of memory. */
+static int
+stable_begin(t_dev *dp)
+{
+    int64_t blocks = dp->end - dp->start;
+
+    if (NULL == dp->stab_cur)
+    {
+        unsigned char *blk = (unsigned char *)malloc(dp->blk_sz);
+
+        if (NULL == blk)
+            return -1;
+        memset(blk, 0x00, dp->blk_sz);
+        xxh3_128(blk, dp->blk_sz, dp->stab_uni[0]);
+        memset(blk, 0xff, dp->blk_sz);
+        xxh3_128(blk, dp->blk_sz, dp->stab_uni[1]);
+        free(blk);
+        dp->stab_grain = dp->bpt;
+        while ((blocks + dp->stab_grain - 1) / dp->stab_grain >
+               STABLE_MAX_GRAINS)
+            dp->stab_grain *= 2;
+        dp->stab_n = (blocks + dp->stab_grain - 1) / dp->stab_grain;
+        dp->stab_ref = (uint64_t *)calloc(dp->stab_n, sizeof(uint64_t));
+        dp->stab_cur = (uint64_t *)calloc(dp->stab_n, sizeof(uint64_t));
+        if ((NULL == dp->stab_ref) || (NULL == dp->stab_cur))
+        {
+            free(dp->stab_ref);
+            free(dp->stab_cur);
+            dp->stab_ref = dp->stab_cur = NULL;
+            return -1;
+        }
+    }
+    else
+        memset(dp->stab_cur, 0, dp->stab_n * sizeof(uint64_t));
+    return 0;
+}
+
+/* --stable: the end of a pass, what it read compared grain by grain
+ * with the reference pass, or kept as the reference when it is the first
+ * read in full. A grain that differs goes to the bad map as a mismatch;
+ * those not read in full by either pass are not compared, a grain the
+ * reference could not read taking the hash of the first pass that did. */
+static void
+stable_end(t_dev *dp, unsigned int pass)
+{
+    int64_t g, lba, differ = 0, compared = 0;
+    uint64_t *t;
+
+    if (NULL == dp->stab_cur)
+        return;
+    pthread_mutex_lock(&out_mutex);
+    if (dp->from != dp->start)
+        printf("%s: pass %u resumed at lba %" PRId64 ", not compared by "
+               "--stable\n", dp->device_name, pass, dp->from);
+    else if (0 == dp->stab_pass)
+    {
+        t = dp->stab_ref;
+        dp->stab_ref = dp->stab_cur;
+        dp->stab_cur = t;
+        dp->stab_pass = pass;
+        printf("%s: pass %u is the --stable reference, %" PRId64 " grains of "
+               "%" PRId64 " blocks\n", dp->device_name, pass, dp->stab_n,
+               dp->stab_grain);
+    }
+    else
+    {
+        for (g = 0; g < dp->stab_n; ++g)
+        {
+            if (dp->stab_cur[g] & 1)
+                continue;
+            if (dp->stab_ref[g] & 1)
+            {
+                dp->stab_ref[g] = dp->stab_cur[g];
+                continue;
+            }
+            ++compared;
+            if (dp->stab_ref[g] == dp->stab_cur[g])
+                continue;
+            lba = dp->start + g * dp->stab_grain;
+            bad_block(dp, BADMAP_MISMATCH, lba,
+                      (g + 1 < dp->stab_n) ? dp->stab_grain : dp->end - lba);
+            if (differ++ < 10)
+                printf("%s: lba %" PRId64 " to %" PRId64 " read differently "
+                       "in pass %u than in pass %u\n", dp->device_name, lba,
+                       ((g + 1 < dp->stab_n) ? lba + dp->stab_grain
+                                             : dp->end) - 1,
+                       pass, dp->stab_pass);
+        }
+        printf("%s: pass %u read %" PRId64 " of %" PRId64 " grains "
+               "differently than pass %u\n", dp->device_name, pass, differ,
+               compared, dp->stab_pass);
+    }
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* --erase sanitize:crypto: a chunk read after the erase against the
+ * hashes of its sample blocks from before it. A block that reads back
+ * the same goes to the bad map as a mismatch, as its data outlived the
+ * erase; each block is checked once, by the first READ of it. uni is
+ * the byte a uniform chunk is all of, else -1. */
+static void
+erase_chunk(t_dev *dp, const unsigned char *data, int64_t lba, int blocks,
+            int uni)
+{
+    int64_t off, s;
+    uint64_t fp, h[2];
+    int k;
+
+    for (k = 0; k < blocks; ++k, ++lba, data += dp->blk_sz)
+    {
+        off = lba - dp->start;
+        s = off / dp->erase_step;
+        if ((off < 0) || (s >= dp->erase_n) ||
+            (off % dp->erase_step >= dp->erase_len))
+            continue;
+        fp = __atomic_exchange_n(dp->erase_fp + s * dp->erase_len +
+                                     off % dp->erase_step,
+                                 0, __ATOMIC_RELAXED);
+        if (0 == fp)
+            continue;
+        __atomic_fetch_add(&dp->erase_checked, 1, __ATOMIC_RELAXED);
+        if (uni >= 0)
+            continue; /* was not uniform */
+        xxh3_128(data, dp->blk_sz, h);
+        if ((h[0] | 1) != fp)
+            continue;
+        bad_block(dp, BADMAP_MISMATCH, lba, 1);
+        if (__atomic_fetch_add(&dp->erase_survived, 1, __ATOMIC_RELAXED) <
+            ERASE_SHOWN)
+            pr2serr("%s: lba=%" PRId64 " reads back as it did before the "
+                    "crypto erase\n", dp->device_name, lba);
+    }
+}
+
+/* --erase sanitize:crypto: the end of the pass that read the samples
+ * back, how many of their blocks still held what they did. None of n
+ * bounds the share of blocks the erase missed at random by 3 / n (the
+ * rule of three, 95 %); a range it missed wider than the step between
+ * samples cannot have gone unseen. Later passes are not checked. */
+static void
+erase_end(t_dev *dp, unsigned int pass)
+{
+    char name[PATH_MAX];
+    int64_t checked = dp->erase_checked, survived = dp->erase_survived;
+    double bound = checked ? 300.0 / checked : 100.0;
+
+    if (NULL == dp->erase_fp)
+        return;
+    free(dp->erase_fp);
+    dp->erase_fp = NULL;
+    pthread_mutex_lock(&out_mutex);
+    if (survived)
+        printf("%s: crypto erase FAILED, %" PRId64 " of %" PRId64 " sampled "
+               "blocks read back in pass %u as they did before it\n",
+               dp->device_name, survived, checked, pass);
+    else
+        printf("%s: crypto erase checked, none of %" PRId64 " sampled blocks "
+               "read back as before: under %.2g%% missed at 95%% confidence, "
+               "no range over %" PRId64 " blocks\n", dp->device_name,
+               checked, bound, dp->erase_step);
+    if (dp->erase_before[0] || dp->erase_before[1])
+        printf("%s: %" PRId64 " sampled blocks uniform and %" PRId64 " unread "
+               "before the erase, not checked\n", dp->device_name,
+               dp->erase_before[0], dp->erase_before[1]);
+    pthread_mutex_unlock(&out_mutex);
+    if (jsonl_enabled())
+        jsonl_printf("{\"type\":\"erase_check\",\"device\":\"%s\","
+                     "\"pass\":%u,\"method\":\"%s\",\"samples\":%" PRId64
+                     ",\"step\":%" PRId64 ",\"checked\":%" PRId64
+                     ",\"survived\":%" PRId64 ",\"uniform_before\":%" PRId64
+                     ",\"unread_before\":%" PRId64 ",\"bound_pct\":%.4g}",
+                     jsonl_escape(name, sizeof(name), dp->device_name), pass,
+                     dp->erase_how, dp->erase_n, dp->erase_step, checked,
+                     survived, dp->erase_before[0], dp->erase_before[1],
+                     survived ? 100.0 : bound);
+}
+
+/* What a stamped block that is not the pattern holds instead: the data
+ * of another lba (a misdirected read or write), of another pass or run
+ * (stale data, the write lost), or no stamp at all. */
+static void
+stamp_report(const t_dev *dp, const unsigned char *blk, const t_pattern *pat,
+             int64_t lba)
+{
+    struct stamp st;
+
+    if (stamp_decode(blk, &st))
+        pr2serr("%s: lba=%" PRId64 " holds no stamp\n", dp->device_name, lba);
+    else if ((uint64_t)lba != st.lba)
+        pr2serr("%s: lba=%" PRId64 " holds the block of lba=%" PRIu64
+                " (pass %u, run %" PRIu64 "), misdirected\n",
+                dp->device_name, lba, st.lba, st.pass, st.run);
+    else if ((st.pass != pat->pass) || (st.run != pat->run))
+        pr2serr("%s: lba=%" PRId64 " holds stale data of pass %u, run %"
+                PRIu64 " (expected pass %u, run %" PRIu64 ")\n",
+                dp->device_name, lba, st.pass, st.run, pat->pass, pat->run);
+    else
+        pr2serr("%s: lba=%" PRId64 " has its stamp, the data after it "
+                "differs\n", dp->device_name, lba);
+}
+
+/* Offset in the file of a file pass of the byte at lba. */
+static size_t
+pattern_phase(const t_dev *dp, const t_pattern *pat, int64_t lba)
+{
+    return (size_t)(((unsigned __int128)lba * dp->blk_sz) % pat->period);
+}
+
+/* The first byte of the len at buf, of the block at lba, that is not
+ * what the file pass has there, or len. */
+static size_t
+pattern_file_check(const t_dev *dp, const t_pattern *pat,
+                   const unsigned char *buf, size_t len, int64_t lba)
+{
+    size_t off = 0, phase = pattern_phase(dp, pat, lba), n, d;
+
+    while (off < len)
+    {
+        n = pat->span - phase;
+        if (n > len - off)
+            n = len - off;
+        d = __atomic_load_n(&check_stream, __ATOMIC_RELAXED)
+                ? buf_compare_stream(buf + off, pat->data + phase, n)
+                : buf_compare(buf + off, pat->data + phase, n);
+        if (d < n)
+            return off + d;
+        off += n;
+        phase = 0;
+    }
+    return len;
+}
+
+/* The expected data of the blocks at lba, read only and shared by every
+ * device, when a pass has it in one piece: a word pass from the region
+ * of the word repeated, grown to the largest transfer asked of it (one
+ * outgrown stays mapped, a READ may be comparing to it), a file pass
+ * from the file's own span when its phase there runs long enough. The
+ * address is block aligned, for O_DIRECT. NULL for the passes of
+ * blocks made from their lba, which pattern_fill() then writes out. */
+static const unsigned char *
+pattern_ref(const t_dev *dp, const t_pattern *pat, int64_t lba, int blocks)
+{
+    static pthread_mutex_t ref_mutex = PTHREAD_MUTEX_INITIALIZER;
+    t_pattern *pp = (t_pattern *)pat; /* the region is a cache of it */
+    size_t len = (size_t)blocks * dp->blk_sz, phase, n;
+    const unsigned char *p = NULL;
+
+    if (FILEDATAFLAG == pat->flag)
+    {
+        phase = pattern_phase(dp, pat, lba);
+        if (pat->span - phase >= len)
+            p = pat->data + phase;
+    }
+    else if (0 == pat->flag)
+    {
+        if (__atomic_load_n(&pp->ref_len, __ATOMIC_ACQUIRE) < len)
+        {
+            pthread_mutex_lock(&ref_mutex);
+            n = 2 * pp->ref_len;
+            if (n < len)
+                n = len;
+            if ((pp->ref_len < len) &&
+                (p = (const unsigned char *)iobuf_ref(pp->word,
+                                                      PATTERN_WORD_SZ, n)))
+            {
+                __atomic_store_n(&pp->ref, p, __ATOMIC_RELAXED);
+                __atomic_store_n(&pp->ref_len, n, __ATOMIC_RELEASE);
+            }
+            pthread_mutex_unlock(&ref_mutex);
+        }
+        p = (__atomic_load_n(&pp->ref_len, __ATOMIC_ACQUIRE) >= len)
+                ? __atomic_load_n(&pp->ref, __ATOMIC_RELAXED)
+                : NULL;
+    }
+    return (p && (0 == (uintptr_t)p % dp->blk_sz)) ? p : NULL;
+}
+
+/* The guard of the block at blk, metadata md: over the block and the
+ * metadata before the tuple. */
+static uint64_t
+pi_crc(const t_dev *dp, const uint8_t *blk, const uint8_t *md)
+{
+    if (8 == dp->pi_guard_sz)
+        return crc64_nvme(crc64_nvme(0, blk, dp->blk_sz), md, dp->pi_off);
+    return crc16_t10dif(crc16_t10dif(0, blk, dp->blk_sz), md, dp->pi_off);
+}
+
+/* --pi: checks the tuple of each block of a READ at lba into buf as it
+ * completes, then packs the blocks together as a READ without metadata
+ * leaves them. Escaped tuples, app tag 0xffff (and a reference tag of
+ * all ones with type 3), are passed over as the drive does. Returns the
+ * blocks whose tuple was not right. */
+static int
+pi_check(t_dev *dp, uint8_t *buf, int64_t lba, int blocks)
+{
+    size_t bs = dp->blk_sz;
+    size_t xs = dp->pi_ext ? bs + dp->pi_ms : bs;
+    uint64_t mask = (1ULL << dp->pi_ref_bits) - 1;
+    uint64_t guard, crc, ref;
+    const uint8_t *blk, *md, *t;
+    uint16_t app;
+    const char *what;
+    int b, ok = 0, bad = 0;
+
+    for (b = 0; b < blocks; ++b)
+    {
+        blk = buf + b * xs;
+        md = dp->pi_ext ? blk + bs : buf + blocks * bs + b * dp->pi_ms;
+        t = md + dp->pi_off;
+        if (8 == dp->pi_guard_sz)
+        {
+            guard = sg_get_unaligned_be64(t);
+            app = sg_get_unaligned_be16(t + 8);
+            ref = sg_get_unaligned_be48(t + 10) & mask;
+        }
+        else
+        {
+            guard = sg_get_unaligned_be16(t);
+            app = sg_get_unaligned_be16(t + 2);
+            ref = sg_get_unaligned_be32(t + 4) & mask;
+        }
+        what = NULL;
+        crc = guard;
+        if ((0xffff == app) && ((3 != dp->pi_type) || (mask == ref)))
+            ;
+        else if (guard != (crc = pi_crc(dp, blk, md)))
+        {
+            what = "guard";
+            __atomic_fetch_add(&dp->pi_guard, 1, __ATOMIC_RELAXED);
+        }
+        else if ((3 != dp->pi_type) && (ref != ((uint64_t)(lba + b) & mask)))
+        {
+            what = "reference";
+            __atomic_fetch_add(&dp->pi_ref, 1, __ATOMIC_RELAXED);
+        }
+        else if ((app ^ opt.pi_app) & opt.pi_mask)
+        {
+            what = "application";
+            __atomic_fetch_add(&dp->pi_app, 1, __ATOMIC_RELAXED);
+        }
+        else
+            ++ok;
+        if (what)
+        {
+            ++bad;
+            bad_block(dp, BADMAP_MISMATCH, lba + b, 1);
+            if (__atomic_fetch_add(&diff_shown, 1, __ATOMIC_RELAXED) <
+                opt.diff_sectors)
+                pr2serr("%s: lba=%" PRId64 " %s tag check failed: guard "
+                        "0x%0*" PRIx64 " (data 0x%0*" PRIx64 "), app 0x%04x, "
+                        "ref 0x%" PRIx64 "\n", dp->device_name, lba + b, what,
+                        2 * dp->pi_guard_sz, guard, 2 * dp->pi_guard_sz, crc,
+                        app, ref);
+        }
+        if (b && dp->pi_ext)
+            memmove(buf + b * bs, blk, bs);
+    }
+    __atomic_fetch_add(&dp->pi_ok, ok, __ATOMIC_RELAXED);
+    return bad;
+}
+
+/* The offset of the first byte of the blocks at lba in data that is
+ * not the pattern, or their length. uni is the byte they are all of
+ * when buf_uniform() found them so, else -1: a word pass of that byte
+ * then matches without a look at them. */
+static size_t
+pattern_match(const t_dev *dp, const unsigned char *data,
+              const t_pattern *pat, int64_t lba, int blocks, int uni)
+{
+    size_t len = (size_t)blocks * dp->blk_sz;
+
+    if (CHECKDATAFLAG == pat->flag)
+        return len;
+    if ((uni >= 0) && (0 == pat->flag) && (uni == pat->word[0]) &&
+        (uni == buf_uniform(pat->word, PATTERN_WORD_SZ)))
+        return len;
+    if (RANDOMDATAFLAG == pat->flag)
+        return rand_pattern_check(data, dp->blk_sz, blocks, pat->key, lba);
+    if (STAMPDATAFLAG == pat->flag)
+        return stamp_pattern_check(data, dp->blk_sz, blocks, pat->key,
+                                   pat->run, pat->pass, lba);
+    if (FILEDATAFLAG == pat->flag)
+        return pattern_file_check(dp, pat, data, len, lba);
+    if (__atomic_load_n(&check_stream, __ATOMIC_RELAXED))
+        return pattern_check_stream(data, len, pat->word);
+    return pattern_check(data, len, pat->word);
+}
+
+/* --diff-dump record of a block that is not the pattern, integers
+ * little endian: u32 block size, u32 name length, u64 lba, u32 pass,
+ * u32 bits read 1 for 0, u32 read 0 for 1, u32 first byte that
+ * differs, the device name (no NUL), the block expected, the block
+ * read. The file starts with DIFF_MAGIC. */
+static void
+diff_dump(const t_dev *dp, const t_pattern *pat, int64_t lba,
+          const unsigned char *got, const unsigned char *exp, uint64_t up,
+          uint64_t down, size_t first)
+{
+    uint8_t hdr[32];
+    size_t nlen = strlen(dp->device_name);
+
+    sg_put_unaligned_le32(dp->blk_sz, hdr);
+    sg_put_unaligned_le32((uint32_t)nlen, hdr + 4);
+    sg_put_unaligned_le64((uint64_t)lba, hdr + 8);
+    sg_put_unaligned_le32(pat->pass, hdr + 16);
+    sg_put_unaligned_le32((uint32_t)up, hdr + 20);
+    sg_put_unaligned_le32((uint32_t)down, hdr + 24);
+    sg_put_unaligned_le32((uint32_t)first, hdr + 28);
+    pthread_mutex_lock(&diff_mutex);
+    if ((1 != fwrite(hdr, sizeof(hdr), 1, diff_fp)) ||
+        (1 != fwrite(dp->device_name, nlen, 1, diff_fp)) ||
+        (1 != fwrite(exp, dp->blk_sz, 1, diff_fp)) ||
+        (1 != fwrite(got, dp->blk_sz, 1, diff_fp)) || fflush(diff_fp))
+        perror(opt.diff_path);
+    pthread_mutex_unlock(&diff_mutex);
+}
+
+/* -v -v: the 16 byte lines of a block from first to last that are not
+ * the pattern, as read and as expected, in the format of hex2str(), to
+ * stderr in one write. */
+static void
+mismatch_hex(const t_dev *dp, const unsigned char *got,
+             const unsigned char *exp, size_t first, size_t last)
+{
+    size_t off, n = 0, len = ((last - first) / 16 + 2) * 2 * MISMATCH_LINE;
+    char *b = (char *)malloc(len), lead[32];
+    int k;
+
+    if (NULL == b)
+        return;
+    for (off = first & ~(size_t)15; (off <= last) && (n + 2 * MISMATCH_LINE
+                                                      < len); off += 16)
+    {
+        k = (dp->blk_sz - off < 16) ? (int)(dp->blk_sz - off) : 16;
+        if (0 == memcmp(got + off, exp + off, k))
+            continue;
+        snprintf(lead, sizeof(lead), "  %04zx read ", off);
+        n += hex2str(got + off, k, lead, 0, (int)(len - n), b + n);
+        snprintf(lead, sizeof(lead), "  %04zx want ", off);
+        n += hex2str(exp + off, k, lead, 0, (int)(len - n), b + n);
+    }
+    pr2serr("%s", b);
+    free(b);
+}
+
+/* One block at lba that is not the pattern: counts its bit flips and,
+ * while fewer than --diff-sectors were, shows the bytes that differ and
+ * dumps both blocks. The block expected is the shared reference, or
+ * made in scratch, a block. */
+static void
+mismatch_block(t_dev *dp, const t_pattern *pat, const unsigned char *got,
+               unsigned char *scratch, int64_t lba)
+{
+    const unsigned char *exp = pattern_ref(dp, pat, lba, 1);
+    uint64_t up, down;
+    size_t first, last;
+
+    PROBE2(mismatch, dp->device_name, lba);
+    bad_block(dp, BADMAP_MISMATCH, lba, 1);
+    __atomic_fetch_add(&dp->mis_blocks, 1, __ATOMIC_RELAXED);
+    if ((NULL == exp) && scratch)
+    {
+        pattern_fill(dp, pat, scratch, lba, 1);
+        exp = scratch;
+    }
+    if (NULL == exp)
+        return; /* out of memory: counted, not looked into */
+    bit_flips(got, exp, dp->blk_sz, &up, &down);
+    __atomic_fetch_add(&dp->flips_up, (int64_t)up, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dp->flips_down, (int64_t)down, __ATOMIC_RELAXED);
+    if (__atomic_fetch_add(&diff_shown, 1, __ATOMIC_RELAXED) >=
+        opt.diff_sectors)
+        return;
+    first = buf_compare(got, exp, dp->blk_sz);
+    for (last = dp->blk_sz - 1; (last > first) && (got[last] == exp[last]);
+         --last)
+        ;
+    pr2serr("%s: lba=%" PRId64 " bytes %zu to %zu differ, %" PRIu64 " bits "
+            "read 1 for 0, %" PRIu64 " read 0 for 1\n", dp->device_name, lba,
+            first, last, up, down);
+    if (verbose > 1)
+        mismatch_hex(dp, got, exp, first, last);
+    if (STAMPDATAFLAG == pat->flag)
+        stamp_report(dp, got, pat, lba);
+    if (diff_fp)
+        diff_dump(dp, pat, lba, got, exp, up, down, first);
+}
+
+/* Checks a chunk just read against the pass pattern over its full
+ * length, random passes regenerate the expected blocks from their LBA.
+ * There is no pattern (NULL) while --tune calibrates.
+ * A mismatch is reported with the first block that differs, and every
+ * block that does is then passed to mismatch_block(), the check going
+ * on after each. Returns true when the chunk matches. */
+static bool
+verify_chunk(t_dev *dp, const unsigned char *data, const t_pattern *pat,
+             int64_t lba, int blocks)
+{
+    size_t len = (size_t)blocks * dp->blk_sz;
+    size_t off;
+    unsigned char *exp;
+    int b, uni = -1;
+
+    if (NULL == pat)
+        return true; /* calibration reads */
+    /* sanitized and unmapped blocks: one pass over them finds it, and
+     * the CRC, hashes and word check are then taken as known */
+    if (opt.crc || dp->stab_cur || dp->erase_fp || (0 == pat->flag))
+        uni = buf_uniform(data, len);
+    if (opt.crc)
+        crc_chunk(dp, data, lba, blocks, uni);
+    if (dp->stab_cur)
+        stable_chunk(dp, data, lba, blocks, uni);
+    if (dp->erase_fp)
+        erase_chunk(dp, data, lba, blocks, uni);
+    if (__atomic_load_n(&check_stream, __ATOMIC_RELAXED) &&
+        (RANDOMDATAFLAG != pat->flag) && (STAMPDATAFLAG != pat->flag))
+        __atomic_fetch_add(&dp->stream_bytes, (int64_t)len, __ATOMIC_RELAXED);
+    off = pattern_match(dp, data, pat, lba, blocks, uni);
+    if (off >= len)
+        return true;
+    __atomic_fetch_add(&dp->mismatches, 1, __ATOMIC_RELAXED);
+    pr2serr("start sector %" PRId64 " error, first mismatch at lba=%" PRId64
+            " offset %zu\n", lba, lba + (int64_t)(off / dp->blk_sz),
+            off % dp->blk_sz);
+    /* scratch only for the passes the shared reference has not */
+    exp = pattern_ref(dp, pat, lba, 1) ? NULL
+                                       : (unsigned char *)malloc(dp->blk_sz);
+    for (b = (int)(off / dp->blk_sz); b < blocks;)
+    {
+        mismatch_block(dp, pat, data + (size_t)b * dp->blk_sz, exp, lba + b);
+        if (++b >= blocks)
+            break;
+        off = pattern_match(dp, data + (size_t)b * dp->blk_sz, pat, lba + b,
+                            blocks - b, uni);
+        b += (int)(off / dp->blk_sz);
+    }
+    free(exp);
+    return false;
+}
+
+/* verify_chunk() of the blocks at lba in the segments of sgl, each a
+ * whole number of blocks. Returns true when they all match. */
+static bool
+verify_sgl(t_dev *dp, const struct iobuf_sgl *sgl, const t_pattern *pat,
+           int64_t lba, int blocks)
+{
+    bool ok = true;
+    int k, n;
+
+    for (k = 0; (k < sgl->n) && (blocks > 0); ++k)
+    {
+        n = (int)(sgl->iov[k].iov_len / dp->blk_sz);
+        if (n > blocks)
+            n = blocks;
+        if (!verify_chunk(dp, sgl->iov[k].iov_base, pat, lba, n))
+            ok = false;
+        lba += n;
+        blocks -= n;
+    }
+    return ok;
+}
+
+/* A queued READ engine starts a pass of dp: the chunk map of the pass
+ * is cleared, unless --resume loaded it for this one, and what the pass
+ * does not read (below dp->from, between the --lba-status or
+ * --allocated extents) counts as done. Not with --rounds, whose rounds
+ * read the range again. */
+static void
+dmap_begin(t_dev *dp)
+{
+    unsigned int pass = __atomic_load_n(&dp->cur_pass, __ATOMIC_RELAXED);
+    int64_t last;
+    int k;
+
+    __atomic_store_n(&dp->dmap_on, false, __ATOMIC_RELAXED);
+    dp->dmap_skip = false;
+    if (dp->rounds || (0 == pass))
+        return;
+    if (NULL == dp->dmap.cnt)
+        return; /* out of memory, only the low water mark then */
+    if (pass == dp->dmap_pass)
+        dp->dmap_skip = true;
+    else
+        donemap_clear(&dp->dmap);
+    dp->dmap_pass = pass;
+    donemap_add(&dp->dmap, dp->start, dp->from - dp->start);
+    for (k = 0, last = dp->start; dp->ext && (k < dp->num_ext); ++k)
+    {
+        donemap_add(&dp->dmap, last, dp->ext[k].lba - last);
+        last = dp->ext[k].lba + dp->ext[k].len;
+    }
+    if (dp->ext)
+        donemap_add(&dp->dmap, last, dp->end - last);
+    __atomic_store_n(&dp->dmap_on, true, __ATOMIC_RELAXED);
+}
+
+/* blocks at lba read whole, in the chunk map. */
+static void
+dmap_done(t_dev *dp, int64_t lba, int blocks)
+{
+    if (__atomic_load_n(&dp->dmap_on, __ATOMIC_RELAXED))
+        donemap_add(&dp->dmap, lba, blocks);
+}
+
+/* Where the pass of dp is for the progress table: the blocks done in all
+ * when a queued engine keeps the chunk map, else its low water mark. */
+static int64_t
+dev_progress(t_dev *dp)
+{
+    int64_t lba = __atomic_load_n(&dp->cur_lba, __ATOMIC_RELAXED), done;
+
+    if (__atomic_load_n(&dp->dmap_on, __ATOMIC_RELAXED))
+    {
+        done = dp->start + __atomic_load_n(&dp->dmap.blocks, __ATOMIC_RELAXED);
+        if (done > dp->end)
+            done = dp->end;
+        if (done > lba)
+            lba = done;
+    }
+    return lba;
+}
+
+/* Whether range_next() stopped dp short of the end of its pass. */
+static inline bool
+dev_stopped(const t_dev *dp)
+{
+    return dp->tl_hit || dp->err_hit || dp->cancelled || dp->gone;
+}
+
+/* Moves *lbap to the first block a pass reads at or after it and cuts
+ * *blocksp to what is contiguous there: everything up to dp->end, or
+ * only the selected extents after --lba-status. Returns false when
+ * nothing is left, the --time-limit is up, --max-errors exceeded, the
+ * run cancelled or the device gone. */
+static bool
+range_next(t_dev *dp, int64_t *lbap, int *blocksp)
+{
+    int64_t lba = *lbap, stop = dp->end;
+    int lo = 0, hi = dp->num_ext, mid;
+    int cap = __atomic_load_n(&dp->bpt_cap, __ATOMIC_RELAXED);
+
+    if (dp->tl_end_ns && (lat_now_ns() >= dp->tl_end_ns))
+    {
+        __atomic_store_n(&dp->tl_hit, true, __ATOMIC_RELAXED);
+        return false; /* --time-limit, every engine stops here */
+    }
+    if (__atomic_load_n(&run_cancel, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&dp->cancelled, true, __ATOMIC_RELAXED);
+        return false;
+    }
+    if (__atomic_load_n(&dp->gone, __ATOMIC_RELAXED))
+        return false; /* dev_gone(), what is in flight drains */
+    if (opt.max_errors &&
+        (__atomic_load_n(&dp->fail_blocks, __ATOMIC_RELAXED) > opt.max_errors))
+    {
+        __atomic_store_n(&dp->err_hit, true, __ATOMIC_RELAXED);
+        return false; /* and gives up the host's share to the others */
+    }
+    if (cap && (*blocksp > cap))
+        *blocksp = cap; /* --control bpt */
+    if (dp->ext)
+    {
+        /* first extent that ends after lba */
+        while (lo < hi)
+        {
+            mid = (lo + hi) / 2;
+            if (dp->ext[mid].lba + dp->ext[mid].len <= lba)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo >= dp->num_ext)
+            return false;
+        if (lba < dp->ext[lo].lba)
+            lba = dp->ext[lo].lba;
+        if (dp->ext[lo].lba + dp->ext[lo].len < stop)
+            stop = dp->ext[lo].lba + dp->ext[lo].len;
+    }
+    if (dp->dmap_skip)
+    {
+        int64_t to;
+
+        /* --resume: the chunks read whole before are not read again */
+        lba = donemap_next(&dp->dmap, lba, &to);
+        if (to < stop)
+            stop = to;
+    }
+    if (lba >= stop)
+        return false;
+    if (lba + *blocksp > stop)
+        *blocksp = (int)(stop - lba);
+    else if (dp->pblk > 1)
+    {
+        /* end on a physical block, so that the next READ starts on one */
+        int over = (int)((lba + *blocksp + dp->pblk - dp->align_lba) %
+                         dp->pblk);
+
+        if ((over > 0) && (*blocksp > over))
+            *blocksp -= over;
+    }
+    if (dp->md_chunk && (lba + *blocksp < stop))
+    {
+        /* --array: end on a chunk, so that the next READ starts on one */
+        int64_t over = (lba + *blocksp - dp->md_lba) % dp->md_chunk;
+
+        if (over < 0)
+            over += dp->md_chunk;
+        if ((over > 0) && (*blocksp > over))
+            *blocksp -= (int)over;
+    }
+    *lbap = lba;
+    return true;
+}
+
+/* Lowers dp->iso_low to the READs still on the side queue. */
+static void
+iso_low_update(t_dev *dp)
+{
+    int64_t low = (dp->iso_work >= 0) ? dp->iso_work : INT64_MAX;
+    int k;
+
+    for (k = 0; k < dp->iso_num; ++k)
+        if (dp->iso_q[k].lba < low)
+            low = dp->iso_q[k].lba;
+    __atomic_store_n(&dp->iso_low, low, __ATOMIC_RELAXED);
+}
+
+/* The retry_policy[] entry of error class cat. */
+static int
+retry_class(int cat)
+{
+    int k;
+
+    if (SG_LIB_CAT_MEDIUM_HARD_WITH_INFO == cat)
+        cat = SG_LIB_CAT_MEDIUM_HARD;
+    for (k = 0; k < NUM_RETRY_POLICIES - 1; ++k)
+        if (retry_policy[k].cat == cat)
+            break;
+    return k; /* else the last, "other" */
+}
+
+/* Queues ip to be tried again after the backoff of its class for the
+ * attempts it had, or at once when its class has no attempts left.
+ * Under iso_mutex. Returns 0, -1 when out of memory. */
+static int
+iso_queue(t_dev *dp, const t_iso *ip)
+{
+    const struct _retry_policy *rp = retry_policy + ip->cls;
+    t_iso *qp;
+
+    if (dp->iso_num == dp->iso_cap)
+    {
+        int cap = dp->iso_cap ? 2 * dp->iso_cap : 16;
+
+        qp = (t_iso *)realloc(dp->iso_q, cap * sizeof(t_iso));
+        if (NULL == qp)
+            return -1;
+        dp->iso_q = qp;
+        dp->iso_cap = cap;
+    }
+    qp = dp->iso_q + dp->iso_num++;
+    *qp = *ip;
+    qp->due_ns = lat_now_ns();
+    if (ip->attempts < rp->attempts)
+        qp->due_ns += (uint64_t)rp->backoff_ms * 1000000ULL << ip->attempts;
+    if (ip->lba < dp->iso_low)
+        __atomic_store_n(&dp->iso_low, ip->lba, __ATOMIC_RELAXED);
+    pthread_cond_signal(&dp->iso_cond);
+    return 0;
+}
+
+/* One more try of a READ of the side queue. Returns 0, else the
+ * SG_LIB_CAT_* class of the error. A try that fails is not counted as
+ * unrecovered, the last one is. */
+static int
+retry_once(t_dev *dp, uint8_t *buff, const t_iso *ip)
+{
+    int64_t unrecovered = dp->ctr[ctr_shard].unrecovered;
+    uint64_t io_addr = 0;
+    int res;
+
+    if ((FT_SG | FT_SIM) & dp->out_type)
+    {
+        res = sg_read_low(dp, buff, ip->blocks, ip->lba, NULL, &io_addr);
+        if (res < 0)
+            res = SG_LIB_CAT_OTHER;
+    }
+    else
+    {
+        res = isolate_read(dp, buff, ip->blocks, ip->lba);
+        if (res)
+            res = (res > 0) ? SG_LIB_CAT_MEDIUM_HARD : SG_LIB_CAT_OTHER;
+    }
+    CTR_ADD(dp, unrecovered,
+            unrecovered - dp->ctr[ctr_shard].unrecovered);
+    return res;
+}
+
+/* The side queue thread. A READ is tried again as the --retry policy
+ * of its error class says, each try after a backoff doubling from the
+ * class's, the READs due soonest first. Once it reads, or its class
+ * has no attempts left, it is read with sg_read() or direct_read(),
+ * which split it to find its bad blocks, and checked and counted as the
+ * engine would have. The first error is kept for the engines, which
+ * stop the pass at their next completion. */
+static void *
+iso_thread(void *arg)
+{
+    t_dev *dp = (t_dev *)arg;
+    uint8_t *buf, *free_buf;
+    struct timespec ts;
+    uint64_t now, t_ns;
+    t_iso it;
+    int k, next, res;
+
+    ctr_shard = ISO_SHARD;
+    buf = io_buf(dp, dp->bpt * dp->blk_sz, &free_buf);
+    pthread_mutex_lock(&dp->iso_mutex);
+    for (;;)
+    {
+        for (k = 0, next = -1; k < dp->iso_num; ++k)
+            if ((next < 0) || (dp->iso_q[k].due_ns < dp->iso_q[next].due_ns))
+                next = k;
+        if ((next < 0) && dp->iso_stop)
+            break;
+        if (next < 0)
+        {
+            pthread_cond_wait(&dp->iso_cond, &dp->iso_mutex);
+            continue;
+        }
+        now = lat_now_ns();
+        if (dp->iso_q[next].due_ns > now)
+        {
+            ts.tv_sec = dp->iso_q[next].due_ns / 1000000000ULL;
+            ts.tv_nsec = dp->iso_q[next].due_ns % 1000000000ULL;
+            pthread_cond_timedwait(&dp->iso_cond, &dp->iso_mutex, &ts);
+            continue;
+        }
+        it = dp->iso_q[next];
+        dp->iso_q[next] = dp->iso_q[--dp->iso_num];
+        dp->iso_work = it.lba;
+        pthread_mutex_unlock(&dp->iso_mutex);
+
+        t_ns = lat_now_ns();
+        res = -1;
+        if (NULL == buf)
+            pr2serr(">> heap problems\n");
+        else if (it.attempts < retry_policy[it.cls].attempts)
+        {
+            CTR_ADD(dp, retries, 1);
+            res = retry_once(dp, buf, &it);
+            if (res)
+            {
+                ++it.attempts;
+                it.cls = retry_class(res);
+                pthread_mutex_lock(&dp->iso_mutex);
+                if (0 == iso_queue(dp, &it))
+                {
+                    dp->iso_work = -1;
+                    continue; /* under iso_mutex, as the loop wants */
+                }
+                pthread_mutex_unlock(&dp->iso_mutex);
+            }
+        }
+        if (res && buf)
+            res = ((FT_SG | FT_SIM) & dp->out_type)
+                      ? sg_read(dp, buf, it.blocks, it.lba, NULL, NULL)
+                      : direct_read(dp, buf, it.blocks, it.lba);
+        /* the READ again, as the sync engine traces one it isolated */
+        io_trace(dp, TRACE_READ, it.lba, it.blocks, lat_now_ns() - t_ns, 1,
+                 res);
+        if (res)
+            pr2serr("%s: read failed, at or after lba=%" PRId64 " [0x%" PRIx64
+                    "]\n", dp->device_name, it.lba, it.lba);
+        else
+        {
+            verify_chunk(dp, buf, dp->iso_pat, it.lba, it.blocks);
+            CTR_ADD(dp, in_full, it.blocks);
+            __atomic_fetch_add(&dp->bytes_done,
+                               (int64_t)it.blocks * dp->blk_sz,
+                               __ATOMIC_RELAXED);
+            dmap_done(dp, it.lba, it.blocks);
+        }
+
+        pthread_mutex_lock(&dp->iso_mutex);
+        if (res && (0 == dp->iso_res))
+            __atomic_store_n(&dp->iso_res, res, __ATOMIC_RELAXED);
+        dp->iso_work = -1;
+        iso_low_update(dp);
+    }
+    pthread_mutex_unlock(&dp->iso_mutex);
+    iobuf_free(free_buf);
+    cpu_charge(dp);
+    return NULL;
+}
+
+/* Hands a READ of the pass checked against pat that failed with error
+ * class cat (SG_LIB_CAT_*) to the side queue, starting its thread with
+ * the first; in the coarse phase of --triage it is only noted. Returns
+ * 0, else -1 and the caller re-reads it itself. */
+static int
+iso_push(t_dev *dp, const t_pattern *pat, int64_t lba, int blocks, int cat)
+{
+    t_iso it;
+    int res = 0;
+
+    if (dp->coarse)
+        return badmap_add(&dp->suspect, lba, blocks, BADMAP_BAD) ? -1 : 0;
+    pthread_mutex_lock(&dp->iso_mutex);
+    if (!dp->iso_started)
+    {
+        dp->iso_pat = pat;
+        dp->iso_stop = false;
+        dp->iso_res = 0;
+        if (pthread_create(&dp->iso_tid, NULL, iso_thread, dp))
+            res = -1;
+        else
+            dp->iso_started = true;
+    }
+    if (0 == res)
+    {
+        it.lba = lba;
+        it.blocks = blocks;
+        it.cls = retry_class(cat);
+        it.attempts = 0;
+        res = iso_queue(dp, &it);
+    }
+    pthread_mutex_unlock(&dp->iso_mutex);
+    return res;
+}
+
+/* Waits for the side queue to drain at the end of a pass. Returns the
+ * first error of its READs, else 0. */
+static int
+iso_finish(t_dev *dp)
+{
+    int res;
+
+    pthread_mutex_lock(&dp->iso_mutex);
+    if (!dp->iso_started)
+    {
+        pthread_mutex_unlock(&dp->iso_mutex);
+        return 0;
+    }
+    dp->iso_stop = true;
+    pthread_cond_signal(&dp->iso_cond);
+    pthread_mutex_unlock(&dp->iso_mutex);
+    pthread_join(dp->iso_tid, NULL);
+    dp->iso_started = false;
+    res = dp->iso_res;
+    dp->iso_res = 0;
+    return res;
+}
+
+/* The first error of the side queue in this pass, else 0. */
+static int
+iso_error(t_dev *dp)
+{
+    return __atomic_load_n(&dp->iso_res, __ATOMIC_RELAXED);
+}
+
+/* low, or lower when the side queue still holds an older READ. */
+static int64_t
+iso_water(t_dev *dp, int64_t low)
+{
+    int64_t iso = __atomic_load_n(&dp->iso_low, __ATOMIC_RELAXED);
+
+    return (iso < low) ? iso : low;
+}
+
+/* The actuator of dp that lba is on. */
+static int
+actuator_of(const t_dev *dp, int64_t lba)
+{
+    int k;
+
+    for (k = 0; (k + 1 < dp->nact) && (lba >= dp->act[k].end); ++k)
+        ;
+    return k;
+}
+
+/* Counts bytes read at lba against its actuator. */
+static void
+actuator_done(t_dev *dp, int64_t lba, int64_t bytes)
+{
+    if (dp->nact > 1)
+        __atomic_fetch_add(&dp->act[actuator_of(dp, lba)].bytes, bytes,
+                           __ATOMIC_RELAXED);
+}
+
+/* The lowest lba of the READs in flight in rqs, else next. READs
+ * complete out of order, but every block below it has been read. */
+static int64_t
+low_water(const t_rq *rqs, int qd, int64_t next)
+{
+    int k;
+
+    for (k = 0; k < qd; ++k)
+        if ((rqs[k].busy || rqs[k].requeue) && (rqs[k].lba < next))
+            next = rqs[k].lba;
+    return next;
+}
+
+/* Starts the --adaptive-qd controller, the first time an engine that
+ * follows it reads dp; it then runs across passes. */
+static void
+qd_start(t_dev *dp)
+{
+    if (opt.qd_target_ns && dp->run && !dp->run->qdc.qd)
+        qdctl_init(&dp->run->qdc, dp->qd, opt.qd_target_ns);
+}
+
+/* --prefetch: once the READs queued reach into the window hinted last,
+ * a PRE-FETCH with IMMED for the window after it, so the drive stages
+ * it while the host still checks the data. next is the first lba not
+ * queued yet, window the blocks of the READs in flight. */
+static void
+prefetch_ahead(t_dev *dp, int64_t next, int64_t window)
+{
+    int64_t lba = (dp->pf_lba > next) ? dp->pf_lba : next;
+    int res;
+
+    if (!dp->prefetch || dp->ext || (next < dp->pf_lba - window) ||
+        (lba >= dp->end))
+        return;
+    if (lba + window > dp->end)
+        window = dp->end - lba;
+    res = sg_ll_pre_fetch_x(dp->fd, false, 16 == dp->flags.cdbsz, true,
+                            lba, (uint32_t)window, 0, 0, false,
+                            verbose > 1 ? verbose - 1 : 0);
+    dp->pf_lba = lba + window;
+    if (res && (SG_LIB_CAT_CONDITION_MET != res))
+    {
+        pr2serr("%s: PRE-FETCH failed (%d), reading without it\n",
+                dp->device_name, res);
+        dp->prefetch = false;
+    }
+}
+
+/* The READs dp may have in flight: the --adaptive-qd depth, at most the
+ * --control cap. */
+static int
+dev_qd(t_dev *dp)
+{
+    int qd = dp->run ? qdctl_qd(&dp->run->qdc) : INT32_MAX;
+    int cap = __atomic_load_n(&dp->qd_cap, __ATOMIC_RELAXED);
+    int full = __atomic_load_n(&dp->qfull_cap, __ATOMIC_RELAXED);
+
+    if (cap && (cap < qd))
+        qd = cap;
+    return (full && (full < qd)) ? full : qd;
+}
+
+/* A READ of dp came back TASK SET FULL or BUSY with in_flight queued,
+ * itself included: the LUN, or the array behind it, takes one less
+ * than that for now. Not a retry, nor an error of the drive. */
+static void
+qfull_hit(t_dev *dp, int in_flight)
+{
+    int cap = dev_qd(dp);
+
+    CTR_ADD(dp, qfull, 1);
+    dp->qfull_ok = 0;
+    if (in_flight - 1 < cap)
+        cap = in_flight - 1;
+    if (cap < 1)
+        cap = 1;
+    if (cap == dp->qfull_cap)
+        return;
+    __atomic_store_n(&dp->qfull_cap, cap, __ATOMIC_RELAXED);
+    if (verbose)
+        pr2serr("%s: queue full with %d in flight, holding %d\n",
+                dp->device_name, in_flight, cap);
+}
+
+/* A READ of dp completed: every QFULL_PROBE_CMDS of them the cap of a
+ * full queue is raised by one, until it is gone. */
+static void
+qfull_probe(t_dev *dp)
+{
+    int cap = dp->qfull_cap;
+
+    if ((0 == cap) || (++dp->qfull_ok < QFULL_PROBE_CMDS))
+        return;
+    dp->qfull_ok = 0;
+    ++cap;
+    __atomic_store_n(&dp->qfull_cap, (cap < dp->qd) ? cap : 0,
+                     __ATOMIC_RELAXED);
+}
+
+/* Queues READs of [*nextp, end) on every idle slot until cap are in
+ * flight, the range is exhausted or the rate caps are reached, when
+ * *waitp is set to the ns until the next READ may go. A slot a full
+ * queue refused goes again as it is, first. Returns 0, else the
+ * sg_start_io() error. */
+static int
+async_fill(t_dev *dp, t_rq *rqs, int qd, int64_t *nextp, int64_t end,
+           int cap, int *in_flightp, uint64_t *waitp)
+{
+    int k, res;
+    t_rq *rqp;
+
+    *waitp = 0;
+    for (k = 0; (k < qd) && (*in_flightp < cap); ++k)
+    {
+        rqp = rqs + k;
+        if (rqp->busy || (!rqp->requeue && (*nextp >= end)))
+            continue;
+        if (!rqp->requeue)
+        {
+            rqp->lba = *nextp;
+            rqp->blocks = dp->bpt;
+            if (!range_next(dp, &rqp->lba, &rqp->blocks) ||
+                (rqp->lba >= end))
+            {
+                *nextp = end;
+                continue;
+            }
+            if (rqp->lba + rqp->blocks > end)
+                rqp->blocks = (int)(end - rqp->lba); /* up to the next actuator */
+            *waitp = throttle_ns(dp, (int64_t)rqp->blocks * dp->blk_sz);
+            if (*waitp)
+                break;
+        }
+        res = sg_start_io(dp, rqp);
+        if ((-2 == res) && (*in_flightp > 0))
+            return 0; /* ENOMEM, reap some first */
+        if (-2 == res)
+            pr2serr("sg_start_io: ENOMEM at lba=%" PRId64 ", try reducing "
+                    "-n or --qd\n", *nextp);
+        if (res)
+            return res;
+        rqp->busy = true;
+        rqp->qd = ++*in_flightp;
+        if (rqp->requeue)
+            rqp->requeue = false;
+        else
+            *nextp = rqp->lba + rqp->blocks;
+    }
+    if (end == dp->end)
+        prefetch_ahead(dp, *nextp, (int64_t)qd * dp->bpt);
+    return 0;
+}
+
+/* Escalation of missed deadlines: a LOGICAL UNIT RESET of the device,
+ * which ends every command it still holds. */
+static void
+deadline_reset(t_dev *dp)
+{
+    int k = SG_SCSI_RESET_DEVICE;
+
+    pr2serr("%s: %" PRId64 " READs missed the %d ms deadline, resetting the "
+            "logical unit\n", dp->device_name, CTR_GET(dp, timeouts),
+            opt.deadline_ms);
+    if ((ioctl(dp->fd, SG_SCSI_RESET, &k) < 0) && verbose)
+        perror("SG_SCSI_RESET");
+}
+
+/* Aborts the queued READ rqp with SG_IOABORT so that it completes now
+ * and goes to the side queue, unless the driver can not. */
+static void
+rq_abort(t_dev *dp, t_rq *rqp)
+{
+    struct sg_io_v4 ctl_v4;
+
+    rqp->aborted = true;
+    if (dp->no_abort)
+        return;
+    if (dp->sim)
+    {
+        sim_abort(dp->sim, &rqp->io_hdr); /* ENODATA: completed meanwhile */
+        return;
+    }
+    memset(&ctl_v4, 0, sizeof(ctl_v4));
+    ctl_v4.guard = 'Q';
+    ctl_v4.request_extra = rqp->io_hdr.pack_id;
+    if ((ioctl(path_fd(dp, rqp->path), SG_IOABORT, &ctl_v4) < 0) &&
+        (ENODATA != errno) && !dp->gone)
+    {
+        /* ENODATA: it completed meanwhile */
+        pr2serr("%s: SG_IOABORT refused (%s), READs queued are waited "
+                "for\n", dp->device_name, safe_strerror(errno));
+        dp->no_abort = true;
+    }
+}
+
+/* A READ past the --deadline: counted, and aborted. Every
+ * opt.deadline_resets missed deadlines the device is reset. */
+static void
+deadline_abort(t_dev *dp, t_rq *rqp)
+{
+    CTR_ADD(dp, timeouts, 1);
+    if (verbose)
+        pr2serr("%s: READ at lba=%" PRId64 " is past the %d ms deadline\n",
+                dp->device_name, rqp->lba, opt.deadline_ms);
+    rq_abort(dp, rqp);
+    if ((opt.deadline_resets > 0) &&
+        (0 == CTR_GET(dp, timeouts) % opt.deadline_resets))
+        deadline_reset(dp);
+}
+
+/* Aborts the READs of rqs that are past the --deadline at now. Returns
+ * when the next of the others gets there, UINT64_MAX for none. */
+static uint64_t
+deadline_scan(t_dev *dp, t_rq *rqs, int qd, uint64_t now)
+{
+    uint64_t dl = (uint64_t)opt.deadline_ms * 1000000ULL;
+    uint64_t first = UINT64_MAX;
+    int k;
+
+    for (k = 0; k < qd; ++k)
+    {
+        if (!rqs[k].busy || rqs[k].aborted)
+            continue;
+        if (rqs[k].t_ns + dl <= now)
+            deadline_abort(dp, rqs + k);
+        else if (rqs[k].t_ns + dl < first)
+            first = rqs[k].t_ns + dl;
+    }
+    return first;
+}
+
+/* With a --deadline, waits until a READ of rqs completes, aborting
+ * those that get past it meanwhile. While uevents are watched it also
+ * looks each GONE_POLL_MS for dev_gone(), and then aborts all of them.
+ * Without either, sg_finish_io() waits. */
+static void
+async_wait(t_dev *dp, t_rq *rqs, int qd)
+{
+    uint64_t now, first, due, tick = GONE_POLL_MS * 1000000ULL;
+    struct pollfd pfd[MAX_PATHS];
+    int res, k, n = dp->npaths ? dp->npaths : 1;
+
+    for (k = 0; k < n; ++k)
+    {
+        pfd[k].fd = path_fd(dp, k);
+        pfd[k].events = POLLIN;
+    }
+    for (;;)
+    {
+        now = lat_now_ns();
+        if (__atomic_load_n(&dp->gone, __ATOMIC_RELAXED))
+            for (k = 0; k < qd; ++k)
+                if (rqs[k].busy && !rqs[k].aborted)
+                    rq_abort(dp, rqs + k);
+        first = (opt.deadline_ms > 0) ? deadline_scan(dp, rqs, qd, now)
+                                      : UINT64_MAX;
+        if ((uevent_fd >= 0) && (first > now + tick))
+            first = now + tick;
+        if (dp->sim)
+        {
+            /* nothing to poll, the next completion is known */
+            due = sim_next_due(dp->sim);
+            if (due <= now)
+                return;
+            throttle_sleep(((due < first) ? due : first) - now);
+            continue;
+        }
+        res = poll(pfd, n, (UINT64_MAX == first) ? -1 :
+                            (int)((first - now) / 1000000ULL) + 1);
+        if ((res > 0) || ((res < 0) && (EINTR != errno)))
+            return;
+    }
+}
+
+/* The state of one pass of the sg async engine, kept apart from any
+ * stack so a thread of the event engine can drive it as well. */
+typedef struct _apass
+{
+    t_dev *dp;
+    const t_pattern *pat;
+    t_rq *rqs;
+    int qd;
+    int64_t next;       /* first lba not yet queued */
+    int nact;           /* actuators, 0 -> one stream over the range */
+    int64_t act_next[MAX_ACTUATORS]; /* next of each, on its share of rqs */
+    int64_t act_end[MAX_ACTUATORS];
+    int in_flight;
+    int ret;            /* first error, the pass then drains */
+    uint64_t wait;      /* ns until the rate caps allow a READ */
+    uint8_t *spare;     /* the buffer one more than there are slots */
+    uint8_t *spare_free;
+    struct iobuf_sgl *sgls; /* --sgl: one per slot and the spare last */
+    struct iobuf_sgl *spare_sgl;
+    /* event engine */
+    uint64_t resume_ns; /* nothing in flight, fill again then */
+    bool done;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct _apass *link; /* on the list of its event loop */
+} t_apass;
+
+/* Allocates the slots of a pass of dp checked against pat. Returns 0,
+ * else -1 with ap->ret set and apass_free() still to be called. */
+static int
+apass_init(t_apass *ap, t_dev *dp, const t_pattern *pat)
+{
+    int k;
+
+    memset(ap, 0, sizeof(*ap));
+    ap->dp = dp;
+    ap->pat = pat;
+    ap->qd = dp->qd;
+    ap->next = dp->from;
+    dp->pf_lba = dp->from;
+    dmap_begin(dp);
+    if ((dp->nact > 1) && (ap->qd >= dp->nact))
+    {
+        ap->nact = dp->nact;
+        for (k = 0; k < ap->nact; ++k)
+        {
+            ap->act_end[k] = (dp->act[k].end < dp->end) ? dp->act[k].end
+                                                        : dp->end;
+            ap->act_next[k] = (dp->act[k].lba > dp->from) ? dp->act[k].lba
+                                                          : dp->from;
+            if (ap->act_next[k] > ap->act_end[k])
+                ap->act_next[k] = ap->act_end[k];
+        }
+    }
+    ap->rqs = (t_rq *)calloc(ap->qd, sizeof(t_rq));
+    if (NULL == ap->rqs)
+    {
+        ap->ret = -1;
+        return -1;
+    }
+    qd_start(dp);
+    if (opt.sgl && ((size_t)dp->bpt * dp->blk_sz > IOBUF_HUGE_MIN))
+    {
+        ap->sgls = (struct iobuf_sgl *)calloc(ap->qd + 1, sizeof(*ap->sgls));
+        for (k = 0; ap->sgls && (k <= ap->qd); ++k)
+            if (iobuf_sgl_alloc(ap->sgls + k, (size_t)dp->bpt * dp->blk_sz,
+                                IOBUF_HUGE_MIN, dp->numa_node))
+                break;
+        if ((NULL == ap->sgls) || (k <= ap->qd))
+        {
+            pr2serr(">> heap problems\n");
+            ap->ret = -1;
+            return -1;
+        }
+        for (k = 0; k < ap->qd; ++k)
+            ap->rqs[k].sgl = ap->sgls + k;
+        ap->spare_sgl = ap->sgls + ap->qd;
+        return 0;
+    }
+    ap->spare = io_buf(dp, dp->bpt * dp->blk_sz, &ap->spare_free);
+    for (k = 0; k < ap->qd; ++k)
+    {
+        ap->rqs[k].buffp = io_buf(dp, dp->bpt * dp->blk_sz,
+                                  &ap->rqs[k].free_buffp);
+        if ((NULL == ap->rqs[k].buffp) || (NULL == ap->spare))
+        {
+            pr2serr(">> heap problems\n");
+            ap->ret = -1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Waits for the side queue and frees the slots. Returns the result of
+ * the pass. */
+static int
+apass_free(t_apass *ap)
+{
+    int k, res = iso_finish(ap->dp);
+
+    if (0 == ap->ret)
+        ap->ret = res;
+    if (ap->rqs)
+        for (k = 0; k < ap->qd; ++k)
+            iobuf_free(ap->rqs[k].free_buffp);
+    free(ap->rqs);
+    iobuf_free(ap->spare_free);
+    for (k = 0; ap->sgls && (k <= ap->qd); ++k)
+        iobuf_sgl_free(ap->sgls + k);
+    free(ap->sgls);
+    return ap->ret;
+}
+
+/* Queues READs on the idle slots of ap. With actuators each has
+ * qd / nact of the slots and as much of the --adaptive-qd depth, and
+ * reads its range in order, as the device positions them apart. */
+static void
+apass_fill(t_apass *ap)
+{
+    t_dev *dp = ap->dp;
+    int a, k, lo, hi, n, cap;
+    uint64_t wait;
+
+    if (0 == ap->nact)
+    {
+        ap->ret = async_fill(dp, ap->rqs, ap->qd, &ap->next, dp->end,
+                             dev_qd(dp), &ap->in_flight, &ap->wait);
+        return;
+    }
+    ap->wait = 0;
+    for (a = 0; (a < ap->nact) && (0 == ap->ret); ++a)
+    {
+        lo = a * ap->qd / ap->nact;
+        hi = (a + 1) * ap->qd / ap->nact;
+        for (n = 0, k = lo; k < hi; ++k)
+            n += ap->rqs[k].busy;
+        ap->in_flight -= n;
+        cap = dev_qd(dp) * (hi - lo) / ap->qd;
+        ap->ret = async_fill(dp, ap->rqs + lo, hi - lo, ap->act_next + a,
+                             ap->act_end[a], cap ? cap : 1, &n, &wait);
+        ap->in_flight += n;
+        if (wait && (!ap->wait || (wait < ap->wait)))
+            ap->wait = wait;
+    }
+}
+
+/* Every block of the pass below it has been read: the lowest of the
+ * low_water() of each actuator that has some of its range left. */
+static int64_t
+apass_low(const t_apass *ap)
+{
+    int64_t low = ap->dp->end, w;
+    int a, lo, hi;
+
+    if (0 == ap->nact)
+        return low_water(ap->rqs, ap->qd, ap->next);
+    for (a = 0; a < ap->nact; ++a)
+    {
+        lo = a * ap->qd / ap->nact;
+        hi = (a + 1) * ap->qd / ap->nact;
+        w = low_water(ap->rqs + lo, hi - lo, ap->act_next[a]);
+        if ((w < ap->act_end[a]) && (w < low))
+            low = w;
+    }
+    return low;
+}
+
+/* Whether the pass has READs in flight or still to queue. */
+static bool
+apass_running(const t_apass *ap)
+{
+    return (ap->in_flight > 0) || ((0 == ap->ret) && ap->wait);
+}
+
+/* Takes in the READ rqp that sg_finish_io() returned with res: hands a
+ * failure to the side queue, re-queues the slot and then checks the
+ * data. One a full queue refused lowers the cap of dp and is queued
+ * again once the cap allows it. */
+static void
+apass_complete(t_apass *ap, t_rq *rqp, int res)
+{
+    t_dev *dp = ap->dp;
+    int64_t lba = rqp->lba;
+    int blocks = rqp->blocks;
+    uint8_t *cbuf = rqp->buffp;
+    uint8_t *cfree = rqp->free_buffp;
+    struct iobuf_sgl *csgl = rqp->sgl;
+    bool queued = false;
+
+    if (rqp->aborted && (SG_LIB_CAT_CLEAN != res) &&
+        (SG_LIB_CAT_CONDITION_MET != res))
+        res = SG_LIB_CAT_ABORTED_COMMAND; /* by deadline_abort() */
+    else if (qfull_status(&rqp->io_hdr))
+    {
+        io_trace(dp, TRACE_READ, lba, blocks, rqp->t_ns, rqp->qd, res);
+        qfull_hit(dp, ap->in_flight);
+        rqp->busy = false;
+        rqp->requeue = true;
+        --ap->in_flight;
+        if (0 == ap->ret)
+            apass_fill(ap);
+        return;
+    }
+    lat_done(dp, lba, blocks, rqp->t_ns);
+    io_trace(dp, TRACE_READ, lba, blocks, rqp->t_ns, rqp->qd, res);
+    rqp->buffp = ap->spare;
+    rqp->free_buffp = ap->spare_free;
+    rqp->sgl = ap->spare_sgl;
+    rqp->busy = false;
+    --ap->in_flight;
+    switch (res)
+    {
+    case SG_LIB_CAT_CLEAN:
+    case SG_LIB_CAT_CONDITION_MET:
+        qfull_probe(dp);
+        if (dp->pi_type)
+            pi_check(dp, cbuf, lba, blocks);
+        break;
+    case SG_LIB_CAT_RECOVERED:
+        qfull_probe(dp);
+        rec_error(dp, lba);
+        errlog_put(res, NULL, 0, 0, "reading", &rqp->io_hdr, verbose > 1);
+        if (dp->pi_type)
+            pi_check(dp, cbuf, lba, blocks);
+        break;
+    default:
+    {
+        bool diop = false;
+        int blks_readp = 0;
+
+        /* past its --cdl limit: the side queue reads it without one */
+        cdl_expired(dp, rqp->sb, rqp->io_hdr.sb_len_wr);
+        if (0 == iso_push(dp, ap->pat, lba, blocks, res))
+        {
+            queued = true;
+            break;
+        }
+        res = csgl ? sg_read_sgl(dp, csgl, blocks, lba)
+                   : sg_read(dp, cbuf, blocks, lba, &diop, &blks_readp);
+        if (res)
+        {
+            errlog_put(res, "sg_read failed, at or after lba=%" PRId64 " [0x%"
+                       PRIx64 "]\n", lba, lba, NULL, NULL, false);
+            if (0 == ap->ret)
+                ap->ret = res;
+        }
+    }
+    }
+    if (0 == ap->ret)
+        ap->ret = iso_error(dp);
+    if (0 == ap->ret)
+        apass_fill(ap);
+
+    /* device is busy with the next READs while this one is checked */
+    if (queued)
+        ;
+    else if (csgl)
+        verify_sgl(dp, csgl, ap->pat, lba, blocks);
+    else
+        verify_chunk(dp, cbuf, ap->pat, lba, blocks);
+    ap->spare = cbuf;
+    ap->spare_free = cfree;
+    ap->spare_sgl = csgl;
+    if (ap->ret || queued)
+        return; /* drain what is still in flight */
+    CTR_ADD(dp, in_full, blocks);
+    __atomic_fetch_add(&dp->bytes_done, (int64_t)blocks * dp->blk_sz,
+                       __ATOMIC_RELAXED);
+    actuator_done(dp, lba, (int64_t)blocks * dp->blk_sz);
+    dmap_done(dp, lba, blocks);
+    __atomic_store_n(&dp->cur_lba, iso_water(dp, apass_low(ap)),
+                     __ATOMIC_RELAXED);
+}
+
+/* Drives ap on the calling thread until the pass is over. */
+static void
+apass_run(t_apass *ap)
+{
+    t_dev *dp = ap->dp;
+    t_rq *rqp;
+    int res;
+
+    while (apass_running(ap))
+    {
+        if (0 == ap->in_flight)
+        {
+            throttle_sleep(ap->wait);
+            apass_fill(ap);
+            continue;
+        }
+        if ((opt.deadline_ms > 0) || (uevent_fd >= 0))
+            async_wait(dp, ap->rqs, ap->qd);
+        res = sg_finish_io(dp, &rqp, false);
+        if (res < 0)
+        {
+            ap->ret = -1;
+            break;
+        }
+        apass_complete(ap, rqp, res);
+    }
+}
+
+/* One pass over [dp->start, dp->end) keeping dp->qd READs queued on the
+ * sg fd. Completions are handled in whatever order the device returns
+ * them. There is one buffer more than there are slots: a completed
+ * READ's buffer is swapped for the spare and its slot re-queued before
+ * the data is checked, so the check overlaps the READs still in flight.
+ * A READ that does not complete cleanly goes to the side queue, where
+ * sg_read() re-issues it with the usual retry, isolation, coe and READ
+ * LONG handling while the other READs stream on. So does one aborted
+ * for missing the --deadline. Under a rate cap slots stay idle until
+ * the buckets refill, sleeping only when none is in flight. */
+static int
+read_pass_async(t_dev *dp, const t_pattern *pat)
+{
+    t_apass ap;
+
+    if (apass_init(&ap, dp, pat))
+        return apass_free(&ap);
+    apass_fill(&ap);
+    apass_run(&ap);
+    return apass_free(&ap);
+}
+
+/* The event engine: opt.event_threads threads, each with an epoll set
+ * of the sg fds of the passes it drives. A pass is handed to the loop
+ * of its device and the device's thread sleeps until it is over, so
+ * the threads doing I/O do not grow with the number of devices.
+ * Throttled passes and --deadline checks are looked at every
+ * EV_TICK_MS. */
+typedef struct _evloop
+{
+    int epfd;
+    pthread_mutex_t mutex;
+    t_apass *head; /* the passes of the loop */
+    pthread_t tid;
+} t_evloop;
+
+static t_evloop evloops[MAX_EVENT_THREADS];
+static int ev_started; /* loops running */
+static pthread_once_t ev_once = PTHREAD_ONCE_INIT;
+
+/* Takes ap off lp and wakes the device thread, which may free ap. */
+static void
+ev_finish(t_evloop *lp, t_apass *ap)
+{
+    t_apass **app;
+
+    pthread_mutex_lock(&lp->mutex);
+    for (app = &lp->head; *app; app = &(*app)->link)
+        if (*app == ap)
+        {
+            *app = ap->link;
+            break;
+        }
+    pthread_mutex_unlock(&lp->mutex);
+    epoll_ctl(lp->epfd, EPOLL_CTL_DEL, ap->dp->fd, NULL);
+    pthread_mutex_lock(&ap->mutex);
+    ap->done = true;
+    pthread_cond_signal(&ap->cond);
+    pthread_mutex_unlock(&ap->mutex);
+}
+
+/* Notes when a pass with nothing in flight may fill again, or finishes
+ * it. Returns false when it did finish. */
+static bool
+ev_settle(t_evloop *lp, t_apass *ap)
+{
+    if (!apass_running(ap))
+    {
+        ev_finish(lp, ap);
+        return false;
+    }
+    if (0 == ap->in_flight)
+        ap->resume_ns = lat_now_ns() + ap->wait;
+    return true;
+}
+
+/* The sg fd of ap is readable: takes in what has completed, at most
+ * one slot's worth so that no device holds up the others. */
+static void
+ev_ready(t_evloop *lp, t_apass *ap)
+{
+    t_rq *rqp;
+    int k, res;
+
+    for (k = 0; (k < ap->qd) && (ap->in_flight > 0); ++k)
+    {
+        res = sg_finish_io(ap->dp, &rqp, true);
+        if (-3 == res)
+            break;
+        if (res < 0)
+        {
+            ap->ret = -1;
+            ap->in_flight = 0;
+            break;
+        }
+        apass_complete(ap, rqp, res);
+    }
+    ev_settle(lp, ap);
+}
+
+/* Every EV_TICK_MS: refills the throttled passes that may go on and
+ * aborts the READs past the --deadline. */
+static void
+ev_tick(t_evloop *lp, uint64_t now)
+{
+    t_apass *ap, *next;
+
+    pthread_mutex_lock(&lp->mutex);
+    ap = lp->head;
+    pthread_mutex_unlock(&lp->mutex);
+    /* only this thread takes passes off the list */
+    for (; ap; ap = next)
+    {
+        pthread_mutex_lock(&lp->mutex);
+        next = ap->link;
+        pthread_mutex_unlock(&lp->mutex);
+        if ((opt.deadline_ms > 0) && ap->in_flight)
+            deadline_scan(ap->dp, ap->rqs, ap->qd, now);
+        if ((0 == ap->in_flight) && (ap->resume_ns <= now))
+        {
+            apass_fill(ap);
+            ev_settle(lp, ap);
+        }
+    }
+}
+
+static void *
+ev_thread(void *arg)
+{
+    t_evloop *lp = (t_evloop *)arg;
+    struct epoll_event evs[EV_BATCH];
+    uint64_t now, tick = 0;
+    int k, n;
+
+    if (opt.background)
+        syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, IOPRIO_IDLE);
+    for (;;)
+    {
+        n = epoll_wait(lp->epfd, evs, EV_BATCH, EV_TICK_MS);
+        if ((n < 0) && (EINTR != errno))
+        {
+            perror("epoll_wait");
+            return NULL;
+        }
+        for (k = 0; k < n; ++k)
+            ev_ready(lp, (t_apass *)evs[k].data.ptr);
+        now = lat_now_ns();
+        if (now - tick >= EV_TICK_MS * 1000000ULL)
+        {
+            tick = now;
+            ev_tick(lp, now);
+        }
+    }
+    return NULL;
+}
+
+/* Starts the loops, once. Those that fail to start are left out. */
+static void
+ev_start(void)
+{
+    int k;
+
+    for (k = 0; k < opt.event_threads; ++k)
+    {
+        t_evloop *lp = evloops + ev_started;
+
+        lp->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (lp->epfd < 0)
+            break;
+        pthread_mutex_init(&lp->mutex, NULL);
+        if (pthread_create(&lp->tid, NULL, ev_thread, lp))
+        {
+            close(lp->epfd);
+            break;
+        }
+        pthread_detach(lp->tid);
+        ++ev_started;
+    }
+    if (ev_started < opt.event_threads)
+        pr2serr("started %d of %d event threads: %s\n", ev_started,
+                opt.event_threads, safe_strerror(errno));
+}
+
+/* One pass of dp as read_pass_async() does it, driven by the event loop
+ * of the device. */
+static int
+read_pass_event(t_dev *dp, const t_pattern *pat)
+{
+    t_evloop *lp;
+    t_apass ap;
+    struct epoll_event ev;
+    int res;
+
+    pthread_once(&ev_once, ev_start);
+    if (0 == ev_started)
+        return read_pass_async(dp, pat);
+    if (apass_init(&ap, dp, pat))
+        return apass_free(&ap);
+    pthread_mutex_init(&ap.mutex, NULL);
+    pthread_cond_init(&ap.cond, NULL);
+    lp = evloops + (dp - devs) % ev_started;
+    apass_fill(&ap);
+    if (apass_running(&ap))
+    {
+        if (0 == ap.in_flight)
+            ap.resume_ns = lat_now_ns() + ap.wait;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = &ap;
+        pthread_mutex_lock(&lp->mutex);
+        ap.link = lp->head;
+        lp->head = &ap;
+        res = epoll_ctl(lp->epfd, EPOLL_CTL_ADD, dp->fd, &ev);
+        if (res)
+            lp->head = ap.link;
+        pthread_mutex_unlock(&lp->mutex);
+        if (res)
+        {
+            pr2serr("%s: epoll_ctl: %s, reading on its own thread\n",
+                    dp->device_name, safe_strerror(errno));
+            apass_run(&ap);
+        }
+        else
+        {
+            pthread_mutex_lock(&ap.mutex);
+            while (!ap.done)
+                pthread_cond_wait(&ap.cond, &ap.mutex);
+            pthread_mutex_unlock(&ap.mutex);
+        }
+    }
+    pthread_mutex_destroy(&ap.mutex);
+    pthread_cond_destroy(&ap.cond);
+    return apass_free(&ap);
+}
+
+/* Reads blocks at lba from a block device opened O_DIRECT, re-trying
+ * after EINTR and short reads. Returns 0, else -1 once reported or,
+ * when quiet, 1 for a media error (EIO) and -1 for any other. */
+static int
+blk_pread(t_dev *dp, uint8_t *buff, int blocks, int64_t lba, bool quiet)
+{
+    size_t len = (size_t)blocks * dp->blk_sz;
+    size_t got = 0;
+    ssize_t res;
+
+    PROBE3(submit, dp->device_name, lba, blocks);
+    while (got < len)
+    {
+        res = pread(dp->fd, buff + got, len - got,
+                    (off_t)lba * dp->blk_sz + (off_t)got);
+        if ((res < 0) && (EINTR == errno))
+            continue;
+        if ((res < 0) && ((ENODEV == errno) || (ENXIO == errno)))
+        {
+            dev_gone(dp, "device removed");
+            return -1;
+        }
+        if ((res <= 0) && quiet)
+            return ((res < 0) && (EIO == errno)) ? 1 : -1;
+        if (res <= 0)
+        {
+            pr2serr("%s: read failed at or after lba=%" PRId64 " [0x%" PRIx64
+                    "]: %s\n", dp->device_name, lba, lba,
+                    (res < 0) ? safe_strerror(errno) : "unexpected end");
+            CTR_ADD(dp, unrecovered, 1);
+            bad_block(dp, BADMAP_BAD, lba, blocks);
+            return -1;
+        }
+        got += res;
+    }
+    return 0;
+}
+
+/* The data and metadata pointers and lengths of an NVM Read of blocks
+ * into buff, metadata apart from the data after its blocks. PRINFO is
+ * left 0: the controller passes the tuples on unchecked, pi_check()
+ * checks them. */
+static void
+nvme_rd_xfer(const t_dev *dp, uint8_t *buff, int blocks, __u64 *addrp,
+             __u32 *data_lenp, __u64 *mdp, __u32 *md_lenp)
+{
+    *addrp = (uint64_t)(uintptr_t)buff;
+    *data_lenp = (uint32_t)xfer_len(dp, blocks);
+    if (dp->pi_ms && !dp->pi_ext)
+    {
+        *mdp = (uint64_t)(uintptr_t)(buff + (size_t)blocks * dp->blk_sz);
+        *md_lenp = (uint32_t)blocks * dp->pi_ms;
+    }
+}
+
+/* The NVM Read of blocks at lba into buff, as nvme_io() takes it. */
+static void
+nvme_rd_cmd(const t_dev *dp, struct nvme_passthru_cmd64 *cmd, uint8_t *buff,
+            int blocks, int64_t lba)
+{
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->opcode = 0x02; /* Read */
+    cmd->nsid = dp->nsid;
+    nvme_rd_xfer(dp, buff, blocks, &cmd->addr, &cmd->data_len,
+                 &cmd->metadata, &cmd->metadata_len);
+    cmd->cdw10 = (uint32_t)lba;
+    cmd->cdw11 = (uint32_t)((uint64_t)lba >> 32);
+    cmd->cdw12 = blocks - 1; /* NLB is 0's based */
+    if (dp->flags.fua)
+        cmd->cdw12 |= 1u << 30; /* FUA */
+}
+
+/* One NVM Read of blocks at lba, synchronous, with nvme_io(). Returns
+ * 0, else -1 once reported or, when quiet, 1 for an NVMe status and -1
+ * when the command could not be sent. */
+static int
+nvme_read(t_dev *dp, uint8_t *buff, int blocks, int64_t lba, bool quiet)
+{
+    struct nvme_passthru_cmd64 cmd;
+    int res;
+
+    PROBE3(submit, dp->device_name, lba, blocks);
+    nvme_rd_cmd(dp, &cmd, buff, blocks, lba);
+    res = nvme_io(dp, &cmd);
+    if ((0 == res) && dp->pi_type)
+        pi_check(dp, buff, lba, blocks);
+    if (0 == res)
+        return 0;
+    if (quiet)
+        return (res > 0) ? 1 : -1;
+    if (res < 0)
+        pr2serr("%s: NVMe Read failed at lba=%" PRId64 " [0x%" PRIx64
+                "]: %s\n", dp->device_name, lba, lba, safe_strerror(errno));
+    else
+        pr2serr("%s: NVMe Read failed at lba=%" PRId64 " [0x%" PRIx64
+                "], status: sct=0x%x sc=0x%x\n", dp->device_name, lba, lba,
+                (res >> 8) & 0x7, res & 0xff);
+    CTR_ADD(dp, unrecovered, 1);
+    bad_block(dp, BADMAP_BAD, lba, blocks);
+    return -1;
+}
+
+/* Reads a piece of a failed READ once, for isolate_split(): 0 -> read,
+ * 1 -> the piece has bad blocks, -1 -> the device no longer answers. */
+static int
+isolate_read(t_dev *dp, uint8_t *buff, int blocks, int64_t lba)
+{
+    uint64_t io_addr = 0;
+    int res;
+
+    if (FT_NVME & dp->out_type)
+        return nvme_read(dp, buff, blocks, lba, true);
+    if (!((FT_SG | FT_SIM) & dp->out_type))
+        return blk_pread(dp, buff, blocks, lba, true);
+    for (;;)
+    {
+        res = sg_read_low(dp, buff, blocks, lba, NULL, &io_addr);
+        switch (res)
+        {
+        case 0:
+            return 0;
+        case SG_LIB_CAT_MEDIUM_HARD:
+        case SG_LIB_CAT_MEDIUM_HARD_WITH_INFO:
+            return 1;
+        case SG_LIB_CAT_UNIT_ATTENTION:
+            if (CTR_BUDGET(dp, uas, dp->ua_budget))
+                continue;
+            return -1;
+        case SG_LIB_CAT_ABORTED_COMMAND:
+            if (CTR_BUDGET(dp, aborted, dp->aborted_budget))
+                continue;
+            return -1;
+        default:
+            return -1;
+        }
+    }
+}
+
+/* Splits [lba, lba + blocks) in halves, reads each once and splits
+ * every half that fails again, so the blocks that read keep their data
+ * at the size they came in. A single block is retried, then zero
+ * filled and added to *badp. Returns 0, -1 when the device stopped
+ * answering, its unread blocks then counted bad. */
+static int
+isolate_range(t_dev *dp, uint8_t *buff, int64_t lba, int blocks, int *badp)
+{
+    int half = blocks / 2;
+    int k, n, res, retries;
+    int64_t plba;
+    uint8_t *bp;
+
+    for (k = 0; k < 2; ++k)
+    {
+        plba = k ? lba + half : lba;
+        n = k ? blocks - half : half;
+        bp = buff + (k ? (size_t)half * dp->blk_sz : 0);
+        res = isolate_read(dp, bp, n, plba);
+        for (retries = dp->flags.retries; (1 == n) && (1 == res) &&
+                                          (retries > 0); --retries)
+        {
+            CTR_ADD(dp, retries, 1);
+            res = isolate_read(dp, bp, n, plba);
+        }
+        if (res < 0)
+        {
+            n = blocks - (int)(plba - lba);
+            memset(bp, 0, (size_t)n * dp->blk_sz);
+            bad_block(dp, BADMAP_BAD, plba, n);
+            *badp += n;
+            return -1;
+        }
+        if (0 == res)
+            continue;
+        if ((n > 1) && isolate_range(dp, bp, plba, n, badp))
+            return -1;
+        if (n > 1)
+            continue;
+        if (verbose)
+            pr2serr(">> unrecovered read error at blk=%" PRId64 ", use "
+                    "zeros\n", plba);
+        memset(bp, 0, dp->blk_sz);
+        bad_block(dp, BADMAP_BAD, plba, 1);
+        ++*badp;
+    }
+    return 0;
+}
+
+/* Finds the bad blocks of a multi-block READ that failed without
+ * saying where (isolate_range()). The pieces that failed on the way
+ * are not counted, each bad block counts one unrecovered error.
+ * Returns the number of bad blocks, -1 if the device stopped answering. */
+static int
+isolate_split(t_dev *dp, uint8_t *buff, int64_t lba, int blocks)
+{
+    int64_t unrecovered = dp->ctr[ctr_shard].unrecovered;
+    int bad = 0;
+    int res = isolate_range(dp, buff, lba, blocks, &bad);
+
+    CTR_ADD(dp, unrecovered,
+            unrecovered + bad - dp->ctr[ctr_shard].unrecovered);
+    if (res)
+        pr2serr("%s: device stopped answering while isolating the bad "
+                "blocks of lba=%" PRId64 " [0x%" PRIx64 "]\n",
+                dp->device_name, lba, lba);
+    else
+        pr2serr("%s: %d of %d blocks at lba=%" PRId64 " [0x%" PRIx64 "] "
+                "unreadable%s\n", dp->device_name, bad, blocks, lba, lba,
+                bad ? "" : ", the READ did not fail again");
+    return res ? -1 : bad;
+}
+
+/* Synchronous read for the devices the io_uring engine drives. A
+ * multi-block read that fails is split to find its bad blocks, which
+ * with coe are read as zeros. Returns 0, else -1 once reported. */
+static int
+direct_read(t_dev *dp, uint8_t *buff, int blocks, int64_t lba)
+{
+    int res, bad;
+
+    if (__atomic_load_n(&dp->gone, __ATOMIC_RELAXED))
+        return -1;
+    res = (blocks > 1) ? isolate_read(dp, buff, blocks, lba) : -1;
+    if (0 == res)
+        return 0;
+    if (1 == res)
+    {
+        bad = isolate_split(dp, buff, lba, blocks);
+        return ((0 == bad) || ((bad > 0) && dp->flags.coe)) ? 0 : -1;
+    }
+    /* a single block, or not a media error: read again to report it */
+    if (FT_NVME & dp->out_type)
+        return nvme_read(dp, buff, blocks, lba, false);
+    return blk_pread(dp, buff, blocks, lba, false);
+}
+
+/* --slow threshold in ns for dp, 0 -> off. A multiple of the median
+ * needs SLOW_WARMUP commands of the pass first. */
+static uint64_t
+slow_threshold(t_dev *dp)
+{
+    uint64_t median;
+
+    if (opt.slow_ms > 0)
+        return (uint64_t)(opt.slow_ms * 1e6);
+    if ((opt.slow_mult <= 0) || (dp->lat_pass.count < SLOW_WARMUP))
+        return 0;
+    median = __atomic_load_n(&dp->slow_median, __ATOMIC_RELAXED);
+    return (uint64_t)(opt.slow_mult * median);
+}
+
+/* Adds a weak sector to the --weak-report file, or to stderr. */
+static void
+weak_report(t_dev *dp, int64_t lba, uint64_t ns)
+{
+    __atomic_fetch_add(&dp->weak_sectors, 1, __ATOMIC_RELAXED);
+    bad_block(dp, BADMAP_WEAK, lba, 1);
+    pthread_mutex_lock(&weak_mutex);
+    if (weak_fp)
+    {
+        fprintf(weak_fp, "%s\t%" PRId64 "\t%.1f\n", dp->device_name, lba,
+                ns / 1e6);
+        fflush(weak_fp);
+    }
+    else
+        pr2serr("%s: weak sector at lba=%" PRId64 " [0x%" PRIx64 "], read "
+                "took %.1f ms\n", dp->device_name, lba, lba, ns / 1e6);
+    pthread_mutex_unlock(&weak_mutex);
+}
+
+/* Re-reads [lba, lba + blocks) in SLOW_SPLIT pieces and every piece
+ * that is still slower than thr in smaller pieces again, down to single
+ * blocks, which are reported. Returns the number of weak sectors. */
+static int
+slow_hunt(t_dev *dp, int64_t lba, int blocks, uint64_t thr)
+{
+    int piece = (blocks + SLOW_SPLIT - 1) / SLOW_SPLIT;
+    int k, n, found = 0;
+    bool diop = false;
+    uint64_t t_ns;
+    uint8_t *buf, *free_buf;
+
+    buf = io_buf(dp, piece * dp->blk_sz, &free_buf);
+    if (NULL == buf)
+        return 0;
+    for (k = 0; k < blocks; k += piece)
+    {
+        int blks_read = 0;
+
+        n = (blocks - k < piece) ? blocks - k : piece;
+        t_ns = lat_now_ns();
+        if (FT_SG & dp->out_type)
+            sg_read(dp, buf, n, lba + k, &diop, &blks_read);
+        else
+            direct_read(dp, buf, n, lba + k);
+        t_ns = lat_now_ns() - t_ns;
+        if (t_ns <= thr)
+            continue;
+        if (1 == n)
+        {
+            weak_report(dp, lba + k, t_ns);
+            ++found;
+        }
+        else
+            found += slow_hunt(dp, lba + k, n, thr);
+    }
+    iobuf_free(free_buf);
+    return found;
+}
+
+/* Feeds one command to the --adaptive-qd controller of dp. */
+static void
+qd_adapt(t_dev *dp, uint64_t bytes, uint64_t ns)
+{
+    uint64_t p99;
+    double bps;
+    char buf[32];
+    int qd = qdctl_done(&dp->run->qdc, ns, bytes, &p99, &bps);
+
+    if (qd && verbose)
+        pr2serr("%s: queue depth %d (p99 %s, %.1f MB/s)\n", dp->device_name,
+                qd, lat_str(p99, buf, sizeof(buf)), bps / 1e6);
+}
+
+/* Records one command's latency and, when it took longer than --slow
+ * allows, looks for the slow blocks of [lba, lba + blocks). */
+static void
+lat_done(t_dev *dp, int64_t lba, int blocks, uint64_t ns)
+{
+    uint64_t thr, busy;
+
+    lat_record(&dp->lat_pass, ns);
+    if (dp->idle_fd >= 0)
+        __atomic_fetch_add(&dp->idle_cmds, 1, __ATOMIC_RELAXED);
+    if (!dp->tuning)
+    {
+        busy = zone_done(dp, lba, blocks);
+        if (dp->rz.cell)
+            reczone_record(&dp->rz, lba, (uint64_t)blocks * dp->blk_sz, ns,
+                           busy);
+    }
+    if (dp->run && dp->run->qdc.qd && !dp->tuning)
+        qd_adapt(dp, (uint64_t)blocks * dp->blk_sz, ns);
+    if (dp->heat.cell && !dp->tuning)
+        lat_map_record(&dp->heat, lba, (uint64_t)blocks * dp->blk_sz, ns,
+                       lat_now_ns());
+    if (opt.slow_mult > 0 && (0 == (dp->lat_pass.count & 0xff)))
+        __atomic_store_n(&dp->slow_median,
+                         lat_percentile(&dp->lat_pass, 50.0), __ATOMIC_RELAXED);
+    thr = slow_threshold(dp);
+    if ((0 == thr) || (ns <= thr) || dp->tuning)
+        return;
+    if (verbose)
+        pr2serr("%s: %d blocks at lba=%" PRId64 " took %.1f ms, looking for "
+                "weak sectors\n", dp->device_name, blocks, lba, ns / 1e6);
+    if ((0 == slow_hunt(dp, lba, blocks, thr)) && verbose)
+        pr2serr("%s: slow read at lba=%" PRId64 " did not repeat\n",
+                dp->device_name, lba);
+}
+
+/* --trace and the complete probe: one command of dp that took ns at
+ * queue depth qd and ended with res, 0 or its SG_LIB_CAT_* error class. */
+static void
+io_trace(const t_dev *dp, int op, int64_t lba, int blocks, uint64_t ns,
+         int qd, int res)
+{
+    PROBE6(complete, dp->device_name, op, lba, blocks, ns, res);
+    if (__atomic_load_n(&trace_on, __ATOMIC_RELAXED))
+        trace_io((int)(dp - devs), op, lba, blocks, ns, qd, res);
+}
+
+/* The SG_LIB_CAT_* error class of an io_uring completion res that is
+ * not a full READ: a negative errno, or an NVMe status. */
+static int
+uring_cat(const t_dev *dp, int res)
+{
+    if ((FT_NVME & dp->out_type) && (res > 0))
+        return SG_LIB_CAT_MEDIUM_HARD;
+    switch (-res)
+    {
+    case EIO:
+        return SG_LIB_CAT_MEDIUM_HARD;
+    case EAGAIN:
+    case EBUSY:
+    case EINTR:
+        return SG_LIB_CAT_ABORTED_COMMAND;
+    }
+    return SG_LIB_CAT_OTHER; /* a short read among them */
+}
+
+typedef struct _lane t_lane;
+
+/* One io_uring submitter of a pass. With --rings n there are n lanes,
+ * each with its own ring and its own thread pinned to its own CPU, so
+ * that no submission queue is shared between cores. The range is cut
+ * into chunks of CHUNK_BYTES dealt round robin to the lanes' deques. A
+ * lane reads its chunks front first and, out of its own, steals from
+ * the back of the fullest deque, so a lane slowed by its CPU or by
+ * slow sectors does not hold up the pass. Within a chunk a lane moves
+ * its own cursor, the shared mutex is only taken per chunk and for
+ * the low-water mark. */
+struct _lane
+{
+    t_dev *dp;
+    struct uring ring;
+    struct spdkdev_qp *qp; /* spdk_lane(): the lane's queue pair */
+    int idx;
+    int cpu; /* -1 -> not pinned */
+    pthread_mutex_t *sched_mutex; /* the deques of all lanes of the pass */
+    int64_t *dq;      /* first lbas of the lane's chunks, ascending */
+    int dq_head;      /* dq[dq_head, dq_tail) are still to be read */
+    int dq_tail;
+    int64_t chunk;    /* blocks per chunk */
+    int64_t cur;      /* next lba of the chunk being read, published */
+    int64_t cur_end;  /* end of that chunk, under sched_mutex */
+    int stolen;       /* chunks taken from other lanes */
+    const t_pattern *pat;
+    int64_t low;      /* low_water() of the lane, published before cur */
+    t_lane *lanes;    /* all nlanes of the pass */
+    int nlanes;
+    int res;
+    pthread_t tid;
+};
+
+/* Moves lp on to its next chunk, or one stolen. Returns false when no
+ * lane has one left. */
+static bool
+lane_next_chunk(t_lane *lp)
+{
+    t_lane *vp = lp;
+    bool ok = true;
+    int k;
+
+    pthread_mutex_lock(lp->sched_mutex);
+    if (lp->dq_head == lp->dq_tail)
+        for (k = 0; k < lp->nlanes; ++k)
+            if (lp->lanes[k].dq_tail - lp->lanes[k].dq_head >
+                vp->dq_tail - vp->dq_head)
+                vp = lp->lanes + k;
+    if (vp->dq_head == vp->dq_tail)
+    {
+        ok = false;
+        lp->cur_end = INT64_MAX;
+        __atomic_store_n(&lp->cur, INT64_MAX, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        int64_t lba = (vp == lp) ? lp->dq[lp->dq_head++]
+                                 : vp->dq[--vp->dq_tail];
+
+        lp->stolen += (vp != lp);
+        lp->cur_end = (lba + lp->chunk < lp->dp->end) ? lba + lp->chunk
+                                                      : lp->dp->end;
+        __atomic_store_n(&lp->cur, lba, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(lp->sched_mutex);
+    return ok;
+}
+
+/* The next READ of lane lp into rqp, its lba and blocks, the lane's
+ * cursor and low water mark moved over it. Returns false when no lane
+ * has a chunk left. */
+static bool
+lane_next_read(t_lane *lp, t_rq *rqp)
+{
+    t_dev *dp = lp->dp;
+    int64_t lba;
+
+    for (;;)
+    {
+        lba = lp->cur;
+        rqp->blocks = dp->bpt;
+        if ((lba < lp->cur_end) && range_next(dp, &lba, &rqp->blocks) &&
+            (lba < lp->cur_end))
+            break;
+        if (!lane_next_chunk(lp))
+            return false;
+    }
+    if (lba + rqp->blocks > lp->cur_end)
+        rqp->blocks = (int)(lp->cur_end - lba);
+    if (lba < lp->low)
+        __atomic_store_n(&lp->low, lba, __ATOMIC_RELAXED);
+    __atomic_store_n(&lp->cur, lba + rqp->blocks, __ATOMIC_RELEASE);
+    rqp->lba = lba;
+    return true;
+}
+
+/* Pins the thread of lane lp to its CPU, when it has one. */
+static void
+lane_pin(t_lane *lp)
+{
+    cpu_set_t cs;
+
+    if (lp->cpu < 0)
+        return;
+    CPU_ZERO(&cs);
+    CPU_SET(lp->cpu, &cs);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cs), &cs) && verbose)
+        pr2serr("%s: could not pin lane %d to cpu %d\n", lp->dp->device_name,
+                lp->idx, lp->cpu);
+}
+
+/* The lowest lba the lanes of lp's pass have not finished with: the
+ * READs in flight, the chunks being read and those not started. The
+ * caller holds sched_mutex. */
+static int64_t
+lanes_low(t_lane *lp)
+{
+    int64_t low = INT64_MAX, cur;
+    t_lane *op;
+    int k;
+
+    for (k = 0; k < lp->nlanes; ++k)
+    {
+        op = lp->lanes + k;
+        /* cur first: a READ is in low before cur moves past it */
+        cur = __atomic_load_n(&op->cur, __ATOMIC_ACQUIRE);
+        if ((cur < op->cur_end) && (cur < low))
+            low = cur;
+        if (__atomic_load_n(&op->low, __ATOMIC_RELAXED) < low)
+            low = op->low;
+        if ((op->dq_head < op->dq_tail) && (op->dq[op->dq_head] < low))
+            low = op->dq[op->dq_head];
+    }
+    return (low < lp->dp->end) ? low : lp->dp->end;
+}
+
+/* --poll: looks for a completion on ur for up to opt.poll_us before the
+ * lane goes to sleep for one, driving the poll queues on an IOPOLL ring.
+ * Returns the completions that came in time. */
+static int
+uring_spin(t_dev *dp, struct uring *ur)
+{
+    uint64_t t0 = lat_now_ns(), now = t0;
+    uint64_t budget = (uint64_t)opt.poll_us * 1000;
+    int res = 0;
+
+    while ((0 == res) && (now - t0 < budget))
+    {
+        res = uring_poll(ur);
+        now = lat_now_ns();
+    }
+    __atomic_fetch_add(&dp->spin_ns, now - t0, __ATOMIC_RELAXED);
+    return (res > 0) ? res : 0;
+}
+
+/* Queues one READ per idle slot on the lane's ring, NVM Read
+ * passthrough commands for NVMe namespaces, until qd (or fewer by
+ * --adaptive-qd) are in flight, the lane runs out of chunks or the
+ * rate caps are reached (*waitp then being the ns to wait), then
+ * submits them. */
+static int
+uring_fill(t_lane *lp, t_rq *rqs, int qd, int *in_flightp, uint64_t *waitp)
+{
+    t_dev *dp = lp->dp;
+    int k, res, queued = 0;
+    t_rq *rqp;
+
+    *waitp = 0;
+    for (k = 0; (k < qd) && (*in_flightp < dev_qd(dp)); ++k)
+    {
+        rqp = rqs + k;
+        if (rqp->busy)
+            continue;
+        /* taken before the cursor moves; the last READ may be smaller */
+        *waitp = throttle_ns(dp, (int64_t)dp->bpt * dp->blk_sz);
+        if (*waitp)
+            break;
+        if (!lane_next_read(lp, rqp))
+            break;
+        PROBE3(submit, dp->device_name, rqp->lba, rqp->blocks);
+        rqp->t_ns = lat_now_ns();
+        if (FT_NVME & dp->out_type)
+        {
+            struct nvme_uring_cmd cmd;
+
+            memset(&cmd, 0, sizeof(cmd));
+            cmd.opcode = 0x02; /* Read */
+            cmd.nsid = dp->nsid;
+            nvme_rd_xfer(dp, rqp->buffp, rqp->blocks, &cmd.addr,
+                         &cmd.data_len, &cmd.metadata, &cmd.metadata_len);
+            cmd.cdw10 = (uint32_t)rqp->lba;
+            cmd.cdw11 = (uint32_t)((uint64_t)rqp->lba >> 32);
+            cmd.cdw12 = rqp->blocks - 1;
+            if (dp->flags.fua)
+                cmd.cdw12 |= 1u << 30; /* FUA */
+            res = uring_prep_cmd(&lp->ring, dp->fd, NVME_URING_CMD_IO, &cmd,
+                                 sizeof(cmd), k);
+        }
+        else
+            res = uring_prep_read(&lp->ring, dp->fd, rqp->buffp,
+                                  rqp->blocks * dp->blk_sz,
+                                  (uint64_t)rqp->lba * dp->blk_sz,
+                                  rqp->buf_idx, k);
+        if (res)
+        {
+            /* cannot happen, the ring has qd entries */
+            pr2serr("%s: io_uring sq full\n", dp->device_name);
+            return -1;
+        }
+        rqp->busy = true;
+        rqp->qd = ++*in_flightp;
+        ++queued;
+    }
+    if (0 == queued)
+        return 0;
+    res = uring_submit_and_wait(&lp->ring, 0);
+    if (res < 0)
+    {
+        pr2serr("%s: io_uring submit: %s\n", dp->device_name,
+                safe_strerror(-res));
+        return -1;
+    }
+    return 0;
+}
+
+/* Runs one lane with dp->qd READs in flight on its own ring: O_DIRECT
+ * reads, or NVM Read passthrough commands. Block device buffers are
+ * registered with the ring (when RLIMIT_MEMLOCK allows) and, as in
+ * read_pass_async(), there is one more buffer than slots so a slot is
+ * re-queued before its data is checked. A READ that fails or comes back
+ * short goes to the side queue, which re-issues it with direct_read().
+ * Under a rate cap slots stay idle as in read_pass_async(). */
+static void *
+uring_lane(void *arg)
+{
+    t_lane *lp = (t_lane *)arg;
+    t_dev *dp = lp->dp;
+    struct io_uring_cqe cqe;
+    int qd = dp->qd;
+    int k, res, ret = 0, in_flight = 0;
+    int64_t lba, low;
+    int blocks, cidx, spare_idx = qd;
+    uint64_t wait, ns;
+    bool queued;
+    int spun = 0; /* completions the last spin found */
+    uint8_t *cbuf, *cfree;
+    uint8_t *spare = NULL, *spare_free = NULL;
+    struct iovec iov[MAX_QUEUE_DEPTH + 1];
+    t_rq *rqp;
+    t_rq *rqs = (t_rq *)calloc(qd, sizeof(t_rq));
+
+    ctr_shard = lp->idx;
+    lane_pin(lp);
+    res = uring_init(&lp->ring, qd, dp->uring_flags);
+    if (res)
+    {
+        pr2serr("%s: io_uring setup: %s\n", dp->device_name,
+                safe_strerror(-res));
+        lp->ring.fd = -1;
+        ret = -1;
+        goto fini;
+    }
+    uring_register_file(&lp->ring, dp->fd);
+    if (opt.background)
+        lp->ring.ioprio = IOPRIO_IDLE; /* SQPOLL submits for another task */
+    if (NULL == rqs)
+    {
+        ret = -1;
+        goto fini;
+    }
+    spare = io_buf(dp, dp->bpt * dp->blk_sz, &spare_free);
+    iov[qd].iov_base = spare;
+    iov[qd].iov_len = dp->bpt * dp->blk_sz;
+    for (k = 0; k < qd; ++k)
+    {
+        rqs[k].buffp = io_buf(dp, dp->bpt * dp->blk_sz,
+                              &rqs[k].free_buffp);
+        rqs[k].buf_idx = k;
+        iov[k].iov_base = rqs[k].buffp;
+        iov[k].iov_len = dp->bpt * dp->blk_sz;
+        if ((NULL == rqs[k].buffp) || (NULL == spare))
+        {
+            pr2serr(">> heap problems\n");
+            ret = -1;
+            goto fini;
+        }
+    }
+    res = (FT_NVME & dp->out_type) ? 0 :
+          uring_register_buffers(&lp->ring, iov, qd + 1);
+    if (res && verbose)
+        pr2serr("%s: io_uring buffer registration failed (%s), using plain "
+                "reads\n", dp->device_name, safe_strerror(-res));
+
+    ret = uring_fill(lp, rqs, qd, &in_flight, &wait);
+    while ((in_flight > 0) || ((0 == ret) && wait))
+    {
+        if (0 == in_flight)
+        {
+            throttle_sleep(wait);
+            ret = uring_fill(lp, rqs, qd, &in_flight, &wait);
+            continue;
+        }
+        res = uring_reap(&lp->ring, &cqe);
+        if (-EAGAIN == res)
+        {
+            if (opt.poll_us && (spun = uring_spin(dp, &lp->ring)))
+                continue;
+            res = uring_submit_and_wait(&lp->ring, 1);
+            if (res < 0)
+            {
+                pr2serr("%s: io_uring wait: %s\n", dp->device_name,
+                        safe_strerror(-res));
+                ret = -1;
+                break;
+            }
+            continue;
+        }
+        rqp = rqs + cqe.user_data;
+        ns = lat_now_ns() - rqp->t_ns;
+        lat_done(dp, rqp->lba, rqp->blocks, ns);
+        io_trace(dp, TRACE_READ, rqp->lba, rqp->blocks, ns, rqp->qd,
+                 (cqe.res == ((FT_NVME & dp->out_type)
+                                  ? 0 : rqp->blocks * dp->blk_sz))
+                     ? 0 : uring_cat(dp, cqe.res));
+        /* the others were posted while the lane was busy or asleep */
+        if (opt.poll_us && dp->run)
+            lat_record((lp->ring.iopoll || spun) ? &dp->run->lat_polled
+                                                 : &dp->run->lat_irq, ns);
+        if (spun)
+            --spun;
+        lba = rqp->lba;
+        blocks = rqp->blocks;
+        cbuf = rqp->buffp;
+        cfree = rqp->free_buffp;
+        cidx = rqp->buf_idx;
+        rqp->buffp = spare;
+        rqp->free_buffp = spare_free;
+        rqp->buf_idx = spare_idx;
+        rqp->busy = false;
+        --in_flight;
+        queued = false;
+        /* passthrough completions carry the NVMe status, reads a length */
+        if (cqe.res != ((FT_NVME & dp->out_type) ? 0 : blocks * dp->blk_sz))
+        {
+            if (verbose)
+                pr2serr("%s: io_uring read at lba=%" PRId64 " returned %d\n",
+                        dp->device_name, lba, cqe.res);
+            PROBE4(error, dp->device_name, lba, blocks,
+                   uring_cat(dp, cqe.res));
+            if ((-ENODEV == cqe.res) || (-ENXIO == cqe.res))
+                dev_gone(dp, "device removed");
+            queued = (0 == iso_push(dp, lp->pat, lba, blocks,
+                                    uring_cat(dp, cqe.res)));
+            res = queued ? 0 : direct_read(dp, cbuf, blocks, lba);
+            if (res && (0 == ret))
+                ret = res;
+        }
+        else if (dp->pi_type)
+            pi_check(dp, cbuf, lba, blocks);
+        if (0 == ret)
+            ret = iso_error(dp);
+        if (0 == ret)
+            ret = uring_fill(lp, rqs, qd, &in_flight, &wait);
+
+        /* device is busy with the next READs while this one is checked */
+        if (!queued)
+            verify_chunk(dp, cbuf, lp->pat, lba, blocks);
+        spare = cbuf;
+        spare_free = cfree;
+        spare_idx = cidx;
+        if (ret)
+            continue; /* drain what is still in flight */
+        if (!queued)
+        {
+            CTR_ADD(dp, in_full, blocks);
+            __atomic_fetch_add(&dp->bytes_done, (int64_t)blocks * dp->blk_sz,
+                               __ATOMIC_RELAXED);
+            actuator_done(dp, lba, (int64_t)blocks * dp->blk_sz);
+            dmap_done(dp, lba, blocks);
+        }
+        if (lba != lp->low)
+            continue; /* an older READ of the lane still holds the mark */
+        pthread_mutex_lock(lp->sched_mutex);
+        __atomic_store_n(&lp->low, low_water(rqs, qd, INT64_MAX),
+                         __ATOMIC_RELAXED);
+        low = lanes_low(lp);
+        pthread_mutex_unlock(lp->sched_mutex);
+        __atomic_store_n(&dp->cur_lba, iso_water(dp, low), __ATOMIC_RELAXED);
+    }
+    uring_unregister_buffers(&lp->ring);
+
+fini:
+    if (rqs)
+        for (k = 0; k < qd; ++k)
+            iobuf_free(rqs[k].free_buffp);
+    free(rqs);
+    iobuf_free(spare_free);
+    if (lp->ring.fd >= 0)
+        uring_exit(&lp->ring);
+    lp->res = ret;
+    if (lp != lp->lanes) /* lane 0 is the worker's own thread */
+        cpu_charge(dp);
+    return NULL;
+}
+
+/* One pass over [dp->start, dp->end) on opt.rings lanes, each run by
+ * lane (uring_lane(), spdk_lane()). The calling thread runs lane 0 and
+ * any further lanes get threads of their own. With more than one lane
+ * each is pinned to one of the CPUs this process may run on. A drive
+ * with actuators has a multiple of them as lanes, those of an actuator
+ * dealt the chunks of its range in order. */
+static int
+read_pass_lanes(t_dev *dp, const t_pattern *pat, void *(*lane)(void *))
+{
+    int nact = (dp->nact > 1) ? dp->nact : 1;
+    int nlanes = (opt.rings + nact - 1) / nact * nact;
+    int k, c, res, ret = 0, stolen = 0;
+    int64_t chunk, nchunks, i, dealt[MAX_ACTUATORS];
+    pthread_mutex_t sched_mutex = PTHREAD_MUTEX_INITIALIZER;
+    cpu_set_t cs;
+    t_lane *lanes = (t_lane *)calloc(nlanes, sizeof(t_lane));
+
+    if (NULL == lanes)
+        return -1;
+    dmap_begin(dp);
+    /* whole READs per chunk, so that only the last can be short */
+    chunk = CHUNK_BYTES / ((int64_t)dp->bpt * dp->blk_sz);
+    chunk = ((chunk > 0) ? chunk : 1) * dp->bpt;
+    nchunks = (dp->end > dp->from) ? (dp->end - dp->from + chunk - 1) / chunk
+                                   : 0;
+    for (k = 0; k < nlanes; ++k)
+    {
+        lanes[k].dq = (int64_t *)malloc((nchunks / (nlanes / nact) + 1) *
+                                        sizeof(int64_t));
+        if (NULL == lanes[k].dq)
+        {
+            pr2serr(">> heap problems\n");
+            nlanes = k;
+            ret = -1;
+            goto fini;
+        }
+    }
+    memset(dealt, 0, sizeof(dealt));
+    for (i = 0; i < nchunks; ++i)
+    {
+        int a = (nact > 1) ? actuator_of(dp, dp->from + i * chunk) : 0;
+        t_lane *lp = lanes + a + nact * (dealt[a]++ % (nlanes / nact));
+
+        lp->dq[lp->dq_tail++] = dp->from + i * chunk;
+    }
+    qd_start(dp);
+    CPU_ZERO(&cs);
+    if ((nlanes > 1) && sched_getaffinity(0, sizeof(cs), &cs))
+        CPU_ZERO(&cs);
+    for (k = 0, c = 0; k < nlanes; ++k)
+    {
+        t_lane *lp = lanes + k;
+
+        lp->dp = dp;
+        lp->idx = k;
+        lp->sched_mutex = &sched_mutex;
+        lp->chunk = chunk;
+        lp->cpu = -1;
+        if (CPU_COUNT(&cs) > 0)
+        {
+            while (!CPU_ISSET(c % CPU_SETSIZE, &cs))
+                ++c;
+            lp->cpu = c % CPU_SETSIZE;
+            if (++c >= CPU_SETSIZE)
+                c = 0;
+        }
+        lp->pat = pat;
+        lp->low = INT64_MAX;
+        lp->lanes = lanes;
+        lp->nlanes = nlanes;
+        lp->ring.fd = -1;
+    }
+    for (k = 1; k < nlanes; ++k)
+        if (pthread_create(&lanes[k].tid, NULL, lane, lanes + k))
+        {
+            perror("pthread_create");
+            nlanes = k; /* the running lanes read the rest */
+            ret = -1;
+            break;
+        }
+    lane(lanes);
+    for (k = 1; k < nlanes; ++k)
+        pthread_join(lanes[k].tid, NULL);
+    for (k = 0; k < nlanes; ++k)
+    {
+        if (lanes[k].res && (0 == ret))
+            ret = lanes[k].res;
+        stolen += lanes[k].stolen;
+    }
+    if (verbose && (nlanes > 1))
+        pr2serr("%s: %d lanes, %d of %" PRId64 " chunks stolen\n",
+                dp->device_name, nlanes, stolen, nchunks);
+    res = iso_finish(dp);
+    if (0 == ret)
+        ret = res;
+fini:
+    for (k = 0; k < opt.rings; ++k)
+        free(lanes[k].dq);
+    free(lanes);
+    return ret;
+}
+
+/* One pass of a block device or NVMe namespace on opt.rings io_uring
+ * lanes. */
+static int
+read_pass_uring(t_dev *dp, const t_pattern *pat)
+{
+    return read_pass_lanes(dp, pat, uring_lane);
+}
+
+/* Queues one NVM Read per idle slot on the lane's queue pair of the
+ * spdk: controller, as uring_fill() does on a ring. */
+static int
+spdk_fill(t_lane *lp, t_rq *rqs, int qd, int *in_flightp, uint64_t *waitp)
+{
+    struct nvme_passthru_cmd64 cmd;
+    t_dev *dp = lp->dp;
+    t_rq *rqp;
+    int k;
+
+    *waitp = 0;
+    for (k = 0; (k < qd) && (*in_flightp < dev_qd(dp)); ++k)
+    {
+        rqp = rqs + k;
+        if (rqp->busy)
+            continue;
+        *waitp = throttle_ns(dp, (int64_t)dp->bpt * dp->blk_sz);
+        if (*waitp)
+            break;
+        if (!lane_next_read(lp, rqp))
+            break;
+        PROBE3(submit, dp->device_name, rqp->lba, rqp->blocks);
+        rqp->t_ns = lat_now_ns();
+        nvme_rd_cmd(dp, &cmd, rqp->buffp, rqp->blocks, rqp->lba);
+        if (spdkdev_qp_submit(lp->qp, &cmd, k))
+        {
+            pr2serr("%s: spdk submit at lba=%" PRId64 ": %s\n",
+                    dp->device_name, rqp->lba, safe_strerror(errno));
+            return -1;
+        }
+        rqp->busy = true;
+        rqp->qd = ++*in_flightp;
+    }
+    return 0;
+}
+
+/* Runs one lane with dp->qd NVM Reads in flight on a queue pair of its
+ * own of the spdk: controller, reaped by polling it from the lane's CPU,
+ * no interrupts and no system calls. Otherwise as uring_lane(): one
+ * more buffer than slots, a READ that fails goes to the side queue. A
+ * controller that fails ends the lane with what it had in flight. */
+static void *
+spdk_lane(void *arg)
+{
+    t_lane *lp = (t_lane *)arg;
+    t_dev *dp = lp->dp;
+    int qd = dp->qd;
+    int k, n, status, res, ret = 0, in_flight = 0;
+    int64_t lba, low;
+    int blocks;
+    uint64_t wait, ns, tag;
+    bool queued;
+    uint8_t *cbuf, *cfree;
+    uint8_t *spare = NULL, *spare_free = NULL;
+    t_rq *rqp;
+    t_rq *rqs = (t_rq *)calloc(qd, sizeof(t_rq));
+
+    ctr_shard = lp->idx;
+    lane_pin(lp);
+    lp->qp = spdkdev_qp_open(dp->spdk, qd);
+    if (NULL == lp->qp)
+    {
+        pr2serr("%s: spdk queue pair: %s\n", dp->device_name,
+                safe_strerror(errno));
+        ret = -1;
+        goto fini;
+    }
+    if (NULL == rqs)
+    {
+        ret = -1;
+        goto fini;
+    }
+    spare = io_buf(dp, dp->bpt * dp->blk_sz, &spare_free);
+    for (k = 0; k < qd; ++k)
+    {
+        rqs[k].buffp = io_buf(dp, dp->bpt * dp->blk_sz,
+                              &rqs[k].free_buffp);
+        if ((NULL == rqs[k].buffp) || (NULL == spare))
+        {
+            pr2serr(">> heap problems\n");
+            ret = -1;
+            goto fini;
+        }
+    }
+
+    ret = spdk_fill(lp, rqs, qd, &in_flight, &wait);
+    while ((in_flight > 0) || ((0 == ret) && wait))
+    {
+        if (0 == in_flight)
+        {
+            throttle_sleep(wait);
+            ret = spdk_fill(lp, rqs, qd, &in_flight, &wait);
+            continue;
+        }
+        n = spdkdev_qp_poll(lp->qp, &tag, &status, 1);
+        if (0 == n)
+            continue;
+        if (n < 0)
+        {
+            dev_gone(dp, "controller failed");
+            ret = -1;
+            break; /* what is in flight does not complete */
+        }
+        rqp = rqs + tag;
+        ns = lat_now_ns() - rqp->t_ns;
+        lat_done(dp, rqp->lba, rqp->blocks, ns);
+        io_trace(dp, TRACE_READ, rqp->lba, rqp->blocks, ns, rqp->qd,
+                 status ? uring_cat(dp, status) : 0);
+        lba = rqp->lba;
+        blocks = rqp->blocks;
+        cbuf = rqp->buffp;
+        cfree = rqp->free_buffp;
+        rqp->buffp = spare;
+        rqp->free_buffp = spare_free;
+        rqp->busy = false;
+        --in_flight;
+        queued = false;
+        if (status)
+        {
+            if (verbose)
+                pr2serr("%s: spdk read at lba=%" PRId64 " status 0x%x\n",
+                        dp->device_name, lba, status);
+            PROBE4(error, dp->device_name, lba, blocks,
+                   uring_cat(dp, status));
+            queued = (0 == iso_push(dp, lp->pat, lba, blocks,
+                                    uring_cat(dp, status)));
+            res = queued ? 0 : direct_read(dp, cbuf, blocks, lba);
+            if (res && (0 == ret))
+                ret = res;
+        }
+        else if (dp->pi_type)
+            pi_check(dp, cbuf, lba, blocks);
+        if (0 == ret)
+            ret = iso_error(dp);
+        if (0 == ret)
+            ret = spdk_fill(lp, rqs, qd, &in_flight, &wait);
+
+        /* the drive is busy with the next READs while this one is checked */
+        if (!queued)
+            verify_chunk(dp, cbuf, lp->pat, lba, blocks);
+        spare = cbuf;
+        spare_free = cfree;
+        if (ret)
+            continue; /* drain what is still in flight */
+        if (!queued)
+        {
+            CTR_ADD(dp, in_full, blocks);
+            __atomic_fetch_add(&dp->bytes_done, (int64_t)blocks * dp->blk_sz,
+                               __ATOMIC_RELAXED);
+            actuator_done(dp, lba, (int64_t)blocks * dp->blk_sz);
+            dmap_done(dp, lba, blocks);
+        }
+        if (lba != lp->low)
+            continue; /* an older READ of the lane still holds the mark */
+        pthread_mutex_lock(lp->sched_mutex);
+        __atomic_store_n(&lp->low, low_water(rqs, qd, INT64_MAX),
+                         __ATOMIC_RELAXED);
+        low = lanes_low(lp);
+        pthread_mutex_unlock(lp->sched_mutex);
+        __atomic_store_n(&dp->cur_lba, iso_water(dp, low), __ATOMIC_RELAXED);
+    }
+
+fini:
+    /* freed first: a failed controller still aborts what it had */
+    spdkdev_qp_close(lp->qp);
+    lp->qp = NULL;
+    if (rqs)
+        for (k = 0; k < qd; ++k)
+            iobuf_free(rqs[k].free_buffp);
+    free(rqs);
+    iobuf_free(spare_free);
+    lp->res = ret;
+    if (lp != lp->lanes) /* lane 0 is the worker's own thread */
+        cpu_charge(dp);
+    return NULL;
+}
+
+/* One pass of an spdk: controller's namespace on opt.rings lanes, each
+ * with a queue pair of its own polled on its own CPU. */
+static int
+read_pass_spdk(t_dev *dp, const t_pattern *pat)
+{
+    return read_pass_lanes(dp, pat, spdk_lane);
+}
+
+/* Issues up to nrq READs in one ioctl(SG_IO) using the sg v4 driver's
+ * multiple request (mrq) control object. The driver writes every
+ * response back into a_v4p[]. Returns the number of requests the
+ * driver reports as processed, or -1 if the ioctl itself failed. */
+static int
+sg_do_mrq(t_dev *dp, struct sg_io_v4 *a_v4p, int nrq)
+{
+    int res;
+    struct sg_io_v4 ctl_v4;
+
+    memset(&ctl_v4, 0, sizeof(ctl_v4));
+    ctl_v4.guard = 'Q';
+    ctl_v4.flags = SGV4_FLAG_MULTIPLE_REQS;
+    ctl_v4.dout_xferp = (uint64_t)(uintptr_t)a_v4p; /* request array */
+    ctl_v4.dout_xfer_len = nrq * sizeof(*a_v4p);
+    ctl_v4.din_xferp = (uint64_t)(uintptr_t)a_v4p;  /* response array */
+    ctl_v4.din_xfer_len = nrq * sizeof(*a_v4p);
+
+    while (((res = ioctl(dp->fd, SG_IO, &ctl_v4)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
+        ;
+    if (res < 0)
+    {
+        if (verbose)
+            perror("ioctl(SG_IO, mrq) on sg device, error");
+        return -1;
+    }
+    return (int)ctl_v4.info;
+}
+
+/* --sat: whether dp is an ATA drive behind a SCSI to ATA translation
+ * layer, one with an ATA Information VPD page, that does 48 bit LBAs
+ * (IDENTIFY DEVICE word 83 bit 10); its VERIFYs then go to the drive
+ * as ATA READ VERIFY SECTORS EXT. */
+static void
+sat_probe(t_dev *dp)
+{
+    uint8_t vpd[572]; /* 60 of header and SATL, 512 of IDENTIFY DEVICE */
+
+    memset(vpd, 0, sizeof(vpd));
+    if (sg_ll_inquiry(dp->fd, false, true, 0x89, vpd, sizeof(vpd), false,
+                      verbose > 1 ? verbose - 1 : 0) ||
+        (0x89 != vpd[1]))
+    {
+        if (verbose)
+            pr2serr("%s: no ATA Information VPD page, not SATA behind a "
+                    "SATL\n", dp->device_name);
+        return;
+    }
+    if (!(vpd[60 + 2 * 83 + 1] & 0x04))
+    {
+        pr2serr("%s: ATA drive without 48 bit LBAs, verifying with "
+                "VERIFY(16)\n", dp->device_name);
+        return;
+    }
+    dp->sat = true;
+    if (verbose)
+        pr2serr("%s: SATA behind a SATL, verifying with ATA READ VERIFY "
+                "SECTORS EXT\n", dp->device_name);
+}
+
+/* ATA READ VERIFY SECTORS EXT of blks (1 to 65536) from lba through ATA
+ * PASS-THROUGH(16), non-data. Returns as sg_ll_verify16() does: 0,
+ * SG_LIB_CAT_MEDIUM_HARD_WITH_INFO with the lba of the first unreadable
+ * sector in *infop when the ATA Status Return descriptor or descriptor
+ * sense gives it, else the sense category or -1. */
+static int
+sat_verify(t_dev *dp, int64_t lba, int blks, uint64_t *infop)
+{
+    unsigned char cdb[16] = {0x85, (3 << 1) | 1 /* non-data, EXTEND */};
+    unsigned char senseBuff[SENSE_BUFF_LEN];
+    struct sg_io_hdr io_hdr;
+    struct sg_sense_dec sd;
+    const uint8_t *d;
+    int res;
+
+    cdb[5] = (blks >> 8) & 0xff; /* 65536 -> 0 */
+    cdb[6] = blks & 0xff;
+    cdb[7] = (lba >> 24) & 0xff;
+    cdb[8] = lba & 0xff;
+    cdb[9] = (lba >> 32) & 0xff;
+    cdb[10] = (lba >> 8) & 0xff;
+    cdb[11] = (lba >> 40) & 0xff;
+    cdb[12] = (lba >> 16) & 0xff;
+    cdb[13] = 0x40; /* LBA */
+    cdb[14] = 0x42; /* READ VERIFY SECTORS EXT */
+    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+    io_hdr.interface_id = 'S';
+    io_hdr.dxfer_direction = SG_DXFER_NONE;
+    io_hdr.cmd_len = sizeof(cdb);
+    io_hdr.cmdp = cdb;
+    io_hdr.mx_sb_len = SENSE_BUFF_LEN;
+    io_hdr.sbp = senseBuff;
+    io_hdr.timeout = DEF_TIMEOUT;
+    if (verbose > 2)
+        sg_print_command_len(cdb, sizeof(cdb));
+    while (((res = ioctl(dp->fd, SG_IO, &io_hdr)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
+        ;
+    if (res < 0)
+        return -1;
+    res = sg_err_category3_dec(&io_hdr, &sd);
+    if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res))
+        return 0;
+    if (verbose > 1)
+        sg_chk_n_print3("ATA PASS-THROUGH(16)", &io_hdr, verbose > 2);
+    /* ERR in the status with UNC in the error register: the lba is the
+     * first sector the drive could not read */
+    d = sg_scsi_sense_desc_find(senseBuff, io_hdr.sb_len_wr, 0x09);
+    if (d && (d[1] >= 0x0c) && (d[13] & 0x01) && (d[3] & 0x40))
+    {
+        *infop = ((uint64_t)d[10] << 40) | ((uint64_t)d[8] << 32) |
+                 ((uint64_t)d[6] << 24) | ((uint64_t)d[11] << 16) |
+                 ((uint64_t)d[9] << 8) | d[7];
+        return SG_LIB_CAT_MEDIUM_HARD_WITH_INFO;
+    }
+    /* the information field of fixed sense holds ATA registers there */
+    if ((SG_LIB_CAT_MEDIUM_HARD == res) && sd.info_valid &&
+        (sd.ssh.response_code >= 0x72))
+    {
+        *infop = sd.info;
+        return SG_LIB_CAT_MEDIUM_HARD_WITH_INFO;
+    }
+    return res;
+}
+
+/* Device side counterpart of sg_read(): VERIFY(16) over blocks from
+ * from_block. With BYTCHK=0 (dout NULL) the drive only reads the media,
+ * with BYTCHK=3 it also compares every block against the one block in
+ * dout. Either way no read data is transferred; BYTCHK=0 of a --sat
+ * drive goes as sat_verify(). Not ready, unit attentions, aborted
+ * commands and retries are handled as in sg_read().
+ * A medium error at a reported lba is counted, and with coe the verify
+ * resumes after that block. A miscompare is returned to the caller. */
+static int
+sg_verify(t_dev *dp, int blocks, int64_t from_block, const uint8_t *dout)
+{
+    struct flags_t *ifp = &dp->flags;
+    int retries_tmp = ifp->retries;
+    int res, blks, ret = 0;
+    int64_t lba = from_block;
+    uint64_t info;
+
+    while (lba < from_block + blocks)
+    {
+        blks = (int)(from_block + blocks - lba);
+        info = 0;
+        if (dp->sat && !dout)
+        {
+            res = sat_verify(dp, lba, blks, &info);
+            if ((SG_LIB_CAT_INVALID_OP == res) ||
+                (SG_LIB_CAT_ILLEGAL_REQ == res))
+            {
+                pr2serr("%s: ATA PASS-THROUGH(16) rejected, verifying with "
+                        "VERIFY(16)\n", dp->device_name);
+                dp->sat = false;
+                continue;
+            }
+        }
+        else
+            res = sg_ll_verify16(dp->fd, 0, !!ifp->dpo, dout ? 3 : 0, lba,
+                                 blks, 0, (void *)dout,
+                                 dout ? dp->blk_sz : 0, &info, false,
+                                 verbose > 1 ? verbose - 1 : 0);
+        switch (res)
+        {
+        case 0:
+            return ret;
+        case SG_LIB_CAT_MISCOMPARE:
+        case SG_LIB_CAT_ILLEGAL_REQ:
+            return res;
+        case SG_LIB_CAT_NOT_READY:
+            pr2serr("Device (v) not ready\n");
+            return res;
+        case SG_LIB_CAT_ABORTED_COMMAND:
+            if (CTR_BUDGET(dp, aborted, dp->aborted_budget))
+            {
+                pr2serr("Aborted command, continuing (v)\n");
+                continue;
+            }
+            pr2serr("Aborted command, too many (v)\n");
+            return res;
+        case SG_LIB_CAT_UNIT_ATTENTION:
+            if (CTR_BUDGET(dp, uas, dp->ua_budget))
+            {
+                pr2serr("Unit attention, continuing (v)\n");
+                continue;
+            }
+            pr2serr("Unit attention, too many (v)\n");
+            return res;
+        case SG_LIB_CAT_MEDIUM_HARD_WITH_INFO:
+            if (retries_tmp > 0)
+            {
+                pr2serr(">>> retrying a verify, lba=0x%" PRIx64 "\n",
+                        (uint64_t)lba);
+                --retries_tmp;
+                CTR_ADD(dp, retries, 1);
+                continue;
+            }
+            if ((info < (uint64_t)lba) || (info >= (uint64_t)(lba + blks)))
+            {
+                pr2serr("  Unrecovered error lba 0x%" PRIx64 " not in "
+                        "correct range:\n\t[0x%" PRIx64 ",0x%" PRIx64 "]\n",
+                        info, (uint64_t)lba, (uint64_t)(lba + blks - 1));
+                CTR_ADD(dp, unrecovered, 1);
+                bad_block(dp, BADMAP_BAD, lba, blks);
+                return SG_LIB_CAT_MEDIUM_HARD;
+            }
+            CTR_ADD(dp, unrecovered, 1);
+            bad_block(dp, BADMAP_BAD, (int64_t)info, 1);
+            pr2serr(">> unrecovered medium error at lba=%" PRIu64 " [0x%"
+                    PRIx64 "]\n", info, info);
+            ret = SG_LIB_CAT_MEDIUM_HARD;
+            if (0 == ifp->coe)
+                return ret;
+            lba = (int64_t)info + 1;
+            retries_tmp = ifp->retries;
+            break;
+        case SG_LIB_CAT_INVALID_OP:
+            pr2serr("VERIFY(16) not supported on %s\n", dp->device_name);
+            return res;
+        default:
+            if (retries_tmp > 0)
+            {
+                pr2serr(">>> retrying a verify, lba=0x%" PRIx64 "\n",
+                        (uint64_t)lba);
+                --retries_tmp;
+                CTR_ADD(dp, retries, 1);
+                continue;
+            }
+            if (SG_LIB_CAT_MEDIUM_HARD == res)
+            {
+                CTR_ADD(dp, unrecovered, 1);
+                bad_block(dp, BADMAP_BAD, lba, blks);
+            }
+            return res;
+        }
+    }
+    return ret;
+}
+
+/* After a device-side miscompare: reads the range back on the host and
+ * checks it, so the first differing lba and offset get reported. */
+static void
+verify_miscompare(t_dev *dp, const t_pattern *pat, int blocks, int64_t lba)
+{
+    uint8_t *free_buf;
+    uint8_t *buf = io_buf(dp, dp->bpt * dp->blk_sz, &free_buf);
+    int64_t end = lba + blocks;
+    int n, got;
+    bool diop = false;
+
+    if (NULL == buf)
+        return;
+    for (; lba < end; lba += n)
+    {
+        n = ((end - lba) < dp->bpt) ? (int)(end - lba) : dp->bpt;
+        got = 0;
+        if (sg_read(dp, buf, n, lba, &diop, &got))
+            break;
+        if (!verify_chunk(dp, buf, pat, lba, n))
+            break;
+    }
+    iobuf_free(free_buf);
+}
+
+/* One pass over [dp->start, dp->end) done by the drive, VERIFY_BLOCKS
+ * at a time. pat NULL is --device-verify: the media is read and
+ * nothing is compared. Otherwise --device-compare: one block of the
+ * pattern goes out per command and the drive compares every block to
+ * it. Returns VERIFY_FALLBACK when the drive rejects BYTCHK=3, the pass
+ * then has to be checked on the host. */
+static int
+read_pass_verify(t_dev *dp, const t_pattern *pat)
+{
+    int64_t lba;
+    int k, blocks, res, ret = 0;
+    uint64_t t_ns;
+    const uint8_t *dout = NULL;
+    uint8_t *buf, *free_dout = NULL;
+
+    if (pat && (0 == pat->flag))
+        dout = pattern_ref(dp, pat, dp->from, 1); /* the shared word run */
+    if (pat && (NULL == dout))
+    {
+        buf = io_buf(dp, dp->blk_sz, &free_dout);
+        if (NULL == buf)
+            return -1;
+        for (k = 0; k < dp->blk_sz; k += PATTERN_WORD_SZ)
+            memcpy(buf + k, pat->word, (dp->blk_sz - k < PATTERN_WORD_SZ) ?
+                                       dp->blk_sz - k : PATTERN_WORD_SZ);
+        dout = buf;
+    }
+    for (lba = dp->from; lba < dp->end; lba += blocks)
+    {
+        blocks = VERIFY_BLOCKS;
+        if (!range_next(dp, &lba, &blocks))
+            break;
+        t_ns = lat_now_ns();
+        res = sg_verify(dp, blocks, lba, dout);
+        t_ns = lat_now_ns() - t_ns;
+        lat_done(dp, lba, blocks, t_ns);
+        io_trace(dp, TRACE_VERIFY, lba, blocks, t_ns, 1, res);
+        if (dout && (lba == dp->from) &&
+            ((SG_LIB_CAT_INVALID_OP == res) || (SG_LIB_CAT_ILLEGAL_REQ == res)))
+        {
+            pr2serr("%s: drive rejects VERIFY(16) BYTCHK=3, comparing on "
+                    "the host\n", dp->device_name);
+            dp->no_dcompare = true;
+            ret = VERIFY_FALLBACK;
+            break;
+        }
+        if (SG_LIB_CAT_MISCOMPARE == res)
+            verify_miscompare(dp, pat, blocks, lba);
+        else if (res)
+        {
+            pr2serr("sg_verify failed, at or after lba=%" PRId64 " [0x%"
+                    PRIx64 "]\n", lba, lba);
+            if (0 == ret)
+                ret = res;
+            if ((SG_LIB_CAT_MEDIUM_HARD != res) || (0 == dp->flags.coe))
+                break;
+        }
+        CTR_ADD(dp, in_full, blocks);
+        __atomic_fetch_add(&dp->bytes_done, (int64_t)blocks * dp->blk_sz,
+                           __ATOMIC_RELAXED);
+        __atomic_store_n(&dp->cur_lba, lba + blocks, __ATOMIC_RELAXED);
+    }
+    iobuf_free(free_dout);
+    return ret;
+}
+
+/* One pass over [dp->start, dp->end) submitting dp->mrq READs per
+ * syscall through the sg v4 mrq interface. Requests that fail, or that
+ * the driver did not get to, go through sg_read() on the side queue
+ * like those of the other engines. If the driver rejects mrq outright, the remainder of the
+ * device is read through the v3 interface. */
+static int
+read_pass_mrq(t_dev *dp, const t_pattern *pat)
+{
+    int nrq = dp->mrq;
+    int k, n, num_done, res, cat, ret = 0;
+    int64_t next = dp->from;
+    uint64_t t_ns, wait;
+    struct sg_io_v4 *a_v4p;
+    t_rq *rqs;
+
+    a_v4p = (struct sg_io_v4 *)calloc(nrq, sizeof(struct sg_io_v4));
+    rqs = (t_rq *)calloc(nrq, sizeof(t_rq));
+    if ((NULL == a_v4p) || (NULL == rqs))
+    {
+        ret = -1;
+        goto fini;
+    }
+    for (k = 0; k < nrq; ++k)
+    {
+        rqs[k].buffp = io_buf(dp, dp->bpt * dp->blk_sz,
+                              &rqs[k].free_buffp);
+        if (NULL == rqs[k].buffp)
+        {
+            pr2serr(">> heap problems\n");
+            ret = -1;
+            goto fini;
+        }
+    }
+
+    dmap_begin(dp);
+    while ((next < dp->end) && (0 == ret))
+    {
+        for (n = 0; (n < nrq) && (next < dp->end); ++n)
+        {
+            t_rq *rqp = rqs + n;
+            struct sg_io_v4 *h4p = a_v4p + n;
+
+            rqp->lba = next;
+            rqp->blocks = dp->bpt;
+            if (!range_next(dp, &rqp->lba, &rqp->blocks))
+            {
+                next = dp->end;
+                break;
+            }
+            /* over the rate caps: submit the batch so far, or wait */
+            while ((wait = throttle_ns(dp, (int64_t)rqp->blocks *
+                                           dp->blk_sz)) && (0 == n))
+                throttle_sleep(wait);
+            if (wait)
+                break;
+            next = rqp->lba + rqp->blocks;
+            rd_cdb_put(dp, rqp->cmd, rqp->blocks, rqp->lba);
+            *h4p = dp->rd_h4;
+            h4p->request = (uint64_t)(uintptr_t)rqp->cmd;
+            h4p->response = (uint64_t)(uintptr_t)rqp->sb;
+            h4p->din_xfer_len = xfer_len(dp, rqp->blocks);
+            h4p->din_xferp = (uint64_t)(uintptr_t)rqp->buffp;
+            h4p->usr_ptr = (uint64_t)(uintptr_t)rqp;
+            h4p->request_extra = (uint32_t)rqp->lba; /* pack_id */
+            PROBE3(submit, dp->device_name, rqp->lba, rqp->blocks);
+        }
+        if (0 == n)
+            break;
+
+        t_ns = lat_now_ns();
+        num_done = dp->mrq ? sg_do_mrq(dp, a_v4p, n) : -1;
+        if ((num_done < 0) && dp->mrq && (SGV4_FLAG_HIPRI & dp->rd_h4.flags))
+        {
+            /* older drivers take no polled requests, try them without */
+            pr2serr("%s: sg driver refused HIPRI, interrupt completions\n",
+                    dp->device_name);
+            dp->rd_h4.flags &= ~SGV4_FLAG_HIPRI;
+            for (k = 0; k < n; ++k)
+                a_v4p[k].flags &= ~SGV4_FLAG_HIPRI;
+            t_ns = lat_now_ns();
+            num_done = sg_do_mrq(dp, a_v4p, n);
+        }
+        if ((num_done < 0) && dp->mrq)
+        {
+            pr2serr("%s: mrq refused by sg driver, using v3 interface\n",
+                    dp->device_name);
+            dp->mrq = 0;
+        }
+        for (k = 0; k < n; ++k)
+        {
+            t_rq *rqp = rqs + k;
+            struct sg_io_v4 *h4p = a_v4p + k;
+
+            /* the driver times each request of the batch, in ms */
+            if (k < num_done)
+            {
+                uint64_t ns = h4p->duration
+                                  ? (uint64_t)h4p->duration * 1000000ULL
+                                  : lat_now_ns() - t_ns;
+
+                lat_done(dp, rqp->lba, rqp->blocks, ns);
+                if (opt.poll_us && dp->run)
+                    lat_record((SGV4_FLAG_HIPRI & h4p->flags)
+                                   ? &dp->run->lat_polled
+                                   : &dp->run->lat_irq, ns);
+                rqp->t_ns = ns; /* now the latency */
+            }
+            if ((k < num_done) && (SGV4_FLAG_DIRECT_IO & h4p->flags))
+                dio_count(dp, h4p->info);
+            if (k < num_done)
+                cat = sg_err_category_new(h4p->device_status,
+                                          h4p->transport_status,
+                                          h4p->driver_status, rqp->sb,
+                                          h4p->response_len);
+            else
+                cat = SG_LIB_CAT_OTHER; /* not processed by the driver */
+            if ((k < num_done) && (SG_LIB_CAT_CLEAN != cat) &&
+                (SG_LIB_CAT_CONDITION_MET != cat))
+                PROBE4(error, dp->device_name, rqp->lba, rqp->blocks, cat);
+            if (k < num_done)
+                io_trace(dp, TRACE_READ, rqp->lba, rqp->blocks, rqp->t_ns, n,
+                         cat);
+            if (verbose > 2)
+                pr2serr("      duration=%u ms\n", h4p->duration);
+            if (dp->pi_type && ((SG_LIB_CAT_CLEAN == cat) ||
+                                (SG_LIB_CAT_CONDITION_MET == cat) ||
+                                (SG_LIB_CAT_RECOVERED == cat)))
+                pi_check(dp, rqp->buffp, rqp->lba, rqp->blocks);
+            if (SG_LIB_CAT_RECOVERED == cat)
+            {
+                rec_error(dp, rqp->lba);
+                pr2serr("Recovered error reading from block=0x%" PRIx64
+                        ", num=%d\n", (uint64_t)rqp->lba, rqp->blocks);
+            }
+            else if ((SG_LIB_CAT_CLEAN != cat) &&
+                     (SG_LIB_CAT_CONDITION_MET != cat))
+            {
+                bool diop = false;
+                int blks_readp = 0;
+
+                if (k < num_done)
+                    cdl_expired(dp, rqp->sb, h4p->response_len);
+                if (0 == iso_push(dp, pat, rqp->lba, rqp->blocks, cat))
+                    continue;
+                res = sg_read(dp, rqp->buffp, rqp->blocks, rqp->lba, &diop,
+                              &blks_readp);
+                if (res)
+                {
+                    pr2serr("sg_read failed, at or after lba=%" PRId64 " [0x%" PRIx64 "]\n", rqp->lba, rqp->lba);
+                    ret = res;
+                    break;
+                }
+            }
+            verify_chunk(dp, rqp->buffp, pat, rqp->lba, rqp->blocks);
+            CTR_ADD(dp, in_full, rqp->blocks);
+            __atomic_fetch_add(&dp->bytes_done,
+                               (int64_t)rqp->blocks * dp->blk_sz,
+                               __ATOMIC_RELAXED);
+            dmap_done(dp, rqp->lba, rqp->blocks);
+            /* a batch is checked in lba order */
+            __atomic_store_n(&dp->cur_lba,
+                             iso_water(dp, rqp->lba + rqp->blocks),
+                             __ATOMIC_RELAXED);
+        }
+        if (0 == ret)
+            ret = iso_error(dp);
+    }
+
+fini:
+    res = iso_finish(dp);
+    if (0 == ret)
+        ret = res;
+    if (rqs)
+        for (k = 0; k < nrq; ++k)
+            iobuf_free(rqs[k].free_buffp);
+    free(rqs);
+    free(a_v4p);
+    return ret;
+}
+
+/* Reads block 0 once on the IOPOLL ring ur: setting a ring up for
+ * polling succeeds whether or not the queue has poll queues, its reads
+ * then fail with EOPNOTSUPP. Returns true when they do. */
+static bool
+uring_iopoll_refused(t_dev *dp, struct uring *ur)
+{
+    struct io_uring_cqe cqe;
+    uint8_t *free_buf;
+    uint8_t *buf = io_buf(dp, dp->blk_sz, &free_buf);
+    int res;
+
+    if (NULL == buf)
+        return false;
+    res = uring_prep_read(ur, dp->fd, buf, dp->blk_sz, 0, -1, 0);
+    if (0 == res)
+        res = uring_submit_and_wait(ur, 1);
+    while ((res >= 0) && (-EAGAIN == uring_reap(ur, &cqe)))
+        res = uring_submit_and_wait(ur, 1);
+    iobuf_free(free_buf);
+    return (res >= 0) && (-EOPNOTSUPP == cqe.res);
+}
+
+/* Settles the setup flags of the device's rings: flags plus the
+ * --sqpoll/--iopoll ones, dropping those the kernel refuses. Without
+ * io_uring at all the device is read one command at a time. */
+static void
+uring_probe(t_dev *dp, unsigned int flags)
+{
+    struct uring ur;
+    int res;
+
+    dp->uring = 1;
+    dp->uring_flags = flags | opt.uring_setup;
+    res = uring_init(&ur, dp->qd, dp->uring_flags);
+    if (res && opt.uring_setup)
+    {
+        pr2serr("%s: io_uring %s%srefused (%s), not using them\n",
+                dp->device_name,
+                (IORING_SETUP_SQPOLL & opt.uring_setup) ? "SQPOLL " : "",
+                (IORING_SETUP_IOPOLL & opt.uring_setup) ? "IOPOLL " : "",
+                safe_strerror(-res));
+        dp->uring_flags = flags;
+        res = uring_init(&ur, dp->qd, dp->uring_flags);
+    }
+    if (res)
+    {
+        if (verbose)
+            pr2serr("%s: io_uring not available (%s), one command at a "
+                    "time\n", dp->device_name, safe_strerror(-res));
+        dp->uring = 0;
+        return;
+    }
+    if ((IORING_SETUP_IOPOLL & dp->uring_flags) && (FT_BLOCK & dp->out_type) &&
+        uring_iopoll_refused(dp, &ur))
+    {
+        pr2serr("%s: no poll queues, io_uring IOPOLL reads fail, %s\n",
+                dp->device_name, opt.poll_us ? "spinning on interrupt "
+                "completions" : "not using it");
+        dp->uring_flags &= ~IORING_SETUP_IOPOLL;
+    }
+    uring_exit(&ur);
+}
+
+/* Largest transfer the device takes in one command, in bytes, and the
+ * optimal one when reported, 0 when unknown. For sg devices both come
+ * from the Block Limits VPD page, for block devices from the queue. */
+static void
+tune_limits(t_dev *dp, int *max_bytesp, int *opt_bytesp)
+{
+    uint8_t vpd[64];
+    uint32_t v;
+
+    *max_bytesp = 0;
+    *opt_bytesp = 0;
+    if (FT_SG & dp->out_type)
+    {
+        memset(vpd, 0, sizeof(vpd));
+        if ((0 == sg_ll_inquiry(dp->fd, false, true, 0xb0, vpd, sizeof(vpd),
+                                false, verbose > 1 ? verbose - 1 : 0)) &&
+            (0xb0 == vpd[1]) && (sg_get_unaligned_be16(vpd + 2) >= 0xc))
+        {
+            v = sg_get_unaligned_be32(vpd + 8); /* MAXIMUM TRANSFER LENGTH */
+            if ((v > 0) && (v < (uint32_t)(INT_MAX / dp->blk_sz)))
+                *max_bytesp = v * dp->blk_sz;
+            v = sg_get_unaligned_be32(vpd + 12); /* OPTIMAL TRANSFER LENGTH */
+            if ((v > 0) && (v < (uint32_t)(INT_MAX / dp->blk_sz)))
+                *opt_bytesp = v * dp->blk_sz;
+        }
+    }
+    else if (FT_BLOCK & dp->out_type)
+    {
+        unsigned short max_sect = 0;
+        unsigned int io_opt = 0;
+
+        if ((0 == ioctl(dp->fd, BLKSECTGET, &max_sect)) && max_sect)
+            *max_bytesp = max_sect * 512;
+        if (0 == ioctl(dp->fd, BLKIOOPT, &io_opt))
+            *opt_bytesp = io_opt;
+    }
+}
+
+static double
+mono_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Startup calibration for --tune: reads a TUNE_WINDOW_BYTES window per
+ * combination of transfer size (64 KiB doubling up to the device limit)
+ * and queue depth (1 doubling up to MAX_QUEUE_DEPTH) and keeps the
+ * fastest. Each combination reads its own window so a drive cache
+ * does not flatter the later ones. Combinations are tried smallest
+ * first and a later one has to be more than 3% faster to replace the
+ * best. The counters are restored after, so the scan starts from zero. */
+static double
+tune_device(t_dev *dp)
+{
+    int64_t save_start = dp->start, save_end = dp->end;
+    int64_t save_in_full[CTR_SHARDS], save_bytes = dp->bytes_done;
+    int64_t save_ticks = dp->stats.wiping_ticks;
+    int64_t span = dp->end - dp->start, window, lba;
+    int max_bytes, opt_bytes, bytes, qd, res, n = 0;
+    int best_bpt = dp->bpt, best_qd = dp->qd, k;
+    double best = 0.0, mbps, t0;
+    bool pf = dp->prefetch, best_pf = false;
+    int (*lanes)(t_dev *, const t_pattern *) =
+        dp->spdk ? read_pass_spdk
+                 : (((FT_BLOCK | FT_NVME) & dp->out_type) &&
+                    !(FT_SG & dp->out_type) && dp->uring) ? read_pass_uring
+                                                          : NULL;
+    bool async = (FT_SG & dp->out_type) && !(FT_BLOCK & dp->out_type) &&
+                 !dp->mmap_buf && !dp->mrq;
+
+    if (!lanes && !async)
+    {
+        pr2serr("%s: --tune needs queued reads (sg, io_uring or spdk), using "
+                "-n %d --qd %d\n", dp->device_name, dp->bpt, dp->qd);
+        return 0.0;
+    }
+    tune_limits(dp, &max_bytes, &opt_bytes);
+    if ((0 == max_bytes) || (max_bytes > TUNE_MAX_BYTES))
+        max_bytes = TUNE_MAX_BYTES;
+    if (FT_NVME & dp->out_type)
+        max_bytes = 1024 * 1024; /* MDTS is not known, stay modest */
+    if (verbose)
+        pr2serr("%s: tuning, max transfer %d, optimal %d bytes\n",
+                dp->device_name, max_bytes, opt_bytes);
+    window = TUNE_WINDOW_BYTES / dp->blk_sz;
+    if (window > span)
+        window = span;
+    if (window <= 0)
+        return 0.0;
+    for (k = 0; k < CTR_SHARDS; ++k)
+        save_in_full[k] = dp->ctr[k].in_full;
+    dp->tuning = true;
+    dp->prefetch = false;
+
+    for (bytes = TUNE_MIN_BYTES; bytes <= max_bytes; bytes *= 2)
+    {
+        if (bytes < dp->blk_sz)
+            continue;
+        for (qd = 1; qd <= MAX_QUEUE_DEPTH; qd *= 2)
+        {
+            lba = (span >= (n + 1) * window) ? n * window : 0;
+            ++n;
+            dp->start = dp->from = save_start + lba;
+            dp->end = dp->start + window;
+            dp->bpt = bytes / dp->blk_sz;
+            dp->qd = qd;
+            t0 = mono_secs();
+            res = lanes ? lanes(dp, NULL) : read_pass_async(dp, NULL);
+            mbps = window * dp->blk_sz / (mono_secs() - t0) / 1e6;
+            if (verbose > 1)
+                pr2serr("    -n %d --qd %d: %.1f MB/s%s\n", dp->bpt, qd,
+                        mbps, res ? " (errors)" : "");
+            if (res)
+                continue;
+            if (mbps > best * 1.03)
+            {
+                best = mbps;
+                best_bpt = dp->bpt;
+                best_qd = qd;
+            }
+        }
+    }
+    /* --prefetch at the best transfer size, against the deeper queues */
+    for (qd = 1; async && pf && (qd <= best_qd); qd *= 2)
+    {
+        lba = (span >= (n + 1) * window) ? n * window : 0;
+        ++n;
+        dp->start = dp->from = save_start + lba;
+        dp->end = dp->start + window;
+        dp->bpt = best_bpt;
+        dp->qd = qd;
+        dp->prefetch = true;
+        t0 = mono_secs();
+        res = read_pass_async(dp, NULL);
+        mbps = window * dp->blk_sz / (mono_secs() - t0) / 1e6;
+        if (verbose > 1)
+            pr2serr("    -n %d --qd %d --prefetch: %.1f MB/s%s\n", dp->bpt,
+                    qd, mbps, res ? " (errors)" : "");
+        if (!dp->prefetch)
+            break; /* refused */
+        if (!res && (mbps > best * 1.03))
+        {
+            best = mbps;
+            best_qd = qd;
+            best_pf = true;
+        }
+    }
+    dp->prefetch = best_pf;
+    dp->tuning = false;
+    dp->start = save_start;
+    dp->end = save_end;
+    for (k = 0; k < CTR_SHARDS; ++k)
+        dp->ctr[k].in_full = save_in_full[k];
+    dp->bytes_done = save_bytes;
+    dp->stats.wiping_ticks = save_ticks;
+    dp->bpt = best_bpt;
+    dp->qd = best_qd;
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: tuned to -n %d --qd %d%s, %.1f MB/s\n", dp->device_name,
+           dp->bpt, dp->qd, dp->prefetch ? " --prefetch" : "", best);
+    pthread_mutex_unlock(&out_mutex);
+    return best;
+}
+
+/* Drops the extent list, so the whole [start, end) is read again. */
+static void
+extent_drop(t_dev *dp)
+{
+    free(dp->ext);
+    dp->ext = NULL;
+    dp->num_ext = 0;
+    dp->ext_cap = 0;
+}
+
+/* Appends [lba, lba + len) to the extent list, which is built in lba
+ * order, merging it into the last extent when they touch. Returns 0,
+ * else -1 with the list dropped. */
+static int
+extent_add(t_dev *dp, int64_t lba, int64_t len)
+{
+    t_extent *ep = dp->num_ext ? dp->ext + dp->num_ext - 1 : NULL;
+
+    if (ep && (ep->lba + ep->len >= lba))
+    {
+        if (lba + len > ep->lba + ep->len)
+            ep->len = lba + len - ep->lba;
+        return 0;
+    }
+    if (dp->num_ext == dp->ext_cap)
+    {
+        int cap = dp->ext_cap ? 2 * dp->ext_cap : 64;
+
+        ep = (t_extent *)realloc(dp->ext, cap * sizeof(t_extent));
+        if (NULL == ep)
+        {
+            pr2serr(">> heap problems, reading every lba\n");
+            extent_drop(dp);
+            return -1;
+        }
+        dp->ext = ep;
+        dp->ext_cap = cap;
+    }
+    dp->ext[dp->num_ext].lba = lba;
+    dp->ext[dp->num_ext++].len = len;
+    return 0;
+}
+
+/* --write: fills the blocks at lba of buf with what pat reads back
+ * there. */
+static void
+pattern_fill(const t_dev *dp, const t_pattern *pat, uint8_t *buf,
+             int64_t lba, int blocks)
+{
+    size_t len = (size_t)blocks * dp->blk_sz;
+    size_t off, phase, n;
+
+    if (RANDOMDATAFLAG == pat->flag)
+        rand_pattern_fill(buf, dp->blk_sz, blocks, pat->key, lba);
+    else if (STAMPDATAFLAG == pat->flag)
+        stamp_pattern_fill(buf, dp->blk_sz, blocks, pat->key, pat->run,
+                           pat->pass, lba);
+    else if (FILEDATAFLAG == pat->flag)
+        for (off = 0, phase = pattern_phase(dp, pat, lba); off < len;
+             off += n, phase = 0)
+        {
+            n = pat->span - phase;
+            if (n > len - off)
+                n = len - off;
+            memcpy(buf + off, pat->data + phase, n);
+        }
+    else
+        for (off = 0; off < len; off += PATTERN_WORD_SZ)
+            memcpy(buf + off, pat->word,
+                   (len - off < PATTERN_WORD_SZ) ? len - off
+                                                 : PATTERN_WORD_SZ);
+}
+
+/* Whether pat is all zero bytes, which BLKZEROOUT can write. */
+static bool
+pattern_zero(const t_pattern *pat)
+{
+    int k;
+
+    if (pat->flag)
+        return false; /* per block */
+    for (k = 0; k < pat->len; ++k)
+        if (pat->word[k])
+            return false;
+    return true;
+}
+
+/* The lowest lba of the WRITEs (write) or READs of pass (t_rq.pass) in
+ * flight in rqs, else next. */
+static int64_t
+write_water(const t_rq *rqs, int qd, bool write, int pass, int64_t next)
+{
+    int k;
+
+    for (k = 0; k < qd; ++k)
+        if (rqs[k].busy && (rqs[k].write == write) &&
+            (rqs[k].pass == pass) && (rqs[k].lba < next))
+            next = rqs[k].lba;
+    return next;
+}
+
+/* --pipeline: how far pass st of write_pass_async() may write, the
+ * lowest lba pass st - 1 has not written and read back yet (written,
+ * without READs) less the distance kept, the end once it is done. */
+static int64_t
+pipe_top(const t_dev *dp, const t_rq *rqs, int qd, int st, int64_t lag,
+         const int64_t *w_next, const int64_t *r_next)
+{
+    int64_t done;
+
+    if (0 == st)
+        return dp->end;
+    done = (lag >= 0) ? write_water(rqs, qd, false, st - 1, r_next[st - 1])
+                      : write_water(rqs, qd, true, st - 1, w_next[st - 1]);
+    if (done >= dp->end)
+        return dp->end;
+    return done - opt.pipe_dist / dp->blk_sz;
+}
+
+/* An NVM Write (0x01) of buff, or a Write Zeroes (0x08) without data,
+ * to an NVMe namespace, with FUA under --flush=fua. Returns 0, -1 with
+ * the blocks put in the bad map, or when quiet the NVMe status. */
+static int
+nvme_write(t_dev *dp, uint8_t opcode, const uint8_t *buff, int blocks,
+           int64_t lba, bool quiet)
+{
+    struct nvme_passthru_cmd64 cmd;
+    int res;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = opcode;
+    cmd.nsid = dp->nsid;
+    if (buff)
+    {
+        cmd.addr = (uint64_t)(uintptr_t)buff;
+        cmd.data_len = (uint32_t)blocks * dp->blk_sz;
+    }
+    cmd.cdw10 = (uint32_t)lba;
+    cmd.cdw11 = (uint32_t)((uint64_t)lba >> 32);
+    cmd.cdw12 = blocks - 1; /* NLB is 0's based */
+    if (FLUSH_FUA == opt.flush)
+        cmd.cdw12 |= 1u << 30; /* FUA */
+    res = nvme_io(dp, &cmd);
+    if ((0 == res) || (quiet && (res > 0)))
+        return res;
+    pr2serr("%s: NVMe %s failed at lba=%" PRId64 " [0x%" PRIx64 "]: ",
+            dp->device_name, (0x08 == opcode) ? "Write Zeroes" : "Write",
+            lba, lba);
+    if (res < 0)
+        pr2serr("%s\n", safe_strerror(errno));
+    else
+        pr2serr("sct=0x%x sc=0x%x\n", (res >> 8) & 0x7, res & 0xff);
+    CTR_ADD(dp, unrecovered, 1);
+    bad_block(dp, BADMAP_BAD, lba, blocks);
+    return -1;
+}
+
+/* One WRITE of pat at lba with pwrite(2), an NVM Write on an NVMe
+ * namespace. Returns 0, -1 with the blocks put in the bad map. */
+static int
+blk_pwrite(t_dev *dp, const uint8_t *buff, int blocks, int64_t lba)
+{
+    size_t len = (size_t)blocks * dp->blk_sz;
+    size_t put = 0;
+    ssize_t res;
+
+    if (FT_NVME & dp->out_type)
+        return nvme_write(dp, 0x01, buff, blocks, lba, false);
+    while (put < len)
+    {
+        struct iovec iov = {(void *)(buff + put), len - put};
+
+        /* RWF_DSYNC is a FUA WRITE where the queue has one */
+        res = pwritev2(dp->fd, &iov, 1, (off_t)lba * dp->blk_sz + (off_t)put,
+                       (FLUSH_FUA == opt.flush) ? RWF_DSYNC : 0);
+        if ((res < 0) && (EINTR == errno))
+            continue;
+        if (res <= 0)
+        {
+            pr2serr("%s: write failed at or after lba=%" PRId64 " [0x%" PRIx64
+                    "]: %s\n", dp->device_name, lba, lba,
+                    (res < 0) ? safe_strerror(errno) : "unexpected end");
+            CTR_ADD(dp, unrecovered, 1);
+            bad_block(dp, BADMAP_BAD, lba, blocks);
+            return -1;
+        }
+        put += res;
+    }
+    return 0;
+}
+
+/* --write: makes what was written so far durable, SYNCHRONIZE CACHE on
+ * sg devices, Flush on NVMe namespaces, fdatasync(2) on block devices,
+ * timed apart from the WRITEs. Returns 0, -1 when it failed. */
+static int
+write_flush(t_dev *dp)
+{
+    uint64_t t_ns = lat_now_ns();
+    int res;
+
+    if ((FT_SG & dp->out_type) && !(FT_BLOCK & dp->out_type))
+        res = sg_ll_sync_cache_10(dp->fd, false, false, 0, 0, 0, true,
+                                  verbose > 1 ? verbose - 1 : 0);
+    else if (FT_NVME & dp->out_type)
+    {
+        struct nvme_passthru_cmd64 cmd;
+
+        memset(&cmd, 0, sizeof(cmd)); /* Flush, opcode 0x00 */
+        cmd.nsid = dp->nsid;
+        res = nvme_io(dp, &cmd) ? -1 : 0;
+    }
+    else
+        res = (fdatasync(dp->fd) < 0) ? -1 : 0;
+    t_ns = lat_now_ns() - t_ns;
+    ++dp->flushes;
+    dp->flush_ns += t_ns;
+    if (t_ns > dp->flush_max_ns)
+        dp->flush_max_ns = t_ns;
+    if (res)
+        pr2serr("%s: cache flush failed, the WRITEs may still be in the "
+                "drive cache\n", dp->device_name);
+    return res ? -1 : 0;
+}
+
+/* The blocks of a failed NVMe Verify or Write Zeroes done by the host,
+ * dp->bpt at a time: read with direct_read(), which isolates the bad
+ * blocks as for any READ, or written with NVM Writes of zeros. Returns
+ * 0, else the error that stops the pass. */
+static int
+nvme_range_host(t_dev *dp, uint8_t opcode, int64_t lba, int blocks)
+{
+    uint8_t *free_buf;
+    uint8_t *buf = io_buf(dp, dp->bpt * dp->blk_sz, &free_buf);
+    int64_t end = lba + blocks;
+    int n, res, ret = 0;
+
+    if (NULL == buf)
+        return -1;
+    if (NVME_OP_WZ == opcode)
+        memset(buf, 0, (size_t)dp->bpt * dp->blk_sz);
+    for (; lba < end; lba += n)
+    {
+        n = ((end - lba) < dp->bpt) ? (int)(end - lba) : dp->bpt;
+        res = (NVME_OP_WZ == opcode)
+                  ? nvme_write(dp, 0x01, buf, n, lba, false)
+                  : direct_read(dp, buf, n, lba);
+        if (res && (0 == ret))
+            ret = res;
+        if (res && !dp->flags.coe)
+            break;
+    }
+    iobuf_free(free_buf);
+    return dp->flags.coe ? 0 : ret;
+}
+
+/* cdw10 to cdw12 of an NVMe Verify or Write Zeroes of blocks at lba;
+ * a Write Zeroes deallocates as well when the namespace takes it and
+ * then reads the blocks as zeros (DLFEAT). */
+static void
+nvme_range_cdw(const t_dev *dp, uint8_t opcode, int64_t lba, int blocks,
+               uint32_t *cdw)
+{
+    cdw[0] = (uint32_t)lba;
+    cdw[1] = (uint32_t)((uint64_t)lba >> 32);
+    cdw[2] = blocks - 1; /* NLB is 0's based */
+    if ((NVME_OP_WZ == opcode) && (0x8 & dp->nvme_dlfeat) &&
+        (1 == (0x7 & dp->nvme_dlfeat)))
+        cdw[2] |= 1u << 25; /* DEAC */
+}
+
+/* One pass over [dp->from, dp->end) done by an NVMe controller,
+ * VERIFY_BLOCKS per command and dp->qd of them at once as passthrough
+ * commands on an io_uring (one at a time without one): Verify, the
+ * media read with no data transferred, for --device-verify, or Write
+ * Zeroes for a --write pass of zeros. A range the controller fails is
+ * done again by nvme_range_host(). Returns VERIFY_FALLBACK when it
+ * refuses the first command, its ONCS bit then cleared and the pass
+ * left to the host. */
+static int
+nvme_range_pass(t_dev *dp, uint8_t opcode)
+{
+    bool wz = (NVME_OP_WZ == opcode);
+    int qd = dp->uring ? dp->qd : 1;
+    int k, res, status, ret = 0, in_flight = 0, queued = 0;
+    int64_t next = dp->from, lba, unflushed = 0;
+    uint32_t cdw[3];
+    uint64_t wait, ns;
+    bool done_one = false, refused = false;
+    struct uring ur;
+    struct io_uring_cqe cqe;
+    t_rq *rqp;
+    t_rq *rqs = (t_rq *)calloc(qd, sizeof(t_rq));
+
+    ur.fd = -1;
+    if (NULL == rqs)
+        return -1;
+    if (dp->uring && (res = uring_init(&ur, qd, dp->uring_flags)))
+    {
+        pr2serr("%s: io_uring setup: %s\n", dp->device_name,
+                safe_strerror(-res));
+        free(rqs);
+        return -1;
+    }
+    for (;;)
+    {
+        /* as many commands as there are free slots, under the caps */
+        while ((0 == ret) && !refused && (in_flight < qd) &&
+               (next < dp->end) && !dev_stopped(dp))
+        {
+            int blocks = VERIFY_BLOCKS;
+
+            lba = next;
+            if (!range_next(dp, &lba, &blocks))
+            {
+                next = dp->end;
+                break;
+            }
+            wait = throttle_ns(dp, (int64_t)blocks * dp->blk_sz);
+            if (wait && in_flight)
+                break;
+            if (wait)
+            {
+                throttle_sleep(wait);
+                continue;
+            }
+            for (k = 0; rqs[k].busy; ++k)
+                ;
+            rqp = rqs + k;
+            rqp->lba = lba;
+            rqp->blocks = blocks;
+            rqp->busy = true;
+            rqp->qd = ++in_flight;
+            next = lba + blocks;
+            nvme_range_cdw(dp, opcode, lba, blocks, cdw);
+            PROBE3(submit, dp->device_name, lba, blocks);
+            rqp->t_ns = lat_now_ns();
+            if (dp->uring)
+            {
+                struct nvme_uring_cmd cmd;
+
+                memset(&cmd, 0, sizeof(cmd));
+                cmd.opcode = opcode;
+                cmd.nsid = dp->nsid;
+                cmd.cdw10 = cdw[0];
+                cmd.cdw11 = cdw[1];
+                cmd.cdw12 = cdw[2];
+                uring_prep_cmd(&ur, dp->fd, NVME_URING_CMD_IO, &cmd,
+                               sizeof(cmd), k);
+                ++queued;
+                continue;
+            }
+            struct nvme_passthru_cmd64 cmd;
+
+            memset(&cmd, 0, sizeof(cmd));
+            cmd.opcode = opcode;
+            cmd.nsid = dp->nsid;
+            cmd.cdw10 = cdw[0];
+            cmd.cdw11 = cdw[1];
+            cmd.cdw12 = cdw[2];
+            res = nvme_io(dp, &cmd);
+            cqe.res = (res < 0) ? -errno : res;
+            cqe.user_data = k;
+            goto done; /* the slot completed, as a cqe of the ring would */
+        }
+        if (0 == in_flight)
+            break;
+        if (dp->uring)
+        {
+            if (queued)
+                uring_submit_and_wait(&ur, 0);
+            queued = 0;
+            res = uring_reap(&ur, &cqe);
+            if (-EAGAIN == res)
+            {
+                res = uring_submit_and_wait(&ur, 1);
+                if (res < 0)
+                {
+                    pr2serr("%s: io_uring wait: %s\n", dp->device_name,
+                            safe_strerror(-res));
+                    ret = -1;
+                    break; /* what is in flight goes with the ring */
+                }
+                continue;
+            }
+        }
+    done:
+        rqp = rqs + cqe.user_data;
+        ns = lat_now_ns() - rqp->t_ns;
+        status = cqe.res;
+        rqp->busy = false;
+        --in_flight;
+        if (!wz)
+            lat_done(dp, rqp->lba, rqp->blocks, ns);
+        io_trace(dp, wz ? TRACE_WRITE : TRACE_VERIFY, rqp->lba, rqp->blocks,
+                 ns, rqp->qd, status ? SG_LIB_CAT_OTHER : 0);
+        /* Invalid Command Opcode or Invalid Field, before any went */
+        if (!done_one && ((1 == status) || (2 == status) ||
+                          (-EINVAL == status) || (-EOPNOTSUPP == status)))
+        {
+            refused = true;
+            continue;
+        }
+        done_one = true;
+        if ((-ENODEV == status) || (-ENXIO == status))
+            dev_gone(dp, "device removed");
+        if (status)
+        {
+            if (verbose)
+                pr2serr("%s: NVMe %s at lba=%" PRId64 " failed, %s 0x%x\n",
+                        dp->device_name, wz ? "Write Zeroes" : "Verify",
+                        rqp->lba, (status < 0) ? "errno" : "status",
+                        (status < 0) ? -status : status);
+            res = nvme_range_host(dp, opcode, rqp->lba, rqp->blocks);
+            if (res && (0 == ret))
+                ret = res;
+        }
+        if (wz)
+        {
+            __atomic_fetch_add(&dp->bytes_written,
+                               (int64_t)rqp->blocks * dp->blk_sz,
+                               __ATOMIC_RELAXED);
+            unflushed += (int64_t)rqp->blocks * dp->blk_sz;
+            if ((0 == ret) && (FLUSH_EVERY == opt.flush) &&
+                (unflushed >= opt.flush_every))
+            {
+                unflushed = 0;
+                ret = write_flush(dp);
+            }
+        }
+        else
+        {
+            CTR_ADD(dp, in_full, rqp->blocks);
+            __atomic_fetch_add(&dp->bytes_done,
+                               (int64_t)rqp->blocks * dp->blk_sz,
+                               __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&dp->cur_lba, low_water(rqs, qd, next),
+                         __ATOMIC_RELAXED);
+    }
+    if (ur.fd >= 0)
+        uring_exit(&ur);
+    free(rqs);
+    if (refused)
+    {
+        pr2serr("%s: controller refuses NVMe %s, %s on the host\n",
+                dp->device_name, wz ? "Write Zeroes" : "Verify",
+                wz ? "writing the zeros" : "reading the data");
+        dp->nvme_oncs &= ~(wz ? NVME_ONCS_WZ : NVME_ONCS_VERIFY);
+        return VERIFY_FALLBACK;
+    }
+    if ((0 == ret) && wz && (FLUSH_FUA != opt.flush) && unflushed)
+        ret = write_flush(dp);
+    return ret;
+}
+
+/* Takes in a READ of the --write stream: the data is checked and
+ * counted as a pass over it would. */
+static void
+write_read_done(t_dev *dp, const t_pattern *pat, const uint8_t *buf,
+                int64_t lba, int blocks)
+{
+    verify_chunk(dp, buf, pat, lba, blocks);
+    CTR_ADD(dp, in_full, blocks);
+    __atomic_fetch_add(&dp->bytes_done, (int64_t)blocks * dp->blk_sz,
+                       __ATOMIC_RELAXED);
+}
+
+/* --write on block devices and NVMe namespaces: WRITEs with
+ * blk_pwrite() one at a time, or BLKZEROOUT (Write Zeroes) of ws_blocks
+ * at once for a pattern of zeros, and, with lag >= 0, READs with
+ * direct_read() of what was written as soon as the writer is more than
+ * lag blocks ahead of them, the rest after the last WRITE. */
+static int
+write_pass_sync(t_dev *dp, const t_pattern *pat, int64_t lag)
+{
+    uint8_t *wfree, *rfree;
+    uint8_t *wbuf = io_buf(dp, dp->bpt * dp->blk_sz, &wfree);
+    uint8_t *rbuf = io_buf(dp, dp->bpt * dp->blk_sz, &rfree);
+    int64_t w_next = dp->from, r_next = dp->from, lba;
+    int blocks, res = 0;
+    uint64_t wait;
+    int64_t unflushed = 0;
+    bool same = dp->ws_blocks && pattern_zero(pat) &&
+                (FLUSH_FUA != opt.flush);
+
+    if ((NULL == wbuf) || (NULL == rbuf))
+    {
+        pr2serr(">> heap problems\n");
+        res = -1;
+    }
+    while ((0 == res) && ((w_next < dp->end) || ((lag >= 0) &&
+                                                 (r_next < w_next))))
+    {
+        if ((lag >= 0) && (r_next < w_next) &&
+            ((w_next >= dp->end) || (w_next - r_next > lag)))
+        {
+            lba = r_next;
+            blocks = dp->bpt;
+            if (!range_next(dp, &lba, &blocks) || (lba >= w_next))
+            {
+                r_next = w_next;
+                continue;
+            }
+            if (lba + blocks > w_next)
+                blocks = (int)(w_next - lba);
+            uint64_t t_ns = lat_now_ns();
+            res = direct_read(dp, rbuf, blocks, lba);
+            t_ns = lat_now_ns() - t_ns;
+            lat_done(dp, lba, blocks, t_ns);
+            io_trace(dp, TRACE_READ, lba, blocks, t_ns, 1, res);
+            if (0 == res)
+                write_read_done(dp, pat, rbuf, lba, blocks);
+            r_next = lba + blocks;
+            __atomic_store_n(&dp->cur_lba, r_next, __ATOMIC_RELAXED);
+            continue;
+        }
+        lba = w_next;
+        blocks = same ? dp->ws_blocks : dp->bpt;
+        if (!range_next(dp, &lba, &blocks))
+        {
+            w_next = dp->end;
+            continue;
+        }
+        while ((wait = throttle_ns(dp, (int64_t)blocks * dp->blk_sz)))
+            throttle_sleep(wait);
+        if (same && (FT_NVME & dp->out_type))
+        {
+            res = nvme_write(dp, NVME_OP_WZ, NULL, blocks, lba, true);
+            if (res > 0)
+            {
+                pr2serr("%s: Write Zeroes refused (status 0x%x), writing the "
+                        "zeros\n", dp->device_name, res);
+                res = 0;
+                dp->ws_blocks = 0;
+                same = false;
+                continue;
+            }
+            if (res && dp->flags.coe)
+                res = 0;
+        }
+        else if (same)
+        {
+            uint64_t range[2] = {(uint64_t)lba * dp->blk_sz,
+                                 (uint64_t)blocks * dp->blk_sz};
+
+            if (ioctl(dp->fd, BLKZEROOUT, range) < 0)
+            {
+                pr2serr("%s: BLKZEROOUT refused (%s), writing the zeros\n",
+                        dp->device_name, safe_strerror(errno));
+                dp->ws_blocks = 0;
+                same = false;
+                continue;
+            }
+        }
+        else
+        {
+            /* from the shared reference when it has the blocks */
+            const uint8_t *src = dp->spdk ? NULL
+                                          : pattern_ref(dp, pat, lba, blocks);
+
+            if (NULL == src)
+            {
+                pattern_fill(dp, pat, wbuf, lba, blocks);
+                src = wbuf;
+            }
+            if (blk_pwrite(dp, src, blocks, lba) && !dp->flags.coe)
+                res = -1;
+        }
+        if (0 == res)
+            __atomic_fetch_add(&dp->bytes_written,
+                               (int64_t)blocks * dp->blk_sz, __ATOMIC_RELAXED);
+        unflushed += (int64_t)blocks * dp->blk_sz;
+        if ((0 == res) && (FLUSH_EVERY == opt.flush) &&
+            (unflushed >= opt.flush_every))
+        {
+            unflushed = 0;
+            res = write_flush(dp);
+        }
+        w_next = lba + blocks;
+        if (lag < 0)
+            __atomic_store_n(&dp->cur_lba, w_next, __ATOMIC_RELAXED);
+    }
+    if ((0 == res) && (FLUSH_FUA != opt.flush) && unflushed)
+        res = write_flush(dp);
+    iobuf_free(wfree);
+    iobuf_free(rfree);
+    return res;
+}
+
+/* STREAM CONTROL through SG_IO: opens a stream, its id into *idp, or
+ * closes stream *idp. Returns 0, else the sense category or -1. */
+static int
+sg_stream_ctl(t_dev *dp, bool open_it, uint16_t *idp)
+{
+    unsigned char cdb[16] = {0x9e, 0x14 /* STREAM CONTROL */};
+    unsigned char resp[8];
+    unsigned char senseBuff[SENSE_BUFF_LEN];
+    struct sg_io_hdr io_hdr;
+    int res;
+
+    cdb[1] |= (open_it ? 1 : 2) << 5; /* STR_CTL */
+    if (!open_it)
+        sg_put_unaligned_be16(*idp, cdb + 4);
+    sg_put_unaligned_be32(sizeof(resp), cdb + 10);
+    memset(resp, 0, sizeof(resp));
+    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+    io_hdr.interface_id = 'S';
+    io_hdr.cmd_len = sizeof(cdb);
+    io_hdr.cmdp = cdb;
+    io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+    io_hdr.dxfer_len = sizeof(resp);
+    io_hdr.dxferp = resp;
+    io_hdr.mx_sb_len = SENSE_BUFF_LEN;
+    io_hdr.sbp = senseBuff;
+    io_hdr.timeout = DEF_TIMEOUT;
+    if (verbose > 2)
+        sg_print_command_len(cdb, sizeof(cdb));
+    while (((res = ioctl(dp->fd, SG_IO, &io_hdr)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno)))
+        ;
+    if (res < 0)
+        return -1;
+    res = sg_err_category3(&io_hdr);
+    if ((SG_LIB_CAT_CLEAN != res) && (SG_LIB_CAT_RECOVERED != res))
+    {
+        if (verbose)
+            sg_chk_n_print3("STREAM CONTROL", &io_hdr, verbose > 1);
+        return res;
+    }
+    if (open_it)
+        *idp = sg_get_unaligned_be16(resp + 4);
+    return 0;
+}
+
+/* --streams: opens a stream for each of the opt.streams regions of the
+ * pass, none when the drive has no streams. */
+static void
+streams_open(t_dev *dp)
+{
+    int k;
+
+    memset(dp->stream, 0, sizeof(dp->stream));
+    for (dp->nstreams = 0; dp->nstreams < opt.streams; ++dp->nstreams)
+        if (sg_stream_ctl(dp, true, &dp->stream[dp->nstreams].id))
+            break;
+    if (dp->nstreams < opt.streams)
+    {
+        pr2serr("%s: could not open %d streams, writing without\n",
+                dp->device_name, opt.streams);
+        for (k = 0; k < dp->nstreams; ++k)
+            sg_stream_ctl(dp, false, &dp->stream[k].id);
+        dp->nstreams = 0;
+    }
+}
+
+/* Closes the streams of the pass; their counts stay for the summary. */
+static void
+streams_close(t_dev *dp)
+{
+    int k;
+
+    for (k = 0; k < dp->nstreams; ++k)
+        sg_stream_ctl(dp, false, &dp->stream[k].id);
+}
+
+/* 1 + the stream of the region lba is in, 0 when not streaming. */
+static int
+stream_of(const t_dev *dp, int64_t lba, int blocks)
+{
+    if ((0 == dp->nstreams) || (blocks > 0xffff))
+        return 0;
+    return 1 + (int)((lba - dp->start) * dp->nstreams /
+                     (dp->end - dp->start));
+}
+
+/* --write on sg devices: dp->qd commands queued on the sg fd as in
+ * read_pass_async(), WRITEs of pat (WRITE SAME of one block over
+ * ws_blocks for a constant pattern) and, with lag >= 0, READs of what
+ * the WRITEs that have completed put there, taking a slot whenever the
+ * writer is more than lag blocks ahead. Those are checked like the
+ * READs of a pass, a failed one read again by sg_read(); a failed WRITE
+ * fails the pass unless coe. With WRITE_WV the WRITEs are WRITE AND
+ * VERIFY and the drive does the checking, unless it refuses them.
+ * With --pipeline np passes, of pat[0, np), run at once, each writing
+ * only where the one before it is done (pipe_top()), the free slots
+ * taken by the passes in turn. */
+static int
+write_pass_async(t_dev *dp, const t_pattern *pat, int np, int64_t lag)
+{
+    int qd = dp->qd;
+    int j, k, st, res, cat, ret = 0, in_flight = 0, turn = 0;
+    int64_t w_next[MAX_PIPE], r_next[MAX_PIPE], w_low, w_top, lba;
+    int64_t unflushed = 0;
+    uint64_t wait;
+    uint8_t *spare, *spare_free, *cbuf;
+    t_rq *rqp;
+    t_rq *rqs = (t_rq *)calloc(qd, sizeof(t_rq));
+    bool wv = (WRITE_WV == opt.write);
+
+    if (wv)
+    {
+        /* WRITE AND VERIFY(10/16) share the layout of the WRITEs */
+        dp->wr_cdb[0] = (16 == dp->flags.cdbsz) ? 0x8e : 0x2e;
+        dp->wr_cdb[1] = opt.write_bytchk ? 0x2 : 0; /* BYTCHK */
+    }
+    for (st = 0; st < np; ++st)
+        w_next[st] = r_next[st] = dp->from;
+    if (opt.streams)
+        streams_open(dp);
+    spare = io_buf(dp, dp->bpt * dp->blk_sz, &spare_free);
+    for (k = 0; rqs && (k < qd); ++k)
+        rqs[k].buffp = io_buf(dp, dp->bpt * dp->blk_sz, &rqs[k].free_buffp);
+    for (k = 0; rqs && (k < qd) && rqs[k].buffp; ++k)
+        ;
+    if ((NULL == rqs) || (k < qd) || (NULL == spare))
+    {
+        pr2serr(">> heap problems\n");
+        ret = -1;
+        goto fini;
+    }
+    for (;;)
+    {
+        /* fill the idle slots, the READs first when they fell behind */
+        for (k = 0; (0 == ret) && (k < qd); ++k)
+        {
+            rqp = rqs + k;
+            if (rqp->busy)
+                continue;
+            /* the first pass in turn with a command to queue */
+            for (j = 0, st = -1; (st < 0) && (j < np); ++j)
+            {
+                int n = (turn + j) % np;
+
+                w_low = write_water(rqs, qd, true, n, w_next[n]);
+                w_top = pipe_top(dp, rqs, qd, n, lag, w_next, r_next);
+                rqp->write = !((lag >= 0) && (r_next[n] < w_low) &&
+                               ((w_next[n] >= w_top) ||
+                                (w_next[n] - r_next[n] > lag)));
+                rqp->same = rqp->write && dp->ws_blocks && !wv &&
+                            (0 == pat[n].flag) &&
+                            (FLUSH_FUA != opt.flush) && (0 == dp->nstreams);
+                rqp->lba = rqp->write ? w_next[n] : r_next[n];
+                rqp->blocks = rqp->same ? dp->ws_blocks : dp->bpt;
+                if (rqp->write && (w_next[n] >= w_top))
+                    continue;
+                if (!range_next(dp, &rqp->lba, &rqp->blocks))
+                {
+                    if (rqp->write)
+                        w_next[n] = dp->end;
+                    else
+                        r_next[n] = w_low;
+                    continue;
+                }
+                if (!rqp->write && (rqp->lba >= w_low))
+                {
+                    r_next[n] = w_low; /* range_next() skipped to there */
+                    continue;
+                }
+                if (!rqp->write && (rqp->lba + rqp->blocks > w_low))
+                    rqp->blocks = (int)(w_low - rqp->lba);
+                if (rqp->write && (rqp->lba >= w_top))
+                    continue; /* the pass before has not got there */
+                if (rqp->write && (rqp->lba + rqp->blocks > w_top))
+                    rqp->blocks = (int)(w_top - rqp->lba);
+                st = n;
+            }
+            if (st < 0)
+                break;
+            rqp->pass = st;
+            rqp->stream = rqp->write ? stream_of(dp, rqp->lba, rqp->blocks)
+                                     : 0;
+            wait = throttle_ns(dp, (int64_t)rqp->blocks * dp->blk_sz);
+            if (wait && (0 == in_flight))
+                throttle_sleep(wait);
+            else if (wait)
+                break;
+            if (rqp->write)
+                pattern_fill(dp, pat + st, rqp->buffp, rqp->lba,
+                             rqp->same ? 1 : rqp->blocks);
+            res = sg_start_io(dp, rqp);
+            if ((-2 == res) && (in_flight > 0))
+                break; /* ENOMEM, reap some first */
+            if (res)
+            {
+                ret = res;
+                break;
+            }
+            rqp->busy = true;
+            rqp->qd = ++in_flight;
+            if (rqp->stream && !dp->stream[rqp->stream - 1].t0_ns)
+                dp->stream[rqp->stream - 1].t0_ns = rqp->t_ns;
+            if (rqp->write)
+                w_next[st] = rqp->lba + rqp->blocks;
+            else
+                r_next[st] = rqp->lba + rqp->blocks;
+            turn = st + 1;
+        }
+        if (0 == in_flight)
+        {
+            for (st = 0; st < np; ++st)
+                if ((w_next[st] < dp->end) ||
+                    ((lag >= 0) && (r_next[st] < dp->end)))
+                    break;
+            if (ret || (st == np))
+                break;
+            continue;
+        }
+        res = sg_finish_io(dp, &rqp, false);
+        if (res < 0)
+        {
+            ret = -1;
+            break;
+        }
+        rqp->busy = false;
+        --in_flight;
+        lba = rqp->lba;
+        io_trace(dp, rqp->write ? TRACE_WRITE : TRACE_READ, lba, rqp->blocks,
+                 rqp->t_ns, rqp->qd, res);
+        if (rqp->same && ((SG_LIB_CAT_INVALID_OP == res) ||
+                          (SG_LIB_CAT_ILLEGAL_REQ == res)))
+        {
+            /* not supported: this range and the rest as plain WRITEs */
+            if (dp->ws_blocks)
+                pr2serr("%s: WRITE SAME refused, writing the data\n",
+                        dp->device_name);
+            dp->ws_blocks = 0;
+            if (lba < w_next[rqp->pass])
+                w_next[rqp->pass] = lba;
+            continue;
+        }
+        if (rqp->stream && ((SG_LIB_CAT_INVALID_OP == res) ||
+                            (SG_LIB_CAT_ILLEGAL_REQ == res)))
+        {
+            /* opened but no WRITE STREAM: this range and the rest plain */
+            if (dp->nstreams)
+                pr2serr("%s: WRITE STREAM refused, writing without streams\n",
+                        dp->device_name);
+            streams_close(dp);
+            dp->nstreams = 0;
+            if (lba < w_next[rqp->pass])
+                w_next[rqp->pass] = lba;
+            continue;
+        }
+        if (rqp->write && ((0x8e == rqp->cmd[0]) || (0x2e == rqp->cmd[0])) &&
+            ((SG_LIB_CAT_INVALID_OP == res) || (SG_LIB_CAT_ILLEGAL_REQ == res)))
+        {
+            /* this range and the rest as WRITEs read back behind */
+            bool first = wv;
+
+            if (wv)
+                pr2serr("%s: WRITE AND VERIFY refused, reading back behind "
+                        "the writer\n", dp->device_name);
+            wv = false;
+            sg_build_scsi_cdb(dp->wr_cdb, dp->flags.cdbsz, 0, 0, 1,
+                              FLUSH_FUA == opt.flush, 0, 0);
+            lag = opt.write_lag / dp->blk_sz;
+            if (lba < w_next[rqp->pass])
+                w_next[rqp->pass] = lba;
+            /* what WRITE AND VERIFY did check is not read again */
+            for (j = 0; j < np; ++j)
+            {
+                w_low = write_water(rqs, qd, true, j, w_next[j]);
+                if (first || (w_low < r_next[j]))
+                    r_next[j] = w_low;
+            }
+            continue;
+        }
+        if (wv && (SG_LIB_CAT_MISCOMPARE == res))
+        {
+            /* BYTCHK=1: the medium does not hold what was sent */
+            verify_miscompare(dp, pat + rqp->pass, rqp->blocks, lba);
+            res = SG_LIB_CAT_CLEAN;
+        }
+        if (rqp->write)
+        {
+            if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res))
+                __atomic_fetch_add(&dp->bytes_written,
+                                   (int64_t)rqp->blocks * dp->blk_sz,
+                                   __ATOMIC_RELAXED);
+            if (rqp->stream)
+            {
+                dp->stream[rqp->stream - 1].bytes +=
+                    (int64_t)rqp->blocks * dp->blk_sz;
+                dp->stream[rqp->stream - 1].t1_ns = lat_now_ns();
+            }
+            unflushed += (int64_t)rqp->blocks * dp->blk_sz;
+            if ((FLUSH_EVERY == opt.flush) && (unflushed >= opt.flush_every))
+            {
+                /* covers the WRITEs completed, the others keep going */
+                unflushed = 0;
+                write_flush(dp);
+            }
+            if (wv && ((SG_LIB_CAT_CLEAN == res) ||
+                       (SG_LIB_CAT_RECOVERED == res)))
+            {
+                /* checked by the drive as a READ of the pass would be */
+                CTR_ADD(dp, in_full, rqp->blocks);
+                __atomic_fetch_add(&dp->bytes_done,
+                                   (int64_t)rqp->blocks * dp->blk_sz,
+                                   __ATOMIC_RELAXED);
+            }
+            else if ((SG_LIB_CAT_CLEAN != res) &&
+                     (SG_LIB_CAT_RECOVERED != res))
+            {
+                errlog_put(res, NULL, 0, 0, "writing", &rqp->io_hdr,
+                           verbose > 1);
+                CTR_ADD(dp, unrecovered, 1);
+                bad_block(dp, BADMAP_BAD, lba, rqp->blocks);
+                if (!dp->flags.coe && (0 == ret))
+                    ret = res;
+            }
+            if (lag < 0)
+                __atomic_store_n(&dp->cur_lba,
+                                 write_water(rqs, qd, true, np - 1,
+                                             w_next[np - 1]),
+                                 __ATOMIC_RELAXED);
+            continue;
+        }
+        lat_done(dp, lba, rqp->blocks, rqp->t_ns);
+        cbuf = rqp->buffp;
+        rqp->buffp = spare;
+        spare = cbuf;
+        cat = res;
+        if ((SG_LIB_CAT_CLEAN != cat) && (SG_LIB_CAT_RECOVERED != cat))
+        {
+            bool diop = false;
+            int blks_readp = 0;
+
+            res = sg_read(dp, cbuf, rqp->blocks, lba, &diop, &blks_readp);
+            if (res)
+            {
+                pr2serr("sg_read failed, at or after lba=%" PRId64 " [0x%"
+                        PRIx64 "]\n", lba, lba);
+                if (0 == ret)
+                    ret = res;
+                continue;
+            }
+        }
+        write_read_done(dp, pat + rqp->pass, cbuf, lba, rqp->blocks);
+        __atomic_store_n(&dp->cur_lba,
+                         write_water(rqs, qd, false, np - 1, r_next[np - 1]),
+                         __ATOMIC_RELAXED);
+    }
+    if ((0 == ret) && (FLUSH_FUA != opt.flush) && unflushed)
+        write_flush(dp);
+    streams_close(dp);
+
+fini:
+    if (rqs)
+        for (k = 0; k < qd; ++k)
+            iobuf_free(rqs[k].free_buffp);
+    free(rqs);
+    iobuf_free(spare_free);
+    return ret;
+}
+
+/* --write: how many blocks one command may fill with a pattern the
+ * host sends one block of: the MAXIMUM WRITE SAME LENGTH of the Block
+ * Limits VPD page for sg devices, BLKZEROOUT (zeros only) of as many
+ * for block devices, Write Zeroes for NVMe namespaces whose controller
+ * has it (ONCS). */
+static void
+ws_probe(t_dev *dp)
+{
+    uint8_t vpd[64];
+    uint64_t v = 0;
+
+    dp->ws_probed = true;
+    dp->ws_blocks = DEF_WS_BLOCKS;
+    if ((FT_NVME & dp->out_type) && !(NVME_ONCS_WZ & dp->nvme_oncs))
+        dp->ws_blocks = 0; /* no Write Zeroes, the zeros are sent */
+    if (!(FT_SG & dp->out_type) || (FT_BLOCK & dp->out_type))
+        return;
+    memset(vpd, 0, sizeof(vpd));
+    if ((0 == sg_ll_inquiry(dp->fd, false, true, 0xb0, vpd, sizeof(vpd),
+                            false, verbose > 1 ? verbose - 1 : 0)) &&
+        (0xb0 == vpd[1]) && (sg_get_unaligned_be16(vpd + 2) >= 0x3c))
+        v = sg_get_unaligned_be64(vpd + 36);
+    if (v && (v < DEF_WS_BLOCKS))
+        dp->ws_blocks = (int)v;
+    if (verbose)
+        pr2serr("%s: WRITE SAME of up to %d blocks\n", dp->device_name,
+                dp->ws_blocks);
+}
+
+/* --pipeline: how many passes from pass on write_pass() runs at once,
+ * 1 when the device writes one command at a time. */
+static unsigned int
+pipe_passes(const t_dev *dp, unsigned int pass)
+{
+    unsigned int n = opt.passes - pass + 1;
+
+    if (!opt.pipe || !(FT_SG & dp->out_type) || (FT_BLOCK & dp->out_type) ||
+        dp->clone || (opt.stress > 0))
+        return 1;
+    return (n > MAX_PIPE) ? MAX_PIPE : n;
+}
+
+/* --write: writes pat over the pass' range, read back in a stream
+ * trailing the writer with WRITE_LAG, or the np passes of pat[0, np)
+ * at once with --pipeline. Returns 0, else the error that ended it. */
+static int
+write_pass(t_dev *dp, const t_pattern *pat, int np)
+{
+    int64_t lag = (WRITE_LAG == opt.write) ? opt.write_lag / dp->blk_sz : -1;
+
+    dp->bytes_written = 0;
+    dp->flushes = 0;
+    dp->flush_ns = dp->flush_max_ns = 0;
+    dp->nstreams = 0;
+    if (!dp->ws_probed)
+        ws_probe(dp);
+    if ((FT_NVME & dp->out_type) && !dp->spdk && dp->ws_blocks && (lag < 0) &&
+        pattern_zero(pat) && (FLUSH_FUA != opt.flush) &&
+        (WRITE_WV != opt.write))
+    {
+        /* Write Zeroes at queue depth, the host writing if refused */
+        int res = nvme_range_pass(dp, NVME_OP_WZ);
+
+        if (VERIFY_FALLBACK != res)
+            return res;
+        dp->ws_blocks = 0;
+    }
+    if ((FT_SG & dp->out_type) && !(FT_BLOCK & dp->out_type))
+        return write_pass_async(dp, pat, np, lag);
+    if (opt.streams && (0 == dp->passes_done))
+        pr2serr("%s: no WRITE STREAM on block devices, writing without "
+                "streams\n", dp->device_name);
+    if (WRITE_WV == opt.write)
+    {
+        if (0 == dp->passes_done)
+            pr2serr("%s: no WRITE AND VERIFY on block devices, reading back "
+                    "behind the writer\n", dp->device_name);
+        lag = opt.write_lag / dp->blk_sz;
+    }
+    return write_pass_sync(dp, pat, lag);
+}
+
+/* One line of command latency percentiles, for a pass or the run. */
+static void
+print_latency(t_dev *dp, const char *what, const char *which,
+              const struct lat_hist *h)
+{
+    char p50[16], p99[16], p999[16], max[16];
+
+    if (0 == h->count)
+        return;
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: %s %s latency p50 %s, p99 %s, p99.9 %s, max %s over %"
+           PRIu64 " commands\n", dp->device_name, what, which,
+           lat_str(lat_percentile(h, 50.0), p50, sizeof(p50)),
+           lat_str(lat_percentile(h, 99.0), p99, sizeof(p99)),
+           lat_str(lat_percentile(h, 99.9), p999, sizeof(p999)),
+           lat_str(h->max, max, sizeof(max)), h->count);
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* --stress: one WRITE through SG_IO, from the READ template of
+ * rd_template() as sg_start_io() makes them, a unit attention or an
+ * aborted command tried again up to --retries. Returns 0, else the
+ * sense category or -1. */
+static int
+sg_write_sync(t_dev *dp, uint8_t *buff, int blocks, int64_t lba)
+{
+    struct sg_io_hdr io_hdr = dp->rd_hdr;
+    unsigned char cdb[MAX_SCSI_CDBSZ];
+    unsigned char senseBuff[SENSE_BUFF_LEN];
+    int res, tries = dp->flags.retries;
+
+    wr_cdb_put(dp, cdb, blocks, lba);
+    io_hdr.cmdp = cdb;
+    io_hdr.dxfer_direction = SG_DXFER_TO_DEV;
+    io_hdr.dxfer_len = blocks * dp->blk_sz;
+    io_hdr.dxferp = buff;
+    io_hdr.mx_sb_len = SENSE_BUFF_LEN;
+    io_hdr.sbp = senseBuff;
+    io_hdr.pack_id = (int)lba;
+    do
+    {
+        while (((res = ioctl(dp->fd, SG_IO, &io_hdr)) < 0) &&
+               ((EINTR == errno) || (EAGAIN == errno)))
+            ;
+        if (res < 0)
+            return -1;
+        res = sg_err_category3(&io_hdr);
+        if (SG_LIB_CAT_RECOVERED == res)
+            CTR_ADD(dp, recovered, 1);
+        if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res))
+            return 0;
+        CTR_ADD(dp, retries, 1);
+    } while (((SG_LIB_CAT_UNIT_ATTENTION == res) ||
+              (SG_LIB_CAT_ABORTED_COMMAND == res)) && (tries-- > 0));
+    if (verbose)
+        sg_chk_n_print3("WRITE", &io_hdr, verbose > 1);
+    pr2serr("%s: write failed at or after lba=%" PRId64 " [0x%" PRIx64 "]\n",
+            dp->device_name, lba, lba);
+    CTR_ADD(dp, unrecovered, 1);
+    bad_block(dp, BADMAP_BAD, lba, blocks);
+    return res;
+}
+
+/* A --stress run of one pass, shared by its threads. */
+struct _stress
+{
+    t_dev *dp;
+    t_pattern pat;        /* what the WRITEs stamp, */
+    uint64_t t0_ns;
+    uint64_t end_ns;      /* until then, */
+    int64_t grain;        /* in blocks every size is a multiple of, */
+    int64_t ngrains;      /* of the range, */
+    uint8_t *written;     /* a bit each, set once one was written */
+    int sizes[STRESS_SIZES]; /* blocks of --bs-split, */
+    int weights[STRESS_SIZES];
+    int nsizes;
+    int wsum;
+    int max_blocks;
+    int res;              /* the first error, the run then stopped */
+    int64_t reads, writes, rbytes, wbytes, verified, miscompared;
+    struct lat_hist rlat;
+    struct lat_hist wlat;
+};
+
+typedef struct _stress t_stress;
+
+struct _stress_arg
+{
+    t_stress *st;
+    int idx;
+    pthread_t tid;
+};
+
+static int64_t
+gcd64(int64_t a, int64_t b)
+{
+    while (b)
+    {
+        int64_t t = a % b;
+
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* Whether grain g of st was written before now. */
+static inline bool
+stress_grain(const t_stress *st, int64_t g)
+{
+    return __atomic_load_n(st->written + g / 8, __ATOMIC_ACQUIRE) &
+           (1 << (g % 8));
+}
+
+/* The blocks at lba of a READ that were written before it was issued,
+ * when (and only when) is a WRITE of the same block no longer in
+ * flight: its data is the stamp whichever WRITE of it the READ saw.
+ * Runs of them are checked, the others not. */
+static void
+stress_verify(t_stress *st, const uint8_t *buf, const bool *was, int64_t lba,
+              int blocks)
+{
+    t_dev *dp = st->dp;
+    int64_t n = blocks / st->grain, k, run;
+
+    for (k = 0; k < n; k += run)
+    {
+        for (run = 1; (k + run < n) && (was[k + run] == was[k]); ++run)
+            ;
+        if (!was[k])
+            continue;
+        if (verify_chunk(dp, buf + k * st->grain * dp->blk_sz, &st->pat,
+                         lba + k * st->grain, (int)(run * st->grain)))
+            __atomic_fetch_add(&st->verified, run * st->grain,
+                               __ATOMIC_RELAXED);
+        else
+            __atomic_fetch_add(&st->miscompared, run * st->grain,
+                               __ATOMIC_RELAXED);
+    }
+}
+
+/* One of the --qd threads of --stress: READs and WRITEs one at a time
+ * through the engines' own single command paths, so they take the same
+ * retries, sense handling, bad map and side queue as a verify pass. */
+static void *
+stress_thread(void *arg)
+{
+    struct _stress_arg *ap = (struct _stress_arg *)arg;
+    t_stress *st = ap->st;
+    t_dev *dp = st->dp;
+    uint64_t seed = opt.seed ^ STRESS_SALT ^ ((uint64_t)ap->idx << 40);
+    unsigned int n = 0;
+    uint8_t *bfree;
+    uint8_t *buf = io_buf(dp, st->max_blocks * dp->blk_sz, &bfree);
+    bool *was = (bool *)calloc(st->max_blocks / st->grain + 1, sizeof(bool));
+    int64_t span = st->ngrains, lba, g, k;
+    uint64_t r, t_ns, now;
+    int blocks, w, res;
+    bool write, dio;
+
+    ctr_shard = ap->idx;
+    if ((NULL == buf) || (NULL == was))
+    {
+        pr2serr("%s: not enough user memory for --stress\n",
+                dp->device_name);
+        __atomic_store_n(&st->res, SG_LIB_CAT_OTHER, __ATOMIC_RELAXED);
+    }
+    while (buf && was && (0 == __atomic_load_n(&st->res, __ATOMIC_RELAXED)) &&
+           ((now = lat_now_ns()) < st->end_ns))
+    {
+        r = rand_pattern_key(seed, n++);
+        for (w = (int)(r % st->wsum), k = 0; w >= st->weights[k]; ++k)
+            w -= st->weights[k];
+        blocks = st->sizes[k];
+        r = rand_pattern_key(seed, n++);
+        g = (span > blocks / st->grain)
+                ? (int64_t)(r % (uint64_t)(span - blocks / st->grain + 1))
+                : 0;
+        lba = dp->start + g * st->grain;
+        if (lba + blocks > dp->end)
+            blocks = (int)(dp->end - lba);
+        write = (int)((r >> 48) % 100) < opt.stress_mix;
+        if (0 == ap->idx)
+            __atomic_store_n(&dp->cur_lba, dp->start + (int64_t)((double)(
+                                 dp->end - dp->start) * (now - st->t0_ns) /
+                                 (st->end_ns - st->t0_ns)), __ATOMIC_RELAXED);
+        if (write)
+        {
+            pattern_fill(dp, &st->pat, buf, lba, blocks);
+            t_ns = lat_now_ns();
+            res = ((FT_SG & dp->out_type) && !(FT_BLOCK & dp->out_type))
+                      ? sg_write_sync(dp, buf, blocks, lba)
+                      : blk_pwrite(dp, buf, blocks, lba);
+            t_ns = lat_now_ns() - t_ns;
+            lat_record(&st->wlat, t_ns);
+            io_trace(dp, TRACE_WRITE, lba, blocks, t_ns, 1, res);
+            for (k = 0; k < blocks / st->grain; ++k)
+                if (0 == res)
+                    __atomic_fetch_or(st->written + (g + k) / 8,
+                                      (uint8_t)(1 << ((g + k) % 8)),
+                                      __ATOMIC_RELEASE);
+                else /* what it left is not known */
+                    __atomic_fetch_and(st->written + (g + k) / 8,
+                                       (uint8_t)~(1 << ((g + k) % 8)),
+                                       __ATOMIC_RELEASE);
+            if (0 == res)
+            {
+                __atomic_fetch_add(&st->writes, 1, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&st->wbytes, (int64_t)blocks * dp->blk_sz,
+                                   __ATOMIC_RELAXED);
+            }
+        }
+        else
+        {
+            for (k = 0; k < blocks / st->grain; ++k)
+                was[k] = st->written && stress_grain(st, g + k);
+            t_ns = lat_now_ns();
+            if (FT_SG & dp->out_type)
+            {
+                int blks_read = 0;
+
+                dio = dp->flags.dio;
+                res = sg_read(dp, buf, blocks, lba, &dio, &blks_read);
+            }
+            else
+                res = direct_read(dp, buf, blocks, lba);
+            t_ns = lat_now_ns() - t_ns;
+            lat_record(&st->rlat, t_ns);
+            io_trace(dp, TRACE_READ, lba, blocks, t_ns, 1, res);
+            if (0 == res)
+            {
+                if (st->written)
+                    stress_verify(st, buf, was, lba, blocks);
+                CTR_ADD(dp, in_full, blocks);
+                __atomic_fetch_add(&dp->bytes_done,
+                                   (int64_t)blocks * dp->blk_sz,
+                                   __ATOMIC_RELAXED);
+                __atomic_fetch_add(&st->reads, 1, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&st->rbytes, (int64_t)blocks * dp->blk_sz,
+                                   __ATOMIC_RELAXED);
+            }
+        }
+        if (res && !dp->flags.coe)
+        {
+            int none = 0;
+
+            __atomic_compare_exchange_n(&st->res, &none, res ? res : -1,
+                                        false, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED);
+        }
+    }
+    free(was);
+    iobuf_free(bfree);
+    cpu_charge(dp);
+    return NULL;
+}
+
+/* --stress: a pass of opt.stress seconds of random READs, and --mix
+ * percent of WRITEs, of the --bs-split sizes over [start, end) with
+ * dp->qd threads. WRITEs stamp the blocks with their lba, pass and
+ * --run-id, and READs of blocks written check them. Returns 0, else
+ * the error the run stopped on. */
+static int
+stress_pass(t_dev *dp, const t_pattern *pat)
+{
+    t_stress *st = (t_stress *)calloc(1, sizeof(t_stress));
+    struct _stress_arg args[MAX_QUEUE_DEPTH];
+    int k, nthr = dp->qd, res;
+    size_t map_len;
+    double secs;
+
+    if (NULL == st)
+        return SG_LIB_CAT_OTHER;
+    st->dp = dp;
+    parse_pattern("s", &st->pat);
+    st->pat.pass = pat->pass;
+    st->pat.run = opt.run_id;
+    st->pat.key = rand_pattern_key(opt.seed, pat->pass);
+    for (k = 0; k < (opt.bs_n ? opt.bs_n : 1); ++k)
+    {
+        double bytes = opt.bs_n ? opt.bs_size[k]
+                                : (double)dp->bpt * dp->blk_sz;
+
+        st->sizes[k] = (int)(bytes / dp->blk_sz);
+        st->weights[k] = opt.bs_n ? opt.bs_weight[k] : 1;
+        if ((st->sizes[k] < 1) || (st->sizes[k] * (double)dp->blk_sz != bytes))
+        {
+            pr2serr("%s: --bs-split size %.0f is not a multiple of the %d "
+                    "byte blocks\n", dp->device_name, bytes, dp->blk_sz);
+            free(st);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        st->grain = st->grain ? gcd64(st->grain, st->sizes[k]) : st->sizes[k];
+        if (st->sizes[k] > st->max_blocks)
+            st->max_blocks = st->sizes[k];
+        st->wsum += st->weights[k];
+    }
+    st->nsizes = k;
+    st->ngrains = (dp->end - dp->start) / st->grain;
+    if (st->ngrains < 1)
+    {
+        pr2serr("%s: --stress range smaller than its %" PRId64 " block "
+                "grain\n", dp->device_name, st->grain);
+        free(st);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    map_len = (size_t)(st->ngrains + 7) / 8;
+    if (opt.stress_mix && (map_len > STRESS_MAP_MAX))
+    {
+        pr2serr("%s: --stress map of the blocks written would take %zu MiB, "
+                "narrow the range with -s and -e\n", dp->device_name,
+                map_len >> 20);
+        free(st);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.stress_mix &&
+        (NULL == (st->written = (uint8_t *)calloc(map_len, 1))))
+    {
+        pr2serr("%s: not enough user memory for the --stress map\n",
+                dp->device_name);
+        free(st);
+        return SG_LIB_CAT_OTHER;
+    }
+    st->t0_ns = lat_now_ns();
+    st->end_ns = st->t0_ns + (uint64_t)(opt.stress * 1e9);
+    for (k = 0; k < nthr; ++k)
+    {
+        args[k].st = st;
+        args[k].idx = k;
+        if (pthread_create(&args[k].tid, NULL, stress_thread, args + k))
+        {
+            pr2serr("%s: --stress started %d of its %d threads\n",
+                    dp->device_name, k, nthr);
+            break;
+        }
+    }
+    nthr = k;
+    for (k = 0; k < nthr; ++k)
+        pthread_join(args[k].tid, NULL);
+    secs = (lat_now_ns() - st->t0_ns) / 1e9;
+    if (secs <= 0)
+        secs = 1e-9;
+    dp->bytes_written = st->wbytes;
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: stress %.1f s at queue depth %d, %" PRId64 " READs %.0f "
+           "IOPS %.1f MB/s, %" PRId64 " WRITEs %.0f IOPS %.1f MB/s\n",
+           dp->device_name, secs, nthr, st->reads, st->reads / secs,
+           st->rbytes / secs / 1e6, st->writes, st->writes / secs,
+           st->wbytes / secs / 1e6);
+    if (st->written)
+        printf("%s: stress %" PRId64 " blocks read back checked against "
+               "their stamp, %" PRId64 " not it\n", dp->device_name,
+               st->verified, st->miscompared);
+    pthread_mutex_unlock(&out_mutex);
+    print_latency(dp, "stress", "READ", &st->rlat);
+    print_latency(dp, "stress", "WRITE", &st->wlat);
+    if (jsonl_enabled())
+    {
+        char name[PATH_MAX], rbuf[256], wbuf[256];
+
+        jsonl_printf("{\"type\":\"stress\",\"device\":\"%s\",\"pass\":%u,"
+                     "\"seconds\":%.3f,\"qd\":%d,\"reads\":%" PRId64
+                     ",\"read_iops\":%.1f,\"writes\":%" PRId64
+                     ",\"write_iops\":%.1f,\"verified\":%" PRId64
+                     ",\"miscompared\":%" PRId64 ",\"read\":{%s},"
+                     "\"write\":{%s}}",
+                     jsonl_escape(name, sizeof(name), dp->device_name),
+                     pat->pass, secs, nthr, st->reads, st->reads / secs,
+                     st->writes, st->writes / secs, st->verified,
+                     st->miscompared,
+                     json_latency(&st->rlat, rbuf, sizeof(rbuf)),
+                     json_latency(&st->wlat, wbuf, sizeof(wbuf)));
+    }
+    res = st->res;
+    if ((0 == res) && st->writes && write_flush(dp))
+        res = SG_LIB_CAT_OTHER;
+    free(st->written);
+    free(st);
+    return res;
+}
+
+/* One pass over [dp->from, dp->end) one command at a time, sg_read()
+ * or direct_read() into dp->rd_data: devices no queued backend takes,
+ * --mmap and the sg driver on a block device. */
+static int
+read_pass_sync(t_dev *dp, const t_pattern *pat)
+{
+    int64_t seek = dp->from;
+    int blocks, blks_readp, buf_sz, blocks_per, res = 0;
+    uint64_t t_ns, wait;
+    bool diop;
+
+    while (seek < dp->end)
+    {
+        blocks = dp->sync_blocks;
+        if (!range_next(dp, &seek, &blocks))
+            break;
+        while ((wait = throttle_ns(dp, (int64_t)blocks * dp->blk_sz)))
+            throttle_sleep(wait);
+        if ((FT_SG | FT_SIM) & dp->out_type)
+        {
+            prefetch_ahead(dp, seek + blocks, blocks);
+            diop = dp->flags.dio;
+            blks_readp = 0;
+            t_ns = lat_now_ns();
+            res = sg_read(dp, dp->rd_data, blocks, seek, &diop, &blks_readp);
+            t_ns = lat_now_ns() - t_ns;
+            lat_done(dp, seek, blocks, t_ns);
+            io_trace(dp, TRACE_READ, seek, blocks, t_ns, 1, res);
+            verify_chunk(dp, dp->rd_data, pat, seek, blocks);
+            /* ENOMEM, find what's available and try that */
+            if ((-2 == res) &&
+                (ioctl(dp->fd, SG_GET_RESERVED_SIZE, &buf_sz) < 0))
+                perror("RESERVED_SIZE ioctls failed");
+            else if (-2 == res)
+            {
+                if (buf_sz < MIN_RESERVED_SIZE)
+                    buf_sz = MIN_RESERVED_SIZE;
+                blocks_per = (buf_sz + dp->blk_sz - 1) / dp->blk_sz;
+                if (blocks_per < blocks)
+                {
+                    blocks = dp->sync_blocks = blocks_per;
+                    pr2serr("Reducing read to %d blocks per loop\n",
+                            blocks_per);
+                    res = sg_read(dp, dp->rd_data, blocks, seek, &diop,
+                                  &blks_readp);
+                }
+            }
+            if (0 == res)
+            {
+                CTR_ADD(dp, in_full, blks_readp);
+                __atomic_store_n(&dp->bytes_done, dp->bytes_done +
+                                     (int64_t)blks_readp * dp->blk_sz,
+                                 __ATOMIC_RELAXED);
+            }
+            else
+                pr2serr("sg_read failed,%s at or after lba=%" PRId64 " [0x%"
+                        PRIx64 "]\n", ((-2 == res) ? " try reducing bpt," : ""),
+                        seek, seek);
+        }
+        else if ((FT_BLOCK | FT_NVME) & dp->out_type)
+        {
+            t_ns = lat_now_ns();
+            res = direct_read(dp, dp->rd_data, blocks, seek);
+            t_ns = lat_now_ns() - t_ns;
+            lat_done(dp, seek, blocks, t_ns);
+            io_trace(dp, TRACE_READ, seek, blocks, t_ns, 1, res);
+            if (0 == res)
+            {
+                verify_chunk(dp, dp->rd_data, pat, seek, blocks);
+                CTR_ADD(dp, in_full, blocks);
+                __atomic_store_n(&dp->bytes_done, dp->bytes_done +
+                                     (int64_t)blocks * dp->blk_sz,
+                                 __ATOMIC_RELAXED);
+            }
+        }
+        seek += blocks;
+        __atomic_store_n(&dp->cur_lba, seek, __ATOMIC_RELAXED);
+    }
+    return res;
+}
+
+typedef int (*t_engine)(t_dev *dp, const t_pattern *pat);
+
+#define BE_QUEUED 0x1 /* keeps up to dp->qd commands in flight */
+#define BE_CANCEL 0x2 /* a command past the --deadline can be aborted */
+#define BE_SENSE 0x4  /* a failed READ comes back with SCSI sense */
+
+/* A way of reading a device a pass at a time, what the read passes of
+ * read_verify_device() and --triage are written against. Each pass
+ * function is its own submit and complete loop, the pattern checks and
+ * counters direct calls in it the compiler inlines; the one indirect
+ * call is the pass. */
+struct _backend
+{
+    const char *name;
+    unsigned int caps;                /* BE_* */
+    bool (*usable)(const t_dev *dp); /* for this device, now */
+    t_engine pass;
+};
+
+typedef struct _backend t_backend;
+
+static bool
+be_mrq_ok(const t_dev *dp)
+{
+    return dp->mrq && (FT_SG & dp->out_type) && (dp->npaths < 2) &&
+           (dp->nact < 2);
+}
+
+static bool
+be_spdk_ok(const t_dev *dp)
+{
+    return NULL != dp->spdk;
+}
+
+static bool
+be_uring_ok(const t_dev *dp)
+{
+    return ((FT_BLOCK | FT_NVME) & dp->out_type) &&
+           !(FT_SG & dp->out_type) && dp->uring;
+}
+
+static bool
+be_event_ok(const t_dev *dp)
+{
+    return opt.event_threads && (FT_SG & dp->out_type) &&
+           !(FT_BLOCK & dp->out_type) && !dp->mmap_buf && (dp->npaths < 2);
+}
+
+static bool
+be_async_ok(const t_dev *dp)
+{
+    return ((FT_SG | FT_SIM) & dp->out_type) && !(FT_BLOCK & dp->out_type) &&
+           !dp->mmap_buf;
+}
+
+static bool
+be_sync_ok(const t_dev *dp)
+{
+    return ((FT_SG | FT_BLOCK | FT_NVME | FT_SIM) & dp->out_type);
+}
+
+/* In the order they are tried, the first usable one reads the pass */
+static const t_backend backends[] = {
+    {"sg-mrq", BE_QUEUED | BE_SENSE, be_mrq_ok, read_pass_mrq},
+    {"spdk", BE_QUEUED, be_spdk_ok, read_pass_spdk},
+    {"io_uring", BE_QUEUED, be_uring_ok, read_pass_uring},
+    {"sg-event", BE_QUEUED | BE_CANCEL | BE_SENSE, be_event_ok,
+     read_pass_event},
+    {"sg-async", BE_QUEUED | BE_CANCEL | BE_SENSE, be_async_ok,
+     read_pass_async},
+    {"sync", BE_SENSE, be_sync_ok, read_pass_sync},
+};
+
+/* The first backend that can read dp and has every capability of caps
+ * (BE_*), NULL when none; with caps 0 never NULL, the last one reads
+ * what the others do not. */
+static const t_backend *
+backend_select(const t_dev *dp, unsigned int caps)
+{
+    size_t k;
+
+    for (k = 0; k < sizeof(backends) / sizeof(backends[0]); ++k)
+        if ((caps == (backends[k].caps & caps)) && backends[k].usable(dp))
+            return backends + k;
+    return caps ? NULL : backends + k - 1;
+}
+
+/* The engine that keeps READs queued on dp, NULL when the device is
+ * read one command at a time. */
+static t_engine
+queued_engine(t_dev *dp)
+{
+    const t_backend *be = backend_select(dp, BE_QUEUED);
+
+    return be ? be->pass : NULL;
+}
+
+/* --bench: the buffers of a run, an io mode apart from the backend */
+#define BENCH_IO_BUF 0  /* indirect sg, O_DIRECT block, memory sim */
+#define BENCH_IO_DIO 1  /* sg --dio */
+#define BENCH_IO_MMAP 2 /* sg --mmap, one reserved buffer: sync only */
+
+static double
+cpu_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *
+bench_io_str(const t_dev *dp, int io)
+{
+    if (BENCH_IO_DIO == io)
+        return "dio";
+    if (BENCH_IO_MMAP == io)
+        return "mmap";
+    if (FT_SIM & dp->out_type)
+        return "memory";
+    return (FT_SG & dp->out_type) ? "indirect" : "direct";
+}
+
+/* --bench: one run, the window [dp->start, dp->end) read by be as dp is
+ * set up, its line of the table and its JSON record. The CPU time is
+ * the process's, so it is only that of the run with one device. Returns
+ * the MB/s, 0 when a READ failed or a block miscompared. */
+static double
+bench_run(t_dev *dp, const t_backend *be, int io, const t_pattern *pat)
+{
+    int64_t bytes = (dp->end - dp->start) * dp->blk_sz;
+    int64_t mis0 = dp->mismatches, mis;
+    double t0, c0, secs, cpu_gb, mbps, iops;
+    char p50[16], p99[16], p999[16];
+    int res;
+
+    lat_reset(&dp->lat_pass);
+    dp->from = dp->pf_lba = dp->start;
+    dp->sync_blocks = dp->bpt;
+    c0 = cpu_secs();
+    t0 = mono_secs();
+    res = be->pass(dp, pat);
+    secs = mono_secs() - t0;
+    cpu_gb = (cpu_secs() - c0) / (bytes / 1e9);
+    if (secs <= 0)
+        secs = 1e-9;
+    mis = dp->mismatches - mis0;
+    mbps = bytes / secs / 1e6;
+    iops = dp->lat_pass.count / secs;
+    pthread_mutex_lock(&out_mutex);
+    printf("%-9s %8d %3d %-8s %-5s %9.1f %8.0f %8s %8s %8s %8.3f%s\n",
+           be->name, dp->bpt * dp->blk_sz, dp->qd, bench_io_str(dp, io),
+           pat ? "yes" : "no", mbps, iops,
+           lat_str(lat_percentile(&dp->lat_pass, 50.0), p50, sizeof(p50)),
+           lat_str(lat_percentile(&dp->lat_pass, 99.0), p99, sizeof(p99)),
+           lat_str(lat_percentile(&dp->lat_pass, 99.9), p999, sizeof(p999)),
+           cpu_gb, res ? "  errors" : mis ? "  miscompares" : "");
+    pthread_mutex_unlock(&out_mutex);
+    if (jsonl_enabled())
+    {
+        char name[PATH_MAX], lbuf[256];
+
+        jsonl_printf("{\"type\":\"bench\",\"device\":\"%s\",\"engine\":\"%s\","
+                     "\"bytes\":%d,\"qd\":%d,\"io\":\"%s\",\"check\":%s,"
+                     "\"result\":%d,\"miscompares\":%" PRId64 ",\"seconds\":"
+                     "%.3f,\"mb_s\":%.1f,\"iops\":%.1f,\"cpu_s_per_gb\":%.4f,"
+                     "%s}",
+                     jsonl_escape(name, sizeof(name), dp->device_name),
+                     be->name, dp->bpt * dp->blk_sz, dp->qd,
+                     bench_io_str(dp, io), pat ? "true" : "false", res, mis,
+                     secs, mbps, iops, cpu_gb,
+                     json_latency(&dp->lat_pass, lbuf, sizeof(lbuf)));
+    }
+    return (res || mis) ? 0.0 : mbps;
+}
+
+/* --bench: instead of the passes, the matrix of every backend that can
+ * read dp (backends[], so --mrq and --event-threads add theirs) by
+ * transfer size, TUNE_MIN_BYTES times 4 up to the device limit, queue
+ * depth, 1 times BENCH_QD_STEP up to MAX_QUEUE_DEPTH where the backend
+ * queues, the sg buffer modes and the first pattern checked or not.
+ * Each run reads opt.bench bytes of its own, in turn over [start, end),
+ * so a drive cache does not flatter the later ones; the bad map and
+ * counters of a scan are not kept. Returns 0, else the SG_LIB_* error
+ * of the last setting that could not be run. */
+static int
+bench_device(t_dev *dp)
+{
+    int64_t save_start = dp->start, save_end = dp->end;
+    int64_t span = dp->end - dp->start, window, lba;
+    int save_bpt = dp->bpt, save_qd = dp->qd;
+    struct flags_t save_flags = dp->flags;
+    int max_bytes, opt_bytes, bytes, qd, io, chk, n = 0, res = 0;
+    int best_bpt = 0, best_qd = 0, best_io = 0, ios;
+    const t_backend *be, *best_be = NULL;
+    uint8_t *buf, *free_buf;
+    double best = 0.0, mbps;
+    size_t k;
+    bool sg = (FT_SG & dp->out_type) && !(FT_BLOCK & dp->out_type);
+
+    tune_limits(dp, &max_bytes, &opt_bytes);
+    if ((0 == max_bytes) || (max_bytes > TUNE_MAX_BYTES))
+        max_bytes = TUNE_MAX_BYTES;
+    if (FT_NVME & dp->out_type)
+        max_bytes = 1024 * 1024; /* MDTS is not known, as for --tune */
+    window = opt.bench / dp->blk_sz;
+    if (window > span)
+        window = span;
+    if (window <= 0)
+        return 0;
+    buf = io_buf(dp, max_bytes + BYTES_PER_ELEMENT, &free_buf);
+    if (NULL == buf)
+    {
+        pr2serr("%s: --bench has no memory for a %d byte buffer\n",
+                dp->device_name, max_bytes);
+        return SG_LIB_CAT_OTHER;
+    }
+    dp->tuning = true;
+    dp->prefetch = false;
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: bench, %" PRId64 " bytes a run\n", dp->device_name,
+           window * dp->blk_sz);
+    printf("engine       bytes  qd io       check      MB/s     IOPS      p50"
+           "      p99    p99.9 CPU s/GB\n");
+    pthread_mutex_unlock(&out_mutex);
+    ios = sg ? BENCH_IO_MMAP : BENCH_IO_BUF;
+    for (k = 0; k < sizeof(backends) / sizeof(backends[0]); ++k)
+    {
+        be = backends + k;
+        if (!be->usable(dp))
+            continue;
+        for (bytes = TUNE_MIN_BYTES; bytes <= max_bytes; bytes *= 4)
+        {
+            if (bytes < dp->blk_sz)
+                continue;
+            for (qd = 1; qd <= MAX_QUEUE_DEPTH; qd *= BENCH_QD_STEP)
+            {
+                if ((qd > 1) && !(BE_QUEUED & be->caps))
+                    break;
+                for (io = BENCH_IO_BUF; io <= ios; ++io)
+                {
+                    if ((BENCH_IO_MMAP == io) && (BE_QUEUED & be->caps))
+                        break;
+                    for (chk = 0; chk < 2; ++chk)
+                    {
+                        if (dp->cancelled)
+                            goto done;
+                        lba = (span >= (n + 1) * window) ? n * window : 0;
+                        ++n;
+                        dp->start = save_start + lba;
+                        dp->end = dp->start + window;
+                        dp->bpt = bytes / dp->blk_sz;
+                        dp->qd = qd;
+                        dp->flags.dio = (BENCH_IO_DIO == io);
+                        if ((BENCH_IO_MMAP == io) && sg_mmap_setup(dp))
+                        {
+                            res = SG_LIB_CAT_OTHER;
+                            break;
+                        }
+                        dp->rd_data = dp->mmap_buf ? dp->mmap_buf : buf;
+                        mbps = bench_run(dp, be, io, chk ? patterns : NULL);
+                        if (dp->mmap_buf)
+                        {
+                            munmap(dp->mmap_buf, dp->mmap_len);
+                            dp->mmap_buf = NULL;
+                        }
+                        if (!chk && (mbps > best * 1.03))
+                        {
+                            best = mbps;
+                            best_be = be;
+                            best_bpt = dp->bpt;
+                            best_qd = qd;
+                            best_io = io;
+                        }
+                    }
+                }
+            }
+        }
+    }
+done:
+    iobuf_free(free_buf);
+    dp->rd_data = NULL;
+    dp->tuning = false;
+    dp->start = save_start;
+    dp->end = save_end;
+    dp->bpt = save_bpt;
+    dp->qd = save_qd;
+    dp->flags = save_flags;
+    if (best_be)
+    {
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: bench fastest %s -n %d --qd %d%s%s, %.1f MB/s\n",
+               dp->device_name, best_be->name, best_bpt, best_qd,
+               (BENCH_IO_DIO == best_io) ? " --dio" : "",
+               (BENCH_IO_MMAP == best_io) ? " --mmap" : "", best);
+        pthread_mutex_unlock(&out_mutex);
+    }
+    return res;
+}
+/* --seek-probe: how its commands reach the media, */
+#define SEEK_IO_VERIFY 0 /* VERIFY(16) BYTCHK=0 */
+#define SEEK_IO_READ 1   /* READ(16) FUA, SG_FLAG_NO_DXFER */
+#define SEEK_IO_NVME 2   /* NVMe Verify */
+
+typedef struct _seek
+{
+    t_dev *dp;
+    int io;        /* SEEK_IO_* */
+    bool settled;  /* a command of io has gone through */
+    uint64_t seed; /* of rand_pattern_key() */
+    unsigned int n;
+    int64_t errors;
+} t_seek;
+
+static const char *const seek_io_str[] = {"VERIFY(16)", "READ(16) no data",
+                                           "NVMe Verify"};
+
+/* One block at lba, reaching the media with nothing moved to the host.
+ * Returns 0, else the SG_LIB_CAT_* of the failure, SG_LIB_CAT_INVALID_OP
+ * when the first command of its kind is refused; -1 on errors of the
+ * ioctl. */
+static int
+seek_cmd(t_seek *sk, int64_t lba)
+{
+    t_dev *dp = sk->dp;
+    uint8_t cdb[16], sb[SENSE_BUFF_LEN];
+    struct sg_io_hdr hdr;
+    int res;
+
+    if (SEEK_IO_NVME == sk->io)
+    {
+        struct nvme_passthru_cmd64 cmd;
+        uint32_t cdw[3];
+
+        memset(&cmd, 0, sizeof(cmd));
+        nvme_range_cdw(dp, NVME_OP_VERIFY, lba, 1, cdw);
+        cmd.opcode = NVME_OP_VERIFY;
+        cmd.nsid = dp->nsid;
+        cmd.cdw10 = cdw[0];
+        cmd.cdw11 = cdw[1];
+        cmd.cdw12 = cdw[2];
+        res = nvme_io(dp, &cmd);
+        if (res < 0)
+            return -1;
+        if (!sk->settled && ((1 == res) || (2 == res)))
+            return SG_LIB_CAT_INVALID_OP;
+        return res ? SG_LIB_CAT_MEDIUM_HARD : 0;
+    }
+    memset(cdb, 0, sizeof(cdb));
+    memset(&hdr, 0, sizeof(hdr));
+    cdb[0] = (SEEK_IO_VERIFY == sk->io) ? 0x8f : 0x88;
+    if (SEEK_IO_READ == sk->io)
+        cdb[1] = 0x08; /* FUA, from the medium */
+    sg_put_unaligned_be64((uint64_t)lba, cdb + 2);
+    sg_put_unaligned_be32(1, cdb + 10);
+    hdr.interface_id = 'S';
+    hdr.cmd_len = sizeof(cdb);
+    hdr.cmdp = cdb;
+    hdr.mx_sb_len = sizeof(sb);
+    hdr.sbp = sb;
+    hdr.timeout = dp->timeout_ms;
+    hdr.dxfer_direction = SG_DXFER_NONE;
+    if (SEEK_IO_READ == sk->io)
+    {
+        hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+        hdr.dxfer_len = dp->blk_sz;
+        hdr.flags = SG_FLAG_NO_DXFER;
+    }
+    while (((res = (dp->sim ? sim_io(dp->sim, &hdr)
+                            : ioctl(dp->fd, SG_IO, &hdr))) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno)))
+        ;
+    if (res < 0)
+        return -1;
+    res = sg_err_category3(&hdr);
+    if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res) ||
+        (SG_LIB_CAT_CONDITION_MET == res))
+        return 0;
+    if (!sk->settled && (SG_LIB_CAT_ILLEGAL_REQ == res))
+        res = SG_LIB_CAT_INVALID_OP;
+    return res;
+}
+
+/* seek_cmd() of lba timed: its ns, 0 when it failed. A VERIFY the drive
+ * refuses gives way to a READ without the data. */
+static uint64_t
+seek_timed(t_seek *sk, int64_t lba)
+{
+    uint64_t t0;
+    int res;
+
+    for (;;)
+    {
+        t0 = lat_now_ns();
+        res = seek_cmd(sk, lba);
+        t0 = lat_now_ns() - t0;
+        if ((SG_LIB_CAT_INVALID_OP == res) && (SEEK_IO_VERIFY == sk->io))
+        {
+            sk->io = SEEK_IO_READ;
+            continue;
+        }
+        break;
+    }
+    if (res)
+    {
+        ++sk->errors;
+        return 0;
+    }
+    sk->settled = true;
+    return t0 ? t0 : 1;
+}
+
+/* One line of the --seek-probe table, of h and the fastest command, and
+ * its JSON record; with hist the histogram of h under it, SEEK_HIST_BINS
+ * even bins from the fastest to the slowest. */
+static void
+seek_line(const t_seek *sk, const char *kind, int64_t dist,
+          const struct lat_hist *h, uint64_t min, bool hist)
+{
+    t_dev *dp = sk->dp;
+    char b[6][16], col[24], counts[SEEK_HIST_BINS * 12];
+    uint64_t step, le, prev = 0, c, top = 0;
+    uint64_t bin[SEEK_HIST_BINS];
+    int k, n = 0;
+
+    if (0 == h->count)
+        return;
+    if (dist >= 0)
+        snprintf(col, sizeof(col), "%" PRId64, dist);
+    else
+        snprintf(col, sizeof(col), "%s", kind);
+    step = (h->max - min) / SEEK_HIST_BINS + 1;
+    for (k = 0; k < SEEK_HIST_BINS; ++k)
+    {
+        le = lat_count_le(h, min + (k + 1) * step);
+        bin[k] = (le > prev) ? le - prev : 0;
+        prev = (le > prev) ? le : prev;
+        if (bin[k] > top)
+            top = bin[k];
+        n += snprintf(counts + n, sizeof(counts) - n, "%s%" PRIu64,
+                      k ? "," : "", bin[k]);
+    }
+    pthread_mutex_lock(&out_mutex);
+    printf("%-12s %8" PRIu64 " %8s %8s %8s %8s %8s %8s\n", col, h->count,
+           lat_str(min, b[0], sizeof(b[0])),
+           lat_str(lat_percentile(h, 50.0), b[1], sizeof(b[1])),
+           lat_str(h->sum / h->count, b[2], sizeof(b[2])),
+           lat_str(lat_percentile(h, 99.0), b[3], sizeof(b[3])),
+           lat_str(lat_percentile(h, 99.9), b[4], sizeof(b[4])),
+           lat_str(h->max, b[5], sizeof(b[5])));
+    for (k = 0; hist && (k < SEEK_HIST_BINS); ++k)
+    {
+        c = top ? (bin[k] * 50 + top - 1) / top : 0;
+        printf("  <= %8s %8" PRIu64 "%s%.*s\n",
+               lat_str(min + (k + 1) * step, b[0], sizeof(b[0])), bin[k],
+               c ? " " : "", (int)c,
+               "##################################################");
+    }
+    pthread_mutex_unlock(&out_mutex);
+    if (jsonl_enabled())
+    {
+        char name[PATH_MAX], lbuf[256];
+
+        jsonl_printf("{\"type\":\"seek\",\"device\":\"%s\",\"kind\":\"%s\","
+                     "\"distance\":%" PRId64 ",\"io\":\"%s\",\"min_us\":%.1f,"
+                     "\"mean_us\":%.1f,%s,\"hist_min_us\":%.3f,"
+                     "\"hist_step_us\":%.3f,\"hist\":[%s]}",
+                     jsonl_escape(name, sizeof(name), dp->device_name), kind,
+                     dist, seek_io_str[sk->io], min / 1e3,
+                     h->sum / 1e3 / h->count,
+                     json_latency(h, lbuf, sizeof(lbuf)), min / 1e3,
+                     step / 1e3, counts);
+    }
+}
+
+/* --seek-probe: instead of the passes, the access time of the media
+ * alone, one block a command with no data moved to the host, at one
+ * command at a time over [start, end). random takes lbas at random by
+ * --seed, stride=b every b blocks (0 the same block, a revolution a
+ * command), each a line with its histogram; sweep times a seek of
+ * 1, 2, 4 .. blocks to the span, each from a random place and after a
+ * command there, a line of the seek curve each. Returns 0, else the
+ * SG_LIB_* error of a device that takes none of the commands. */
+static int
+seek_device(t_dev *dp)
+{
+    int64_t span = dp->end - dp->start, lba = dp->start, d;
+    struct lat_hist *h = (struct lat_hist *)calloc(1, sizeof(*h));
+    const char *kind = (SEEK_RANDOM == opt.seek)   ? "random"
+                       : (SEEK_STRIDE == opt.seek) ? "stride"
+                                                   : "sweep";
+    uint64_t ns, min, r;
+    t_seek sk;
+    int k;
+
+    if (NULL == h)
+        return SG_LIB_CAT_OTHER;
+    memset(&sk, 0, sizeof(sk));
+    sk.dp = dp;
+    sk.seed = opt.seed ^ SEEK_SALT;
+    if (FT_NVME & dp->out_type)
+        sk.io = SEEK_IO_NVME;
+    else if (!((FT_SG | FT_SIM) & dp->out_type))
+    {
+        pr2serr("%s: --seek-probe needs SCSI VERIFY or READ, or NVMe "
+                "Verify\n", dp->device_name);
+        free(h);
+        return SG_LIB_CAT_OTHER;
+    }
+    if ((FT_NVME & dp->out_type) && !(NVME_ONCS_VERIFY & dp->nvme_oncs))
+    {
+        pr2serr("%s: controller has no NVMe Verify (ONCS), --seek-probe "
+                "needs it\n", dp->device_name);
+        free(h);
+        return SG_LIB_CAT_INVALID_OP;
+    }
+    if (span <= 0)
+    {
+        free(h);
+        return 0;
+    }
+    /* the first command: that it goes, and where it leaves the head */
+    if ((0 == seek_timed(&sk, dp->start)) && !sk.settled)
+    {
+        pr2serr("%s: --seek-probe: the device takes neither VERIFY(16) "
+                "nor READ(16)\n", dp->device_name);
+        free(h);
+        return SG_LIB_CAT_INVALID_OP;
+    }
+    dp->tuning = true;
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: seek probe %s, %s of 1 block, %d commands a line\n",
+           dp->device_name, kind, seek_io_str[sk.io], opt.seek_cmds);
+    printf("%-12s %8s %8s %8s %8s %8s %8s %8s\n",
+           (SEEK_SWEEP == opt.seek) ? "distance" : "pattern", "cmds", "min",
+           "p50", "mean", "p99", "p99.9", "max");
+    pthread_mutex_unlock(&out_mutex);
+    if (SEEK_SWEEP != opt.seek)
+    {
+        min = UINT64_MAX;
+        for (k = 0; (k < opt.seek_cmds) && !dp->cancelled; ++k)
+        {
+            if (SEEK_RANDOM == opt.seek)
+                lba = dp->start + (int64_t)(rand_pattern_key(sk.seed, sk.n++) %
+                                            (uint64_t)span);
+            else
+                lba = dp->start + (lba - dp->start + opt.seek_stride) % span;
+            __atomic_store_n(&dp->cur_lba, lba, __ATOMIC_RELAXED);
+            ns = seek_timed(&sk, lba);
+            if (0 == ns)
+                continue;
+            lat_record(h, ns);
+            if (ns < min)
+                min = ns;
+        }
+        seek_line(&sk, kind, -1, h, min, true);
+    }
+    for (d = 1; (SEEK_SWEEP == opt.seek) && (d < span) && !dp->cancelled;
+         d *= 2)
+    {
+        lat_reset(h);
+        min = UINT64_MAX;
+        for (k = 0; (k < opt.seek_cmds) && !dp->cancelled; ++k)
+        {
+            r = rand_pattern_key(sk.seed, sk.n++);
+            lba = dp->start + (int64_t)(r % (uint64_t)(span - d));
+            if (0 == seek_timed(&sk, (r >> 63) ? lba + d : lba))
+                continue;
+            __atomic_store_n(&dp->cur_lba, lba, __ATOMIC_RELAXED);
+            ns = seek_timed(&sk, (r >> 63) ? lba : lba + d);
+            if (0 == ns)
+                continue;
+            lat_record(h, ns);
+            if (ns < min)
+                min = ns;
+        }
+        seek_line(&sk, kind, d, h, min, false);
+    }
+    dp->tuning = false;
+    if (sk.errors)
+    {
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: %" PRId64 " seek probe commands failed, not timed\n",
+               dp->device_name, sk.errors);
+        pthread_mutex_unlock(&out_mutex);
+    }
+    free(h);
+    return 0;
+}
+/* --cache-probe: one measurement of it, over READs timed one at a time */
+typedef struct _cprobe
+{
+    t_dev *dp;
+    uint8_t *buf;
+    struct lat_hist *h;
+    uint64_t seed; /* of rand_pattern_key() */
+    unsigned int n;
+    int64_t errors;
+} t_cprobe;
+
+/* One READ of blocks at lba, through the drive's cache: its ns, 0 when
+ * it failed. */
+static uint64_t
+cache_timed(t_cprobe *cp, int64_t lba, int blocks)
+{
+    t_dev *dp = cp->dp;
+    bool diop = false;
+    int blks_read = 0, res;
+    uint64_t ns = lat_now_ns();
+
+    if ((FT_SG | FT_SIM) & dp->out_type)
+        res = sg_read(dp, cp->buf, blocks, lba, &diop, &blks_read);
+    else
+        res = direct_read(dp, cp->buf, blocks, lba);
+    ns = lat_now_ns() - ns;
+    if (res)
+    {
+        ++cp->errors;
+        return 0;
+    }
+    return ns ? ns : 1;
+}
+
+/* A random lba of [start, end - len), aligned to align blocks. */
+static int64_t
+cache_place(t_cprobe *cp, int64_t len, int align)
+{
+    int64_t slots = (cp->dp->end - cp->dp->start - len) / align;
+
+    if (slots <= 0)
+        return cp->dp->start;
+    return cp->dp->start +
+           (int64_t)(rand_pattern_key(cp->seed, cp->n++) % (uint64_t)slots) *
+               align;
+}
+
+/* The p50 of CACHE_SAMPLES READs of blocks: with step 0 at random in
+ * [base, base + len), else step blocks apart from base, after an untimed
+ * one at base that starts the stream. 0 when none went. */
+static uint64_t
+cache_p50(t_cprobe *cp, int64_t base, int64_t len, int64_t step, int blocks)
+{
+    int64_t lba, slots = len / blocks;
+    uint64_t ns;
+    int k;
+
+    lat_reset(cp->h);
+    for (k = step ? -1 : 0; (k < CACHE_SAMPLES) && !cp->dp->cancelled; ++k)
+    {
+        if (step)
+            lba = base + (k + 1) * step;
+        else
+            lba = base + (int64_t)(rand_pattern_key(cp->seed, cp->n++) %
+                                   (uint64_t)(slots ? slots : 1)) * blocks;
+        if (lba + blocks > cp->dp->end)
+            break;
+        ns = cache_timed(cp, lba, blocks);
+        if (ns && (k >= 0))
+            lat_record(cp->h, ns);
+    }
+    return lat_percentile(cp->h, 50.0);
+}
+
+/* --cache-probe: instead of the passes, the drive's read cache and its
+ * read-ahead, from READs one at a time that the cache may serve. READs
+ * of CACHE_IO_BYTES at random anywhere give the media time; a working
+ * set of 256 KiB, doubling up to CACHE_MAX_BYTES, is read through once
+ * and then at random, and cached while its p50 stays under half the
+ * media's: the largest one is the effective cache. Small READs one
+ * after the other, then ever further apart, that stay under half the
+ * time of small ones at random are served by read-ahead. The results
+ * go to the profile of the model, and a note on whether the -n, --qd
+ * and range of a pass measure the media or the cache. Returns 0, else
+ * the SG_LIB_* error when it could not run. */
+static int
+cache_device(t_dev *dp)
+{
+    int64_t span = dp->end - dp->start, w, s, base, lba;
+    int io = CACHE_IO_BYTES / dp->blk_sz, small = CACHE_SMALL_BYTES / dp->blk_sz;
+    int warm = dp->bpt, misses = 0, cache_kib = -1, ra_kib = -1, n;
+    uint64_t media, rnd, p;
+    uint8_t *free_buf;
+    char b[3][16], name[PATH_MAX];
+    struct profile prof;
+    t_cprobe cp;
+
+    if (io < 1)
+        io = 1;
+    if (small < 1)
+        small = 1;
+    if (warm < io)
+        warm = io;
+    memset(&cp, 0, sizeof(cp));
+    cp.dp = dp;
+    cp.seed = opt.seed ^ CACHE_SALT;
+    cp.h = (struct lat_hist *)calloc(1, sizeof(*cp.h));
+    cp.buf = io_buf(dp, warm * dp->blk_sz, &free_buf);
+    if ((NULL == cp.h) || (NULL == cp.buf))
+    {
+        pr2serr("%s: --cache-probe has no memory for its buffers\n",
+                dp->device_name);
+        free(cp.h);
+        if (cp.buf)
+            iobuf_free(free_buf);
+        return SG_LIB_CAT_OTHER;
+    }
+    dp->tuning = true;
+    dp->prefetch = false;
+    media = cache_p50(&cp, dp->start, span, 0, io);
+    rnd = cache_p50(&cp, dp->start, span, 0, small);
+    if ((0 == media) || (0 == rnd))
+    {
+        pr2serr("%s: --cache-probe: READs at random failed\n",
+                dp->device_name);
+        dp->tuning = false;
+        free(cp.h);
+        iobuf_free(free_buf);
+        return SG_LIB_CAT_OTHER;
+    }
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: cache probe, media p50 %s for %d KiB, %s for %d KiB READs\n",
+           dp->device_name, lat_str(media, b[0], sizeof(b[0])),
+           io * dp->blk_sz / 1024, lat_str(rnd, b[1], sizeof(b[1])),
+           small * dp->blk_sz / 1024);
+    printf("working set     p50 re-read\n");
+    pthread_mutex_unlock(&out_mutex);
+    for (w = CACHE_MIN_BYTES / dp->blk_sz;
+         ((w * dp->blk_sz) <= CACHE_MAX_BYTES) && (w <= span / 2) &&
+         !dp->cancelled;
+         w *= 2)
+    {
+        base = cache_place(&cp, w, io);
+        for (lba = base; (lba < base + w) && !dp->cancelled; lba += n)
+        {
+            n = (base + w - lba < warm) ? (int)(base + w - lba) : warm;
+            cache_timed(&cp, lba, n);
+        }
+        p = cache_p50(&cp, base, w, 0, io);
+        pthread_mutex_lock(&out_mutex);
+        printf("%8" PRId64 " KiB %8s %s\n", w * dp->blk_sz / 1024,
+               lat_str(p, b[0], sizeof(b[0])),
+               (p && (p * 2 < media)) ? "cache" : "media");
+        pthread_mutex_unlock(&out_mutex);
+        if (p && (p * 2 < media))
+        {
+            cache_kib = (int)(w * dp->blk_sz / 1024);
+            misses = 0;
+        }
+        else if (++misses >= 2)
+            break;
+    }
+    pthread_mutex_lock(&out_mutex);
+    printf("small READs apart  p50\n");
+    pthread_mutex_unlock(&out_mutex);
+    for (s = small; ((CACHE_SAMPLES + 1) * s <= span) &&
+                    (s * dp->blk_sz <= CACHE_RA_MAX) && !dp->cancelled;
+         s *= 2)
+    {
+        base = cache_place(&cp, (CACHE_SAMPLES + 1) * s, small);
+        p = cache_p50(&cp, base, 0, s, small);
+        pthread_mutex_lock(&out_mutex);
+        printf("%8" PRId64 " KiB %8s %s\n", s * dp->blk_sz / 1024,
+               lat_str(p, b[0], sizeof(b[0])),
+               (p && (p * 2 < rnd)) ? "read-ahead" : "media");
+        pthread_mutex_unlock(&out_mutex);
+        if (!p || (p * 2 >= rnd))
+            break;
+        ra_kib = (int)(s * dp->blk_sz / 1024);
+    }
+    dp->tuning = false;
+    free(cp.h);
+    iobuf_free(free_buf);
+    if (dp->cancelled)
+        return 0;
+    n = dp->bpt * dp->blk_sz / 1024;
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: read cache ", dp->device_name);
+    if (cache_kib > 0)
+        printf("%s%d KiB", (cache_kib * 1024LL >= CACHE_MAX_BYTES) ? ">= " : "",
+               cache_kib);
+    else
+        printf("none seen");
+    if (ra_kib > 0)
+        printf(", read-ahead over strides of up to %d KiB\n", ra_kib);
+    else
+        printf(", no read-ahead\n");
+    if ((cache_kib > 0) && ((span * dp->blk_sz / 1024) <= cache_kib))
+        printf("%s: the range fits the cache, passes after the first time "
+               "the cache, not the media\n", dp->device_name);
+    if (ra_kib > 0)
+        printf("%s: -n %d --qd %d, READs of %d KiB: %s\n", dp->device_name,
+               dp->bpt, dp->qd, n,
+               (n <= ra_kib) ? "served from read-ahead, their latency is "
+                               "the cache's and only the throughput the "
+                               "media's"
+                             : "each past the read-ahead, timing the media");
+    if (cp.errors)
+        printf("%s: %" PRId64 " READs failed, not timed\n", dp->device_name,
+               cp.errors);
+    pthread_mutex_unlock(&out_mutex);
+    if (jsonl_enabled())
+        jsonl_printf("{\"type\":\"cache\",\"device\":\"%s\",\"media_p50_us\":"
+                     "%.1f,\"small_p50_us\":%.1f,\"cache_kib\":%d,"
+                     "\"read_ahead_kib\":%d,\"errors\":%" PRId64 "}",
+                     jsonl_escape(name, sizeof(name), dp->device_name),
+                     media / 1e3, rnd / 1e3, cache_kib, ra_kib, cp.errors);
+    if ('\0' == dp->model_key[0])
+        return 0;
+    if (profile_load(opt.profile_path, dp->model_key, &prof))
+        memset(&prof, 0, sizeof(prof)); /* not tuned, bpt and qd 0 */
+    prof.cache_kib = cache_kib;
+    prof.ra_kib = ra_kib;
+    if (profile_store(opt.profile_path, dp->model_key, &prof))
+        pr2serr("%s: could not update profile cache %s\n", dp->device_name,
+                opt.profile_path);
+    return 0;
+}
+
+
+
+/* --triage: lowers the read retry count and recovery time limit in the
+ * current Read-Write Error Recovery mode page of dp for the coarse
+ * phase, with PER set so what the drive still recovers is reported,
+ * keeping the page as it was for recovery_restore(). A weak sector then
+ * fails fast and goes to the fine phase instead of holding the stream
+ * for seconds of firmware recovery. The change is not saved. */
+static void
+recovery_set(t_dev *dp)
+{
+    uint8_t mp[MEDIA_MP_LEN], *pg = mp + 8;
+    int len, res;
+
+    if (!(FT_SG & dp->out_type) || (FT_BLOCK & dp->out_type))
+        return;
+    memset(mp, 0, sizeof(mp));
+    res = sg_ll_mode_sense10(dp->fd, false, true, 0, RW_ERR_RECOVERY_MP, 0,
+                             mp, sizeof(mp), false,
+                             verbose > 1 ? verbose - 1 : 0);
+    len = 8 + sg_get_unaligned_be16(mp + 6) + 2 + pg[1];
+    if (res || sg_get_unaligned_be16(mp + 6) ||
+        (RW_ERR_RECOVERY_MP != (pg[0] & 0x3f)) || (pg[1] < 10) ||
+        (len > (int)sizeof(mp)))
+    {
+        if (verbose)
+            pr2serr("%s: no Read-Write Error Recovery mode page, the drive "
+                    "recovers as it is set to\n", dp->device_name);
+        return;
+    }
+    memcpy(dp->rwr_mp, mp, len);
+    mp[0] = mp[1] = 0; /* MODE DATA LENGTH is reserved in MODE SELECT */
+    pg[0] &= 0x7f;     /* PS */
+    pg[2] |= 0x04;     /* PER */
+    pg[2] &= ~0x02;    /* DTE: a recovered error does not end the READ */
+    if (!(pg[2] & 0x01))
+        pg[2] |= 0x08; /* EER, unless DCR forbids it */
+    if (pg[3] > TRIAGE_RD_RETRIES)
+        pg[3] = TRIAGE_RD_RETRIES; /* READ RETRY COUNT */
+    if ((0 == sg_get_unaligned_be16(pg + 10)) ||
+        (sg_get_unaligned_be16(pg + 10) > TRIAGE_RECOVERY_MS))
+        sg_put_unaligned_be16(TRIAGE_RECOVERY_MS, pg + 10);
+    res = sg_ll_mode_select10(dp->fd, true, false, mp, len, false,
+                              verbose > 1 ? verbose - 1 : 0);
+    if (res)
+    {
+        pr2serr("%s: MODE SELECT of the Read-Write Error Recovery page "
+                "refused, the coarse READs recover in full\n",
+                dp->device_name);
+        return;
+    }
+    dp->rwr_mp_len = len;
+    if (verbose)
+        pr2serr("%s: %d read retries and %d ms of recovery until the coarse "
+                "phase ends\n", dp->device_name, pg[3],
+                sg_get_unaligned_be16(pg + 10));
+}
+
+/* Puts back the Read-Write Error Recovery page recovery_set() changed. */
+static void
+recovery_restore(t_dev *dp)
+{
+    uint8_t mp[MEDIA_MP_LEN];
+
+    if (0 == dp->rwr_mp_len)
+        return;
+    memcpy(mp, dp->rwr_mp, dp->rwr_mp_len);
+    mp[0] = mp[1] = 0;
+    mp[8] &= 0x7f;
+    if (sg_ll_mode_select10(dp->fd, true, false, mp, dp->rwr_mp_len, false,
+                            0))
+        pr2serr("%s: could not restore the Read-Write Error Recovery mode "
+                "page\n", dp->device_name);
+    dp->rwr_mp_len = 0;
+}
+
+/* --triage: one pass in two phases with engine. The coarse phase
+ * streams the range with transfers of up to TRIAGE_BYTES, MAX_QUEUE_DEPTH
+ * in flight and no retries, the drive's own recovery cut short by
+ * recovery_set(); a READ that fails is only noted in
+ * dp->suspect (iso_push()). The fine phase then reads just those
+ * extents TRIAGE_BLOCKS at a time with TRIAGE_RETRIES, isolation and
+ * READ LONG (coe 2), so the bad map comes out sector accurate. */
+static int
+read_pass_triage(t_dev *dp, const t_pattern *pat, t_engine engine)
+{
+    int save_bpt = dp->bpt, save_qd = dp->qd;
+    struct flags_t save_flags = dp->flags;
+    t_extent *save_ext = dp->ext;
+    int save_num = dp->num_ext, save_cap = dp->ext_cap;
+    int max_bytes, opt_bytes, bytes = TRIAGE_BYTES, res;
+    int64_t sel = 0;
+    size_t k;
+
+    tune_limits(dp, &max_bytes, &opt_bytes);
+    if ((max_bytes > 0) && (max_bytes < bytes))
+        bytes = max_bytes;
+    if (FT_NVME & dp->out_type)
+        bytes = 1024 * 1024; /* MDTS is not known, as for --tune */
+    dp->bpt = (bytes > save_bpt * dp->blk_sz) ? bytes / dp->blk_sz : save_bpt;
+    dp->qd = MAX_QUEUE_DEPTH;
+    dp->flags.retries = 0;
+    dp->coarse = true;
+    recovery_set(dp);
+    res = engine(dp, pat);
+    recovery_restore(dp);
+    dp->coarse = false;
+    dp->bpt = save_bpt;
+    dp->qd = save_qd;
+    dp->flags = save_flags;
+    badmap_compact(&dp->suspect);
+    if (res || (0 == dp->suspect.num))
+    {
+        badmap_free(&dp->suspect);
+        return res;
+    }
+
+    dp->ext = NULL;
+    dp->num_ext = dp->ext_cap = 0;
+    for (k = 0; (k < dp->suspect.num) && (0 == res); ++k)
+    {
+        res = extent_add(dp, dp->suspect.ext[k].lba, dp->suspect.ext[k].len);
+        sel += dp->suspect.ext[k].len;
+    }
+    if (0 == res)
+    {
+        pr2serr("%s: %d extents of %" PRId64 " blocks failed, reading them "
+                "again\n", dp->device_name, dp->num_ext, sel);
+        dp->bpt = (save_bpt < TRIAGE_BLOCKS) ? save_bpt : TRIAGE_BLOCKS;
+        dp->flags.retries = TRIAGE_RETRIES;
+        if (dp->flags.coe < 2)
+            dp->flags.coe = 2;
+        dp->from = dp->start;
+        res = engine(dp, pat);
+    }
+    free(dp->ext);
+    dp->ext = save_ext;
+    dp->num_ext = save_num;
+    dp->ext_cap = save_cap;
+    dp->bpt = save_bpt;
+    dp->flags = save_flags;
+    badmap_free(&dp->suspect);
+    return res;
+}
+
+/* --lba-status: walks GET LBA STATUS(16) over [dp->start, dp->end) and
+ * keeps the extents of the wanted provisioning state in dp->ext, the
+ * mapped ones (status 0 or 3) or the deallocated and anchored ones (1 or
+ * 2). Adjacent extents are merged. When the drive has no GET LBA STATUS
+ * dp->ext stays NULL and the whole range is read. */
+static void
+lba_status_walk(t_dev *dp)
+{
+    uint8_t resp[LBA_STATUS_RESP_SZ];
+    int64_t lba = dp->start, prev, dlba, dlen, sel = 0;
+    int k, res, rlen, st;
+    bool want;
+
+    while (lba < dp->end)
+    {
+        prev = lba;
+        res = sg_ll_get_lba_status16(dp->fd, lba, 0, resp, sizeof(resp),
+                                     false, verbose);
+        rlen = (0 == res) ? (int)sg_get_unaligned_be32(resp) + 4 : 0;
+        if (rlen > (int)sizeof(resp))
+            rlen = sizeof(resp);
+        if (rlen < 24)
+        {
+            pr2serr("%s: GET LBA STATUS %s, reading every lba\n",
+                    dp->device_name, res ? "not supported" : "returned nothing");
+            extent_drop(dp);
+            return;
+        }
+        for (k = 8; k + 16 <= rlen; k += 16)
+        {
+            dlba = (int64_t)sg_get_unaligned_be64(resp + k);
+            dlen = sg_get_unaligned_be32(resp + k + 8);
+            st = resp[k + 12] & 0xf;
+            if ((0 == dlen) || (dlba + dlen <= lba))
+                continue;
+            if (dlba < lba)
+            {
+                dlen -= lba - dlba;
+                dlba = lba;
+            }
+            if (dlba + dlen > dp->end)
+                dlen = dp->end - dlba;
+            lba = dlba + dlen;
+            if (LBA_STATUS_DEALLOC == opt.lba_status)
+                want = (1 == st) || (2 == st);
+            else
+                want = (0 == st) || (3 == st);
+            if (!want || (dlen <= 0))
+                continue;
+            sel += dlen;
+            if (extent_add(dp, dlba, dlen))
+                return;
+        }
+        if (lba <= prev)
+            break; /* no descriptor past lba, do not loop */
+    }
+    if (NULL == dp->ext)
+        dp->ext = (t_extent *)calloc(1, sizeof(t_extent)); /* none: empty */
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: %s %" PRId64 " of %" PRId64 " blocks in %d extents\n",
+           dp->device_name,
+           (LBA_STATUS_DEALLOC == opt.lba_status) ? "deallocated" : "mapped",
+           sel, dp->end - dp->start, dp->num_ext);
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* GET PHYSICAL ELEMENT STATUS of every physical element, from the
+ * first, into resp. Returns 0, else the sense category or -1. */
+static int
+sg_get_elem_status(t_dev *dp, uint8_t *resp, int len)
+{
+    unsigned char cdb[16] = {0x9e, 0x17};
+    unsigned char senseBuff[SENSE_BUFF_LEN];
+    struct sg_io_hdr io_hdr;
+    int res;
+
+    sg_put_unaligned_be32((uint32_t)len, cdb + 10);
+    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+    io_hdr.interface_id = 'S';
+    io_hdr.cmd_len = sizeof(cdb);
+    io_hdr.cmdp = cdb;
+    io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+    io_hdr.dxfer_len = len;
+    io_hdr.dxferp = resp;
+    io_hdr.mx_sb_len = SENSE_BUFF_LEN;
+    io_hdr.sbp = senseBuff;
+    io_hdr.timeout = DEF_TIMEOUT;
+    if (verbose > 2)
+        sg_print_command_len(cdb, sizeof(cdb));
+    while (((res = ioctl(dp->fd, SG_IO, &io_hdr)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno)))
+        ;
+    if (res < 0)
+        return -1;
+    res = sg_err_category3(&io_hdr);
+    if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res))
+        return 0;
+    if (verbose)
+        sg_chk_n_print3("GET PHYSICAL ELEMENT STATUS", &io_hdr, verbose > 1);
+    return res;
+}
+
+/* The health of a physical element, as its descriptor codes it. NULL
+ * when it is within its limits or not reported. */
+static const char *
+elem_health_str(int h)
+{
+    if ((h < 0x64) || ((h >= 0xd0) && (h < 0xfd)))
+        return NULL;
+    if (0x64 == h)
+        return "at its limits";
+    if (h < 0xd0)
+        return "outside its limits";
+    if (0xfd == h)
+        return "depopulated, with errors";
+    if (0xfe == h)
+        return "being depopulated";
+    return "depopulated";
+}
+
+/* Adds the extents GET LBA STATUS(32) has of element id in [dp->start,
+ * dp->end) to *deadp, *nump of them. Returns the blocks, -1 when the
+ * drive cannot tell. */
+static int64_t
+elem_lbas(t_dev *dp, uint32_t id, t_extent **deadp, int *nump, int *capp)
+{
+    uint8_t resp[LBA_STATUS_RESP_SZ];
+    int64_t lba = dp->start, prev, dlba, dlen, blocks = 0;
+    int k, res, rlen;
+    t_extent *ep;
+
+    while (lba < dp->end)
+    {
+        prev = lba;
+        res = sg_ll_get_lba_status32(dp->fd, lba, 0, id, 0, resp,
+                                     sizeof(resp), false, verbose);
+        rlen = (0 == res) ? (int)sg_get_unaligned_be32(resp) + 4 : 0;
+        if (rlen > (int)sizeof(resp))
+            rlen = sizeof(resp);
+        if (res)
+            return -1;
+        for (k = 8; k + 16 <= rlen; k += 16)
+        {
+            dlba = (int64_t)sg_get_unaligned_be64(resp + k);
+            dlen = sg_get_unaligned_be32(resp + k + 8);
+            if ((0 == dlen) || (dlba + dlen <= lba))
+                continue;
+            if (dlba < lba)
+            {
+                dlen -= lba - dlba;
+                dlba = lba;
+            }
+            if (dlba + dlen > dp->end)
+                dlen = dp->end - dlba;
+            lba = dlba + dlen;
+            if (dlen <= 0)
+                continue;
+            if (*nump == *capp)
+            {
+                ep = (t_extent *)realloc(*deadp, (*capp ? 2 * *capp : 64) *
+                                                     sizeof(t_extent));
+                if (NULL == ep)
+                    return -1;
+                *deadp = ep;
+                *capp = *capp ? 2 * *capp : 64;
+            }
+            (*deadp)[*nump].lba = dlba;
+            (*deadp)[(*nump)++].len = dlen;
+            blocks += dlen;
+        }
+        if (lba <= prev)
+            break; /* no descriptor past lba, do not loop */
+    }
+    return blocks;
+}
+
+static int
+cmp_extent(const void *a, const void *b)
+{
+    int64_t x = ((const t_extent *)a)->lba, y = ((const t_extent *)b)->lba;
+
+    return (x > y) - (x < y);
+}
+
+/* Takes the n dead extents, sorted, out of what the pass reads: of
+ * dp->ext when there is a plan, else of [dp->start, dp->end). */
+static void
+extent_exclude(t_dev *dp, const t_extent *dead, int n)
+{
+    t_extent whole = {dp->start, dp->end - dp->start};
+    t_extent *old = dp->ext ? dp->ext : &whole;
+    int num = dp->ext ? dp->num_ext : 1;
+    int64_t lba, end;
+    int i, j = 0, k;
+
+    dp->ext = NULL;
+    dp->num_ext = dp->ext_cap = 0;
+    for (k = 0; k < num; ++k)
+    {
+        lba = old[k].lba;
+        end = old[k].lba + old[k].len;
+        while ((j < n) && (dead[j].lba + dead[j].len <= lba))
+            ++j;
+        for (i = j; (i < n) && (dead[i].lba < end) && (lba < end); ++i)
+        {
+            if ((dead[i].lba > lba) &&
+                extent_add(dp, lba, dead[i].lba - lba))
+                goto fini;
+            if (dead[i].lba + dead[i].len > lba)
+                lba = dead[i].lba + dead[i].len;
+        }
+        if ((lba < end) && extent_add(dp, lba, end - lba))
+            goto fini;
+    }
+    if (NULL == dp->ext)
+        dp->ext = (t_extent *)calloc(1, sizeof(t_extent)); /* none: empty */
+fini:
+    if (old != &whole)
+        free(old);
+}
+
+/* --elements: GET PHYSICAL ELEMENT STATUS before the scan. Each storage
+ * element (a head, a surface) at or outside its limits or depopulated
+ * is reported, with the lbas GET LBA STATUS(32) associates with it; with
+ * skip those of the ones outside their limits or depopulated are left
+ * out of the pass, as they would only be retried to no end. */
+static void
+element_walk(t_dev *dp)
+{
+    uint8_t *resp = (uint8_t *)calloc(1, ELEM_STATUS_RESP_SZ);
+    char name[PATH_MAX];
+    const char *hs;
+    t_extent *dead = NULL;
+    int64_t blocks, skip = 0;
+    int k, rlen, res, n = 0, n0, cap = 0;
+    uint32_t id;
+    bool out;
+
+    if (NULL == resp)
+        return;
+    res = sg_get_elem_status(dp, resp, ELEM_STATUS_RESP_SZ);
+    if (res)
+    {
+        pr2serr("%s: GET PHYSICAL ELEMENT STATUS %s, no elements known\n",
+                dp->device_name, (SG_LIB_CAT_INVALID_OP == res) ||
+                (SG_LIB_CAT_ILLEGAL_REQ == res) ? "not supported" : "failed");
+        free(resp);
+        return;
+    }
+    rlen = 32 + 32 * (int)sg_get_unaligned_be32(resp + 4);
+    if (rlen > ELEM_STATUS_RESP_SZ)
+        rlen = ELEM_STATUS_RESP_SZ;
+    for (k = 32; k + 32 <= rlen; k += 32)
+    {
+        id = sg_get_unaligned_be32(resp + k + 4);
+        if (1 != resp[k + 14])
+            continue; /* not a storage element */
+        hs = elem_health_str(resp[k + 15]);
+        if (NULL == hs)
+            continue;
+        out = (resp[k + 15] != 0x64);
+        n0 = n;
+        blocks = elem_lbas(dp, id, &dead, &n, &cap);
+        pthread_mutex_lock(&out_mutex);
+        if (blocks < 0)
+            printf("%s: storage element 0x%x %s, its lbas not reported\n",
+                   dp->device_name, id, hs);
+        else
+            printf("%s: storage element 0x%x %s, %" PRId64 " blocks%s\n",
+                   dp->device_name, id, hs, blocks,
+                   (out && (ELEM_SKIP == opt.elements) && blocks)
+                       ? ", not read" : "");
+        pthread_mutex_unlock(&out_mutex);
+        if (jsonl_enabled())
+            jsonl_printf("{\"type\":\"element\",\"device\":\"%s\","
+                         "\"id\":%u,\"health\":%d,\"state\":\"%s\","
+                         "\"blocks\":%" PRId64 ",\"skipped\":%s}",
+                         jsonl_escape(name, sizeof(name), dp->device_name), id,
+                         resp[k + 15], hs, blocks,
+                         (out && (ELEM_SKIP == opt.elements) && (blocks > 0))
+                             ? "true" : "false");
+        if (!out || (ELEM_SKIP != opt.elements) || (blocks < 0))
+            n = n0; /* only the extents left out are kept */
+        else
+            skip += blocks;
+    }
+    free(resp);
+    if ((ELEM_SKIP == opt.elements) && (n > 0))
+    {
+        qsort(dead, n, sizeof(*dead), cmp_extent);
+        extent_exclude(dp, dead, n);
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: %" PRId64 " blocks of failed elements left out, %d "
+               "extents to read\n", dp->device_name, skip, dp->num_ext);
+        pthread_mutex_unlock(&out_mutex);
+    }
+    free(dead);
+}
+
+/* SANITIZE with IMMED of the kind opt.erase asks for; OVERWRITE puts
+ * zeros once. Returns 0, else the sense category or -1. */
+static int
+sg_sanitize(t_dev *dp)
+{
+    unsigned char cdb[10] = {0x48, 0x80 /* IMMED */};
+    unsigned char param[8] = {0x01 /* OWCOUNT 1 */, 0, 0, 4};
+    unsigned char senseBuff[SENSE_BUFF_LEN];
+    struct sg_io_hdr io_hdr;
+    int res;
+
+    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+    io_hdr.dxfer_direction = SG_DXFER_NONE;
+    if (ERASE_OVERWRITE == opt.erase)
+    {
+        cdb[1] |= 0x01;
+        sg_put_unaligned_be16(sizeof(param), cdb + 7);
+        io_hdr.dxfer_direction = SG_DXFER_TO_DEV;
+        io_hdr.dxfer_len = sizeof(param);
+        io_hdr.dxferp = param;
+    }
+    else
+        cdb[1] |= (ERASE_CRYPTO == opt.erase) ? 0x03 : 0x02;
+    io_hdr.interface_id = 'S';
+    io_hdr.cmd_len = sizeof(cdb);
+    io_hdr.cmdp = cdb;
+    io_hdr.mx_sb_len = SENSE_BUFF_LEN;
+    io_hdr.sbp = senseBuff;
+    io_hdr.timeout = DEF_TIMEOUT;
+    if (verbose > 2)
+        sg_print_command_len(cdb, sizeof(cdb));
+    while (((res = ioctl(dp->fd, SG_IO, &io_hdr)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno)))
+        ;
+    if (res < 0)
+        return -1;
+    res = sg_err_category3(&io_hdr);
+    if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res))
+        return 0;
+    sg_chk_n_print3("SANITIZE", &io_hdr, verbose > 1);
+    return res;
+}
+
+/* Polls a SANITIZE in progress with REQUEST SENSE once a second, its
+ * progress indication moving dp->cur_lba for the progress table, until
+ * the drive reports it over. Returns 0, -1 when it failed. */
+static int
+sanitize_wait(t_dev *dp)
+{
+    uint8_t sb[SENSE_BUFF_LEN];
+    struct sg_sense_dec sd;
+
+    for (;;)
+    {
+        sleep(1);
+        memset(sb, 0, sizeof(sb));
+        if (sg_ll_request_sense(dp->fd, false, sb, sizeof(sb), false,
+                                verbose > 1 ? verbose - 1 : 0))
+            continue; /* some drives are busy answering it as well */
+        if (!sg_decode_sense(sb, sizeof(sb), &sd))
+            return 0;
+        if (sd.progress_valid)
+        {
+            __atomic_store_n(&dp->cur_lba, dp->start + (dp->end - dp->start) *
+                                                           sd.progress / 65536,
+                             __ATOMIC_RELAXED);
+            continue;
+        }
+        if (0x31 == sd.ssh.asc) /* SANITIZE COMMAND FAILED */
+        {
+            pr2serr("%s: sanitize failed\n", dp->device_name);
+            return -1;
+        }
+        if ((SPC_SK_NOT_READY != sd.ssh.sense_key) || (0x04 != sd.ssh.asc))
+            return 0;
+    }
+}
+
+/* UNMAP of [dp->start, dp->end) in as many descriptors and blocks per
+ * command as the Block Limits VPD page allows. Returns 0, else the sense
+ * category or -1. */
+static int
+unmap_all(t_dev *dp)
+{
+    uint8_t vpd[64];
+    uint8_t param[8 + 16 * 64];
+    uint32_t max_lbas = 0, max_desc = 0;
+    int64_t lba = dp->start, n;
+    int k, res;
+
+    memset(vpd, 0, sizeof(vpd));
+    if ((0 == sg_ll_inquiry(dp->fd, false, true, 0xb0, vpd, sizeof(vpd),
+                            false, verbose > 1 ? verbose - 1 : 0)) &&
+        (0xb0 == vpd[1]) && (sg_get_unaligned_be16(vpd + 2) >= 0x3c))
+    {
+        max_lbas = sg_get_unaligned_be32(vpd + 20);
+        max_desc = sg_get_unaligned_be32(vpd + 24);
+    }
+    if ((0 == max_lbas) || (0 == max_desc))
+    {
+        pr2serr("%s: the drive has no UNMAP\n", dp->device_name);
+        return -1;
+    }
+    if (max_desc > 64)
+        max_desc = 64;
+    while (lba < dp->end)
+    {
+        memset(param, 0, sizeof(param));
+        for (k = 0; (k < (int)max_desc) && (lba < dp->end); ++k, lba += n)
+        {
+            n = dp->end - lba;
+            if (n > max_lbas)
+                n = max_lbas;
+            sg_put_unaligned_be64((uint64_t)lba, param + 8 + 16 * k);
+            sg_put_unaligned_be32((uint32_t)n, param + 8 + 16 * k + 8);
+        }
+        sg_put_unaligned_be16(6 + 16 * k, param);
+        sg_put_unaligned_be16(16 * k, param + 2);
+        res = sg_ll_unmap_v2(dp->fd, false, 0, 60, param, 8 + 16 * k, true,
+                             verbose > 1 ? verbose - 1 : 0);
+        if (res)
+            return res;
+        __atomic_store_n(&dp->cur_lba, lba, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+/* Polls an NVMe Sanitize in progress on its log page once a second,
+ * its progress moving dp->cur_lba, until the controller reports it
+ * over. Returns 0, -1 when it failed. */
+static int
+nvme_sanitize_wait(t_dev *dp)
+{
+    struct nvme_admin_cmd cmd;
+    uint8_t log[512];
+    int sstat, idle = 0;
+
+    for (;;)
+    {
+        sleep(1);
+        memset(&cmd, 0, sizeof(cmd));
+        memset(log, 0, sizeof(log));
+        cmd.opcode = 0x02; /* Get Log Page */
+        cmd.nsid = 0xffffffff;
+        cmd.addr = (uint64_t)(uintptr_t)log;
+        cmd.data_len = sizeof(log);
+        cmd.cdw10 = ((sizeof(log) / 4 - 1) << 16) | NVME_LOG_SANITIZE;
+        if (nvme_admin(dp, &cmd))
+            continue; /* some controllers are busy answering it as well */
+        sstat = sg_get_unaligned_le16(log + 2) & 0x7;
+        if (2 == sstat) /* in progress */
+        {
+            __atomic_store_n(&dp->cur_lba, dp->start + (dp->end - dp->start) *
+                                 sg_get_unaligned_le16(log) / 65536,
+                             __ATOMIC_RELAXED);
+            continue;
+        }
+        if ((1 == sstat) || (4 == sstat)) /* done, 4 without deallocation */
+            return 0;
+        if (3 == sstat)
+        {
+            pr2serr("%s: sanitize failed\n", dp->device_name);
+            return -1;
+        }
+        if (++idle > 10) /* never sanitized, still after 10 s */
+        {
+            pr2serr("%s: the controller reports no sanitize\n",
+                    dp->device_name);
+            return -1;
+        }
+    }
+}
+
+/* --erase of an NVMe namespace: the Sanitize action opt.erase asks for
+ * when the controller has it, which erases all of its namespaces. A
+ * crypto erase without it is a Format NVM with a cryptographic erase,
+ * of the namespace or, when the controller formats them together, all
+ * of them, in the LBA format it has. Returns 0, -1 once reported. */
+static int
+nvme_erase(t_dev *dp)
+{
+    /* by ERASE_*: the Sanitize action and the SANICAP bit of it */
+    static const uint32_t sanact[] = {0, 0, 2, 4, 3};
+    static const uint32_t sanicap[] = {0, 0, NVME_SANICAP_BES,
+                                       NVME_SANICAP_CES, NVME_SANICAP_OWS};
+    struct nvme_admin_cmd cmd;
+    int res;
+
+    memset(&cmd, 0, sizeof(cmd));
+    if (dp->nvme_sanicap & sanicap[opt.erase])
+    {
+        pr2serr("%s: NVMe Sanitize erases every namespace of the "
+                "controller\n", dp->device_name);
+        cmd.opcode = NVME_OP_SANITIZE;
+        cmd.cdw10 = sanact[opt.erase];
+        if (ERASE_OVERWRITE == opt.erase)
+            cmd.cdw10 |= 1u << 4; /* OWPASS 1, a pattern of zeros */
+        res = nvme_admin(dp, &cmd);
+        if (res)
+        {
+            pr2serr("%s: NVMe Sanitize failed, %s 0x%x\n", dp->device_name,
+                    (res < 0) ? "errno" : "status", (res < 0) ? errno : res);
+            return -1;
+        }
+        dp->erase_how = "nvme-sanitize";
+        return nvme_sanitize_wait(dp);
+    }
+    if ((ERASE_CRYPTO != opt.erase) || !(dp->nvme_fna & NVME_FNA_CRYPTO))
+    {
+        pr2serr("%s: the controller has no %s erase\n", dp->device_name,
+                (ERASE_CRYPTO == opt.erase) ? "crypto"
+                : (ERASE_BLOCK == opt.erase) ? "block" : "overwrite");
+        return -1;
+    }
+    if (dp->nvme_fna & NVME_FNA_ALL)
+        pr2serr("%s: Format NVM erases every namespace of the controller\n",
+                dp->device_name);
+    cmd.opcode = NVME_OP_FORMAT;
+    cmd.nsid = (dp->nvme_fna & NVME_FNA_ALL) ? 0xffffffff : dp->nsid;
+    /* LBAF, MSET, PI and PIL as they are, LBAFU, SES 2 */
+    cmd.cdw10 = (dp->nvme_flbas & 0x1f) |
+                ((uint32_t)(dp->nvme_dps & 0xf) << 5) | (2u << 9) |
+                ((uint32_t)((dp->nvme_flbas >> 5) & 0x3) << 12);
+    cmd.timeout_ms = NVME_FORMAT_MS;
+    res = nvme_admin(dp, &cmd);
+    if (res)
+    {
+        pr2serr("%s: NVMe Format NVM failed, %s 0x%x\n", dp->device_name,
+                (res < 0) ? "errno" : "status", (res < 0) ? errno : res);
+        return -1;
+    }
+    dp->erase_how = "nvme-format";
+    return 0;
+}
+
+/* --erase sanitize:crypto: reads the samples sample k erase_len blocks
+ * at start + k * erase_step, before the erase and hashes each block of
+ * them for erase_chunk() to compare with. Blocks all of one byte are
+ * not hashed, as an erased drive may read so too, nor those that do not
+ * read. Returns 0, -1 when out of memory. */
+static int
+erase_fingerprint(t_dev *dp)
+{
+    uint8_t *free_buf;
+    uint8_t *buf = io_buf(dp, (size_t)dp->erase_len * dp->blk_sz, &free_buf);
+    uint64_t h[2];
+    int64_t k, lba;
+    bool diop = false;
+    int b, n, got, res;
+
+    dp->erase_fp = (uint64_t *)calloc(dp->erase_n * dp->erase_len,
+                                      sizeof(uint64_t));
+    if ((NULL == buf) || (NULL == dp->erase_fp))
+    {
+        iobuf_free(free_buf);
+        free(dp->erase_fp);
+        dp->erase_fp = NULL;
+        return -1;
+    }
+    for (k = 0; k < dp->erase_n; ++k)
+    {
+        lba = dp->start + k * dp->erase_step;
+        n = (dp->end - lba < dp->erase_len) ? (int)(dp->end - lba)
+                                            : dp->erase_len;
+        got = 0;
+        if ((FT_SG | FT_SIM) & dp->out_type)
+            res = sg_read(dp, buf, n, lba, &diop, &got);
+        else
+            res = direct_read(dp, buf, n, lba);
+        if (res)
+        {
+            dp->erase_before[1] += n;
+            continue;
+        }
+        for (b = 0; b < n; ++b)
+        {
+            if (buf_uniform(buf + (size_t)b * dp->blk_sz, dp->blk_sz) >= 0)
+            {
+                ++dp->erase_before[0];
+                continue;
+            }
+            xxh3_128(buf + (size_t)b * dp->blk_sz, dp->blk_sz, h);
+            dp->erase_fp[k * dp->erase_len + b] = h[0] | 1;
+        }
+    }
+    iobuf_free(free_buf);
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: %" PRId64 " samples of %d blocks read before the crypto "
+           "erase\n", dp->device_name, dp->erase_n, dp->erase_len);
+    pthread_mutex_unlock(&out_mutex);
+    return 0;
+}
+
+/* --erase: erases dp, its progress in the table under an "UNMP" or
+ * "SANI" pass, and unless --lba-status picks the blocks to check, plans
+ * ERASE_SAMPLES READs spread evenly over it for the passes. Before a
+ * crypto erase the samples are read, for the first pass to find none
+ * of them as it was. Returns 0, else the error that stopped the erase. */
+static int
+erase_device(t_dev *dp)
+{
+    t_stats *stats = &dp->stats;
+    double t0 = mono_secs();
+    int64_t step, lba;
+    int res;
+
+    if (!(FT_SG & dp->out_type) &&
+        !((FT_NVME & dp->out_type) && (ERASE_UNMAP != opt.erase)))
+    {
+        pr2serr("%s: --erase needs SCSI UNMAP or SANITIZE, or NVMe Sanitize "
+                "or Format NVM\n", dp->device_name);
+        return -1;
+    }
+    step = (dp->end - dp->start) / ERASE_SAMPLES;
+    if ((ERASE_CRYPTO == opt.erase) && !opt.lba_status && !opt.dverify &&
+        (dp->end - dp->start >= dp->bpt))
+    {
+        /* the samples planned below, or the whole of a small device */
+        dp->erase_len = dp->bpt;
+        dp->erase_step = (step <= dp->bpt) ? dp->bpt : step;
+        dp->erase_n = (step <= dp->bpt)
+                          ? (dp->end - dp->start + dp->bpt - 1) / dp->bpt
+                          : (dp->end - dp->start - dp->bpt) / step + 1;
+        if (erase_fingerprint(dp))
+            pr2serr("%s: out of memory, what the crypto erase leaves is not "
+                    "checked\n", dp->device_name);
+    }
+    snprintf(dp->cur_label, sizeof(dp->cur_label), "%s",
+             (ERASE_UNMAP == opt.erase) ? "UNMP" : "SANI");
+    dp->pass_start_ticks = get_ticks(stats);
+    dp->base_ticks = stats->wiping_ticks;
+    __atomic_store_n(&dp->cur_lba, dp->start, __ATOMIC_RELAXED);
+    __atomic_store_n(&dp->cur_pass, 1, __ATOMIC_RELEASE);
+    if (ERASE_UNMAP == opt.erase)
+        res = unmap_all(dp);
+    else if (FT_NVME & dp->out_type)
+        res = nvme_erase(dp);
+    else
+    {
+        dp->erase_how = "sanitize";
+        res = sg_sanitize(dp);
+        if (0 == res)
+            res = sanitize_wait(dp);
+    }
+    if (res)
+    {
+        free(dp->erase_fp); /* nothing to check */
+        dp->erase_fp = NULL;
+    }
+    __atomic_store_n(&dp->cur_pass, 0, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: %s %s after %.1f s\n", dp->device_name,
+           (ERASE_UNMAP == opt.erase) ? "unmap" : "sanitize",
+           res ? "failed" : "done", mono_secs() - t0);
+    pthread_mutex_unlock(&out_mutex);
+    if (res || opt.lba_status)
+        return res;
+    if (step <= dp->bpt)
+        return 0; /* small enough to read whole */
+    for (lba = dp->start; lba + dp->bpt <= dp->end; lba += step)
+        if (extent_add(dp, lba, dp->bpt))
+            break;
+    return 0;
+}
+
+/* LOG SENSE page pg_code of dp into pg, OFFLOAD_LOG_LEN bytes. Returns
+ * 0, else the sense category or -1. */
+static int
+offload_log(t_dev *dp, int pg_code, uint8_t *pg)
+{
+    memset(pg, 0, OFFLOAD_LOG_LEN);
+    return sg_ll_log_sense(dp->fd, false, false, 1, pg_code, 0, 0, pg,
+                           OFFLOAD_LOG_LEN, false,
+                           verbose > 1 ? verbose - 1 : 0);
+}
+
+/* Moves dp->cur_lba for the progress table by the progress indication
+ * of TEST UNIT READY, else of REQUEST SENSE, when the drive gives one. */
+static void
+offload_progress(t_dev *dp)
+{
+    uint8_t sb[SENSE_BUFF_LEN];
+    struct sg_sense_dec sd;
+    int progress = -1, vb = verbose > 1 ? verbose - 1 : 0;
+
+    sg_ll_test_unit_ready_progress(dp->fd, 0, &progress, false, vb);
+    if (progress < 0)
+    {
+        memset(sb, 0, sizeof(sb));
+        if ((0 == sg_ll_request_sense(dp->fd, false, sb, sizeof(sb), false,
+                                      vb)) &&
+            sg_decode_sense(sb, sizeof(sb), &sd) && sd.progress_valid)
+            progress = sd.progress;
+    }
+    if (progress >= 0)
+        __atomic_store_n(&dp->cur_lba, dp->start + (dp->end - dp->start) *
+                                                       progress / 65536,
+                         __ATOMIC_RELAXED);
+}
+
+/* BACKGROUND CONTROL of dp, bo_ctl 1 start, 2 stop medium scans.
+ * Returns 0, else the sense category or -1. */
+static int
+bg_control(t_dev *dp, int bo_ctl)
+{
+    unsigned char cdb[16] = {0x9e, 0x15 /* BACKGROUND CONTROL */};
+    unsigned char senseBuff[SENSE_BUFF_LEN];
+    struct sg_io_hdr io_hdr;
+    int res;
+
+    cdb[2] = bo_ctl << 6;
+    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+    io_hdr.interface_id = 'S';
+    io_hdr.dxfer_direction = SG_DXFER_NONE;
+    io_hdr.cmd_len = sizeof(cdb);
+    io_hdr.cmdp = cdb;
+    io_hdr.mx_sb_len = SENSE_BUFF_LEN;
+    io_hdr.sbp = senseBuff;
+    io_hdr.timeout = DEF_TIMEOUT;
+    if (verbose > 2)
+        sg_print_command_len(cdb, sizeof(cdb));
+    while (((res = ioctl(dp->fd, SG_IO, &io_hdr)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno)))
+        ;
+    if (res < 0)
+        return -1;
+    res = sg_err_category3(&io_hdr);
+    if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res))
+        return 0;
+    sg_chk_n_print3("BACKGROUND CONTROL", &io_hdr, verbose > 1);
+    return res;
+}
+
+/* --offload=selftest: an extended self-test of dp in the background,
+ * polled until the Self-Test Results log has a new one that is over.
+ * Its first failure goes into the bad map. Returns 0 when it passed,
+ * SG_LIB_CAT_MEDIUM_HARD when it failed, else why it did not run. */
+static int
+offload_selftest(t_dev *dp, uint8_t *pg, double t0)
+{
+    int was = -1, was_hours = -1, result = -1, hours = -1;
+    int vb = verbose > 1 ? verbose - 1 : 0;
+    int64_t was_lba = -1, lba = -1;
+    bool seen = false;
+    int res;
+
+    if (offload_log(dp, 0x10, pg) || (0x10 != (pg[0] & 0x3f)))
+    {
+        pr2serr("%s: --offload=selftest: no Self-Test Results log page\n",
+                dp->device_name);
+        return -1;
+    }
+    health_selftest(pg, OFFLOAD_LOG_LEN, &was, &was_hours, &was_lba);
+    res = sg_ll_send_diag(dp->fd, 2 /* background extended */, false, false,
+                          false, false, 0, NULL, 0, true, vb);
+    if (res)
+        return res;
+    for (;;)
+    {
+        sleep(OFFLOAD_POLL_S);
+        if (dp->cancelled)
+        {
+            sg_ll_send_diag(dp->fd, 4 /* abort background */, false, false,
+                            false, false, 0, NULL, 0, false, vb);
+            return SG_LIB_CAT_OTHER;
+        }
+        offload_progress(dp);
+        if (offload_log(dp, 0x10, pg) ||
+            health_selftest(pg, OFFLOAD_LOG_LEN, &result, &hours, &lba))
+            continue;
+        if (HEALTH_ST_RUNNING == result)
+            seen = true;
+        else if (seen || (result != was) || (hours != was_hours) ||
+                 (lba != was_lba) || (mono_secs() - t0 > OFFLOAD_START_S))
+            break; /* the last case: over between two looks, the same */
+    }
+    pthread_mutex_lock(&out_mutex);
+    if ((result >= 3) && (result <= 7) && (lba >= 0))
+        printf("%s: extended self-test failed at lba 0x%" PRIx64 "\n",
+               dp->device_name, lba);
+    else if ((result >= 3) && (result <= 7))
+        printf("%s: extended self-test failed, result %d\n",
+               dp->device_name, result);
+    else
+        printf("%s: extended self-test %s\n", dp->device_name,
+               result ? "aborted" : "passed");
+    pthread_mutex_unlock(&out_mutex);
+    if ((result >= 3) && (result <= 7))
+    {
+        if (lba >= 0)
+            bad_block(dp, BADMAP_BAD, lba, 1);
+        return SG_LIB_CAT_MEDIUM_HARD;
+    }
+    return result ? SG_LIB_CAT_OTHER : 0;
+}
+
+/* --offload=bms: a background medium scan of dp, polled on the
+ * Background Scan Results log until the drive is no longer scanning.
+ * The medium errors it logged meanwhile go into the bad map. Returns 0
+ * when it found none, SG_LIB_CAT_MEDIUM_HARD when it did, else why it
+ * did not run or halted. */
+static int
+offload_bms(t_dev *dp, uint8_t *pg, double t0)
+{
+    int status, progress, scans, was_scans, k, n, res;
+    int64_t since, minutes, *lba;
+    bool seen = false;
+
+    if (offload_log(dp, 0x15, pg) ||
+        health_bms_status(pg, OFFLOAD_LOG_LEN, &status, &progress, &was_scans,
+                          &since))
+    {
+        pr2serr("%s: --offload=bms: no Background Scan Results log page\n",
+                dp->device_name);
+        return -1;
+    }
+    res = bg_control(dp, 1);
+    if (res)
+        return res;
+    for (;;)
+    {
+        sleep(OFFLOAD_POLL_S);
+        if (dp->cancelled)
+        {
+            bg_control(dp, 2);
+            return SG_LIB_CAT_OTHER;
+        }
+        if (offload_log(dp, 0x15, pg) ||
+            health_bms_status(pg, OFFLOAD_LOG_LEN, &status, &progress, &scans,
+                              &minutes))
+            continue;
+        if ((1 == status) || (2 == status))
+        {
+            seen = true;
+            __atomic_store_n(&dp->cur_lba, dp->start + (dp->end - dp->start) *
+                                                           progress / 65536,
+                             __ATOMIC_RELAXED);
+            continue;
+        }
+        /* 8: waiting on the BMS interval timer, this scan is over */
+        if ((status > 2) && (8 != status))
+        {
+            pr2serr("%s: background medium scan halted, status %d\n",
+                    dp->device_name, status);
+            return -1;
+        }
+        if (seen || (scans != was_scans) || (mono_secs() - t0 > OFFLOAD_START_S))
+            break;
+    }
+    n = health_bms_lbas(pg, OFFLOAD_LOG_LEN, since, NULL, 0);
+    lba = (int64_t *)malloc((n ? n : 1) * sizeof(int64_t));
+    if (lba)
+    {
+        health_bms_lbas(pg, OFFLOAD_LOG_LEN, since, lba, n);
+        for (k = 0; k < n; ++k)
+            bad_block(dp, BADMAP_BAD, lba[k], 1);
+        free(lba);
+    }
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: background medium scan done, %d medium errors\n",
+           dp->device_name, n);
+    pthread_mutex_unlock(&out_mutex);
+    return n ? SG_LIB_CAT_MEDIUM_HARD : 0;
+}
+
+/* --offload: dp scans its own media, its progress in the table under a
+ * "SLFT" or "BMS" pass, the host reading none of it. Returns what
+ * offload_selftest() or offload_bms() does. */
+static int
+offload_device(t_dev *dp)
+{
+    t_stats *stats = &dp->stats;
+    double t0 = mono_secs();
+    uint8_t *pg;
+    int res;
+
+    if ((FT_NVME & dp->out_type) || !((FT_SG | FT_BLOCK) & dp->out_type))
+    {
+        pr2serr("%s: --offload needs a SCSI drive\n", dp->device_name);
+        return -1;
+    }
+    pg = (uint8_t *)malloc(OFFLOAD_LOG_LEN);
+    if (NULL == pg)
+        return SG_LIB_CAT_OTHER;
+    snprintf(dp->cur_label, sizeof(dp->cur_label), "%s",
+             (OFFLOAD_SELFTEST == opt.offload) ? "SLFT" : "BMS");
+    dp->pass_start_ticks = get_ticks(stats);
+    dp->base_ticks = stats->wiping_ticks;
+    __atomic_store_n(&dp->cur_lba, dp->start, __ATOMIC_RELAXED);
+    __atomic_store_n(&dp->cur_pass, 1, __ATOMIC_RELEASE);
+    if (OFFLOAD_SELFTEST == opt.offload)
+        res = offload_selftest(dp, pg, t0);
+    else
+        res = offload_bms(dp, pg, t0);
+    pthread_mutex_lock(&dp->report_mutex);
+    __atomic_store_n(&dp->cur_pass, 0, __ATOMIC_RELEASE);
+    stats->passwiping_ticks = get_ticks(stats) - dp->pass_start_ticks;
+    stats->wiping_ticks = dp->base_ticks + stats->passwiping_ticks;
+    pthread_mutex_unlock(&dp->report_mutex);
+    free(pg);
+    if ((0 == res) || (SG_LIB_CAT_MEDIUM_HARD == res))
+    {
+        print_stats(dp, 1, dp->cur_label, dp->end, 1);
+#ifndef DEBUG
+        printf("\n");
+#endif
+    }
+    return res;
+}
+
+/* --sample: the first lba of window i of n, one at a random place of
+ * stratum i of [start, end), aligned to the physical block. */
+static int64_t
+sample_window(const t_dev *dp, int64_t i)
+{
+    int64_t range = dp->end - dp->start;
+    int64_t lo = dp->start + (int64_t)((__int128)range * i / dp->sample_n);
+    int64_t hi = dp->start + (int64_t)((__int128)range * (i + 1) /
+                                       dp->sample_n);
+    int64_t span = hi - lo - dp->sample_w;
+    int64_t align = (dp->pblk_sz > dp->blk_sz) ? dp->pblk_sz / dp->blk_sz : 1;
+    int64_t lba;
+
+    lba = lo + (int64_t)(rand_pattern_key(opt.seed ^ SAMPLE_SALT,
+                                          (unsigned int)i) %
+                         (uint64_t)(span + 1));
+    if ((lba % align) && (lba - lba % align >= lo))
+        lba -= lba % align;
+    return lba;
+}
+
+/* --sample: plans a window of dp->bpt blocks in each of n strata of
+ * [start, end), n the fewest that, none of them failing, bound the bad
+ * fraction below opt.sample at opt.sample_conf. Every bad block lies in
+ * a window, so the fraction of failing windows bounds that of blocks.
+ * The strata are in lba order, which makes the scan one elevator sweep,
+ * and the places are of the counter PRNG under --seed, so a run with
+ * the same seed reads the same windows. */
+static void
+sample_plan(t_dev *dp)
+{
+    int64_t range = dp->end - dp->start;
+    double n = ceil(log(1.0 - opt.sample_conf) / log1p(-opt.sample));
+    int64_t i;
+
+    if (n * dp->bpt >= (double)range)
+    {
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: --sample needs %.0f windows of %d blocks, reading the "
+               "whole range\n", dp->device_name, n, dp->bpt);
+        pthread_mutex_unlock(&out_mutex);
+        return;
+    }
+    dp->sample_n = (int64_t)n;
+    dp->sample_w = dp->bpt;
+    for (i = 0; i < dp->sample_n; ++i)
+        if (extent_add(dp, sample_window(dp, i), dp->sample_w))
+        {
+            dp->sample_n = 0; /* read whole */
+            return;
+        }
+    if (verbose)
+        pr2serr("%s: sampling %" PRId64 " windows of %d blocks, %.3g%% of "
+                "the range\n", dp->device_name, dp->sample_n, dp->sample_w,
+                100.0 * dp->sample_n * dp->sample_w / range);
+}
+
+/* --time-limit: the extents of round r, a stripe of tl_stripe blocks
+ * from each of the TL_ZONES zones, outer to inner, so a pass cut short
+ * has read every zone alike. Returns 0, -1 with the list dropped. */
+static int
+tl_round_plan(t_dev *dp, int64_t r)
+{
+    int64_t zlo, zhi, lo, hi;
+    int z;
+
+    dp->num_ext = 0;
+    for (z = 0, zlo = dp->start; z < TL_ZONES; ++z, zlo = zhi)
+    {
+        zhi = zlo + zone_len(dp, z);
+        lo = zlo + r * dp->tl_stripe;
+        hi = (lo + dp->tl_stripe < zhi) ? lo + dp->tl_stripe : zhi;
+        if ((lo < hi) && extent_add(dp, lo, hi - lo))
+            return -1;
+    }
+    return 0;
+}
+
+/* --time-limit: a pass is read in rounds of tl_round_plan() stripes,
+ * the time limit then leaving no zone unread. A range too small to
+ * stripe is read in lba order. */
+static void
+tl_plan(t_dev *dp)
+{
+    int64_t zmax = zone_len(dp, TL_ZONES - 1);
+    int64_t stripe = TL_STRIPE / dp->blk_sz;
+
+    if (zone_len(dp, 0) > zmax)
+        zmax = zone_len(dp, 0);
+    if (stripe > zmax / TL_MIN_ROUNDS)
+        stripe = zmax / TL_MIN_ROUNDS; /* a small range striped finer */
+    if (stripe < dp->bpt)
+        stripe = dp->bpt;
+    if (dp->pblk > 1)
+        stripe -= stripe % dp->pblk;
+    if ((stripe < 1) || (zmax <= stripe))
+        return;
+    dp->tl_stripe = stripe;
+    dp->rounds = (zmax + stripe - 1) / stripe;
+    if (verbose)
+        pr2serr("%s: --time-limit, %" PRId64 " rounds of %d stripes of %"
+                PRId64 " blocks a pass\n", dp->device_name, dp->rounds,
+                TL_ZONES, stripe);
+}
+
+/* --coarse: the extents of round r. Round 0 reads a window every
+ * co_stride blocks, each round after it those halfway between the ones
+ * before, and the last all that is left; any failure spread over the
+ * device shows up in the first minutes. Returns 0, -1 with the list
+ * dropped. */
+static int
+coarse_round_plan(t_dev *dp, int64_t r)
+{
+    bool fill = (r >= dp->co_levels);
+    int64_t g = dp->co_stride >> (fill ? dp->co_levels - 1 : r);
+    int64_t lba, lo, hi;
+
+    dp->num_ext = 0;
+    for (lba = dp->start; lba < dp->end; lba += g)
+    {
+        if ((r > 0) && !fill && (0 == (lba - dp->start) % (2 * g)))
+            continue; /* a window of an earlier round */
+        lo = fill ? lba + dp->co_win : lba; /* the gap after the window */
+        hi = fill ? lba + g : lba + dp->co_win;
+        if (hi > dp->end)
+            hi = dp->end;
+        if ((lo < hi) && extent_add(dp, lo, hi - lo))
+            return -1;
+    }
+    return 0;
+}
+
+/* --coarse: the stride, a power of two windows, and the rounds of a
+ * pass. A range smaller than the stride is read in lba order. */
+static void
+coarse_plan(t_dev *dp)
+{
+    int64_t win = COARSE_WIN / dp->blk_sz, n = 1;
+
+    if (win < dp->bpt)
+        win = dp->bpt;
+    if (dp->pblk > 1)
+        win += (dp->pblk - win % dp->pblk) % dp->pblk;
+    while ((2 * n * win <= opt.coarse * (1 << 20) / dp->blk_sz) &&
+           (2 * n * win < dp->end - dp->start))
+        n *= 2;
+    if (n < 2)
+        return;
+    dp->co_win = win;
+    dp->co_stride = n * win;
+    for (dp->co_levels = 1; (n >> dp->co_levels) >= COARSE_FILL;)
+        ++dp->co_levels;
+    dp->rounds = dp->co_levels + 1;
+    if (verbose)
+        pr2serr("%s: --coarse, windows of %" PRId64 " blocks every %"
+                PRId64 ", %d rounds halving it, then the rest\n",
+                dp->device_name, win, dp->co_stride, dp->co_levels - 1);
+}
+
+/* The extents of round r of a pass, of --coarse or --time-limit. */
+static int
+round_plan(t_dev *dp, int64_t r)
+{
+    return dp->co_stride ? coarse_round_plan(dp, r) : tl_round_plan(dp, r);
+}
+
+/* --time-limit: what was read in the time, and how long the rest would
+ * take at the rate each zone was read at. */
+static void
+tl_report(t_dev *dp)
+{
+    double full = 0.0, left = zone_remaining(dp, dp->passes_done + 1, &full);
+    double want = (double)(dp->end - dp->start) * dp->blk_sz * opt.passes;
+    double got = (double)dp->bytes_done, rate;
+    int z;
+
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: time limit of %g min %s, %.1f%% of the %u passes read\n",
+           dp->device_name, opt.time_limit / 60,
+           dp->tl_hit ? "reached" : "not reached",
+           100.0 * got / (want > 0 ? want : 1), opt.passes);
+    if (left >= 0)
+    {
+        printf("%s: a whole pass takes an estimated %.1f s, the rest of "
+               "the run %.1f s more\n", dp->device_name, full, left);
+        printf("%s: zone MB/s, outer to inner:", dp->device_name);
+        for (z = 0; z < TL_ZONES; ++z)
+        {
+            rate = zone_rate(dp, z);
+            printf(__atomic_load_n(&dp->zone_ns[z], __ATOMIC_RELAXED)
+                       ? " %.0f"
+                       : " (%.0f)",
+                   rate / 1e6);
+        }
+        printf("\n");
+    }
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* The one-sided Clopper-Pearson upper bound on p from k of n at conf:
+ * the p at which k or fewer come up with probability 1 - conf. */
+static double
+binom_upper(int64_t k, int64_t n, double conf)
+{
+    double lo = (double)k / n, hi = 1.0, p, cdf, lc;
+    int64_t i;
+    int it;
+
+    if (k >= n)
+        return 1.0;
+    if (0 == k)
+        return 1.0 - pow(1.0 - conf, 1.0 / n);
+    lc = lgamma(n + 1.0);
+    for (it = 0; it < 60; ++it)
+    {
+        p = (lo + hi) / 2;
+        for (cdf = 0.0, i = 0; i <= k; ++i)
+            cdf += exp(lc - lgamma(i + 1.0) - lgamma(n - i + 1.0) +
+                       i * log(p) + (n - i) * log1p(-p));
+        if (cdf > 1.0 - conf)
+            lo = p;
+        else
+            hi = p;
+    }
+    return hi;
+}
+
+/* --sample: the windows read, those of them with a bad or miscompared
+ * block in the bad map, and the bound on the bad fraction they give. */
+static void
+sample_report(t_dev *dp)
+{
+    int64_t reached = dp->passes_done ? dp->end : dp->cur_lba;
+    const struct badmap_ext *e;
+    int64_t i, a;
+    size_t j = 0, k;
+
+    badmap_compact(&dp->bad);
+    for (i = 0; i < dp->sample_n; ++i)
+    {
+        a = sample_window(dp, i);
+        if (a + dp->sample_w > reached)
+            break;
+        ++dp->sample_read;
+        while ((j < dp->bad.num) &&
+               (dp->bad.ext[j].lba + dp->bad.ext[j].len <= a))
+            ++j;
+        for (k = j; (k < dp->bad.num) && (dp->bad.ext[k].lba <
+                                          a + dp->sample_w); ++k)
+        {
+            e = dp->bad.ext + k;
+            if ((BADMAP_WEAK != e->kind) && (e->lba + e->len > a))
+            {
+                ++dp->sample_bad;
+                break;
+            }
+        }
+    }
+    dp->sample_ub = dp->sample_read
+                        ? binom_upper(dp->sample_bad, dp->sample_read,
+                                      opt.sample_conf)
+                        : 1.0;
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: sampled %" PRId64 " of %" PRId64 " windows of %d blocks, %"
+           PRId64 " failing: bad fraction < %.3g at %g%% confidence, %s "
+           "%.3g\n", dp->device_name, dp->sample_read, dp->sample_n,
+           dp->sample_w, dp->sample_bad, dp->sample_ub,
+           100.0 * opt.sample_conf,
+           (dp->sample_ub < opt.sample) ? "within" : "NOT within",
+           opt.sample);
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* REPORT ZONES from zs_lba into resp through SG_IO. Returns 0, else the
+ * sense category or -1. */
+static int
+sg_report_zones(t_dev *dp, int64_t zs_lba, uint8_t *resp, int len)
+{
+    unsigned char cdb[16] = {ZONING_IN_CMD, 0 /* REPORT ZONES */};
+    unsigned char senseBuff[SENSE_BUFF_LEN];
+    struct sg_io_hdr io_hdr;
+    int res;
+
+    sg_put_unaligned_be64((uint64_t)zs_lba, cdb + 2);
+    sg_put_unaligned_be32((uint32_t)len, cdb + 10);
+    cdb[14] = 0x80; /* PARTIAL, all zones */
+    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+    io_hdr.interface_id = 'S';
+    io_hdr.cmd_len = sizeof(cdb);
+    io_hdr.cmdp = cdb;
+    io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+    io_hdr.dxfer_len = len;
+    io_hdr.dxferp = resp;
+    io_hdr.mx_sb_len = SENSE_BUFF_LEN;
+    io_hdr.sbp = senseBuff;
+    io_hdr.timeout = DEF_TIMEOUT;
+    if (verbose > 2)
+        sg_print_command_len(cdb, sizeof(cdb));
+    while (((res = ioctl(dp->fd, SG_IO, &io_hdr)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno)))
+        ;
+    if (res < 0)
+        return -1;
+    res = sg_err_category3(&io_hdr);
+    if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res))
+        return 0;
+    if (verbose)
+        sg_chk_n_print3("REPORT ZONES", &io_hdr, verbose > 1);
+    return res;
+}
+
+/* Zone Management Receive, Report Zones, from zs_lba into resp. Returns
+ * 0, else -1. */
+static int
+nvme_report_zones(t_dev *dp, int64_t zs_lba, uint8_t *resp, int len)
+{
+    struct nvme_passthru_cmd64 cmd;
+    int res;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = 0x7a; /* Zone Management Receive */
+    cmd.nsid = dp->nsid;
+    cmd.addr = (uint64_t)(uintptr_t)resp;
+    cmd.data_len = len;
+    cmd.cdw10 = (uint32_t)zs_lba;
+    cmd.cdw11 = (uint32_t)((uint64_t)zs_lba >> 32);
+    cmd.cdw12 = len / 4 - 1;  /* dwords, 0's based */
+    cmd.cdw13 = 1 << 16;      /* Report Zones, all states, partial */
+    res = nvme_io(dp, &cmd);
+    return res ? -1 : 0;
+}
+
+/* Plans the reads of one zone, whatever the transport reported it with:
+ * conventional zones are read whole, sequential ones up to the write
+ * pointer (full and read only ones up to their capacity). Empty zones
+ * hold no data above a write pointer at their start and offline ones
+ * cannot be read, their condition is all that is checked. Returns the
+ * blocks planned, or -1 once the extent list is lost. */
+static int64_t
+zone_plan(t_dev *dp, int type, int cond, int64_t start, int64_t cap,
+          int64_t wp, int *emptyp, int *offlinep)
+{
+    int64_t end;
+
+    if ((ZONE_TYPE_CONVENTIONAL == type) || (ZONE_COND_NOT_WP == cond))
+        end = start + cap;
+    else if (ZONE_COND_EMPTY == cond)
+    {
+        ++*emptyp;
+        return 0;
+    }
+    else if (ZONE_COND_OFFLINE == cond)
+    {
+        ++*offlinep;
+        pr2serr("%s: zone at lba=%" PRId64 " [0x%" PRIx64 "] is offline\n",
+                dp->device_name, start, start);
+        return 0;
+    }
+    else if ((ZONE_COND_FULL == cond) || (ZONE_COND_READ_ONLY == cond))
+        end = start + cap;
+    else
+        end = wp; /* open or closed */
+    if (start < dp->start)
+        start = dp->start;
+    if (end > dp->end)
+        end = dp->end;
+    if (end <= start)
+        return 0;
+    return extent_add(dp, start, end - start) ? -1 : end - start;
+}
+
+/* --zones: fetches the zone list once, with REPORT ZONES (ZBC), Zone
+ * Management Receive (ZNS) or BLKREPORTZONE, and keeps in dp->ext only
+ * what lies below the write pointers. Devices that are not zoned are
+ * read in full. */
+static void
+zone_walk(t_dev *dp)
+{
+    uint8_t *resp = (uint8_t *)malloc(ZONES_RESP_SZ);
+    struct blk_zone_report *rep = (struct blk_zone_report *)resp;
+    int64_t lba = dp->start, prev, start, len, cap, wp, sel = 0, got;
+    int k, n, res, zones = 0, empty = 0, offline = 0;
+    int lbs = dp->blk_sz / 512; /* BLKREPORTZONE counts 512 byte sectors */
+    bool scsi = !!(FT_SG & dp->out_type);
+    bool nvme = !scsi && (FT_NVME & dp->out_type);
+
+    if (NULL == resp)
+        return;
+    if (lbs < 1)
+        lbs = 1;
+    while (lba < dp->end)
+    {
+        prev = lba;
+        memset(resp, 0, ZONES_RESP_SZ);
+        if (scsi)
+        {
+            res = sg_report_zones(dp, lba, resp, ZONES_RESP_SZ);
+            n = res ? 0 : (int)(sg_get_unaligned_be32(resp) / 64);
+        }
+        else if (nvme)
+        {
+            res = nvme_report_zones(dp, lba, resp, ZONES_RESP_SZ);
+            n = res ? 0 : (int)sg_get_unaligned_le64(resp);
+        }
+        else
+        {
+            rep->sector = (uint64_t)lba * lbs;
+            rep->nr_zones = (ZONES_RESP_SZ - sizeof(*rep)) /
+                            sizeof(struct blk_zone);
+            res = ioctl(dp->fd, BLKREPORTZONE, rep);
+            n = res ? 0 : (int)rep->nr_zones;
+        }
+        if (n > ZONES_RESP_SZ / 64 - 1)
+            n = ZONES_RESP_SZ / 64 - 1;
+        if ((0 == n) && (0 == zones))
+        {
+            if (verbose || res)
+                pr2serr("%s: not a zoned device, reading every lba\n",
+                        dp->device_name);
+            extent_drop(dp);
+            free(resp);
+            return;
+        }
+        for (k = 0; k < n; ++k)
+        {
+            int type, cond;
+
+            if (scsi)
+            {
+                const uint8_t *bp = resp + 64 + 64 * k;
+
+                type = bp[0] & 0xf;
+                cond = bp[1] >> 4;
+                cap = (int64_t)sg_get_unaligned_be64(bp + 8);
+                start = (int64_t)sg_get_unaligned_be64(bp + 16);
+                wp = (int64_t)sg_get_unaligned_be64(bp + 24);
+                len = cap;
+            }
+            else if (nvme)
+            {
+                const uint8_t *bp = resp + 64 + 64 * k;
+
+                type = bp[0] & 0xf; /* sequential write required */
+                cond = bp[1] >> 4;
+                cap = (int64_t)sg_get_unaligned_le64(bp + 8);
+                start = (int64_t)sg_get_unaligned_le64(bp + 16);
+                wp = (int64_t)sg_get_unaligned_le64(bp + 24);
+                len = cap; /* a zone reports again if cap < size */
+            }
+            else
+            {
+                const struct blk_zone *zp = rep->zones + k;
+
+                type = zp->type;
+                cond = zp->cond;
+                start = (int64_t)(zp->start / lbs);
+                len = (int64_t)(zp->len / lbs);
+                cap = (rep->flags & BLK_ZONE_REP_CAPACITY) ?
+                      (int64_t)(zp->capacity / lbs) : len;
+                wp = (int64_t)(zp->wp / lbs);
+            }
+            if (start + len <= lba)
+                continue;
+            ++zones;
+            got = zone_plan(dp, type, cond, start, cap, wp, &empty, &offline);
+            if (got < 0)
+            {
+                free(resp);
+                return;
+            }
+            sel += got;
+            lba = start + len;
+        }
+        if (lba <= prev)
+            break; /* no zone past lba, do not loop */
+    }
+    free(resp);
+    if (NULL == dp->ext)
+        dp->ext = (t_extent *)calloc(1, sizeof(t_extent)); /* none: empty */
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: %d zones, %d empty, %d offline, reading %" PRId64 " of %"
+           PRId64 " blocks below the write pointers\n", dp->device_name,
+           zones, empty, offline, sel, dp->end - dp->start);
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* --tune: the transport alone, READ BUFFER (data mode) of the drive's
+ * buffer again and again for LINK_PROBE_NS, which moves nothing to or
+ * from the media. Against the link throughput cached for the model a
+ * drive that reads fine but whose link runs at a fraction of it (a bad
+ * cable, a PHY negotiated down) is flagged. Returns the MB/s, 0 when
+ * the drive has no buffer to read. */
+static double
+link_probe(t_dev *dp, double media_mbps)
+{
+    uint8_t desc[4], *buf, *free_buf;
+    struct lat_hist h;
+    char name[PATH_MAX], lbuf[256], p50[16], p99[16];
+    double model = dp->have_profile ? dp->profile.link_mbps : 0.0, mbps;
+    uint64_t t0, t, now;
+    int64_t bytes = 0;
+    int vb = verbose > 1 ? verbose - 1 : 0;
+    int len, res;
+    bool slow;
+
+    if (!(FT_SG & dp->out_type))
+        return 0.0;
+    memset(desc, 0, sizeof(desc));
+    res = sg_ll_read_buffer(dp->fd, 3 /* descriptor */, 0, 0, desc,
+                            sizeof(desc), false, vb);
+    len = (int)sg_get_unaligned_be24(desc + 1); /* BUFFER CAPACITY */
+    if (len > LINK_PROBE_MAX)
+        len = LINK_PROBE_MAX;
+    if ((dp->max_xfer > 0) && (len > dp->max_xfer))
+        len = dp->max_xfer;
+    if (res || (len <= 0))
+    {
+        if (verbose)
+            pr2serr("%s: no READ BUFFER, the link is not probed\n",
+                    dp->device_name);
+        return 0.0;
+    }
+    buf = io_buf(dp, len, &free_buf);
+    if (NULL == buf)
+        return 0.0;
+    lat_reset(&h);
+    t0 = now = lat_now_ns();
+    do
+    {
+        t = now;
+        res = sg_ll_read_buffer(dp->fd, 2 /* data */, 0, 0, buf, len, false,
+                                vb);
+        now = lat_now_ns();
+        if (res)
+            break;
+        lat_record(&h, now - t);
+        bytes += len;
+    } while (now - t0 < LINK_PROBE_NS);
+    iobuf_free(free_buf);
+    if (res || (0 == bytes))
+    {
+        pr2serr("%s: READ BUFFER failed, the link is not probed\n",
+                dp->device_name);
+        return 0.0;
+    }
+    mbps = bytes / ((now - t0) / 1e9) / 1e6;
+    slow = (model > 0) && (mbps < model * PROFILE_SLOW_PCT / 100);
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: link %.1f MB/s, READ BUFFER of %d bytes p50 %s p99 %s",
+           dp->device_name, mbps, len,
+           lat_str(lat_percentile(&h, 50.0), p50, sizeof(p50)),
+           lat_str(lat_percentile(&h, 99.0), p99, sizeof(p99)));
+    if (media_mbps > 0)
+        printf(", media %.1f MB/s", media_mbps);
+    printf("\n");
+    if (slow)
+        printf("%s: link below %d%% of the model's %.1f MB/s, a bad cable or "
+               "a downgraded PHY?\n", dp->device_name, PROFILE_SLOW_PCT,
+               model);
+    pthread_mutex_unlock(&out_mutex);
+    if (jsonl_enabled())
+        jsonl_printf("{\"type\":\"link\",\"device\":\"%s\",\"mb_s\":%.1f,"
+                     "\"buffer_bytes\":%d,\"media_mb_s\":%.1f,"
+                     "\"model_mb_s\":%.1f,\"slow\":%s,%s}",
+                     jsonl_escape(name, sizeof(name), dp->device_name), mbps,
+                     len, media_mbps, model, slow ? "true" : "false",
+                     json_latency(&h, lbuf, sizeof(lbuf)));
+    return mbps;
+}
+
+/* --tune: takes bpt and qd from the profile cached for the drive model,
+ * else calibrates and caches the result for the next drive of the same
+ * model. Without --tune a cached profile only provides the baseline the
+ * passes are compared against. */
+static void
+tune_or_load(t_dev *dp)
+{
+    double mbps, link;
+
+    if (dp->model_key[0] &&
+        (0 == profile_load(opt.profile_path, dp->model_key, &dp->profile)))
+        dp->have_profile = true;
+    if (!opt.tune)
+        return;
+    if (dp->have_profile && (dp->profile.bpt > 0)) /* else --cache-probe's */
+    {
+        dp->bpt = dp->profile.bpt;
+        dp->qd = (dp->profile.qd > MAX_QUEUE_DEPTH) ? MAX_QUEUE_DEPTH
+                                                     : dp->profile.qd;
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: cached profile, -n %d --qd %d, baseline %.1f MB/s\n",
+               dp->device_name, dp->bpt, dp->qd, dp->profile.mbps);
+        pthread_mutex_unlock(&out_mutex);
+        link = link_probe(dp, dp->profile.mbps);
+        /* a profile cached before the link was probed gets it now */
+        if ((link <= 0.0) || (dp->profile.link_mbps > 0.0))
+            return;
+        dp->profile.link_mbps = link;
+    }
+    else
+    {
+        mbps = tune_device(dp);
+        link = link_probe(dp, mbps);
+        if ((mbps <= 0.0) || ('\0' == dp->model_key[0]))
+            return;
+        dp->profile.bpt = dp->bpt;
+        dp->profile.qd = dp->qd;
+        dp->profile.mbps = mbps;
+        dp->profile.link_mbps = link;
+        dp->have_profile = true;
+    }
+    if (profile_store(opt.profile_path, dp->model_key, &dp->profile))
+        pr2serr("%s: could not update profile cache %s\n", dp->device_name,
+                opt.profile_path);
+}
+
+/* A device's line of the --checkpoint file, with its errors so far from
+ * the .map written next to it. */
+struct _ckpt
+{
+    char name[PATH_MAX];
+    char id[DEV_ID_SZ]; /* "-" -> unknown */
+    unsigned int passes_done;
+    unsigned int passes;
+    char label[8]; /* of pass passes_done + 1 */
+    int64_t lba;   /* every block of that pass below it has been read */
+    int64_t start;
+    int64_t end;
+    uint64_t seed;
+    int blk_sz;
+    int64_t num_sect;
+    int64_t scrub_full; /* --scrub, 0 -> never, or an older checkpoint */
+    struct badmap bad;
+    bool used; /* matched to a device */
+};
+
+typedef struct _ckpt t_ckpt;
+
+static t_ckpt *ckpts; /* --resume, read before any device starts */
+static int num_ckpts;
+static pthread_mutex_t ck_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Reads the --checkpoint file and its map for --resume. Returns 0, else
+ * -1 once reported. */
+static int
+checkpoint_read(void)
+{
+    char line[PATH_MAX + 512], map[PATH_MAX], label[8];
+    FILE *fp = fopen(opt.ck_path, "r");
+    t_ckpt *ck;
+    int n;
+
+    if (NULL == fp)
+    {
+        perror(opt.ck_path);
+        return -1;
+    }
+    if ((NULL == fgets(line, sizeof(line), fp)) ||
+        strncmp(line, CHECKPOINT_MAGIC, strlen(CHECKPOINT_MAGIC)))
+    {
+        pr2serr("%s is not a dskread checkpoint\n", opt.ck_path);
+        fclose(fp);
+        return -1;
+    }
+    snprintf(map, sizeof(map), "%s.map", opt.ck_path);
+    while (fgets(line, sizeof(line), fp))
+    {
+        ck = (t_ckpt *)realloc(ckpts, (num_ckpts + 1) * sizeof(t_ckpt));
+        if (NULL == ck)
+            break;
+        ckpts = ck;
+        ck += num_ckpts;
+        memset(ck, 0, sizeof(*ck));
+        n = sscanf(line, "%4095[^\t]\t%79s\t%u\t%u\t%7s\t%" SCNd64 "\t%" SCNd64
+                   "\t%" SCNd64 "\t%" SCNx64 "\t%d\t%" SCNd64 "\t%" SCNd64,
+                   ck->name, ck->id, &ck->passes_done, &ck->passes, label,
+                   &ck->lba, &ck->start, &ck->end, &ck->seed, &ck->blk_sz,
+                   &ck->num_sect, &ck->scrub_full);
+        if (n < 11)
+            continue;
+        snprintf(ck->label, sizeof(ck->label), "%s", label);
+        badmap_init(&ck->bad);
+        if (badmap_load(map, ck->name, &ck->bad) < 0)
+            pr2serr("%s: no error map in %s, starting an empty one\n",
+                    ck->name, map);
+        ++num_ckpts;
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* One checkpoint line and map record of dp, or of what an earlier run
+ * left for it while it has not got to its first pass, and the chunks
+ * read whole of the pass it would resume in, when a queued engine has
+ * kept them. */
+static void
+checkpoint_dev(FILE *fp, FILE *mfp, FILE *dfp, t_dev *dp)
+{
+    const t_ckpt *ck = NULL;
+    unsigned int done;
+    int64_t lba;
+    int k;
+
+    if (!__atomic_load_n(&dp->ck_ready, __ATOMIC_ACQUIRE))
+    {
+        for (k = 0; k < num_ckpts; ++k)
+            if (0 == strcmp(ckpts[k].name, dp->device_name))
+                ck = ckpts + k;
+        if (ck)
+        {
+            fprintf(fp, "%s\t%s\t%u\t%u\t%s\t%" PRId64 "\t%" PRId64 "\t%"
+                    PRId64 "\t%" PRIx64 "\t%d\t%" PRId64 "\t%" PRId64 "\n",
+                    ck->name, ck->id, ck->passes_done, ck->passes, ck->label,
+                    ck->lba, ck->start, ck->end, ck->seed, ck->blk_sz,
+                    ck->num_sect, ck->scrub_full);
+            badmap_save(mfp, ck->name, ck->blk_sz, ck->num_sect,
+                        (struct badmap *)&ck->bad);
+        }
+        return;
+    }
+    pthread_mutex_lock(&dp->report_mutex);
+    done = dp->passes_done;
+    lba = __atomic_load_n(&dp->cur_lba, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&dp->report_mutex);
+    if (dp->dmap.cnt && (dp->dmap_pass == done + 1) &&
+        (donemap_low(&dp->dmap) > lba))
+        lba = donemap_low(&dp->dmap); /* whole chunks past the mark */
+    fprintf(fp, "%s\t%s\t%u\t%u\t%s\t%" PRId64 "\t%" PRId64 "\t%" PRId64
+            "\t%" PRIx64 "\t%d\t%" PRId64 "\t%" PRId64 "\n", dp->device_name,
+            dp->dev_id[0] ? dp->dev_id : "-", done, opt.passes,
+            (done < opt.passes) ? patterns[done].label : "-", lba, dp->start,
+            dp->end, opt.seed, dp->blk_sz, dp->num_sect, dp->scrub_full);
+    badmap_save(mfp, dp->device_name, dp->blk_sz, dp->num_sect, &dp->bad);
+    if (dp->dmap.cnt && (dp->dmap_pass == done + 1))
+        donemap_save(dfp, dp->device_name, &dp->dmap);
+}
+
+/* Rewrites the --checkpoint file and its .map. Both are written under
+ * temporary names and renamed, map first, so a crash at any point
+ * leaves a checkpoint no older than one refresh. */
+static void
+checkpoint_write(void)
+{
+    char tmp[PATH_MAX + 8], map[PATH_MAX + 8], map_tmp[PATH_MAX + 16];
+    char done[PATH_MAX + 8], done_tmp[PATH_MAX + 16];
+    FILE *fp, *mfp, *dfp;
+    int k;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", opt.ck_path);
+    snprintf(map, sizeof(map), "%s.map", opt.ck_path);
+    snprintf(map_tmp, sizeof(map_tmp), "%s.map.tmp", opt.ck_path);
+    snprintf(done, sizeof(done), "%s.done", opt.ck_path);
+    snprintf(done_tmp, sizeof(done_tmp), "%s.done.tmp", opt.ck_path);
+    fp = fopen(tmp, "w");
+    mfp = fp ? fopen(map_tmp, "wb") : NULL;
+    dfp = mfp ? fopen(done_tmp, "wb") : NULL;
+    if (NULL == dfp)
+    {
+        if (mfp)
+            fclose(mfp);
+        if (fp)
+            fclose(fp);
+        perror(opt.ck_path);
+        return;
+    }
+    fprintf(fp, CHECKPOINT_MAGIC "\n");
+    pthread_mutex_lock(&ck_mutex);
+    for (k = 0; k < num_devs; ++k)
+        checkpoint_dev(fp, mfp, dfp, devs + k);
+    pthread_mutex_unlock(&ck_mutex);
+    if (fclose(dfp) | fclose(mfp) | fclose(fp))
+        perror(opt.ck_path);
+    else if (rename(done_tmp, done) || rename(map_tmp, map) ||
+             rename(tmp, opt.ck_path))
+        perror(opt.ck_path);
+}
+
+/* --resume: takes the checkpoint line of the disk in dp, by its id or
+ * else by its name, when the run it was saved by read the same range
+ * with the same patterns. The first pass to run then starts at
+ * dp->resume_lba and the errors found so far are in dp->bad again. */
+static void
+resume_device(t_dev *dp)
+{
+    t_ckpt *ck = NULL;
+    char path[PATH_MAX + 8];
+    bool same;
+    int k;
+
+    pthread_mutex_lock(&ck_mutex);
+    for (k = 0; (k < num_ckpts) && (NULL == ck); ++k)
+        if (!ckpts[k].used && dp->dev_id[0] &&
+            (0 == strcmp(ckpts[k].id, dp->dev_id)))
+            ck = ckpts + k;
+    for (k = 0; (k < num_ckpts) && (NULL == ck); ++k)
+        if (!ckpts[k].used && (0 == strcmp(ckpts[k].name, dp->device_name)))
+            ck = ckpts + k;
+    if (ck && dp->dev_id[0] && strcmp(ck->id, "-") &&
+        strcmp(ck->id, dp->dev_id))
+    {
+        pr2serr("%s: now %s, not %s of the checkpoint, starting over\n",
+                dp->device_name, dp->dev_id, ck->id);
+        ck = NULL;
+    }
+    same = ck && (ck->passes == opt.passes) && (ck->start == dp->start) &&
+           (ck->end == dp->end) && (ck->seed == opt.seed) &&
+           (ck->blk_sz == dp->blk_sz) &&
+           ((ck->passes_done >= opt.passes) ||
+            (0 == strcmp(ck->label, patterns[ck->passes_done].label)));
+    if (ck && !same)
+        pr2serr("%s: checkpoint is of other passes or range, starting "
+                "over\n", dp->device_name);
+    else if (ck)
+    {
+        struct badmap tmp = dp->bad;
+
+        ck->used = true;
+        dp->passes_done = ck->passes_done;
+        dp->scrub_full = ck->scrub_full;
+        if ((ck->lba > dp->start) && (ck->lba < dp->end))
+            dp->resume_lba = ck->lba;
+        snprintf(path, sizeof(path), "%s.done", opt.ck_path);
+        if ((ck->passes_done < opt.passes) &&
+            (0 == donemap_load(path, ck->name, &dp->dmap)))
+            dp->dmap_pass = ck->passes_done + 1; /* not read again */
+        /* swap the extents, each map keeps its own mutex */
+        dp->bad.ext = ck->bad.ext;
+        dp->bad.num = ck->bad.num;
+        dp->bad.cap = ck->bad.cap;
+        dp->bad.sorted = ck->bad.sorted;
+        ck->bad.ext = tmp.ext;
+        ck->bad.num = tmp.num;
+        ck->bad.cap = tmp.cap;
+        ck->bad.sorted = tmp.sorted;
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: resuming after %u of %u passes at lba %" PRId64 "\n",
+               dp->device_name, dp->passes_done, opt.passes,
+               (dp->resume_lba >= 0) ? dp->resume_lba : dp->start);
+        if (opt.scrub && dp->scrub_full)
+            printf("%s: last read in full %.1f days ago\n", dp->device_name,
+                   (time(NULL) - dp->scrub_full) / 86400.0);
+        pthread_mutex_unlock(&out_mutex);
+    }
+    pthread_mutex_unlock(&ck_mutex);
+}
+
+/* --retest: keeps in dp->ext the extents of dp in the map of an
+ * earlier --bad-map run, of any kind, within [dp->start, dp->end).
+ * Extents at most --retest-gap blocks apart become one window, the
+ * blocks between read too: on a disk that seeks, reading through a
+ * short gap costs less than a READ of its own, and the windows in lba
+ * order are one sweep of the heads. Returns the blocks to read, 0 when
+ * the map has none, -1 when it can not be read. */
+static int64_t
+retest_walk(t_dev *dp)
+{
+    struct badmap m;
+    int64_t lba, end, last, sel = 0, gaps = 0;
+    int64_t gap = (opt.retest_gap < 0) ? dp->bpt : opt.retest_gap;
+    size_t k;
+    int res;
+
+    badmap_init(&m);
+    res = badmap_load(opt.retest_path, dp->device_name, &m);
+    if (res < 0)
+    {
+        pr2serr("%s: can not read bad map %s\n", dp->device_name,
+                opt.retest_path);
+        badmap_free(&m);
+        return -1;
+    }
+    for (k = 0; k < m.num; ++k)
+    {
+        lba = m.ext[k].lba;
+        end = lba + m.ext[k].len;
+        if (lba < dp->start)
+            lba = dp->start;
+        if (end > dp->end)
+            end = dp->end;
+        if (end <= lba)
+            continue;
+        /* the map is sorted by lba, extents of other kinds may overlap */
+        last = dp->num_ext ? dp->ext[dp->num_ext - 1].lba +
+                                 dp->ext[dp->num_ext - 1].len
+                           : -1;
+        if ((last >= 0) && (lba > last) && (lba - last <= gap))
+        {
+            gaps += lba - last;
+            lba = last;
+        }
+        else if ((last >= 0) && (lba < last))
+            lba = (end > last) ? last : end;
+        if (extent_add(dp, lba, end - lba))
+        {
+            sel = -1;
+            break;
+        }
+        sel += end - lba;
+    }
+    if (verbose && (sel >= 0))
+        pr2serr("%s: retesting %zu extents in %d windows, %" PRId64
+                " blocks, %" PRId64 " of them between extents\n",
+                dp->device_name, m.num, dp->num_ext, sel, gaps);
+    badmap_free(&m);
+    return sel;
+}
+
+/* The n extents of list, sorted here, into dp->ext: clipped to
+ * [dp->start, dp->end) and merged where they overlap or touch. Returns
+ * the blocks they hold, -1 when out of memory. */
+static int64_t
+extent_list_take(t_dev *dp, t_extent *list, int n)
+{
+    int64_t lba, end, last, sel = 0;
+    int k;
+
+    qsort(list, n, sizeof(t_extent), cmp_extent);
+    for (k = 0; k < n; ++k)
+    {
+        lba = list[k].lba;
+        end = list[k].lba + list[k].len;
+        if (lba < dp->start)
+            lba = dp->start;
+        if (end > dp->end)
+            end = dp->end;
+        last = dp->num_ext ? dp->ext[dp->num_ext - 1].lba +
+                                 dp->ext[dp->num_ext - 1].len
+                           : -1;
+        if (lba < last)
+            lba = last;
+        if (end <= lba)
+            continue;
+        if (extent_add(dp, lba, end - lba))
+            return -1;
+        sel += end - lba;
+    }
+    return sel;
+}
+
+/* --ranges: one line of a range list into *ep, its device into dev
+ * (empty when the line names none). A line is lba, lba+n or
+ * first-last, or device, kind, first and last lba and blocks as
+ * --bad-map-text writes them. Returns 1, 0 for a blank line or a
+ * comment, -1 when it is neither. */
+static int
+ranges_line(char *line, t_extent *ep, char *dev, size_t dev_len)
+{
+    char *f[5], *save, *endp;
+    int64_t last;
+    int n = 0;
+
+    dev[0] = '\0';
+    if ((endp = strchr(line, '#')))
+        *endp = '\0';
+    for (f[n] = strtok_r(line, " \t\r\n", &save); f[n] && (n < 4);
+         f[++n] = strtok_r(NULL, " \t\r\n", &save))
+        ;
+    if (f[n])
+        ++n;
+    if (0 == n)
+        return 0;
+    if (5 == n)
+    {
+        snprintf(dev, dev_len, "%s", f[0]);
+        ep->lba = strtoll(f[2], &endp, 0);
+        if (*endp || (ep->lba < 0))
+            return -1;
+        last = strtoll(f[3], &endp, 0);
+        ep->len = last + 1 - ep->lba;
+        return (*endp || (ep->len < 1)) ? -1 : 1;
+    }
+    if (n > 1)
+        return -1;
+    ep->lba = strtoll(f[0], &endp, 0);
+    if ((endp == f[0]) || (ep->lba < 0))
+        return -1;
+    ep->len = 1;
+    if ('+' == *endp)
+        ep->len = strtoll(endp + 1, &endp, 0);
+    else if ('-' == *endp)
+    {
+        last = strtoll(endp + 1, &endp, 0);
+        ep->len = last + 1 - ep->lba;
+    }
+    return (*endp || (ep->len < 1)) ? -1 : 1;
+}
+
+/* --ranges: keeps in dp->ext the extents of file opt.ranges_path
+ * within [dp->start, dp->end), sorted and merged. A --bad-map map
+ * gives its record of dp, a --bad-map-text list its lines of dp, or
+ * all of them when it names one device only. Returns the blocks to
+ * read, 0 when the list has none of them, -1 when it can not be
+ * read. */
+static int64_t
+ranges_walk(t_dev *dp)
+{
+    char line[PATH_MAX + 128], dev[PATH_MAX], one[PATH_MAX] = "";
+    char magic[8] = "";
+    t_extent *list = NULL, *ep;
+    int64_t sel;
+    int k, n = 0, cap = 0, lineno = 0, res;
+    bool mine = false, many = false;
+    struct badmap m;
+    FILE *fp = fopen(opt.ranges_path, "r");
+
+    if (NULL == fp)
+    {
+        perror(opt.ranges_path);
+        return -1;
+    }
+    if ((fread(magic, 1, 7, fp) == 7) && (0 == memcmp(magic, "DSKBADM", 7)))
+    {
+        fclose(fp);
+        badmap_init(&m);
+        if (badmap_load(opt.ranges_path, dp->device_name, &m) < 0)
+        {
+            pr2serr("%s: can not read bad map %s\n", dp->device_name,
+                    opt.ranges_path);
+            badmap_free(&m);
+            return -1;
+        }
+        list = (t_extent *)calloc(m.num ? m.num : 1, sizeof(t_extent));
+        for (k = 0; list && (k < (int)m.num); ++k)
+        {
+            list[k].lba = m.ext[k].lba;
+            list[k].len = m.ext[k].len;
+        }
+        n = (int)m.num;
+        badmap_free(&m);
+        if (NULL == list)
+            goto oom;
+        goto clip;
+    }
+    rewind(fp);
+    while (fgets(line, sizeof(line), fp))
+    {
+        ++lineno;
+        if (cap == n)
+        {
+            cap = cap ? 2 * cap : 64;
+            ep = (t_extent *)realloc(list, cap * sizeof(t_extent));
+            if (NULL == ep)
+            {
+                fclose(fp);
+                goto oom;
+            }
+            list = ep;
+        }
+        res = ranges_line(line, list + n, dev, sizeof(dev));
+        if (res < 0)
+        {
+            pr2serr("%s:%d: not lba, lba+n, first-last or a --bad-map-text "
+                    "line\n", opt.ranges_path, lineno);
+            fclose(fp);
+            free(list);
+            return -1;
+        }
+        if (0 == res)
+            continue;
+        if (dev[0])
+        {
+            if (one[0] && strcmp(one, dev))
+                many = true;
+            else
+                snprintf(one, sizeof(one), "%s", dev);
+            if (strcmp(dev, dp->device_name))
+            {
+                list[n].len = -list[n].len; /* another's, kept for now */
+                ++n;
+                continue;
+            }
+            mine = true;
+        }
+        ++n;
+    }
+    fclose(fp);
+    /* the lines of other devices, unless it names only one */
+    for (k = 0; k < n; ++k)
+        if (list[k].len < 0)
+        {
+            if (mine || many)
+                list[k].len = 0;
+            else
+                list[k].len = -list[k].len;
+        }
+clip:
+    sel = extent_list_take(dp, list, n);
+    free(list);
+    if (verbose && (sel >= 0))
+        pr2serr("%s: --ranges: %d extents of the list in %d, %" PRId64
+                " blocks\n", dp->device_name, n, dp->num_ext, sel);
+    return sel;
+oom:
+    free(list);
+    pr2serr(">> heap problems, can not read %s\n", opt.ranges_path);
+    return -1;
+}
+
+/* --allocated: what fsmap.c reads through, and the extents it finds in
+ * use, in blocks of dp. */
+typedef struct _alloc_walk
+{
+    t_dev *dp;
+    uint8_t *buf; /* a transfer, io_buf() */
+    uint8_t *free_buf;
+    t_extent *list;
+    int n;
+    int cap;
+} t_alloc_walk;
+
+/* fsmap_read_fn: len bytes at off, read in whole blocks through
+ * isolate_read(), as the READs of the pass, a transfer at a time. */
+static int
+alloc_read(void *ctx, uint64_t off, void *buf, size_t len)
+{
+    t_alloc_walk *aw = (t_alloc_walk *)ctx;
+    t_dev *dp = aw->dp;
+    int64_t lba = off / dp->blk_sz;
+    size_t skip = off % dp->blk_sz, done = 0, n;
+    int blocks;
+
+    while (done < len)
+    {
+        blocks = (skip + len - done + dp->blk_sz - 1) / dp->blk_sz;
+        if (blocks > dp->bpt)
+            blocks = dp->bpt;
+        if ((lba + blocks > dp->num_sect) ||
+            isolate_read(dp, aw->buf, blocks, lba))
+            return -1;
+        n = (size_t)blocks * dp->blk_sz - skip;
+        if (n > len - done)
+            n = len - done;
+        memcpy((uint8_t *)buf + done, aw->buf + skip, n);
+        done += n;
+        skip = 0;
+        lba += blocks;
+    }
+    return 0;
+}
+
+/* fsmap_use_fn: the blocks [off, off + len) is in, kept in aw->list. */
+static int
+alloc_use(void *ctx, uint64_t off, uint64_t len)
+{
+    t_alloc_walk *aw = (t_alloc_walk *)ctx;
+    int64_t lba = off / aw->dp->blk_sz;
+    t_extent *ep;
+
+    if (0 == len)
+        return 0;
+    if (aw->n == aw->cap)
+    {
+        ep = (t_extent *)realloc(aw->list, (aw->cap ? 2 * aw->cap : 256) *
+                                                sizeof(t_extent));
+        if (NULL == ep)
+            return -1;
+        aw->list = ep;
+        aw->cap = aw->cap ? 2 * aw->cap : 256;
+    }
+    aw->list[aw->n].lba = lba;
+    aw->list[aw->n++].len =
+        (int64_t)((off + len + aw->dp->blk_sz - 1) / aw->dp->blk_sz) - lba;
+    return 0;
+}
+
+/* --allocated: keeps in dp->ext what of [dp->start, dp->end) is in
+ * use: the blocks of the GPT or MBR and, of each partition, those its
+ * ext2/3/4 or XFS filesystem has allocated, read from its bitmaps or
+ * free space b-trees with the READs of the pass. A partition whose
+ * filesystem is neither, or can not be followed, is read whole; with
+ * no partition table the device is taken as one. When nothing is
+ * known dp->ext stays NULL and every lba is read. */
+static void
+alloc_walk(t_dev *dp)
+{
+    struct fsmap_part parts[FSMAP_MAX_PARTS];
+    t_alloc_walk aw;
+    int64_t sel;
+    int k, n, fs, known = 0;
+
+    memset(&aw, 0, sizeof(aw));
+    aw.dp = dp;
+    aw.buf = io_buf(dp, (size_t)dp->bpt * dp->blk_sz, &aw.free_buf);
+    if (NULL == aw.buf)
+    {
+        pr2serr(">> heap problems, reading every lba\n");
+        return;
+    }
+    n = fsmap_parts(alloc_read, alloc_use, &aw, dp->blk_sz, dp->num_sect,
+                    parts, FSMAP_MAX_PARTS);
+    if (n < 0)
+    {
+        pr2serr("%s: --allocated: partition table unreadable, reading every "
+                "lba\n", dp->device_name);
+        goto fini;
+    }
+    if (0 == n)
+    {
+        parts[0].off = 0;
+        parts[0].len = (uint64_t)dp->num_sect * dp->blk_sz;
+    }
+    for (k = 0; k < (n ? n : 1); ++k)
+    {
+        int at = aw.n;
+
+        fs = fsmap_used(alloc_read, alloc_use, &aw, parts[k].off,
+                        parts[k].len);
+        if (fs > 0)
+        {
+            ++known;
+            if (verbose)
+                pr2serr("%s: --allocated: %s at lba %" PRIu64 ", %d extents "
+                        "in use\n", dp->device_name, fsmap_fs_str(fs),
+                        parts[k].off / dp->blk_sz, aw.n - at);
+            continue;
+        }
+        if (fs < 0)
+            pr2serr("%s: --allocated: filesystem at lba %" PRIu64 " not "
+                    "followed, reading it whole\n", dp->device_name,
+                    parts[k].off / dp->blk_sz);
+        if ((0 == n) || alloc_use(&aw, parts[k].off, parts[k].len))
+            break;
+    }
+    if ((0 == n) && (0 == known))
+    {
+        pr2serr("%s: --allocated: no partition table or filesystem known, "
+                "reading every lba\n", dp->device_name);
+        goto fini;
+    }
+    sel = (k < (n ? n : 1)) ? -1 : extent_list_take(dp, aw.list, aw.n);
+    if (sel < 0)
+    {
+        pr2serr(">> heap problems, reading every lba\n");
+        extent_drop(dp);
+        goto fini;
+    }
+    if (NULL == dp->ext)
+        dp->ext = (t_extent *)calloc(1, sizeof(t_extent)); /* none: empty */
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: allocated %" PRId64 " of %" PRId64 " blocks in %d extents, "
+           "%d partitions, %d filesystems followed\n", dp->device_name, sel,
+           dp->end - dp->start, dp->num_ext, n, known);
+    pthread_mutex_unlock(&out_mutex);
+fini:
+    free(aw.list);
+    iobuf_free(aw.free_buf);
+}
+
+/* Whether the holes of a file can be taken as read: every pass reads
+ * without a check, or checks for zeros, and only reads. */
+static bool
+file_holes_free(void)
+{
+    int k, i;
+
+    if (strcmp(cost_mode(), "read") || opt.manifest_path ||
+        opt.manifest_old || opt.crc || opt.stable || opt.erase)
+        return false;
+    for (k = 0; k < num_patterns; ++k)
+    {
+        if (CHECKDATAFLAG == patterns[k].flag)
+            continue;
+        if (patterns[k].flag)
+            return false;
+        for (i = 0; i < PATTERN_WORD_SZ; ++i)
+            if (patterns[k].word[i])
+                return false;
+    }
+    return true;
+}
+
+/* A regular file: keeps in dp->ext the blocks of [dp->start, dp->end)
+ * that have data, by SEEK_DATA and SEEK_HOLE. A hole reads as zeros by
+ * the filesystem's word, so it is not read when the passes check for
+ * nothing else. When the filesystem does not tell, dp->ext stays NULL
+ * and every block is read. */
+static void
+file_walk(t_dev *dp)
+{
+    off_t off = (off_t)dp->start * dp->blk_sz, data, hole;
+    off_t end = (off_t)dp->end * dp->blk_sz;
+    int64_t lba, sel = 0;
+
+    if (!file_holes_free())
+        return;
+    while (off < end)
+    {
+        data = lseek(dp->fd, off, SEEK_DATA);
+        if (data < 0)
+        {
+            if (ENXIO == errno)
+                break; /* a hole to the end */
+            pr2serr("%s: SEEK_DATA not supported, reading every block\n",
+                    dp->device_name);
+            extent_drop(dp);
+            return;
+        }
+        if (data >= end)
+            break;
+        hole = lseek(dp->fd, data, SEEK_HOLE);
+        if ((hole < 0) || (hole > end))
+            hole = end;
+        lba = data / dp->blk_sz;
+        off = ((hole + dp->blk_sz - 1) / dp->blk_sz) * dp->blk_sz;
+        if (off > end)
+            off = end;
+        sel += off / dp->blk_sz - lba;
+        if (extent_add(dp, lba, off / dp->blk_sz - lba))
+            return;
+    }
+    if (NULL == dp->ext)
+        dp->ext = (t_extent *)calloc(1, sizeof(t_extent)); /* none: empty */
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: data in %" PRId64 " of %" PRId64 " blocks in %d extents, "
+           "the holes zero by the filesystem, not read\n", dp->device_name,
+           sel, dp->end - dp->start, dp->num_ext);
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* The sysfs directory of the device at path into real. Returns 0, -1
+ * when it has none. */
+static int
+sysfs_dev_path(const char *path, char *real, struct stat *stp)
+{
+    char sys[64];
+
+    if (stat(path, stp) || !(S_ISCHR(stp->st_mode) || S_ISBLK(stp->st_mode)))
+        return -1;
+    snprintf(sys, sizeof(sys), "/sys/dev/%s/%u:%u",
+             S_ISCHR(stp->st_mode) ? "char" : "block", major(stp->st_rdev),
+             minor(stp->st_rdev));
+    return realpath(sys, real) ? 0 : -1;
+}
+
+/* The SCSI host adapter of the device at sysfs path real, as in
+ * .../host2/port-2:0/expander-2:0/.../end_device-2:0:5/... for a SAS
+ * disk behind an expander. Returns the host number, else -1. The
+ * expander is copied to exp, empty when there is none. */
+static int
+scsi_host_of(const char *real, char *exp, size_t exp_len)
+{
+    const char *cp, *host = NULL;
+    int host_no;
+
+    exp[0] = '\0';
+    for (cp = real; (cp = strstr(cp, "/host")); ++cp)
+        host = cp; /* the innermost, USB and the like nest them */
+    if ((NULL == host) || (1 != sscanf(host, "/host%d/", &host_no)))
+        return -1;
+    cp = strstr(host, "/expander-");
+    if (cp)
+        snprintf(exp, exp_len, "%.*s", (int)strcspn(cp + 1, "/"), cp + 1);
+    return host_no;
+}
+
+/* The enclosure and slot of the SCSI device whose sg or block node is
+ * at sysfs path real: its directory holds an "enclosure_device:SLOT"
+ * link to .../enclosure/ENCLOSURE/SLOT once the ses driver has read the
+ * enclosure's SES pages. Returns 0, -1 when there is none. */
+static int
+encl_of(const char *real, char *encl, size_t encl_len, char *slot,
+        size_t slot_len)
+{
+    char dir[PATH_MAX], link[PATH_MAX], *cp;
+    struct dirent *de;
+    DIR *dp;
+    int res = -1;
+
+    snprintf(dir, sizeof(dir), "%s", real);
+    cp = strstr(dir, "/scsi_generic/");
+    if (NULL == cp)
+        cp = strstr(dir, "/block/");
+    if (NULL == cp)
+        return -1;
+    *cp = '\0';
+    dp = opendir(dir);
+    if (NULL == dp)
+        return -1;
+    while ((de = readdir(dp)))
+    {
+        if (strncmp(de->d_name, "enclosure_device:", 17))
+            continue;
+        snprintf(link, sizeof(link), "%s/%s", dir, de->d_name);
+        if (NULL == realpath(link, dir))
+            break;
+        cp = strrchr(dir, '/');
+        if (NULL == cp)
+            break;
+        snprintf(slot, slot_len, "%s", cp + 1);
+        *cp = '\0';
+        cp = strrchr(dir, '/');
+        snprintf(encl, encl_len, "%s", cp ? cp + 1 : dir);
+        res = 0;
+        break;
+    }
+    closedir(dp);
+    return res;
+}
+
+static void
+gate_init(t_gate *g)
+{
+    memset(g, 0, sizeof(*g));
+    pthread_mutex_init(&g->mutex, NULL);
+    pthread_cond_init(&g->cond, NULL);
+}
+
+/* Waits until fewer than limit are in g, in turn, and gap_ns after the
+ * one let in before. */
+static void
+gate_enter(t_gate *g, int limit, uint64_t gap_ns)
+{
+    unsigned int t;
+    uint64_t now;
+
+    pthread_mutex_lock(&g->mutex);
+    t = g->ticket++;
+    while ((g->active >= limit) || (t != g->serving))
+        pthread_cond_wait(&g->cond, &g->mutex);
+    /* the others wait for this ticket meanwhile */
+    while (g->last_ns && ((now = lat_now_ns()) < g->last_ns + gap_ns))
+    {
+        pthread_mutex_unlock(&g->mutex);
+        throttle_sleep(g->last_ns + gap_ns - now);
+        pthread_mutex_lock(&g->mutex);
+    }
+    g->last_ns = lat_now_ns();
+    ++g->serving;
+    ++g->active;
+    pthread_cond_broadcast(&g->cond); /* the next ticket may fit too */
+    pthread_mutex_unlock(&g->mutex);
+}
+
+static void
+gate_leave(t_gate *g)
+{
+    pthread_mutex_lock(&g->mutex);
+    --g->active;
+    pthread_cond_broadcast(&g->cond);
+    pthread_mutex_unlock(&g->mutex);
+}
+
+/* set as a cpulist, "0-3,8-11". */
+static char *
+cpuset_str(const cpu_set_t *set, char *buf, int len)
+{
+    int c, lo, n = 0;
+
+    buf[0] = '\0';
+    for (c = 0; (c < CPU_SETSIZE) && (n < len); ++c)
+    {
+        if (!CPU_ISSET(c, set))
+            continue;
+        for (lo = c; (c + 1 < CPU_SETSIZE) && CPU_ISSET(c + 1, set); ++c)
+            ;
+        n += (lo == c) ? snprintf(buf + n, len - n, "%s%d", n ? "," : "", c)
+                       : snprintf(buf + n, len - n, "%s%d-%d", n ? "," : "",
+                                  lo, c);
+    }
+    return buf;
+}
+
+/* Finds the host adapter and enclosure of every device, for
+ * --per-host, --host-rate and --spin-up, and prints where each is. */
+static void
+topology_map(void)
+{
+    char real[PATH_MAX], exp[64], encl[64], cpus[256];
+    struct stat st;
+    int k, j, host_no, node;
+    bool shown;
+
+    pthread_mutex_lock(&rate_mutex);
+    shown = verbose || (opt.per_host > 0) || (opt.host_bps > 0) ||
+            (opt.host_iops > 0) || (opt.spin_up > 0);
+    pthread_mutex_unlock(&rate_mutex);
+
+    hosts = (t_host *)calloc(num_devs, sizeof(t_host));
+    encls = (t_encl *)calloc(num_devs, sizeof(t_encl));
+    if ((NULL == hosts) || (NULL == encls))
+        return;
+    for (k = 0; k < num_devs; ++k)
+    {
+        t_dev *dp = devs + k;
+
+        encl[0] = '\0';
+        host_no = -1;
+        exp[0] = '\0';
+        dp->numa_node = -1;
+        /* the polled queue pairs of spdk: take no interrupts */
+        if (0 == spdkdev_sysfs(dp->device_name, real, sizeof(real)))
+            dp->numa_node = iobuf_node_of(real);
+        else if (0 == sysfs_dev_path(dp->device_name, real, &st))
+        {
+            dp->numa_node = iobuf_node_of(real);
+            dp->irq_dom = (0 == iobuf_irq_domain(real, &dp->irq_cpus, &node));
+            if (dp->irq_dom && (node >= 0))
+                dp->numa_node = node;
+            host_no = scsi_host_of(real, exp, sizeof(exp));
+            if (encl_of(real, encl, sizeof(encl), dp->slot, sizeof(dp->slot)))
+                encl[0] = '\0';
+        }
+        for (j = 0; (j < num_encls) && strcmp(encls[j].name, encl); ++j)
+            ;
+        if (j == num_encls)
+        {
+            snprintf(encls[j].name, sizeof(encls[j].name), "%s", encl);
+            gate_init(&encls[j].gate);
+            ++num_encls;
+        }
+        dp->encl = encls + j;
+        if (host_no >= 0)
+        {
+            for (j = 0; (j < num_hosts) && (hosts[j].host_no != host_no); ++j)
+                ;
+            if (j == num_hosts)
+            {
+                hosts[j].host_no = host_no;
+                gate_init(&hosts[j].gate);
+                ++num_hosts;
+            }
+            dp->host = hosts + j;
+            ++dp->host->devices;
+        }
+        if (shown && ((host_no >= 0) || encl[0]))
+            printf("%s: host%d%s%s%s%s%s%s\n", dp->device_name, host_no,
+                   exp[0] ? " " : "", exp, encl[0] ? " enclosure " : "",
+                   encl, dp->slot[0] ? " slot " : "", dp->slot);
+        if (verbose && (dp->numa_node >= 0))
+            printf("%s: NUMA node %d\n", dp->device_name, dp->numa_node);
+        if (verbose && dp->irq_dom)
+            printf("%s: interrupts in the cache domain of cpus %s\n",
+                   dp->device_name,
+                   cpuset_str(&dp->irq_cpus, cpus, sizeof(cpus)));
+    }
+}
+
+/* --multipath: the sg nodes listed that are the same LU, by the NAA or
+ * EUI-64 designator of its Device Identification VPD page, as the two
+ * ports of a SAS drive are. The first of each is scanned, through them
+ * all; the others are its paths. */
+static void
+multipath_map(void)
+{
+    struct stat st;
+    int k, j, fd;
+
+    if ((MPATH_OFF == opt.multipath) || (num_devs < 2))
+        return;
+    for (k = 0; k < num_devs; ++k)
+    {
+        t_dev *dp = devs + k;
+
+        if ((stat(dp->device_name, &st) < 0) || !S_ISCHR(st.st_mode) ||
+            (SCSI_GENERIC_MAJOR != major(st.st_rdev)))
+            continue;
+        fd = open(dp->device_name, O_RDONLY | O_NONBLOCK);
+        if (fd < 0)
+            continue;
+        scsi_dev_id(dp, fd);
+        dev_close(fd);
+        if (strncmp(dp->dev_id, "naa.", 4) && strncmp(dp->dev_id, "eui.", 4))
+            continue; /* a serial number is not of the LU alone */
+        for (j = 0; j < k; ++j)
+        {
+            t_dev *first = devs + j;
+
+            if (first->path_of || strcmp(first->dev_id, dp->dev_id))
+                continue;
+            if (first->npaths >= MAX_PATHS)
+                break;
+            if (0 == first->npaths)
+                first->path[first->npaths++].dev = first;
+            first->path[first->npaths++].dev = dp;
+            first->path_pol = opt.multipath;
+            dp->path_of = first;
+            printf("%s: a path of %s, %s, scanned through it\n",
+                   dp->device_name, first->device_name, dp->dev_id);
+            break;
+        }
+    }
+    /* no more than the node alone until path_attach() opens the others */
+    for (k = 0; k < num_devs; ++k)
+        for (j = 0; j < devs[k].npaths; ++j)
+            devs[k].path[j].fd = -1;
+}
+
+/* Opens the further paths of dp, once it is open itself, with the flags
+ * of its fd. Those that do not open are left out. */
+static void
+path_attach(t_dev *dp)
+{
+    int k, n = 1, flags;
+
+    if (dp->npaths < 2)
+        return;
+    flags = fcntl(dp->fd, F_GETFL);
+    dp->path[0].fd = dp->fd;
+    if (dp->mmap_buf || !(FT_SG & dp->out_type) || (flags < 0))
+    {
+        pr2serr("%s: its other paths not used with --mmap\n",
+                dp->device_name);
+        dp->npaths = 0;
+        return;
+    }
+    for (k = 1; k < dp->npaths; ++k)
+    {
+        t_dev *pp = dp->path[k].dev;
+        int fd = open(pp->device_name, flags & (O_ACCMODE | O_NONBLOCK |
+                                                O_EXCL | O_DIRECT));
+
+        if (fd < 0)
+        {
+            pr2serr("%s: path %s: %s, left out\n", dp->device_name,
+                    pp->device_name, safe_strerror(errno));
+            continue;
+        }
+        dp->path[n] = dp->path[k];
+        dp->path[n++].fd = fd;
+    }
+    dp->npaths = n;
+    if (verbose)
+        pr2serr("%s: %d paths, READs to %s\n", dp->device_name, n,
+                (MPATH_RR == opt.multipath) ? "each in turn"
+                                            : "the least busy");
+}
+
+/* --sg-fds: opens the sg node of dp more times, with the flags of its
+ * fd, the READs then spread over them as over paths. Each fd has a
+ * reserved buffer of its own, so that many READs are in flight without
+ * the kernel allocating theirs, and an sg driver that serialises the
+ * commands of an fd has that many queues. */
+static void
+sg_fds_attach(t_dev *dp)
+{
+    int n = (opt.sg_fds < 0) ? dp->qd : opt.sg_fds;
+    int k, flags, fd;
+
+    if ((n < 2) || (dp->npaths > 1) || dp->flags.mmap ||
+        !(FT_SG & dp->out_type) || (FT_BLOCK & dp->out_type))
+        return;
+    if (n > MAX_PATHS)
+        n = MAX_PATHS;
+    flags = fcntl(dp->fd, F_GETFL);
+    if (flags < 0)
+        return;
+    dp->path[0].fd = dp->fd;
+    dp->path[0].dev = dp;
+    for (k = 1; k < n; ++k)
+    {
+        fd = open(dp->device_name, flags & (O_ACCMODE | O_NONBLOCK | O_DIRECT));
+        if (fd < 0)
+        {
+            pr2serr("%s: fd %d of %d: %s\n", dp->device_name, k + 1, n,
+                    safe_strerror(errno));
+            break;
+        }
+        memset(dp->path + k, 0, sizeof(dp->path[k]));
+        dp->path[k].fd = fd;
+        dp->path[k].dev = dp;
+    }
+    dp->npaths = k;
+    dp->path_pol = MPATH_LQ;
+    if (verbose)
+        pr2serr("%s: %d sg fds, READs to the least busy\n", dp->device_name,
+                dp->npaths);
+}
+
+/* The reserved buffer of every fd of dp sized to one transfer of -n,
+ * now that the block size is known and --tune has had its say. */
+static void
+sg_fds_resbuf(t_dev *dp)
+{
+    int bytes = dp->bpt * dp->blk_sz;
+    int k, got = sg_resbuf(dp->fd, bytes);
+
+    for (k = 1; k < dp->npaths; ++k)
+        if (dp->path[k].fd >= 0)
+            sg_resbuf(dp->path[k].fd, bytes);
+    if (verbose && (got >= 0) && (got < bytes))
+        pr2serr("%s: reserved buffer only %d of %d bytes, READs past it "
+                "need kernel memory\n", dp->device_name, got, bytes);
+}
+
+/* The commands and bytes of each path of dp, and its fds closed. */
+static void
+path_detach(t_dev *dp)
+{
+    int k;
+
+    if (dp->npaths < 2)
+        return;
+    pthread_mutex_lock(&out_mutex);
+    for (k = 0; k < dp->npaths; ++k)
+        if (dp->path[1].dev == dp) /* --sg-fds, all of the one node */
+            printf("%s: fd %d %" PRId64 " commands, %.1f MB\n",
+                   dp->device_name, k, dp->path[k].cmds,
+                   dp->path[k].bytes / 1e6);
+        else
+            printf("%s: path %s %" PRId64 " commands, %.1f MB\n",
+                   dp->device_name, dp->path[k].dev->device_name,
+                   dp->path[k].cmds, dp->path[k].bytes / 1e6);
+    pthread_mutex_unlock(&out_mutex);
+    for (k = 1; k < dp->npaths; ++k)
+        if (dp->path[k].fd >= 0)
+            dev_close(dp->path[k].fd);
+}
+
+/* The paths of dp as a JSON member, "" with one. */
+static char *
+json_paths(const t_dev *dp, char *buf, int len)
+{
+    char name[PATH_MAX];
+    int k, n;
+
+    buf[0] = '\0';
+    if (dp->npaths < 2)
+        return buf;
+    n = snprintf(buf, len, ",\"paths\":[");
+    for (k = 0; (k < dp->npaths) && (n < len); ++k)
+        n += snprintf(buf + n, len - n, "%s{\"device\":\"%s\",\"commands\":%"
+                      PRId64 ",\"bytes\":%" PRId64 "}", k ? "," : "",
+                      jsonl_escape(name, sizeof(name),
+                                   dp->path[k].dev->device_name),
+                      dp->path[k].cmds, dp->path[k].bytes);
+    if (n < len)
+        snprintf(buf + n, len - n, "]");
+    return buf;
+}
+
+/* The sg reserved buffers of dp, the kernel memory of a READ each, cut
+ * to one block while it waits for a --per-host slot (park) and grown
+ * back to a READ once it has one. */
+static void
+sg_fds_park(t_dev *dp, bool park)
+{
+    int bytes = park ? dp->blk_sz : dp->bpt * dp->blk_sz;
+    int k;
+
+    if (!dp->resbuf_park || (park == dp->resbuf_parked))
+        return;
+    sg_resbuf(dp->fd, bytes);
+    for (k = 1; k < dp->npaths; ++k)
+        if (dp->path[k].fd >= 0)
+            sg_resbuf(dp->path[k].fd, bytes);
+    dp->resbuf_parked = park;
+}
+
+/* The first time dp is let in, what it holds only while it is scanned.
+ * Out of memory, --poll and --adaptive-qd go without. */
+static void
+dev_run_get(t_dev *dp)
+{
+    if (dp->run || !(opt.poll_us || opt.qd_target_ns))
+        return;
+    dp->run = (t_run *)calloc(1, sizeof(*dp->run));
+    if (NULL == dp->run)
+        pr2serr("%s: out of memory, no --poll latencies or --adaptive-qd\n",
+                dp->device_name);
+}
+
+/* Waits for a --per-host slot of dp's adapter, in turn, then takes what
+ * it reads with. */
+static void
+host_enter(t_dev *dp)
+{
+    t_host *hp = dp->host;
+
+    if (hp && (opt.per_host > 0))
+    {
+        if (verbose && (hp->gate.active >= opt.per_host))
+            pr2serr("%s: waiting for one of the %d slots of host%d\n",
+                    dp->device_name, opt.per_host, hp->host_no);
+        gate_enter(&hp->gate, opt.per_host, 0);
+    }
+    dev_run_get(dp);
+    sg_fds_park(dp, false);
+}
+
+static void
+host_leave(t_dev *dp)
+{
+    if (dp->host && (opt.per_host > 0))
+    {
+        sg_fds_park(dp, true);
+        gate_leave(&dp->host->gate);
+    }
+}
+
+/* --spin-up: a drive that is not ready is started with START STOP UNIT,
+ * at most opt.spin_up of an enclosure at once and opt.spin_gap_ms
+ * apart, and waited for with TEST UNIT READY. Its scan begins as soon
+ * as it is ready, whatever the other drives are doing. */
+static void
+spin_up(t_dev *dp)
+{
+    uint64_t t0;
+    int res;
+
+    if ((opt.spin_up <= 0) || (NULL == dp->encl) ||
+        !((FT_SG | FT_BLOCK) & dp->out_type) || (FT_NVME & dp->out_type))
+        return;
+    res = sg_ll_test_unit_ready(dp->fd, 0, false, verbose > 1);
+    if (SG_LIB_CAT_NOT_READY != res)
+        return; /* spinning already, or not one to start */
+    gate_enter(&dp->encl->gate, opt.spin_up,
+               (uint64_t)opt.spin_gap_ms * 1000000ULL);
+    if (verbose)
+        pr2serr("%s: spinning up%s%s\n", dp->device_name,
+                dp->slot[0] ? " in slot " : "", dp->slot);
+    t0 = lat_now_ns();
+    res = sg_ll_start_stop_unit(dp->fd, true, 0, 0, false, false, true, false,
+                                verbose > 1);
+    if (res && verbose)
+        pr2serr("%s: START STOP UNIT: %d\n", dp->device_name, res);
+    do
+    {
+        throttle_sleep(SPIN_POLL_MS * 1000000ULL);
+        res = sg_ll_test_unit_ready(dp->fd, 0, false, verbose > 1);
+    } while (((SG_LIB_CAT_NOT_READY == res) ||
+              (SG_LIB_CAT_UNIT_ATTENTION == res)) &&
+             (lat_now_ns() - t0 < SPIN_TIMEOUT_S * 1000000000ULL));
+    gate_leave(&dp->encl->gate);
+    if (SG_LIB_CAT_NOT_READY == res)
+        pr2serr("%s: not ready %d s after START STOP UNIT, reading anyway\n",
+                dp->device_name, SPIN_TIMEOUT_S);
+    else if (verbose)
+        pr2serr("%s: ready after %.1f s\n", dp->device_name,
+                (lat_now_ns() - t0) / 1e9);
+}
+
+/* The transport of the device at sysfs path real, from the kind of
+ * node its path goes through. */
+static const char *
+transport_of(t_dev *dp, const char *real)
+{
+    if (FT_NVME & dp->out_type)
+        return "nvme";
+    return devscan_transport(real);
+}
+
+/* The pass-through the library binds dp->fd to, from its fd cache */
+static const char *
+passthru_of(t_dev *dp, struct sg_pt_fd_info *fip)
+{
+    if (sg_pt_fd_info(dp->fd, fip, verbose > 1))
+        memset(fip, 0, sizeof(*fip));
+    if (fip->is_sg)
+        return "sg";
+    if (fip->is_bsg)
+        return "bsg";
+    if (fip->is_nvme)
+        return "nvme";
+    return (FT_SG & dp->out_type) ? "sg_io" : "none";
+}
+
+/* The number in sysfs attribute path into *vp. Returns 0, else -1. */
+static int
+sysfs_int64(const char *path, int64_t *vp)
+{
+    FILE *fp = fopen(path, "r");
+    int res;
+
+    if (NULL == fp)
+        return -1;
+    res = (1 == fscanf(fp, "%" SCNd64, vp)) ? 0 : -1;
+    fclose(fp);
+    return res;
+}
+
+/* The string in sysfs attribute path into buf, its newline cut.
+ * Returns 0, else -1. */
+static int
+sysfs_str(const char *path, char *buf, int len)
+{
+    FILE *fp = fopen(path, "r");
+    bool ok;
+
+    if (NULL == fp)
+        return -1;
+    ok = (NULL != fgets(buf, len, fp));
+    fclose(fp);
+    if (ok)
+        buf[strcspn(buf, "\n")] = '\0';
+    return ok ? 0 : -1;
+}
+
+/* --array: when dp is a member of an md array, its role, data offset
+ * and the chunks its READs end on, from /sys/block/<md>/md; the array
+ * goes into mds[]. An sg node is taken as the disk it is the generic
+ * node of. */
+static void
+array_probe(t_dev *dp)
+{
+    char real[PATH_MAX], path[PATH_MAX + 300], name[64], buf[64];
+    struct dirent *de;
+    struct stat st;
+    int64_t v;
+    DIR *dir;
+    t_md *mp;
+    int k;
+
+    if (dp->sim || sysfs_dev_path(dp->device_name, real, &st))
+        return;
+    if (!S_ISBLK(st.st_mode))
+    {
+        snprintf(path, sizeof(path), "%s/device/block", real);
+        dir = opendir(path);
+        while (dir && (de = readdir(dir)) && ('.' == de->d_name[0]))
+            ;
+        if (NULL == dir)
+            return;
+        snprintf(path, sizeof(path), "%s/device/block/%s", real,
+                 de ? de->d_name : "");
+        closedir(dir);
+        if (NULL == realpath(path, real))
+            return;
+    }
+    snprintf(path, sizeof(path), "%s/holders", real);
+    dir = opendir(path);
+    if (NULL == dir)
+        return;
+    name[0] = '\0';
+    while ((de = readdir(dir)))
+        if (0 == strncmp(de->d_name, "md", 2))
+        {
+            snprintf(name, sizeof(name), "%s", de->d_name);
+            break;
+        }
+    closedir(dir);
+    if (!name[0])
+        return;
+    for (k = 0; (k < num_mds) && strcmp(mds[k].name, name); ++k)
+        ;
+    if ((k == num_mds) && (num_mds < MAX_MDS))
+    {
+        mp = mds + num_mds;
+        memset(mp, 0, sizeof(*mp));
+        snprintf(mp->name, sizeof(mp->name), "%s", name);
+        snprintf(path, sizeof(path), "/sys/block/%s/md/level", name);
+        mp->level = (0 == sysfs_str(path, buf, sizeof(buf))) &&
+                            (0 == strncmp(buf, "raid", 4))
+                        ? atoi(buf + 4) : -1;
+        if ((0 != mp->level) && (1 != mp->level) && (4 != mp->level) &&
+            (5 != mp->level) && (6 != mp->level) && (10 != mp->level))
+            mp->level = -1;
+        snprintf(path, sizeof(path), "/sys/block/%s/md/layout", name);
+        mp->layout = (0 == sysfs_int64(path, &v)) ? (int)v : 0;
+        snprintf(path, sizeof(path), "/sys/block/%s/md/raid_disks", name);
+        mp->disks = (0 == sysfs_int64(path, &v)) ? (int)v : 0;
+        snprintf(path, sizeof(path), "/sys/block/%s/md/chunk_size", name);
+        mp->chunks = (0 == sysfs_int64(path, &v)) && (v >= 512);
+        mp->chunk_sectors = mp->chunks ? v / 512 : ARRAY_ROW;
+        ++num_mds;
+    }
+    if (k == num_mds)
+        return; /* more arrays than MAX_MDS */
+    mp = mds + k;
+    snprintf(path, sizeof(path), "/sys/block/%s/md/dev-%s/offset", name,
+             strrchr(real, '/') + 1);
+    if (sysfs_int64(path, &dp->md_offset))
+        return; /* not an active member */
+    snprintf(path, sizeof(path), "/sys/block/%s/md/dev-%s/slot", name,
+             strrchr(real, '/') + 1);
+    dp->md_slot = ((0 == sysfs_int64(path, &v)) && (v >= 0)) ? (int)v : -1;
+    dp->md_id = k;
+}
+
+/* --array: the chunks of member dp in its blocks, once they are known,
+ * for range_next() to end READs on. */
+static void
+array_align(t_dev *dp)
+{
+    const t_md *mp = mds + dp->md_id;
+
+    if (mp->chunks && (0 == (mp->chunk_sectors * 512) % dp->blk_sz))
+    {
+        dp->md_chunk = mp->chunk_sectors * 512 / dp->blk_sz;
+        dp->md_lba = dp->md_offset * 512 / dp->blk_sz;
+    }
+    pthread_mutex_lock(&out_mutex);
+    if (mp->chunks)
+        printf("%s: member %d of %s, raid%d of %d, chunk %" PRId64 " KiB, "
+               "data from sector %" PRId64 "\n", dp->device_name,
+               dp->md_slot, mp->name, mp->level, mp->disks,
+               mp->chunk_sectors / 2, dp->md_offset);
+    else
+        printf("%s: member %d of %s, raid%d of %d, data from sector %" PRId64
+               "\n", dp->device_name, dp->md_slot, mp->name, mp->level,
+               mp->disks, dp->md_offset);
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* --array: where sector sec of member dp is in its array: its stripe
+ * (row of chunks) into *stripep and its role into *role, 'D' data, 'P'
+ * or 'Q' parity, 'M' md metadata before the data, 'S' a spare and '?'
+ * a layout not mapped here. Returns the array sector of data, else
+ * -1. The layouts are those of md's raid5 and raid6 (the four left
+ * and right, symmetric and asymmetric, and parity first or last) and
+ * the near copies of raid10. */
+static int64_t
+array_sector(const t_dev *dp, int64_t sec, int64_t *stripep, char *role)
+{
+    const t_md *mp = mds + dp->md_id;
+    int64_t rel = sec - dp->md_offset, cs = mp->chunk_sectors, stripe;
+    int n = mp->disks, d = dp->md_slot, data = n, pd = -1, qd = -1, dd = d;
+    int nc;
+
+    *stripep = -1;
+    if (rel < 0)
+    {
+        *role = 'M';
+        return -1;
+    }
+    if ((d < 0) || (d >= n))
+    {
+        *role = 'S';
+        return -1;
+    }
+    stripe = rel / cs;
+    *stripep = stripe;
+    *role = 'D';
+    switch (mp->level)
+    {
+    case 1:
+        return rel;
+    case 0:
+        return (stripe * n + d) * cs + rel % cs;
+    case 10:
+        nc = mp->layout & 0xff;
+        if ((nc < 1) || (((mp->layout >> 8) & 0xff) > 1) ||
+            (mp->layout & 0x10000))
+            break; /* far and offset copies */
+        return (stripe * n + d) / nc * cs + rel % cs;
+    case 4:
+        pd = n - 1;
+        data = n - 1;
+        break;
+    case 5:
+        data = n - 1;
+        switch (mp->layout)
+        {
+        case 0: /* left asymmetric */
+        case 2: /* left symmetric */
+            pd = data - (int)(stripe % n);
+            break;
+        case 1: /* right asymmetric */
+        case 3: /* right symmetric */
+            pd = (int)(stripe % n);
+            break;
+        case 4: /* parity 0 */
+            pd = 0;
+            break;
+        case 5: /* parity n */
+            pd = data;
+            break;
+        }
+        if ((pd >= 0) && (d != pd))
+            dd = ((2 == mp->layout) || (3 == mp->layout))
+                     ? (d - pd - 1 + n) % n
+                     : (d > pd) ? d - 1 : d;
+        break;
+    case 6:
+        data = n - 2;
+        if (mp->layout > 3)
+            break;
+        pd = (mp->layout & 1) ? (int)(stripe % n) : n - 1 - (int)(stripe % n);
+        qd = (pd + 1) % n;
+        if ((d == pd) || (d == qd))
+            break;
+        if (mp->layout >= 2) /* symmetric */
+            dd = (d - pd - 2 + 2 * n) % n;
+        else
+            dd = (qd == 0) ? d - 1 : (d > qd) ? d - 2 : d;
+        break;
+    }
+    if ((mp->level < 4) || (pd < 0))
+    {
+        *role = '?';
+        return -1;
+    }
+    if ((d == pd) || (d == qd))
+    {
+        *role = (d == pd) ? 'P' : 'Q';
+        return -1;
+    }
+    return (stripe * data + dd) * cs + rel % cs;
+}
+
+static int
+cmp_llu2(const void *a, const void *b)
+{
+    const uint64_t *x = (const uint64_t *)a, *y = (const uint64_t *)b;
+
+    if (x[0] != y[0])
+        return (x[0] > y[0]) - (x[0] < y[0]);
+    return (x[1] > y[1]) - (x[1] < y[1]);
+}
+
+/* --array: the bad extents of the members of each array, where they
+ * are in the array, and the stripes (for raid1 and raid10 the array
+ * chunks) with bad blocks on more members than the level can rebuild
+ * from. */
+static void
+array_report(void)
+{
+    int64_t stripe, s0, s1, sec, asec, key, first, over;
+    uint64_t *keys;
+    const struct badmap_ext *e;
+    int i, k, m, nkeys, listed, spare, members, spb, cnt;
+    size_t j;
+    char role;
+
+    keys = (uint64_t *)malloc(ARRAY_KEYS_MAX * 2 * sizeof(uint64_t));
+    if (NULL == keys)
+        return;
+    for (i = 0; i < num_mds; ++i)
+    {
+        const t_md *mp = mds + i;
+
+        spare = (0 == mp->level) ? 0 : (1 == mp->level) ? mp->disks - 1
+                : (6 == mp->level) ? 2
+                : (10 == mp->level) ? (mp->layout & 0xff) - 1 : 1;
+        nkeys = listed = members = 0;
+        pthread_mutex_lock(&out_mutex);
+        for (k = 0; k < num_devs; ++k)
+        {
+            t_dev *dp = devs + k;
+
+            if (i != dp->md_id)
+                continue;
+            ++members;
+            spb = dp->blk_sz / 512;
+            badmap_compact(&dp->bad);
+            for (j = 0; j < dp->bad.num; ++j)
+            {
+                e = dp->bad.ext + j;
+                sec = e->lba * spb;
+                asec = array_sector(dp, sec, &stripe, &role);
+                if (listed++ < ARRAY_REPORT_MAX)
+                {
+                    printf("%s: %s %s lba %" PRId64 " +%u: ", mp->name,
+                           dp->device_name, badmap_kind_str(e->kind), e->lba,
+                           e->len);
+                    if (asec >= 0)
+                        printf("stripe %" PRId64 ", array sector %" PRId64
+                               "\n", stripe, asec);
+                    else if (stripe >= 0)
+                        printf("stripe %" PRId64 ", %s\n", stripe,
+                               ('?' == role) ? "layout not mapped"
+                                             : ('P' == role) ? "parity P"
+                                                             : "parity Q");
+                    else
+                        printf("%s\n", ('M' == role) ? "md metadata"
+                                                     : "a spare");
+                }
+                if ((BADMAP_BAD != e->kind) || (stripe < 0))
+                    continue;
+                /* the stripes or array chunks the extent is in */
+                s0 = stripe;
+                array_sector(dp, (e->lba + e->len) * spb - 1, &s1, &role);
+                for (; (s0 <= s1) && (nkeys < ARRAY_KEYS_MAX); ++s0)
+                {
+                    key = s0;
+                    if ((1 == mp->level) || (10 == mp->level))
+                    {
+                        asec = array_sector(dp, dp->md_offset +
+                                                    s0 * mp->chunk_sectors,
+                                            &stripe, &role);
+                        if (asec < 0)
+                            continue;
+                        key = asec / mp->chunk_sectors;
+                    }
+                    keys[2 * nkeys] = (uint64_t)key;
+                    keys[2 * nkeys++ + 1] = (uint64_t)dp->md_slot;
+                }
+            }
+        }
+        if (listed > ARRAY_REPORT_MAX)
+            printf("%s: and %d bad extents more\n", mp->name,
+                   listed - ARRAY_REPORT_MAX);
+        qsort(keys, nkeys, 2 * sizeof(uint64_t), cmp_llu2);
+        for (k = 0, over = 0, first = -1; k < nkeys; k = m)
+        {
+            for (m = k + 1, cnt = 1;
+                 (m < nkeys) && (keys[2 * m] == keys[2 * k]); ++m)
+                if (keys[2 * m + 1] != keys[2 * (m - 1) + 1])
+                    ++cnt; /* another member */
+            if ((cnt > spare) && (0 == over++))
+                first = (int64_t)keys[2 * k];
+        }
+        if (over)
+            printf("%s: %" PRId64 " %s with bad blocks on more members than "
+                   "raid%d can rebuild from, first %" PRId64 "\n", mp->name,
+                   over, ((1 == mp->level) || (10 == mp->level))
+                             ? "array chunks" : "stripes", mp->level, first);
+        else
+            printf("%s: %d members read, %d bad extents, no %s past what "
+                   "raid%d can rebuild\n", mp->name, members, listed,
+                   ((1 == mp->level) || (10 == mp->level)) ? "array chunk"
+                                                            : "stripe",
+                   mp->level);
+        pthread_mutex_unlock(&out_mutex);
+    }
+    free(keys);
+}
+
+/* The actuators of dp, from the Concurrent Positioning Ranges VPD page
+ * of a SCSI device, else the independent access ranges the block layer
+ * has from it, in 512 byte sectors. More than one, in order and
+ * covering the capacity, and the queued engines read each as a stream
+ * of its own. */
+static void
+actuator_map(t_dev *dp)
+{
+    uint8_t vpd[64 + 32 * MAX_ACTUATORS];
+    char path[PATH_MAX];
+    struct stat st;
+    int64_t sect, len;
+    int k, n = 0, vlen;
+
+    dp->nact = 0;
+    if (!opt.actuators || dp->path_of)
+        return;
+    if (FT_SG & dp->out_type)
+    {
+        memset(vpd, 0, sizeof(vpd));
+        if (sg_ll_inquiry(dp->fd, false, true, 0xb9, vpd, sizeof(vpd), false,
+                          verbose > 1 ? verbose - 1 : 0) || (0xb9 != vpd[1]))
+            return;
+        vlen = sg_get_unaligned_be16(vpd + 2) + 4;
+        if (vlen > (int)sizeof(vpd))
+        {
+            pr2serr("%s: more than %d positioning ranges, read as one\n",
+                    dp->device_name, MAX_ACTUATORS);
+            return;
+        }
+        /* 64 bytes of header, then a 32 byte descriptor a range */
+        for (k = 64; k + 32 <= vlen; k += 32, ++n)
+        {
+            dp->act[n].lba = (int64_t)sg_get_unaligned_be64(vpd + k + 8);
+            dp->act[n].end = dp->act[n].lba +
+                             (int64_t)sg_get_unaligned_be64(vpd + k + 16);
+        }
+    }
+    else if ((FT_BLOCK & dp->out_type) && (0 == fstat(dp->fd, &st)))
+    {
+        for (n = 0; n <= MAX_ACTUATORS; ++n)
+        {
+            snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/queue/"
+                     "independent_access_ranges/%d/sector",
+                     major(st.st_rdev), minor(st.st_rdev), n);
+            if (sysfs_int64(path, &sect))
+                break;
+            snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/queue/"
+                     "independent_access_ranges/%d/nr_sectors",
+                     major(st.st_rdev), minor(st.st_rdev), n);
+            if ((n == MAX_ACTUATORS) || sysfs_int64(path, &len))
+                return;
+            dp->act[n].lba = sect * 512 / dp->blk_sz;
+            dp->act[n].end = (sect + len) * 512 / dp->blk_sz;
+        }
+    }
+    if (n < 2)
+        return;
+    for (k = 0; k < n; ++k)
+        if ((dp->act[k].lba != (k ? dp->act[k - 1].end : 0)) ||
+            (dp->act[k].end <= dp->act[k].lba))
+            break;
+    if ((k < n) || (dp->act[n - 1].end != dp->num_sect))
+    {
+        if (verbose)
+            pr2serr("%s: positioning ranges not one after the other over "
+                    "the capacity, read as one\n", dp->device_name);
+        return;
+    }
+    for (k = 0; k < n; ++k)
+        dp->act[k].bytes = 0;
+    dp->nact = n;
+}
+
+/* The actuators of dp as a JSON member, "" with one. */
+static char *
+json_actuators(const t_dev *dp, char *buf, int len)
+{
+    int k, n;
+
+    buf[0] = '\0';
+    if (dp->nact < 2)
+        return buf;
+    n = snprintf(buf, len, ",\"actuators\":[");
+    for (k = 0; (k < dp->nact) && (n < len); ++k)
+        n += snprintf(buf + n, len - n, "%s{\"lba\":%" PRId64 ",\"blocks\":%"
+                      PRId64 ",\"bytes\":%" PRId64 "}", k ? "," : "",
+                      dp->act[k].lba, dp->act[k].end - dp->act[k].lba,
+                      dp->act[k].bytes);
+    if (n < len)
+        snprintf(buf + n, len - n, "]");
+    return buf;
+}
+
+/* Completes the profile of dp once its capacity is known: physical
+ * block size, transfer limits and transport. Prints it as one row and,
+ * with --jsonl, one "probe" record, as the scan of dp begins. */
+static void
+probe_profile(t_dev *dp, double t0)
+{
+    char real[PATH_MAX], name[PATH_MAX], id[2 * sizeof(dp->dev_id)];
+    uint8_t rc16[RCAP16_REPLY_LEN];
+    struct sg_pt_fd_info fi;
+    const char *pt;
+    struct stat st;
+    unsigned int pbsz = 0;
+    int k, align_off = 0;
+
+    dp->pblk_sz = dp->blk_sz;
+    dp->align_lba = 0;
+    if ((FT_SG & dp->out_type) &&
+        (0 == sg_ll_readcap_16(dp->fd, false, 0, rc16, sizeof(rc16), false,
+                               verbose > 1)))
+    {
+        dp->pblk_sz = dp->blk_sz << (rc16[13] & 0xf); /* LBPPBE */
+        /* LOWEST ALIGNED LOGICAL BLOCK ADDRESS */
+        dp->align_lba = sg_get_unaligned_be16(rc16 + 14) & 0x3fff;
+    }
+    else if ((FT_BLOCK & dp->out_type) &&
+             (0 == ioctl(dp->fd, BLKPBSZGET, &pbsz)) && pbsz)
+    {
+        dp->pblk_sz = (int)pbsz;
+        if ((0 == ioctl(dp->fd, BLKALIGNOFF, &align_off)) && (align_off > 0))
+            dp->align_lba = align_off / dp->blk_sz;
+    }
+    tune_limits(dp, &dp->max_xfer, &dp->opt_xfer);
+    actuator_map(dp);
+    snprintf(dp->transport, sizeof(dp->transport), "%s",
+             transport_of(dp, sysfs_dev_path(dp->device_name, real, &st) ?
+                              NULL : real));
+    pt = passthru_of(dp, &fi);
+    printf("%s: %s %s, %" PRId64 " blocks of %d (%d physical), max transfer "
+           "%d KiB, probed in %.0f ms\n", dp->device_name, dp->transport,
+           dp->dev_id[0] ? dp->dev_id : "-", dp->num_sect, dp->blk_sz,
+           dp->pblk_sz, dp->max_xfer / 1024, (mono_secs() - t0) * 1000);
+    if (verbose && fi.sg_version)
+        pr2serr("%s: pass-through %s, sg driver %d.%d.%d\n", dp->device_name,
+                pt, fi.sg_version / 10000, (fi.sg_version / 100) % 100,
+                fi.sg_version % 100);
+    else if (verbose)
+        pr2serr("%s: pass-through %s\n", dp->device_name, pt);
+    for (k = 0; k < dp->nact; ++k)
+        printf("%s: actuator %d, lbas %" PRId64 " to %" PRId64 ", read as a "
+               "stream of its own\n", dp->device_name, k, dp->act[k].lba,
+               dp->act[k].end - 1);
+    if (jsonl_enabled())
+        jsonl_printf("{\"type\":\"probe\",\"device\":\"%s\",\"transport\":"
+                     "\"%s\",\"id\":\"%s\",\"blocks\":%" PRId64 ","
+                     "\"block_size\":%d,\"physical_block_size\":%d,"
+                     "\"max_transfer\":%d,\"opt_transfer\":%d,"
+                     "\"passthru\":\"%s\",\"sg_version\":%d,"
+                     "\"nsid\":%u,\"actuators\":%d,\"probe_ms\":%.0f}",
+                     jsonl_escape(name, sizeof(name), dp->device_name),
+                     dp->transport, jsonl_escape(id, sizeof(id), dp->dev_id),
+                     dp->num_sect, dp->blk_sz, dp->pblk_sz, dp->max_xfer,
+                     dp->opt_xfer, pt, fi.sg_version, fi.nvme_nsid,
+                     dp->nact ? dp->nact : 1, (mono_secs() - t0) * 1000);
+}
+
+/* What a device is made of, for its default policy. */
+#define MTYPE_UNKNOWN 0
+#define MTYPE_HDD 1  /* rotating, conventional recording */
+#define MTYPE_SMR 2  /* rotating, zoned: host aware, drive or host managed */
+#define MTYPE_SSD 3  /* SCSI or SATA flash */
+#define MTYPE_NVME 4
+
+/* The defaults of each media type where -n, --qd and --tune leave them:
+ * sequential streams of large READs at a shallow queue for disks, whose
+ * heads a deeper one only sends back and forth; SMR at one, its cleaning
+ * stalls given a long timeout; smaller READs at a deep queue for flash,
+ * which reads its dies in parallel. */
+static const struct media_policy
+{
+    const char *name;
+    int bytes;      /* per READ, 0 -> -n as it is */
+    int qd;         /* 0 -> --qd as it is */
+    int timeout_ms; /* of the READs through SG_IO */
+} media_policies[] = {
+    {"unknown", 0, 0, DEF_TIMEOUT},
+    {"hdd", 1024 * 1024, 2, 60000},
+    {"smr", 1024 * 1024, 1, 120000},
+    {"ssd", 256 * 1024, 16, 30000},
+    {"nvme", 128 * 1024, 32, 30000},
+};
+
+/* The media type of dp: for SCSI the Block Device Characteristics VPD
+ * page (MEDIUM ROTATION RATE, ZONED) and a host managed zoned pdt, for
+ * block devices queue/rotational and queue/zoned in sysfs (a partition
+ * has them a level up), any NVMe namespace flash. */
+static int
+media_type(t_dev *dp)
+{
+    uint8_t vpd[64];
+    char path[PATH_MAX];
+    struct stat st;
+    int64_t rot;
+    int k;
+
+    if (FT_NVME & dp->out_type)
+        return MTYPE_NVME;
+    if ((FT_SG & dp->out_type) && !(FT_BLOCK & dp->out_type))
+    {
+        if (0x14 == dp->flags.pdt)
+            return MTYPE_SMR;
+        memset(vpd, 0, sizeof(vpd));
+        if (sg_ll_inquiry(dp->fd, false, true, 0xb1, vpd, sizeof(vpd), false,
+                          verbose > 1 ? verbose - 1 : 0) || (0xb1 != vpd[1]))
+            return MTYPE_UNKNOWN;
+        rot = sg_get_unaligned_be16(vpd + 4);
+        if (1 == rot)
+            return MTYPE_SSD;
+        if (0 == rot)
+            return MTYPE_UNKNOWN; /* not reported */
+        return (vpd[8] & 0x30) ? MTYPE_SMR : MTYPE_HDD;
+    }
+    if (!(FT_BLOCK & dp->out_type) || (FT_FILE & dp->out_type) ||
+        fstat(dp->fd, &st))
+        return MTYPE_UNKNOWN;
+    for (k = 0; k < 2; ++k)
+    {
+        snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/%squeue/rotational",
+                 major(st.st_rdev), minor(st.st_rdev), k ? "../" : "");
+        if (0 == sysfs_int64(path, &rot))
+            break;
+    }
+    if (2 == k)
+        return MTYPE_UNKNOWN;
+    if (0 == rot)
+        return MTYPE_SSD;
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/%squeue/zoned",
+             major(st.st_rdev), minor(st.st_rdev), k ? "../" : "");
+    if (sysfs_str(path, (char *)vpd, sizeof(vpd)) ||
+        (0 == strcmp((char *)vpd, "none")))
+        return MTYPE_HDD;
+    return MTYPE_SMR;
+}
+
+/* Puts the defaults of dp's media type on it, those of --media-type t
+ * when given, leaving what -n and --qd set; --tune picks again later. */
+static void
+media_policy(t_dev *dp)
+{
+    const struct media_policy *mp;
+    int bpt, qd;
+
+    dp->mtype = (opt.mtype >= 0) ? opt.mtype : media_type(dp);
+    mp = media_policies + dp->mtype;
+    dp->timeout_ms = mp->timeout_ms;
+    bpt = (mp->bytes && !opt.sectors_set) ? mp->bytes / dp->blk_sz : dp->bpt;
+    if ((dp->max_xfer > 0) && ((int64_t)bpt * dp->blk_sz > dp->max_xfer))
+        bpt = dp->max_xfer / dp->blk_sz;
+    qd = (mp->qd && !opt.qd_set && !dp->mmap_buf && !dp->mrq) ? mp->qd
+                                                              : dp->qd;
+    if ((bpt < 1) || ((bpt == dp->bpt) && (qd == dp->qd)))
+        return;
+    dp->bpt = bpt;
+    dp->qd = qd;
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: %s defaults, -n %d --qd %d\n", dp->device_name, mp->name,
+           dp->bpt, dp->qd);
+    pthread_mutex_unlock(&out_mutex);
+}
+
+#define HEALTH_DIP_PCT 50 /* a sample under this % of the median MB/s */
+
+static pthread_mutex_t health_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t health_tid;
+static int health_stop;
+
+/* --health: opens the management fd of dp, the one its log pages are
+ * read through, and has the health thread sample it. Devices the pages
+ * cannot be read from (files, most virtual disks) are not sampled. */
+static void
+health_open(t_dev *dp)
+{
+    int fd;
+
+    if ((0 == opt.health_s) || !((FT_SG | FT_BLOCK | FT_NVME) & dp->out_type))
+        return;
+    if (dp->spdk)
+    {
+        pr2serr("%s: --health: not sampled on an spdk: controller\n",
+                dp->device_name);
+        return;
+    }
+    fd = open(dp->device_name, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        pr2serr("%s: --health: %s\n", dp->device_name, strerror(errno));
+        return;
+    }
+    if (!(FT_NVME & dp->out_type) &&
+        (NULL == (dp->health_pt = construct_scsi_pt_obj_with_fd(fd, 0))))
+    {
+        close(fd);
+        return;
+    }
+    memset(&dp->health_last, 0, sizeof(dp->health_last));
+    dp->health_t0 = mono_secs();
+    dp->health_nphys = 0;
+    dp->health_stalls = CTR_GET(dp, timeouts) + CTR_GET(dp, aborted);
+    pthread_mutex_lock(&health_mutex);
+    dp->health_fd = fd;
+    pthread_mutex_unlock(&health_mutex);
+}
+
+/* The end of --health on a SAS drive: the phy that gained the most
+ * errors over the run and how many of the throughput dips came with
+ * errors gained. Most of them with errors points at the cable or the
+ * expander port, not the drive. */
+static void
+health_link_line(t_dev *dp)
+{
+    char name[PATH_MAX];
+    int64_t total = 0;
+    int k, errs, dips, both, worst = 0;
+
+    for (k = 0; k < dp->health_nphys; ++k)
+    {
+        total += dp->health_phy_gain[k];
+        if (dp->health_phy_gain[k] > dp->health_phy_gain[worst])
+            worst = k;
+    }
+    health_link_dips(&dp->health, HEALTH_DIP_PCT, &errs, &dips, &both);
+    if (0 == total)
+        printf("%s: no SAS phy errors over %d health samples", dp->device_name,
+               dp->health.num);
+    else
+        printf("%s: %" PRId64 " SAS phy errors in %d of %d health samples, "
+               "most on port %d phy %d (attached %016" PRIx64 ")",
+               dp->device_name, total, errs, dp->health.num,
+               dp->health_phy[worst].port, dp->health_phy[worst].phy,
+               dp->health_phy[worst].attached);
+    if (dips)
+        printf("; %d of %d throughput dips came with them%s", both, dips,
+               (2 * both > dips) ? ": suspect the cable or expander port"
+                                 : "");
+    printf("\n");
+    if (jsonl_enabled())
+        jsonl_printf("{\"type\":\"link\",\"device\":\"%s\",\"samples\":%d,"
+                     "\"phy_errors\":%" PRId64 ",\"error_samples\":%d,"
+                     "\"dips\":%d,\"dips_with_errors\":%d}",
+                     jsonl_escape(name, sizeof(name), dp->device_name),
+                     dp->health.num, total, errs, dips, both);
+}
+
+/* Stops sampling dp, then prints the hottest it got and, of a SAS drive,
+ * what its phys gained. */
+static void
+health_close(t_dev *dp)
+{
+    int fd, temp;
+
+    pthread_mutex_lock(&health_mutex);
+    fd = dp->health_fd;
+    dp->health_fd = -1;
+    pthread_mutex_unlock(&health_mutex);
+    if (dp->health_pt)
+        destruct_scsi_pt_obj(dp->health_pt);
+    dp->health_pt = NULL;
+    if (fd >= 0)
+        dev_close(fd);
+    temp = health_temp_max(&dp->health);
+    if (dp->health.num && (HEALTH_NONE != temp))
+        printf("%s: %d health samples, hottest %d C\n", dp->device_name,
+               dp->health.num, temp);
+    if ((dp->health_nphys > 0) && (dp->health.num > 1))
+        health_link_line(dp);
+    health_free(&dp->health);
+}
+
+/* The NVMe SMART / Health Information log of the controller into log.
+ * Returns 0, else the ioctl's result. */
+static int
+health_nvme_log(int fd, uint8_t *log)
+{
+    struct nvme_admin_cmd cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = 0x02; /* Get Log Page */
+    cmd.nsid = 0xffffffff;
+    cmd.addr = (uint64_t)(uintptr_t)log;
+    cmd.data_len = HEALTH_SMART_LEN;
+    cmd.cdw10 = ((HEALTH_SMART_LEN / 4 - 1) << 16) | 0x02; /* NUMDL, LID */
+    return ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd);
+}
+
+/* The Protocol Specific Port page of dp into hs->link_errors: what its
+ * phys gained since the sample before, each phy that gained any told
+ * of. The first page read, or one of other phys, only sets where they
+ * are counted from. A drive without the page (SATA, FC) is not asked
+ * for it again. Returns whether the page was read. */
+static bool
+health_phys(t_dev *dp, struct health_sample *hs)
+{
+    static const char *ctr_name[HEALTH_PHY_CTRS] = {
+        "invalid_dword", "disparity_error", "loss_of_sync",
+        "phy_reset_problem"};
+    struct health_phy now[HEALTH_PHYS], *was;
+    uint8_t pg[HEALTH_PORT_LEN];
+    char name[PATH_MAX], ctrs[160];
+    int64_t d[HEALTH_PHY_CTRS], sum;
+    int k, c, n = -1, vb = (verbose > 2) ? verbose - 2 : 0;
+
+    if (dp->health_nphys < 0)
+        return false;
+    if (0 == sg_ll_log_sense_pt(dp->health_pt, false, false, 1, 0x18, 0, 0,
+                                pg, sizeof(pg), 0, NULL, false, vb))
+        n = health_sas_phys(pg, sizeof(pg), now, HEALTH_PHYS);
+    if (n <= 0)
+    {
+        if (0 == dp->health.num)
+            dp->health_nphys = -1;
+        return false;
+    }
+    hs->link_errors = 0;
+    for (k = 0; (n == dp->health_nphys) && (k < n); ++k)
+        if ((now[k].port != dp->health_phy[k].port) ||
+            (now[k].phy != dp->health_phy[k].phy))
+            break;
+    if ((n != dp->health_nphys) || (k < n))
+    {
+        memcpy(dp->health_phy, now, n * sizeof(*now));
+        memset(dp->health_phy_gain, 0, sizeof(dp->health_phy_gain));
+        dp->health_nphys = n;
+        return true;
+    }
+    for (k = 0; k < n; ++k)
+    {
+        was = dp->health_phy + k;
+        for (sum = 0, c = 0; c < HEALTH_PHY_CTRS; ++c)
+        {
+            /* lower: the counters were reset, by LOG SELECT or a
+             * power cycle of the expander */
+            d[c] = (now[k].cnt[c] >= was->cnt[c])
+                       ? now[k].cnt[c] - was->cnt[c] : now[k].cnt[c];
+            sum += d[c];
+        }
+        *was = now[k];
+        if (0 == sum)
+            continue;
+        hs->link_errors += sum;
+        dp->health_phy_gain[k] += sum;
+        pr2serr("%s: port %d phy %d gained %" PRId64 " invalid DWORD, %"
+                PRId64 " disparity, %" PRId64 " loss of sync, %" PRId64
+                " phy reset problem errors, at lba=%" PRId64 " and %.1f "
+                "MB/s\n", dp->device_name, now[k].port, now[k].phy, d[0],
+                d[1], d[2], d[3], hs->lba, hs->mbps);
+        if (!jsonl_enabled())
+            continue;
+        for (ctrs[0] = '\0', c = 0; c < HEALTH_PHY_CTRS; ++c)
+            snprintf(ctrs + strlen(ctrs), sizeof(ctrs) - strlen(ctrs),
+                     ",\"%s\":%" PRId64, ctr_name[c], d[c]);
+        jsonl_printf("{\"type\":\"link_errors\",\"device\":\"%s\","
+                     "\"elapsed_s\":%.1f,\"lba\":%" PRId64 ",\"mbps\":%.2f,"
+                     "\"port\":%d,\"phy\":%d,\"attached_sas\":\"%016" PRIx64
+                     "\"%s}",
+                     jsonl_escape(name, sizeof(name), dp->device_name),
+                     mono_secs() - dp->health_t0, hs->lba, hs->mbps,
+                     now[k].port, now[k].phy, now[k].attached, ctrs);
+    }
+    return true;
+}
+
+/* One sample of dp, under health_mutex: its pages, where the scan is
+ * and the MB/s since the sample before. A drive that answers none of
+ * them the first time is not asked again. */
+static void
+health_sample(t_dev *dp)
+{
+    struct health_sample hs, *last = &dp->health_last;
+    char name[PATH_MAX], temp[16], corr[24], unc[24], link[24];
+    uint8_t pg[HEALTH_SMART_LEN];
+    bool got = false;
+    int vb = (verbose > 2) ? verbose - 2 : 0;
+    int64_t stalls;
+
+    hs.t = lat_now_ns();
+    hs.lba = __atomic_load_n(&dp->cur_lba, __ATOMIC_RELAXED);
+    hs.mbps = 0;
+    if (last->t && (hs.t > last->t) && (hs.lba > last->lba))
+        hs.mbps = (double)(hs.lba - last->lba) * dp->blk_sz * 1e3 /
+                  (hs.t - last->t);
+    hs.temp = HEALTH_NONE;
+    hs.corrected = hs.uncorrected = hs.link_errors = -1;
+    stalls = CTR_GET(dp, timeouts) + CTR_GET(dp, aborted);
+    hs.stalls = stalls - dp->health_stalls;
+    dp->health_stalls = stalls;
+    if (FT_NVME & dp->out_type)
+    {
+        if (0 == health_nvme_log(dp->health_fd, pg))
+        {
+            health_nvme_smart(pg, &hs.temp, &hs.uncorrected);
+            got = true;
+        }
+    }
+    else
+    {
+        if ((0 == sg_ll_log_sense_pt(dp->health_pt, false, false, 1, 0x0d, 0,
+                                     0, pg, sizeof(pg), 0, NULL, false, vb)) &&
+            (0 == health_scsi_temp(pg, sizeof(pg), &hs.temp)))
+            got = true;
+        if ((0 == sg_ll_log_sense_pt(dp->health_pt, false, false, 1, 0x03, 0,
+                                     0, pg, sizeof(pg), 0, NULL, false, vb)) &&
+            (0 == health_scsi_read_errors(pg, sizeof(pg), &hs.corrected,
+                                          &hs.uncorrected)))
+            got = true;
+        if (health_phys(dp, &hs))
+            got = true;
+    }
+    if (!got && (0 == dp->health.num))
+    {
+        pr2serr("%s: --health: no temperature or error counter log page, "
+                "not sampled\n", dp->device_name);
+        if (dp->health_pt)
+            destruct_scsi_pt_obj(dp->health_pt);
+        dp->health_pt = NULL;
+        dev_close(dp->health_fd);
+        dp->health_fd = -1;
+        return;
+    }
+    if (!got)
+        return;
+    *last = hs;
+    if (health_add(&dp->health, &hs))
+        return;
+    if (!jsonl_enabled())
+        return;
+    snprintf(temp, sizeof(temp), (HEALTH_NONE == hs.temp) ? "null" : "%d",
+             hs.temp);
+    snprintf(corr, sizeof(corr), (hs.corrected < 0) ? "null" : "%" PRId64,
+             hs.corrected);
+    snprintf(unc, sizeof(unc), (hs.uncorrected < 0) ? "null" : "%" PRId64,
+             hs.uncorrected);
+    snprintf(link, sizeof(link), (hs.link_errors < 0) ? "null" : "%" PRId64,
+             hs.link_errors);
+    jsonl_printf("{\"type\":\"health\",\"device\":\"%s\",\"pass\":%u,"
+                 "\"elapsed_s\":%.1f,\"lba\":%" PRId64 ",\"mbps\":%.2f,"
+                 "\"temp_c\":%s,\"read_corrected\":%s,"
+                 "\"read_uncorrected\":%s,\"link_errors\":%s,"
+                 "\"stalls\":%" PRId64 "}",
+                 jsonl_escape(name, sizeof(name), dp->device_name),
+                 __atomic_load_n(&dp->cur_pass, __ATOMIC_ACQUIRE),
+                 mono_secs() - dp->health_t0, hs.lba, hs.mbps, temp, corr,
+                 unc, link, hs.stalls);
+}
+
+/* Samples every device with a management fd each --health seconds. It
+ * only ever waits on those fds, never the ones the scan reads through. */
+static void *
+health_thread(void *arg)
+{
+    double next = mono_secs();
+    int k;
+
+    (void)arg;
+    while (!__atomic_load_n(&health_stop, __ATOMIC_ACQUIRE))
+    {
+        struct timespec ts = {0, 100 * 1000 * 1000};
+
+        nanosleep(&ts, NULL);
+        if (mono_secs() < next)
+            continue;
+        next += opt.health_s;
+        for (k = 0; k < num_devs; ++k)
+        {
+            pthread_mutex_lock(&health_mutex);
+            if (devs[k].health_fd >= 0)
+                health_sample(devs + k);
+            pthread_mutex_unlock(&health_mutex);
+        }
+    }
+    return NULL;
+}
+
+static pthread_mutex_t idle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t idle_tid;
+static int idle_stop;
+
+/* --idle: opens the /sys/block stat of dp, of the whole disk for a
+ * partition and of the disk an sg node is the generic node of. */
+static void
+idle_open(t_dev *dp)
+{
+    char real[PATH_MAX], path[PATH_MAX + 300], *cp;
+    struct dirent *de;
+    struct stat st;
+    DIR *dir;
+    int fd = -1;
+
+    if ((opt.idle_pct <= 0) || dp->sim ||
+        sysfs_dev_path(dp->device_name, real, &st))
+        goto none;
+    snprintf(path, sizeof(path), "%s/partition", real);
+    if (S_ISBLK(st.st_mode) && (0 == access(path, F_OK)) &&
+        (cp = strrchr(real, '/')))
+        *cp = '\0';
+    if (S_ISBLK(st.st_mode))
+        snprintf(path, sizeof(path), "%s/stat", real);
+    else
+    {
+        snprintf(path, sizeof(path), "%s/device/block", real);
+        dir = opendir(path);
+        while (dir && (de = readdir(dir)) && ('.' == de->d_name[0]))
+            ;
+        if (dir && de)
+            snprintf(path, sizeof(path), "%s/device/block/%s/stat", real,
+                     de->d_name);
+        else
+            path[0] = '\0';
+        if (dir)
+            closedir(dir);
+    }
+    if (path[0])
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        pthread_mutex_lock(&idle_mutex);
+        dp->idle_primed = false;
+        dp->idle_fd = fd;
+        pthread_mutex_unlock(&idle_mutex);
+        return;
+    }
+none:
+    if (opt.idle_pct > 0)
+        pr2serr("%s: --idle: no /sys/block stat, reading regardless of "
+                "other I/O\n", dp->device_name);
+}
+
+static void
+idle_close(t_dev *dp)
+{
+    if (dp->idle_fd < 0)
+        return;
+    pthread_mutex_lock(&idle_mutex);
+    close(dp->idle_fd);
+    dp->idle_fd = -1;
+    __atomic_store_n(&dp->idle_busy, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&idle_mutex);
+    if (dp->idle_held_ns)
+    {
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: --idle held the READs %.1f s for other I/O\n",
+               dp->device_name, dp->idle_held_ns / 1e9);
+        pthread_mutex_unlock(&out_mutex);
+    }
+}
+
+/* --idle: one sample of how busy other I/O keeps dp, dt_ns after the
+ * one before. The busy time of the stat is the time anything was in
+ * flight. It counts the scan's own READs of a block device, so it is
+ * split by the share of completions that were not the scan's; the
+ * passthrough commands of an sg node are not in it at all. Under
+ * idle_mutex. */
+static void
+idle_sample(t_dev *dp, uint64_t dt_ns)
+{
+    unsigned long long v[10];
+    uint64_t now[3], d_ios, d_own;
+    double busy;
+    char buf[256];
+    ssize_t n = pread(dp->idle_fd, buf, sizeof(buf) - 1, 0);
+
+    if (n <= 0)
+        return;
+    buf[n] = '\0';
+    /* reads, merged, sectors, ms, writes, ..., in flight, io_ticks */
+    if (10 != sscanf(buf, "%llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+                     v, v + 1, v + 2, v + 3, v + 4, v + 5, v + 6, v + 7, v + 8,
+                     v + 9))
+        return;
+    now[0] = v[0] + v[4];
+    now[1] = v[9];
+    now[2] = (FT_SG & dp->out_type)
+                 ? 0 : __atomic_load_n(&dp->idle_cmds, __ATOMIC_RELAXED);
+    if (!dp->idle_primed)
+    {
+        memcpy(dp->idle_last, now, sizeof(now));
+        dp->idle_primed = true;
+        return;
+    }
+    d_ios = now[0] - dp->idle_last[0];
+    d_own = now[2] - dp->idle_last[2];
+    busy = 100.0 * (double)(now[1] - dp->idle_last[1]) * 1e6 / dt_ns;
+    if (d_ios)
+        busy *= (double)(d_ios - ((d_own < d_ios) ? d_own : d_ios)) / d_ios;
+    memcpy(dp->idle_last, now, sizeof(now));
+    if (dp->idle_busy)
+        dp->idle_held_ns += dt_ns;
+    if (busy > opt.idle_pct)
+    {
+        dp->idle_calm = 0;
+        if (!dp->idle_busy && (verbose > 1))
+            pr2serr("%s: --idle: other I/O %.0f%% busy, holding\n",
+                    dp->device_name, busy);
+        __atomic_store_n(&dp->idle_busy, 1, __ATOMIC_RELAXED);
+    }
+    else if (dp->idle_busy && (++dp->idle_calm >= IDLE_QUIET))
+        __atomic_store_n(&dp->idle_busy, 0, __ATOMIC_RELAXED);
+}
+
+/* --idle: samples every device with a stat each opt.idle_ms. */
+static void *
+idle_thread(void *arg)
+{
+    struct timespec ts = {opt.idle_ms / 1000, (opt.idle_ms % 1000) * 1000000L};
+    uint64_t last = lat_now_ns(), now;
+    int k;
+
+    (void)arg;
+    while (!__atomic_load_n(&idle_stop, __ATOMIC_ACQUIRE))
+    {
+        nanosleep(&ts, NULL);
+        now = lat_now_ns();
+        pthread_mutex_lock(&idle_mutex);
+        for (k = 0; k < num_devs; ++k)
+            if (devs[k].idle_fd >= 0)
+                idle_sample(devs + k, now - last);
+        pthread_mutex_unlock(&idle_mutex);
+        last = now;
+    }
+    return NULL;
+}
+
+static pthread_mutex_t dirty_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dirty_cond; /* CLOCK_MONOTONIC, by dirty_open() */
+static pthread_t dirty_tid;
+static int dirty_stop;
+
+/* --dirty: the queue of dp, allocated when it has none. Under
+ * dirty_mutex. */
+static t_dirty *
+dirty_get(t_dev *dp)
+{
+    if (NULL == dp->dirty)
+        dp->dirty = (t_dirty *)calloc(1, sizeof(t_dirty));
+    return dp->dirty;
+}
+
+/* Doubles the ring of dy, up to DIRTY_MAX, its oldest extent first.
+ * Returns 0, -1 when it may not grow. */
+static int
+dirty_grow(t_dirty *dy)
+{
+    int cap = dy->cap ? 2 * dy->cap : 64, k;
+    t_dirty_ext *q;
+
+    if (dy->cap >= DIRTY_MAX)
+        return -1;
+    q = (t_dirty_ext *)malloc(cap * sizeof(t_dirty_ext));
+    if (NULL == q)
+        return -1;
+    for (k = 0; k < dy->num; ++k)
+        q[k] = dy->q[(dy->head + k) % dy->cap];
+    free(dy->q);
+    dy->q = q;
+    dy->cap = cap;
+    dy->head = 0;
+    return 0;
+}
+
+/* --dirty: len blocks at lba of dp were written, as the feed said at
+ * now. Under dirty_mutex. */
+static void
+dirty_note(t_dev *dp, int64_t lba, int64_t len, uint64_t now)
+{
+    t_dirty *dy = dirty_get(dp);
+    t_dirty_ext *ep;
+
+    if (NULL == dy)
+        return;
+    if (dy->num > 1)
+    {
+        ep = dy->q + (dy->head + dy->num - 1) % dy->cap;
+        if ((lba <= ep->lba + ep->len) && (lba + len >= ep->lba))
+        {
+            if (lba + len > ep->lba + ep->len)
+                ep->len = lba + len - ep->lba;
+            if (lba < ep->lba)
+            {
+                ep->len += ep->lba - lba;
+                ep->lba = lba;
+            }
+            return; /* when it was first said to be written */
+        }
+    }
+    if ((dy->num == dy->cap) && dirty_grow(dy))
+    {
+        ++dy->dropped; /* left to the sweep */
+        return;
+    }
+    ep = dy->q + (dy->head + dy->num++) % dy->cap;
+    ep->lba = lba;
+    ep->len = len;
+    ep->noted_ns = now;
+    pthread_cond_broadcast(&dirty_cond);
+}
+
+/* Whether the device of a --dirty line, w, is dp: by the name it was
+ * given, its basename or the major:minor (or major,minor, as blktrace
+ * has it) of its node. */
+static bool
+dirty_dev_match(const t_dev *dp, const char *w)
+{
+    const char *base = strrchr(dp->device_name, '/');
+    unsigned int maj, min;
+    char c;
+
+    if ((0 == strcmp(w, dp->device_name)) ||
+        (base && (0 == strcmp(w, base + 1))))
+        return true;
+    return dp->rdev && (3 == sscanf(w, "%u%c%u", &maj, &c, &min)) &&
+           ((':' == c) || (',' == c)) && (major(dp->rdev) == maj) &&
+           (minor(dp->rdev) == min);
+}
+
+/* One line of the --dirty feed, [device] then lba, lba+n or first-last:
+ * its extent noted for that device, or for each when it names none. */
+static void
+dirty_line(char *line, uint64_t now)
+{
+    char *f[3], *save, *cp, dev[4];
+    t_extent e;
+    int k;
+
+    if ((cp = strchr(line, '#')))
+        *cp = '\0';
+    f[0] = strtok_r(line, " \t\r", &save);
+    f[1] = f[0] ? strtok_r(NULL, " \t\r", &save) : NULL;
+    f[2] = f[1] ? strtok_r(NULL, " \t\r", &save) : NULL;
+    if (NULL == f[0])
+        return;
+    if (f[2] || (1 != ranges_line(f[1] ? f[1] : f[0], &e, dev, sizeof(dev))))
+    {
+        if (verbose)
+            pr2serr("%s: not [device] lba, lba+n or first-last: %s\n",
+                    opt.dirty_path, f[0]);
+        return;
+    }
+    pthread_mutex_lock(&dirty_mutex);
+    for (k = 0; k < num_devs; ++k)
+        if ((NULL == f[1]) || dirty_dev_match(devs + k, f[0]))
+            dirty_note(devs + k, e.lba, e.len, now);
+    pthread_mutex_unlock(&dirty_mutex);
+}
+
+/* --dirty: follows opt.dirty_path as it grows, a line at a time, from
+ * its start. Once at its end it is looked at every DIRTY_POLL_MS, and
+ * opened again from the start when it was truncated or replaced, as a
+ * rotated log is; a FIFO is read as its writers come and go. */
+static void *
+dirty_thread(void *arg)
+{
+    struct timespec ts = {0, DIRTY_POLL_MS * 1000000L};
+    char buf[8192], *line, *nl;
+    struct stat st, now_st;
+    size_t have = 0;
+    off_t off = 0;
+    ssize_t n;
+    int fd = -1;
+
+    (void)arg;
+    while (!__atomic_load_n(&dirty_stop, __ATOMIC_ACQUIRE))
+    {
+        if (fd < 0)
+        {
+            fd = open(opt.dirty_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if ((fd >= 0) && fstat(fd, &st))
+            {
+                close(fd);
+                fd = -1;
+            }
+            off = 0;
+            have = 0;
+        }
+        n = (fd >= 0) ? read(fd, buf + have, sizeof(buf) - 1 - have) : 0;
+        if (n > 0)
+        {
+            off += n;
+            have += n;
+            buf[have] = '\0';
+            for (line = buf; (nl = strchr(line, '\n')); line = nl + 1)
+            {
+                *nl = '\0';
+                dirty_line(line, lat_now_ns());
+            }
+            have -= line - buf;
+            if (have == sizeof(buf) - 1)
+                have = 0; /* a line this long is none of ours */
+            memmove(buf, line, have);
+            continue;
+        }
+        if ((fd >= 0) && S_ISREG(st.st_mode) &&
+            (stat(opt.dirty_path, &now_st) || (now_st.st_ino != st.st_ino) ||
+             (now_st.st_size < off)))
+        {
+            close(fd);
+            fd = -1;
+        }
+        nanosleep(&ts, NULL);
+    }
+    if (fd >= 0)
+        close(fd);
+    return NULL;
+}
+
+/* --dirty: the condition of the threads and the feed's thread. */
+static void
+dirty_open(void)
+{
+    pthread_condattr_t cattr;
+
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&dirty_cond, &cattr);
+    pthread_condattr_destroy(&cattr);
+    dirty_stop = 0;
+    if (pthread_create(&dirty_tid, NULL, dirty_thread, NULL))
+    {
+        perror("pthread_create");
+        dirty_tid = 0;
+    }
+}
+
+/* Stops the feed's thread, and frees the queues, their threads done. */
+static void
+dirty_close(void)
+{
+    int k;
+
+    __atomic_store_n(&dirty_stop, 1, __ATOMIC_RELEASE);
+    if (dirty_tid)
+        pthread_join(dirty_tid, NULL);
+    dirty_tid = 0;
+    for (k = 0; k < num_devs; ++k)
+        if (devs[k].dirty)
+        {
+            free(devs[k].dirty->q);
+            free(devs[k].dirty);
+            devs[k].dirty = NULL;
+        }
+    pthread_cond_destroy(&dirty_cond);
+}
+
+/* --dirty: verifies the extents of dp's queue, each once its settle
+ * time is past, in pieces of dp->bpt blocks taken from its caps as the
+ * sweep's READs are. The data is what was written, so it is read, not
+ * compared: what it finds are the blocks that do not read back, kept
+ * by sg_read() and direct_read() as the sweep's are. */
+static void *
+dirty_worker(void *arg)
+{
+    t_dev *dp = (t_dev *)arg;
+    t_dirty *dy = dp->dirty;
+    uint8_t *buf, *free_buf;
+    struct timespec ts;
+    t_dirty_ext e, *ep;
+    uint64_t due, w;
+    double lag;
+    int n, res;
+
+    ctr_shard = ISO_SHARD;
+    buf = io_buf(dp, dp->bpt * dp->blk_sz, &free_buf);
+    if (NULL == buf)
+        pr2serr("%s: --dirty: no memory to read with\n", dp->device_name);
+    pthread_mutex_lock(&dirty_mutex);
+    while (!dy->stop)
+    {
+        if ((NULL == buf) || (0 == dy->num) ||
+            __atomic_load_n(&run_cancel, __ATOMIC_RELAXED) ||
+            __atomic_load_n(&dp->gone, __ATOMIC_RELAXED))
+        {
+            pthread_cond_wait(&dirty_cond, &dirty_mutex);
+            continue;
+        }
+        e = dy->q[dy->head];
+        if (e.lba < dp->start)
+        {
+            e.len -= dp->start - e.lba;
+            e.lba = dp->start;
+        }
+        if (e.lba + e.len > dp->end)
+            e.len = dp->end - e.lba;
+        if (e.len <= 0)
+        {
+            dy->head = (dy->head + 1) % dy->cap;
+            --dy->num; /* outside the range scanned */
+            continue;
+        }
+        due = e.noted_ns + (uint64_t)opt.dirty_settle_s * 1000000000ULL;
+        if (due > lat_now_ns())
+        {
+            ts.tv_sec = due / 1000000000ULL;
+            ts.tv_nsec = due % 1000000000ULL;
+            pthread_cond_timedwait(&dirty_cond, &dirty_mutex, &ts);
+            continue;
+        }
+        pthread_mutex_unlock(&dirty_mutex);
+
+        n = (e.len > dp->bpt) ? dp->bpt : (int)e.len;
+        while ((w = throttle_ns(dp, (int64_t)n * dp->blk_sz)) &&
+               !__atomic_load_n(&dy->stop, __ATOMIC_RELAXED))
+            throttle_sleep((w < EV_TICK_MS * 1000000ULL)
+                               ? w : EV_TICK_MS * 1000000ULL);
+        res = ((FT_SG | FT_SIM) & dp->out_type)
+                  ? sg_read(dp, buf, n, e.lba, NULL, NULL)
+                  : direct_read(dp, buf, n, e.lba);
+        if (res)
+            pr2serr("%s: --dirty: read failed, at or after lba=%" PRId64
+                    " [0x%" PRIx64 "]\n", dp->device_name, e.lba, e.lba);
+
+        pthread_mutex_lock(&dirty_mutex);
+        if (res)
+            ++dy->failed;
+        dy->blocks += n;
+        ep = dy->q + dy->head;
+        ep->len = e.lba + e.len - (e.lba + n);
+        ep->lba = e.lba + n;
+        if (ep->len > 0)
+            continue;
+        dy->head = (dy->head + 1) % dy->cap;
+        --dy->num;
+        ++dy->extents;
+        lag = (lat_now_ns() - e.noted_ns) / 1e9;
+        dy->lag_sum += lag;
+        if (lag > dy->lag_max)
+            dy->lag_max = lag;
+    }
+    pthread_mutex_unlock(&dirty_mutex);
+    iobuf_free(free_buf);
+    cpu_charge(dp);
+    return NULL;
+}
+
+/* --dirty: starts the thread verifying the written extents of dp, for
+ * as long as dp is scanned. */
+static void
+dirty_start(t_dev *dp)
+{
+    t_dirty *dy;
+
+    if (NULL == opt.dirty_path)
+        return;
+    pthread_mutex_lock(&dirty_mutex);
+    dy = dirty_get(dp);
+    if (dy && !dy->started)
+    {
+        dy->stop = false;
+        if (pthread_create(&dy->tid, NULL, dirty_worker, dp))
+            perror("pthread_create");
+        else
+            dy->started = true;
+    }
+    pthread_mutex_unlock(&dirty_mutex);
+}
+
+/* --dirty: stops the thread of dp and reports what it verified, how
+ * long after the write on average and at most, and what is left. */
+static void
+dirty_finish(t_dev *dp)
+{
+    char name[PATH_MAX];
+    t_dirty *dy = dp->dirty;
+
+    if ((NULL == dy) || !dy->started)
+        return;
+    pthread_mutex_lock(&dirty_mutex);
+    dy->stop = true;
+    pthread_cond_broadcast(&dirty_cond);
+    pthread_mutex_unlock(&dirty_mutex);
+    pthread_join(dy->tid, NULL);
+    dy->started = false;
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: --dirty: %" PRIu64 " written extents verified, %" PRIu64
+           " blocks, %.1f s after the write on average, %.1f s at most",
+           dp->device_name, dy->extents, dy->blocks,
+           dy->extents ? dy->lag_sum / dy->extents : 0.0, dy->lag_max);
+    if (dy->failed)
+        printf(", %" PRIu64 " READs failed", dy->failed);
+    if (dy->dropped || dy->num)
+        printf(", %" PRIu64 " dropped and %d left to the sweep", dy->dropped,
+               dy->num);
+    printf("\n");
+    pthread_mutex_unlock(&out_mutex);
+    if (jsonl_enabled())
+        jsonl_printf("{\"type\":\"dirty\",\"device\":\"%s\",\"extents\":%" PRIu64
+                     ",\"blocks\":%" PRIu64 ",\"failed\":%" PRIu64
+                     ",\"dropped\":%" PRIu64 ",\"left\":%d,\"lag_mean_s\":%.3f,"
+                     "\"lag_max_s\":%.3f}",
+                     jsonl_escape(name, sizeof(name), dp->device_name),
+                     dy->extents, dy->blocks, dy->failed, dy->dropped, dy->num,
+                     dy->extents ? dy->lag_sum / dy->extents : 0.0,
+                     dy->lag_max);
+}
+
+static pthread_t uevent_tid;
+static int uevent_stop;
+
+/* Watches the kernel's uevents for the removal of a node being read,
+ * by its major and minor: a pulled drive, or one its transport gave up
+ * on once the link stayed down, goes to dev_gone() at once rather than
+ * when its commands time out. */
+static void *
+uevent_thread(void *arg)
+{
+    char buf[8192], *p;
+    unsigned int maj, min;
+    struct pollfd pfd;
+    ssize_t n;
+    int k;
+
+    (void)arg;
+    pfd.fd = uevent_fd;
+    pfd.events = POLLIN;
+    while (!__atomic_load_n(&uevent_stop, __ATOMIC_ACQUIRE))
+    {
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+        n = recv(uevent_fd, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+        if (n <= 0)
+            continue;
+        buf[n] = '\0';
+        /* "remove@/devices/...", then NUL separated KEY=value */
+        if (strncmp(buf, "remove@", 7))
+            continue;
+        maj = min = UINT_MAX;
+        for (p = buf; p < buf + n; p += strlen(p) + 1)
+        {
+            if (0 == strncmp(p, "MAJOR=", 6))
+                maj = (unsigned int)strtoul(p + 6, NULL, 10);
+            else if (0 == strncmp(p, "MINOR=", 6))
+                min = (unsigned int)strtoul(p + 6, NULL, 10);
+        }
+        if ((UINT_MAX == maj) || (UINT_MAX == min))
+            continue;
+        for (k = 0; k < num_devs; ++k)
+            if (devs[k].rdev && (major(devs[k].rdev) == maj) &&
+                (minor(devs[k].rdev) == min))
+                dev_gone(devs + k, "device removed");
+    }
+    return NULL;
+}
+
+/* Joins the kernel's uevent group, when this process may, for the
+ * removals uevent_thread() looks for. */
+static void
+uevent_start(void)
+{
+    struct sockaddr_nl sa;
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+                    NETLINK_KOBJECT_UEVENT);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups = 1; /* those of the kernel, not the ones udev relays */
+    if ((fd >= 0) && bind(fd, (struct sockaddr *)&sa, sizeof(sa)))
+    {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0)
+    {
+        if (verbose)
+            pr2serr("no uevents (%s), a removed device is only noticed by "
+                    "its errors\n", safe_strerror(errno));
+        return;
+    }
+    uevent_fd = fd;
+    uevent_stop = 0;
+    if (pthread_create(&uevent_tid, NULL, uevent_thread, NULL))
+    {
+        perror("pthread_create");
+        close(fd);
+        uevent_fd = -1;
+    }
+}
+
+static void
+uevent_end(void)
+{
+    if (uevent_fd < 0)
+        return;
+    __atomic_store_n(&uevent_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(uevent_tid, NULL);
+    close(uevent_fd);
+    uevent_fd = -1;
+}
+
+/* The lat_map_csv() temp of a cell: what dp was sampled at meanwhile */
+static int
+heat_temp(void *arg, uint64_t from, uint64_t to)
+{
+    return health_temp(&((t_dev *)arg)->health, from, to);
+}
+
+/* --defects: the grown defect list of dp through fd, asked for in long
+ * block format, only its header or, when full, all of it with the LBAs
+ * into dp->glist. Returns the number of defects, -1 when the drive does
+ * not say. */
+static int64_t
+glist_read(t_dev *dp, int fd, bool full)
+{
+    uint8_t hdr[HEALTH_GLIST_HDR], *buf;
+    int64_t n;
+    int fmt, len, k;
+    int vb = (verbose > 2) ? verbose - 2 : 0;
+
+    if (sg_ll_read_defect10(fd, false, true, 3, hdr, sizeof(hdr), false, vb))
+        return -1;
+    n = health_glist_count(hdr, sizeof(hdr), &fmt);
+    if ((n <= 0) || !full)
+        return n;
+    len = HEALTH_GLIST_HDR + ((hdr[2] << 8) | hdr[3]);
+    if (len > 0xffff)
+        len = 0xffff;
+    free(dp->glist);
+    dp->glist = NULL;
+    dp->glist_lbas = 0;
+    buf = (uint8_t *)malloc(len);
+    if (NULL == buf)
+        return n;
+    if (0 == sg_ll_read_defect10(fd, false, true, 3, buf, len, false, vb))
+    {
+        n = health_glist_count(buf, len, &fmt);
+        dp->glist = (int64_t *)malloc((n > 0 ? n : 1) * sizeof(int64_t));
+        k = dp->glist ? health_glist_lbas(buf, len, dp->glist, n) : -1;
+        if (k < 0)
+        {
+            free(dp->glist);
+            dp->glist = NULL;
+        }
+        else
+            dp->glist_lbas = k;
+    }
+    free(buf);
+    return n;
+}
+
+/* --defects: where pass of dp starts from. The list is read the first
+ * time only, a pass after that starts where the one before ended. */
+static void
+defects_begin(t_dev *dp, int fd)
+{
+    dp->rec_n = 0;
+    dp->rec_track = true;
+    dp->rec0 = CTR_GET(dp, recovered);
+    dp->unrec0 = CTR_GET(dp, unrecovered);
+    if (dp->glist_none || (dp->glist_n >= 0))
+        return;
+    if ((FT_NVME & dp->out_type) || !((FT_SG | FT_BLOCK) & dp->out_type) ||
+        ((dp->glist_n = glist_read(dp, fd, false)) < 0))
+    {
+        pr2serr("%s: --defects: no READ DEFECT DATA, the grown defects are "
+                "not tracked\n", dp->device_name);
+        dp->glist_none = true;
+        return;
+    }
+    if (dp->glist_n > 0)
+        glist_read(dp, fd, true);
+}
+
+/* Appends the LBAs of lba, n of them of which num are there, to the JSON
+ * array of b. */
+static void
+json_lbas(char *b, int len, const int64_t *lba, int num)
+{
+    int k, off = strlen(b);
+
+    off += snprintf(b + off, len - off, "[");
+    for (k = 0; (k < num) && (off < len); ++k)
+        off += snprintf(b + off, len - off, "%s%" PRId64, k ? "," : "",
+                        lba[k]);
+    if (off < len)
+        snprintf(b + off, len - off, "]");
+}
+
+/* --defects: the grown defect list of dp after pass, against the one it
+ * began with, and the recovered errors of the pass, printed and as the
+ * "defects" JSON member of the pass record into json. The full list is
+ * only read when the count is not the one before. */
+static void
+defects_end(t_dev *dp, int fd, unsigned int pass, char *json, int jlen)
+{
+    int64_t fresh[DEFECT_SHOW], *was;
+    int64_t before = dp->glist_n, after = -1;
+    int64_t rec = CTR_GET(dp, recovered) - dp->rec0;
+    int64_t unrec = CTR_GET(dp, unrecovered) - dp->unrec0;
+    int nwas, k, nfresh = 0, nrec = dp->rec_n;
+    char nb[24], na[24];
+
+    if (nrec > DEFECT_REC_LBAS)
+        nrec = DEFECT_REC_LBAS;
+    if (!dp->glist_none)
+        after = glist_read(dp, fd, false);
+    if ((after >= 0) && (after != before))
+    {
+        was = dp->glist;
+        nwas = dp->glist_lbas;
+        dp->glist = NULL;
+        dp->glist_lbas = 0;
+        after = glist_read(dp, fd, true);
+        if (dp->glist)
+            nfresh = health_glist_new(was, nwas, dp->glist, dp->glist_lbas,
+                                      fresh, DEFECT_SHOW);
+        free(was);
+    }
+    if (after >= 0)
+        dp->glist_n = after;
+    pthread_mutex_lock(&out_mutex);
+    if (after >= 0)
+        printf("%s: pass %u grown defects %" PRId64 " -> %" PRId64 " (%+"
+               PRId64 "), %" PRId64 " recovered and %" PRId64 " unrecovered "
+               "errors\n", dp->device_name, pass, before, after,
+               after - before, rec, unrec);
+    else
+        printf("%s: pass %u %" PRId64 " recovered and %" PRId64
+               " unrecovered errors\n", dp->device_name, pass, rec, unrec);
+    for (k = 0; (k < nfresh) && (k < DEFECT_SHOW); ++k)
+        printf("    new grown defect at lba 0x%" PRIx64 "\n", fresh[k]);
+    if (nfresh > DEFECT_SHOW)
+        printf("    and %d more new grown defects\n", nfresh - DEFECT_SHOW);
+    for (k = 0; (k < nrec) && (k < DEFECT_SHOW); ++k)
+        printf("    recovered error at lba 0x%" PRIx64 "\n", dp->rec_lba[k]);
+    if (dp->rec_n > DEFECT_SHOW)
+        printf("    and %d more recovered errors with an lba\n",
+               dp->rec_n - DEFECT_SHOW);
+    pthread_mutex_unlock(&out_mutex);
+    snprintf(nb, sizeof(nb), (before < 0) ? "null" : "%" PRId64, before);
+    snprintf(na, sizeof(na), (after < 0) ? "null" : "%" PRId64, after);
+    snprintf(json, jlen, ",\"defects\":{\"glist_before\":%s,"
+             "\"glist_after\":%s,\"glist_new\":", nb, na);
+    json_lbas(json, jlen, fresh, (nfresh < DEFECT_SHOW) ? nfresh : DEFECT_SHOW);
+    k = strlen(json);
+    snprintf(json + k, jlen - k, ",\"recovered\":%" PRId64 ",\"unrecovered\":%"
+             PRId64 ",\"recovered_lbas\":", rec, unrec);
+    json_lbas(json, jlen, dp->rec_lba, nrec);
+    k = strlen(json);
+    snprintf(json + k, jlen - k, "}");
+}
+
+/* --results: what a pass of dp is measured from, taken when it begins. */
+struct results_mark
+{
+    int64_t zone_bytes[TL_ZONES];
+    uint64_t zone_ns[TL_ZONES];
+    int64_t rec;
+    int64_t unrec;
+    uint64_t t; /* lat_now_ns() */
+};
+
+static void
+results_begin(t_dev *dp, struct results_mark *rm)
+{
+    int z;
+
+    for (z = 0; z < TL_ZONES; ++z)
+    {
+        rm->zone_bytes[z] = __atomic_load_n(&dp->zone_bytes[z],
+                                            __ATOMIC_RELAXED);
+        rm->zone_ns[z] = __atomic_load_n(&dp->zone_ns[z], __ATOMIC_RELAXED);
+    }
+    rm->rec = CTR_GET(dp, recovered);
+    rm->unrec = CTR_GET(dp, unrecovered);
+    rm->t = lat_now_ns();
+}
+
+/* The --health samples over the pass that began at t: the hottest, and
+ * the read errors the drive counted since the sample before it, -1
+ * where it does not report them. */
+static void
+results_health(t_dev *dp, uint64_t t, struct results_rec *r)
+{
+    struct health_log *hl = &dp->health;
+    const struct health_sample *base = NULL, *last = NULL;
+    int k;
+
+    r->temp_max = HEALTH_NONE;
+    r->corrected = r->uncorrected = -1;
+    pthread_mutex_lock(&hl->mutex);
+    for (k = 0; k < hl->num; ++k)
+    {
+        if (hl->s[k].t < t)
+        {
+            base = hl->s + k;
+            continue;
+        }
+        if (NULL == base)
+            base = hl->s + k;
+        last = hl->s + k;
+        if (hl->s[k].temp > r->temp_max)
+            r->temp_max = hl->s[k].temp;
+    }
+    if (base && last)
+    {
+        if ((base->corrected >= 0) && (last->corrected >= 0))
+            r->corrected = last->corrected - base->corrected;
+        if ((base->uncorrected >= 0) && (last->uncorrected >= 0))
+            r->uncorrected = last->uncorrected - base->uncorrected;
+    }
+    pthread_mutex_unlock(&hl->mutex);
+}
+
+/* --rec-zones: pass of dp by recording zone, those of its model in the
+ * zone table, else where the MB/s steps, to stdout and as one JSON
+ * "rec_zone" record a zone. */
+static void
+rec_zones_report(t_dev *dp, unsigned int pass)
+{
+    int64_t first[RECZONE_MAX];
+    struct reczone z[RECZONE_MAX];
+    bool table = false;
+    char name[PATH_MAX], b[4][16];
+    double tb;
+    int n = 0, k;
+
+    if (opt.rz_table && dp->model_key[0])
+        n = reczone_table(opt.rz_table, dp->model_key, &dp->rz, first,
+                          RECZONE_MAX);
+    if (n < 0)
+        pr2serr("%s: zone table %s: %s\n", dp->device_name, opt.rz_table,
+                safe_strerror(errno));
+    if (n > 0)
+        table = true;
+    else
+        n = reczone_infer(&dp->rz, first, RECZONE_MAX);
+    reczone_sum(&dp->rz, first, n, z);
+    pthread_mutex_lock(&out_mutex);
+    printf("%s: pass %u by recording zone, %d from the %s:\n",
+           dp->device_name, pass, n, table ? "zone table" : "MB/s steps");
+    printf("  zone        first lba         lbas     MB/s      p50      p99"
+           "    p99.9      max   rec/TB unrec/TB\n");
+    for (k = 0; k < n; ++k)
+    {
+        tb = z[k].bytes / 1e12;
+        printf("  %4d %16" PRId64 " %12" PRId64 " %8.1f %8s %8s %8s %8s "
+               "%8.3g %8.3g\n", k, z[k].start, z[k].end - z[k].start,
+               z[k].mbps, lat_str(z[k].p50, b[0], sizeof(b[0])),
+               lat_str(z[k].p99, b[1], sizeof(b[1])),
+               lat_str(z[k].p999, b[2], sizeof(b[2])),
+               lat_str(z[k].max, b[3], sizeof(b[3])),
+               (tb > 0) ? z[k].recovered / tb : 0.0,
+               (tb > 0) ? z[k].unrecovered / tb : 0.0);
+    }
+    pthread_mutex_unlock(&out_mutex);
+    if (!jsonl_enabled())
+        return;
+    jsonl_escape(name, sizeof(name), dp->device_name);
+    for (k = 0; k < n; ++k)
+        jsonl_printf("{\"type\":\"rec_zone\",\"device\":\"%s\",\"pass\":%u,"
+                     "\"zone\":%d,\"zones\":%d,\"from\":\"%s\",\"lba\":%"
+                     PRId64 ",\"lbas\":%" PRId64 ",\"bytes\":%" PRIu64
+                     ",\"mbps\":%.2f,\"commands\":%" PRIu64 ",\"p50_us\":%.1f,"
+                     "\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f,"
+                     "\"recovered\":%" PRIu64 ",\"unrecovered\":%" PRIu64 "}",
+                     name, pass, k, n, table ? "table" : "steps",
+                     z[k].start, z[k].end - z[k].start, z[k].bytes, z[k].mbps,
+                     z[k].count, z[k].p50 / 1e3, z[k].p99 / 1e3,
+                     z[k].p999 / 1e3, z[k].max / 1e3, z[k].recovered,
+                     z[k].unrecovered);
+}
+
+/* --drift: keeps step s, is_lat of the latency series, of the pass
+ * sampled. The step before of its series ends where s begins. */
+static void
+drift_keep(t_drift *dr, const struct drift_step *s, bool is_lat)
+{
+    int *last = is_lat ? &dr->last_lat : &dr->last_rate;
+
+    if (*last >= 0)
+        dr->step[*last].after = s->before;
+    if (DRIFT_STEPS == dr->num)
+    {
+        ++dr->lost;
+        *last = -1;
+        return;
+    }
+    dr->step[dr->num] = *s;
+    dr->is_lat[dr->num] = is_lat;
+    *last = dr->num++;
+}
+
+/* --drift: called by the reporter every tick, takes a sample of dp's
+ * pass each DRIFT_SAMPLE_S. The samples are of what bytes_done and
+ * lat_pass moved by, so the engines do nothing for them. */
+static void
+drift_sample(t_dev *dp)
+{
+    t_drift *dr = &dp->drift;
+    unsigned int pass = __atomic_load_n(&dp->cur_pass, __ATOMIC_ACQUIRE);
+    int64_t bytes = __atomic_load_n(&dp->bytes_done, __ATOMIC_RELAXED);
+    int64_t lba = __atomic_load_n(&dp->cur_lba, __ATOMIC_RELAXED);
+    uint64_t count = __atomic_load_n(&dp->lat_pass.count, __ATOMIC_RELAXED);
+    uint64_t sum = __atomic_load_n(&dp->lat_pass.sum, __ATOMIC_RELAXED);
+    double now = mono_secs(), secs = now - dr->last_t;
+    struct drift_step s;
+
+    if (0 == pass)
+        return;
+    if (pass != dr->pass)
+    {
+        dr->pass = pass;
+        dr->t0 = now;
+        drift_init(&dr->rate, opt.drift_pct);
+        drift_init(&dr->lat, opt.drift_pct);
+        dr->num = dr->lost = 0;
+        dr->last_rate = dr->last_lat = -1;
+    }
+    else if (secs < DRIFT_SAMPLE_S)
+        return;
+    else if ((bytes > dr->bytes) && (count >= dr->count))
+    {
+        if (drift_add(&dr->rate, now - dr->t0, lba,
+                      (bytes - dr->bytes) / secs / 1e6, &s))
+            drift_keep(dr, &s, false);
+        if ((count > dr->count) &&
+            drift_add(&dr->lat, now - dr->t0, lba,
+                      (double)(sum - dr->sum) / (count - dr->count) / 1e3, &s))
+            drift_keep(dr, &s, true);
+    }
+    /* else nothing read, or lat_pass was reset under us */
+    dr->last_t = now;
+    dr->bytes = bytes;
+    dr->count = count;
+    dr->sum = sum;
+}
+
+/* --drift: the steps of pass of dp, to stdout and as one JSON "drift"
+ * record a step. */
+static void
+drift_report(t_dev *dp, unsigned int pass)
+{
+    t_drift *dr = &dp->drift;
+    struct drift_step step[DRIFT_STEPS];
+    bool is_lat[DRIFT_STEPS];
+    char name[PATH_MAX], b[2][16];
+    int n, lost, k;
+
+    pthread_mutex_lock(&dp->report_mutex);
+    if (pass != dr->pass)
+    {
+        pthread_mutex_unlock(&dp->report_mutex);
+        return; /* not a sample of it */
+    }
+    if (dr->last_rate >= 0)
+        dr->step[dr->last_rate].after = drift_level(&dr->rate);
+    if (dr->last_lat >= 0)
+        dr->step[dr->last_lat].after = drift_level(&dr->lat);
+    n = dr->num;
+    lost = dr->lost;
+    memcpy(step, dr->step, n * sizeof(step[0]));
+    memcpy(is_lat, dr->is_lat, n * sizeof(is_lat[0]));
+    pthread_mutex_unlock(&dp->report_mutex);
+
+    pthread_mutex_lock(&out_mutex);
+    if (0 == n + lost)
+        printf("%s: pass %u held its MB/s and latency, no step of %g%% or "
+               "more\n", dp->device_name, pass, opt.drift_pct);
+    else
+    {
+        printf("%s: pass %u, %d step%s of %g%% or more:\n",
+               dp->device_name, pass, n + lost, (1 == n + lost) ? "" : "s",
+               opt.drift_pct);
+        printf("   seconds              lba   series      before       "
+               "after\n");
+    }
+    for (k = 0; k < n; ++k)
+    {
+        if (is_lat[k])
+            printf("  %8.1f %16" PRId64 "  latency %11s %11s\n", step[k].t,
+                   step[k].lba,
+                   lat_str((uint64_t)(step[k].before * 1e3), b[0],
+                           sizeof(b[0])),
+                   lat_str((uint64_t)(step[k].after * 1e3), b[1],
+                           sizeof(b[1])));
+        else
+            printf("  %8.1f %16" PRId64 "  MB/s    %11.1f %11.1f\n",
+                   step[k].t, step[k].lba, step[k].before, step[k].after);
+    }
+    if (lost)
+        printf("  %d more after the first %d not kept\n", lost, DRIFT_STEPS);
+    pthread_mutex_unlock(&out_mutex);
+    if (!jsonl_enabled())
+        return;
+    jsonl_escape(name, sizeof(name), dp->device_name);
+    for (k = 0; k < n; ++k)
+        jsonl_printf("{\"type\":\"drift\",\"device\":\"%s\",\"pass\":%u,"
+                     "\"series\":\"%s\",\"seconds\":%.1f,\"lba\":%" PRId64
+                     ",\"before\":%.2f,\"after\":%.2f}", name, pass,
+                     is_lat[k] ? "latency_us" : "mbps", step[k].t, step[k].lba,
+                     step[k].before, step[k].after);
+}
+
+/* --results: appends the record of pass of dp, begun at rm, secs and
+ * bytes long, to the store. */
+static void
+results_end(t_dev *dp, unsigned int pass, const char *label, double secs,
+            int64_t bytes, const struct results_mark *rm)
+{
+    struct results_rec *r = (struct results_rec *)calloc(1, sizeof(*r));
+    int z;
+
+    if (NULL == r)
+        return;
+    r->time = time(NULL);
+    r->pass = pass;
+    r->blk_sz = dp->blk_sz;
+    r->start = dp->start;
+    r->end = dp->end;
+    r->bytes = bytes;
+    r->ns = (secs > 0) ? (uint64_t)(secs * 1e9) : 0;
+    snprintf(r->id, sizeof(r->id), "%s", dp->dev_id);
+    snprintf(r->name, sizeof(r->name), "%s", dp->device_name);
+    snprintf(r->config, sizeof(r->config), "engine=%s bpt=%d qd=%d "
+             "pattern=%s%s", backend_select(dp, 0)->name, dp->bpt, dp->qd,
+             label, dp->flags.fua ? " fua" : "");
+    if (dp->erase_how && (1 == pass))
+    {
+        z = strlen(r->config);
+        snprintf(r->config + z, sizeof(r->config) - z, " erase=%s",
+                 dp->erase_how);
+        if (dp->erase_step)
+            snprintf(r->config + z, sizeof(r->config) - z, " erase=%s "
+                     "checked=%" PRId64 " survived=%" PRId64, dp->erase_how,
+                     dp->erase_checked, dp->erase_survived);
+    }
+    r->zones = TL_ZONES;
+    for (z = 0; z < TL_ZONES; ++z)
+    {
+        r->zone_bytes[z] = dp->zone_bytes[z] - rm->zone_bytes[z];
+        r->zone_ns[z] = dp->zone_ns[z] - rm->zone_ns[z];
+    }
+    r->lat = dp->lat_pass;
+    badmap_compact(&dp->bad);
+    pthread_mutex_lock(&dp->bad.mutex);
+    r->ext = dp->bad.ext;
+    r->next = dp->bad.num;
+    results_health(dp, rm->t, r);
+    r->recovered = CTR_GET(dp, recovered) - rm->rec;
+    r->unrecovered = CTR_GET(dp, unrecovered) - rm->unrec;
+    r->grown = dp->glist_n;
+    if (results_append(opt.results_path, r))
+        pr2serr("%s: --results: could not append to %s: %s\n",
+                dp->device_name, opt.results_path, strerror(errno));
+    pthread_mutex_unlock(&dp->bad.mutex);
+    free(r);
+}
+
+/* Prepares the READ templates of dp from dp->flags, once its CDB size
+ * is known; the limits of the size were checked by cdb_select(). */
+static void
+rd_template(t_dev *dp)
+{
+    const struct flags_t *ifp = &dp->flags;
+
+    sg_build_scsi_cdb(dp->rd_cdb, ifp->cdbsz, 0, 0, 0, ifp->fua, ifp->dpo,
+                      dp->dld);
+    if (dp->pi_type && (32 == ifp->cdbsz))
+    {
+        dp->rd_cdb[10] |= 0x20; /* RDPROTECT=1 */
+        sg_put_unaligned_be16(opt.pi_app, dp->rd_cdb + 24);
+        sg_put_unaligned_be16(opt.pi_mask, dp->rd_cdb + 26);
+    }
+    else if (dp->pi_type)
+        dp->rd_cdb[1] |= 0x20;
+    if (ifp->write)
+        sg_build_scsi_cdb(dp->wr_cdb, ifp->cdbsz, 0, 0, 1,
+                          FLUSH_FUA == opt.flush, 0, 0);
+    memset(&dp->rd_hdr, 0, sizeof(dp->rd_hdr));
+    dp->rd_hdr.interface_id = 'S';
+    dp->rd_hdr.cmd_len = ifp->cdbsz;
+    dp->rd_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+    dp->rd_hdr.mx_sb_len = SENSE_BUFF_LEN;
+    dp->rd_hdr.timeout = dp->timeout_ms;
+    memset(&dp->rd_h4, 0, sizeof(dp->rd_h4));
+    dp->rd_h4.guard = 'Q';
+    dp->rd_h4.request_len = ifp->cdbsz;
+    dp->rd_h4.max_response_len = SENSE_BUFF_LEN;
+    dp->rd_h4.timeout = dp->timeout_ms;
+    if (ifp->dio)
+        dp->rd_h4.flags = SGV4_FLAG_DIRECT_IO;
+    if (opt.poll_us)
+        dp->rd_h4.flags |= SGV4_FLAG_HIPRI;
+    if (opt.background)
+    {
+        dp->rd_h4.request_attr = 0; /* SIMPLE task attribute */
+        dp->rd_h4.request_priority = SAM_PRIORITY_LOW;
+    }
+}
+
+/* --pi: the protection type of dp from READ CAPACITY(16), and with it
+ * reads with RDPROTECT=1, the tuple of each block checked on the host.
+ * A drive formatted without PI, or with more than one tuple per block,
+ * is read without. NVMe namespaces are probed by nvme_identify_ns(). */
+static void
+pi_probe(t_dev *dp)
+{
+    uint8_t rc[RCAP16_REPLY_LEN];
+
+    if (FT_NVME & dp->out_type)
+        return;
+    if (!(FT_SG & dp->out_type))
+    {
+        pr2serr("%s: --pi needs sg or NVMe, reading without protection "
+                "information\n", dp->device_name);
+        return;
+    }
+    if (sg_ll_readcap_16(dp->fd, false, 0, rc, sizeof(rc), true,
+                         verbose > 1 ? verbose - 1 : 0) ||
+        !(rc[12] & 0x1))
+    {
+        pr2serr("%s: not formatted with protection information, reading "
+                "without\n", dp->device_name);
+        return;
+    }
+    if (rc[13] >> 4)
+    {
+        pr2serr("%s: %d protection intervals per block are not supported, "
+                "reading without\n", dp->device_name, 1 << (rc[13] >> 4));
+        return;
+    }
+    dp->pi_type = ((rc[12] >> 1) & 0x7) + 1;
+    dp->pi_ms = PI_TUPLE_SZ;
+    dp->pi_ext = true;
+    dp->pi_off = 0;
+    dp->pi_guard_sz = 2;
+    dp->pi_ref_bits = 32;
+    if (verbose)
+        pr2serr("%s: protection type %d\n", dp->device_name, dp->pi_type);
+}
+
+/* The READ CDB size of an sg device: READ(16) when the last lba does
+ * not fit the 32 bits of READ(10) or a transfer the 16 bits of its
+ * length, else READ(10), which every disk takes. A transfer larger
+ * than the Block Limits maximum is cut down to it. */
+static void
+cdb_select(t_dev *dp)
+{
+    int max_blocks = dp->max_xfer / (int)xfer_len(dp, 1);
+
+    if (!((FT_SG | FT_SIM) & dp->out_type))
+        return;
+    if ((max_blocks > 0) && (dp->bpt > max_blocks))
+    {
+        pr2serr("%s: -n %d is over the device maximum, reading %d blocks "
+                "at once\n", dp->device_name, dp->bpt, max_blocks);
+        dp->bpt = max_blocks;
+    }
+    if (2 == dp->pi_type)
+        dp->flags.cdbsz = 32; /* the only READ that takes type 2 PI */
+    else if ((dp->num_sect - 1 > (int64_t)UINT32_MAX) ||
+        (dp->end - 1 > (int64_t)UINT32_MAX) || (dp->bpt > 0xffff) ||
+        dp->dld)
+        dp->flags.cdbsz = 16; /* and for --cdl, READ(10) has no DLD */
+    else
+        dp->flags.cdbsz = DEF_SCSI_CDBSZ;
+    rd_template(dp);
+    if (verbose)
+        pr2serr("%s: READ(%d)\n", dp->device_name, dp->flags.cdbsz);
+}
+
+/* --media=dra|rcd: sets DRA or RCD in the current Caching mode page of
+ * dp, keeping the page as it was for media_restore(). The change is not
+ * saved, a power cycle also undoes it. */
+static void
+media_set(t_dev *dp)
+{
+    uint8_t mp[MEDIA_MP_LEN], *pg = mp + 8;
+    int len, res;
+
+    if (opt.media && !((FT_SG | FT_NVME) & dp->out_type))
+        pr2serr("%s: --media needs sg or NVMe passthrough, the drive cache "
+                "may serve the READs\n", dp->device_name);
+    if ((opt.media < MEDIA_DRA) || !(FT_SG & dp->out_type))
+        return;
+    memset(mp, 0, sizeof(mp));
+    res = sg_ll_mode_sense10(dp->fd, false, true, 0, CACHING_MP, 0, mp,
+                             sizeof(mp), false, verbose > 1 ? verbose - 1 : 0);
+    len = 8 + sg_get_unaligned_be16(mp + 6) + 2 + pg[1];
+    if (res || sg_get_unaligned_be16(mp + 6) || (CACHING_MP != (pg[0] & 0x3f)) ||
+        (pg[1] < 11) || (len > (int)sizeof(mp)))
+    {
+        pr2serr("%s: no Caching mode page, reading with DPO and FUA only\n",
+                dp->device_name);
+        return;
+    }
+    memcpy(dp->cache_mp, mp, len);
+    mp[0] = mp[1] = 0; /* MODE DATA LENGTH is reserved in MODE SELECT */
+    pg[0] &= 0x7f;     /* PS */
+    if (MEDIA_RCD == opt.media)
+        pg[2] |= 0x1;  /* RCD */
+    else
+        pg[12] |= 0x20; /* DRA */
+    res = sg_ll_mode_select10(dp->fd, true, false, mp, len, false,
+                              verbose > 1 ? verbose - 1 : 0);
+    if (res)
+    {
+        pr2serr("%s: MODE SELECT of the Caching page refused, reading with "
+                "DPO and FUA only\n", dp->device_name);
+        return;
+    }
+    dp->cache_mp_len = len;
+    if (verbose)
+        pr2serr("%s: %s until the scan ends\n", dp->device_name,
+                (MEDIA_RCD == opt.media) ? "read cache disabled"
+                                         : "read-ahead disabled");
+}
+
+/* Puts back the Caching page media_set() changed. */
+static void
+media_restore(t_dev *dp)
+{
+    uint8_t mp[MEDIA_MP_LEN];
+
+    if (0 == dp->cache_mp_len)
+        return;
+    memcpy(mp, dp->cache_mp, dp->cache_mp_len);
+    mp[0] = mp[1] = 0;
+    mp[8] &= 0x7f;
+    if (sg_ll_mode_select10(dp->fd, true, false, mp, dp->cache_mp_len, false,
+                            0))
+        pr2serr("%s: could not restore the Caching mode page\n",
+                dp->device_name);
+    dp->cache_mp_len = 0;
+}
+
+static void cdl_restore(t_dev *dp);
+
+/* The mode pages of all devices as they were, on a signal. */
+#ifndef DSKREAD_LIB
+static void
+media_restore_all(void)
+{
+    int k;
+
+    for (k = 0; k < num_devs; ++k)
+    {
+        if ((devs[k].fd >= 0) && devs[k].cache_mp_len)
+            media_restore(devs + k);
+        if ((devs[k].fd >= 0) && devs[k].cdl_mp_len)
+            cdl_restore(devs + k);
+        if ((devs[k].fd >= 0) && devs[k].rwr_mp_len)
+            recovery_restore(devs + k);
+    }
+}
+#endif
+
+/* REPORT SUPPORTED OPERATION CODES of the one command op, of service
+ * action sa when it is not negative, into resp through SG_IO. Returns
+ * 0, else the sense category or -1. */
+static int
+sg_rsoc_one(t_dev *dp, int op, int sa, uint8_t *resp, int len)
+{
+    unsigned char cdb[12] = {0xa3, 0x0c};
+    unsigned char senseBuff[SENSE_BUFF_LEN];
+    struct sg_io_hdr io_hdr;
+    int res;
+
+    cdb[2] = (sa < 0) ? 0x1 : 0x2; /* one command, with a service action */
+    cdb[3] = (unsigned char)op;
+    sg_put_unaligned_be16((sa < 0) ? 0 : sa, cdb + 4);
+    sg_put_unaligned_be32((uint32_t)len, cdb + 6);
+    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+    io_hdr.interface_id = 'S';
+    io_hdr.cmd_len = sizeof(cdb);
+    io_hdr.cmdp = cdb;
+    io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+    io_hdr.dxfer_len = len;
+    io_hdr.dxferp = resp;
+    io_hdr.mx_sb_len = SENSE_BUFF_LEN;
+    io_hdr.sbp = senseBuff;
+    io_hdr.timeout = DEF_TIMEOUT;
+    if (verbose > 2)
+        sg_print_command_len(cdb, sizeof(cdb));
+    while (((res = ioctl(dp->fd, SG_IO, &io_hdr)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno)))
+        ;
+    if (res < 0)
+        return -1;
+    res = sg_err_category3(&io_hdr);
+    if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res))
+        return 0;
+    if (verbose)
+        sg_chk_n_print3("REPORT SUPPORTED OPERATION CODES", &io_hdr,
+                        verbose > 1);
+    return res;
+}
+
+/* --cdl: whether the READ cdb_select() picks for dp takes a duration
+ * limit descriptor, and which CDL mode page has its limits, from
+ * REPORT SUPPORTED OPERATION CODES (RWCDLP and CDLP). Sets dp->dld,
+ * which cdb_select() then reads with READ(16) at least. */
+static void
+cdl_probe(t_dev *dp)
+{
+    static const int spg[2][2] = {{CDL_A_SPG, CDL_B_SPG},
+                                  {CDL_T2A_SPG, CDL_T2B_SPG}};
+    static const char *spg_str[2][2] = {{"A", "B"}, {"T2A", "T2B"}};
+    bool r32 = (2 == dp->pi_type); /* READ(32), as cdb_select() has it */
+    uint8_t resp[64];
+    int cdlp, sup;
+
+    dp->dld = dp->cdl_spg = 0;
+    if (0 == opt.cdl)
+        return;
+    if (!(FT_SG & dp->out_type))
+    {
+        pr2serr("%s: --cdl needs SCSI, reading without a duration limit\n",
+                dp->device_name);
+        return;
+    }
+    memset(resp, 0, sizeof(resp));
+    if (sg_rsoc_one(dp, r32 ? 0x7f : 0x88, r32 ? 0x9 : -1, resp,
+                    sizeof(resp)))
+    {
+        pr2serr("%s: no REPORT SUPPORTED OPERATION CODES, reading without a "
+                "duration limit\n", dp->device_name);
+        return;
+    }
+    sup = resp[1] & 0x7;
+    cdlp = (resp[1] >> 3) & 0x3;
+    if (((0x3 != sup) && (0x5 != sup)) || (0 == cdlp) || (0x3 == cdlp))
+    {
+        pr2serr("%s: READ(%d) takes no duration limit, reading without "
+                "one\n", dp->device_name, r32 ? 32 : 16);
+        return;
+    }
+    dp->dld = opt.cdl;
+    dp->cdl_spg = spg[resp[0] & 0x1][cdlp - 1];
+    if (verbose)
+        pr2serr("%s: READs carry duration limit descriptor %d of the CDL %s "
+                "mode page\n", dp->device_name, dp->dld,
+                spg_str[resp[0] & 0x1][cdlp - 1]);
+}
+
+/* ns of a T2CDLUNITS code, 0 -> no value */
+static uint64_t
+cdl_t2_unit_ns(int u)
+{
+    switch (u)
+    {
+    case 0x6:
+        return 500;
+    case 0x8:
+        return 1000;
+    case 0xa:
+        return 10000000;
+    case 0xe:
+        return 500000000;
+    default:
+        return 0;
+    }
+}
+
+/* A T2 descriptor time of old_ns units in new_ns ones, rounded up. */
+static void
+cdl_t2_rescale(uint8_t *p, uint64_t old_ns, uint64_t new_ns)
+{
+    uint64_t v = sg_get_unaligned_be16(p) * old_ns;
+
+    v = (v + new_ns - 1) / new_ns;
+    sg_put_unaligned_be16((v > 0xffff) ? 0xffff : (uint16_t)v, p);
+}
+
+/* --cdl i:ms: sets the active time of descriptor i in the current CDL
+ * mode page of dp to ms, aborting a command past it (the T2 pages have
+ * a policy, A and B abort anyway), keeping the page as it was for
+ * cdl_restore(). The change is not saved, a power cycle also undoes
+ * it. Times of up to 65 ms are set in us, longer ones in 10 ms. */
+static void
+cdl_set(t_dev *dp)
+{
+    uint8_t mp[CDL_MP_LEN], *pg = mp + 8, *d;
+    bool t2 = (dp->cdl_spg >= CDL_T2A_SPG);
+    bool fine = (opt.cdl_ms <= 65);
+    int len, res;
+
+    if ((0 == opt.cdl_ms) || (0 == dp->cdl_spg))
+        return;
+    memset(mp, 0, sizeof(mp));
+    res = sg_ll_mode_sense10(dp->fd, false, true, 0, CONTROL_MP, dp->cdl_spg,
+                             mp, sizeof(mp), false,
+                             verbose > 1 ? verbose - 1 : 0);
+    len = 8 + 4 + sg_get_unaligned_be16(pg + 2);
+    if (res || sg_get_unaligned_be16(mp + 6) ||
+        ((0x40 | CONTROL_MP) != (pg[0] & 0x7f)) || (dp->cdl_spg != pg[1]) ||
+        (len > (int)sizeof(mp)) || (len < 8 + 8 + CDL_MAX * (t2 ? 32 : 4)))
+    {
+        pr2serr("%s: no CDL mode page, reading with descriptor %d as the "
+                "drive has it\n", dp->device_name, dp->dld);
+        return;
+    }
+    memcpy(dp->cdl_mp, mp, len);
+    mp[0] = mp[1] = 0; /* MODE DATA LENGTH is reserved in MODE SELECT */
+    pg[0] &= 0x7f;     /* PS */
+    if (t2)
+    {
+        uint64_t old_ns, new_ns = fine ? 1000 : 10000000;
+
+        d = pg + 8 + 32 * (dp->dld - 1);
+        old_ns = cdl_t2_unit_ns(d[0] & 0xf);
+        cdl_t2_rescale(d + 2, old_ns, new_ns);  /* max inactive time */
+        cdl_t2_rescale(d + 10, old_ns, new_ns); /* duration guideline */
+        d[0] = (d[0] & 0xf0) | (fine ? 0x8 : 0xa);
+        sg_put_unaligned_be16(fine ? opt.cdl_ms * 1000 : (opt.cdl_ms + 9) / 10,
+                              d + 4);           /* max active time */
+        d[6] = (d[6] & 0xf0) | 0xf;             /* abort past it */
+    }
+    else
+    {
+        d = pg + 8 + 4 * (dp->dld - 1);
+        d[0] = (d[0] & 0x1f) | ((fine ? 0x4 : 0x5) << 5); /* CDLUNIT */
+        sg_put_unaligned_be16(fine ? opt.cdl_ms * 1000 : (opt.cdl_ms + 9) / 10,
+                              d + 2);
+    }
+    res = sg_ll_mode_select10(dp->fd, true, false, mp, len, false,
+                              verbose > 1 ? verbose - 1 : 0);
+    if (res)
+    {
+        pr2serr("%s: MODE SELECT of the CDL page refused, reading with "
+                "descriptor %d as the drive has it\n", dp->device_name,
+                dp->dld);
+        return;
+    }
+    dp->cdl_mp_len = len;
+    if (verbose)
+        pr2serr("%s: duration limit %d set to %d ms until the scan ends\n",
+                dp->device_name, dp->dld, opt.cdl_ms);
+}
+
+/* Puts back the CDL page cdl_set() changed. */
+static void
+cdl_restore(t_dev *dp)
+{
+    uint8_t mp[CDL_MP_LEN];
+
+    if (0 == dp->cdl_mp_len)
+        return;
+    memcpy(mp, dp->cdl_mp, dp->cdl_mp_len);
+    mp[0] = mp[1] = 0;
+    mp[8] &= 0x7f;
+    if (sg_ll_mode_select10(dp->fd, true, false, mp, dp->cdl_mp_len, false,
+                            0))
+        pr2serr("%s: could not restore the CDL mode page\n",
+                dp->device_name);
+    dp->cdl_mp_len = 0;
+}
+
+/* Aligns the transfers of dp to its physical blocks, which 512e drives
+ * otherwise read-modify: -n becomes a multiple of them and range_next()
+ * ends each READ on one. A --start or --end off a physical block only
+ * makes the first or the last READ short, and is warned about. */
+static void
+align_plan(t_dev *dp)
+{
+    int64_t a;
+
+    dp->pblk = ((dp->pblk_sz > dp->blk_sz) && !(dp->pblk_sz % dp->blk_sz))
+                   ? dp->pblk_sz / dp->blk_sz : 1;
+    if (1 == dp->pblk)
+        return;
+    a = dp->align_lba %= dp->pblk;
+    if (dp->bpt % dp->pblk)
+    {
+        int bpt = (dp->bpt < dp->pblk) ? dp->pblk
+                                       : dp->bpt - dp->bpt % dp->pblk;
+
+        pr2serr("%s: -n %d is not a multiple of the %d blocks of a physical "
+                "block, using %d\n", dp->device_name, dp->bpt, dp->pblk, bpt);
+        dp->bpt = bpt;
+    }
+    if (((dp->start + dp->pblk - a) % dp->pblk) ||
+        ((dp->end + dp->pblk - a) % dp->pblk))
+        pr2serr("%s: --start %" PRId64 " or --end %" PRId64 " is not on a "
+                "physical block (%d blocks from lba %" PRId64 "), a READ at "
+                "that end is misaligned\n", dp->device_name, dp->start,
+                dp->end, dp->pblk, a);
+}
+
+/* The condition attributes of the devices: the side queues wait on
+ * lat_now_ns(). */
+static void
+dev_cattr(pthread_condattr_t *cattr)
+{
+    pthread_condattr_init(cattr);
+    pthread_condattr_setclock(cattr, CLOCK_MONOTONIC);
+}
+
+/* A device named name with the options of the command line, not open. */
+static void
+dev_init(t_dev *dp, char *name, const pthread_condattr_t *cattr)
+{
+    dp->device_name = name;
+    dp->fd = -1;
+    dp->blk_sz = DEF_BLOCK_SIZE;
+    dp->start = opt.start;
+    dp->end = opt.end;
+    dp->flags = oflag;
+    dp->mrq = opt.mrq;
+    dp->bpt = opt.sectors;
+    dp->qd = opt.qd;
+    dp->timeout_ms = DEF_TIMEOUT;
+    dp->ua_budget = MAX_UNIT_ATTENTIONS;
+    dp->aborted_budget = MAX_ABORTED_CMDS;
+    dp->read_long_blk_inc = READ_LONG_DEF_BLK_INC;
+    dp->dd_count = -1;
+    pthread_mutex_init(&dp->report_mutex, NULL);
+    pthread_mutex_init(&dp->iso_mutex, NULL);
+    pthread_mutex_init(&dp->rl_mutex, NULL);
+    dp->rl_fd = -1;
+    pthread_cond_init(&dp->iso_cond, cattr);
+    dp->iso_low = INT64_MAX;
+    dp->iso_work = -1;
+    badmap_init(&dp->bad);
+    badmap_init(&dp->suspect);
+    dp->resume_lba = -1;
+    dp->numa_node = -1;
+    dp->health_fd = -1;
+    health_init(&dp->health);
+    dp->glist_n = -1;
+    dp->idle_fd = -1;
+    dp->md_id = -1;
+}
+
+/* Appends the bad map of dp to --bad-map and --bad-map-text. */
+static void
+bad_save(t_dev *dp)
+{
+    if (!bad_fp && !bad_text_fp)
+        return;
+    pthread_mutex_lock(&bad_mutex);
+    if (bad_fp && (badmap_save(bad_fp, dp->device_name, dp->blk_sz,
+                               dp->num_sect, &dp->bad) ||
+                   fflush(bad_fp)))
+        perror(opt.bad_path);
+    if (bad_text_fp)
+    {
+        badmap_text(bad_text_fp, dp->device_name, &dp->bad);
+        fflush(bad_text_fp);
+    }
+    pthread_mutex_unlock(&bad_mutex);
+}
+
+/* --clone: the buffers between the READs of the source and the WRITEs
+ * of the destination, bpt blocks each. The reader takes free slots in
+ * lba order and queues them full as its READs complete; the writer
+ * takes them in that order and frees them once written, so no more
+ * than nslots buffers of the source are ever held. Under mutex. */
+struct _clone
+{
+    t_dev *src;
+    t_dev *dst;
+    int nslots;
+    struct
+    {
+        uint8_t *buf;
+        uint8_t *free_buf;
+        uint8_t *cbuf; /* --compare, what the other side holds there */
+        uint8_t *free_cbuf;
+        int64_t lba;
+        int blocks;
+        uint64_t seq; /* the order it was read in */
+    } *slot;
+    int *free_stk; /* free_stk[0, nfree) are free */
+    int nfree;
+    int *full_q;   /* a ring, nfull of them from full_head */
+    int full_head;
+    int nfull;
+    bool eof;      /* the reader is done, what is full is the last */
+    bool stop;     /* the writer is done, the reader stops */
+    int wres;      /* what ended the writer */
+    int64_t unflushed;  /* --flush=bytes, written since the last flush */
+    int64_t mismatches; /* blocks read back different, or that differ */
+    uint8_t *vbuf;      /* which are read back into this */
+    uint8_t *vbuf_free;
+    double t0; /* mono_secs() the copy started */
+    int64_t from; /* where the reader starts, after what was offloaded */
+    int via;      /* CLONE_*, how it is copied */
+    bool shared;  /* the destination fd shares the buffer of the source */
+    uint8_t cscd[2][32]; /* CLONE_XCOPY: the target descriptors, */
+    int xc_blocks;       /* blocks per segment, */
+    int xc_segs;         /* segments per EXTENDED COPY */
+    int xc_usage;        /* and its LIST ID USAGE */
+    uint8_t list_id;
+    bool compare;        /* --compare: the "writer" reads and compares */
+    const uint8_t *map;  /* --compare with an image file: it all mapped */
+    size_t map_len;
+    struct image *image; /* --image: the writer adds to it instead */
+    struct image_stats image_st; /* of it at the end of the pass */
+    struct manifest *man; /* --manifest, --manifest-check: hashed too */
+    struct manifest_stats man_st;
+    bool ordered;  /* the writer takes the slots in the order read */
+    uint64_t rseq; /* the seq of the next slot read, */
+    uint64_t wseq; /* and of the next the writer takes */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+typedef struct _clone t_clone;
+
+/* A full slot for the writer (full), else a free one for the reader,
+ * waiting for one when wait. -1 when there is none now, -2 when no
+ * more will come: the reader is done and all it read taken, or for the
+ * reader, the writer failed. An ordered writer (--image, --manifest)
+ * takes the slots in the order the reader took them, though READs
+ * queued on an sg device can complete in any order. */
+static int
+clone_take(t_clone *c, bool full, bool wait)
+{
+    int k = -1, j, *hp;
+
+    pthread_mutex_lock(&c->mutex);
+    for (;;)
+    {
+        for (j = 0; full && c->ordered && (j < c->nfull); ++j)
+        {
+            hp = c->full_q + (c->full_head + j) % c->nslots;
+            if (c->slot[*hp].seq == c->wseq)
+            {
+                k = *hp; /* to the head, which is taken */
+                *hp = c->full_q[c->full_head];
+                c->full_q[c->full_head] = k;
+                ++c->wseq;
+                break;
+            }
+        }
+        if (full && c->nfull && (!c->ordered || (j < c->nfull)))
+        {
+            k = c->full_q[c->full_head];
+            c->full_head = (c->full_head + 1) % c->nslots;
+            --c->nfull;
+            break;
+        }
+        if ((full && c->eof) || (!full && c->stop))
+        {
+            k = -2;
+            break;
+        }
+        if (!full && c->nfree)
+        {
+            k = c->free_stk[--c->nfree];
+            break;
+        }
+        if (!wait)
+            break;
+        pthread_cond_wait(&c->cond, &c->mutex);
+    }
+    pthread_mutex_unlock(&c->mutex);
+    return k;
+}
+
+/* Queues slot k for the writer (full), else frees it. */
+static void
+clone_put(t_clone *c, int k, bool full)
+{
+    pthread_mutex_lock(&c->mutex);
+    if (full)
+        c->full_q[(c->full_head + c->nfull++) % c->nslots] = k;
+    else
+        c->free_stk[c->nfree++] = k;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->mutex);
+}
+
+/* The side stops, the writer when write. */
+static void
+clone_end(t_clone *c, bool write)
+{
+    pthread_mutex_lock(&c->mutex);
+    if (write)
+        c->stop = true;
+    else
+        c->eof = true;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->mutex);
+}
+
+/* --clone-verify: reads back the blocks written at lba from buf, those
+ * that differ put in the bad map of the destination. */
+static void
+clone_check(t_clone *c, const uint8_t *buf, int64_t lba, int blocks)
+{
+    t_dev *dp = c->dst;
+    size_t bs = dp->blk_sz;
+    int k, res;
+
+    if (FT_SG & dp->out_type)
+    {
+        bool diop = false;
+        int blks_readp = 0;
+
+        res = sg_read(dp, c->vbuf, blocks, lba, &diop, &blks_readp);
+    }
+    else
+        res = direct_read(dp, c->vbuf, blocks, lba);
+    if (res)
+    {
+        pr2serr("%s: reading back lba=%" PRId64 " [0x%" PRIx64 "] failed\n",
+                dp->device_name, lba, lba);
+        return;
+    }
+    for (k = 0; k < blocks; ++k)
+        if (memcmp(buf + k * bs, c->vbuf + k * bs, bs))
+        {
+            ++c->mismatches;
+            bad_block(dp, BADMAP_MISMATCH, lba + k, 1);
+        }
+}
+
+/* Takes in the I/O of slot on one side of --clone, res its sense
+ * category, or when not async, the result of a read or write that has
+ * retried and reported it already. A READ goes to the writer, a failed
+ * one read again by sg_read() first; a WRITE is read back with
+ * --clone-verify and its slot freed. Returns 0, else the error that
+ * fails the copy. */
+static int
+clone_done(t_clone *c, t_rq *rqp, int slot, int res, bool async)
+{
+    t_dev *dp = rqp->write ? c->dst : c->src;
+    uint8_t *buf = c->slot[slot].buf;
+    int64_t lba = rqp->lba, bytes = (int64_t)rqp->blocks * dp->blk_sz;
+    bool ok = (SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res);
+
+    if (!rqp->write)
+    {
+        if (!ok && async)
+        {
+            bool diop = false;
+            int blks_readp = 0;
+
+            res = sg_read(dp, buf, rqp->blocks, lba, &diop, &blks_readp);
+            ok = (0 == res);
+        }
+        if (!ok)
+        {
+            pr2serr("%s: read failed at or after lba=%" PRId64 " [0x%"
+                    PRIx64 "], not cloned\n", dp->device_name, lba, lba);
+            clone_put(c, slot, false);
+            return res ? res : -1;
+        }
+        if (async)
+        {
+            lat_done(dp, lba, rqp->blocks, rqp->t_ns);
+            io_trace(dp, TRACE_READ, lba, rqp->blocks, rqp->t_ns, rqp->qd, 0);
+        }
+        CTR_ADD(dp, in_full, rqp->blocks);
+        __atomic_fetch_add(&dp->bytes_done, bytes, __ATOMIC_RELAXED);
+        clone_put(c, slot, true);
+        return 0;
+    }
+    if (!ok && async)
+    {
+        errlog_put(SG_LIB_CAT_OTHER, NULL, 0, 0, "writing", &rqp->io_hdr,
+                   verbose > 1);
+        CTR_ADD(dp, unrecovered, 1);
+        bad_block(dp, BADMAP_BAD, lba, rqp->blocks);
+    }
+    if (ok)
+    {
+        __atomic_fetch_add(&dp->bytes_written, bytes, __ATOMIC_RELAXED);
+        if (opt.clone_verify)
+            clone_check(c, buf, lba, rqp->blocks);
+        c->unflushed += bytes;
+        if ((FLUSH_EVERY == opt.flush) && (c->unflushed >= opt.flush_every))
+        {
+            c->unflushed = 0;
+            write_flush(dp);
+        }
+    }
+    clone_put(c, slot, false);
+    return (ok || (dp->flags.coe && !c->ordered)) ? 0 : (res ? res : -1);
+}
+
+/* Takes in the READ into the cbuf of slot by the other side of
+ * --compare, res as in clone_done(), and compares it with what the
+ * source read there. Blocks that differ go to the bad map of the
+ * source, those the other side could not read to its own. Returns 0,
+ * else the error that fails the compare. */
+static int
+compare_done(t_clone *c, t_rq *rqp, int slot, int res, bool async)
+{
+    t_dev *dp = c->dst;
+    int64_t lba = rqp->lba;
+    size_t bs = dp->blk_sz, len = (size_t)rqp->blocks * bs, pos = 0, off;
+    const uint8_t *buf = c->slot[slot].buf;
+    const uint8_t *other = c->map ? c->map + lba * bs : c->slot[slot].cbuf;
+    bool ok = (SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res);
+
+    if (!ok && async)
+    {
+        bool diop = false;
+        int blks_readp = 0;
+
+        res = sg_read(dp, c->slot[slot].cbuf, rqp->blocks, lba, &diop,
+                      &blks_readp);
+        ok = (0 == res);
+    }
+    if (!ok)
+    {
+        pr2serr("%s: read failed at or after lba=%" PRId64 " [0x%" PRIx64
+                "], not compared\n", dp->device_name, lba, lba);
+        bad_block(dp, BADMAP_BAD, lba, rqp->blocks);
+        clone_put(c, slot, false);
+        return dp->flags.coe ? 0 : (res ? res : -1);
+    }
+    if (__atomic_load_n(&check_stream, __ATOMIC_RELAXED))
+        __atomic_fetch_add(&c->src->stream_bytes, (int64_t)len,
+                           __ATOMIC_RELAXED);
+    while ((off = (__atomic_load_n(&check_stream, __ATOMIC_RELAXED)
+                       ? buf_compare_stream
+                       : buf_compare)(buf + pos, other + pos, len - pos)) <
+           len - pos)
+    {
+        pos += off;
+        if (0 == c->mismatches++)
+            pr2serr("%s: first difference from %s at lba=%" PRId64
+                    " offset %zu\n", c->src->device_name, dp->device_name,
+                    lba + (int64_t)(pos / bs), pos % bs);
+        bad_block(c->src, BADMAP_MISMATCH, lba + (int64_t)(pos / bs), 1);
+        pos = (pos / bs + 1) * bs; /* on to the next block */
+        if (pos >= len)
+            break;
+    }
+    __atomic_fetch_add(&dp->bytes_done, (int64_t)len, __ATOMIC_RELAXED);
+    clone_put(c, slot, false);
+    return 0;
+}
+
+/* One side of --clone, the writer when write: dp->qd commands queued on
+ * an sg device as in write_pass_async(), else one at a time with
+ * sg_read(), direct_read() or blk_pwrite(). With --compare the writer
+ * reads too, into the cbufs, or takes the blocks from the mapped image.
+ * Returns 0, else the error that ended it. */
+static int
+clone_side(t_clone *c, bool write)
+{
+    t_dev *dp = write ? c->dst : c->src;
+    bool async = (FT_SG & dp->out_type) && !(FT_BLOCK & dp->out_type);
+    bool cmp = write && c->compare;
+    int qd = async ? dp->qd : 1;
+    t_rq *rqs = (t_rq *)calloc(qd, sizeof(t_rq));
+    int *slot_of = (int *)calloc(qd, sizeof(int));
+    int64_t next = c->from, lba;
+    int k, slot, blocks, res, ret = 0, in_flight = 0, pend = -1;
+    uint64_t wait;
+    bool done = false; /* nothing more to take */
+    t_rq *rqp;
+
+    if ((NULL == rqs) || (NULL == slot_of))
+    {
+        pr2serr(">> heap problems\n");
+        ret = -1;
+    }
+    for (;;)
+    {
+        for (k = 0; !done && (0 == ret) && (k < qd); ++k)
+        {
+            rqp = rqs + k;
+            if (rqp->busy)
+                continue;
+            slot = pend;
+            pend = -1;
+            if ((slot < 0) && write)
+            {
+                slot = clone_take(c, true, 0 == in_flight);
+                done = (-2 == slot);
+                if (slot < 0)
+                    break;
+            }
+            else if (slot < 0)
+            {
+                lba = next;
+                blocks = dp->bpt;
+                if (!range_next(dp, &lba, &blocks))
+                {
+                    done = true;
+                    break;
+                }
+                slot = clone_take(c, false, 0 == in_flight);
+                done = (-2 == slot);
+                if (slot < 0)
+                    break;
+                c->slot[slot].lba = lba;
+                c->slot[slot].blocks = blocks;
+                c->slot[slot].seq = c->rseq++;
+                next = lba + blocks;
+                while ((wait = throttle_ns(dp, (int64_t)blocks * dp->blk_sz)))
+                    throttle_sleep(wait);
+            }
+            rqp->write = write && !cmp;
+            rqp->lba = c->slot[slot].lba;
+            rqp->blocks = c->slot[slot].blocks;
+            rqp->buffp = cmp ? c->slot[slot].cbuf : c->slot[slot].buf;
+            slot_of[k] = slot;
+            if (!async)
+            {
+                if (rqp->write && (c->image || c->man))
+                {
+                    res = c->image ? image_put(c->image, rqp->lba,
+                                               rqp->buffp, rqp->blocks)
+                                   : 0;
+                    if ((0 == res) && c->man)
+                        res = manifest_put(c->man, rqp->lba, rqp->buffp,
+                                           rqp->blocks);
+                    if (res)
+                        perror(dp->device_name);
+                }
+                else if (rqp->write)
+                    res = blk_pwrite(dp, rqp->buffp, rqp->blocks, rqp->lba);
+                else if (cmp && c->map)
+                    res = 0; /* compared where it is mapped */
+                else if (FT_SG & dp->out_type)
+                {
+                    bool diop = false;
+                    int blks_readp = 0;
+
+                    res = sg_read(dp, rqp->buffp, rqp->blocks, rqp->lba,
+                                  &diop, &blks_readp);
+                }
+                else
+                    res = direct_read(dp, rqp->buffp, rqp->blocks, rqp->lba);
+                ret = cmp ? compare_done(c, rqp, slot, res, false)
+                          : clone_done(c, rqp, slot, res, false);
+                if (!write)
+                    __atomic_store_n(&dp->cur_lba, next, __ATOMIC_RELAXED);
+                continue;
+            }
+            res = sg_start_io(dp, rqp);
+            if ((-2 == res) && (in_flight > 0))
+            {
+                pend = slot; /* ENOMEM, reap some first */
+                break;
+            }
+            if (res)
+            {
+                clone_put(c, slot, false);
+                ret = res;
+                break;
+            }
+            rqp->busy = true;
+            rqp->qd = ++in_flight;
+        }
+        if (0 == in_flight)
+        {
+            if (ret || done)
+                break;
+            continue;
+        }
+        res = sg_finish_io(dp, &rqp, false);
+        if (res < 0)
+        {
+            ret = -1;
+            break;
+        }
+        rqp->busy = false;
+        --in_flight;
+        res = cmp ? compare_done(c, rqp, slot_of[rqp - rqs], res, true)
+                  : clone_done(c, rqp, slot_of[rqp - rqs], res, true);
+        if (res && (0 == ret))
+            ret = res;
+        if (!write)
+            __atomic_store_n(&dp->cur_lba, write_water(rqs, qd, false, 0, next),
+                             __ATOMIC_RELAXED);
+    }
+    free(rqs);
+    free(slot_of);
+    return ret;
+}
+
+static void *
+clone_writer(void *arg)
+{
+    t_clone *c = (t_clone *)arg;
+
+    c->wres = clone_side(c, true);
+    clone_end(c, true);
+    cpu_charge(c->src);
+    return NULL;
+}
+
+static const char *
+clone_via_str(int via)
+{
+    switch (via)
+    {
+    case CLONE_XCOPY:
+        return "by EXTENDED COPY";
+    case CLONE_SHARE:
+        return "through shared sg buffers";
+    }
+    return "through the host";
+}
+
+/* --clone-verify of a copy that did not pass through the host: reads
+ * the source back as well, bpt blocks at a time. */
+static void
+clone_check_both(t_clone *c, int64_t lba, int blocks)
+{
+    t_dev *dp = c->src;
+    uint8_t *buf = c->slot[0].buf;
+    int n, res;
+
+    for (; blocks > 0; lba += n, blocks -= n)
+    {
+        n = (blocks < dp->bpt) ? blocks : dp->bpt;
+        if (FT_SG & dp->out_type)
+        {
+            bool diop = false;
+            int blks_readp = 0;
+
+            res = sg_read(dp, buf, n, lba, &diop, &blks_readp);
+        }
+        else
+            res = direct_read(dp, buf, n, lba);
+        if (0 == res)
+            clone_check(c, buf, lba, n);
+    }
+}
+
+/* The identification target descriptor of EXTENDED COPY for dp, of its
+ * NAA designator, else its EUI-64 one. Returns 0, -1 without either. */
+static int
+xcopy_cscd(t_dev *dp, uint8_t *desc)
+{
+    uint8_t vpd[512];
+    int k, len, dlen, type;
+
+    if (sg_ll_inquiry(dp->fd, false, true, 0x83, vpd, sizeof(vpd), false, 0))
+        return -1;
+    len = sg_get_unaligned_be16(vpd + 2) + 4;
+    if (len > (int)sizeof(vpd))
+        len = sizeof(vpd);
+    for (type = 3; type >= 2; --type)
+        for (k = 4; k + 4 <= len; k += 4 + dlen)
+        {
+            dlen = vpd[k + 3];
+            if ((k + 4 + dlen > len) || (vpd[k + 1] & 0x30) ||
+                (1 != (vpd[k] & 0xf)) || (type != (vpd[k + 1] & 0xf)) ||
+                (dlen > 20))
+                continue; /* not of the lu, not binary or too long */
+            memset(desc, 0, 32);
+            desc[0] = 0xe4; /* identification descriptor */
+            memcpy(desc + 4, vpd + k, 4 + dlen);
+            desc[4] &= 0x1f;
+            sg_put_unaligned_be24((uint32_t)dp->blk_sz, desc + 29);
+            return 0;
+        }
+    return -1;
+}
+
+/* Whether the source of c takes EXTENDED COPY(LID1) to the destination,
+ * by the RECEIVE COPY OPERATING PARAMETERS of the source. Sets the
+ * segments of c to its limits. */
+static bool
+xcopy_probe(t_clone *c)
+{
+    uint8_t rc[256];
+    uint32_t seg_bytes, max_desc;
+
+    if (!(FT_SG & c->src->out_type) || !(FT_SG & c->dst->out_type))
+        return false;
+    memset(rc, 0, sizeof(rc));
+    if (sg_ll_receive_copy_results(c->src->fd, 3 /* OPERATING PARAMETERS */,
+                                   0, rc, sizeof(rc), false,
+                                   verbose > 1 ? verbose - 1 : 0) ||
+        (sg_get_unaligned_be16(rc + 8) < 2) ||
+        (0 == sg_get_unaligned_be16(rc + 10)))
+        return false;
+    seg_bytes = sg_get_unaligned_be32(rc + 16);
+    c->xc_blocks = seg_bytes ? (int)(seg_bytes / c->src->blk_sz) : 0xffff;
+    if (c->xc_blocks > 0xffff)
+        c->xc_blocks = 0xffff;
+    c->xc_segs = sg_get_unaligned_be16(rc + 10);
+    if (c->xc_segs > XCOPY_SEGS)
+        c->xc_segs = XCOPY_SEGS;
+    max_desc = sg_get_unaligned_be32(rc + 12);
+    while ((c->xc_segs > 1) && max_desc && (64 + 28 * c->xc_segs > max_desc))
+        --c->xc_segs;
+    /* no list id to hold data under when the device holds none */
+    c->xc_usage = sg_get_unaligned_be32(rc + 24) ? 0 : 2;
+    return (c->xc_blocks > 0) && (0 == xcopy_cscd(c->src, c->cscd[0])) &&
+           (0 == xcopy_cscd(c->dst, c->cscd[1])) &&
+           memcmp(c->cscd[0], c->cscd[1], sizeof(c->cscd[0]));
+}
+
+/* --clone by EXTENDED COPY(LID1) to the source: up to xc_segs block to
+ * block segments of xc_blocks each per command, the data moving only
+ * between the devices. The first that fails leaves the rest from its
+ * lba to the host (c->via). Returns 0. */
+static int
+clone_xcopy(t_clone *c)
+{
+    t_dev *dp = c->src;
+    uint8_t param[16 + 64 + 28 * XCOPY_SEGS], *seg;
+    int64_t next = c->from, lba, first, blks;
+    int n, blocks, res;
+    uint64_t wait;
+
+    while (next < dp->end)
+    {
+        memset(param, 0, sizeof(param));
+        param[0] = c->list_id++;
+        param[1] = c->xc_usage << 3;
+        sg_put_unaligned_be16(64, param + 2); /* two target descriptors */
+        memcpy(param + 16, c->cscd[0], 32);
+        memcpy(param + 48, c->cscd[1], 32);
+        first = -1;
+        blks = 0;
+        for (n = 0; n < c->xc_segs; ++n)
+        {
+            lba = next;
+            blocks = c->xc_blocks;
+            if (!range_next(dp, &lba, &blocks))
+            {
+                next = dp->end;
+                break;
+            }
+            if (first < 0)
+                first = lba;
+            seg = param + 80 + 28 * n;
+            seg[0] = 0x02; /* block device to block device */
+            sg_put_unaligned_be16(0x18, seg + 2);
+            sg_put_unaligned_be16(1, seg + 6); /* to the second target */
+            sg_put_unaligned_be16((uint16_t)blocks, seg + 10);
+            sg_put_unaligned_be64((uint64_t)lba, seg + 12);
+            sg_put_unaligned_be64((uint64_t)lba, seg + 20);
+            next = lba + blocks;
+            blks += blocks;
+        }
+        if (0 == n)
+            break;
+        sg_put_unaligned_be32(28 * n, param + 8);
+        while ((wait = throttle_ns(dp, blks * dp->blk_sz)))
+            throttle_sleep(wait);
+        res = sg_ll_3party_copy_out(dp->fd, 0 /* EXTENDED COPY(LID1) */,
+                                    param[0], 0, XCOPY_TIMEOUT_S, param,
+                                    80 + 28 * n, false,
+                                    verbose > 1 ? verbose - 1 : 0);
+        if (res)
+        {
+            pr2serr("%s: EXTENDED COPY at lba=%" PRId64 " failed, copying "
+                    "the rest through the host\n", dp->device_name, first);
+            c->via = CLONE_COPY;
+            c->from = first;
+            return 0;
+        }
+        CTR_ADD(dp, in_full, blks);
+        __atomic_fetch_add(&dp->bytes_done, blks * dp->blk_sz,
+                           __ATOMIC_RELAXED);
+        __atomic_fetch_add(&c->dst->bytes_written, blks * dp->blk_sz,
+                           __ATOMIC_RELAXED);
+        c->unflushed += blks * dp->blk_sz;
+        if (opt.clone_verify)
+            for (n = 0, seg = param + 80; n < (int)(sg_get_unaligned_be32(
+                                                         param + 8) / 28);
+                 ++n, seg += 28)
+                clone_check_both(c, (int64_t)sg_get_unaligned_be64(seg + 12),
+                                 sg_get_unaligned_be16(seg + 10));
+        __atomic_store_n(&dp->cur_lba, next, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+/* Whether the sg fd of the destination of c can share the buffer of the
+ * source's, which is made large enough for a transfer; they then share
+ * it (c->shared). */
+static bool
+share_probe(t_clone *c)
+{
+    struct sg_extended_info sei;
+    int t = c->src->bpt * c->src->blk_sz, v = 0;
+
+    if (!(FT_SG & c->src->out_type) || (FT_BLOCK & c->src->out_type) ||
+        !(FT_SG & c->dst->out_type) || (FT_BLOCK & c->dst->out_type) ||
+        (ioctl(c->src->fd, SG_GET_VERSION_NUM, &v) < 0) ||
+        (v < SG_SHARE_MIN_VERSION) ||
+        (ioctl(c->src->fd, SG_SET_RESERVED_SIZE, &t) < 0))
+        return false;
+    memset(&sei, 0, sizeof(sei));
+    sei.sei_wr_mask = sei.sei_rd_mask = SG_SEIM_SHARE_FD;
+    sei.share_fd = (uint32_t)c->src->fd;
+    c->shared = (ioctl(c->dst->fd, SG_SET_GET_EXTENDED, &sei) >= 0);
+    return c->shared;
+}
+
+static void
+share_drop(t_clone *c)
+{
+    struct sg_extended_info sei;
+
+    memset(&sei, 0, sizeof(sei));
+    sei.sei_wr_mask = sei.sei_rd_mask = SG_SEIM_CTL_FLAGS;
+    sei.ctl_flags_wr_mask = sei.ctl_flags = SG_CTL_FLAGM_UNSHARE;
+    ioctl(c->src->fd, SG_SET_GET_EXTENDED, &sei);
+    c->shared = false;
+}
+
+/* A READ, or WRITE when write, of blocks at lba through the sg v4
+ * interface, into or from buf, or the buffer shared with the other fd
+ * of --clone when buf is NULL. Returns the sense category, -1 when the
+ * ioctl failed. */
+static int
+sg4_rw(t_dev *dp, bool write, int64_t lba, int blocks, uint8_t *buf)
+{
+    struct sg_io_v4 h4;
+    uint8_t cdb[MAX_SCSI_CDBSZ], sb[SENSE_BUFF_LEN];
+    uint32_t len = (uint32_t)blocks * dp->blk_sz;
+    int res;
+
+    if (write)
+        wr_cdb_put(dp, cdb, blocks, lba);
+    else
+        rd_cdb_put(dp, cdb, blocks, lba);
+    memset(&h4, 0, sizeof(h4));
+    h4.guard = 'Q';
+    h4.request_len = dp->flags.cdbsz;
+    h4.request = (uint64_t)(uintptr_t)cdb;
+    h4.max_response_len = sizeof(sb);
+    h4.response = (uint64_t)(uintptr_t)sb;
+    h4.timeout = DEF_TIMEOUT;
+    if (write)
+    {
+        h4.dout_xfer_len = len;
+        h4.dout_xferp = (uint64_t)(uintptr_t)buf;
+    }
+    else
+    {
+        h4.din_xfer_len = len;
+        h4.din_xferp = (uint64_t)(uintptr_t)buf;
+    }
+    if (NULL == buf)
+        h4.flags = SGV4_FLAG_SHARE | SGV4_FLAG_NO_DXFER;
+    if (verbose > 2)
+        sg_print_command_len(cdb, dp->flags.cdbsz);
+    while (((res = ioctl(dp->fd, SG_IO, &h4)) < 0) &&
+           ((EINTR == errno) || (EAGAIN == errno)))
+        ;
+    if (res < 0)
+        return -1;
+    return sg_err_category_new(h4.device_status, h4.transport_status,
+                               h4.driver_status, sb, h4.response_len);
+}
+
+/* --clone through the shared buffer: each READ of the source stays in
+ * the sg driver and the WRITE of the destination takes it from there,
+ * one transfer at a time. A READ that fails is read again by sg_read()
+ * and written from the host. If the first transfer fails the driver
+ * does not share after all, and the host copies (c->via). Returns 0,
+ * else the error that ended it. */
+static int
+clone_share(t_clone *c)
+{
+    t_dev *dp = c->src, *dst = c->dst;
+    uint8_t *buf = c->slot[0].buf;
+    int64_t lba, next = c->from;
+    int blocks, res, ret = 0;
+    uint64_t wait;
+    bool first = true;
+
+    while (0 == ret)
+    {
+        lba = next;
+        blocks = dp->bpt;
+        if (!range_next(dp, &lba, &blocks))
+            break;
+        while ((wait = throttle_ns(dp, (int64_t)blocks * dp->blk_sz)))
+            throttle_sleep(wait);
+        res = sg4_rw(dp, false, lba, blocks, NULL);
+        if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res))
+            res = sg4_rw(dst, true, lba, blocks, NULL);
+        else if (!first)
+        {
+            bool diop = false;
+            int blks_readp = 0;
+
+            res = sg_read(dp, buf, blocks, lba, &diop, &blks_readp);
+            if (res)
+            {
+                pr2serr("%s: read failed at or after lba=%" PRId64 " [0x%"
+                        PRIx64 "], not cloned\n", dp->device_name, lba, lba);
+                ret = res;
+                break;
+            }
+            res = sg4_rw(dst, true, lba, blocks, buf);
+        }
+        if (first && (SG_LIB_CAT_CLEAN != res) &&
+            (SG_LIB_CAT_RECOVERED != res))
+        {
+            pr2serr("%s: the sg driver does not share buffers, copying "
+                    "through the host\n", dp->device_name);
+            share_drop(c);
+            c->via = CLONE_COPY;
+            c->from = lba;
+            return 0;
+        }
+        first = false;
+        if ((SG_LIB_CAT_CLEAN == res) || (SG_LIB_CAT_RECOVERED == res))
+        {
+            c->unflushed += (int64_t)blocks * dp->blk_sz;
+            __atomic_fetch_add(&dst->bytes_written, (int64_t)blocks *
+                                                        dp->blk_sz,
+                               __ATOMIC_RELAXED);
+        }
+        else
+        {
+            pr2serr("%s: write failed at or after lba=%" PRId64 " [0x%"
+                    PRIx64 "]\n", dst->device_name, lba, lba);
+            CTR_ADD(dst, unrecovered, 1);
+            bad_block(dst, BADMAP_BAD, lba, blocks);
+            if (!dst->flags.coe)
+                ret = res;
+        }
+        CTR_ADD(dp, in_full, blocks);
+        __atomic_fetch_add(&dp->bytes_done, (int64_t)blocks * dp->blk_sz,
+                           __ATOMIC_RELAXED);
+        if (opt.clone_verify)
+            clone_check_both(c, lba, blocks);
+        next = lba + blocks;
+        __atomic_store_n(&dp->cur_lba, next, __ATOMIC_RELAXED);
+    }
+    return ret;
+}
+
+/* The end of the --clone pass: the --flush of the destination, or the
+ * end of the --image and the --manifest. */
+static int
+clone_flush(t_clone *c)
+{
+    int res = 0;
+
+    if (c->man)
+    {
+        res = manifest_close(c->man, &c->man_st);
+        c->man = NULL;
+        if (res)
+            perror(opt.manifest_path);
+    }
+    if (c->image)
+    {
+        image_get_stats(c->image, &c->image_st);
+        if (image_close(c->image))
+        {
+            perror(c->dst->device_name);
+            res = -1;
+        }
+        c->image = NULL;
+    }
+    if (c->ordered)
+        return res;
+    if ((FLUSH_FUA == opt.flush) || (0 == c->unflushed))
+        return 0;
+    return write_flush(c->dst);
+}
+
+/* --clone: the pass, a copy of the range of the source to the same lbas
+ * of the destination that XCOPY or shared buffers do when they can, else
+ * read on this thread and written on one of its own. --compare reads
+ * the other side on that thread instead, --image adds to the image. Returns 0, else
+ * the error of the side that failed. */
+static int
+clone_pass(t_dev *dp)
+{
+    t_clone *c = dp->clone;
+    t_dev *dst = c->dst;
+    pthread_t tid;
+    int k, res = 0;
+
+    dst->from = dp->from;
+    dst->bytes_written = dst->bytes_done = 0;
+    dst->flushes = 0;
+    dst->flush_ns = dst->flush_max_ns = 0;
+    c->nfree = c->nfull = c->full_head = 0;
+    for (k = 0; k < c->nslots; ++k)
+        c->free_stk[c->nfree++] = k;
+    c->eof = c->stop = false;
+    c->wres = 0;
+    c->unflushed = c->mismatches = 0;
+    c->rseq = c->wseq = 0;
+    c->t0 = mono_secs();
+    c->from = dp->from;
+    if (CLONE_XCOPY == c->via)
+        res = clone_xcopy(c);
+    else if (CLONE_SHARE == c->via)
+        res = clone_share(c);
+    if (CLONE_COPY != c->via) /* unless they left the rest to the host */
+        return res ? res : clone_flush(c);
+    if (pthread_create(&tid, NULL, clone_writer, c))
+    {
+        perror("pthread_create");
+        return -1;
+    }
+    res = clone_side(c, false);
+    clone_end(c, false);
+    pthread_join(tid, NULL);
+    if (0 == res)
+        res = c->wres;
+    return res ? res : clone_flush(c);
+}
+
+/* Frees the --clone of dp and closes its destination. */
+static void
+clone_close(t_dev *dp)
+{
+    t_clone *c = dp->clone;
+    int k;
+
+    if (NULL == c)
+        return;
+    pthread_mutex_lock(&dp->report_mutex);
+    dp->clone = NULL;
+    pthread_mutex_unlock(&dp->report_mutex);
+    for (k = 0; c->slot && (k < c->nslots); ++k)
+    {
+        iobuf_free(c->slot[k].free_buf);
+        iobuf_free(c->slot[k].free_cbuf);
+    }
+    free(c->slot);
+    free(c->free_stk);
+    free(c->full_q);
+    iobuf_free(c->vbuf_free);
+    if (c->shared)
+        share_drop(c);
+    if (c->map)
+        munmap((void *)c->map, c->map_len);
+    if (c->image)
+        image_close(c->image);
+    if (c->man)
+        manifest_close(c->man, NULL);
+    if (c->dst->fd >= 0)
+        dev_close(c->dst->fd);
+    badmap_free(&c->dst->bad);
+    badmap_free(&c->dst->suspect);
+    free(c->dst);
+    free(c);
+}
+
+/* --manifest-check, --manifest-diff: an extent that differs, arg the
+ * device whose bad map it goes to, NULL for none. */
+static void
+manifest_report(void *arg, int64_t lba, int64_t blocks, int how)
+{
+    t_dev *dp = (t_dev *)arg;
+
+    if (dp && (MANIFEST_GONE != how))
+        bad_block(dp, BADMAP_MISMATCH, lba, blocks);
+    pthread_mutex_lock(&out_mutex);
+    printf("%s%slba %" PRId64 " to %" PRId64 ", %" PRId64 " blocks, %s\n",
+           dp ? dp->device_name : "", dp ? ": " : "", lba, lba + blocks - 1,
+           blocks, (MANIFEST_CHANGED == how) ? "changed"
+                   : (MANIFEST_NEW == how)   ? "not in the old manifest"
+                                             : "not in the new manifest");
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* Whether the writer of the clone ring is not a device: --image and
+ * --manifest take what is read, in the order it was read. */
+static bool
+clone_capture(void)
+{
+    return opt.image_path || opt.manifest_path || opt.manifest_old;
+}
+
+/* --manifest, --manifest-check: the manifest of dp. Returns 0, -1 with
+ * an error printed. */
+static int
+manifest_setup(t_clone *c, t_dev *dp)
+{
+    int64_t extent = opt.manifest_extent / dp->blk_sz;
+
+    if (opt.manifest_extent % dp->blk_sz)
+    {
+        pr2serr("--manifest-extent: %" PRId64 " is not a multiple of the "
+                "block size %d\n", opt.manifest_extent, dp->blk_sz);
+        return -1;
+    }
+    c->man = manifest_open(opt.manifest_path, opt.manifest_old,
+                           dp->device_name, dp->blk_sz, dp->num_sect, extent,
+                           manifest_report, dp);
+    if (NULL == c->man)
+    {
+        if (EINVAL == errno)
+            pr2serr("%s: not a manifest of %d byte blocks%s\n",
+                    opt.manifest_old, dp->blk_sz,
+                    extent ? " with that --manifest-extent" : "");
+        else
+            perror(opt.manifest_path ? opt.manifest_path
+                                     : opt.manifest_old);
+        return -1;
+    }
+    return 0;
+}
+
+/* --clone: opens and sizes the destination of the source dp, which needs
+ * its block size and at least dp->end blocks, and sets up the buffers
+ * between them. NULL when dp cannot be cloned to it. The other side of
+ * --compare is opened read only; an image file is mapped whole. The
+ * "destination" of --image is the fd main() opened, that of --manifest
+ * alone the manifest. */
+static t_clone *
+clone_open(t_dev *dp)
+{
+    t_clone *c = (t_clone *)calloc(1, sizeof(t_clone));
+    t_dev *dst = (t_dev *)calloc(1, sizeof(t_dev));
+    pthread_condattr_t cattr;
+    double t0 = mono_secs();
+    char *path = opt.image_path      ? opt.image_path
+                 : opt.compare_path  ? opt.compare_path
+                 : opt.manifest_path ? opt.manifest_path
+                 : opt.manifest_old  ? opt.manifest_old
+                                     : opt.clone_path;
+    const char *what = opt.compare_path ? "--compare side"
+                                        : "--clone destination";
+    struct stat st;
+    uint64_t bytes;
+    int k, qs, sect_sz = 0, res = -1;
+
+    if ((NULL == c) || (NULL == dst))
+    {
+        pr2serr(">> heap problems\n");
+        free(c);
+        free(dst);
+        return NULL;
+    }
+    dev_cattr(&cattr);
+    dev_init(dst, path, &cattr);
+    dst->flags.write = !opt.compare_path;
+    dst->start = dp->start;
+    dst->end = dp->end;
+    dst->bpt = dp->bpt;
+    dst->qd = opt.clone_qd ? opt.clone_qd : dp->qd;
+    c->compare = (NULL != opt.compare_path);
+    c->ordered = clone_capture();
+    if (c->ordered)
+        dst->out_type = FT_OTHER;
+    else if (c->compare && (0 == stat(path, &st)) && S_ISREG(st.st_mode))
+    {
+        dst->out_type = FT_OTHER;
+        dst->fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    else
+        dst->fd = open_of(dst, dst->start, dst->bpt, verbose);
+    if ((dst->fd < 0) && !c->ordered)
+    {
+        pr2serr("%s: cannot open the %s\n", path, what);
+        free(c);
+        free(dst);
+        return NULL;
+    }
+    if (opt.image_path)
+    {
+        c->image = image_open(image_fd, dp->blk_sz, dp->num_sect,
+                              opt.image_rle, opt.image_level,
+                              opt.image_threads);
+        if (NULL == c->image)
+        {
+            pr2serr("%s: %s\n", path, (ENOTSUP == errno)
+                                         ? "built without zstd, no "
+                                           "--image-zstd"
+                                         : strerror(errno));
+            free(c);
+            free(dst);
+            return NULL;
+        }
+        image_fd = -1;
+    }
+    if ((opt.manifest_path || opt.manifest_old) && manifest_setup(c, dp))
+    {
+        if (c->image)
+            image_close(c->image);
+        free(c);
+        free(dst);
+        return NULL;
+    }
+    if (c->ordered)
+    {
+        sect_sz = dp->blk_sz;
+        dst->num_sect = dp->num_sect;
+        res = 0;
+    }
+    else if (FT_OTHER == dst->out_type)
+    {
+        /* the image of the whole device, block 0 at offset 0 */
+        sect_sz = dp->blk_sz;
+        dst->num_sect = (int64_t)(st.st_size / sect_sz);
+        c->map_len = (size_t)dp->end * sect_sz;
+        if (dst->num_sect >= dp->end)
+        {
+            c->map = (const uint8_t *)mmap(NULL, c->map_len, PROT_READ,
+                                           MAP_SHARED, dst->fd, 0);
+            if (MAP_FAILED == c->map)
+            {
+                perror(path);
+                c->map = NULL;
+            }
+            else
+                madvise((void *)c->map, c->map_len, MADV_SEQUENTIAL);
+        }
+        res = (c->map || (dst->num_sect < dp->end)) ? 0 : -1;
+    }
+    else if (FT_SG & dst->out_type)
+        res = scsi_read_capacity(dst->fd, &dst->num_sect, &sect_sz);
+    else if ((FT_BLOCK & dst->out_type) &&
+             (ioctl(dst->fd, BLKSSZGET, &sect_sz) >= 0) &&
+             (ioctl(dst->fd, BLKGETSIZE64, &bytes) >= 0) && (sect_sz > 0))
+    {
+        dst->num_sect = (int64_t)(bytes / sect_sz);
+        res = 0;
+    }
+    if (res)
+        pr2serr("%s: cannot size the %s (sg or block devices%s)\n", path,
+                what, c->compare ? " or image files" : " only");
+    else if (sect_sz != dp->blk_sz)
+        pr2serr("%s: blocks of %d, the source %s has blocks of %d\n",
+                path, sect_sz, dp->device_name, dp->blk_sz);
+    else if (dst->num_sect < dp->end)
+        pr2serr("%s: %" PRId64 " blocks, fewer than the %" PRId64 " to "
+                "%s\n", path, dst->num_sect, dp->end,
+                c->compare ? "compare" : "clone");
+    else if (dp->dev_id[0] && (0 == strcmp(dp->dev_id, dst->dev_id)))
+    {
+        pr2serr("%s: is %s itself\n", path, dp->device_name);
+        res = -1;
+    }
+    if (res || (sect_sz != dp->blk_sz) || (dst->num_sect < dp->end))
+    {
+        if (c->map)
+            munmap((void *)c->map, c->map_len);
+        dev_close(dst->fd);
+        free(c);
+        free(dst);
+        return NULL;
+    }
+    dst->blk_sz = sect_sz;
+    dst->stats.device_name = dst->device_name;
+    dst->stats.bytes_per_sector = sect_sz;
+    if (FT_OTHER != dst->out_type)
+    {
+        probe_profile(dst, t0);
+        cdb_select(dst);
+    }
+    if (dst->bpt < dp->bpt)
+        dp->bpt = dst->bpt;
+    qs = ((FT_SG & dp->out_type) && !(FT_BLOCK & dp->out_type)) ? dp->qd : 1;
+    c->nslots = 2 * (qs + (((FT_SG & dst->out_type) &&
+                            !(FT_BLOCK & dst->out_type)) ? dst->qd : 1));
+    c->src = dp;
+    c->dst = dst;
+    c->t0 = t0;
+    pthread_mutex_init(&c->mutex, NULL);
+    pthread_cond_init(&c->cond, NULL);
+    c->slot = calloc(c->nslots, sizeof(*c->slot));
+    c->free_stk = (int *)calloc(c->nslots, sizeof(int));
+    c->full_q = (int *)calloc(c->nslots, sizeof(int));
+    for (k = 0; c->slot && (k < c->nslots); ++k)
+    {
+        c->slot[k].buf = io_buf(dp, (size_t)dp->bpt * dp->blk_sz,
+                                &c->slot[k].free_buf);
+        if (c->compare && !c->map)
+            c->slot[k].cbuf = io_buf(dst, (size_t)dp->bpt * dp->blk_sz,
+                                     &c->slot[k].free_cbuf);
+    }
+    for (k = 0; c->slot && (k < c->nslots) && c->slot[k].buf &&
+                (c->slot[k].cbuf || !c->compare || c->map);
+         ++k)
+        ;
+    if (opt.clone_verify)
+        c->vbuf = io_buf(dst, (size_t)dp->bpt * dp->blk_sz, &c->vbuf_free);
+    dp->clone = c;
+    if ((k < c->nslots) || !c->free_stk || !c->full_q ||
+        (opt.clone_verify && !c->vbuf))
+    {
+        pr2serr(">> heap problems\n");
+        clone_close(dp);
+        return NULL;
+    }
+    c->via = CLONE_COPY;
+    if (c->image)
+    {
+        printf("%s: imaging to %s, %s\n", dp->device_name, dst->device_name,
+               !image_records(c->image) ? "zero blocks as holes"
+               : opt.image_level        ? "records compressed by zstd"
+                                        : "records");
+    }
+    if (c->man)
+    {
+        manifest_get_stats(c->man, &c->man_st);
+        printf("%s: hashing extents of %" PRId64 " blocks%s%s%s%s\n",
+               dp->device_name, c->man_st.extent,
+               opt.manifest_path ? " to " : "",
+               opt.manifest_path ? opt.manifest_path : "",
+               opt.manifest_old ? ", checked against " : "",
+               opt.manifest_old ? opt.manifest_old : "");
+    }
+    if (c->ordered)
+        return c;
+    if (c->compare)
+    {
+        printf("%s: comparing with %s%s\n", dp->device_name,
+               dst->device_name, c->map ? ", an image file" : "");
+        return c;
+    }
+    if (((CLONE_AUTO == opt.clone_via) || (CLONE_XCOPY == opt.clone_via)) &&
+        xcopy_probe(c))
+        c->via = CLONE_XCOPY;
+    else if (((CLONE_AUTO == opt.clone_via) ||
+              (CLONE_SHARE == opt.clone_via)) && share_probe(c))
+        c->via = c->shared ? CLONE_SHARE : CLONE_COPY;
+    if ((CLONE_AUTO != opt.clone_via) && (opt.clone_via != c->via))
+        pr2serr("%s: no %s to %s\n", dp->device_name,
+                clone_via_str(opt.clone_via), dst->device_name);
+    printf("%s: cloning to %s %s\n", dp->device_name, dst->device_name,
+           clone_via_str(c->via));
+    return c;
+}
+
+/* The reporter's line for the destination, under the row of the source. */
+static void
+clone_report(const t_clone *c)
+{
+    double kilo = opt.kilobyte ? 1024.0 : 1000.0;
+    double secs = mono_secs() - c->t0;
+    int64_t done = __atomic_load_n(c->compare ? &c->dst->bytes_done
+                                              : &c->dst->bytes_written,
+                                   __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&out_mutex);
+    printf("  -> %s: %.1f %s %s, %.1f %s/s, %d of %d buffers full\n",
+           c->dst->device_name, done / (kilo * kilo), opt.kilobyte ? "MiB"
+                                                                   : "MB",
+           c->compare                  ? "compared"
+           : (c->image || !c->ordered) ? "written"
+                                       : "hashed",
+           done / (kilo * kilo) / (secs > 0 ? secs : 1),
+           opt.kilobyte ? "MiB" : "MB", c->nfull, c->nslots);
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* The end of the --clone pass: the rates of both sides. */
+static void
+clone_summary(const t_clone *c, unsigned int pass, double secs)
+{
+    const t_dev *dst = c->dst;
+
+    if (secs <= 0)
+        secs = 1;
+    pthread_mutex_lock(&out_mutex);
+    if (opt.manifest_path || opt.manifest_old)
+    {
+        const struct manifest_stats *ms = &c->man_st;
+
+        printf("%s: pass %u hashed %" PRId64 " extents", c->src->device_name,
+               pass, ms->extents);
+        if (opt.manifest_old)
+            printf(", %" PRId64 " of them in %s, %" PRId64 " differ",
+                   ms->checked, opt.manifest_old, ms->differ);
+        printf(", read %.1f MB/s\n", c->src->bytes_done / secs / 1e6);
+    }
+    if (!opt.image_path && c->ordered)
+    {
+        pthread_mutex_unlock(&out_mutex);
+        return;
+    }
+    if (opt.image_path)
+    {
+        const struct image_stats *is = &c->image_st;
+
+        printf("%s: pass %u imaged to %s, %.1f MB of data, %.1f MB zero, "
+               "%.1f MB 0xff, %.1f MB written, read %.1f MB/s\n",
+               c->src->device_name, pass, dst->device_name, is->data / 1e6,
+               is->zero / 1e6, is->ff / 1e6, is->out / 1e6,
+               c->src->bytes_done / secs / 1e6);
+        pthread_mutex_unlock(&out_mutex);
+        return;
+    }
+    if (c->compare)
+    {
+        printf("%s: pass %u compared with %s, %" PRId64 " blocks differ, "
+               "read %.1f MB/s and %.1f MB/s\n", c->src->device_name, pass,
+               dst->device_name, c->mismatches,
+               c->src->bytes_done / secs / 1e6, dst->bytes_done / secs / 1e6);
+        pthread_mutex_unlock(&out_mutex);
+        return;
+    }
+    printf("%s: pass %u cloned to %s %s, read %.1f MB/s, wrote %.1f MB/s\n",
+           c->src->device_name, pass, dst->device_name, clone_via_str(c->via),
+           c->src->bytes_done / secs / 1e6, dst->bytes_written / secs / 1e6);
+    if (opt.clone_verify)
+        printf("%s: %" PRId64 " blocks read back different\n",
+               dst->device_name, c->mismatches);
+    if (dst->flushes)
+        printf("%s: cache flushes %d, %.3f s in all, max %.2f ms\n",
+               dst->device_name, dst->flushes, dst->flush_ns / 1e9,
+               dst->flush_max_ns / 1e6);
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* --scrub: dp has been read end to end once more; its next cycle
+ * starts over at the first pass. */
+static void
+scrub_cycle_end(t_dev *dp)
+{
+    int64_t now = (int64_t)time(NULL), was;
+    char name[PATH_MAX];
+
+    pthread_mutex_lock(&dp->report_mutex);
+    was = dp->scrub_full;
+    dp->scrub_full = now;
+    ++dp->scrub_cycles;
+    dp->passes_done = 0;
+    pthread_mutex_unlock(&dp->report_mutex);
+    pthread_mutex_lock(&out_mutex);
+    if (was)
+        printf("%s: scrub cycle %u done, %.1f days after the one before, "
+               "%zu bad extents known\n", dp->device_name, dp->scrub_cycles,
+               (now - was) / 86400.0, dp->bad.num);
+    else
+        printf("%s: scrub cycle %u done, %zu bad extents known\n",
+               dp->device_name, dp->scrub_cycles, dp->bad.num);
+    pthread_mutex_unlock(&out_mutex);
+    if (jsonl_enabled())
+        jsonl_printf("{\"type\":\"scrub\",\"device\":\"%s\",\"cycle\":%u,"
+                     "\"full_at\":%" PRId64 ",\"previous_age_s\":%" PRId64
+                     ",\"bad_extents\":%zu}",
+                     jsonl_escape(name, sizeof(name), dp->device_name),
+                     dp->scrub_cycles, now, was ? now - was : -1,
+                     dp->bad.num);
+    if (opt.ck_path)
+        checkpoint_write();
+}
+
+/* --plan: the blocks a pass of dp reads, now its walks have chosen
+ * them, the rate it would read them at and the buffers it would take.
+ * The rate is the throughput of the model's profile (what --tune
+ * measured, now or for an earlier drive), else that of the drive's last
+ * pass in the --results store, capped by the link READ
+ * BUFFER measured and by the per-device --max-rate buckets, as the
+ * passes would be; the adapter and process caps are shared and left to
+ * plan_print(). */
+static void
+plan_device(t_dev *dp)
+{
+    const t_backend *be = backend_select(dp, BE_QUEUED);
+    int64_t xfer = (int64_t)dp->bpt * dp->blk_sz;
+    int nact = (dp->nact > 1) ? dp->nact : 1;
+    int k, lanes = 1;
+
+    dp->plan_blocks = dp->end - dp->start;
+    if (dp->ext)
+        for (k = 0, dp->plan_blocks = 0; k < dp->num_ext; ++k)
+            dp->plan_blocks += dp->ext[k].len;
+    dp->plan_bps = 0.0;
+    dp->plan_src = "unknown, no profile of the model: add --tune";
+    if (dp->have_profile && (dp->profile.mbps > 0))
+    {
+        dp->plan_bps = dp->profile.mbps * 1e6;
+        dp->plan_src = opt.tune ? "profile" : "profile, not tuned";
+    }
+    else if (opt.results_path)
+    {
+        struct results_rec *r = (struct results_rec *)malloc(sizeof(*r));
+
+        /* the drive's last pass in the --results store */
+        if (r && (1 == results_query(opt.results_path, dp->dev_id[0]
+                                                           ? dp->dev_id
+                                                           : dp->device_name,
+                                     1, r)) && r->ns)
+        {
+            dp->plan_bps = r->bytes * 1e9 / r->ns;
+            dp->plan_src = "last pass in --results";
+            results_free(r, 1);
+        }
+        free(r);
+    }
+    if (dp->plan_bps > 0)
+    {
+        if (dp->have_profile && (dp->profile.link_mbps > 0) &&
+            (dp->profile.link_mbps * 1e6 < dp->plan_bps))
+        {
+            dp->plan_bps = dp->profile.link_mbps * 1e6;
+            dp->plan_src = "link";
+        }
+        if ((dp->tb_bytes.rate > 0) && (dp->tb_bytes.rate < dp->plan_bps))
+        {
+            dp->plan_bps = dp->tb_bytes.rate;
+            dp->plan_src = "--max-rate";
+        }
+        if ((dp->tb_reads.rate > 0) &&
+            (dp->tb_reads.rate * xfer < dp->plan_bps))
+        {
+            dp->plan_bps = dp->tb_reads.rate * xfer;
+            dp->plan_src = "--max-rate READs";
+        }
+    }
+    /* the buffer of read_pass_sync(), and those of a queued engine */
+    dp->plan_mem = xfer + BYTES_PER_ELEMENT;
+    if (be)
+    {
+        /* lanes as read_pass_lanes() has them, a READ each and a spare */
+        if ((read_pass_uring == be->pass) || (read_pass_spdk == be->pass))
+            lanes = (opt.rings + nact - 1) / nact * nact;
+        dp->plan_mem += (int64_t)((lanes > 1) ? lanes : 1) * (dp->qd + 1) *
+                        xfer;
+    }
+}
+
+/* --log-dir: the file of the table of dp, d/<device>.log with the /s of
+ * the name made _, as --job has its logs, through a sink of its own so
+ * a slow disk under the directory does not stall the reads either. */
+static void
+log_open(t_dev *dp)
+{
+    char path[PATH_MAX], *cp;
+    const char *name = dp->device_name;
+    int n;
+
+    n = snprintf(path, sizeof(path), "%s/%s.log", opt.log_dir,
+                 name + ('/' == name[0]));
+    if ((n < 0) || (n >= (int)sizeof(path)))
+        return;
+    for (cp = path + strlen(opt.log_dir) + 1; *cp; ++cp)
+        if ('/' == *cp)
+            *cp = '_';
+    dp->log = outsink_file(path, 0, OUTSINK_DROP);
+    if (NULL == dp->log)
+    {
+        perror(path);
+        return;
+    }
+    outsink_printf(dp->log, "%s:\n" HEADER, dp->device_name,
+                   opt.kilobyte ? " MiB" : "MB", opt.kilobyte ? " MiB" : "MB");
+}
+
+static int
+read_verify_device(t_dev *dp)
+{
+    t_stats *stats = &dp->stats;
+    char *device_name = dp->device_name;
+
+    stats->start_ticks = get_ticks(stats);
+    stats->wiping_ticks = 0;
+
+    stats->device_name = device_name;
+
+    stats->bytes_per_sector = DEF_BLOCK_SIZE;
+
+    int out_type;
+    int outfd, retries_tmp = 5;
+    int64_t out_num_sect = -1;
+    int out_sect_sz;
+    int res = 0;
+
+    dp->out_type = FT_OTHER;
+    double probe_t0 = mono_secs();
+
+    /* the buffers are first touched, so placed, by this thread, which
+     * also reaps the completions, and the lanes and side queue it starts
+     * run where it may: with the interrupts, when they are in one cache
+     * domain, else on the node of the adapter */
+    if (dp->irq_dom)
+    {
+        if (pthread_setaffinity_np(pthread_self(), sizeof(dp->irq_cpus),
+                                   &dp->irq_cpus) && verbose)
+            pr2serr("%s: could not pin to the cache domain of its "
+                    "interrupts\n", device_name);
+    }
+    else if ((dp->numa_node >= 0) && iobuf_bind_thread(dp->numa_node) &&
+             verbose)
+        pr2serr("%s: could not pin to NUMA node %d\n", device_name,
+                dp->numa_node);
+
+    gate_enter(&probe_gate, opt.probe_jobs, 0);
+    outfd = open_of(dp, dp->start, dp->bpt, verbose);
+    if (outfd < 0)
+    {
+        gate_leave(&probe_gate);
+        pr2serr("outfd=%d\n", outfd);
+        return -outfd;
+    }
+    dp->fd = outfd;
+    {
+        struct stat st;
+
+        if (!dp->sim && !dp->spdk && (0 == fstat(outfd, &st)) &&
+            (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode)))
+            dp->rdev = st.st_rdev;
+    }
+    out_type = dp->out_type;
+    path_attach(dp);
+    sg_fds_attach(dp);
+    if (opt.spin_up > 0)
+    {
+        /* a slot is not held while the drive spins up */
+        gate_leave(&probe_gate);
+        spin_up(dp);
+        gate_enter(&probe_gate, opt.probe_jobs, 0);
+    }
+
+    out_num_sect = -1;
+    out_sect_sz = -1;
+    if (FT_SG & out_type)
+    {
+        res = scsi_read_capacity(outfd, &out_num_sect, &out_sect_sz);
+        if (SG_LIB_CAT_UNIT_ATTENTION == res)
+        {
+            pr2serr("Unit attention (readcap out), continuing\n");
+            res = scsi_read_capacity(outfd, &out_num_sect, &out_sect_sz);
+        }
+        else if (SG_LIB_CAT_ABORTED_COMMAND == res)
+        {
+            pr2serr("Aborted command (readcap out), continuing\n");
+            res = scsi_read_capacity(outfd, &out_num_sect, &out_sect_sz);
+        }
+        if (0 != res)
+        {
+            if (res == SG_LIB_CAT_INVALID_OP)
+                pr2serr("read capacity not supported on %s\n", device_name);
+            else
+                pr2serr("Unable to read capacity on %s\n", device_name);
+            out_num_sect = -1;
+        }
+        else if (dp->blk_sz != out_sect_sz)
+        {
+            pr2serr(">> warning: block size on %s confusion: bs=%d, "
+                    "device claims=%d\n",
+                    device_name, dp->blk_sz, out_sect_sz);
+            dp->blk_sz = out_sect_sz;
+            stats->bytes_per_sector = dp->blk_sz;
+        }
+    }
+    else if (FT_FILE & out_type)
+    {
+        struct stat st;
+
+        if (fstat(outfd, &st) < 0)
+        {
+            perror("fstat error");
+            out_num_sect = -1;
+        }
+        else
+        {
+            out_sect_sz = DEF_BLOCK_SIZE;
+            out_num_sect = (int64_t)st.st_size / out_sect_sz;
+            if (st.st_size % out_sect_sz)
+                pr2serr("%s: the last %d bytes, short of a block of %d, are "
+                        "not read\n", device_name,
+                        (int)(st.st_size % out_sect_sz), out_sect_sz);
+            dp->blk_sz = out_sect_sz;
+            stats->bytes_per_sector = dp->blk_sz;
+        }
+        uring_probe(dp, 0);
+    }
+    else if (FT_BLOCK & out_type)
+    {
+        uint64_t bytes;
+
+        if ((ioctl(outfd, BLKSSZGET, &out_sect_sz) < 0) ||
+            (ioctl(outfd, BLKGETSIZE64, &bytes) < 0))
+        {
+            perror("BLKSSZGET/BLKGETSIZE64 ioctl error");
+            out_num_sect = -1;
+        }
+        else
+        {
+            out_num_sect = (int64_t)(bytes / out_sect_sz);
+            dp->blk_sz = out_sect_sz;
+            stats->bytes_per_sector = dp->blk_sz;
+        }
+        uring_probe(dp, 0);
+    }
+    else if (FT_NVME & out_type)
+    {
+        if (nvme_identify_ns(dp, &out_num_sect, &out_sect_sz, opt.pi))
+            out_num_sect = -1;
+        else
+        {
+            dp->blk_sz = out_sect_sz;
+            stats->bytes_per_sector = dp->blk_sz;
+        }
+        if (!dp->spdk) /* polled queue pairs of their own, no io_uring */
+            uring_probe(dp, IORING_SETUP_SQE128 | IORING_SETUP_CQE32);
+    }
+    else if (FT_SIM & out_type)
+    {
+        out_num_sect = dp->sim->blocks;
+        out_sect_sz = dp->sim->bs;
+        dp->blk_sz = out_sect_sz;
+        stats->bytes_per_sector = dp->blk_sz;
+    }
+
+    if (dp->flags.mmap && (FT_SG & out_type) && !(FT_BLOCK & out_type))
+    {
+        if (sg_mmap_setup(dp))
+            pr2serr("%s: mmap-ed IO not available, using normal buffers\n",
+                    device_name);
+        else if ((dp->qd > 1) || dp->mrq)
+        {
+            pr2serr("%s: mmap-ed IO has one reserved buffer, ignoring --qd "
+                    "and --mrq\n", device_name);
+            dp->mrq = 0;
+        }
+    }
+
+    dp->num_sect = out_num_sect;
+    if (opt.pi && (out_num_sect > 0))
+        pi_probe(dp);
+    probe_profile(dp, probe_t0);
+    media_policy(dp);
+    cdl_probe(dp);
+    cdb_select(dp);
+    gate_leave(&probe_gate);
+    pr2serr("Start, out_num_sect=%" PRId64 ",block size=%d\n", out_num_sect, out_sect_sz);
+    if (dp->end > out_num_sect)
+    {
+        pr2serr("Ending sector must be less than or equal to %" PRId64 " for %s\n", out_num_sect, device_name);
+        dev_close(outfd);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (dp->end == 0)
+    {
+        dp->end = out_num_sect;
+    }
+
+    if (out_num_sect > dp->start)
+        out_num_sect -= dp->start;
+
+    if (dp->start > dp->end)
+    {
+        pr2serr("Ending sector must be greater than starting sector\n");
+        dev_close(outfd);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+
+    if (opt.dverify && !opt.dcompare && (FT_NVME & out_type))
+    {
+        if (!(NVME_ONCS_VERIFY & dp->nvme_oncs))
+            pr2serr("%s: controller has no NVMe Verify (ONCS), reading the "
+                    "data instead\n", device_name);
+    }
+    else if ((opt.dverify || opt.dcompare) && !(FT_SG & out_type))
+        pr2serr("%s: --device-verify/--device-compare need SCSI VERIFY, "
+                "reading the data instead\n", device_name);
+    else if (opt.sat)
+        sat_probe(dp);
+    dp->prefetch = opt.prefetch && (FT_SG & out_type);
+    if (opt.bench)
+    {
+        res = bench_device(dp);
+        dev_close(outfd);
+        return res;
+    }
+    if (opt.seek)
+    {
+        res = seek_device(dp);
+        dev_close(outfd);
+        return res;
+    }
+    if (opt.cache_probe)
+    {
+        res = cache_device(dp);
+        dev_close(outfd);
+        return res;
+    }
+    tune_or_load(dp); /* before the walk, it times reads of any lba */
+    if ((FT_SG & out_type) && !(FT_BLOCK & out_type) && !dp->mmap_buf)
+    {
+        sg_fds_resbuf(dp);
+        /* small until the adapter has a slot for it */
+        dp->resbuf_park = dp->host && (opt.per_host > 0);
+        sg_fds_park(dp, true);
+    }
+    align_plan(dp);
+    if (dp->md_id >= 0)
+        array_align(dp);
+    if (opt.retest_path)
+    {
+        int64_t sel = retest_walk(dp);
+
+        if (sel <= 0)
+        {
+            pthread_mutex_lock(&out_mutex);
+            printf("%s: %s\n", device_name,
+                   sel ? "bad map unreadable, not retested"
+                       : "nothing in the bad map to retest");
+            pthread_mutex_unlock(&out_mutex);
+            dev_close(outfd);
+            return sel ? SG_LIB_FILE_ERROR : 0;
+        }
+        if (opt.zones || opt.lba_status)
+            pr2serr("%s: retesting, ignoring --zones and --lba-status\n",
+                    device_name);
+    }
+    else if (opt.ranges_path)
+    {
+        int64_t sel = ranges_walk(dp);
+
+        if (sel <= 0)
+        {
+            pthread_mutex_lock(&out_mutex);
+            printf("%s: %s\n", device_name,
+                   sel ? "range list unreadable, not read"
+                       : "nothing of the range list on the device");
+            pthread_mutex_unlock(&out_mutex);
+            dev_close(outfd);
+            return sel ? SG_LIB_FILE_ERROR : 0;
+        }
+        if (opt.zones || opt.lba_status)
+            pr2serr("%s: --ranges, ignoring --zones and --lba-status\n",
+                    device_name);
+    }
+    else if (opt.zones)
+    {
+        zone_walk(dp);
+        if (opt.lba_status && dp->ext)
+            pr2serr("%s: zoned, ignoring --lba-status\n", device_name);
+    }
+    if (opt.erase && erase_device(dp))
+    {
+        extent_drop(dp);
+        dev_close(outfd);
+        return SG_LIB_CAT_OTHER;
+    }
+    if (dp->ext || opt.retest_path || opt.ranges_path)
+        ; /* the zones, the map, the list or the erase samples decide */
+    else if (opt.sample > 0)
+        sample_plan(dp);
+    else if (opt.coarse)
+        coarse_plan(dp);
+    else if (opt.time_limit > 0)
+        tl_plan(dp);
+    else if (FT_FILE & out_type)
+    {
+        file_walk(dp);
+        if (opt.allocated || opt.lba_status)
+            pr2serr("%s: a regular file, ignoring --allocated and "
+                    "--lba-status\n", device_name);
+    }
+    else if (opt.allocated)
+        alloc_walk(dp);
+    else if (opt.lba_status && (FT_SG & out_type))
+        lba_status_walk(dp);
+    else if (opt.lba_status)
+        pr2serr("%s: --lba-status needs SCSI GET LBA STATUS, reading every "
+                "lba\n", device_name);
+    if (opt.elements && (FT_SG & out_type))
+        element_walk(dp);
+    else if (opt.elements)
+        pr2serr("%s: --elements needs SCSI GET PHYSICAL ELEMENT STATUS, "
+                "reading every lba\n", device_name);
+
+    if (donemap_init(&dp->dmap, dp->start, dp->end))
+        pr2serr("%s: no memory for the map of the chunks read\n", device_name);
+    /* the windows of an extent list are in LBA order: a drive given a
+     * run of them at once sweeps its arm over them, not over the turns
+     * of the others on the link */
+    if (opt.burst > 0)
+        dp->burst = dp->ext ? opt.burst : 1;
+    else if (dp->ext && (MTYPE_HDD == dp->mtype) &&
+             ((dp->host && (dp->host->devices > 1)) || dp->ctrl))
+        dp->burst = BURST_DEF;
+    else
+        dp->burst = 1;
+    dp->burst_left = 0;
+    if (opt.resume)
+        resume_device(dp);
+    __atomic_store_n(&dp->cur_lba, (dp->resume_lba >= 0) ? dp->resume_lba
+                                                          : dp->start,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&dp->ck_ready, true, __ATOMIC_RELEASE);
+    if (opt.plan)
+    {
+        plan_device(dp);
+        extent_drop(dp);
+        dev_close(outfd);
+        return 0;
+    }
+    if (opt.scrub && (dp->passes_done >= opt.passes))
+        dp->passes_done = 0; /* a new cycle */
+    if (dp->passes_done >= opt.passes)
+    {
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: all %u passes done already\n", device_name, opt.passes);
+        pthread_mutex_unlock(&out_mutex);
+        extent_drop(dp);
+        dev_close(outfd);
+        return 0;
+    }
+
+    media_set(dp);
+    cdl_set(dp);
+    if ((opt.clone_path || opt.compare_path || clone_capture()) &&
+        (NULL == (dp->clone = clone_open(dp))))
+    {
+        media_restore(dp);
+        cdl_restore(dp);
+        extent_drop(dp);
+        dev_close(outfd);
+        return SG_LIB_FILE_ERROR;
+    }
+    time_t t = time(NULL);
+    localtime_r(&t, &stats->lpStartTime);
+    snprintf(stats->start_time, sizeof(stats->start_time), "%02d:%02d:%02d", stats->lpStartTime.tm_hour, stats->lpStartTime.tm_min, stats->lpStartTime.tm_sec);
+
+    pthread_mutex_lock(&out_mutex);
+    if (num_devs > 1)
+        printf("%s:\n", device_name);
+    printf(HEADER, opt.kilobyte ? " MiB" : "MB", opt.kilobyte ? " MiB" : "MB");
+    pthread_mutex_unlock(&out_mutex);
+    if (opt.log_dir)
+        log_open(dp);
+    if (opt.offload)
+    {
+        res = offload_device(dp);
+        outsink_close(dp->log);
+        dp->log = NULL;
+        bad_save(dp);
+        media_restore(dp);
+        cdl_restore(dp);
+        extent_drop(dp);
+        dev_close(outfd);
+        return res;
+    }
+    unsigned int bytes_to_process = dp->bpt * stats->bytes_per_sector;
+    uint8_t *sector_free;
+    unsigned char *sector_data = io_buf(dp, bytes_to_process + BYTES_PER_ELEMENT,
+                                        &sector_free);
+    dp->rd_data = dp->mmap_buf ? dp->mmap_buf : sector_data;
+
+    bool bRetryerror = false;
+    if (opt.triage && !queued_engine(dp))
+        pr2serr("%s: --triage needs queued reads (sg or io_uring), reading "
+                "in one phase\n", device_name);
+    if (opt.pipe && (opt.passes > 1) && (1 == pipe_passes(dp, 1)))
+        pr2serr("%s: --pipeline needs queued sg WRITEs, the passes run one "
+                "after another\n", device_name);
+    if (heat_fp && lat_map_init(&dp->heat, HEATMAP_CELLS, dp->start, dp->end))
+        pr2serr("%s: no memory for the heatmap\n", device_name);
+    if (opt.rec_zones && reczone_init(&dp->rz, dp->start, dp->end))
+        pr2serr("%s: no memory for the recording zones\n", device_name);
+    health_open(dp);
+    idle_open(dp);
+    dirty_start(dp);
+    if (verbose)
+        pr2serr("%s: reading through the %s backend\n", device_name,
+                backend_select(dp, 0)->name);
+    if ((dp->qd > 1) && !queued_engine(dp))
+        pr2serr("%s: no backend keeps READs queued on it, --qd %d is read "
+                "one command at a time\n", device_name, dp->qd);
+
+    for (unsigned int pass = dp->passes_done + 1; pass <= opt.passes; ++pass)
+    {
+        unsigned int n;
+
+        stats->passwiping_ticks = 0;
+        lat_reset(&dp->lat_pass);
+        if (dp->heat.cell)
+            lat_map_reset(&dp->heat);
+        reczone_reset(&dp->rz);
+
+        const t_pattern *pat = patterns + (pass - 1);
+        char s_byte[5];
+        snprintf(s_byte, sizeof(s_byte), "%s",
+                 opt.image_path    ? "IMAG"
+                 : clone_capture() ? "HASH"
+                 : dp->clone       ? (dp->clone->compare ? "COMP" : "CLON")
+                                   : pat->label);
+        if (dp->blk_sz % pat->len)
+            pr2serr("%s: pattern period %d does not divide block size %d\n",
+                    device_name, pat->len, dp->blk_sz);
+
+        dp->sync_blocks = dp->bpt;
+        retries_tmp = opt.nretries;
+        host_enter(dp);
+        double pass_t0 = mono_secs();
+        int64_t pass_bytes0 = dp->bytes_done;
+        t_cost pass_c0, pass_c1;
+        char defects[1024] = "";
+        struct results_mark pass_rm;
+
+        if (opt.defects)
+            defects_begin(dp, outfd);
+        cost_sample(dp, &pass_c0);
+        if (opt.results_path)
+            results_begin(dp, &pass_rm);
+
+        dp->from = dp->start;
+        if (dp->resume_lba >= 0)
+        {
+            dp->from = dp->resume_lba; /* once, the pass --resume is in */
+            dp->resume_lba = -1;
+        }
+        dp->pf_lba = dp->from;
+        int64_t rnd = 0;
+
+        memset(dp->zone_pass, 0, sizeof(dp->zone_pass));
+        if ((opt.time_limit > 0) && (0 == dp->tl_end_ns))
+            dp->tl_end_ns = lat_now_ns() + (uint64_t)(opt.time_limit * 1e9);
+        if (dp->rounds && round_plan(dp, 0))
+            dp->rounds = 0; /* the rest in lba order */
+        dp->crc_acc = 0;
+        dp->crc_bytes = 0;
+        if (opt.stable && stable_begin(dp))
+            pr2serr("%s: no memory for the --stable hashes\n", device_name);
+        dp->pass_start_ticks = get_ticks(stats);
+        dp->base_ticks = stats->wiping_ticks;
+        snprintf(dp->cur_label, sizeof(dp->cur_label), "%s", s_byte);
+        __atomic_store_n(&dp->cur_lba, dp->from, __ATOMIC_RELAXED);
+        __atomic_store_n(&dp->cur_pass, pass, __ATOMIC_RELEASE);
+
+        double write_secs = 0;
+
+        if (opt.stress > 0)
+            res = stress_pass(dp, pat);
+        else if (opt.write)
+        {
+            n = pipe_passes(dp, pass);
+            res = write_pass(dp, pat, n);
+            write_secs = mono_secs() - pass_t0;
+            __atomic_store_n(&dp->cur_lba, dp->from, __ATOMIC_RELAXED);
+            if ((0 == res) && (n > 1))
+            {
+                pthread_mutex_lock(&out_mutex);
+                printf("%s: passes %u to %u pipelined, each %" PRId64 " MiB "
+                       "behind the one before\n", device_name, pass,
+                       pass + n - 1, opt.pipe_dist >> 20);
+                pthread_mutex_unlock(&out_mutex);
+                pass += n - 1; /* the last of them, done with the others */
+            }
+        }
+        else if (dp->clone)
+            res = clone_pass(dp);
+        /* read back trailing the WRITEs, or the pass failed writing */
+        bool read_back = !dp->clone && !(opt.stress > 0) &&
+                         (!opt.write || ((WRITE_PASS == opt.write) && !res));
+
+        /* a pattern a block holds whole can be compared by the drive */
+        bool dcmp = read_back && (opt.dcompare || (dp->ext && (LBA_STATUS_DEALLOC ==
+                                                  opt.lba_status))) &&
+                    (FT_SG & out_type) && !dp->no_dcompare &&
+                    (0 == pat->flag) && (0 == dp->blk_sz % pat->len);
+        bool on_device = dcmp || (read_back && opt.dverify &&
+                                  (FT_SG & out_type));
+        /* NVMe Verify reads the media, it has nothing to compare with */
+        bool nvme_dv = read_back && opt.dverify && !opt.dcompare &&
+                       (FT_NVME & out_type) &&
+                       (NVME_ONCS_VERIFY & dp->nvme_oncs);
+
+    next_round:
+        if (nvme_dv)
+        {
+            res = nvme_range_pass(dp, NVME_OP_VERIFY);
+            on_device = nvme_dv = (VERIFY_FALLBACK != res);
+        }
+        else if (on_device)
+        {
+            res = read_pass_verify(dp, dcmp ? pat : NULL);
+            on_device = (VERIFY_FALLBACK != res);
+        }
+        if (on_device || !read_back)
+            ; /* the drive did the pass, or the --write one */
+        else if (opt.triage && queued_engine(dp))
+            res = read_pass_triage(dp, pat, queued_engine(dp));
+        else
+            res = backend_select(dp, 0)->pass(dp, pat);
+        if ((0 == res) && dp->rounds && !dev_stopped(dp) &&
+            (++rnd < dp->rounds))
+        {
+            if (0 == round_plan(dp, rnd))
+            {
+                dp->from = dp->pf_lba = dp->start;
+                goto next_round;
+            }
+            dp->rounds = 0; /* out of memory, this pass stops short */
+        }
+        host_leave(dp);
+        __atomic_store_n(&dp->dmap_on, false, __ATOMIC_RELAXED);
+        dp->dmap_skip = false;
+        pthread_mutex_lock(&dp->report_mutex);
+        __atomic_store_n(&dp->cur_pass, 0, __ATOMIC_RELAXED);
+        if ((0 == res) && !dev_stopped(dp))
+        {
+            dp->passes_done = pass;
+            __atomic_store_n(&dp->cur_lba, dp->start, __ATOMIC_RELAXED);
+        }
+        stats->passwiping_ticks = get_ticks(stats) - dp->pass_start_ticks;
+        stats->wiping_ticks = dp->base_ticks + stats->passwiping_ticks;
+        pthread_mutex_unlock(&dp->report_mutex);
+        if (res != 0)
+        {
+            if (retries_tmp > 0 && bRetryerror)
+            {
+                bRetryerror = false;
+                pass--;
+                continue;
+            }
+            else
+                break;
+        }
+        // print_stats(pass - nCheckCount, s_byte, opt.end, stats, opt.passes - CheckSumPasses);
+        print_stats(dp, pass, s_byte,
+                    dev_stopped(dp)
+                        ? __atomic_load_n(&dp->cur_lba, __ATOMIC_RELAXED)
+                        : dp->end,
+                    opt.passes);
+#ifndef DEBUG
+        printf("\n"); /* keep each finished pass's row */
+#endif
+        char pass_str[16];
+        snprintf(pass_str, sizeof(pass_str), "%u", pass);
+        print_latency(dp, "pass", pass_str, &dp->lat_pass);
+        cost_sample(dp, &pass_c1);
+        print_cost(dp, "pass", pass_str, &pass_c0, &pass_c1,
+                   dp->bytes_done - pass_bytes0, mono_secs() - pass_t0);
+        if (opt.write)
+        {
+            double secs = mono_secs() - pass_t0;
+            int k;
+
+            pthread_mutex_lock(&out_mutex);
+            if ((WRITE_WV == opt.write) && (FT_SG & out_type) &&
+                !(FT_BLOCK & out_type))
+                printf("%s: pass %u wrote %.1f MB/s with WRITE AND VERIFY "
+                       "(BYTCHK=%d), %.1f MB/s checked by the drive\n",
+                       device_name, pass, dp->bytes_written /
+                       (secs > 0 ? secs : 1) / 1e6, opt.write_bytchk,
+                       (dp->bytes_done - pass_bytes0) /
+                       (secs > 0 ? secs : 1) / 1e6);
+            else if (WRITE_PASS == opt.write)
+                printf("%s: pass %u wrote %.1f MB/s, read back %.1f MB/s\n",
+                       device_name, pass, dp->bytes_written /
+                       (write_secs > 0 ? write_secs : 1) / 1e6,
+                       (dp->bytes_done - pass_bytes0) /
+                       (secs > write_secs ? secs - write_secs : 1) / 1e6);
+            else
+                printf("%s: pass %u wrote %.1f MB/s reading it back behind "
+                       "the writer\n", device_name, pass,
+                       dp->bytes_written / (secs > 0 ? secs : 1) / 1e6);
+            if (dp->flushes)
+                printf("%s: pass %u cache flushes %d, %.3f s in all, avg %.2f "
+                       "ms, max %.2f ms\n", device_name, pass, dp->flushes,
+                       dp->flush_ns / 1e9, dp->flush_ns / 1e6 / dp->flushes,
+                       dp->flush_max_ns / 1e6);
+            else if (FLUSH_FUA == opt.flush)
+                printf("%s: pass %u wrote with FUA, no cache flushes\n",
+                       device_name, pass);
+            for (k = 0; k < dp->nstreams; ++k)
+            {
+                double ssecs = (dp->stream[k].t1_ns - dp->stream[k].t0_ns) /
+                               1e9;
+
+                printf("%s: pass %u stream %u wrote %.1f MB in %.1f s, %.1f "
+                       "MB/s\n", device_name, pass, dp->stream[k].id,
+                       dp->stream[k].bytes / 1e6, ssecs,
+                       dp->stream[k].bytes / (ssecs > 0 ? ssecs : 1) / 1e6);
+            }
+            pthread_mutex_unlock(&out_mutex);
+        }
+        if (dp->clone)
+            clone_summary(dp->clone, pass, mono_secs() - pass_t0);
+        if (opt.crc)
+        {
+            int64_t want = (dp->end - dp->from) * dp->blk_sz;
+
+            pthread_mutex_lock(&out_mutex);
+            if (dp->crc_bytes == want)
+                printf("%s: pass %u CRC32C 0x%08x of lba %" PRId64 " to %"
+                       PRId64 "\n", device_name, pass, dp->crc_acc, dp->from,
+                       dp->end - 1);
+            else
+                printf("%s: pass %u no CRC32C, %" PRId64 " of the %" PRId64
+                       " bytes of the range read\n", device_name, pass,
+                       dp->crc_bytes, want);
+            pthread_mutex_unlock(&out_mutex);
+        }
+        stable_end(dp, pass);
+        erase_end(dp, pass);
+        if (dp->run && dp->run->qdc.qd)
+            printf("%s: adaptive queue depth %d at the end of pass %u\n",
+                   device_name, dp->run->qdc.qd, pass);
+        if (opt.defects)
+            defects_end(dp, outfd, pass, defects, sizeof(defects));
+        if (jsonl_enabled())
+        {
+            char name[PATH_MAX], cbuf[512], lbuf[256], kbuf[256];
+            double secs = mono_secs() - pass_t0;
+
+            jsonl_printf("{\"type\":\"pass\",\"device\":\"%s\",\"pass\":%u,"
+                         "\"pattern\":\"%s\",\"result\":%d,\"bytes\":%" PRId64
+                         ",\"seconds\":%.3f,\"mbps\":%.2f,%s,%s,%s%s}",
+                         jsonl_escape(name, sizeof(name), device_name), pass,
+                         pat->label, res, dp->bytes_done - pass_bytes0, secs,
+                         (secs > 0) ? (dp->bytes_done - pass_bytes0) / secs / 1e6
+                                    : 0.0,
+                         json_latency(&dp->lat_pass, lbuf, sizeof(lbuf)),
+                         json_counters(dp, cbuf, sizeof(cbuf)),
+                         json_cost(dp, &pass_c0, &pass_c1,
+                                   dp->bytes_done - pass_bytes0, kbuf,
+                                   sizeof(kbuf)),
+                         defects);
+        }
+        if (dp->heat.cell)
+        {
+            pthread_mutex_lock(&heat_mutex);
+            lat_map_csv(heat_fp, device_name, pass, &dp->heat,
+                        opt.health_s ? heat_temp : NULL, dp);
+            fflush(heat_fp);
+            pthread_mutex_unlock(&heat_mutex);
+        }
+        if (dp->rz.cell)
+            rec_zones_report(dp, pass);
+        if (opt.drift_pct > 0)
+            drift_report(dp, pass);
+        if (opt.results_path)
+            results_end(dp, pass, s_byte, mono_secs() - pass_t0,
+                        dp->bytes_done - pass_bytes0, &pass_rm);
+        lat_merge(&dp->lat_run, &dp->lat_pass);
+        if (dp->have_profile && (0 == res) && (NULL == dp->ext))
+            zone_curve_learn(dp);
+        if (dp->have_profile)
+        {
+            double mbps = (dp->bytes_done - pass_bytes0) /
+                          (mono_secs() - pass_t0) / 1e6;
+
+            if (mbps < dp->profile.mbps * PROFILE_SLOW_PCT / 100)
+                pr2serr("%s: pass %u ran at %.1f MB/s, below %d%% of the "
+                        "%.1f MB/s baseline of its model\n", device_name,
+                        pass, mbps, PROFILE_SLOW_PCT, dp->profile.mbps);
+        }
+        if (dev_stopped(dp))
+            break;
+        if (opt.scrub && (pass == opt.passes))
+        {
+            scrub_cycle_end(dp);
+            pass = 0; /* and the next cycle from its first pass */
+        }
+    }
+    idle_close(dp);
+    dirty_finish(dp);
+    if (opt.passes > 1)
+        print_latency(dp, "all", "passes", &dp->lat_run);
+    if (dp->run)
+    {
+        t_run *rp = dp->run;
+
+        print_latency(dp, "polled", "completion", &rp->lat_polled);
+        print_latency(dp, "interrupt", "completion", &rp->lat_irq);
+        if (opt.poll_us && (rp->lat_polled.count + rp->lat_irq.count))
+        {
+            pthread_mutex_lock(&out_mutex);
+            printf("%s: polling spun %.1f ms of CPU, %.1f%% of the commands "
+                   "reaped by it\n", device_name, dp->spin_ns / 1e6,
+                   100.0 * rp->lat_polled.count /
+                       (rp->lat_polled.count + rp->lat_irq.count));
+            pthread_mutex_unlock(&out_mutex);
+        }
+    }
+    if (dp->flags.dio && (FT_SG & out_type))
+    {
+        int64_t all = dp->dio_done + dp->dio_copied;
+
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: direct I/O for %" PRId64 " of %" PRId64 " READs%s\n",
+               device_name, dp->dio_done, all,
+               dp->dio_copied ? ", the others copied by the sg driver" : "");
+        pthread_mutex_unlock(&out_mutex);
+    }
+    if ((opt.slow_ms > 0) || (opt.slow_mult > 0))
+    {
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: %d weak sectors\n", device_name, dp->weak_sectors);
+        pthread_mutex_unlock(&out_mutex);
+    }
+    if (dp->dld)
+    {
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: %" PRId64 " READs past duration limit %d, read again "
+               "without one\n", device_name, CTR_GET(dp, cdl), dp->dld);
+        pthread_mutex_unlock(&out_mutex);
+    }
+    if (CTR_GET(dp, qfull))
+    {
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: %" PRId64 " READs refused by a full queue and queued "
+               "again", device_name, CTR_GET(dp, qfull));
+        if (dp->qfull_cap)
+            printf(", %d at most in flight at the end", dp->qfull_cap);
+        printf("\n");
+        pthread_mutex_unlock(&out_mutex);
+    }
+    if (dp->pi_type)
+    {
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: protection type %d, %" PRId64 " tuples verified, %"
+               PRId64 " guard, %" PRId64 " reference and %" PRId64
+               " application tag errors\n", device_name, dp->pi_type,
+               dp->pi_ok, dp->pi_guard, dp->pi_ref, dp->pi_app);
+        pthread_mutex_unlock(&out_mutex);
+    }
+    if (dp->mis_blocks)
+    {
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: %" PRId64 " blocks not the pattern, %" PRId64 " bits "
+               "read 1 for 0, %" PRId64 " read 0 for 1\n", device_name,
+               dp->mis_blocks, dp->flips_up, dp->flips_down);
+        pthread_mutex_unlock(&out_mutex);
+    }
+    if (dp->sample_n)
+        sample_report(dp);
+    if (opt.time_limit > 0)
+        tl_report(dp);
+    if (dp->err_hit)
+    {
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: %" PRId64 " bad or miscompared blocks, over --max-errors "
+               "%" PRId64 ", stopped early\n", device_name, dp->fail_blocks,
+               opt.max_errors);
+        pthread_mutex_unlock(&out_mutex);
+        if (0 == res)
+            res = SG_LIB_CAT_MEDIUM_HARD;
+    }
+    if (dp->cancelled && opt.scrub)
+        pr2serr("%s: scrub stopped\n", device_name);
+    else if (dp->cancelled && (0 == res))
+    {
+        pr2serr("%s: cancelled\n", device_name);
+        res = SG_LIB_CAT_OTHER;
+    }
+    if (dp->gone)
+    {
+        /* where the READs got to, for a --resume once it is back */
+        pthread_mutex_lock(&out_mutex);
+        printf("%s: gone at lba %" PRId64 ", the rest not read\n",
+               device_name, __atomic_load_n(&dp->cur_lba, __ATOMIC_RELAXED));
+        pthread_mutex_unlock(&out_mutex);
+        if (opt.ck_path)
+            checkpoint_write();
+        if (0 == res)
+            res = SG_LIB_CAT_OTHER;
+    }
+    bad_save(dp);
+    if (dp->clone && !clone_capture())
+        bad_save(dp->clone->dst);
+    clone_close(dp);
+    iobuf_free(sector_free);
+    extent_drop(dp);
+    lat_map_free(&dp->heat);
+    reczone_free(&dp->rz);
+    outsink_close(dp->log);
+    dp->log = NULL;
+    free(dp->stab_ref);
+    free(dp->stab_cur);
+    dp->stab_ref = dp->stab_cur = NULL;
+    free(dp->erase_fp);
+    dp->erase_fp = NULL;
+    free(dp->run);
+    dp->run = NULL;
+    if (dp->mmap_buf)
+    {
+        munmap(dp->mmap_buf, dp->mmap_len);
+        dp->mmap_buf = NULL;
+    }
+    media_restore(dp);
+    cdl_restore(dp);
+    health_close(dp);
+    free(dp->glist);
+    dp->glist = NULL;
+    path_detach(dp);
+    read_long_close(dp);
+    dev_close(outfd);
+
+    return res;
+}
+
+/* --baseline: the zone throughput and READ latency of a full, uncapped
+ * sequential scan of dp that passed, held against the fleet baseline of
+ * its model and firmware, and added to it unless it is off; the JSON
+ * member of the device record into json, "" when there is none. */
+static void
+baseline_check(t_dev *dp, char *json, int jlen)
+{
+    double mbps[TL_ZONES], sig[TL_ZONES], p50, p99, s50 = 0, s99 = 0;
+    double k = opt.baseline_k;
+    char model[PROFILE_KEY_SZ], *cp;
+    struct baseline b;
+    uint64_t ns;
+    int z, n, slow = 0, judged;
+
+    json[0] = '\0';
+    if ((NULL == opt.baseline_path) || dp->res || ('\0' == dp->model_key[0]))
+        return;
+    if (dp->start || (dp->end != dp->num_sect) || dp->ext || dp->sample_n ||
+        opt.coarse || (opt.stress > 0) ||
+        __atomic_load_n(&throttle_on, __ATOMIC_RELAXED))
+    {
+        pr2serr("%s: not a full uncapped scan, not held against the fleet "
+                "baseline\n", dp->device_name);
+        return;
+    }
+    for (z = 0; z < TL_ZONES; ++z)
+    {
+        int64_t bytes = zone_read(dp, z, &ns);
+
+        if (0 == ns)
+            return; /* too small a device to time each zone */
+        mbps[z] = bytes * 1e3 / ns;
+    }
+    p50 = lat_percentile(&dp->lat_run, 50.0) / 1e3;
+    p99 = lat_percentile(&dp->lat_run, 99.0) / 1e3;
+    snprintf(model, sizeof(model), "%s", dp->model_key);
+    for (cp = model; *cp; ++cp)
+        if ('\t' == *cp)
+            *cp = ' ';
+    judged = (0 == baseline_load(opt.baseline_path, dp->model_key, &b)) &&
+             (TL_ZONES == b.nz) && (b.n >= BASELINE_MIN);
+    if (judged)
+    {
+        for (z = 0; z < TL_ZONES; ++z)
+        {
+            sig[z] = baseline_sigmas(b.zone[z], b.n, mbps[z], BASELINE_FLOOR);
+            slow += (sig[z] < -k);
+        }
+        s50 = baseline_sigmas(b.p50, b.n, p50, BASELINE_FLOOR);
+        s99 = baseline_sigmas(b.p99, b.n, p99, BASELINE_FLOOR);
+        slow += (s50 > k) + (s99 > k);
+    }
+    if (!judged)
+        printf("%s: fleet baseline of %s building, %d drives before it "
+               "judges\n", dp->device_name, model, BASELINE_MIN);
+    else if (0 == slow)
+        printf("%s: within %g sigma of the fleet baseline of %d %s\n",
+               dp->device_name, k, b.n, model);
+    else
+    {
+        printf("%s: SLOWER than the fleet baseline of %d %s by over %g "
+               "sigma:", dp->device_name, b.n, model, k);
+        for (z = 0; z < TL_ZONES; ++z)
+            if (sig[z] < -k)
+                printf(" zone %d %.0f MB/s (%.0f, %+.1f)", z, mbps[z],
+                       b.zone[z][0], sig[z]);
+        if (s50 > k)
+            printf(" p50 %.0f us (%.0f, %+.1f)", p50, b.p50[0], s50);
+        if (s99 > k)
+            printf(" p99 %.0f us (%.0f, %+.1f)", p99, b.p99[0], s99);
+        printf("\n");
+    }
+    if (!slow && baseline_add(opt.baseline_path, dp->model_key, TL_ZONES,
+                              mbps, p50, p99))
+        pr2serr("%s: could not update fleet baseline %s\n", dp->device_name,
+                opt.baseline_path);
+    if (!judged)
+        return;
+    n = snprintf(json, jlen, ",\"baseline\":{\"drives\":%d,\"sigmas\":%g,"
+                 "\"flagged\":%s,\"p50_sigmas\":%.2f,\"p99_sigmas\":%.2f,"
+                 "\"zones_sigmas\":[", b.n, k, slow ? "true" : "false", s50,
+                 s99);
+    for (z = 0; (z < TL_ZONES) && (n < jlen); ++z)
+        n += snprintf(json + n, jlen - n, "%s%.2f", z ? "," : "", sig[z]);
+    if (n < jlen)
+        snprintf(json + n, jlen - n, "]}");
+}
+
+static void *
+verify_worker(void *arg)
+{
+    t_dev *dp = (t_dev *)arg;
+    char bjson[1536];
+    t_cost c0, c1;
+    double t0;
+
+    if (dp->path_of)
+    {
+        /* scanned through the first node of its LU */
+        __atomic_store_n(&dp->done, 1, __ATOMIC_RELEASE);
+        if (lib_dev_done)
+            lib_dev_done((int)(dp - devs));
+        return NULL;
+    }
+
+    /* the lanes and the side queue are started from here and inherit it */
+    if (opt.background &&
+        syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, IOPRIO_IDLE))
+        pr2serr("%s: ioprio_set: %s, reading at normal I/O priority\n",
+                dp->device_name, safe_strerror(errno));
+    cost_open(dp);
+    cost_sample(dp, &c0);
+    t0 = mono_secs();
+    dp->res = read_verify_device(dp);
+    cost_sample(dp, &c1);
+    if (opt.passes > 1)
+        print_cost(dp, "all", "passes", &c0, &c1, dp->bytes_done,
+                   mono_secs() - t0);
+    cost_close(dp);
+    if (dp->sim)
+        sim_close(dp->sim);
+    free(dp->sim);
+    dp->sim = NULL;
+    spdkdev_close(dp->spdk);
+    dp->spdk = NULL;
+    baseline_check(dp, bjson, sizeof(bjson));
+    if (live)
+    {
+        double kilo = opt.kilobyte ? 1024.0 : 1000.0;
+        double secs = (double)(get_ticks(&dp->stats) - dp->stats.start_ticks) /
+                      TICKS_PER_SEC;
+
+        live_update(dp, LIVESTAT_DONE, opt.passes, dp->end,
+                    (secs > 0) ? dp->bytes_done / (kilo * kilo) / secs : 0.0,
+                    0.0);
+    }
+    if (jsonl_enabled())
+    {
+        char name[PATH_MAX], cbuf[512], lbuf[256], sbuf[192] = "";
+        char kbuf[256], pbuf[MAX_PATHS * (PATH_MAX / 8)];
+        char abuf[MAX_ACTUATORS * 80];
+
+        if (dp->sample_n)
+            snprintf(sbuf, sizeof(sbuf), ",\"sample\":{\"windows\":%" PRId64
+                     ",\"blocks\":%d,\"read\":%" PRId64 ",\"failing\":%"
+                     PRId64 ",\"bound\":%.6g,\"confidence\":%g,"
+                     "\"target\":%g}", dp->sample_n, dp->sample_w,
+                     dp->sample_read, dp->sample_bad, dp->sample_ub,
+                     opt.sample_conf, opt.sample);
+        else if (opt.time_limit > 0)
+        {
+            double full = 0.0;
+            double left = zone_remaining(dp, dp->passes_done + 1, &full);
+
+            snprintf(sbuf, sizeof(sbuf), ",\"time_limit\":{\"seconds\":%g,"
+                     "\"reached\":%s,\"pass_seconds\":%.0f,"
+                     "\"remaining_seconds\":%.0f}", opt.time_limit,
+                     dp->tl_hit ? "true" : "false", full,
+                     (left >= 0) ? left : 0.0);
+        }
+        jsonl_printf("{\"type\":\"device\",\"device\":\"%s\",\"result\":%d,"
+                     "\"passes\":%u,\"bytes\":%" PRId64 ",%s,%s,%s%s%s%s%s}",
+                     jsonl_escape(name, sizeof(name), dp->device_name), dp->res,
+                     opt.passes, dp->bytes_done,
+                     json_latency(&dp->lat_run, lbuf, sizeof(lbuf)),
+                     json_counters(dp, cbuf, sizeof(cbuf)),
+                     json_cost(dp, &c0, &c1, dp->bytes_done, kbuf,
+                               sizeof(kbuf)),
+                     json_paths(dp, pbuf, sizeof(pbuf)),
+                     json_actuators(dp, abuf, sizeof(abuf)), sbuf, bjson);
+    }
+    __atomic_store_n(&dp->done, 1, __ATOMIC_RELEASE);
+    if (lib_dev_done)
+        lib_dev_done((int)(dp - devs));
+    return NULL;
+}
+
+/* One summary row across all devices, printed by the reporter while
+ * the workers run. */
+static void
+print_aggregate(int64_t all_start_ticks)
+{
+    int k, running = 0;
+    int64_t bytes = 0, total = 0;
+    double kilo = opt.kilobyte ? 1024.0 : 1000.0;
+    double seconds = (double)(get_ticks(NULL) - all_start_ticks) / TICKS_PER_SEC;
+    double pct = 0, mb_sec = 0;
+    char elapsed_time[255];
+
+    for (k = 0; k < num_devs; ++k)
+    {
+        t_dev *dp = devs + k;
+
+        if (!__atomic_load_n(&dp->done, __ATOMIC_ACQUIRE))
+            ++running;
+        bytes += __atomic_load_n(&dp->bytes_done, __ATOMIC_RELAXED);
+        if (dp->end > dp->start)
+            total += (dp->end - dp->start) * dp->blk_sz * (int64_t)opt.passes;
+    }
+    if (total > 0)
+        pct = (double)bytes / (double)total * 100.0;
+    if (seconds > 0)
+        mb_sec = (double)bytes / (kilo * kilo) / seconds;
+    seconds_to_hhmmss((uint)seconds, elapsed_time, sizeof(elapsed_time));
+
+    pthread_mutex_lock(&out_mutex);
+    printf("All %d devices (%d running): %7.3f%% %s %9.2f %s/Second\n",
+           num_devs, running, pct, elapsed_time, mb_sec,
+           opt.kilobyte ? "MiB" : "MB");
+    fflush(stdout);
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* --plan: the schedule of the passes of the devices probed, as the run
+ * would go: every device starting at once, a --per-host gate letting
+ * the devices of an adapter into a pass in the order they asked, and
+ * the devices reading together sharing the --host-rate and --total-rate
+ * caps of the buckets. Between two passes ending, each device reads at
+ * its plan_device() rate scaled down to its share of a cap it is over,
+ * so the schedule is run pass by pass to its end. Prints when each
+ * device would be done, the peak MB/s of each adapter and of all, and
+ * the buffers the passes take. */
+static void
+plan_print(void)
+{
+    double *left = (double *)calloc(num_devs, sizeof(double));
+    double *rate = (double *)calloc(num_devs, sizeof(double));
+    double *t_first = (double *)calloc(num_devs, sizeof(double));
+    double *t_done = (double *)calloc(num_devs, sizeof(double));
+    double *peak = (double *)calloc(num_hosts + 1, sizeof(double));
+    double *sum = (double *)calloc(num_hosts + 1, sizeof(double));
+    unsigned int *passes = (unsigned int *)calloc(num_devs, sizeof(*passes));
+    uint64_t *ticket = (uint64_t *)calloc(num_devs, sizeof(*ticket));
+    int *state = (int *)calloc(num_devs, sizeof(int)); /* PLAN_* */
+    int *active = (int *)calloc(num_hosts + 1, sizeof(int));
+    double t = 0.0, dt, f, total_peak = 0.0, tl = opt.time_limit;
+    char hms[32], name[PATH_MAX];
+    int64_t mem = 0, unknown = 0;
+    uint64_t next_ticket = 0;
+    int k, h, n, best;
+
+    if (!(left && rate && t_first && t_done && peak && sum && passes &&
+          ticket && state && active))
+    {
+        pr2serr("--plan: out of memory\n");
+        goto fini;
+    }
+    for (k = 0; k < num_devs; ++k)
+    {
+        t_dev *dp = devs + k;
+
+        state[k] = PLAN_WAIT;
+        ticket[k] = next_ticket++;
+        passes[k] = (opt.passes > dp->passes_done)
+                        ? opt.passes - dp->passes_done : 0;
+        left[k] = (double)dp->plan_blocks * dp->blk_sz;
+        if ((dp->resume_lba > dp->start) && !dp->ext)
+            left[k] = (double)(dp->end - dp->resume_lba) * dp->blk_sz;
+        if (dp->path_of || dp->res || (0 == passes[k]) || (left[k] <= 0))
+            state[k] = PLAN_NONE;
+        else if (dp->plan_bps <= 0)
+        {
+            state[k] = PLAN_NONE;
+            ++unknown;
+        }
+        if (PLAN_NONE != state[k])
+            mem += dp->plan_mem;
+    }
+    for (;;)
+    {
+        /* the gates: the longest waiting first */
+        for (;;)
+        {
+            best = -1;
+            for (k = 0; k < num_devs; ++k)
+            {
+                h = devs[k].host ? (int)(devs[k].host - hosts) : num_hosts;
+                if ((PLAN_WAIT == state[k]) &&
+                    ((opt.per_host <= 0) || (num_hosts == h) ||
+                     (active[h] < opt.per_host)) &&
+                    ((best < 0) || (ticket[k] < ticket[best])))
+                    best = k;
+            }
+            if (best < 0)
+                break;
+            h = devs[best].host ? (int)(devs[best].host - hosts) : num_hosts;
+            state[best] = PLAN_RUN;
+            ++active[h];
+            if (0 == t_first[best])
+                t_first[best] = t + 1e-9; /* 0 -> not started */
+        }
+        /* the rates, each adapter's cap then the process's */
+        memset(sum, 0, (num_hosts + 1) * sizeof(double));
+        for (k = 0, n = 0; k < num_devs; ++k)
+            if (PLAN_RUN == state[k])
+            {
+                h = devs[k].host ? (int)(devs[k].host - hosts) : num_hosts;
+                rate[k] = devs[k].plan_bps;
+                sum[h] += rate[k];
+                ++n;
+            }
+        if (0 == n)
+            break;
+        for (k = 0, f = 0.0; k < num_devs; ++k)
+            if (PLAN_RUN == state[k])
+            {
+                h = devs[k].host ? (int)(devs[k].host - hosts) : num_hosts;
+                if ((h < num_hosts) && (hosts[h].tb_bytes.rate > 0) &&
+                    (sum[h] > hosts[h].tb_bytes.rate))
+                    rate[k] *= hosts[h].tb_bytes.rate / sum[h];
+                f += rate[k];
+            }
+        memset(sum, 0, (num_hosts + 1) * sizeof(double));
+        for (k = 0, dt = -1.0; k < num_devs; ++k)
+            if (PLAN_RUN == state[k])
+            {
+                h = devs[k].host ? (int)(devs[k].host - hosts) : num_hosts;
+                if ((tb_all_bytes.rate > 0) && (f > tb_all_bytes.rate))
+                    rate[k] *= tb_all_bytes.rate / f;
+                sum[h] += rate[k];
+                if ((dt < 0) || (left[k] / rate[k] < dt))
+                    dt = left[k] / rate[k];
+                if ((tl > 0) && (t_first[k] + tl - t < dt))
+                    dt = (t_first[k] + tl - t > 0) ? t_first[k] + tl - t : 0;
+            }
+        for (h = 0, f = 0.0; h <= num_hosts; ++h)
+        {
+            if (sum[h] > peak[h])
+                peak[h] = sum[h];
+            f += sum[h];
+        }
+        if (f > total_peak)
+            total_peak = f;
+        /* to the next pass ending, or --time-limit */
+        t += dt;
+        for (k = 0; k < num_devs; ++k)
+        {
+            if (PLAN_RUN != state[k])
+                continue;
+            h = devs[k].host ? (int)(devs[k].host - hosts) : num_hosts;
+            left[k] -= rate[k] * dt;
+            if ((tl > 0) && (t >= t_first[k] + tl - 1e-9))
+                passes[k] = 1; /* stopped mid pass */
+            else if (left[k] > 1.0)
+                continue; /* bytes, to the rounding of the rates */
+            --active[h];
+            if (0 == --passes[k])
+            {
+                state[k] = PLAN_DONE;
+                t_done[k] = t;
+                continue;
+            }
+            left[k] = (double)devs[k].plan_blocks * devs[k].blk_sz;
+            /* host_enter() again for the next pass, behind the others */
+            state[k] = PLAN_WAIT;
+            ticket[k] = next_ticket++;
+        }
+    }
+    pthread_mutex_lock(&out_mutex);
+    printf("plan: %d devices, %u passes, total-rate %s%.1f MB/s, "
+           "per-host %d\n", num_devs, opt.passes,
+           (tb_all_bytes.rate > 0) ? "" : "none ",
+           tb_all_bytes.rate / 1e6, opt.per_host);
+    for (k = 0; k < num_devs; ++k)
+    {
+        t_dev *dp = devs + k;
+
+        if (dp->path_of)
+            continue;
+        if (dp->res || (dp->plan_bps <= 0))
+        {
+            printf("%s: %s\n", dp->device_name,
+                   dp->res ? "not probed" : dp->plan_src);
+            continue;
+        }
+        seconds_to_hhmmss((uint)(t_done[k] + 0.5), hms, sizeof(hms));
+        printf("%s: %.1f GB a pass at %.1f MB/s (%s), -n %d --qd %d, "
+               "%.1f MiB of buffers, done in %s\n", dp->device_name,
+               (double)dp->plan_blocks * dp->blk_sz / 1e9,
+               dp->plan_bps / 1e6, dp->plan_src, dp->bpt, dp->qd,
+               dp->plan_mem / 1048576.0, hms);
+        if (jsonl_enabled())
+            jsonl_printf("{\"type\":\"plan\",\"device\":\"%s\",\"bytes\":%"
+                         PRId64 ",\"mbps\":%.2f,\"source\":\"%s\","
+                         "\"buffer_bytes\":%" PRId64 ",\"seconds\":%.0f}",
+                         jsonl_escape(name, sizeof(name), dp->device_name),
+                         dp->plan_blocks * dp->blk_sz, dp->plan_bps / 1e6,
+                         dp->plan_src, dp->plan_mem, t_done[k]);
+    }
+    for (h = 0; h < num_hosts; ++h)
+        printf("host%d: %d devices, peak %.1f MB/s%s\n", hosts[h].host_no,
+               hosts[h].devices, peak[h] / 1e6,
+               (hosts[h].tb_bytes.rate > 0) ? " (host-rate)" : "");
+    seconds_to_hhmmss((uint)(t + 0.5), hms, sizeof(hms));
+    printf("plan: all done in %s, peak %.1f MB/s, %.1f MiB of buffers%s\n",
+           hms, total_peak / 1e6, mem / 1048576.0,
+           unknown ? ", without the devices of unknown rate" : "");
+    pthread_mutex_unlock(&out_mutex);
+fini:
+    free(left);
+    free(rate);
+    free(t_first);
+    free(t_done);
+    free(peak);
+    free(sum);
+    free(passes);
+    free(ticket);
+    free(state);
+    free(active);
+}
+
+/* Sets a cap of opt, *bps_p and *iops_p, from the thread of --control
+ * or the reporter, for throttle_apply() to read in another. */
+static void
+rate_set(double *bps_p, double *iops_p, double bps, double iops)
+{
+    pthread_mutex_lock(&rate_mutex);
+    *bps_p = bps;
+    *iops_p = iops;
+    pthread_mutex_unlock(&rate_mutex);
+}
+
+/* --coordinate: the host adapters and the host as a whole ("*") are
+ * shared with the other dskread runs on them, each taking an equal
+ * part of the lowest cap any of them has. */
+static void
+throttle_share(void)
+{
+    double host[2], all[2], share[2];
+    char key[HOSTCO_KEY_SZ];
+    bool on = false;
+    int k;
+
+    pthread_mutex_lock(&rate_mutex);
+    host[0] = opt.host_bps;
+    host[1] = opt.host_iops;
+    all[0] = opt.total_bps;
+    all[1] = opt.total_iops;
+    pthread_mutex_unlock(&rate_mutex);
+    for (k = 0; k < num_hosts; ++k)
+    {
+        snprintf(key, sizeof(key), "host%d", hosts[k].host_no);
+        if (hostco_share(key, host, share) > 0)
+        {
+            tb_set(&hosts[k].tb_bytes, share[0]);
+            tb_set(&hosts[k].tb_reads, share[1]);
+            on = on || (share[0] > 0) || (share[1] > 0);
+        }
+    }
+    if (hostco_share("*", all, share) > 0)
+    {
+        tb_set(&tb_all_bytes, share[0]);
+        tb_set(&tb_all_reads, share[1]);
+        on = on || (share[0] > 0) || (share[1] > 0);
+    }
+    if (on)
+        __atomic_store_n(&throttle_on, 1, __ATOMIC_RELAXED);
+}
+
+/* Puts the --max-rate and --total-rate caps of opt on the buckets. */
+static void
+throttle_apply(void)
+{
+    double dev[2], host[2], ctrl[2], all[2];
+    int k;
+
+    pthread_mutex_lock(&rate_mutex);
+    dev[0] = opt.max_bps;
+    dev[1] = opt.max_iops;
+    host[0] = opt.host_bps;
+    host[1] = opt.host_iops;
+    ctrl[0] = opt.target_bps;
+    ctrl[1] = opt.target_iops;
+    all[0] = opt.total_bps;
+    all[1] = opt.total_iops;
+    pthread_mutex_unlock(&rate_mutex);
+    for (k = 0; k < num_devs; ++k)
+    {
+        tb_set(&devs[k].tb_bytes, dev[0]);
+        tb_set(&devs[k].tb_reads, dev[1]);
+    }
+    for (k = 0; k < num_hosts; ++k)
+    {
+        tb_set(&hosts[k].tb_bytes, host[0]);
+        tb_set(&hosts[k].tb_reads, host[1]);
+    }
+    for (k = 0; k < num_ctrls; ++k)
+    {
+        tb_set(&ctrls[k].tb_bytes, ctrl[0]);
+        tb_set(&ctrls[k].tb_reads, ctrl[1]);
+    }
+    tb_set(&tb_all_bytes, all[0]);
+    tb_set(&tb_all_reads, all[1]);
+    __atomic_store_n(&throttle_on, (dev[0] > 0) || (dev[1] > 0) ||
+                                   (all[0] > 0) || (all[1] > 0) ||
+                                   (host[0] > 0) || (host[1] > 0) ||
+                                   (ctrl[0] > 0) || (ctrl[1] > 0),
+                     __ATOMIC_RELAXED);
+    if (__atomic_load_n(&hostco_on, __ATOMIC_RELAXED))
+        throttle_share();
+}
+
+static struct timespec rate_mtime; /* of the --rate-file last read */
+
+/* Takes the caps of the "max-rate r[:n]", "total-rate r[:n]",
+ * "host-rate r[:n]" and "target-rate r[:n]" lines of the --rate-file,
+ * when it changed since it was last read, and puts them on the buckets. Other lines, and a missing file, are ignored. */
+static void
+rate_file_load(void)
+{
+    char line[256], key[32], val[64];
+    struct stat st;
+    FILE *fp;
+
+    if ((NULL == opt.rate_path) || stat(opt.rate_path, &st) ||
+        ((st.st_mtim.tv_sec == rate_mtime.tv_sec) &&
+         (st.st_mtim.tv_nsec == rate_mtime.tv_nsec)))
+        return;
+    rate_mtime = st.st_mtim;
+    fp = fopen(opt.rate_path, "r");
+    if (NULL == fp)
+        return;
+    while (fgets(line, sizeof(line), fp))
+    {
+        double bps, iops;
+
+        if ((2 != sscanf(line, "%31s %63s", key, val)) ||
+            parse_rate(val, &bps, &iops))
+            continue;
+        if (0 == strcmp(key, "max-rate"))
+            rate_set(&opt.max_bps, &opt.max_iops, bps, iops);
+        else if (0 == strcmp(key, "total-rate"))
+            rate_set(&opt.total_bps, &opt.total_iops, bps, iops);
+        else if (0 == strcmp(key, "host-rate"))
+            rate_set(&opt.host_bps, &opt.host_iops, bps, iops);
+        else if (0 == strcmp(key, "target-rate"))
+            rate_set(&opt.target_bps, &opt.target_iops, bps, iops);
+    }
+    fclose(fp);
+    throttle_apply();
+}
+
+/* The device of --control command word w: its index, -1 for all when w
+ * is NULL or "all", -2 when no device is named w. */
+static int
+ctl_dev(const char *w)
+{
+    int k;
+
+    if ((NULL == w) || (0 == strcmp(w, "all")))
+        return -1;
+    for (k = 0; k < num_devs; ++k)
+        if (0 == strcmp(w, devs[k].device_name))
+            return k;
+    return -2;
+}
+
+/* The "stats" line of dp. */
+static void
+ctl_stats(FILE *out, t_dev *dp)
+{
+    int64_t lba = dev_progress(dp);
+    unsigned int pass = __atomic_load_n(&dp->cur_pass, __ATOMIC_RELAXED);
+    int qd = __atomic_load_n(&dp->qd_cap, __ATOMIC_RELAXED);
+    int bpt = __atomic_load_n(&dp->bpt_cap, __ATOMIC_RELAXED);
+    double span = (double)(dp->end - dp->start);
+
+    fprintf(out, "%s %s pass %u/%d lba %" PRId64 " %.3f%% bytes %" PRId64
+            " unrecovered %" PRId64 " mismatched %" PRId64 " weak %d qd %d/%d"
+            " bpt %d/%d max-rate %.0f:%.0f\n", dp->device_name,
+            __atomic_load_n(&dp->done, __ATOMIC_ACQUIRE) ? "done"
+            : __atomic_load_n(&dp->paused, __ATOMIC_RELAXED) ? "paused"
+            : __atomic_load_n(&dp->idle_busy, __ATOMIC_RELAXED) ? "yielding"
+            : pass                                          ? "running"
+                                                            : "waiting",
+            pass, opt.passes, lba,
+            (pass && (span > 0)) ? 100.0 * (lba - dp->start) / span : 0.0,
+            dp->bytes_done, CTR_GET(dp, unrecovered), dp->mis_blocks,
+            dp->weak_sectors, qd ? qd : dp->qd, dp->qd, bpt ? bpt : dp->bpt,
+            dp->bpt, dp->tb_bytes.rate, dp->tb_reads.rate);
+}
+
+/* A command of the --control socket, see control_help below. */
+static void
+control_cmd(const char *cmd, FILE *out)
+{
+    static const char *control_help =
+        "pause [dev]         hold the READs of dev, of all without one\n"
+        "resume [dev]        let them go again\n"
+        "qd n [dev]          at most n READs in flight, up to --qd, 0 -> --qd\n"
+        "bpt n [dev]         READs of at most n blocks, up to -n, 0 -> -n\n"
+        "max-rate r[:n] [dev]  cap as --max-rate, 0 lifts it\n"
+        "total-rate r[:n]    cap as --total-rate\n"
+        "host-rate r[:n]     cap as --host-rate\n"
+        "target-rate r[:n]   cap as --target-rate\n"
+        "stats               a line per device\n"
+        "metrics             the OpenMetrics of --metrics-port\n";
+    char verb[32], a1[256], a2[256];
+    int n = sscanf(cmd, "%31s %255s %255s", verb, a1, a2);
+    double bps, iops;
+    char *ep;
+    long v;
+    int k, d;
+
+    if (n < 1)
+        return; /* an empty line, no reply */
+    if (0 == strcmp(verb, "help"))
+    {
+        fputs(control_help, out);
+        fputs("ok\n", out);
+        return;
+    }
+    if (0 == strcmp(verb, "stats"))
+    {
+        for (k = 0; k < num_devs; ++k)
+            ctl_stats(out, devs + k);
+        fputs("ok\n", out);
+        return;
+    }
+    if (0 == strcmp(verb, "metrics"))
+    {
+        metrics_render(out);
+        fputs("ok\n", out);
+        return;
+    }
+    if ((0 == strcmp(verb, "pause")) || (0 == strcmp(verb, "resume")))
+    {
+        d = ctl_dev((n > 1) ? a1 : NULL);
+        if (-2 == d)
+        {
+            fprintf(out, "error: no device %s\n", a1);
+            return;
+        }
+        for (k = 0; k < num_devs; ++k)
+            if ((d < 0) || (d == k))
+                __atomic_store_n(&devs[k].paused, 'p' == verb[0],
+                                 __ATOMIC_RELAXED);
+    }
+    else if ((0 == strcmp(verb, "qd")) || (0 == strcmp(verb, "bpt")))
+    {
+        v = (n > 1) ? strtol(a1, &ep, 10) : -1;
+        d = ctl_dev((n > 2) ? a2 : NULL);
+        if ((n < 2) || *ep || (v < 0) || (v > INT_MAX))
+        {
+            fprintf(out, "error: %s wants a number\n", verb);
+            return;
+        }
+        if (-2 == d)
+        {
+            fprintf(out, "error: no device %s\n", a2);
+            return;
+        }
+        for (k = 0; k < num_devs; ++k)
+        {
+            t_dev *dp = devs + k;
+
+            if ((d >= 0) && (d != k))
+                continue;
+            /* the slots and buffers are those of the start */
+            if ('q' == verb[0])
+                __atomic_store_n(&dp->qd_cap, (v < dp->qd) ? (int)v : 0,
+                                 __ATOMIC_RELAXED);
+            else
+                __atomic_store_n(&dp->bpt_cap, (v < dp->bpt) ? (int)v : 0,
+                                 __ATOMIC_RELAXED);
+            if (v > ('q' == verb[0] ? dp->qd : dp->bpt))
+                fprintf(out, "%s: %s %d, as started\n", dp->device_name, verb,
+                        'q' == verb[0] ? dp->qd : dp->bpt);
+        }
+    }
+    else if ((0 == strcmp(verb, "max-rate")) ||
+             (0 == strcmp(verb, "total-rate")) ||
+             (0 == strcmp(verb, "host-rate")) ||
+             (0 == strcmp(verb, "target-rate")))
+    {
+        if ((n < 2) || parse_rate(a1, &bps, &iops))
+        {
+            fprintf(out, "error: %s wants r[:n]\n", verb);
+            return;
+        }
+        d = ctl_dev((n > 2) ? a2 : NULL);
+        if ((n > 2) && strcmp(verb, "max-rate"))
+        {
+            fprintf(out, "error: only max-rate is per device\n");
+            return;
+        }
+        if (-2 == d)
+        {
+            fprintf(out, "error: no device %s\n", a2);
+            return;
+        }
+        if ((0 == strcmp(verb, "max-rate")) && (d >= 0))
+        {
+            tb_set(&devs[d].tb_bytes, bps);
+            tb_set(&devs[d].tb_reads, iops);
+            if ((bps > 0) || (iops > 0))
+                __atomic_store_n(&throttle_on, 1, __ATOMIC_RELAXED);
+        }
+        else if (0 == strcmp(verb, "max-rate"))
+        {
+            rate_set(&opt.max_bps, &opt.max_iops, bps, iops);
+            throttle_apply();
+        }
+        else if (0 == strcmp(verb, "total-rate"))
+        {
+            rate_set(&opt.total_bps, &opt.total_iops, bps, iops);
+            throttle_apply();
+        }
+        else if (0 == strcmp(verb, "host-rate"))
+        {
+            rate_set(&opt.host_bps, &opt.host_iops, bps, iops);
+            throttle_apply();
+        }
+        else
+        {
+            rate_set(&opt.target_bps, &opt.target_iops, bps, iops);
+            throttle_apply();
+        }
+    }
+    else
+    {
+        fprintf(out, "error: no command %s, try help\n", verb);
+        return;
+    }
+    pr2serr("control: %s\n", cmd);
+    fputs("ok\n", out);
+}
+
+/* One rate of print_rates(), "12.3 MB/s of 20.0 MB/s cap, 150 READs/s". */
+static void
+print_rate(const char *name, const struct tbucket *bb,
+           const struct tbucket *rb, double *taken, double seconds)
+{
+    double kilo = opt.kilobyte ? 1024.0 : 1000.0;
+    const char *unit = opt.kilobyte ? "MiB" : "MB";
+    double bytes = tb_taken(bb), reads = tb_taken(rb);
+
+    printf("%s: %.1f %s/s", name, (bytes - taken[0]) / (kilo * kilo) / seconds,
+           unit);
+    if (bb->rate > 0)
+        printf(" of %.1f %s/s cap", bb->rate / (kilo * kilo), unit);
+    printf(", %.0f READs/s", (reads - taken[1]) / seconds);
+    if (rb->rate > 0)
+        printf(" of %.0f", rb->rate);
+    printf("\n");
+    taken[0] = bytes;
+    taken[1] = reads;
+}
+
+/* Under a rate cap, what each device and all of them achieved over the
+ * last seconds against the caps. */
+static void
+print_rates(double seconds)
+{
+    int k;
+
+    if (!__atomic_load_n(&throttle_on, __ATOMIC_RELAXED) || (seconds <= 0))
+        return;
+    pthread_mutex_lock(&out_mutex);
+    putchar('\n'); /* off the progress row, which ends in a \r */
+    for (k = 0; k < num_devs; ++k)
+        print_rate(devs[k].device_name, &devs[k].tb_bytes, &devs[k].tb_reads,
+                   devs[k].rate_taken, seconds);
+    for (k = 0; k < num_hosts; ++k)
+    {
+        char name[32];
+
+        snprintf(name, sizeof(name), "host%d", hosts[k].host_no);
+        if ((hosts[k].tb_bytes.rate > 0) || (hosts[k].tb_reads.rate > 0))
+            print_rate(name, &hosts[k].tb_bytes, &hosts[k].tb_reads,
+                       hosts[k].rate_taken, seconds);
+    }
+    for (k = 0; k < num_ctrls; ++k)
+        if ((ctrls[k].tb_bytes.rate > 0) || (ctrls[k].tb_reads.rate > 0))
+            print_rate(ctrls[k].name, &ctrls[k].tb_bytes, &ctrls[k].tb_reads,
+                       ctrls[k].rate_taken, seconds);
+    if ((num_devs > 1) || (tb_all_bytes.rate > 0) || (tb_all_reads.rate > 0))
+        print_rate("All devices", &tb_all_bytes, &tb_all_reads,
+                   rate_all_taken, seconds);
+    fflush(stdout);
+    pthread_mutex_unlock(&out_mutex);
+}
+
+/* --stream: the checks switched to the streaming kernels once all the
+ * devices read over opt.stream_mbps, back once under STREAM_OFF_PCT of
+ * it, over windows of STREAM_WINDOW_S. */
+static void
+stream_update(void)
+{
+    static double t0;
+    static int64_t bytes0;
+    double now = mono_secs(), mbps;
+    int64_t bytes = 0;
+    int k, on;
+
+    for (k = 0; k < num_devs; ++k)
+        bytes += __atomic_load_n(&devs[k].bytes_done, __ATOMIC_RELAXED);
+    if (0 == t0)
+    {
+        t0 = now;
+        bytes0 = bytes;
+        return;
+    }
+    if (now - t0 < STREAM_WINDOW_S)
+        return;
+    mbps = (bytes - bytes0) / (now - t0) / 1e6;
+    t0 = now;
+    bytes0 = bytes;
+    on = __atomic_load_n(&check_stream, __ATOMIC_RELAXED);
+    if ((opt.stream_mbps <= 0) ||
+        (on ? mbps >= opt.stream_mbps * STREAM_OFF_PCT / 100
+            : mbps <= opt.stream_mbps))
+        return;
+    __atomic_store_n(&check_stream, !on, __ATOMIC_RELAXED);
+    if (verbose)
+        pr2serr("all devices at %.0f MB/s, %s checks\n", mbps,
+                on ? "back to the cached" : "streaming");
+}
+
+static pthread_t reporter_tid;
+static int reporter_stop;
+
+/* Prints every device's row, and the summary across them, and saves
+ * the --checkpoint each --refresh seconds. The I/O paths only publish cur_lba, so a slow
+ * terminal never holds up a READ. It also picks up --rate-file changes
+ * and, under a rate cap, prints the rates achieved. Under --drift it
+ * samples the MB/s and latency of each pass. */
+static void *
+reporter(void *arg)
+{
+    int64_t all_start_ticks = *(int64_t *)arg;
+    int64_t last_ticks = all_start_ticks;
+    double rate_t = mono_secs();
+    int k;
+
+    while (!__atomic_load_n(&reporter_stop, __ATOMIC_ACQUIRE))
+    {
+        struct timespec ts = {0, 100 * 1000 * 1000};
+
+        nanosleep(&ts, NULL);
+        stream_update();
+        if (__atomic_load_n(&hostco_on, __ATOMIC_RELAXED))
+            throttle_share(); /* runs come and go between refreshes */
+        for (k = 0; (opt.drift_pct > 0) && (k < num_devs); ++k)
+        {
+            pthread_mutex_lock(&devs[k].report_mutex);
+            drift_sample(devs + k);
+            pthread_mutex_unlock(&devs[k].report_mutex);
+        }
+        if (get_ticks(NULL) - last_ticks < opt.refresh * TICKS_PER_SEC)
+            continue;
+        last_ticks = get_ticks(NULL);
+        for (k = 0; k < num_devs; ++k)
+        {
+            t_dev *dp = devs + k;
+            t_stats *stats = &dp->stats;
+            unsigned int pass;
+
+            pthread_mutex_lock(&dp->report_mutex);
+            pass = __atomic_load_n(&dp->cur_pass, __ATOMIC_ACQUIRE);
+            if (pass)
+            {
+                stats->passwiping_ticks = last_ticks - dp->pass_start_ticks;
+                stats->wiping_ticks = dp->base_ticks + stats->passwiping_ticks;
+                print_stats(dp, pass, dp->cur_label, dev_progress(dp),
+                            opt.passes);
+                if (dp->clone)
+                    clone_report(dp->clone);
+            }
+            pthread_mutex_unlock(&dp->report_mutex);
+        }
+        if (num_devs > 1)
+            print_aggregate(all_start_ticks);
+        print_rates(mono_secs() - rate_t);
+        rate_t = mono_secs();
+        rate_file_load();
+        if (opt.ck_path)
+            checkpoint_write();
+    }
+    return NULL;
+}
+
+/* Whether s matches glob pat of --vendor, --model or --transport,
+ * ignoring case and the padding of INQUIRY strings; "!pat" inverts. */
+static bool
+filter_match(const char *pat, const char *s)
+{
+    bool invert;
+
+    if (NULL == pat)
+        return true;
+    invert = ('!' == pat[0]);
+    return (0 == fnmatch(pat + invert, s, FNM_CASEFOLD)) != invert;
+}
+
+/* Appends to device[0, devices) the disks of ents that --vendor,
+ * --model, --transport and --size let through, skipping those in use
+ * and those named already. Returns the new number of devices. */
+static int
+all_devices(const struct devscan_ent *ents, int num_ents, char **device,
+            int devices)
+{
+    int k, j, named = devices, excluded = 0;
+
+    for (k = 0; k < num_ents; ++k)
+    {
+        const struct devscan_ent *e = ents + k;
+        const char *why = NULL;
+
+        for (j = 0; j < named; ++j)
+            if (0 == strcmp(device[j], e->path))
+                break;
+        if (j < named)
+            continue;
+        if (e->in_use)
+            why = "holds a mounted filesystem or swap";
+        else if (!filter_match(opt.vendor_pat, e->vendor))
+            why = "vendor";
+        else if (!filter_match(opt.model_pat, e->model))
+            why = "model";
+        else if (!filter_match(opt.transport_pat, e->transport))
+            why = "transport";
+        else if (((opt.size_min > 0) || (opt.size_max > 0)) &&
+                 ((e->bytes < 0) || (e->bytes < opt.size_min) ||
+                  ((opt.size_max > 0) && (e->bytes > opt.size_max))))
+            why = "size";
+        if (why)
+        {
+            ++excluded;
+            if (verbose || e->in_use)
+                pr2serr("--all: skipping %s (%s %s, %s): %s\n", e->path,
+                        e->vendor, e->model, e->disk[0] ? e->disk : "-",
+                        why);
+            continue;
+        }
+        printf("--all: %s %s %s %s, %.1f GB%s%s\n", e->path, e->transport,
+               e->vendor, e->model, (e->bytes > 0) ? e->bytes / 1e9 : 0.0,
+               e->disk[0] ? ", " : "", e->disk);
+        device[devices] = (char *)malloc(strlen(e->path) + 1);
+        strcpy(device[devices++], e->path);
+    }
+    printf("--all: %d devices (%d excluded)\n", devices - named, excluded);
+    return devices;
+}
+
+/* --fan-out: the LUNs REPORT LUNS gives for the target of the n LUs of
+ * ents that have no disk node of theirs, reported as not read. */
+static void
+fanout_luns(const char *group, const struct devscan_ent *ents, int n)
+{
+    uint8_t resp[8 + 8 * 256];
+    uint64_t lun;
+    int fd, len, k, j, b;
+
+    fd = open(ents[0].path, O_RDONLY | O_NONBLOCK);
+    if (fd < 0)
+        return;
+    if (sg_ll_report_luns(fd, 0, resp, sizeof(resp), false, verbose))
+    {
+        dev_close(fd);
+        return;
+    }
+    dev_close(fd);
+    len = (int)sg_get_unaligned_be32(resp) + 8;
+    if (len > (int)sizeof(resp))
+        len = sizeof(resp);
+    for (k = 8; k + 8 <= len; k += 8)
+    {
+        /* as the kernel numbers them: each level of two bytes in turn */
+        for (lun = 0, b = 0; b < 8; b += 2)
+            lun |= (uint64_t)sg_get_unaligned_be16(resp + k + b) << (8 * b);
+        for (j = 0; (j < n) && (ents[j].lun != lun); ++j)
+            ;
+        if (j == n)
+            pr2serr("--fan-out: %s: LUN %" PRIu64 " has no disk node (not "
+                    "a disk, or not scanned by the kernel), not read\n",
+                    group, lun);
+    }
+}
+
+/* --fan-out: each of device[0, devices) that is an NVMe controller or
+ * one of its namespaces, or a LUN of a SCSI target, turned into all of
+ * them, but those holding a mounted filesystem or swap. The controllers
+ * and targets go in ctrls, with the index of each device's in
+ * fanout_ctrl. Returns the new number of devices. */
+static int
+fanout_devices(char ***devicep, int devices)
+{
+    char **device = *devicep, **out, group[32];
+    struct devscan_ent *ents;
+    int k, j, c, e, n, m = 0, cap = devices;
+
+    out = (char **)malloc(cap * sizeof(char *));
+    fanout_ctrl = (int *)malloc(cap * sizeof(int));
+    ctrls = (t_ctrl *)calloc(devices, sizeof(t_ctrl));
+    if ((NULL == out) || (NULL == fanout_ctrl) || (NULL == ctrls))
+    {
+        pr2serr("--fan-out: out of memory, reading the devices named\n");
+        free(out);
+        free(fanout_ctrl);
+        free(ctrls);
+        fanout_ctrl = NULL;
+        ctrls = NULL;
+        return devices;
+    }
+    for (k = 0; k < devices; ++k)
+    {
+        ents = NULL;
+        n = (sim_name(device[k]) || spdkdev_name(device[k]))
+                ? 0
+                : devscan_fanout(device[k], &ents, group, sizeof(group));
+        for (c = 0; (n > 0) && (c < num_ctrls); ++c)
+            if (0 == strcmp(ctrls[c].name, group))
+                break;
+        if ((n > 0) && (c == num_ctrls))
+        {
+            snprintf(ctrls[c].name, sizeof(ctrls[c].name), "%s", group);
+            ++num_ctrls;
+            if (strncmp(group, "nvme", 4))
+                fanout_luns(group, ents, n);
+        }
+        for (e = 0; e < ((n > 0) ? n : 1); ++e)
+        {
+            const char *path = (n > 0) ? ents[e].path : device[k];
+
+            for (j = 0; (j < m) && strcmp(out[j], path); ++j)
+                ;
+            if (j < m)
+                continue;
+            if ((n > 0) && ents[e].in_use && strcmp(path, device[k]))
+            {
+                pr2serr("--fan-out: skipping %s of %s: holds a mounted "
+                        "filesystem or swap\n", path, group);
+                continue;
+            }
+            if (m == cap)
+            {
+                char **o = (char **)realloc(out, 2 * cap * sizeof(char *));
+                int *f = (int *)realloc(fanout_ctrl, 2 * cap * sizeof(int));
+
+                if (o)
+                    out = o;
+                if (f)
+                    fanout_ctrl = f;
+                if ((NULL == o) || (NULL == f))
+                    break; /* out of memory: the LUNs so far */
+                cap *= 2;
+            }
+            if (n > 0)
+                printf("--fan-out: %s %s %u of %s, %.1f GB\n", path,
+                       strncmp(group, "nvme", 4) ? "LUN" : "namespace",
+                       (unsigned int)ents[e].lun, group,
+                       (ents[e].bytes > 0) ? ents[e].bytes / 1e9 : 0.0);
+            out[m] = strdup(path);
+            fanout_ctrl[m++] = (n > 0) ? c : -1;
+            if (n > 0)
+                ++ctrls[c].devices;
+        }
+        free(ents);
+        free(device[k]);
+    }
+    free(device);
+    *devicep = out;
+    return m;
+}
+
+/* --manifest-diff a,b: the extents that differ, no device read. Returns
+ * 0 when there are none, SG_LIB_CAT_MISCOMPARE when there are. */
+static int
+manifest_diff_main(char *arg)
+{
+    struct manifest_stats st;
+    char *b = strchr(arg, ',');
+
+    *b++ = '\0';
+    if (manifest_diff(arg, b, manifest_report, NULL, &st))
+    {
+        if (EINVAL == errno)
+            pr2serr("--manifest-diff: %s and %s are not manifests of the "
+                    "same blocks and extents\n", arg, b);
+        else
+            perror("--manifest-diff");
+        return SG_LIB_FILE_ERROR;
+    }
+    printf("%" PRId64 " extents of %" PRId64 " blocks in %s, %" PRId64
+           " of them in %s, %" PRId64 " differ\n", st.extents, st.extent, b,
+           st.checked, arg, st.differ);
+    return st.differ ? SG_LIB_CAT_MISCOMPARE : 0;
+}
+
+/* --trace-export f[,csv|chrome]: trace f to stdout, no device read. */
+static int
+trace_export_main(char *arg)
+{
+    struct trace_stats st;
+    char *fmt = strrchr(arg, ',');
+    int chrome = fmt && (0 == strcmp(fmt + 1, "chrome"));
+
+    if (fmt && (chrome || (0 == strcmp(fmt + 1, "csv"))))
+        *fmt = '\0';
+    if (trace_export(arg, chrome ? TRACE_CHROME : TRACE_CSV, stdout, &st))
+    {
+        if (EINVAL == errno)
+            pr2serr("--trace-export: %s is not a trace of this host's byte "
+                    "order\n", arg);
+        else
+            perror("--trace-export");
+        return SG_LIB_FILE_ERROR;
+    }
+    if (st.dropped)
+        pr2serr("%s: %" PRIu64 " commands, %" PRIu64 " were not recorded\n",
+                arg, st.records, st.dropped);
+    return 0;
+}
+
+/* --results-query id[,n]: the last n passes of drive id in the
+ * --results store, their MB/s, slowest zone, latency, errors and
+ * health, and the trend of the MB/s over them, no device read. A name
+ * with commas in it (sim:) is taken whole unless what follows the last
+ * is a number. */
+static int
+results_query_main(char *arg)
+{
+    struct results_rec *recs;
+    char *cp = strrchr(arg, ','), *endp, p50[16], p99[16], ts[32];
+    double mbps, first = 0, last = 0, sx = 0, sy = 0, sxy = 0, sxx = 0;
+    long n = RESULTS_QUERY_DEF;
+    int got, k, z, slow;
+    int64_t bad;
+    size_t e;
+    time_t t;
+    struct tm tm;
+
+    if (NULL == opt.results_path)
+    {
+        pr2serr("--results-query needs the store, --results f\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (cp && cp[1] && (n = strtol(cp + 1, &endp, 10), '\0' == *endp))
+    {
+        if (n < 1)
+        {
+            pr2serr("--results-query: id[,n], n at least 1\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        *cp = '\0';
+    }
+    else
+        n = RESULTS_QUERY_DEF;
+    recs = (struct results_rec *)calloc(n, sizeof(*recs));
+    if (NULL == recs)
+    {
+        pr2serr("--results-query: out of memory\n");
+        return SG_LIB_CAT_OTHER;
+    }
+    got = results_query(opt.results_path, arg, (int)n, recs);
+    if (got <= 0)
+    {
+        if (got < 0)
+            perror(opt.results_path);
+        else
+            pr2serr("%s: no passes of %s\n", opt.results_path, arg);
+        free(recs);
+        return SG_LIB_FILE_ERROR;
+    }
+    printf("%s: last %d passes in %s\n", arg, got, opt.results_path);
+    printf("ended               pass     MB/s  slowest zone      p50      "
+           "p99  bad blocks  temp  corr  unc  config\n");
+    for (k = 0; k < got; ++k)
+    {
+        const struct results_rec *r = recs + k;
+        double zmin = 0;
+
+        mbps = r->ns ? r->bytes * 1e3 / r->ns : 0.0;
+        for (z = 0, slow = -1; z < r->zones; ++z)
+            if (r->zone_ns[z] && (r->zone_bytes[z] > 0) &&
+                ((slow < 0) ||
+                 (r->zone_bytes[z] * 1e3 / r->zone_ns[z] < zmin)))
+            {
+                slow = z;
+                zmin = r->zone_bytes[z] * 1e3 / r->zone_ns[z];
+            }
+        for (e = 0, bad = 0; e < r->next; ++e)
+            if (BADMAP_BAD == r->ext[e].kind)
+                bad += r->ext[e].len;
+        t = (time_t)r->time;
+        strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+        printf("%s %5u %8.1f %8.1f (%2d) %8s %8s %11" PRId64, ts, r->pass,
+               mbps, zmin, slow, lat_str(lat_percentile(&r->lat, 50), p50,
+                                         sizeof(p50)),
+               lat_str(lat_percentile(&r->lat, 99), p99, sizeof(p99)), bad);
+        if (HEALTH_NONE == r->temp_max)
+            printf("     -");
+        else
+            printf(" %5d", r->temp_max);
+        printf((r->corrected < 0) ? "     -" : " %5" PRId64, r->corrected);
+        printf((r->uncorrected < 0) ? "    -" : " %4" PRId64, r->uncorrected);
+        printf("  %s\n", r->config);
+        if (0 == k)
+            first = mbps;
+        last = mbps;
+        sx += k;
+        sy += mbps;
+        sxy += k * mbps;
+        sxx += (double)k * k;
+    }
+    if (got > 1)
+        printf("trend: %.1f -> %.1f MB/s (%+.1f%%), %+.2f MB/s a pass by "
+               "least squares\n", first, last,
+               first > 0 ? (last - first) * 100 / first : 0.0,
+               (got * sxy - sx * sy) / (got * sxx - sx * sx));
+    results_free(recs, got);
+    free(recs);
+    return 0;
+}
+
+/* --job f: runs the plan, each job a process of this program of its
+ * own. Returns 0 when every job passed, else the exit status of the
+ * first that did not. */
+static int
+job_main(const char *path)
+{
+    char err[512];
+    struct job_plan *p = job_load(path, err, sizeof(err));
+    int res;
+
+    if (NULL == p)
+    {
+        pr2serr("--job: %s\n", err);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    res = job_run(p, "/proc/self/exe", verbose);
+    job_free(p);
+    return res;
+}
+
+/* The state a run leaves behind put back as it was before the first,
+ * for the next run of libdskread in the same process. */
+static void
+run_reset(void)
+{
+    static t_opt opt0;
+    static bool saved;
+
+    if (!saved)
+    {
+        opt0 = opt;
+        saved = true;
+        return;
+    }
+    opt = opt0;
+    memset(&iflag, 0, sizeof(iflag));
+    memset(&oflag, 0, sizeof(oflag));
+    memset(patterns, 0, sizeof(patterns));
+    num_patterns = 0;
+    verbose = 0;
+    weak_fp = heat_fp = bad_fp = bad_text_fp = diff_fp = NULL;
+    diff_shown = 0;
+    live = NULL;
+    memset(&tb_all_bytes, 0, sizeof(tb_all_bytes));
+    memset(&tb_all_reads, 0, sizeof(tb_all_reads));
+    __atomic_store_n(&throttle_on, 0, __ATOMIC_RELAXED);
+    free(hosts);
+    free(encls);
+    hosts = NULL;
+    encls = NULL;
+    num_hosts = num_encls = 0;
+    ckpts = NULL;
+    num_ckpts = 0;
+    reporter_tid = 0;
+    reporter_stop = 0;
+    run_cancel = 0;
+}
+
+#ifndef DSKREAD_LIB
+static struct outsink *out_sink, *err_sink; /* the console, and */
+static FILE *out_fp0, *err_fp0;             /* the streams they replace */
+
+/* Writes out what the console sinks hold and puts stdout and stderr back,
+ * then says what was dropped. At exit, whichever way the program ends. */
+static void
+output_stop(void)
+{
+    unsigned long n[2] = {0, 0};
+    size_t bytes[2] = {0, 0};
+
+    fflush(stdout);
+    fflush(stderr);
+    if (out_sink)
+    {
+        stdout = out_fp0;
+        n[0] = outsink_dropped(out_sink, bytes + 0);
+        outsink_close(out_sink);
+        out_sink = NULL;
+    }
+    if (err_sink)
+    {
+        stderr = err_fp0;
+        n[1] = outsink_dropped(err_sink, bytes + 1);
+        outsink_close(err_sink);
+        err_sink = NULL;
+    }
+    if (n[0] || n[1])
+        fprintf(stderr, "%s: output fell behind, %lu writes (%zu bytes) of "
+                "stdout and %lu (%zu) of stderr dropped\n", progname, n[0],
+                bytes[0], n[1], bytes[1]);
+}
+
+/* stdout and stderr through output sinks, so what prints never waits on
+ * the reader of the console: the table, whose redrawn progress lines
+ * may be dropped when the sink is full, and the messages, dropped only
+ * then and counted. */
+static void
+output_start(void)
+{
+    struct outsink *sink;
+    FILE *fp;
+    int k, fd;
+
+    fflush(stdout);
+    fflush(stderr);
+    for (k = 0; k < 2; ++k)
+    {
+        fd = dup(k ? STDERR_FILENO : STDOUT_FILENO);
+        sink = (fd < 0) ? NULL : outsink_open(fd, opt.output_buf,
+                                              k ? OUTSINK_DROP
+                                                : OUTSINK_COALESCE);
+        fp = sink ? outsink_stream(sink) : NULL;
+        if (NULL == fp)
+        {
+            outsink_close(sink);
+            if (fd >= 0 && !sink)
+                close(fd);
+            continue; /* this one stays as it was */
+        }
+        if (k)
+        {
+            err_sink = sink;
+            err_fp0 = stderr;
+            stderr = fp;
+        }
+        else
+        {
+            out_sink = sink;
+            out_fp0 = stdout;
+            stdout = fp;
+        }
+    }
+    atexit(output_stop);
+}
+#endif
+
+/* The program, and a run of libdskread on its thread. */
+static int
+dskread_main(int argc, char *argv[])
+{
+    run_reset();
+    progname = basename(argv[0]);
+
+    opterr = 0;
+    int option_index = 0;
+    optind = 1;
+    int ret = 0;
+
+    while (true)
+    {
+        int c = getopt_long(argc, argv, short_options, long_options, &option_index);
+
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+        case 'p':
+            add_pattern(optarg);
+            break;
+        case OPT_PATTERN_FILE:
+            if (add_pattern_file(optarg))
+                return SG_LIB_FILE_ERROR;
+            break;
+        case OPT_DIFF_DUMP:
+            opt.diff_path = optarg;
+            break;
+        case OPT_DIFF_SECTORS:
+            opt.diff_sectors = atoi(optarg);
+            break;
+        case OPT_FORCE_ISA: /* --force-isa l */
+            switch (cpu_force_isa(optarg))
+            {
+            case -1:
+                pr2serr("--force-isa: scalar, sse2, sse4.2, avx2, avx512, "
+                        "neon, armv8-crc or native\n");
+                return SG_LIB_SYNTAX_ERROR;
+            case 1:
+                pr2serr("--force-isa: this CPU has not all of %s, using "
+                        "%s\n", optarg, cpu_isa_name());
+                break;
+            }
+            break;
+        case OPT_PI: /* --pi[=app[:mask]] */
+            opt.pi = true;
+            if (optarg)
+            {
+                char *endp;
+
+                opt.pi_app = (uint16_t)strtoul(optarg, &endp, 0);
+                opt.pi_mask = (':' == *endp)
+                                  ? (uint16_t)strtoul(endp + 1, NULL, 0)
+                                  : 0xffff;
+            }
+            break;
+        case 'D': /* --dod DoD 5220.22-M: 0, 0xff, random */
+            add_pattern("0");
+            add_pattern("0xff");
+            add_pattern("r");
+            break;
+        case 'k':
+            opt.kilobyte = true;
+            break;
+        case 'q': /* -q | --qd n Queue n reads per device */
+            opt.qd = atoi(optarg);
+            if ((opt.qd < 1) || (opt.qd > MAX_QUEUE_DEPTH))
+                usage(1);
+            opt.qd_set = true;
+            break;
+        case 'R': /* --rings n io_uring lanes per device */
+            opt.rings = atoi(optarg);
+            if ((opt.rings < 1) || (opt.rings > MAX_RINGS))
+                usage(1);
+            break;
+        case 'Y': /* --device-verify VERIFY(16) BYTCHK=0 */
+            opt.dverify = true;
+            break;
+        case 'C': /* --device-compare VERIFY(16) BYTCHK=3 */
+            opt.dcompare = true;
+            break;
+        case 'c': /* --coe n continue on unreadable blocks */
+            oflag.coe = atoi(optarg);
+            if ((oflag.coe < 1) || (oflag.coe > 3))
+            {
+                pr2serr("--coe takes 1, 2 or 3\n");
+                usage(1);
+            }
+            break;
+        case 'W': /* --retry class=attempts[:backoff_ms] */
+            if (retry_policy_set(optarg))
+            {
+                pr2serr("--retry takes class=attempts[:ms], class one of ua, "
+                        "aborted, not-ready, medium, other\n");
+                usage(1);
+            }
+            break;
+        case 'd': /* --deadline ms */
+            opt.deadline_ms = atoi(optarg);
+            if (opt.deadline_ms <= 0)
+            {
+                pr2serr("--deadline takes ms\n");
+                usage(1);
+            }
+            break;
+        case 'Q': /* --deadline-resets n */
+            opt.deadline_resets = atoi(optarg);
+            if (opt.deadline_resets < 0)
+                usage(1);
+            break;
+        case 'r': /* --max-rate bytes/s[:iops] */
+            if (parse_rate(optarg, &opt.max_bps, &opt.max_iops))
+            {
+                pr2serr("--max-rate takes bytes/s[:READs/s]\n");
+                usage(1);
+            }
+            break;
+        case 't': /* --total-rate bytes/s[:iops] */
+            if (parse_rate(optarg, &opt.total_bps, &opt.total_iops))
+            {
+                pr2serr("--total-rate takes bytes/s[:READs/s]\n");
+                usage(1);
+            }
+            break;
+        case 'f': /* --rate-file f */
+            opt.rate_path = optarg;
+            break;
+        case 'o': /* --per-host n */
+            opt.per_host = atoi(optarg);
+            if (opt.per_host < 1)
+                usage(1);
+            break;
+        case 'x': /* --host-rate bytes/s[:iops] */
+            if (parse_rate(optarg, &opt.host_bps, &opt.host_iops))
+            {
+                pr2serr("--host-rate takes bytes/s[:READs/s]\n");
+                usage(1);
+            }
+            break;
+        case OPT_FAN_OUT:
+            opt.fan_out = true;
+            break;
+        case OPT_LOG_DIR:
+            opt.log_dir = optarg;
+            break;
+        case OPT_SYNC_OUTPUT:
+            opt.sync_output = true;
+            break;
+        case OPT_MEDIA_TYPE:
+        {
+            int k;
+
+            for (k = 0; k <= MTYPE_NVME; ++k)
+                if (0 == strcmp(optarg, media_policies[k].name))
+                    break;
+            if (0 == strcmp(optarg, "none"))
+                k = MTYPE_UNKNOWN;
+            else if (k > MTYPE_NVME)
+            {
+                pr2serr("--media-type takes hdd, smr, ssd, nvme or none\n");
+                usage(1);
+            }
+            opt.mtype = k;
+            break;
+        }
+        case OPT_COORDINATE:
+            opt.coordinate = true;
+            if (optarg && ('/' != optarg[0]))
+            {
+                pr2serr("--coordinate takes a shm name, /name\n");
+                usage(1);
+            }
+            opt.coord_name = optarg;
+            break;
+        case OPT_OUTPUT_BUF:
+        {
+            double v;
+            char *ep;
+
+            if (parse_bytes(optarg, &ep, &v) || *ep || (v < 4096) ||
+                (v > (double)(1ULL << 32)))
+            {
+                pr2serr("--output-buf takes 4k to 4G bytes\n");
+                usage(1);
+            }
+            opt.output_buf = (size_t)v;
+            break;
+        }
+        case OPT_TARGET_RATE:
+            if (parse_rate(optarg, &opt.target_bps, &opt.target_iops))
+            {
+                pr2serr("--target-rate takes bytes/s[:READs/s]\n");
+                usage(1);
+            }
+            break;
+        case OPT_ALL:
+            opt.all = true;
+            break;
+        case OPT_VENDOR:
+            opt.vendor_pat = optarg;
+            break;
+        case OPT_MODEL:
+            opt.model_pat = optarg;
+            break;
+        case OPT_TRANSPORT:
+            opt.transport_pat = optarg;
+            break;
+        case OPT_SIZE: /* --size min[:max] */
+        {
+            char *ep;
+
+            if (parse_bytes(optarg, &ep, &opt.size_min) ||
+                ((':' == *ep) &&
+                 (parse_bytes(ep + 1, &ep, &opt.size_max) ||
+                  (opt.size_max < opt.size_min))) ||
+                *ep)
+            {
+                pr2serr("--size takes min[:max] bytes\n");
+                usage(1);
+            }
+            break;
+        }
+        case OPT_PREFETCH:
+            opt.prefetch = true;
+            break;
+        case OPT_MLOCK:
+            iobuf_set_mlock(1);
+            break;
+        case OPT_SGL:
+            opt.sgl = true;
+            break;
+        case OPT_WRITE: /* --write[=pass|bytes] */
+            opt.write = WRITE_LAG;
+            oflag.write = 1;
+            if (optarg && (0 == strcmp(optarg, "pass")))
+                opt.write = WRITE_PASS;
+            else if (optarg && (0 == strncmp(optarg, "verify", 6)) &&
+                     (('\0' == optarg[6]) || (0 == strcmp(optarg + 6, ":0")) ||
+                      (0 == strcmp(optarg + 6, ":1"))))
+            {
+                opt.write = WRITE_WV;
+                opt.write_bytchk = (0 == strcmp(optarg + 6, ":1"));
+            }
+            else if (optarg)
+            {
+                double v;
+                char *endp;
+
+                if (parse_bytes(optarg, &endp, &v) || *endp || (v < 0))
+                {
+                    pr2serr("--write: pass or bytes, not '%s'\n", optarg);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                opt.write_lag = (int64_t)v;
+            }
+            break;
+        case OPT_YES:
+            opt.yes = true;
+            break;
+        case OPT_CLONE:
+            opt.clone_path = optarg;
+            break;
+        case OPT_CLONE_QD:
+            opt.clone_qd = atoi(optarg);
+            if ((opt.clone_qd < 1) || (opt.clone_qd > MAX_QUEUE_DEPTH))
+            {
+                pr2serr("--clone-qd: 1 to %d\n", MAX_QUEUE_DEPTH);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_CLONE_VERIFY:
+            opt.clone_verify = true;
+            break;
+        case OPT_CLONE_VIA:
+            if (0 == strcmp(optarg, "auto"))
+                opt.clone_via = CLONE_AUTO;
+            else if (0 == strcmp(optarg, "xcopy"))
+                opt.clone_via = CLONE_XCOPY;
+            else if (0 == strcmp(optarg, "share"))
+                opt.clone_via = CLONE_SHARE;
+            else if (0 == strcmp(optarg, "copy"))
+                opt.clone_via = CLONE_COPY;
+            else
+            {
+                pr2serr("--clone-via: auto, xcopy, share or copy, not '%s'\n",
+                        optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_COMPARE:
+            opt.compare_path = optarg;
+            break;
+        case OPT_CRC:
+            opt.crc = true;
+            break;
+        case OPT_STABLE:
+            opt.stable = true;
+            break;
+        case OPT_RUN_ID:
+            opt.run_id = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_SAMPLE: /* --sample x[:c] */
+        {
+            char *cp;
+
+            opt.sample = strtod(optarg, &cp);
+            if (':' == *cp)
+                opt.sample_conf = strtod(cp + 1, &cp);
+            if (*cp || !(opt.sample > 0) || !(opt.sample < 1) ||
+                !(opt.sample_conf > 0) || !(opt.sample_conf < 1))
+            {
+                pr2serr("--sample takes a fraction x, and a confidence c, "
+                        "both between 0 and 1\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        }
+        case OPT_TIME_LIMIT: /* --time-limit m */
+        {
+            char *cp;
+
+            opt.time_limit = strtod(optarg, &cp) * 60;
+            if (*cp || !(opt.time_limit > 0))
+            {
+                pr2serr("--time-limit takes minutes, above 0\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        }
+        case OPT_COARSE: /* --coarse m */
+            opt.coarse = strtoll(optarg, NULL, 0);
+            if (opt.coarse < 1)
+            {
+                pr2serr("--coarse takes a stride of 1 MiB or more\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_MAX_ERRORS: /* --max-errors n */
+            opt.max_errors = strtoll(optarg, NULL, 0);
+            if (opt.max_errors < 1)
+            {
+                pr2serr("--max-errors takes blocks, 1 or more\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_STRESS: /* --stress s */
+        {
+            char *cp;
+
+            opt.stress = strtod(optarg, &cp);
+            if (*cp || !(opt.stress > 0))
+            {
+                pr2serr("--stress takes seconds, above 0\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        }
+        case OPT_MIX: /* --mix p */
+            opt.stress_mix = atoi(optarg);
+            if ((opt.stress_mix < 0) || (opt.stress_mix > 100))
+            {
+                pr2serr("--mix takes a percent of WRITEs, 0 to 100\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            if (opt.stress_mix)
+                oflag.write = 1;
+            break;
+        case OPT_BS_SPLIT: /* --bs-split b/w[:b/w...] */
+            if (parse_bs_split(optarg, opt.bs_size, opt.bs_weight,
+                               &opt.bs_n))
+            {
+                pr2serr("--bs-split takes up to %d size/weight pairs, "
+                        "colon separated\n", STRESS_SIZES);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_IMAGE:
+            opt.image_path = optarg;
+            break;
+        case OPT_MANIFEST:
+            opt.manifest_path = optarg;
+            break;
+        case OPT_MANIFEST_CHECK:
+            opt.manifest_old = optarg;
+            break;
+        case OPT_MANIFEST_EXTENT:
+        {
+            double v;
+            char *endp;
+
+            if (parse_bytes(optarg, &endp, &v) || *endp || (v < 1))
+            {
+                pr2serr("--manifest-extent: bytes, not '%s'\n", optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            opt.manifest_extent = (int64_t)v;
+            break;
+        }
+        case OPT_JOB:
+            opt.job_path = optarg;
+            break;
+        case OPT_CONTROL:
+            opt.ctl_path = optarg;
+            break;
+        case OPT_AGENT:
+            opt.agent = optarg;
+            break;
+        case OPT_COORDINATOR:
+        {
+            char *ep;
+            long port = strtol(optarg, &ep, 10), n = 1;
+
+            if (':' == *ep)
+                n = strtol(ep + 1, &ep, 10);
+            if (*ep || (port < 1) || (port > 65535) || (n < 1) ||
+                (n > 65535))
+            {
+                pr2serr("--coordinator takes a port and the agents, "
+                        "p[:n]\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            opt.coord_port = (int)port;
+            opt.coord_agents = (int)n;
+            break;
+        }
+        case OPT_BASELINE:
+        {
+            char *cp = strrchr(optarg, ':');
+
+            opt.baseline_path = optarg;
+            if (cp)
+            {
+                char *ep;
+
+                opt.baseline_k = strtod(cp + 1, &ep);
+                if (*ep || (opt.baseline_k <= 0))
+                {
+                    pr2serr("--baseline takes a file and the sigmas, "
+                            "f[:k]\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                *cp = '\0';
+            }
+            break;
+        }
+        case OPT_POWER:
+        {
+            char *ep;
+
+            opt.power = strtod(optarg, &ep);
+            if (*ep || (opt.power <= 0))
+            {
+                pr2serr("--power takes the watts of the lab\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        }
+        case OPT_TRACE:
+            opt.trace_path = optarg;
+            break;
+        case OPT_DEFECTS:
+            opt.defects = true;
+            break;
+        case OPT_SAT:
+            opt.sat = true;
+            break;
+        case OPT_BENCH: /* --bench bytes */
+        {
+            double v;
+            char *endp;
+
+            if (parse_bytes(optarg, &endp, &v) || *endp || (v < 1))
+            {
+                pr2serr("--bench: bytes read per setting, not '%s'\n",
+                        optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            opt.bench = (int64_t)v;
+            break;
+        }
+        case OPT_SEEK_PROBE: /* --seek-probe p[:n] */
+        {
+            char *endp = strchr(optarg, ':');
+            size_t len = endp ? (size_t)(endp - optarg) : strlen(optarg);
+
+            if (endp)
+                opt.seek_cmds = atoi(endp + 1);
+            if ((6 == len) && (0 == strncmp(optarg, "random", len)))
+                opt.seek = SEEK_RANDOM;
+            else if ((5 == len) && (0 == strncmp(optarg, "sweep", len)))
+                opt.seek = SEEK_SWEEP;
+            else if (0 == strncmp(optarg, "stride=", 7))
+            {
+                opt.seek = SEEK_STRIDE;
+                opt.seek_stride = strtoll(optarg + 7, &endp, 0);
+                if ((endp == optarg + 7) || (*endp && (':' != *endp)) ||
+                    (opt.seek_stride < 0))
+                    opt.seek = 0;
+            }
+            if (!opt.seek || (opt.seek_cmds < 1))
+            {
+                pr2serr("--seek-probe: random, stride=b or sweep, then :n "
+                        "commands, not '%s'\n", optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        }
+        case OPT_CACHE_PROBE:
+            opt.cache_probe = true;
+            break;
+        case OPT_BURST:
+            opt.burst = atoi(optarg);
+            if (opt.burst < 1)
+                usage(1);
+            break;
+        case OPT_COST:
+            opt.cost = true;
+            break;
+        case OPT_MULTIPATH:
+            if (0 == strcmp(optarg, "off"))
+                opt.multipath = MPATH_OFF;
+            else if (0 == strcmp(optarg, "lq"))
+                opt.multipath = MPATH_LQ;
+            else if (0 == strcmp(optarg, "rr"))
+                opt.multipath = MPATH_RR;
+            else
+            {
+                pr2serr("--multipath: lq, rr or off, not '%s'\n", optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_SG_FDS:
+            if (0 == strcmp(optarg, "auto"))
+                opt.sg_fds = -1;
+            else
+            {
+                opt.sg_fds = sg_get_num(optarg);
+                if ((opt.sg_fds < 1) || (opt.sg_fds > MAX_PATHS))
+                {
+                    pr2serr("--sg-fds: 1 to %d or auto, not '%s'\n",
+                            MAX_PATHS, optarg);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+            break;
+        case OPT_IDLE: /* --idle pct[:ms] */
+        {
+            char *endp;
+
+            opt.idle_pct = strtod(optarg, &endp);
+            if (':' == *endp)
+                opt.idle_ms = (int)strtol(endp + 1, &endp, 10);
+            if (*endp || (opt.idle_pct <= 0) || (opt.idle_pct > 100) ||
+                (opt.idle_ms < 1))
+            {
+                pr2serr("--idle: pct (0 to 100] and ms, not '%s'\n", optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        }
+        case OPT_SCRUB:
+            opt.scrub = true;
+            break;
+        case OPT_DIRTY: /* --dirty f[:s] */
+        {
+            char *cp = strrchr(optarg, ':'), *endp;
+            long s;
+
+            opt.dirty_path = optarg;
+            if (cp && cp[1])
+            {
+                s = strtol(cp + 1, &endp, 10);
+                if ('\0' == *endp)
+                {
+                    if (s < 0)
+                        usage(1);
+                    opt.dirty_settle_s = (int)s;
+                    *cp = '\0';
+                }
+            }
+            break;
+        }
+        case OPT_ALLOCATED:
+            opt.allocated = true;
+            break;
+        case OPT_ARRAY:
+            opt.array = true;
+            break;
+        case OPT_PIPELINE: /* --pipeline[=bytes] */
+            opt.pipe = true;
+            if (optarg)
+            {
+                double v;
+                char *endp;
+
+                if (parse_bytes(optarg, &endp, &v) || *endp || (v < 0))
+                {
+                    pr2serr("--pipeline: bytes, not '%s'\n", optarg);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                opt.pipe_dist = (int64_t)v;
+            }
+            break;
+        case OPT_RESULTS:
+            opt.results_path = optarg;
+            break;
+        case OPT_RESULTS_QUERY:
+            opt.results_query = optarg;
+            break;
+        case OPT_PLAN:
+            opt.plan = true;
+            break;
+        case OPT_REC_ZONES:
+            opt.rec_zones = true;
+            opt.rz_table = optarg;
+            break;
+        case OPT_DRIFT: /* --drift[=p] */
+        {
+            char *endp;
+
+            opt.drift_pct = optarg ? strtod(optarg, &endp) : DEF_DRIFT_PCT;
+            if ((optarg && *endp) || !(opt.drift_pct > 0))
+            {
+                pr2serr("--drift: a step in percent over 0, not '%s'\n",
+                        optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        }
+        case OPT_CDL: /* --cdl i[:ms] */
+        {
+            char *endp;
+
+            opt.cdl = (int)strtol(optarg, &endp, 10);
+            if (':' == *endp)
+                opt.cdl_ms = (int)strtol(endp + 1, &endp, 10);
+            if (*endp || (opt.cdl < 1) || (opt.cdl > CDL_MAX) ||
+                (opt.cdl_ms < 0) || (opt.cdl_ms > CDL_MAX_MS))
+            {
+                pr2serr("--cdl: descriptor 1 to %d and ms, not '%s'\n",
+                        CDL_MAX, optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        }
+        case OPT_RANGES: /* --ranges f */
+            opt.ranges_path = optarg;
+            break;
+        case OPT_RETEST_GAP:
+            opt.retest_gap = sg_get_llnum(optarg);
+            if (opt.retest_gap < 0)
+            {
+                pr2serr("--retest-gap: blocks, not '%s'\n", optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_ELEMENTS:
+            if (0 == strcmp(optarg, "flag"))
+                opt.elements = ELEM_FLAG;
+            else if (0 == strcmp(optarg, "skip"))
+                opt.elements = ELEM_SKIP;
+            else
+            {
+                pr2serr("--elements: flag or skip, not '%s'\n", optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_ACTUATORS:
+            if (0 == strcmp(optarg, "auto"))
+                opt.actuators = true;
+            else if (0 == strcmp(optarg, "off"))
+                opt.actuators = false;
+            else
+            {
+                pr2serr("--actuators: auto or off, not '%s'\n", optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_STREAM: /* --stream mbps[,dist] */
+        {
+            double v = 0;
+            char *endp;
+
+            opt.stream_mbps = strtod(optarg, &endp);
+            if ((endp == optarg) || (opt.stream_mbps < 0) ||
+                ((',' == *endp) && (parse_bytes(endp + 1, &endp, &v) ||
+                                    (v < 64) || (v > 1024 * 1024))) ||
+                *endp)
+            {
+                pr2serr("--stream: MB/s[,prefetch distance], not '%s'\n",
+                        optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            stream_prefetch_set((size_t)v);
+            break;
+        }
+        case OPT_HEALTH:
+            opt.health_s = atoi(optarg);
+            if ((opt.health_s < 1) || (opt.health_s > MAX_HEALTH_S))
+            {
+                pr2serr("--health takes 1 to %d seconds\n", MAX_HEALTH_S);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_TRACE_EXPORT:
+        {
+            char *fmt = strrchr(optarg, ',');
+
+            if (fmt && strcmp(fmt + 1, "chrome") && strcmp(fmt + 1, "csv"))
+            {
+                pr2serr("--trace-export: f, f,csv or f,chrome\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            opt.trace_export = optarg;
+            break;
+        }
+        case OPT_MANIFEST_DIFF:
+            if (NULL == strchr(optarg, ','))
+            {
+                pr2serr("--manifest-diff: two manifests, a,b\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            opt.manifest_diff = optarg;
+            break;
+        case OPT_IMAGE_RLE:
+            opt.image_rle = true;
+            break;
+        case OPT_IMAGE_ZSTD: /* --image-zstd[=l[:t]] */
+            opt.image_level = 3;
+            opt.image_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            if (optarg)
+            {
+                char *cp = strchr(optarg, ':');
+
+                opt.image_level = atoi(optarg);
+                if (cp)
+                    opt.image_threads = atoi(cp + 1);
+            }
+            if ((opt.image_level < 1) || (opt.image_level > 22) ||
+                (opt.image_threads < 0))
+            {
+                pr2serr("--image-zstd: level 1 to 22, threads 0 or more\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_STREAMS: /* --streams[=n] */
+            opt.streams = optarg ? atoi(optarg) : 1;
+            if ((opt.streams < 1) || (opt.streams > MAX_STREAMS))
+            {
+                pr2serr("--streams: 1 to %d regions\n", MAX_STREAMS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_FLUSH: /* --flush end|fua|bytes */
+            if (0 == strcmp(optarg, "end"))
+                opt.flush = FLUSH_END;
+            else if (0 == strcmp(optarg, "fua"))
+                opt.flush = FLUSH_FUA;
+            else
+            {
+                double v;
+                char *endp;
+
+                if (parse_bytes(optarg, &endp, &v) || *endp || (v < 1))
+                {
+                    pr2serr("--flush: end, fua or bytes, not '%s'\n", optarg);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                opt.flush = FLUSH_EVERY;
+                opt.flush_every = (int64_t)v;
+            }
+            break;
+        case OPT_ERASE: /* --erase unmap|sanitize[:block|crypto|overwrite] */
+            oflag.write = 1; /* UNMAP and SANITIZE need O_RDWR */
+            if (0 == strcmp(optarg, "unmap"))
+                opt.erase = ERASE_UNMAP;
+            else if ((0 == strcmp(optarg, "sanitize")) ||
+                     (0 == strcmp(optarg, "sanitize:block")))
+                opt.erase = ERASE_BLOCK;
+            else if (0 == strcmp(optarg, "sanitize:crypto"))
+                opt.erase = ERASE_CRYPTO;
+            else if (0 == strcmp(optarg, "sanitize:overwrite"))
+                opt.erase = ERASE_OVERWRITE;
+            else
+            {
+                pr2serr("--erase: unmap or sanitize[:block|crypto|overwrite], "
+                        "not '%s'\n", optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_OFFLOAD: /* --offload selftest|bms */
+            if (0 == strcmp(optarg, "selftest"))
+                opt.offload = OFFLOAD_SELFTEST;
+            else if (0 == strcmp(optarg, "bms"))
+                opt.offload = OFFLOAD_BMS;
+            else
+            {
+                pr2serr("--offload: selftest or bms, not '%s'\n", optarg);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case OPT_POLL: /* --poll[=us] */
+            opt.poll_us = optarg ? sg_get_num(optarg) : DEF_POLL_US;
+            if ((opt.poll_us < 1) || (opt.poll_us > 1000000))
+            {
+                pr2serr("--poll: spin budget 1 to 1000000 us\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            opt.uring_setup |= IORING_SETUP_IOPOLL;
+            break;
+        case OPT_DIO: /* --dio, in locked page aligned buffers */
+            oflag.dio = 1;
+            iobuf_set_mlock(1);
+            break;
+        case OPT_MEDIA: /* --media[=dra|rcd] */
+            if (NULL == optarg)
+                opt.media = MEDIA_FUA;
+            else if (0 == strcmp(optarg, "dra"))
+                opt.media = MEDIA_DRA;
+            else if (0 == strcmp(optarg, "rcd"))
+                opt.media = MEDIA_RCD;
+            else
+            {
+                pr2serr("--media takes dra or rcd\n");
+                usage(1);
+            }
+            break;
+        case 'l': /* --probe-jobs n */
+            opt.probe_jobs = atoi(optarg);
+            if (opt.probe_jobs < 1)
+                usage(1);
+            break;
+        case 'y': /* --spin-up n[:ms] */
+            if ((sscanf(optarg, "%d:%d", &opt.spin_up, &opt.spin_gap_ms) < 1) ||
+                (opt.spin_up < 1) || (opt.spin_gap_ms < 0))
+                usage(1);
+            break;
+        case 'j': /* --event-threads n */
+            opt.event_threads = atoi(optarg);
+            if ((opt.event_threads < 1) ||
+                (opt.event_threads > MAX_EVENT_THREADS))
+                usage(1);
+            break;
+        case 'A': /* --adaptive-qd t p99 target in ms */
+        {
+            char *ep;
+            double ms = strtod(optarg, &ep);
+
+            if ((ms <= 0) || *ep)
+                usage(1);
+            opt.qd_target_ns = (uint64_t)(ms * 1e6);
+            break;
+        }
+        case 'g': /* --background */
+            opt.background = true;
+            break;
+        case 'a': /* --triage coarse, then fine over the failures */
+            opt.triage = true;
+            break;
+        case 'w': /* --slow ms | Nx */
+        {
+            char *cp;
+            double v = strtod(optarg, &cp);
+
+            if ((v <= 0) || (*cp && strcmp(cp, "x")))
+            {
+                pr2serr("--slow takes ms, or a multiple of the median as Nx\n");
+                usage(1);
+            }
+            if (*cp)
+                opt.slow_mult = v;
+            else
+                opt.slow_ms = v;
+            break;
+        }
+        case 'E': /* --metrics-port n */
+            opt.metrics_port = atoi(optarg);
+            if ((opt.metrics_port <= 0) || (opt.metrics_port > 65535))
+            {
+                pr2serr("--metrics-port takes a TCP port\n");
+                usage(1);
+            }
+            break;
+        case 'G': /* --metrics-file f */
+            opt.metrics_path = optarg;
+            break;
+        case 'X': /* --live-stats name */
+            opt.live_path = optarg;
+            break;
+        case 'J': /* --json f */
+            opt.json_path = optarg;
+            break;
+        case 'b': /* --bad-map f */
+            opt.bad_path = optarg;
+            break;
+        case 'B': /* --bad-map-text f */
+            opt.bad_text_path = optarg;
+            break;
+        case 'K': /* --checkpoint f */
+            opt.ck_path = optarg;
+            break;
+        case 'U': /* --resume from the checkpoint */
+            opt.resume = true;
+            break;
+        case 'u': /* --retest f */
+            opt.retest_path = optarg;
+            break;
+        case 'H': /* --heatmap f */
+            opt.heat_path = optarg;
+            break;
+        case 'O': /* --weak-report f */
+            opt.weak_path = optarg;
+            break;
+        case 'Z': /* --zones stop at the write pointers */
+            opt.zones = true;
+            break;
+        case 'L': /* --lba-status mapped|dealloc */
+            if (0 == strcmp(optarg, "mapped"))
+                opt.lba_status = LBA_STATUS_MAPPED;
+            else if (0 == strcmp(optarg, "dealloc"))
+                opt.lba_status = LBA_STATUS_DEALLOC;
+            else
+            {
+                pr2serr("--lba-status takes mapped or dealloc\n");
+                usage(1);
+            }
+            break;
+        case 'F': /* --profiles f Tuning profile cache */
+            opt.profile_path = optarg;
+            break;
+        case 'T': /* --tune calibrate -n and --qd per device */
+            opt.tune = true;
+            break;
+        case 'P': /* --sqpoll */
+            opt.uring_setup |= IORING_SETUP_SQPOLL;
+            break;
+        case 'I': /* --iopoll */
+            opt.uring_setup |= IORING_SETUP_IOPOLL;
+            break;
+        case 'N': /* --nvme Native NVMe reads on nvmeXnY */
+            oflag.nvme = 1;
+            break;
+        case 'm': /* --mmap Check data in the mmap-ed sg reserved buffer */
+            oflag.mmap = 1;
+            break;
+        case 'M': /* --mrq n Submit n reads per sg v4 mrq syscall */
+            opt.mrq = atoi(optarg);
+            if ((opt.mrq < 2) || (opt.mrq > MAX_MRQ_REQS))
+                usage(1);
+            break;
+        case 'S': /* --seed n Seed of the random pattern passes */
+            opt.seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'V':
+            verbose = atoi(optarg);
+            break;
+        case 'n': /* -n | --sectors n Write n sectors at once (default is %d) */
+            opt.sectors = atoi(optarg);
+            if (opt.sectors == 0)
+                usage(1);
+            if (opt.sectors >= 0x100000)
+                usage(1);
+            opt.sectors_set = true;
+            break;
+        case 's': // -s | --start   n Start at sector n (default is first sector)
+            opt.start = strtoull(optarg, (char **)NULL, 10);
+            if (opt.start == (int64_t)-1)
+                usage(1);
+            break;
+        case 'e': // -e | --end     n End at sector n (default is last sector)
+            opt.end = strtoull(optarg, (char **)NULL, 10);
+            if (opt.end == 0)
+                usage(1);
+            break;
+        case 'v': /* -v | --version   Show version and copyright information and quit */
+            version();
+            exit(0);
+            break;
+        case '?': /* -? | --help      Show this help message and quit */
+            ++opt.help;
+            break;
+        default:
+            usage(1);
+        }
+    }
+
+    if (opt.help)
+    {
+        _usage();
+        if (opt.help > 1)
+        {
+            // examples();
+        }
+        exit(0);
+    }
+
+    if (opt.manifest_diff)
+        return manifest_diff_main(opt.manifest_diff);
+    if (opt.trace_export)
+        return trace_export_main(opt.trace_export);
+    if (opt.results_query)
+        return results_query_main(opt.results_query);
+    if ((opt.agent && (opt.job_path || opt.coord_port)) ||
+        (opt.coord_port && !opt.job_path) ||
+        (opt.power && !opt.coord_port))
+    {
+        pr2serr("--coordinator serves a --job plan, --agent takes it from "
+                "one, --power is the coordinator's\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.agent || opt.coord_port)
+    {
+        int res = opt.agent ? agent_run(opt.agent, "/proc/self/exe", verbose)
+                            : coord_run(opt.coord_port, opt.coord_agents,
+                                        opt.job_path, opt.total_bps, opt.power,
+                                        opt.refresh, verbose);
+
+        return (res < 0) ? SG_LIB_FILE_ERROR : res;
+    }
+    if (opt.job_path)
+        return job_main(opt.job_path);
+
+    int devices = 0;
+    int i = 0;
+    for (i = optind; i < argc; ++i)
+    {
+        if ((argv[i][0] == '/' && argv[i][1] == 'd' && argv[i][2] == 'e' && argv[i][3] == 'v' && argv[i][4] == '/') ||
+            sim_name(argv[i]) || spdkdev_name(argv[i]) || file_arg(argv[i]))
+        {
+            ++devices;
+            continue;
+        }
+    }
+
+    struct devscan_ent *ents = NULL;
+    int num_ents = 0;
+
+    if (opt.all)
+    {
+        num_ents = devscan_all(&ents);
+        if (num_ents < 0)
+        {
+            pr2serr("--all: sysfs is not mounted, name the devices\n");
+            return SG_LIB_FILE_ERROR;
+        }
+        devices += num_ents;
+    }
+    if (devices == 0)
+    {
+        pr2serr("%s: No devices specified\n", progname);
+        usage(1);
+    }
+
+    char **device = (char **)malloc(sizeof(char *) * devices);
+    devices = 0;
+    for (i = optind; i < argc; ++i)
+    {
+        if ((argv[i][0] == '/' &&
+             argv[i][1] == 'd' &&
+             argv[i][2] == 'e' &&
+             argv[i][3] == 'v' &&
+             argv[i][4] == '/') ||
+            sim_name(argv[i]) || spdkdev_name(argv[i]) || file_arg(argv[i]))
+        {
+            device[devices] = (char *)malloc((strlen(argv[i]) + 6) * sizeof(char));
+            strcpy(device[devices++], argv[i]);
+            continue;
+        }
+        add_pattern(argv[i]);
+    }
+    if (opt.all)
+    {
+        devices = all_devices(ents, num_ents, device, devices);
+        free(ents);
+        if (devices == 0)
+        {
+            pr2serr("%s: No devices specified or found\n", progname);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (opt.fan_out)
+        devices = fanout_devices(&device, devices);
+    if ((LBA_STATUS_DEALLOC == opt.lba_status) && num_patterns)
+    {
+        pr2serr("--lba-status dealloc checks for zeros, ignoring the patterns\n");
+        num_patterns = 0;
+    }
+    if ((0 == num_patterns) && opt.scrub)
+        add_pattern("any"); /* a disk in use, not one a pattern was written to */
+    if ((0 == num_patterns) && (ERASE_CRYPTO == opt.erase))
+        add_pattern("any"); /* the new key reads as noise */
+    if (0 == num_patterns)
+        add_pattern("0");
+    if (NULL == opt.profile_path)
+    {
+        static char path[PATH_MAX];
+        const char *home = getenv("HOME");
+
+        snprintf(path, sizeof(path), "%s/" DEF_PROFILE_FILE,
+                 home ? home : ".");
+        opt.profile_path = path;
+    }
+    opt.passes = num_patterns;
+    for (i = 0; i < num_patterns; ++i)
+    {
+        patterns[i].pass = i + 1;
+        patterns[i].run = opt.run_id;
+        if (patterns[i].flag)
+            patterns[i].key = rand_pattern_key(opt.seed, i + 1);
+    }
+
+    if (opt.json_path && jsonl_open(opt.json_path))
+    {
+        perror(opt.json_path);
+        return SG_LIB_FILE_ERROR;
+    }
+    if (opt.json_path && (0 == strcmp(opt.json_path, "-")))
+    {
+        fflush(stdout);
+        dup2(STDERR_FILENO, STDOUT_FILENO); /* the table goes to stderr */
+    }
+#ifndef DSKREAD_LIB
+    if (!opt.sync_output)
+        output_start();
+#endif
+    version();
+    if (opt.heat_path)
+    {
+        heat_fp = fopen(opt.heat_path, "w");
+        if (NULL == heat_fp)
+        {
+            perror(opt.heat_path);
+            return SG_LIB_FILE_ERROR;
+        }
+        fprintf(heat_fp, "device,pass,lba,lbas,commands,min_us,avg_us,max_us,"
+                         "mbps%s\n", opt.health_s ? ",temp_c" : "");
+    }
+    if (opt.weak_path)
+    {
+        weak_fp = fopen(opt.weak_path, "a");
+        if (NULL == weak_fp)
+        {
+            perror(opt.weak_path);
+            return SG_LIB_FILE_ERROR;
+        }
+    }
+    if (opt.write && !opt.yes)
+    {
+        pr2serr("--write overwrites every block it reads, add --yes to go "
+                "ahead\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.streams && ((WRITE_LAG != opt.write) && (WRITE_PASS != opt.write)))
+    {
+        pr2serr("--streams places the WRITEs of --write[=pass|bytes]\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.pipe && ((WRITE_LAG != opt.write) && (WRITE_WV != opt.write)))
+    {
+        pr2serr("--pipeline overlaps the passes of --write[=bytes] or "
+                "--write=verify\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.pipe && opt.streams)
+    {
+        pr2serr("--pipeline and --streams: a stream is opened per pass\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.clone_path && (!opt.yes || opt.write || opt.erase ||
+                           (1 != devices)))
+    {
+        pr2serr("--clone %s\n", (1 != devices) ? "copies one source device"
+                                : (opt.write || opt.erase)
+                                    ? "does not go with --write or --erase"
+                                    : "overwrites the destination, add --yes");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.compare_path && (opt.clone_path || opt.write || opt.erase ||
+                             (1 != devices)))
+    {
+        pr2serr("--compare %s\n", (1 != devices)
+                                      ? "reads one device against the other side"
+                                      : "does not go with --clone, --write or "
+                                        "--erase");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((opt.clone_qd && !opt.clone_path && !opt.compare_path) ||
+        ((opt.clone_verify || (CLONE_AUTO != opt.clone_via)) &&
+         !opt.clone_path))
+    {
+        pr2serr("--clone-qd needs --clone or --compare, --clone-verify and "
+                "--clone-via need --clone\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.image_path && (opt.clone_path || opt.compare_path || opt.write ||
+                           opt.erase || (1 != devices)))
+    {
+        pr2serr("--image %s\n", (1 != devices)
+                                    ? "captures one device"
+                                    : "does not go with --clone, --compare, "
+                                      "--write or --erase");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.crc && (opt.dverify || opt.clone_path || opt.compare_path ||
+                    opt.image_path || opt.erase || (WRITE_WV == opt.write)))
+    {
+        pr2serr("--crc is of the data a pass reads, there is none with "
+                "--dverify, --write=verify, --clone, --compare, --image or "
+                "--erase\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((opt.manifest_path || opt.manifest_old) &&
+        (opt.clone_path || opt.compare_path || opt.write || opt.erase ||
+         opt.crc || (1 != devices)))
+    {
+        pr2serr("--manifest and --manifest-check %s\n",
+                (1 != devices) ? "hash one device"
+                               : "do not go with --clone, --compare, --write, "
+                                 "--erase or --crc");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.stable && ((opt.passes < 2) || opt.write || opt.dverify ||
+                       opt.erase || opt.clone_path || opt.compare_path ||
+                       clone_capture()))
+    {
+        pr2serr("--stable compares the data of two passes or more that "
+                "only read it: no --write, --dverify, --erase, --clone, "
+                "--compare, --image or --manifest\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.retest_path && opt.ranges_path)
+    {
+        pr2serr("--retest or --ranges, not both\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.allocated &&
+        (opt.write || opt.erase || opt.retest_path || opt.ranges_path ||
+         opt.zones || opt.lba_status || (opt.sample > 0) ||
+         (opt.stress > 0) || opt.offload || opt.bench ||
+         (opt.time_limit > 0) || opt.coarse))
+    {
+        pr2serr("--allocated picks what is read from the partitions and "
+                "filesystems: no --write, --erase, --retest, --ranges, "
+                "--zones, --lba-status, --sample, --stress, --offload, "
+                "--bench, --time-limit or --coarse\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((opt.sample > 0) && (opt.retest_path || opt.ranges_path ||
+                             opt.erase || opt.zones || opt.lba_status))
+    {
+        pr2serr("--sample picks what is read: no --retest, --ranges, "
+                "--erase, --zones or --lba-status\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (!(opt.stress > 0) && (opt.stress_mix || opt.bs_n))
+    {
+        pr2serr("--mix and --bs-split shape the commands of --stress\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((opt.stress > 0) &&
+        (opt.write || opt.clone_path || opt.compare_path || clone_capture() ||
+         (opt.sample > 0) || opt.retest_path || opt.ranges_path ||
+         opt.erase || opt.zones || opt.lba_status || (opt.time_limit > 0) ||
+         opt.coarse || opt.resume || opt.ck_path || opt.pi || opt.dverify ||
+         opt.dcompare || opt.triage || opt.stable || opt.crc || oflag.mmap ||
+         opt.sgl))
+    {
+        pr2serr("--stress is a pass of its own: no --write, --clone, "
+                "--compare, --image, --manifest, --sample, --retest, "
+                "--ranges, --erase, "
+                "--zones, --lba-status, --time-limit, --coarse, --resume, "
+                "--checkpoint, --pi, --dverify, --device-compare, --triage, "
+                "--stable, --crc, --mmap or --sgl\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.plan && (opt.write || opt.erase || (opt.stress > 0) ||
+                     opt.bench || opt.offload || opt.clone_path ||
+                     opt.compare_path || clone_capture()))
+    {
+        pr2serr("--plan schedules passes that read: no --write, --erase, "
+                "--stress, --bench, --offload, --clone, --compare, --image "
+                "or --manifest\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.sat && !opt.dverify)
+    {
+        pr2serr("--sat is how --device-verify reaches SATA drives, add "
+                "--device-verify\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.offload &&
+        (opt.write || opt.clone_path || opt.compare_path || clone_capture() ||
+         (opt.stress > 0) || (opt.sample > 0) || opt.retest_path ||
+         opt.ranges_path || opt.erase || opt.zones || opt.lba_status ||
+         opt.resume || opt.triage || opt.stable || opt.crc))
+    {
+        pr2serr("--offload has the drives scan themselves: no --write, "
+                "--clone, --compare, --image, --manifest, --stress, "
+                "--sample, --retest, --ranges, --erase, --zones, "
+                "--lba-status, --resume, --triage, --stable or --crc\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.bench &&
+        (opt.write || opt.clone_path || opt.compare_path || clone_capture() ||
+         (opt.stress > 0) || opt.offload || (opt.sample > 0) ||
+         opt.retest_path || opt.ranges_path || opt.erase || opt.zones ||
+         opt.lba_status || opt.resume || opt.ck_path || opt.tune ||
+         opt.triage || oflag.mmap))
+    {
+        pr2serr("--bench times reads of its own: no --write, --clone, "
+                "--compare, --image, --manifest, --stress, --offload, "
+                "--sample, --retest, --ranges, --erase, --zones, "
+                "--lba-status, --resume, --checkpoint, --tune, --triage or "
+                "--mmap\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((opt.seek || opt.cache_probe) &&
+        (opt.write || opt.clone_path || opt.compare_path || clone_capture() ||
+         (opt.stress > 0) || opt.offload || (opt.sample > 0) ||
+         opt.retest_path || opt.ranges_path || opt.erase || opt.zones ||
+         opt.lba_status || opt.resume || opt.ck_path || opt.tune ||
+         opt.triage || opt.bench || (opt.seek && opt.cache_probe)))
+    {
+        pr2serr("--seek-probe and --cache-probe time commands of their own, "
+                "one at a time: no --write, --clone, --compare, --image, "
+                "--manifest, --stress, --offload, --sample, --retest, "
+                "--ranges, --erase, --zones, --lba-status, --resume, "
+                "--checkpoint, --tune, --triage, --bench or each other\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.stress_mix && !opt.yes)
+    {
+        pr2serr("--mix overwrites the blocks it picks, add --yes to go "
+                "ahead\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (((opt.time_limit > 0) || opt.coarse) &&
+        (opt.write || opt.clone_path || opt.compare_path || clone_capture() ||
+         (opt.sample > 0) || opt.retest_path || opt.ranges_path ||
+         opt.erase || opt.zones || opt.lba_status || opt.resume ||
+         opt.ck_path))
+    {
+        pr2serr("--time-limit and --coarse order a pass that only reads: no "
+                "--write, --clone, --compare, --image, --manifest, --sample, "
+                "--retest, --ranges, --erase, --zones, --lba-status, "
+                "--resume or --checkpoint\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.pi && (opt.write || opt.dverify || opt.dcompare || opt.erase ||
+                   opt.clone_path || opt.compare_path || clone_capture() ||
+                   oflag.mmap || opt.sgl || (oflag.coe > 1)))
+    {
+        pr2serr("--pi checks what a pass reads into buffers of its own: no "
+                "--write, --dverify, --device-compare, --erase, --clone, "
+                "--compare, --image, --manifest, --mmap, --sgl or --coe "
+                "above 1\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.diff_sectors < 0)
+    {
+        pr2serr("--diff-sectors is 0 or more\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.manifest_extent && !opt.manifest_path)
+    {
+        pr2serr("--manifest-extent is of the --manifest written\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((opt.image_rle || opt.image_level) && !opt.image_path)
+    {
+        pr2serr("--image-rle and --image-zstd need --image\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((opt.clone_path || opt.compare_path || clone_capture()) &&
+        (opt.passes > 1))
+    {
+        pr2serr("%s once, ignoring the other %u patterns\n",
+                opt.image_path     ? "--image captures"
+                : clone_capture()  ? "--manifest hashes"
+                : opt.compare_path ? "--compare compares"
+                                   : "--clone copies",
+                opt.passes - 1);
+        opt.passes = 1;
+    }
+    if (opt.erase && (!opt.yes || opt.write))
+    {
+        pr2serr("--erase %s\n", opt.write ? "and --write do not go together"
+                                           : "destroys the data, add --yes");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((ERASE_CRYPTO == opt.erase) && opt.dverify)
+        pr2serr("--erase sanitize:crypto: --dverify reads no data, what the "
+                "erase leaves is not checked\n");
+    if (opt.scrub &&
+        (opt.write || opt.clone_path || opt.compare_path || clone_capture() ||
+         (opt.stress > 0) || opt.bench || opt.offload || (opt.sample > 0) ||
+         opt.retest_path || opt.ranges_path || opt.erase ||
+         (opt.time_limit > 0) || opt.coarse))
+    {
+        pr2serr("--scrub only reads, whole devices: no --write, --clone, "
+                "--compare, --image, --manifest, --stress, --bench, "
+                "--offload, --sample, --retest, --ranges, --erase, "
+                "--time-limit or --coarse\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.write)
+        for (i = 0; i < num_patterns; ++i)
+            if (CHECKDATAFLAG == patterns[i].flag)
+            {
+                pr2serr("--write: pattern any has no data to write\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+    if (opt.dirty_path && !opt.scrub)
+    {
+        pr2serr("--dirty verifies the extents written while --scrub reads\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.scrub)
+    {
+        opt.background = true;
+        if ((opt.max_bps <= 0) && (opt.total_bps <= 0))
+            opt.max_bps = DEF_SCRUB_BPS;
+        if (opt.ck_path && !opt.resume && (0 == access(opt.ck_path, R_OK)))
+            opt.resume = true; /* the rolling checkpoint of the last run */
+    }
+    if (opt.resume && (NULL == opt.ck_path))
+    {
+        pr2serr("--resume needs the --checkpoint file to resume from\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (opt.resume && checkpoint_read())
+        return SG_LIB_FILE_ERROR;
+    if (opt.diff_path)
+    {
+        diff_fp = fopen(opt.diff_path, "wb");
+        if ((NULL == diff_fp) ||
+            (1 != fwrite(DIFF_MAGIC, 8, 1, diff_fp)))
+        {
+            perror(opt.diff_path);
+            return SG_LIB_FILE_ERROR;
+        }
+    }
+    if (opt.bad_path)
+    {
+        bad_fp = fopen(opt.bad_path, "wb");
+        if (NULL == bad_fp)
+        {
+            perror(opt.bad_path);
+            return SG_LIB_FILE_ERROR;
+        }
+    }
+    if (opt.bad_text_path)
+    {
+        bad_text_fp = fopen(opt.bad_text_path, "w");
+        if (NULL == bad_text_fp)
+        {
+            perror(opt.bad_text_path);
+            return SG_LIB_FILE_ERROR;
+        }
+        fprintf(bad_text_fp, "device\tkind\tfirst_lba\tlast_lba\tblocks\n");
+    }
+    if (opt.image_path && (0 == strcmp(opt.image_path, "-")))
+    {
+        /* the image has stdout, what is printed there goes to stderr,
+         * what is still buffered too */
+        image_fd = dup(STDOUT_FILENO);
+        if ((image_fd < 0) || (dup2(STDERR_FILENO, STDOUT_FILENO) < 0))
+        {
+            perror("--image=-");
+            return SG_LIB_FILE_ERROR;
+        }
+    }
+    else if (opt.image_path)
+    {
+        image_fd = open(opt.image_path, O_WRONLY | O_CREAT | O_TRUNC |
+                                            O_CLOEXEC, 0644);
+        if (image_fd < 0)
+        {
+            perror(opt.image_path);
+            return SG_LIB_FILE_ERROR;
+        }
+    }
+    if (opt.coordinate)
+    {
+        if (hostco_open(opt.coord_name))
+        {
+            perror(opt.coord_name ? opt.coord_name : HOSTCO_NAME);
+            return SG_LIB_FILE_ERROR;
+        }
+        __atomic_store_n(&hostco_on, 1, __ATOMIC_RELAXED);
+    }
+
+#ifndef DSKREAD_LIB /* the signals are the caller's */
+    install_handler(SIGINT, opt.scrub ? scrub_stop_handler : interrupt_handler);
+    if (opt.scrub)
+        install_handler(SIGTERM, scrub_stop_handler);
+    install_handler(SIGQUIT, interrupt_handler);
+    install_handler(SIGPIPE, interrupt_handler);
+    install_handler(SIGUSR1, siginfo_handler);
+#endif
+
+    printf("sg_lib_version: %s\n", sg_lib_version());
+    cpu_dispatch();
+    printf("isa: %s\n", cpu_isa_name());
+
+    time_t rawtime;
+    struct tm timeinfo;
+    char tbuf[32]; /* asctime_r() needs 26 */
+
+    time(&rawtime);
+    localtime_r(&rawtime, &timeinfo);
+
+    printf("Start Task local time and date: %s\n",
+           asctime_r(&timeinfo, tbuf));
+    oflag.cdbsz = DEF_SCSI_CDBSZ;
+    if (oflag.dio)
+    {
+        FILE *fp = fopen("/proc/scsi/sg/allow_dio", "r");
 
-    pr2serr("Start, out_num_sect=%" PRId64 ",block size=%d\n", out_num_sect, out_sect_sz);
-    if (opt.end > out_num_sect)
+        if (fp && ('0' == fgetc(fp)))
+            pr2serr("--dio: /proc/scsi/sg/allow_dio is 0, the sg driver "
+                    "copies every READ\n");
+        if (fp)
+            fclose(fp);
+    }
+    if (opt.media)
+        oflag.dpo = oflag.fua = 1;
+
+    pthread_condattr_t cattr;
+
+    dev_cattr(&cattr);
+    pthread_mutex_lock(&lib_mutex);
+    devs = (t_dev *)calloc(devices, sizeof(t_dev));
+    num_devs = devices;
+    for (i = 0; i < devices; ++i)
+    {
+        dev_init(devs + i, device[i], &cattr);
+        if (fanout_ctrl && (fanout_ctrl[i] >= 0))
+            devs[i].ctrl = ctrls + fanout_ctrl[i];
+    }
+    pthread_mutex_unlock(&lib_mutex);
+    gate_init(&probe_gate);
+    topology_map();
+    multipath_map();
+    throttle_apply();
+    rate_file_load();
+    if (opt.live_path)
     {
-        pr2serr("Ending sector must be less than or equal to %" PRId64 " for %s", out_num_sect, device_name);
-        exit(-2);
+        live = livestat_open(opt.live_path, devices);
+        if (NULL == live)
+            perror(opt.live_path);
+        for (i = 0; live && (i < devices); ++i)
+            live_update(devs + i, LIVESTAT_STARTING, 0, devs[i].start, 0.0,
+                        0.0);
     }
-    if (opt.end == 0)
+    if ((opt.metrics_port || opt.metrics_path) &&
+        metrics_start(opt.metrics_port, opt.metrics_path, opt.refresh,
+                      metrics_render))
+        perror("metrics exporter");
+    if (opt.ctl_path && control_start(opt.ctl_path, control_cmd))
+        perror(opt.ctl_path);
+    if (errlog_start())
+        perror("error logger");
+    if (opt.trace_path)
     {
-        opt.end = out_num_sect;
+        const char **names = (const char **)calloc(devices, sizeof(*names));
+
+        for (i = 0; names && (i < devices); ++i)
+            names[i] = devs[i].device_name;
+        if ((NULL == names) || trace_open(opt.trace_path, devices, names))
+            perror(opt.trace_path);
+        free(names);
     }
 
-    if (out_num_sect > opt.start)
-        out_num_sect -= opt.start;
+    int64_t all_start_ticks = get_ticks(NULL);
 
-    if (opt.start > opt.end)
+    if (pthread_create(&reporter_tid, NULL, reporter, &all_start_ticks))
+    {
+        perror("pthread_create");
+        reporter_tid = 0;
+    }
+    health_stop = 0;
+    if (opt.health_s && pthread_create(&health_tid, NULL, health_thread, NULL))
+    {
+        perror("pthread_create");
+        health_tid = 0;
+    }
+    if (opt.array)
+        for (i = 0; i < devices; ++i)
+            array_probe(devs + i);
+    uevent_start();
+    idle_stop = 0;
+    if ((opt.idle_pct > 0) &&
+        pthread_create(&idle_tid, NULL, idle_thread, NULL))
+    {
+        perror("pthread_create");
+        idle_tid = 0;
+    }
+    if (opt.dirty_path)
+        dirty_open();
+    if (1 == devices)
+        verify_worker(devs);
+    else
     {
-        pr2serr("Ending sector must be greater than starting sector");
-        exit(-2);
+        for (i = 0; i < devices; ++i)
+        {
+            if (pthread_create(&devs[i].tid, NULL, verify_worker, devs + i))
+            {
+                perror("pthread_create");
+                devs[i].res = SG_LIB_CAT_OTHER;
+                devs[i].done = 1;
+                devs[i].tid = 0;
+            }
+        }
+        for (i = 0; i < devices; ++i)
+            if (devs[i].tid)
+                pthread_join(devs[i].tid, NULL);
     }
+    __atomic_store_n(&health_stop, 1, __ATOMIC_RELEASE);
+    if (health_tid)
+        pthread_join(health_tid, NULL);
+    health_tid = 0;
+    uevent_end();
+    __atomic_store_n(&idle_stop, 1, __ATOMIC_RELEASE);
+    if (idle_tid)
+        pthread_join(idle_tid, NULL);
+    idle_tid = 0;
+    if (opt.dirty_path)
+        dirty_close();
+    if (opt.array)
+        array_report();
+    errlog_stop(); /* the errors left, before the aggregate */
+    __atomic_store_n(&reporter_stop, 1, __ATOMIC_RELEASE);
+    if (reporter_tid)
+        pthread_join(reporter_tid, NULL);
+    if (opt.plan)
+        plan_print();
+    else if (devices > 1)
+        print_aggregate(all_start_ticks);
+    if (opt.ck_path)
+        checkpoint_write();
+    if (trace_on)
+    {
+        struct trace_stats tst;
 
-    time_t t = time(NULL);
-    stats->lpStartTime = *localtime(&t);
-    snprintf(stats->start_time, sizeof(stats->start_time), "%02d:%02d:%02d", stats->lpStartTime.tm_hour, stats->lpStartTime.tm_min, stats->lpStartTime.tm_sec);
-    uint64_t last_ticks = get_ticks(stats);
+        if (trace_close(&tst))
+            perror(opt.trace_path);
+        else
+            printf("trace: %" PRIu64 " commands to %s, %" PRIu64
+                   " dropped\n", tst.records, opt.trace_path, tst.dropped);
+    }
 
-    printf(HEADER, opt.kilobyte ? " MiB" : "MB", opt.kilobyte ? " MiB" : "MB");
-    unsigned char chars[3] = {0};
-    int byte_to_write = byte[0];
-    for (int j = 0; j < BYTES_PER_ELEMENT; ++j)
+    control_stop();
+    metrics_stop(); /* the last textfile still names the devices */
+    /* --control may still be putting caps on, see throttle_apply() */
+    if (__atomic_exchange_n(&hostco_on, 0, __ATOMIC_RELAXED))
+        hostco_close(); /* the others' shares grow back */
+    pthread_mutex_lock(&lib_mutex);
+    if (lib_run_end)
+        lib_run_end();
+    for (i = 0; i < devices; ++i)
+    {
+        if (devs[i].res && (0 == ret))
+            ret = devs[i].res;
+        badmap_free(&devs[i].bad);
+        donemap_free(&devs[i].dmap);
+        free(device[i]);
+    }
+    for (i = 0; i < num_ckpts; ++i)
+        badmap_free(&ckpts[i].bad);
+    free(ckpts);
+    livestat_close(live);
+    free(devs);
+    devs = NULL;
+    num_devs = 0;
+    pthread_mutex_unlock(&lib_mutex);
+    free(device);
+    if (weak_fp)
+        fclose(weak_fp);
+    if (heat_fp)
+        fclose(heat_fp);
+    if (bad_fp && fclose(bad_fp))
+        perror(opt.bad_path);
+    if (diff_fp && fclose(diff_fp))
+        perror(opt.diff_path);
+    if (bad_text_fp)
+        fclose(bad_text_fp);
+    if (jsonl_enabled())
     {
-        chars[j] = (unsigned char)byte_to_write;
+        jsonl_printf("{\"type\":\"run\",\"devices\":%d,\"result\":%d,"
+                     "\"dropped_records\":%lu}", devices, ret,
+                     jsonl_dropped());
+        jsonl_close();
     }
-    unsigned int bytes_to_process = opt.sectors * stats->bytes_per_sector;
-    unsigned char *sector_data = (unsigned char *)malloc(bytes_to_process + BYTES_PER_ELEMENT);
-    unsigned char *check_data = (unsigned char *)malloc(bytes_to_process + BYTES_PER_ELEMENT);
-    memset(check_data, byte[0], bytes_to_process + BYTES_PER_ELEMENT);
-    memset(sector_data, byte[0], bytes_to_process + BYTES_PER_ELEMENT);
+    if (verbose)
+        pr2serr("buffer pool: %.1f MiB\n", iobuf_pool_bytes() / 1048576.0);
+    time(&rawtime);
+    localtime_r(&rawtime, &timeinfo);
 
-    bool bRetryerror = false;
+    printf("\nend Task local time and date: %s", asctime_r(&timeinfo, tbuf));
 
-    for (unsigned int pass = 1; pass <= opt.passes; ++pass)
-    {
-        unsigned int n;
+    return ret;
+}
 
-        stats->passwiping_ticks = 0;
+#ifndef DSKREAD_LIB
 
-        char s_byte[5];
-        sprintf(s_byte, "0x%02X", chars[0]);
+int
+main(int argc, char *argv[])
+{
+    return dskread_main(argc, argv);
+}
 
-        unsigned long sectors_to_process = opt.sectors;
+#else /* libdskread, see dskread.h */
 
-        int buf_sz, dio_tmp, first, blocks_per;
-        int64_t seek = opt.start;
-        int dio_incomplete = 0;
-        retries_tmp = opt.nretries;
+struct lib_event
+{
+    int event;
+    int dev;
+};
 
-        for (int64_t sector = opt.start; sector <= opt.end; sector += opt.sectors)
-        {
-            if (sector + sectors_to_process > opt.end)
-            {
-                sectors_to_process = (unsigned long)(opt.end - sector);
-                if (sectors_to_process == 0)
-                {
-                    fprintf(stderr, "sector				=%" PRIx64 "\n", sector);
-                    break;
-                }
-            }
+struct dskread
+{
+    char **argv; /* "dskread" then the options, NULL terminated */
+    int argc;
+    dskread_cb cb;
+    void *cb_arg;
+    int efd;
+    pthread_t tid;
+    bool started;
+    bool joined;
+    int result;
+    pthread_mutex_t mutex; /* the events and what follows */
+    struct lib_event *ev;
+    int num_ev, cap_ev;
+    bool ended;
+    struct dskread_dev *st; /* of the devices at the end, */
+    struct badmap *bad;     /* and their maps, num_st of each */
+    int num_st;
+};
 
-            uint64_t before_ticks = get_ticks(stats);
-            if (FT_SG & out_type)
-            {
-                // dio_tmp = oflag.dio;
-                bool diop;
-                first = 1;
-                while (1)
-                {
-                    //res = sg_write(outfd, sector_data, sectors_to_process, seek, blk_sz,
-                    //    &oflag, &dio_tmp);
-                    int blks_readp = 0;
-                    res = sg_read(outfd, sector_data, sectors_to_process, seek, blk_sz,
-                                  &oflag, &diop, &blks_readp);
-                    if (memcmp(sector_data, check_data, sectors_to_process)!=0){
-                        pr2serr("start sector %" PRId64 "error\n", sector);
-                    }
-                    if (0 == res)
-                        break;
-                    if (-2 == res)
-                    { /* ENOMEM, find what's available+try that */
-                        if (ioctl(outfd, SG_GET_RESERVED_SIZE, &buf_sz) < 0)
-                        {
-                            perror("RESERVED_SIZE ioctls failed");
-                            break;
-                        }
-                        if (buf_sz < MIN_RESERVED_SIZE)
-                            buf_sz = MIN_RESERVED_SIZE;
-                        blocks_per = (buf_sz + blk_sz - 1) / blk_sz;
-                        if (blocks_per < sectors_to_process)
-                        {
-                            sectors_to_process = blocks_per;
-                            pr2serr("Reducing read to %d blocks per loop\n",
-                                    blocks_per);
-                            res = sg_read(outfd, sector_data, sectors_to_process, seek, blk_sz,
-                                          &iflag, &diop, &blks_readp);
-                        }
-                    }
-                    if (res)
-                    {
-                        pr2serr("sg_read failed,%s at or after lba=%" PRId64 " [0x%" PRIx64 "]\n", ((-2 == res) ? " try reducing bpt," : ""), seek, seek);
-                        break;
-                    }
-                    first = 0;
-                }
-            }
-            seek += sectors_to_process;
+static struct dskread *lib_ctx; /* the one open, under lib_mutex */
 
-            uint64_t after_ticks = get_ticks(stats);
-            stats->wiping_ticks += after_ticks - before_ticks;
-            stats->passwiping_ticks += after_ticks - before_ticks;
+static void
+lib_push(struct dskread *d, int event, int dev)
+{
+    uint64_t one = 1;
 
-            uint64_t seconds = (after_ticks - last_ticks);
-            if (seconds >= opt.refresh && res == 0)
-            {
-                last_ticks = after_ticks;
-                // print_stats(pass - nCheckCount, s_byte, sector, stats, opt.passes - CheckSumPasses);
-                print_stats(pass, s_byte, sector, stats, opt.passes);
-            }
-        }
-        if (res != 0)
+    pthread_mutex_lock(&d->mutex);
+    if (d->num_ev == d->cap_ev)
+    {
+        int cap = d->cap_ev ? 2 * d->cap_ev : 16;
+        struct lib_event *ev = (struct lib_event *)realloc(d->ev,
+                                                  cap * sizeof(*ev));
+
+        if (NULL == ev)
         {
-            if (retries_tmp > 0 && bRetryerror)
-            {
-                bRetryerror = false;
-                pass--;
-                continue;
-            }
-            else
-                break;
+            pthread_mutex_unlock(&d->mutex);
+            return; /* the state is still there to poll */
         }
-        // print_stats(pass - nCheckCount, s_byte, opt.end, stats, opt.passes - CheckSumPasses);
-        print_stats(pass, s_byte, opt.end, stats, opt.passes);
+        d->ev = ev;
+        d->cap_ev = cap;
+    }
+    d->ev[d->num_ev].event = event;
+    d->ev[d->num_ev++].dev = dev;
+    pthread_mutex_unlock(&d->mutex);
+    if (write(d->efd, &one, sizeof(one)) < 0)
+    {
+        /* the counter is full: it is readable anyway */
     }
-    free(sector_data);
-    free(check_data);
-    close(outfd);
+}
 
-    return res;
+static void
+lib_fill(struct dskread_dev *st, const t_dev *dp)
+{
+    memset(st, 0, sizeof(*st));
+    snprintf(st->name, sizeof(st->name), "%s", dp->device_name);
+    st->done = __atomic_load_n(&dp->done, __ATOMIC_ACQUIRE);
+    st->result = st->done ? dp->res : 0;
+    st->pass = __atomic_load_n(&dp->cur_pass, __ATOMIC_RELAXED);
+    st->passes = dp->passes_done;
+    st->total = opt.passes;
+    st->start = dp->start;
+    st->end = dp->end;
+    st->lba = __atomic_load_n(&dp->cur_lba, __ATOMIC_RELAXED);
+    st->bytes = dp->bytes_done;
+    st->unrecovered = CTR_GET((t_dev *)dp, unrecovered);
+    st->mismatched = dp->mis_blocks;
+    st->weak = dp->weak_sectors;
 }
 
-int main(int argc, char *argv[])
+static void
+lib_dev_event(int dev)
 {
-    version();
-    progname = basename(argv[0]);
+    lib_push(lib_ctx, DSKREAD_EV_DEVICE, dev);
+}
 
-    opterr = 0;
-    int option_index = 0;
-    optind = 1;
-    int ret = 0;
-    int patten[1] = {0};
-    int byte_to_write = 0;
+/* Called under lib_mutex before devs goes: their state, and their maps
+ * moved out of them. */
+static void
+lib_end_capture(void)
+{
+    struct dskread *d = lib_ctx;
+    int i;
 
-    while (true)
+    d->st = (struct dskread_dev *)calloc(num_devs, sizeof(*d->st));
+    d->bad = (struct badmap *)calloc(num_devs, sizeof(*d->bad));
+    if ((NULL == d->st) || (NULL == d->bad))
     {
-        int c = getopt_long(argc, argv, short_options, long_options, &option_index);
+        free(d->st);
+        free(d->bad);
+        d->st = NULL;
+        d->bad = NULL;
+        return;
+    }
+    for (i = 0; i < num_devs; ++i)
+    {
+        lib_fill(d->st + i, devs + i);
+        badmap_compact(&devs[i].bad);
+        d->bad[i] = devs[i].bad;
+        pthread_mutex_init(&d->bad[i].mutex, NULL);
+        badmap_init(&devs[i].bad);
+    }
+    d->num_st = num_devs;
+}
 
-        if (c == -1)
-            break;
+static void *
+lib_run(void *arg)
+{
+    struct dskread *d = (struct dskread *)arg;
+    int res = dskread_main(d->argc, d->argv);
 
-        switch (c)
-        {
-        case 'p':
-            if (strncasecmp(optarg, "0x", 2) == 0)
-            {
-                if (sscanf(optarg, "%x", &byte_to_write) == 0)
-                {
-                    usage(1);
-                }
-                break;
-            }
+    fflush(stdout);
+    pthread_mutex_lock(&d->mutex);
+    d->result = res;
+    d->ended = true;
+    pthread_mutex_unlock(&d->mutex);
+    lib_push(d, DSKREAD_EV_RUN, -1);
+    return NULL;
+}
 
-            if (optarg[0] == '0')
-            {
-                if (sscanf(optarg, "%o", &byte_to_write) == 0)
-                {
-                    usage(1);
-                }
-                break;
-            }
-            byte_to_write = atoi(optarg);
-            byte_to_write &= 0xff;
+struct dskread *
+dskread_open(void)
+{
+    struct dskread *d;
 
-            patten[0] = (unsigned char)byte_to_write;
-            break;
-        case 'k':
-            opt.kilobyte = true;
-            break;
-        case 'V':
-            verbose = atoi(optarg);
-            break;
-        case 'n': /* -n | --sectors n Write n sectors at once (default is %d) */
-            opt.sectors = atoi(optarg);
-            if (opt.sectors == 0)
-                usage(1);
-            if (opt.sectors >= 0x100000)
-                usage(1);
-            break;
-        case 's': // -s | --start   n Start at sector n (default is first sector)
-            opt.start = strtoull(optarg, (char **)NULL, 10);
-            if (opt.start == (int64_t)-1)
-                usage(1);
-            break;
-        case 'e': // -e | --end     n End at sector n (default is last sector)
-            opt.end = strtoull(optarg, (char **)NULL, 10);
-            if (opt.end == 0)
-                usage(1);
-            break;
-        case 'v': /* -v | --version   Show version and copyright information and quit */
-            version();
-            exit(0);
-            break;
-        case '?': /* -? | --help      Show this help message and quit */
-            ++opt.help;
-            break;
-        default:
-            usage(1);
-        }
+    pthread_mutex_lock(&lib_mutex);
+    if (lib_ctx)
+    {
+        pthread_mutex_unlock(&lib_mutex);
+        errno = EBUSY;
+        return NULL;
     }
-
-    if (opt.help)
+    d = (struct dskread *)calloc(1, sizeof(*d));
+    if (d)
     {
-        _usage();
-        if (opt.help > 1)
+        d->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (d->efd < 0)
         {
-            // examples();
+            free(d);
+            d = NULL;
         }
-        exit(0);
     }
+    if (d)
+    {
+        pthread_mutex_init(&d->mutex, NULL);
+        d->result = -1;
+        lib_ctx = d;
+        lib_dev_done = lib_dev_event;
+        lib_run_end = lib_end_capture;
+    }
+    pthread_mutex_unlock(&lib_mutex);
+    return d;
+}
 
-    int devices = 0;
-    int bytes = 0;
-    int i = 0;
-    for (i = optind; i < argc; ++i)
+static void
+lib_free_argv(struct dskread *d)
+{
+    int i;
+
+    if (d->argv)
+        for (i = 0; i < d->argc; ++i)
+            free(d->argv[i]);
+    free(d->argv);
+    d->argv = NULL;
+    d->argc = 0;
+}
+
+int
+dskread_configure(struct dskread *d, int argc, char *const argv[])
+{
+    int i;
+
+    if (d->started)
     {
-        if (argv[i][0] == '/' && argv[i][1] == 'd' && argv[i][2] == 'e' && argv[i][3] == 'v' && argv[i][4] == '/')
+        errno = EBUSY;
+        return -1;
+    }
+    lib_free_argv(d);
+    d->argv = (char **)calloc(argc + 2, sizeof(char *));
+    if (NULL == d->argv)
+        return -1;
+    d->argc = argc + 1;
+    d->argv[0] = strdup(APPNAME);
+    for (i = 0; i < argc; ++i)
+        d->argv[i + 1] = strdup(argv[i]);
+    for (i = 0; i < d->argc; ++i)
+        if (NULL == d->argv[i])
         {
-            ++devices;
-            continue;
+            lib_free_argv(d);
+            errno = ENOMEM;
+            return -1;
         }
-        ++bytes;
-    }
+    return 0;
+}
 
-    if (devices == 0)
+void
+dskread_set_callback(struct dskread *d, dskread_cb cb, void *arg)
+{
+    d->cb = cb;
+    d->cb_arg = arg;
+}
+
+int
+dskread_start(struct dskread *d)
+{
+    int res;
+
+    if (d->started || (NULL == d->argv))
     {
-        pr2serr("%s: No devices specified\n", progname);
-        usage(1);
+        errno = d->started ? EBUSY : EINVAL;
+        return -1;
     }
-
-    char **device = (char **)malloc(sizeof(char *) * devices);
-    devices = 0;
-    for (i = optind; i < argc; ++i)
+    res = pthread_create(&d->tid, NULL, lib_run, d);
+    if (res)
     {
-        device[devices] = (char *)malloc((strlen(argv[i]) + 6) * sizeof(char));
+        errno = res;
+        return -1;
+    }
+    d->started = true;
+    return 0;
+}
 
-        if (argv[i][0] == '/' &&
-            argv[i][1] == 'd' &&
-            argv[i][2] == 'e' &&
-            argv[i][3] == 'v' &&
-            argv[i][4] == '/')
-        {
-            strcpy(device[devices++], argv[i]);
-            continue;
-        }
+int
+dskread_event_fd(const struct dskread *d)
+{
+    return d->efd;
+}
+
+void
+dskread_dispatch(struct dskread *d)
+{
+    uint64_t n;
+    struct lib_event *ev;
+    int i, num;
+
+    if (read(d->efd, &n, sizeof(n)) < 0)
+    {
+        /* nothing due: EAGAIN */
     }
-    opt.passes = 1;
+    pthread_mutex_lock(&d->mutex);
+    ev = d->ev;
+    num = d->num_ev;
+    d->ev = NULL;
+    d->num_ev = d->cap_ev = 0;
+    pthread_mutex_unlock(&d->mutex);
+    for (i = 0; i < num; ++i)
+        if (d->cb)
+            d->cb(d->cb_arg, ev[i].event, ev[i].dev);
+    free(ev);
+}
 
-    install_handler(SIGINT, interrupt_handler);
-    install_handler(SIGQUIT, interrupt_handler);
-    install_handler(SIGPIPE, interrupt_handler);
-    install_handler(SIGUSR1, siginfo_handler);
+int
+dskread_poll(struct dskread *d, struct dskread_dev *st, int max)
+{
+    int i, num;
 
-    t_stats stats;
-    stats.device_name = NULL;
-    stats.bytes_per_sector = 0;
-    printf("sg_lib_version: %s\n", sg_lib_version());
+    pthread_mutex_lock(&d->mutex);
+    if (d->ended)
+    {
+        num = d->num_st;
+        for (i = 0; (i < num) && (i < max); ++i)
+            st[i] = d->st[i];
+        pthread_mutex_unlock(&d->mutex);
+        return num;
+    }
+    pthread_mutex_unlock(&d->mutex);
+    pthread_mutex_lock(&lib_mutex);
+    num = devs ? num_devs : 0;
+    for (i = 0; (i < num) && (i < max); ++i)
+        lib_fill(st + i, devs + i);
+    pthread_mutex_unlock(&lib_mutex);
+    return num;
+}
 
-    time_t rawtime;
-    struct tm *timeinfo;
+int
+dskread_control(struct dskread *d, const char *cmd, char *reply, int len)
+{
+    char *buf = NULL;
+    size_t n = 0;
+    FILE *fp;
 
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
+    (void)d;
+    pthread_mutex_lock(&lib_mutex);
+    if ((NULL == devs) || (NULL == (fp = open_memstream(&buf, &n))))
+    {
+        pthread_mutex_unlock(&lib_mutex);
+        return -1;
+    }
+    control_cmd(cmd, fp);
+    fclose(fp);
+    pthread_mutex_unlock(&lib_mutex);
+    if (len > 0)
+        snprintf(reply, len, "%s", buf);
+    free(buf);
+    return 0;
+}
 
-    printf("Start Task local time and date: %s\n", asctime(timeinfo));
-    oflag.cdbsz = DEF_SCSI_CDBSZ;
+void
+dskread_cancel(struct dskread *d)
+{
+    (void)d;
+    __atomic_store_n(&run_cancel, 1, __ATOMIC_RELAXED);
+}
 
-    for (i = 0; i < devices; ++i)
+int
+dskread_wait(struct dskread *d)
+{
+    if (d->started && !d->joined)
     {
-        ret = read_verify_device(device[i], 1, patten, &stats);
+        pthread_join(d->tid, NULL);
+        d->joined = true;
     }
+    return d->result;
+}
 
-    free(device);
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
+int
+dskread_badmap(struct dskread *d, int dev, dskread_ext_fn fn, void *arg)
+{
+    const struct badmap *m;
+    size_t k;
+
+    pthread_mutex_lock(&d->mutex);
+    if (!d->ended || (dev < 0) || (dev >= d->num_st))
+    {
+        pthread_mutex_unlock(&d->mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&d->mutex);
+    m = d->bad + dev; /* no longer changes */
+    for (k = 0; k < m->num; ++k)
+        fn(arg, m->ext[k].lba, m->ext[k].len, (int)m->ext[k].kind);
+    return 0;
+}
 
-    printf("\nend Task local time and date: %s", asctime(timeinfo));
+void
+dskread_close(struct dskread *d)
+{
+    int i;
 
-    return ret;
+    dskread_wait(d);
+    pthread_mutex_lock(&lib_mutex);
+    lib_ctx = NULL;
+    lib_dev_done = NULL;
+    lib_run_end = NULL;
+    pthread_mutex_unlock(&lib_mutex);
+    for (i = 0; i < d->num_st; ++i)
+        badmap_free(d->bad + i);
+    free(d->bad);
+    free(d->st);
+    free(d->ev);
+    lib_free_argv(d);
+    close(d->efd);
+    pthread_mutex_destroy(&d->mutex);
+    free(d);
 }
+
+#endif /* DSKREAD_LIB */
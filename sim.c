@@ -0,0 +1,562 @@
+/*
+ * sim.c
+ *
+ *  A READ names its blocks in the CDB; the first fault among them
+ *  decides how it ends: the blocks before it are filled and the rest
+ *  are the residual, as a drive that stops at the bad block does. The
+ *  sense is in descriptor format, so the LBA of the error fits whatever
+ *  the capacity. Latencies come from a counter hashed with the seed,
+ *  the same run for the same seed whatever the threads.
+ *
+ *  A queued command is answered when submitted, the data in place
+ *  before it is reaped, as nothing can look at it meanwhile; only its
+ *  completion waits, on a binary heap of due times.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <scsi/sg.h>
+
+#include "sim.h"
+
+#define SIM_SPIN_NS 50000 // latencies below are spun, not slept
+
+#define DID_ABORT 0x05
+#define DID_TIME_OUT 0x03
+#define DRIVER_TIMEOUT 0x06
+
+bool sim_name(const char *name)
+{
+	return 0 == strncmp(name, SIM_PREFIX, strlen(SIM_PREFIX));
+}
+
+// lba[+n] into f, returns where it stopped, NULL when not that
+static char *
+parse_range(char *s, struct sim_fault *f)
+{
+	char *end;
+
+	f->lba = strtoll(s, &end, 0);
+	if ((end == s) || (f->lba < 0))
+		return NULL;
+	f->len = 1;
+	if ('+' == *end)
+	{
+		s = end + 1;
+		f->len = strtoll(s, &end, 0);
+		if ((end == s) || (f->len < 1))
+			return NULL;
+	}
+	return end;
+}
+
+// One key=value of the name. Returns 0, -1 when it is not one
+static int
+parse_kv(struct sim_dev *sd, const char *key, char *val)
+{
+	struct sim_fault *f = sd->fault + sd->num_faults;
+	unsigned int k, asc, ascq;
+	char *end;
+
+	if (0 == strcmp(key, "blocks"))
+		return ((sd->blocks = strtoll(val, &end, 0)) > 0) && !*end ? 0 : -1;
+	if (0 == strcmp(key, "bs"))
+		return ((sd->bs = atoi(val)) >= 512) && !(sd->bs & 511) ? 0 : -1;
+	if (0 == strcmp(key, "lat"))
+	{
+		sd->lat_ns = (uint64_t)(strtod(val, &end) * 1000);
+		return *end ? -1 : 0;
+	}
+	if (0 == strcmp(key, "min"))
+	{
+		sd->min_ns = (uint64_t)(strtod(val, &end) * 1000);
+		return *end ? -1 : 0;
+	}
+	if (0 == strcmp(key, "dist"))
+	{
+		if (0 == strcmp(val, "fixed"))
+			sd->dist = SIM_FIXED;
+		else if (0 == strcmp(val, "uniform"))
+			sd->dist = SIM_UNIFORM;
+		else if (0 == strcmp(val, "exp"))
+			sd->dist = SIM_EXP;
+		else
+			return -1;
+		return 0;
+	}
+	if (0 == strcmp(key, "qd"))
+		return ((sd->qd = atoi(val)) >= 0) ? 0 : -1;
+	if (0 == strcmp(key, "fill"))
+	{
+		k = (unsigned int)strtoul(val, &end, 0);
+		sd->fill = (uint8_t)k;
+		return (*end || (k > 0xff)) ? -1 : 0;
+	}
+	if (0 == strcmp(key, "ua"))
+		return ((sd->ua_every = strtoull(val, &end, 0)) > 0) && !*end ? 0
+										  : -1;
+	if (0 == strcmp(key, "qfull"))
+		return ((sd->qfull_every = strtoull(val, &end, 0)) > 0) && !*end
+			       ? 0
+			       : -1;
+	if (0 == strcmp(key, "seed"))
+	{
+		sd->seed = strtoull(val, &end, 0);
+		return *end ? -1 : 0;
+	}
+	if (strcmp(key, "bad") && strcmp(key, "rec") && strcmp(key, "timeout") &&
+	    strcmp(key, "sense"))
+		return -1;
+	if (sd->num_faults >= SIM_FAULTS)
+		return -1;
+	memset(f, 0, sizeof(*f));
+	end = parse_range(val, f);
+	if (NULL == end)
+		return -1;
+	if (0 == strcmp(key, "sense"))
+	{
+		if ((':' != *end) ||
+		    (3 != sscanf(end + 1, "%x/%x/%x", &k, &asc, &ascq)) ||
+		    (k > 0xf) || (asc > 0xff) || (ascq > 0xff))
+			return -1;
+		f->key = k;
+		f->asc = asc;
+		f->ascq = ascq;
+	}
+	else if (*end)
+		return -1;
+	else if (0 == strcmp(key, "bad"))
+	{
+		f->key = 0x3; // MEDIUM ERROR, unrecovered read error
+		f->asc = 0x11;
+	}
+	else if (0 == strcmp(key, "rec"))
+	{
+		f->key = 0x1; // RECOVERED ERROR, with retries and ECC
+		f->asc = 0x18;
+	}
+	else
+		f->timeout = true;
+	++sd->num_faults;
+	return 0;
+}
+
+int sim_parse(const char *name, struct sim_dev *sd, char *err, int elen)
+{
+	char *s, *tok, *save, *eq;
+	int res = 0;
+
+	memset(sd, 0, sizeof(*sd));
+	sd->blocks = 2097152;
+	sd->bs = 512;
+	if (!sim_name(name))
+	{
+		snprintf(err, elen, "not %s...", SIM_PREFIX);
+		return -1;
+	}
+	s = strdup(name + strlen(SIM_PREFIX));
+	if (NULL == s)
+	{
+		snprintf(err, elen, "out of memory");
+		return -1;
+	}
+	for (tok = strtok_r(s, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+	{
+		eq = strchr(tok, '=');
+		if (eq)
+			*eq = '\0';
+		if ((NULL == eq) || parse_kv(sd, tok, eq + 1))
+		{
+			if (eq)
+				*eq = '=';
+			snprintf(err, elen, "bad '%s'", tok);
+			res = -1;
+			break;
+		}
+	}
+	free(s);
+	return res;
+}
+
+static uint64_t
+mix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+// The latency of command n, ns
+static uint64_t
+latency(const struct sim_dev *sd, uint64_t n)
+{
+	double u = (mix(sd->seed ^ mix(n)) >> 11) * (1.0 / 9007199254740992.0);
+	uint64_t ns;
+
+	switch (sd->dist)
+	{
+	case SIM_UNIFORM:
+		ns = (uint64_t)(2.0 * sd->lat_ns * u);
+		break;
+	case SIM_EXP:
+		ns = (uint64_t)(-(double)sd->lat_ns * log(1.0 - u));
+		break;
+	default:
+		ns = sd->lat_ns;
+		break;
+	}
+	return (ns < sd->min_ns) ? sd->min_ns : ns;
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+wait_ns(uint64_t ns)
+{
+	uint64_t t0 = now_ns();
+	struct timespec ts;
+
+	if (ns >= SIM_SPIN_NS)
+	{
+		ts.tv_sec = ns / 1000000000ULL;
+		ts.tv_nsec = ns % 1000000000ULL;
+		while (nanosleep(&ts, &ts) && (EINTR == errno))
+			;
+		return;
+	}
+	while (now_ns() - t0 < ns)
+		;
+}
+
+static uint64_t
+get_be(const uint8_t *p, int len)
+{
+	uint64_t v = 0;
+
+	while (len-- > 0)
+		v = (v << 8) | *p++;
+	return v;
+}
+
+// The blocks of cdb into *lba and *len. Returns 0, -1 not a READ
+static int
+cdb_range(const uint8_t *cdb, int64_t *lba, int64_t *len)
+{
+	switch (cdb[0])
+	{
+	case 0x08: // READ(6)
+		*lba = get_be(cdb + 1, 3) & 0x1fffff;
+		*len = cdb[4] ? cdb[4] : 256;
+		return 0;
+	case 0x28: // READ(10)
+	case 0x2f: // VERIFY(10)
+		*lba = get_be(cdb + 2, 4);
+		*len = get_be(cdb + 7, 2);
+		return 0;
+	case 0xa8: // READ(12)
+		*lba = get_be(cdb + 2, 4);
+		*len = get_be(cdb + 6, 4);
+		return 0;
+	case 0x88: // READ(16)
+	case 0x8f: // VERIFY(16)
+		*lba = (int64_t)(get_be(cdb + 2, 8) & INT64_MAX);
+		*len = get_be(cdb + 10, 4);
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+// CHECK CONDITION with descriptor sense key/asc/ascq, and the
+// information lba when not negative
+static void
+check_cond(struct sg_io_hdr *hp, int key, int asc, int ascq, int64_t lba)
+{
+	uint8_t sb[20];
+	int n = 8, k;
+
+	memset(sb, 0, sizeof(sb));
+	sb[0] = 0x72;
+	sb[1] = key;
+	sb[2] = asc;
+	sb[3] = ascq;
+	if (lba >= 0)
+	{
+		sb[7] = 12;
+		sb[8] = 0x00; // information
+		sb[9] = 0x0a;
+		sb[10] = 0x80; // VALID
+		for (k = 0; k < 8; ++k)
+			sb[12 + k] = (uint8_t)((uint64_t)lba >> (56 - 8 * k));
+		n = sizeof(sb);
+	}
+	hp->status = 0x02;
+	hp->masked_status = 0x01;
+	hp->info |= SG_INFO_CHECK;
+	hp->sb_len_wr = (n < hp->mx_sb_len) ? n : hp->mx_sb_len;
+	if (hp->sbp)
+		memcpy(hp->sbp, sb, hp->sb_len_wr);
+}
+
+// Fills the first bytes of the transfer of hp with byte
+static void
+fill(struct sg_io_hdr *hp, uint8_t byte, int64_t bytes)
+{
+	struct sg_iovec *iov = (struct sg_iovec *)hp->dxferp;
+	int64_t n;
+	int k;
+
+	if (0 == hp->iovec_count)
+	{
+		memset(hp->dxferp, byte, bytes);
+		return;
+	}
+	for (k = 0; (k < hp->iovec_count) && (bytes > 0); ++k)
+	{
+		n = ((int64_t)iov[k].iov_len < bytes) ? (int64_t)iov[k].iov_len
+						      : bytes;
+		memset(iov[k].iov_base, byte, n);
+		bytes -= n;
+	}
+}
+
+static void
+clear(struct sg_io_hdr *hp)
+{
+	hp->status = hp->masked_status = hp->msg_status = 0;
+	hp->host_status = hp->driver_status = 0;
+	hp->sb_len_wr = 0;
+	hp->resid = 0;
+	hp->info = SG_INFO_OK;
+	hp->duration = 0;
+}
+
+// Answers the command of hp as it will have ended. Returns its latency
+static uint64_t
+answer(struct sim_dev *sd, struct sg_io_hdr *hp)
+{
+	const struct sim_fault *f, *hit = NULL;
+	int64_t lba, len, at = 0, done;
+	uint64_t n, ns;
+	int k;
+
+	n = __atomic_fetch_add(&sd->cmds, 1, __ATOMIC_RELAXED);
+	clear(hp);
+	ns = latency(sd, n);
+	hp->duration = (unsigned int)(ns / 1000000);
+	if (cdb_range(hp->cmdp, &lba, &len))
+	{
+		check_cond(hp, 0x5, 0x20, 0x00, -1); // invalid command operation
+		return ns;
+	}
+	if ((lba + len > sd->blocks) ||
+	    ((int64_t)hp->dxfer_len < len * sd->bs && (0x2f != hp->cmdp[0]) &&
+	     (0x8f != hp->cmdp[0])))
+	{
+		check_cond(hp, 0x5, 0x21, 0x00, -1); // lba out of range
+		return ns;
+	}
+	if (sd->qfull_every && (n % sd->qfull_every == sd->qfull_every - 1))
+	{
+		hp->status = 0x28; // TASK SET FULL
+		hp->masked_status = 0x14;
+		hp->resid = hp->dxfer_len;
+		return ns;
+	}
+	if (sd->ua_every && (n % sd->ua_every == sd->ua_every - 1))
+	{
+		check_cond(hp, 0x6, 0x29, 0x00, -1); // reset occurred
+		hp->resid = hp->dxfer_len;
+		return ns;
+	}
+	for (k = 0; k < sd->num_faults; ++k)
+	{
+		f = sd->fault + k;
+		if ((f->lba >= lba + len) || (f->lba + f->len <= lba))
+			continue;
+		if ((NULL == hit) || (((f->lba > lba) ? f->lba : lba) < at))
+		{
+			hit = f;
+			at = (f->lba > lba) ? f->lba : lba;
+		}
+	}
+	// a recovered error returns all of the data
+	done = (hit && (0x1 != hit->key)) ? at - lba : len;
+	if (hp->dxferp && hp->dxfer_len)
+		fill(hp, sd->fill, done * sd->bs);
+	hp->resid = hp->dxfer_len ? hp->dxfer_len - done * sd->bs : 0;
+	if (hit && hit->timeout)
+	{
+		hp->host_status = DID_TIME_OUT;
+		hp->driver_status = DRIVER_TIMEOUT;
+		hp->info |= SG_INFO_CHECK;
+		hp->duration = hp->timeout;
+	}
+	else if (hit)
+		check_cond(hp, hit->key, hit->asc, hit->ascq, at);
+	return ns;
+}
+
+int sim_io(struct sim_dev *sd, struct sg_io_hdr *hp)
+{
+	uint64_t ns;
+	int k;
+
+	k = __atomic_add_fetch(&sd->in_flight, 1, __ATOMIC_ACQUIRE);
+	if (sd->qd && (k > sd->qd))
+	{
+		__atomic_sub_fetch(&sd->in_flight, 1, __ATOMIC_RELEASE);
+		errno = EBUSY;
+		return -1;
+	}
+	ns = answer(sd, hp);
+	if (ns)
+		wait_ns(ns);
+	__atomic_sub_fetch(&sd->in_flight, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static void
+heap_up(struct sim_pend *h, int k)
+{
+	struct sim_pend t;
+
+	while ((k > 0) && (h[(k - 1) / 2].due > h[k].due))
+	{
+		t = h[k];
+		h[k] = h[(k - 1) / 2];
+		h[(k - 1) / 2] = t;
+		k = (k - 1) / 2;
+	}
+}
+
+static void
+heap_down(struct sim_pend *h, int n, int k)
+{
+	struct sim_pend t;
+	int c;
+
+	while ((c = 2 * k + 1) < n)
+	{
+		if ((c + 1 < n) && (h[c + 1].due < h[c].due))
+			++c;
+		if (h[k].due <= h[c].due)
+			break;
+		t = h[k];
+		h[k] = h[c];
+		h[c] = t;
+		k = c;
+	}
+}
+
+int sim_submit(struct sim_dev *sd, struct sg_io_hdr *hp)
+{
+	struct sim_pend *p;
+	uint64_t now = now_ns();
+	int k, cap;
+
+	if (sd->num_pend == sd->cap_pend)
+	{
+		cap = sd->cap_pend ? 2 * sd->cap_pend : 64;
+		p = (struct sim_pend *)realloc(sd->pend, cap * sizeof(*p));
+		if (NULL == p)
+		{
+			errno = ENOMEM;
+			return -1;
+		}
+		sd->pend = p;
+		sd->cap_pend = cap;
+	}
+	p = sd->pend + sd->num_pend;
+	p->hp = hp;
+	k = __atomic_add_fetch(&sd->in_flight, 1, __ATOMIC_ACQUIRE);
+	if (sd->qd && (k > sd->qd))
+	{
+		__atomic_sub_fetch(&sd->in_flight, 1, __ATOMIC_RELEASE);
+		clear(hp);
+		hp->status = 0x28; // TASK SET FULL
+		hp->masked_status = 0x14;
+		hp->resid = hp->dxfer_len;
+		p->due = now;
+		p->counted = false;
+	}
+	else
+	{
+		p->due = now + answer(sd, hp);
+		p->counted = true;
+	}
+	heap_up(sd->pend, sd->num_pend++);
+	return 0;
+}
+
+int sim_reap(struct sim_dev *sd, struct sg_io_hdr **hpp, bool nowait)
+{
+	uint64_t now;
+
+	if (0 == sd->num_pend)
+	{
+		errno = nowait ? EAGAIN : ENOENT;
+		return -1;
+	}
+	now = now_ns();
+	if (sd->pend[0].due > now)
+	{
+		if (nowait)
+		{
+			errno = EAGAIN;
+			return -1;
+		}
+		wait_ns(sd->pend[0].due - now);
+	}
+	*hpp = sd->pend[0].hp;
+	if (sd->pend[0].counted)
+		__atomic_sub_fetch(&sd->in_flight, 1, __ATOMIC_RELEASE);
+	sd->pend[0] = sd->pend[--sd->num_pend];
+	heap_down(sd->pend, sd->num_pend, 0);
+	return 0;
+}
+
+uint64_t sim_next_due(const struct sim_dev *sd)
+{
+	return sd->num_pend ? sd->pend[0].due : UINT64_MAX;
+}
+
+int sim_abort(struct sim_dev *sd, struct sg_io_hdr *hp)
+{
+	int k;
+
+	for (k = 0; k < sd->num_pend; ++k)
+		if (sd->pend[k].hp == hp)
+			break;
+	if (k == sd->num_pend)
+	{
+		errno = ENODATA;
+		return -1;
+	}
+	clear(hp);
+	hp->host_status = DID_ABORT;
+	hp->info |= SG_INFO_CHECK;
+	hp->resid = hp->dxfer_len;
+	sd->pend[k].due = now_ns();
+	heap_up(sd->pend, k);
+	return 0;
+}
+
+void sim_close(struct sim_dev *sd)
+{
+	free(sd->pend);
+	sd->pend = NULL;
+	sd->num_pend = sd->cap_pend = 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * sim.h
+ *
+ *  A simulated SCSI disk, named "sim:" and a list of key=value on the
+ *  command line, to time dskread itself with a device that is never
+ *  what it waits on. Its READs are answered in memory: the data is the
+ *  fill byte, after a latency drawn from the distribution asked for,
+ *  and the blocks and commands given as faulty come back with the
+ *  status and sense a drive would send, so they go through the same
+ *  classification, retries and isolation as those of a real one.
+ *
+ *    blocks=n     capacity (2097152)     bs=n      block size (512)
+ *    lat=us       mean latency (0)       dist=d    fixed, uniform
+ *                                                  (0 to 2 lat) or exp
+ *    min=us       least latency, of any distribution (0)
+ *    qd=n         commands at once, more are refused with EBUSY (0 any)
+ *    fill=n       byte the blocks hold (0)
+ *    bad=lba[+n]  unrecovered medium error, 3/11/00
+ *    rec=lba[+n]  recovered error, 1/18/00, the data is returned
+ *    timeout=lba[+n]  the command times out
+ *    sense=lba[+n]:k/asc/ascq  any other sense key and code
+ *    ua=n         a unit attention, 6/29/00, every n commands
+ *    qfull=n      TASK SET FULL status every n commands
+ *    seed=n       of the latencies
+ *
+ *  bad, rec, timeout and sense may be given more than once.
+ *
+ *  Besides SG_IO, a device takes commands queued as on the sg v3
+ *  asynchronous interface: sim_submit() answers one at once and holds
+ *  it until its latency has passed, sim_reap() hands back the next to
+ *  complete, in the order of their latencies, not of submission. A
+ *  command over qd= of them in flight completes at once with TASK SET
+ *  FULL, as from a drive whose queue is full.
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIM_PREFIX "sim:"
+#define SIM_FAULTS 256 // most faults of a device
+
+#define SIM_FIXED 0
+#define SIM_UNIFORM 1
+#define SIM_EXP 2
+
+struct sg_io_hdr;
+
+struct sim_pend
+{
+	uint64_t due; // CLOCK_MONOTONIC ns it completes at
+	struct sg_io_hdr *hp;
+	bool counted; // in in_flight
+};
+
+struct sim_fault
+{
+	int64_t lba;
+	int64_t len;
+	bool timeout;
+	uint8_t key, asc, ascq; // sense, when not a timeout
+};
+
+struct sim_dev
+{
+	int64_t blocks;
+	int bs;
+	uint64_t lat_ns;
+	uint64_t min_ns;
+	int dist; // SIM_*
+	int qd;
+	uint8_t fill;
+	uint64_t ua_every;
+	uint64_t qfull_every;
+	uint64_t seed;
+	struct sim_fault fault[SIM_FAULTS];
+	int num_faults;
+	int in_flight; // atomic
+	uint64_t cmds; // atomic
+	// sim_submit()ted, a heap on due; of one thread at a time
+	struct sim_pend *pend;
+	int num_pend;
+	int cap_pend;
+};
+
+// Whether name is that of a simulated device
+bool sim_name(const char *name);
+// The device of name "sim:...". Returns 0, -1 with what is wrong in
+// err, elen bytes
+int sim_parse(const char *name, struct sim_dev *sd, char *err, int elen);
+// SG_IO of hp on sd: READ(6/10/12/16) and VERIFY(10/16), ILLEGAL
+// REQUEST for anything else. Safe from several threads at once. Returns
+// 0, -1 with errno EBUSY when over qd
+int sim_io(struct sim_dev *sd, struct sg_io_hdr *hp);
+// Queues the command of hp, which must stay put until reaped. Returns
+// 0, -1 with errno ENOMEM
+int sim_submit(struct sim_dev *sd, struct sg_io_hdr *hp);
+// The next queued command to complete into *hpp, waiting for it unless
+// nowait. Returns 0, -1 with errno EAGAIN (nowait, none complete yet) or
+// ENOENT (none queued)
+int sim_reap(struct sim_dev *sd, struct sg_io_hdr **hpp, bool nowait);
+// When the next queued command completes, UINT64_MAX for none
+uint64_t sim_next_due(const struct sim_dev *sd);
+// Aborts the queued command of hp: it completes now, DID_ABORT. Returns
+// 0, -1 with errno ENODATA when it is not queued
+int sim_abort(struct sim_dev *sd, struct sg_io_hdr *hp);
+// Frees what the queue took; sd itself is the caller's
+void sim_close(struct sim_dev *sd);
+
+#endif /* SIM_H_ */
@@ -0,0 +1,695 @@
+/*
+ * spdkdev.c
+ *
+ *  A controller is attached once for the process and shared by the
+ *  namespaces named on it. spdkdev_io() keeps a queue pair of one
+ *  command per thread and device, found in a small table local to the
+ *  thread, so the retries and isolation reads of any thread go to the
+ *  drive without a lock; the queued engines open their own. The queue
+ *  pairs of a device are freed with it, those of threads gone included.
+ *  The EAL pins the thread that starts it to its main core: the affinity
+ *  it had is put back.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <linux/nvme_ioctl.h>
+
+#include "spdkdev.h"
+
+#ifdef HAVE_SPDK
+#include <spdk/env.h>
+#include <spdk/nvme.h>
+#endif
+
+#define SPDKDEV_ADDR_LEN 32 // "dddd:bb:dd.f" and then some
+
+// The PCI address and namespace of name into addr, *nsidp. Returns 0,
+// -1 when it is not "spdk:<address>[/nsid]"
+static int
+parse_name(const char *name, char *addr, uint32_t *nsidp)
+{
+	const char *s, *slash;
+	char *end;
+	size_t n;
+
+	if (!spdkdev_name(name))
+		return -1;
+	s = name + strlen(SPDKDEV_PREFIX);
+	slash = strchr(s, '/');
+	n = slash ? (size_t)(slash - s) : strlen(s);
+	if ((0 == n) || (n >= SPDKDEV_ADDR_LEN) || (NULL == memchr(s, '.', n)))
+		return -1;
+	memcpy(addr, s, n);
+	addr[n] = '\0';
+	*nsidp = 1;
+	if (slash)
+	{
+		unsigned long v = strtoul(slash + 1, &end, 0);
+
+		if ((end == slash + 1) || *end || (0 == v) || (v > UINT32_MAX))
+			return -1;
+		*nsidp = (uint32_t)v;
+	}
+	return 0;
+}
+
+bool spdkdev_name(const char *name)
+{
+	return 0 == strncmp(name, SPDKDEV_PREFIX, strlen(SPDKDEV_PREFIX));
+}
+
+int spdkdev_sysfs(const char *name, char *buf, int blen)
+{
+	char addr[SPDKDEV_ADDR_LEN];
+	uint32_t nsid;
+
+	if (parse_name(name, addr, &nsid))
+		return -1;
+	snprintf(buf, blen, "/sys/bus/pci/devices/%s", addr);
+	return 0;
+}
+
+#ifdef HAVE_SPDK
+
+#define SPDKDEV_TQ 16 // devices a thread has a spdkdev_io() queue pair for
+#define SPDKDEV_ALIGN 4096
+
+struct spdkdev_rq
+{
+	struct spdkdev_qp *qp;
+	uint64_t tag;
+	uint8_t *buf, *md; // the caller's, when bounced
+	uint32_t len, md_len;
+	uint8_t *bounce;
+	size_t bounce_len;
+	bool in; // data from the controller
+	bool busy;
+	uint32_t cdw0;
+};
+
+struct spdkdev_qp
+{
+	struct spdkdev *sd;
+	struct spdk_nvme_qpair *qpair;
+	struct spdkdev_rq *rq;
+	int qd;
+	uint64_t *tags; // of the poll under way, max of them
+	int *status;
+	int max;
+	int ndone;
+	struct spdkdev_qp *next; // of sd->qps
+};
+
+// An attached controller, shared by its namespaces
+struct ctrlr_ref
+{
+	char addr[SPDKDEV_ADDR_LEN];
+	struct spdk_nvme_ctrlr *ctrlr;
+	int refs;
+	struct ctrlr_ref *next;
+};
+
+struct spdkdev
+{
+	struct ctrlr_ref *cr;
+	struct spdk_nvme_ctrlr *ctrlr;
+	uint32_t nsid;
+	uint64_t gen; // tells it from a device freed at the same address
+	pthread_mutex_t mutex; // qps
+	struct spdkdev_qp *qps;
+};
+
+// The spdkdev_io() queue pairs of the thread
+static __thread struct
+{
+	uint64_t gen;
+	struct spdkdev_qp *qp;
+} tq[SPDKDEV_TQ];
+
+static pthread_once_t env_once = PTHREAD_ONCE_INIT;
+static int env_res = -1;
+static pthread_mutex_t ctrlr_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct ctrlr_ref *ctrlrs;
+static uint64_t next_gen = 1;
+
+static void
+env_init(void)
+{
+	struct spdk_env_opts opts;
+	cpu_set_t cs;
+	bool saved = (0 == sched_getaffinity(0, sizeof(cs), &cs));
+
+	spdk_env_opts_init(&opts);
+	opts.name = "dskread";
+	env_res = spdk_env_init(&opts);
+	if (saved)
+		sched_setaffinity(0, sizeof(cs), &cs);
+}
+
+// The status of cpl as the passthrough ioctls return it
+static int
+cpl_status(const struct spdk_nvme_cpl *cpl)
+{
+	return cpl->status.sc | (cpl->status.sct << 8) | (cpl->status.crd << 11) |
+	       (cpl->status.m << 13) | (cpl->status.dnr << 14);
+}
+
+// Whether the controller can DMA to [p, p + len) as it is
+static bool
+dma_ok(const void *p, size_t len)
+{
+	return (SPDK_VTOPHYS_ERROR != spdk_vtophys(p, NULL)) &&
+	       (SPDK_VTOPHYS_ERROR !=
+		spdk_vtophys((const uint8_t *)p + len - 1, NULL));
+}
+
+// The controller of addr, attached now or already. Returns NULL with
+// what is wrong in err
+static struct ctrlr_ref *
+ctrlr_get(const char *addr, char *err, int elen)
+{
+	struct spdk_nvme_transport_id trid;
+	struct ctrlr_ref *cr;
+	char s[64 + SPDKDEV_ADDR_LEN];
+
+	pthread_mutex_lock(&ctrlr_mutex);
+	for (cr = ctrlrs; cr && strcmp(cr->addr, addr); cr = cr->next)
+		;
+	if (cr)
+	{
+		++cr->refs;
+		pthread_mutex_unlock(&ctrlr_mutex);
+		return cr;
+	}
+	cr = (struct ctrlr_ref *)calloc(1, sizeof(*cr));
+	if (NULL == cr)
+	{
+		pthread_mutex_unlock(&ctrlr_mutex);
+		snprintf(err, elen, "out of memory");
+		return NULL;
+	}
+	memset(&trid, 0, sizeof(trid));
+	snprintf(s, sizeof(s), "trtype:PCIe traddr:%s", addr);
+	if (spdk_nvme_transport_id_parse(&trid, s))
+	{
+		pthread_mutex_unlock(&ctrlr_mutex);
+		snprintf(err, elen, "bad PCI address");
+		free(cr);
+		return NULL;
+	}
+	cr->ctrlr = spdk_nvme_connect(&trid, NULL, 0);
+	if (NULL == cr->ctrlr)
+	{
+		pthread_mutex_unlock(&ctrlr_mutex);
+		snprintf(err, elen, "SPDK could not attach the controller");
+		free(cr);
+		return NULL;
+	}
+	snprintf(cr->addr, sizeof(cr->addr), "%s", addr);
+	cr->refs = 1;
+	cr->next = ctrlrs;
+	ctrlrs = cr;
+	pthread_mutex_unlock(&ctrlr_mutex);
+	return cr;
+}
+
+static void
+ctrlr_put(struct ctrlr_ref *cr)
+{
+	struct ctrlr_ref **pp;
+
+	pthread_mutex_lock(&ctrlr_mutex);
+	if (--cr->refs > 0)
+	{
+		pthread_mutex_unlock(&ctrlr_mutex);
+		return;
+	}
+	for (pp = &ctrlrs; *pp != cr; pp = &(*pp)->next)
+		;
+	*pp = cr->next;
+	pthread_mutex_unlock(&ctrlr_mutex);
+	spdk_nvme_detach(cr->ctrlr);
+	free(cr);
+}
+
+struct spdkdev *spdkdev_open(const char *name, char *err, int elen)
+{
+	char addr[SPDKDEV_ADDR_LEN], path[PATH_MAX], drv[PATH_MAX];
+	struct spdk_nvme_ns *ns;
+	struct spdkdev *sd;
+	uint32_t nsid;
+	ssize_t n;
+	char *cp;
+
+	if (parse_name(name, addr, &nsid))
+	{
+		snprintf(err, elen, "not %s<PCI address>[/nsid]", SPDKDEV_PREFIX);
+		return NULL;
+	}
+	snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/driver", addr);
+	n = readlink(path, drv, sizeof(drv) - 1);
+	drv[(n > 0) ? n : 0] = '\0';
+	cp = strrchr(drv, '/');
+	if (strcmp(cp ? cp + 1 : drv, "vfio-pci"))
+	{
+		snprintf(err, elen, "%s is %s%s, not vfio-pci (SPDK's "
+			 "scripts/setup.sh binds it)", addr,
+			 (n > 0) ? "bound to " : "not bound",
+			 (n > 0) ? (cp ? cp + 1 : drv) : "");
+		return NULL;
+	}
+	pthread_once(&env_once, env_init);
+	if (env_res)
+	{
+		snprintf(err, elen, "SPDK environment not initialised (hugepages "
+			 "reserved? root?)");
+		return NULL;
+	}
+	sd = (struct spdkdev *)calloc(1, sizeof(*sd));
+	if (NULL == sd)
+	{
+		snprintf(err, elen, "out of memory");
+		return NULL;
+	}
+	sd->cr = ctrlr_get(addr, err, elen);
+	if (NULL == sd->cr)
+	{
+		free(sd);
+		return NULL;
+	}
+	sd->ctrlr = sd->cr->ctrlr;
+	ns = spdk_nvme_ctrlr_get_ns(sd->ctrlr, nsid);
+	if ((NULL == ns) || !spdk_nvme_ns_is_active(ns))
+	{
+		snprintf(err, elen, "no active namespace %u", nsid);
+		ctrlr_put(sd->cr);
+		free(sd);
+		return NULL;
+	}
+	sd->nsid = nsid;
+	sd->gen = __atomic_fetch_add(&next_gen, 1, __ATOMIC_RELAXED);
+	pthread_mutex_init(&sd->mutex, NULL);
+	return sd;
+}
+
+void spdkdev_close(struct spdkdev *sd)
+{
+	if (NULL == sd)
+		return;
+	while (sd->qps)
+		spdkdev_qp_close(sd->qps);
+	ctrlr_put(sd->cr);
+	pthread_mutex_destroy(&sd->mutex);
+	free(sd);
+}
+
+uint32_t spdkdev_nsid(const struct spdkdev *sd)
+{
+	return sd->nsid;
+}
+
+int spdkdev_dma_map(void *addr, size_t len)
+{
+	return spdk_mem_register(addr, len) ? -1 : 0;
+}
+
+struct admin_wait
+{
+	bool done;
+	int status;
+	uint32_t cdw0;
+};
+
+static void
+admin_done(void *arg, const struct spdk_nvme_cpl *cpl)
+{
+	struct admin_wait *aw = (struct admin_wait *)arg;
+
+	aw->status = cpl_status(cpl);
+	aw->cdw0 = cpl->cdw0;
+	aw->done = true;
+}
+
+// The command of a passthrough one; CDW2-3 are not taken, no command
+// of dskread has them
+static void
+cmd_of(struct spdk_nvme_cmd *c, uint8_t opcode, uint32_t nsid,
+       const uint32_t *cdw10)
+{
+	memset(c, 0, sizeof(*c));
+	c->opc = opcode;
+	c->nsid = nsid;
+	c->cdw10 = cdw10[0];
+	c->cdw11 = cdw10[1];
+	c->cdw12 = cdw10[2];
+	c->cdw13 = cdw10[3];
+	c->cdw14 = cdw10[4];
+	c->cdw15 = cdw10[5];
+}
+
+// Admin commands are few and small: their data always goes through a
+// DMA buffer of their own
+int spdkdev_admin(struct spdkdev *sd, struct nvme_passthru_cmd *cmd)
+{
+	uint32_t cdw10[6] = {cmd->cdw10, cmd->cdw11, cmd->cdw12,
+			     cmd->cdw13, cmd->cdw14, cmd->cdw15};
+	void *buf = (void *)(uintptr_t)cmd->addr;
+	struct admin_wait aw = {false, 0, 0};
+	struct spdk_nvme_cmd c;
+	uint8_t *dma = NULL;
+	int res;
+
+	if (cmd->data_len)
+	{
+		dma = (uint8_t *)spdk_dma_zmalloc(cmd->data_len, SPDKDEV_ALIGN,
+						  NULL);
+		if (NULL == dma)
+		{
+			errno = ENOMEM;
+			return -1;
+		}
+		if (cmd->opcode & 1) // to the controller
+			memcpy(dma, buf, cmd->data_len);
+	}
+	cmd_of(&c, cmd->opcode, cmd->nsid, cdw10);
+	res = spdk_nvme_ctrlr_cmd_admin_raw(sd->ctrlr, &c, dma, cmd->data_len,
+					    admin_done, &aw);
+	while ((0 == res) && !aw.done)
+		if (spdk_nvme_ctrlr_process_admin_completions(sd->ctrlr) < 0)
+			res = -ENXIO;
+	if ((0 == res) && (0 == aw.status) && dma && (cmd->opcode & 2))
+		memcpy(buf, dma, cmd->data_len);
+	spdk_dma_free(dma);
+	if (res)
+	{
+		errno = -res;
+		return -1;
+	}
+	cmd->result = aw.cdw0;
+	return aw.status;
+}
+
+// The queue pair of one command of the calling thread for sd
+static struct spdkdev_qp *
+thread_qp(struct spdkdev *sd)
+{
+	int k, free_k = -1;
+
+	for (k = 0; k < SPDKDEV_TQ; ++k)
+	{
+		if (tq[k].gen == sd->gen)
+			return tq[k].qp;
+		if ((free_k < 0) && (0 == tq[k].gen))
+			free_k = k;
+	}
+	// full: the oldest entry is forgotten, its queue pair stays with its
+	// device until that is closed
+	if (free_k < 0)
+		free_k = (int)(sd->gen % SPDKDEV_TQ);
+	tq[free_k].qp = spdkdev_qp_open(sd, 1);
+	tq[free_k].gen = tq[free_k].qp ? sd->gen : 0;
+	return tq[free_k].qp;
+}
+
+int spdkdev_io(struct spdkdev *sd, struct nvme_passthru_cmd64 *cmd)
+{
+	struct spdkdev_qp *qp = thread_qp(sd);
+	uint64_t tag;
+	int n, status;
+
+	if (NULL == qp)
+		return -1;
+	if (spdkdev_qp_submit(qp, cmd, 0))
+		return -1;
+	while (0 == (n = spdkdev_qp_poll(qp, &tag, &status, 1)))
+		;
+	if (n < 0)
+		return -1;
+	cmd->result = qp->rq[0].cdw0;
+	return status;
+}
+
+struct spdkdev_qp *spdkdev_qp_open(struct spdkdev *sd, int qd)
+{
+	struct spdk_nvme_io_qpair_opts o;
+	struct spdkdev_qp *qp;
+	int k;
+
+	qp = (struct spdkdev_qp *)calloc(1, sizeof(*qp));
+	if ((NULL == qp) ||
+	    (NULL == (qp->rq = (struct spdkdev_rq *)calloc(qd, sizeof(*qp->rq)))))
+	{
+		free(qp);
+		errno = ENOMEM;
+		return NULL;
+	}
+	qp->sd = sd;
+	qp->qd = qd;
+	for (k = 0; k < qd; ++k)
+		qp->rq[k].qp = qp;
+	spdk_nvme_ctrlr_get_default_io_qpair_opts(sd->ctrlr, &o, sizeof(o));
+	// one entry of a queue stays empty
+	if (o.io_queue_size < (uint32_t)qd + 1)
+		o.io_queue_size = qd + 1;
+	if (o.io_queue_requests < o.io_queue_size)
+		o.io_queue_requests = o.io_queue_size;
+	qp->qpair = spdk_nvme_ctrlr_alloc_io_qpair(sd->ctrlr, &o, sizeof(o));
+	if (NULL == qp->qpair)
+	{
+		free(qp->rq);
+		free(qp);
+		errno = EAGAIN;
+		return NULL;
+	}
+	pthread_mutex_lock(&sd->mutex);
+	qp->next = sd->qps;
+	sd->qps = qp;
+	pthread_mutex_unlock(&sd->mutex);
+	return qp;
+}
+
+void spdkdev_qp_close(struct spdkdev_qp *qp)
+{
+	struct spdkdev *sd;
+	struct spdkdev_qp **pp;
+	int k;
+
+	if (NULL == qp)
+		return;
+	sd = qp->sd;
+	pthread_mutex_lock(&sd->mutex);
+	for (pp = &sd->qps; *pp && (*pp != qp); pp = &(*pp)->next)
+		;
+	if (*pp)
+		*pp = qp->next;
+	pthread_mutex_unlock(&sd->mutex);
+	qp->max = 0;
+	spdk_nvme_ctrlr_free_io_qpair(qp->qpair);
+	for (k = 0; k < qp->qd; ++k)
+		spdk_dma_free(qp->rq[k].bounce);
+	free(qp->rq);
+	free(qp);
+}
+
+static void
+rq_done(void *arg, const struct spdk_nvme_cpl *cpl)
+{
+	struct spdkdev_rq *rq = (struct spdkdev_rq *)arg;
+	struct spdkdev_qp *qp = rq->qp;
+	int status = cpl_status(cpl);
+
+	if (rq->buf && rq->in && (0 == status))
+	{
+		memcpy(rq->buf, rq->bounce, rq->len);
+		if (rq->md)
+			memcpy(rq->md, rq->bounce + rq->len, rq->md_len);
+	}
+	rq->cdw0 = cpl->cdw0;
+	rq->busy = false;
+	// none when aborted as the queue pair is freed
+	if (qp->ndone < qp->max)
+	{
+		qp->tags[qp->ndone] = rq->tag;
+		qp->status[qp->ndone++] = status;
+	}
+}
+
+int spdkdev_qp_submit(struct spdkdev_qp *qp,
+		      const struct nvme_passthru_cmd64 *cmd, uint64_t tag)
+{
+	uint32_t cdw10[6] = {cmd->cdw10, cmd->cdw11, cmd->cdw12,
+			     cmd->cdw13, cmd->cdw14, cmd->cdw15};
+	uint8_t *buf = (uint8_t *)(uintptr_t)cmd->addr;
+	uint8_t *md = (uint8_t *)(uintptr_t)cmd->metadata;
+	struct spdkdev_rq *rq;
+	struct spdk_nvme_cmd c;
+	size_t need;
+	int k, res;
+
+	for (k = 0; (k < qp->qd) && qp->rq[k].busy; ++k)
+		;
+	if (k == qp->qd)
+	{
+		errno = EBUSY;
+		return -1;
+	}
+	rq = qp->rq + k;
+	rq->tag = tag;
+	rq->in = !!(cmd->opcode & 2);
+	rq->len = cmd->data_len;
+	rq->md_len = cmd->metadata_len;
+	rq->buf = rq->md = NULL;
+	if (!md || !cmd->metadata_len)
+		md = NULL;
+	if ((cmd->data_len && !dma_ok(buf, cmd->data_len)) ||
+	    (md && !dma_ok(md, cmd->metadata_len)))
+	{
+		// data and metadata bounced together, the metadata after
+		need = (size_t)cmd->data_len + (md ? cmd->metadata_len : 0);
+		if (rq->bounce_len < need)
+		{
+			spdk_dma_free(rq->bounce);
+			rq->bounce = (uint8_t *)spdk_dma_malloc(need, SPDKDEV_ALIGN,
+								NULL);
+			rq->bounce_len = rq->bounce ? need : 0;
+			if (NULL == rq->bounce)
+			{
+				errno = ENOMEM;
+				return -1;
+			}
+		}
+		rq->buf = buf;
+		rq->md = md;
+		if (cmd->opcode & 1) // to the controller
+		{
+			memcpy(rq->bounce, buf, cmd->data_len);
+			if (md)
+				memcpy(rq->bounce + cmd->data_len, md,
+				       cmd->metadata_len);
+		}
+		buf = rq->bounce;
+		if (md)
+			md = rq->bounce + cmd->data_len;
+	}
+	cmd_of(&c, cmd->opcode, cmd->nsid, cdw10);
+	res = md ? spdk_nvme_ctrlr_cmd_io_raw_with_md(qp->sd->ctrlr, qp->qpair,
+						      &c, buf, cmd->data_len, md,
+						      rq_done, rq)
+		 : spdk_nvme_ctrlr_cmd_io_raw(qp->sd->ctrlr, qp->qpair, &c, buf,
+					      cmd->data_len, rq_done, rq);
+	if (res)
+	{
+		errno = -res;
+		return -1;
+	}
+	rq->busy = true;
+	return 0;
+}
+
+int spdkdev_qp_poll(struct spdkdev_qp *qp, uint64_t *tags, int *status,
+		    int max)
+{
+	int32_t n;
+
+	qp->tags = tags;
+	qp->status = status;
+	qp->max = max;
+	qp->ndone = 0;
+	n = spdk_nvme_qpair_process_completions(qp->qpair, max);
+	if (n < 0)
+	{
+		errno = ENXIO;
+		return -1;
+	}
+	return qp->ndone;
+}
+
+#else /* HAVE_SPDK */
+
+struct spdkdev *spdkdev_open(const char *name, char *err, int elen)
+{
+	(void)name;
+	snprintf(err, elen, "dskread was built without SPDK");
+	return NULL;
+}
+
+void spdkdev_close(struct spdkdev *sd)
+{
+	(void)sd;
+}
+
+uint32_t spdkdev_nsid(const struct spdkdev *sd)
+{
+	(void)sd;
+	return 0;
+}
+
+int spdkdev_dma_map(void *addr, size_t len)
+{
+	(void)addr;
+	(void)len;
+	return -1;
+}
+
+int spdkdev_admin(struct spdkdev *sd, struct nvme_passthru_cmd *cmd)
+{
+	(void)sd;
+	(void)cmd;
+	errno = ENOSYS;
+	return -1;
+}
+
+int spdkdev_io(struct spdkdev *sd, struct nvme_passthru_cmd64 *cmd)
+{
+	(void)sd;
+	(void)cmd;
+	errno = ENOSYS;
+	return -1;
+}
+
+struct spdkdev_qp *spdkdev_qp_open(struct spdkdev *sd, int qd)
+{
+	(void)sd;
+	(void)qd;
+	errno = ENOSYS;
+	return NULL;
+}
+
+void spdkdev_qp_close(struct spdkdev_qp *qp)
+{
+	(void)qp;
+}
+
+int spdkdev_qp_submit(struct spdkdev_qp *qp,
+		      const struct nvme_passthru_cmd64 *cmd, uint64_t tag)
+{
+	(void)qp;
+	(void)cmd;
+	(void)tag;
+	errno = ENOSYS;
+	return -1;
+}
+
+int spdkdev_qp_poll(struct spdkdev_qp *qp, uint64_t *tags, int *status,
+		    int max)
+{
+	(void)qp;
+	(void)tags;
+	(void)status;
+	(void)max;
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif /* HAVE_SPDK */
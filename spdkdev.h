@@ -0,0 +1,73 @@
+/*
+ * spdkdev.h
+ *
+ *  NVMe controllers driven from user space with SPDK, named
+ *  "spdk:<PCI address>[/nsid]" on the command line (namespace 1 when
+ *  not given), for qualification hosts where the kernel's submission
+ *  and interrupt path is what the scan waits on. The controller is
+ *  bound to vfio-pci beforehand (SPDK's scripts/setup.sh does) and
+ *  claimed by the process, nothing else has it while dskread runs.
+ *
+ *  Commands are given as the kernel's NVMe passthrough ioctls take them,
+ *  so what builds them for /dev/ngXnY builds them here too, and the
+ *  status comes back as the ioctls return it. Each thread submits on
+ *  queue pairs of its own and polls them for the completions: no
+ *  interrupts, no locks between threads. Data moves by DMA to and from
+ *  the hugepages of the iobuf.c pool, registered with SPDK as the pool
+ *  maps them; a command on any other buffer goes through a bounce
+ *  buffer.
+ *
+ *  Built without SPDK (HAVE_SPDK, set by -DDSKREAD_SPDK=ON), the names are
+ *  known but do not open.
+ */
+
+#ifndef SPDKDEV_H_
+#define SPDKDEV_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPDKDEV_PREFIX "spdk:"
+
+struct spdkdev;
+struct spdkdev_qp;
+struct nvme_passthru_cmd;
+struct nvme_passthru_cmd64;
+
+// Whether name is that of a controller driven with SPDK
+bool spdkdev_name(const char *name);
+// The sysfs directory of the PCI function of name into buf, blen bytes.
+// Returns 0, -1 when name is not one
+int spdkdev_sysfs(const char *name, char *buf, int blen);
+// Claims the controller of name, checks its namespace. Returns NULL with
+// what is wrong in err, elen bytes
+struct spdkdev *spdkdev_open(const char *name, char *err, int elen);
+// Lets it go, with the queue pairs of every thread; nothing may be in
+// flight
+void spdkdev_close(struct spdkdev *sd);
+uint32_t spdkdev_nsid(const struct spdkdev *sd);
+// Registers [addr, addr + len), whole hugepages, for DMA; the callback
+// of iobuf_set_dma(). Returns 0, -1 when refused
+int spdkdev_dma_map(void *addr, size_t len);
+// An admin command as NVME_IOCTL_ADMIN_CMD takes it, waited for. Returns
+// 0, the status (SCT << 8 | SC, CRD, M and DNR above), -1 with errno
+int spdkdev_admin(struct spdkdev *sd, struct nvme_passthru_cmd *cmd);
+// An I/O command as NVME_IOCTL_IO64_CMD takes it, on a queue pair of the
+// calling thread, polled for. Returns as spdkdev_admin()
+int spdkdev_io(struct spdkdev *sd, struct nvme_passthru_cmd64 *cmd);
+// A queue pair for qd commands at once, used by the calling thread
+// alone. Returns NULL with errno
+struct spdkdev_qp *spdkdev_qp_open(struct spdkdev *sd, int qd);
+void spdkdev_qp_close(struct spdkdev_qp *qp);
+// Queues cmd; tag comes back with its completion. Returns 0, -1 with
+// errno, EBUSY when qd are in flight
+int spdkdev_qp_submit(struct spdkdev_qp *qp,
+		      const struct nvme_passthru_cmd64 *cmd, uint64_t tag);
+// Reaps the completion queue once, up to max completions into tags and
+// status (as spdkdev_admin() returns it). Returns how many, -1 with
+// errno ENXIO when the controller failed or was removed
+int spdkdev_qp_poll(struct spdkdev_qp *qp, uint64_t *tags, int *status,
+		    int max);
+
+#endif /* SPDKDEV_H_ */
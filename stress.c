@@ -0,0 +1,725 @@
+/*
+ * stress.c
+ *
+ *  dskread_stress: schedules of runs of libdskread on simulated disks,
+ *  each drawn from a seed by the counter based rand_pattern_key() of
+ *  util.c, draw n of schedule s being rand_pattern_key(s, n), so any
+ *  one runs again, the same, from its seed alone. A schedule is 1 to -d
+ *  devices of random size, block size, latency and faults (bad and
+ *  recovered blocks, unit attentions, full queues, a queue depth the
+ *  disk refuses past), a run of them all with random --qd and -n, and
+ *  events at random times while it goes: max-rate, qd and bpt changes
+ *  and pauses through dskread_control(), and in one schedule of four a
+ *  dskread_cancel(), the rest then read by a second run with --resume
+ *  from the --checkpoint of the first. Each schedule runs in a child of
+ *  its own, killed when it hangs for -t seconds.
+ *
+ *  Checked of every device, from the --trace of each run and from
+ *  dskread_badmap(): no READ that ended well past the end of the disk,
+ *  each block read by one once in a run and in one run at least, the
+ *  bad blocks mapped, with --coe, exactly those the disk was given and
+ *  nothing else mapped, and the last run ending well on every device.
+ *  sim: disks are read by the queued sg-async engine, completions out
+ *  of order and READs refused by a full queue sent again. With --qd
+ *  over 1 each disk holds a READ STRESS_MIN_LAT us at least, and
+ *  unless an event caps the queue at 1 or the rate, the trace must
+ *  show READs queued behind others. The blocks of a READ that failed
+ *  are covered by the one the side queue reads them again with, traced
+ *  too. A trace that dropped records fails the schedule, its coverage
+ *  not known. Each schedule's counters are a line: READs, seconds,
+ *  READs/s, MB/s and the deepest queue the trace saw.
+ *
+ *    dskread_stress [-s seed] [-n schedules] [-d devices] [-t secs] [-k]
+ *                   [-v]
+ *
+ *  Schedule k of a run is seed + k; a failing one is run alone again by
+ *  -s with its seed and -n 1, -k keeping its log, trace and checkpoint.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "sg_lib.h"
+#include "common.h"
+#include "dskread.h"
+#include "trace.h"
+
+#define STRESS_DEVS 8	   // -d default
+#define STRESS_MAX_DEVS 32
+#define STRESS_MAX_BAD 4   // bad extents of a disk
+#define STRESS_MAX_REC 2   // recovered blocks of a disk without bad ones
+#define STRESS_MAX_EVENTS 16
+#define STRESS_EVENT_NS 50000000ULL // events fall in the first 50 ms
+#define STRESS_MIN_LAT 200	    // us a READ is held at least, --qd > 1
+#define STRESS_SECS 120		    // -t default
+#define STRESS_POLL_MS 1
+
+#define EV_RATE 0  // max-rate v bytes/s, 0 lifts it
+#define EV_QD 1	   // qd v
+#define EV_BPT 2   // bpt v
+#define EV_PAUSE 3 // pause, resume v ns later
+
+struct sdisk
+{
+	char name[512];
+	int64_t blocks;
+	int bs;
+	int64_t bad[STRESS_MAX_BAD][2]; // lba, blocks
+	int nbad;
+};
+
+struct sevent
+{
+	uint64_t at_ns; // after the start of the run
+	int kind;	// EV_*
+	long v;
+};
+
+struct sched
+{
+	uint64_t seed;
+	unsigned int n; // draws so far
+	int ndev;
+	struct sdisk dev[STRESS_MAX_DEVS];
+	int qd, bpt;
+	struct sevent ev[STRESS_MAX_EVENTS];
+	int nev;
+	uint64_t cancel_ns; // the first run's, 0 -> one run only
+};
+
+// What the runs of a schedule saw of a device
+struct sseen
+{
+	uint8_t *run;	 // READs that ended well of each block, this run
+	uint8_t *all;	 // in any run
+	uint8_t *mapped; // bad, by dskread_badmap()
+	int64_t other;	 // weak or miscompared blocks mapped
+};
+
+struct stally
+{
+	uint64_t reads;
+	uint64_t bytes;
+	int qd_max;
+	double secs;
+};
+
+static int verbose;
+static FILE *rep; // the parent's stdout, the child's own a log
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t
+below(struct sched *s, uint64_t n)
+{
+	return rand_pattern_key(s->seed, s->n++) % n;
+}
+
+static bool
+in_bad(const struct sdisk *dk, int64_t lba)
+{
+	int k;
+
+	for (k = 0; k < dk->nbad; ++k)
+		if ((lba >= dk->bad[k][0]) && (lba < dk->bad[k][0] + dk->bad[k][1]))
+			return true;
+	return false;
+}
+
+static int
+cmp_event(const void *a, const void *b)
+{
+	uint64_t x = ((const struct sevent *)a)->at_ns;
+	uint64_t y = ((const struct sevent *)b)->at_ns;
+
+	return (x > y) - (x < y);
+}
+
+// Schedule seed, of up to maxdev devices
+static void
+sched_make(struct sched *s, uint64_t seed, int maxdev)
+{
+	static const char *dist[] = {"fixed", "uniform", "exp"};
+	struct sdisk *dk;
+	struct sevent *ep;
+	int64_t lba, cmds;
+	int k, j, n, m, nrec;
+
+	memset(s, 0, sizeof(*s));
+	s->seed = seed;
+	s->ndev = 1 + (int)below(s, maxdev);
+	s->qd = 1 + (int)below(s, 16);
+	s->bpt = 8 << below(s, 5);
+	for (k = 0; k < s->ndev; ++k)
+	{
+		dk = s->dev + k;
+		dk->bs = below(s, 4) ? 512 : 4096;
+		dk->blocks = 1024 + below(s, (512 == dk->bs) ? 65536 : 8192);
+		n = snprintf(dk->name, sizeof(dk->name),
+			     "sim:blocks=%" PRId64 ",bs=%d,lat=%d,dist=%s,"
+			     "seed=%" PRIu64, dk->blocks, dk->bs,
+			     below(s, 3) ? (int)below(s, 50) : 0,
+			     dist[below(s, 3)], below(s, 1ULL << 32));
+		dk->nbad = (int)below(s, STRESS_MAX_BAD + 1);
+		for (j = 0; j < dk->nbad; ++j)
+		{
+			dk->bad[j][0] = below(s, dk->blocks);
+			dk->bad[j][1] = 1 + below(s, 4);
+			if (dk->bad[j][0] + dk->bad[j][1] > dk->blocks)
+				dk->bad[j][1] = dk->blocks - dk->bad[j][0];
+			n += snprintf(dk->name + n, sizeof(dk->name) - n,
+				      ",bad=%" PRId64 "+%" PRId64, dk->bad[j][0],
+				      dk->bad[j][1]);
+		}
+		/* the sim returns all of a READ with a recovered error in
+		 * it, so one would hide a bad block after it */
+		nrec = dk->nbad ? 0 : (int)below(s, STRESS_MAX_REC + 1);
+		for (j = 0; j < nrec; ++j)
+		{
+			lba = below(s, dk->blocks);
+			n += snprintf(dk->name + n, sizeof(dk->name) - n,
+				      ",rec=%" PRId64, lba);
+		}
+		/* fewer unit attentions than a device takes in a run (10),
+		 * with -n 8 and every READ of it retried once */
+		cmds = 2 * dk->blocks / 8 + 64;
+		if (0 == below(s, 3))
+			n += snprintf(dk->name + n, sizeof(dk->name) - n,
+				      ",ua=%" PRId64, cmds / 6 + 1 + below(s, cmds));
+		if (0 == below(s, 3))
+			n += snprintf(dk->name + n, sizeof(dk->name) - n,
+				      ",qfull=%d", 10 + (int)below(s, 200));
+		if (0 == below(s, 4))
+			n += snprintf(dk->name + n, sizeof(dk->name) - n, ",qd=%d",
+				      1 + (int)below(s, 4));
+		/* a READ that ends before the next is sent, on a slow
+		 * runner, would never have one queued behind it */
+		if (s->qd > 1)
+			n += snprintf(dk->name + n, sizeof(dk->name) - n,
+				      ",min=%d", STRESS_MIN_LAT);
+	}
+	m = (int)below(s, STRESS_MAX_EVENTS / 2); // a pause is two
+	for (k = 0; k < m; ++k)
+	{
+		ep = s->ev + s->nev++;
+		ep->at_ns = below(s, STRESS_EVENT_NS);
+		ep->kind = (int)below(s, 4);
+		switch (ep->kind)
+		{
+		case EV_RATE:
+			ep->v = below(s, 4) ? (long)(1 + below(s, 200)) << 20 : 0;
+			break;
+		case EV_QD:
+			ep->v = (long)below(s, s->qd + 1);
+			break;
+		case EV_BPT:
+			ep->v = below(s, 2) ? 8L << below(s, 5) : 0;
+			break;
+		default:
+			ep->v = (long)(1 + below(s, 5)) * 1000000L;
+			ep[1].at_ns = ep->at_ns + ep->v; // its resume
+			ep[1].kind = EV_PAUSE;
+			ep[1].v = 0;
+			++s->nev;
+			break;
+		}
+	}
+	qsort(s->ev, s->nev, sizeof(s->ev[0]), cmp_event);
+	if (0 == below(s, 4))
+		s->cancel_ns = 1 + below(s, STRESS_EVENT_NS);
+}
+
+// The control command of event ep into cmd
+static void
+event_cmd(const struct sevent *ep, char *cmd, size_t len)
+{
+	switch (ep->kind)
+	{
+	case EV_RATE:
+		snprintf(cmd, len, "max-rate %ld", ep->v);
+		break;
+	case EV_QD:
+		snprintf(cmd, len, "qd %ld", ep->v);
+		break;
+	case EV_BPT:
+		snprintf(cmd, len, "bpt %ld", ep->v);
+		break;
+	default:
+		snprintf(cmd, len, "%s", ep->v ? "pause" : "resume");
+		break;
+	}
+}
+
+static void
+run_ended(void *arg, int event, int dev)
+{
+	(void)dev;
+	if (DSKREAD_EV_RUN == event)
+		*(int *)arg = 1;
+}
+
+static void
+badmap_ext(void *arg, int64_t lba, int64_t len, int kind)
+{
+	struct sseen *sn = (struct sseen *)arg;
+
+	if (DSKREAD_BAD != kind)
+	{
+		sn->other += len;
+		return;
+	}
+	for (; len > 0; ++lba, --len)
+		if (lba >= 0)
+			sn->mapped[lba] = 1;
+}
+
+// A failure of the schedule, to the parent
+static int
+fail(const struct sched *s, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static int
+fail(const struct sched *s, const char *fmt, ...)
+{
+	va_list ap;
+
+	fprintf(rep, "seed 0x%" PRIx64 ": ", s->seed);
+	va_start(ap, fmt);
+	vfprintf(rep, fmt, ap);
+	va_end(ap);
+	fputc('\n', rep);
+	return 1;
+}
+
+// The records of trace path into the run counts of sn and t. Returns the
+// failures
+static int
+trace_tally(const struct sched *s, const char *path, struct sseen *sn,
+	    struct stally *t)
+{
+	struct trace_hdr h;
+	struct trace_rec r;
+	uint16_t len;
+	char name[512];
+	int k, bad = 0;
+	int64_t b;
+	FILE *fp = fopen(path, "rb");
+
+	if (NULL == fp)
+		return fail(s, "no trace %s: %s", path, strerror(errno));
+	if ((1 != fread(&h, sizeof(h), 1, fp)) ||
+	    memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) ||
+	    (TRACE_BOM != h.bom) || (sizeof(r) != h.rec_size) ||
+	    ((int)h.ndev != s->ndev))
+	{
+		fclose(fp);
+		return fail(s, "%s is not a trace of its %d devices", path,
+			    s->ndev);
+	}
+	for (k = 0; k < s->ndev; ++k)
+		if ((1 != fread(&len, sizeof(len), 1, fp)) ||
+		    (len >= sizeof(name)) || (len != fread(name, 1, len, fp)))
+		{
+			fclose(fp);
+			return fail(s, "%s: truncated names", path);
+		}
+	while (1 == fread(&r, sizeof(r), 1, fp))
+	{
+		if (TRACE_END == r.op)
+		{
+			if (r.lba)
+				bad += fail(s, "the trace dropped %" PRId64
+					    " records, coverage not known", r.lba);
+			break;
+		}
+		if ((TRACE_READ != r.op) || (r.dev >= s->ndev))
+			continue;
+		++t->reads;
+		if (r.qd > t->qd_max)
+			t->qd_max = r.qd;
+		if (r.status && (SG_LIB_CAT_RECOVERED != r.status))
+			continue; // read again, by the side queue
+		t->bytes += (uint64_t)r.blocks * s->dev[r.dev].bs;
+		if ((r.lba < 0) || (r.lba + r.blocks > s->dev[r.dev].blocks))
+		{
+			bad += fail(s, "dev %d: READ of %u at lba %" PRId64
+				    " past its %" PRId64 " blocks", r.dev,
+				    r.blocks, r.lba, s->dev[r.dev].blocks);
+			continue;
+		}
+		for (b = r.lba; b < r.lba + r.blocks; ++b)
+			if (sn[r.dev].run[b] < UINT8_MAX)
+				++sn[r.dev].run[b];
+	}
+	fclose(fp);
+	return bad;
+}
+
+// One run of s, the first (run 0) or the one resuming it, and its
+// checks. Returns the failures
+static int
+sched_run(const struct sched *s, int run, const char *dir,
+	  struct sseen *sn, struct stally *t)
+{
+	char *argv[STRESS_MAX_DEVS + 16], trace[256], ck[256], qd[16], bpt[16];
+	char cmd[64], reply[256];
+	struct dskread_dev st[STRESS_MAX_DEVS];
+	struct dskread *d;
+	struct pollfd pfd;
+	uint64_t t0, el;
+	int argc = 0, k, bad = 0, ended = 0, next = 0, res;
+	int64_t b, lo;
+	bool cancel = (0 == run) && s->cancel_ns;
+
+	snprintf(trace, sizeof(trace), "%s/trace.%d", dir, run);
+	snprintf(ck, sizeof(ck), "%s/checkpoint", dir);
+	snprintf(qd, sizeof(qd), "%d", s->qd);
+	snprintf(bpt, sizeof(bpt), "%d", s->bpt);
+	for (k = 0; k < s->ndev; ++k)
+		argv[argc++] = (char *)s->dev[k].name;
+	argv[argc++] = (char *)"--coe";
+	argv[argc++] = (char *)"1";
+	argv[argc++] = (char *)"--qd";
+	argv[argc++] = qd;
+	argv[argc++] = (char *)"-n";
+	argv[argc++] = bpt;
+	argv[argc++] = (char *)"--trace";
+	argv[argc++] = trace;
+	if (s->cancel_ns)
+	{
+		argv[argc++] = (char *)"--checkpoint";
+		argv[argc++] = ck;
+	}
+	if (run)
+		argv[argc++] = (char *)"--resume";
+
+	d = dskread_open();
+	if ((NULL == d) || dskread_configure(d, argc, argv))
+		return fail(s, "dskread_open: %s", strerror(errno));
+	dskread_set_callback(d, run_ended, &ended);
+	t0 = now_ns();
+	if (dskread_start(d))
+	{
+		dskread_close(d);
+		return fail(s, "dskread_start: %s", strerror(errno));
+	}
+	pfd.fd = dskread_event_fd(d);
+	pfd.events = POLLIN;
+	while (!ended)
+	{
+		if (poll(&pfd, 1, STRESS_POLL_MS) > 0)
+			dskread_dispatch(d);
+		el = now_ns() - t0;
+		for (; (next < s->nev) && (s->ev[next].at_ns <= el); ++next)
+		{
+			event_cmd(s->ev + next, cmd, sizeof(cmd));
+			if (dskread_control(d, cmd, reply, sizeof(reply)) &&
+			    verbose)
+				fprintf(rep, "seed 0x%" PRIx64 ": %s before the "
+					"devices are there\n", s->seed, cmd);
+		}
+		if (cancel && (el >= s->cancel_ns))
+		{
+			dskread_cancel(d);
+			cancel = false;
+		}
+	}
+	res = dskread_wait(d);
+	t->secs += (now_ns() - t0) / 1e9;
+	if (dskread_poll(d, st, STRESS_MAX_DEVS) != s->ndev)
+		bad += fail(s, "run %d: not %d devices", run, s->ndev);
+	for (k = 0; k < s->ndev; ++k)
+		if (dskread_badmap(d, k, badmap_ext, sn + k))
+			bad += fail(s, "run %d: no bad map of dev %d", run, k);
+	dskread_close(d);
+	if (bad)
+		return bad;
+	for (k = 0; k < s->ndev; ++k)
+		if (!st[k].done)
+			bad += fail(s, "run %d: dev %d not done", run, k);
+	if (!s->cancel_ns || run)
+	{
+		if (res)
+			bad += fail(s, "run %d: exit status %d", run, res);
+		for (k = 0; k < s->ndev; ++k)
+			if (st[k].result)
+				bad += fail(s, "run %d: dev %d ended with %d", run, k,
+					    st[k].result);
+	}
+
+	for (k = 0; k < s->ndev; ++k)
+		memset(sn[k].run, 0, s->dev[k].blocks);
+	bad += trace_tally(s, trace, sn, t);
+	for (k = 0; k < s->ndev; ++k)
+		for (b = 0; b < s->dev[k].blocks; ++b)
+		{
+			if (sn[k].run[b] > 1)
+			{
+				/* a run of them, one line */
+				for (lo = b; (b + 1 < s->dev[k].blocks) &&
+					     (sn[k].run[b + 1] > 1); ++b)
+					;
+				bad += fail(s, "run %d: dev %d: lba %" PRId64 "-%"
+					    PRId64 " read more than once", run, k,
+					    lo, b);
+			}
+			if (sn[k].run[b])
+				sn[k].all[b] = 1;
+		}
+	if (!verbose)
+		return bad;
+	fprintf(rep, "seed 0x%" PRIx64 ": run %d done, exit status %d\n",
+		s->seed, run, res);
+	return bad;
+}
+
+// Whether an event of s may keep a READ from being queued behind
+// another: qd 1 or a max-rate, which on a slow runner can land before
+// the first READ is sent
+static bool
+queue_held(const struct sched *s)
+{
+	int k;
+
+	for (k = 0; k < s->nev; ++k)
+		if (((EV_QD == s->ev[k].kind) && (1 == s->ev[k].v)) ||
+		    ((EV_RATE == s->ev[k].kind) && s->ev[k].v))
+			return true;
+	return false;
+}
+
+// Schedule s whole, in the child. Returns 0 when it passed
+static int
+sched_check(struct sched *s, const char *dir)
+{
+	struct sseen sn[STRESS_MAX_DEVS];
+	struct stally t;
+	const struct sdisk *dk;
+	int k, bad = 0;
+	int64_t b, lo;
+
+	memset(sn, 0, sizeof(sn));
+	memset(&t, 0, sizeof(t));
+	for (k = 0; k < s->ndev; ++k)
+	{
+		sn[k].run = (uint8_t *)calloc(3, s->dev[k].blocks);
+		if (NULL == sn[k].run)
+			return fail(s, "out of memory");
+		sn[k].all = sn[k].run + s->dev[k].blocks;
+		sn[k].mapped = sn[k].all + s->dev[k].blocks;
+	}
+	bad = sched_run(s, 0, dir, sn, &t);
+	if ((0 == bad) && s->cancel_ns)
+		bad = sched_run(s, 1, dir, sn, &t);
+	/* sim: disks are read by the queued sg-async engine */
+	if ((0 == bad) && (s->qd > 1) && !queue_held(s) && (t.qd_max < 2))
+		bad += fail(s, "--qd %d, but no READ was queued behind another",
+			    s->qd);
+	for (k = 0; (0 == bad) && (k < s->ndev); ++k)
+	{
+		dk = s->dev + k;
+		if (sn[k].other)
+			bad += fail(s, "dev %d: %" PRId64 " weak or miscompared "
+				    "blocks mapped", k, sn[k].other);
+		for (b = 0; b < dk->blocks; ++b)
+		{
+			if (!sn[k].all[b])
+			{
+				for (lo = b; (b + 1 < dk->blocks) && !sn[k].all[b + 1];
+				     ++b)
+					;
+				bad += fail(s, "dev %d: lba %" PRId64 "-%" PRId64
+					    " never read", k, lo, b);
+				continue;
+			}
+			if (sn[k].mapped[b] != in_bad(dk, b))
+				bad += fail(s, "dev %d: lba %" PRId64 " %s", k, b,
+					    sn[k].mapped[b] ? "mapped bad, it is not"
+							    : "bad, not mapped");
+		}
+	}
+	for (k = 0; k < s->ndev; ++k)
+		free(sn[k].run);
+	fprintf(rep, "seed 0x%" PRIx64 ": %d devices, %d events%s, %" PRIu64
+		" READs, %.2f s, %.0f READs/s, %.1f MB/s, qd max %d: %s\n",
+		s->seed, s->ndev, s->nev, s->cancel_ns ? ", cancel, resume" : "",
+		t.reads, t.secs, t.secs > 0 ? t.reads / t.secs : 0.0,
+		t.secs > 0 ? t.bytes / t.secs / 1e6 : 0.0, t.qd_max,
+		bad ? "FAILED" : "ok");
+	fflush(rep);
+	return bad ? 1 : 0;
+}
+
+// Runs schedule seed in a child, its output to log in dir. Returns 0
+// when it passed
+static int
+sched_fork(uint64_t seed, int maxdev, int secs, const char *dir)
+{
+	struct sched s;
+	char log[256];
+	uint64_t end = now_ns() + (uint64_t)secs * 1000000000ULL;
+	pid_t pid;
+	int fd, status;
+
+	snprintf(log, sizeof(log), "%s/log", dir);
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0)
+	{
+		perror("fork");
+		return 1;
+	}
+	if (0 == pid)
+	{
+		rep = fdopen(dup(STDOUT_FILENO), "w");
+		fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if ((NULL == rep) || (fd < 0))
+			_exit(2);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		close(fd);
+		sched_make(&s, seed, maxdev);
+		status = sched_check(&s, dir);
+		fflush(stdout);
+		fflush(rep);
+		_exit(status);
+	}
+	while (0 == waitpid(pid, &status, WNOHANG))
+	{
+		if (now_ns() > end)
+		{
+			kill(pid, SIGKILL);
+			waitpid(pid, &status, 0);
+			printf("seed 0x%" PRIx64 ": hung, killed after %d s\n", seed,
+			       secs);
+			return 1;
+		}
+		usleep(10000);
+	}
+	if (WIFSIGNALED(status))
+	{
+		printf("seed 0x%" PRIx64 ": killed by signal %d\n", seed,
+		       WTERMSIG(status));
+		return 1;
+	}
+	return WEXITSTATUS(status) ? 1 : 0;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+		"Usage: dskread_stress [-s seed] [-n schedules] [-d devices] "
+		"[-t secs] [-k] [-v]\n"
+		"  -s  seed of the first schedule, schedule k is seed + k "
+		"(default: the time)\n"
+		"  -n  schedules to run (default 100)\n"
+		"  -d  most devices of a schedule, 1-%d (default %d)\n"
+		"  -t  seconds a schedule may take before it is killed "
+		"(default %d)\n"
+		"  -k  keep the log, traces and checkpoint of every schedule, "
+		"not only of those failing\n"
+		"  -v  each run's end too\n",
+		STRESS_MAX_DEVS, STRESS_DEVS, STRESS_SECS);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	char base[] = "/tmp/dskread_stress.XXXXXX", dir[sizeof(base) + 32];
+	uint64_t seed = (uint64_t)time(NULL);
+	int c, k, n = 100, maxdev = STRESS_DEVS, secs = STRESS_SECS, failed = 0;
+	bool keep = false;
+
+	while ((c = getopt(argc, argv, "s:n:d:t:kv")) != -1)
+	{
+		switch (c)
+		{
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'n':
+			n = atoi(optarg);
+			break;
+		case 'd':
+			maxdev = atoi(optarg);
+			if ((maxdev < 1) || (maxdev > STRESS_MAX_DEVS))
+				usage();
+			break;
+		case 't':
+			secs = atoi(optarg);
+			break;
+		case 'k':
+			keep = true;
+			break;
+		case 'v':
+			++verbose;
+			break;
+		default:
+			usage();
+		}
+	}
+	if ((n < 1) || (secs < 1) || (optind < argc))
+		usage();
+	if (NULL == mkdtemp(base))
+	{
+		perror(base);
+		return 2;
+	}
+	rep = stdout;
+	for (k = 0; k < n; ++k)
+	{
+		snprintf(dir, sizeof(dir), "%s/%d", base, k);
+		if (mkdir(dir, 0755))
+		{
+			perror(dir);
+			return 2;
+		}
+		if (sched_fork(seed + k, maxdev, secs, dir))
+		{
+			++failed;
+			printf("seed 0x%" PRIx64 ": kept in %s, again with "
+			       "dskread_stress -s 0x%" PRIx64 " -n 1 -d %d\n",
+			       seed + k, dir, seed + k, maxdev);
+		}
+		else if (!keep)
+		{
+			char path[sizeof(dir) + 16];
+			static const char *files[] = {"log", "trace.0", "trace.1",
+						      "checkpoint"};
+			int j;
+
+			for (j = 0; j < 4; ++j)
+			{
+				snprintf(path, sizeof(path), "%s/%s", dir, files[j]);
+				unlink(path);
+			}
+			rmdir(dir);
+		}
+	}
+	if (!failed && !keep)
+		rmdir(base);
+	printf("%d schedules from seed 0x%" PRIx64 ", %d failed\n", n, seed,
+	       failed);
+	return failed ? 1 : 0;
+}
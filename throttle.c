@@ -0,0 +1,87 @@
+/*
+ * throttle.c
+ *
+ *  One mutex for every bucket: a take spans the buckets of a device
+ *  and those of the process, and READs are submitted at most some
+ *  thousands per second, so it is never contended for long.
+ */
+
+#include <pthread.h>
+#include <time.h>
+
+#include "throttle.h"
+
+static pthread_mutex_t tb_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+refill(struct tbucket *b, uint64_t now)
+{
+	double burst = b->rate * TB_BURST_SECS;
+
+	if (b->last_ns && (now > b->last_ns))
+		b->tokens += b->rate * (now - b->last_ns) / 1e9;
+	if (b->tokens > burst)
+		b->tokens = burst;
+	b->last_ns = now;
+}
+
+void tb_set(struct tbucket *b, double rate)
+{
+	if (rate < 0)
+		rate = 0;
+	pthread_mutex_lock(&tb_mutex);
+	if (b->rate != rate) // the same cap again keeps its tokens, or debt
+	{
+		b->rate = rate;
+		b->tokens = b->rate * TB_BURST_SECS;
+		b->last_ns = now_ns();
+	}
+	pthread_mutex_unlock(&tb_mutex);
+}
+
+uint64_t tb_take(struct tbucket *const *b, const double *n, int nb)
+{
+	uint64_t now = now_ns(), wait = 0, w;
+	int k;
+
+	pthread_mutex_lock(&tb_mutex);
+	for (k = 0; k < nb; ++k)
+	{
+		if (0 == b[k]->rate)
+			continue;
+		refill(b[k], now);
+		if (b[k]->tokens >= 0)
+			continue;
+		w = (uint64_t)(-b[k]->tokens / b[k]->rate * 1e9) + 1;
+		if (w > wait)
+			wait = w;
+	}
+	if (0 == wait)
+		for (k = 0; k < nb; ++k)
+		{
+			if (b[k]->rate)
+				b[k]->tokens -= n[k];
+			b[k]->taken += n[k];
+		}
+	pthread_mutex_unlock(&tb_mutex);
+	return wait;
+}
+
+double tb_taken(const struct tbucket *b)
+{
+	double taken;
+
+	pthread_mutex_lock(&tb_mutex);
+	taken = b->taken;
+	pthread_mutex_unlock(&tb_mutex);
+	return taken;
+}
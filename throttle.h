@@ -0,0 +1,36 @@
+/*
+ * throttle.h
+ *
+ *  Token buckets capping a rate, bytes or READs per second, refilled
+ *  from CLOCK_MONOTONIC whenever they are looked at. A READ is checked
+ *  against the buckets of its device and of the process before it is
+ *  submitted; while they are empty the engines leave slots idle, so
+ *  the queue depth, not sleeping, shapes the load. A bucket may go
+ *  into debt by one take, so a READ larger than the burst still goes.
+ */
+
+#ifndef THROTTLE_H_
+#define THROTTLE_H_
+
+#include <stdint.h>
+
+#define TB_BURST_SECS 0.1 // tokens a bucket holds, in seconds of rate
+
+struct tbucket
+{
+	double rate;   // per second, 0 -> no cap
+	double tokens;
+	uint64_t last_ns;
+	double taken;  // ever, capped or not, for the rate achieved
+};
+
+// Sets the cap of b, 0 to lift it; others may be taking meanwhile.
+// Setting the cap it has leaves it as it is
+void tb_set(struct tbucket *b, double rate);
+// Takes n[k] from each of the nb buckets b[k] when none of them is in
+// debt. Returns 0 when taken, else the ns until they all have refilled
+uint64_t tb_take(struct tbucket *const *b, const double *n, int nb);
+// What has been taken from b so far
+double tb_taken(const struct tbucket *b);
+
+#endif /* THROTTLE_H_ */
@@ -0,0 +1,400 @@
+/*
+ * trace.c
+ *
+ *  The rings are single producer, single consumer: the thread that owns
+ *  one moves its head, the flush thread its tail. A thread's ring is
+ *  made the first time it traces and lives until trace_close(); the
+ *  generation tells a thread of an earlier trace, in libdskread, that
+ *  the ring it holds is gone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "trace.h"
+
+#define TRACE_THREADS 256
+
+struct ring
+{
+	struct trace_rec rec[TRACE_RING];
+	uint64_t head; // the owner's
+	uint64_t tail; // the flush thread's
+	uint64_t dropped;
+};
+
+typedef char trace_rec_size[(32 == sizeof(struct trace_rec)) ? 1 : -1];
+
+int trace_on;
+
+static FILE *out;
+static int out_err; // errno of the first failed write
+static uint64_t t0; // CLOCK_MONOTONIC ns of the start
+static struct ring *rings[TRACE_THREADS];
+static int nrings;
+static unsigned int gen;
+static uint64_t lost; // no ring to be had
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t flusher;
+static int stop;
+static __thread struct ring *mine;
+static __thread int mine_id;
+static __thread unsigned int mine_gen;
+
+static uint64_t
+mono_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+put(const void *p, size_t len)
+{
+	if (len && (1 != fwrite(p, len, 1, out)) && (0 == out_err))
+		out_err = errno ? errno : EIO;
+}
+
+// Writes out what ring r holds
+static void
+drain(struct ring *r)
+{
+	uint64_t h = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	uint64_t t = r->tail;
+	uint64_t at = t & (TRACE_RING - 1), n = h - t;
+
+	if (0 == n)
+		return;
+	if (at + n > TRACE_RING)
+	{
+		put(r->rec + at, (TRACE_RING - at) * sizeof(r->rec[0]));
+		n -= TRACE_RING - at;
+		at = 0;
+	}
+	put(r->rec + at, n * sizeof(r->rec[0]));
+	__atomic_store_n(&r->tail, h, __ATOMIC_RELEASE);
+}
+
+static void
+drain_all(void)
+{
+	int k, n;
+
+	pthread_mutex_lock(&mutex);
+	n = nrings;
+	pthread_mutex_unlock(&mutex);
+	for (k = 0; k < n; ++k)
+		drain(rings[k]);
+}
+
+static void *
+flush_thread(void *arg)
+{
+	struct timespec ts = {0, TRACE_FLUSH_MS * 1000000L};
+
+	(void)arg;
+	while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE))
+	{
+		nanosleep(&ts, NULL);
+		drain_all();
+	}
+	return NULL;
+}
+
+// The calling thread's ring, made on its first record. NULL when there
+// can be no more
+static struct ring *
+ring_get(void)
+{
+	struct ring *r;
+
+	if (mine && (mine_gen == gen))
+		return mine;
+	mine = NULL;
+	pthread_mutex_lock(&mutex);
+	r = (nrings < TRACE_THREADS) ? (struct ring *)calloc(1, sizeof(*r))
+				     : NULL;
+	if (r)
+	{
+		mine_id = nrings;
+		rings[nrings++] = r;
+		mine = r;
+		mine_gen = gen;
+	}
+	pthread_mutex_unlock(&mutex);
+	return r;
+}
+
+int trace_open(const char *path, int ndev, const char *const *names)
+{
+	struct trace_hdr h;
+	struct timespec ts;
+	uint16_t len;
+	int k;
+
+	out = fopen(path, "w");
+	if (NULL == out)
+		return -1;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+	h.version = TRACE_VERSION;
+	h.bom = TRACE_BOM;
+	h.rec_size = sizeof(struct trace_rec);
+	h.ndev = ndev;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	t0 = mono_ns();
+	h.start = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	out_err = 0;
+	put(&h, sizeof(h));
+	for (k = 0; k < ndev; ++k)
+	{
+		len = (uint16_t)strnlen(names[k], UINT16_MAX);
+		put(&len, sizeof(len));
+		put(names[k], len);
+	}
+	lost = 0;
+	stop = 0;
+	++gen;
+	if (out_err || (errno = pthread_create(&flusher, NULL, flush_thread,
+					       NULL)))
+	{
+		if (out_err)
+			errno = out_err;
+		fclose(out);
+		out = NULL;
+		return -1;
+	}
+	__atomic_store_n(&trace_on, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void trace_io(int dev, int op, int64_t lba, int blocks, uint64_t lat,
+	      int qd, int status)
+{
+	struct ring *r;
+	struct trace_rec *p;
+	uint64_t now, h;
+
+	if (!__atomic_load_n(&trace_on, __ATOMIC_ACQUIRE))
+		return;
+	r = ring_get();
+	if (NULL == r)
+	{
+		__atomic_fetch_add(&lost, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	h = r->head;
+	if (h - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= TRACE_RING)
+	{
+		__atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	now = mono_ns() - t0;
+	p = r->rec + (h & (TRACE_RING - 1));
+	p->submit = (now > lat) ? now - lat : 0;
+	p->lba = lba;
+	p->lat = (lat > UINT32_MAX) ? UINT32_MAX : (uint32_t)lat;
+	p->blocks = blocks;
+	p->dev = dev;
+	p->thread = mine_id;
+	p->qd = (qd > UINT16_MAX) ? UINT16_MAX : qd;
+	p->op = op;
+	p->status = (status < 0 || status > 254) ? 255 : status;
+	__atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+}
+
+int trace_close(struct trace_stats *st)
+{
+	struct trace_rec end;
+	uint64_t recs = 0, dropped;
+	int k, res;
+
+	if (NULL == out)
+		return 0;
+	__atomic_store_n(&trace_on, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+	pthread_join(flusher, NULL);
+	// the engines are done, nothing is put now
+	drain_all();
+	dropped = lost;
+	for (k = 0; k < nrings; ++k)
+	{
+		recs += rings[k]->head;
+		dropped += rings[k]->dropped;
+		free(rings[k]);
+		rings[k] = NULL;
+	}
+	nrings = 0;
+	memset(&end, 0, sizeof(end));
+	end.op = TRACE_END;
+	end.lba = (int64_t)dropped;
+	put(&end, sizeof(end));
+	res = (fclose(out) || out_err) ? -1 : 0;
+	if (res && out_err)
+		errno = out_err;
+	out = NULL;
+	if (st)
+	{
+		st->records = recs;
+		st->dropped = dropped;
+	}
+	return res;
+}
+
+static const char *
+op_name(int op)
+{
+	switch (op)
+	{
+	case TRACE_READ:
+		return "read";
+	case TRACE_WRITE:
+		return "write";
+	case TRACE_VERIFY:
+		return "verify";
+	}
+	return "?";
+}
+
+// A name for JSON, no quote or control character left in it
+static void
+json_name(FILE *f, const char *s)
+{
+	for (; *s; ++s)
+		fputc(((unsigned char)*s < ' ' || '"' == *s || '\\' == *s)
+			      ? '_'
+			      : *s,
+		      f);
+}
+
+// A name as a CSV field (RFC 4180): in quotes, with each quote doubled,
+// when it holds a comma, a quote or a line break, else as it is. The
+// string is s, or one allocated in its place of s, NULL without memory
+static char *
+csv_name(char *s)
+{
+	const char *p;
+	char *q, *d;
+	size_t n = 0;
+
+	if (NULL == strpbrk(s, ",\"\r\n"))
+		return s;
+	for (p = s; *p; ++p)
+		n += ('"' == *p) ? 2 : 1;
+	q = (char *)malloc(n + 3);
+	if (NULL == q)
+	{
+		free(s);
+		return NULL;
+	}
+	d = q;
+	*d++ = '"';
+	for (p = s; *p; ++p)
+	{
+		if ('"' == *p)
+			*d++ = '"';
+		*d++ = *p;
+	}
+	*d++ = '"';
+	*d = '\0';
+	free(s);
+	return q;
+}
+
+int trace_export(const char *path, int fmt, FILE *f, struct trace_stats *st)
+{
+	struct trace_hdr h;
+	struct trace_rec r;
+	char **names = NULL;
+	uint16_t len;
+	uint32_t k;
+	int res = -1, first = 1;
+	FILE *in = fopen(path, "r");
+
+	memset(st, 0, sizeof(*st));
+	if (NULL == in)
+		return -1;
+	errno = EINVAL;
+	if ((1 != fread(&h, sizeof(h), 1, in)) ||
+	    memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) ||
+	    (TRACE_VERSION != h.version) || (TRACE_BOM != h.bom) ||
+	    (sizeof(r) != h.rec_size) || (h.ndev > UINT16_MAX))
+		goto out;
+	names = (char **)calloc(h.ndev + 1, sizeof(*names));
+	if (NULL == names)
+		goto out;
+	for (k = 0; k < h.ndev; ++k)
+	{
+		if (1 != fread(&len, sizeof(len), 1, in))
+			goto out;
+		names[k] = (char *)calloc(1, len + 1);
+		if ((NULL == names[k]) ||
+		    (len && (1 != fread(names[k], len, 1, in))))
+			goto out;
+		if ((TRACE_CSV == fmt) && (NULL == (names[k] = csv_name(names[k]))))
+			goto out;
+	}
+	if (TRACE_CSV == fmt)
+		fprintf(f, "device,op,submit_us,lba,blocks,latency_us,qd,status,"
+			   "thread\n");
+	else
+	{
+		fprintf(f, "{\"displayTimeUnit\":\"ns\",\"otherData\":{"
+			   "\"start_ns\":%" PRIu64 "},\"traceEvents\":[\n",
+			h.start);
+		for (k = 0; k < h.ndev; ++k)
+		{
+			fprintf(f, "%s{\"name\":\"process_name\",\"ph\":\"M\","
+				   "\"pid\":%u,\"args\":{\"name\":\"",
+				first ? "" : ",\n", k);
+			json_name(f, names[k]);
+			fputs("\"}}", f);
+			first = 0;
+		}
+	}
+	while (1 == fread(&r, sizeof(r), 1, in))
+	{
+		if (TRACE_END == r.op)
+		{
+			st->dropped = (uint64_t)r.lba;
+			continue;
+		}
+		if (r.dev >= h.ndev)
+			goto out;
+		++st->records;
+		if (TRACE_CSV == fmt)
+			fprintf(f, "%s,%s,%.3f,%" PRId64 ",%u,%.3f,%u,%u,%u\n",
+				names[r.dev], op_name(r.op), r.submit / 1e3, r.lba,
+				r.blocks, r.lat / 1e3, r.qd, r.status, r.thread);
+		else
+		{
+			fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"io\",\"ph\":\"X\","
+				   "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u,"
+				   "\"args\":{\"lba\":%" PRId64 ",\"blocks\":%u,"
+				   "\"qd\":%u,\"status\":%u}}",
+				first ? "" : ",\n", op_name(r.op), r.submit / 1e3,
+				r.lat / 1e3, r.dev, r.thread, r.lba, r.blocks, r.qd,
+				r.status);
+			first = 0;
+		}
+	}
+	if (TRACE_CHROME == fmt)
+		fputs("\n]}\n", f);
+	if (ferror(in))
+		goto out;
+	res = (fflush(f) || ferror(f)) ? -1 : 0;
+out:
+	if (names)
+		for (k = 0; k < h.ndev; ++k)
+			free(names[k]);
+	free(names);
+	fclose(in);
+	return res;
+}
@@ -0,0 +1,83 @@
+/*
+ * trace.h
+ *
+ *  A record of every command: when it was sent, where, how much, how
+ *  long it took, at what queue depth and how it ended, fixed size and
+ *  binary. Each thread puts its records into a ring of its own, no lock
+ *  and no system call on the way; a thread of the trace writes the rings
+ *  out every TRACE_FLUSH_MS. A record the ring has no room for is
+ *  counted and dropped. trace_export() turns a trace into CSV or the
+ *  Chrome trace JSON chrome://tracing and Perfetto load.
+ *
+ *  File format, integers in the byte order of the host that wrote it:
+ *    the header, struct trace_hdr
+ *    ndev names of the devices, each a uint16_t length then the bytes
+ *    records, struct trace_rec each; the last has op TRACE_END, its lba
+ *    the number of records dropped
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_MAGIC "DSKTRACE"
+#define TRACE_VERSION 1
+#define TRACE_BOM 0x01020304u // as the writer's byte order has it
+#define TRACE_RING (1 << 16)  // records per thread
+#define TRACE_FLUSH_MS 10
+
+#define TRACE_READ 0
+#define TRACE_WRITE 1
+#define TRACE_VERIFY 2
+#define TRACE_END 255
+
+#define TRACE_CSV 0
+#define TRACE_CHROME 1
+
+struct trace_hdr
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t bom;
+	uint32_t rec_size;
+	uint32_t ndev;
+	uint64_t start; // CLOCK_REALTIME ns of submit 0
+};
+
+struct trace_rec
+{
+	uint64_t submit; // ns after the start
+	int64_t lba;
+	uint32_t lat;	 // ns, UINT32_MAX when longer
+	uint32_t blocks;
+	uint16_t dev;	 // index of the name
+	uint16_t thread; // ring it came through
+	uint16_t qd;	 // in flight when it was sent, itself included
+	uint8_t op;	 // TRACE_*
+	uint8_t status;	 // 0 done, else the SG_LIB_CAT_* error, 255 other
+};
+
+struct trace_stats
+{
+	uint64_t records;
+	uint64_t dropped;
+};
+
+extern int trace_on;
+
+// Starts tracing to path, ndev devices of names. Returns 0, -1 with
+// errno set
+int trace_open(const char *path, int ndev, const char *const *names);
+// A command that took lat ns just now; any thread, trace_on or not
+void trace_io(int dev, int op, int64_t lba, int blocks, uint64_t lat,
+	      int qd, int status);
+// Writes the rest out and closes the file. Returns 0, -1 with errno set
+int trace_close(struct trace_stats *st);
+// The trace in path to out as fmt, TRACE_CSV or TRACE_CHROME. Returns 0,
+// -1 with errno set, EINVAL when path is not a trace of this host
+int trace_export(const char *path, int fmt, FILE *out,
+		 struct trace_stats *st);
+
+#endif /* TRACE_H_ */
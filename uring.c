@@ -0,0 +1,283 @@
+/*
+ * uring.c
+ *
+ *  Minimal io_uring ring for the block device read engine. Only what a
+ *  single submitter reading into registered buffers needs: setup, buffer
+ *  and file registration, queueing reads, submit and reap.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+static int
+sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+		   unsigned int flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			    flags, NULL, 0);
+}
+
+static int
+sys_io_uring_register(int fd, unsigned int opcode, const void *arg,
+		      unsigned int nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// flags are IORING_SETUP_* flags, IORING_SETUP_SQE128 and
+// IORING_SETUP_CQE32 select the big entries passthrough commands need
+int
+uring_init(struct uring *ur, unsigned int entries, unsigned int flags)
+{
+	struct io_uring_params p;
+	char *sq, *cq;
+	int err;
+
+	memset(ur, 0, sizeof(*ur));
+	memset(&p, 0, sizeof(p));
+	p.flags = flags;
+	ur->fd = sys_io_uring_setup(entries, &p);
+	if (ur->fd < 0)
+		return -errno;
+	ur->entries = p.sq_entries;
+	ur->sqe_shift = (flags & IORING_SETUP_SQE128) ? 1 : 0;
+	ur->cqe_shift = (flags & IORING_SETUP_CQE32) ? 1 : 0;
+	ur->sqpoll = (flags & IORING_SETUP_SQPOLL) ? 1 : 0;
+	ur->iopoll = (flags & IORING_SETUP_IOPOLL) ? 1 : 0;
+
+	ur->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ur->cq_ring_sz = p.cq_off.cqes +
+			 (p.cq_entries * sizeof(struct io_uring_cqe) << ur->cqe_shift);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (ur->cq_ring_sz > ur->sq_ring_sz)
+			ur->sq_ring_sz = ur->cq_ring_sz;
+		ur->cq_ring_sz = ur->sq_ring_sz;
+	}
+	ur->sq_ring = mmap(NULL, ur->sq_ring_sz, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING);
+	if (MAP_FAILED == ur->sq_ring)
+		goto err_out;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		ur->cq_ring = ur->sq_ring;
+	else
+	{
+		ur->cq_ring = mmap(NULL, ur->cq_ring_sz, PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_POPULATE, ur->fd,
+				   IORING_OFF_CQ_RING);
+		if (MAP_FAILED == ur->cq_ring)
+		{
+			ur->cq_ring = NULL;
+			goto err_out;
+		}
+	}
+	ur->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe) << ur->sqe_shift;
+	ur->sqes = mmap(NULL, ur->sqes_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQES);
+	if (MAP_FAILED == ur->sqes)
+	{
+		ur->sqes = NULL;
+		goto err_out;
+	}
+
+	sq = (char *)ur->sq_ring;
+	ur->sq_head = (unsigned int *)(sq + p.sq_off.head);
+	ur->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+	ur->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+	ur->sq_array = (unsigned int *)(sq + p.sq_off.array);
+	ur->sq_flags = (unsigned int *)(sq + p.sq_off.flags);
+	cq = (char *)ur->cq_ring;
+	ur->cq_head = (unsigned int *)(cq + p.cq_off.head);
+	ur->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+	ur->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+	ur->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+
+err_out:
+	err = -errno;
+	if (MAP_FAILED == ur->sq_ring)
+		ur->sq_ring = NULL;
+	uring_exit(ur);
+	return err;
+}
+
+void
+uring_exit(struct uring *ur)
+{
+	if (ur->sqes)
+		munmap(ur->sqes, ur->sqes_sz);
+	if (ur->cq_ring && (ur->cq_ring != ur->sq_ring))
+		munmap(ur->cq_ring, ur->cq_ring_sz);
+	if (ur->sq_ring)
+		munmap(ur->sq_ring, ur->sq_ring_sz);
+	if (ur->fd >= 0)
+		close(ur->fd);
+	memset(ur, 0, sizeof(*ur));
+	ur->fd = -1;
+}
+
+int
+uring_register_buffers(struct uring *ur, const struct iovec *iov,
+		       unsigned int nr)
+{
+	if (sys_io_uring_register(ur->fd, IORING_REGISTER_BUFFERS, iov, nr) < 0)
+		return -errno;
+	ur->fixed_bufs = 1;
+	return 0;
+}
+
+int
+uring_unregister_buffers(struct uring *ur)
+{
+	if (!ur->fixed_bufs)
+		return 0;
+	ur->fixed_bufs = 0;
+	if (sys_io_uring_register(ur->fd, IORING_UNREGISTER_BUFFERS, NULL, 0) < 0)
+		return -errno;
+	return 0;
+}
+
+int
+uring_register_file(struct uring *ur, int fd)
+{
+	if (sys_io_uring_register(ur->fd, IORING_REGISTER_FILES, &fd, 1) < 0)
+		return -errno;
+	ur->fixed_file = 1;
+	return 0;
+}
+
+// Returns the next free sqe, cleared, or NULL when the sq is full
+static struct io_uring_sqe *
+uring_get_sqe(struct uring *ur)
+{
+	unsigned int tail = *ur->sq_tail + ur->sq_pending;
+	unsigned int head = __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE);
+	unsigned int idx;
+	struct io_uring_sqe *sqe;
+
+	if (tail - head >= ur->entries)
+		return NULL;
+	idx = tail & *ur->sq_mask;
+	sqe = ur->sqes + (idx << ur->sqe_shift);
+	memset(sqe, 0, sizeof(*sqe) << ur->sqe_shift);
+	ur->sq_array[idx] = idx;
+	++ur->sq_pending;
+	return sqe;
+}
+
+// Queues a read of len bytes at byte offset off. buf_index names the
+// registered buffer holding buf, it is ignored without registration.
+int
+uring_prep_read(struct uring *ur, int fd, void *buf, unsigned int len,
+		uint64_t off, int buf_index, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(ur);
+
+	if (NULL == sqe)
+		return -EBUSY;
+	sqe->opcode = ur->fixed_bufs ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	sqe->fd = ur->fixed_file ? 0 : fd;
+	if (ur->fixed_file)
+		sqe->flags |= IOSQE_FIXED_FILE;
+	sqe->addr = (uint64_t)(uintptr_t)buf;
+	sqe->len = len;
+	sqe->off = off;
+	sqe->ioprio = ur->ioprio;
+	if (ur->fixed_bufs)
+		sqe->buf_index = (uint16_t)buf_index;
+	sqe->user_data = user_data;
+	return 0;
+}
+
+// Queues a driver passthrough command, cmd_op is the driver's command
+// (e.g. NVME_URING_CMD_IO) and cmd its payload, copied into the sqe.
+// The ring must have been set up with IORING_SETUP_SQE128.
+int
+uring_prep_cmd(struct uring *ur, int fd, unsigned int cmd_op, const void *cmd,
+	       size_t cmd_len, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+
+	if (!ur->sqe_shift ||
+	    (cmd_len > 2 * sizeof(*sqe) - offsetof(struct io_uring_sqe, cmd)))
+		return -EINVAL;
+	sqe = uring_get_sqe(ur);
+	if (NULL == sqe)
+		return -EBUSY;
+	sqe->opcode = IORING_OP_URING_CMD;
+	sqe->fd = ur->fixed_file ? 0 : fd;
+	if (ur->fixed_file)
+		sqe->flags |= IOSQE_FIXED_FILE;
+	sqe->cmd_op = cmd_op;
+	memcpy(sqe->cmd, cmd, cmd_len);
+	sqe->user_data = user_data;
+	return 0;
+}
+
+// Submits the queued sqes and waits until at least wait_nr cqes are
+// available. Returns the number submitted or a negated errno. With
+// SQPOLL the kernel thread picks the sqes up by itself, a syscall is
+// only needed to wait or to wake the thread after it went idle.
+int
+uring_submit_and_wait(struct uring *ur, unsigned int wait_nr)
+{
+	unsigned int n = ur->sq_pending;
+	unsigned int flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+	int res;
+
+	__atomic_store_n(ur->sq_tail, *ur->sq_tail + n, __ATOMIC_RELEASE);
+	ur->sq_pending = 0;
+	if (ur->sqpoll)
+	{
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(ur->sq_flags, __ATOMIC_RELAXED) &
+		    IORING_SQ_NEED_WAKEUP)
+			flags |= IORING_ENTER_SQ_WAKEUP;
+		if (0 == flags)
+			return n;
+	}
+	// the kernel reports EINTR only when nothing was submitted
+	do
+		res = sys_io_uring_enter(ur->fd, n, wait_nr, flags);
+	while ((res < 0) && (EINTR == errno));
+	if (res < 0)
+		return -errno;
+	return res;
+}
+
+// Copies out the oldest cqe. Returns 0, or -EAGAIN when there is none.
+int
+uring_reap(struct uring *ur, struct io_uring_cqe *cqe)
+{
+	unsigned int head = *ur->cq_head;
+
+	if (head == __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE))
+		return -EAGAIN;
+	*cqe = ur->cqes[(head & *ur->cq_mask) << ur->cqe_shift];
+	__atomic_store_n(ur->cq_head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int
+uring_poll(struct uring *ur)
+{
+	// min_complete 0: the kernel polls once, or runs the task work that
+	// posts completions of the other rings, and returns
+	if ((sys_io_uring_enter(ur->fd, 0, 0, IORING_ENTER_GETEVENTS) < 0) &&
+	    (EINTR != errno))
+		return -errno;
+	return (int)(__atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE) -
+		     *ur->cq_head);
+}
@@ -0,0 +1,65 @@
+/*
+ * uring.h
+ *
+ *  Minimal io_uring ring for the block device read engine, on the raw
+ *  system calls so that no liburing is needed.
+ */
+
+#ifndef URING_H_
+#define URING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+struct uring
+{
+	int fd;
+	unsigned int entries;
+	int fixed_bufs;         // buffers registered, use READ_FIXED
+	int fixed_file;         // fd registered as file index 0
+	int sqe_shift;          // 1 with 128 byte sqes
+	int cqe_shift;          // 1 with 32 byte cqes
+	int sqpoll;             // kernel thread polls the sq
+	int iopoll;             // completions are polled for, not signalled
+	uint16_t ioprio;        // of the reads, 0 -> the submitter's
+
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *sq_flags;
+	struct io_uring_sqe *sqes;
+	unsigned int sq_pending; // sqes queued, not yet submitted
+
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ring;
+	size_t sq_ring_sz;
+	void *cq_ring;
+	size_t cq_ring_sz;
+	size_t sqes_sz;
+};
+
+// All return 0 or a negated errno
+int uring_init(struct uring *ur, unsigned int entries, unsigned int flags);
+void uring_exit(struct uring *ur);
+int uring_register_buffers(struct uring *ur, const struct iovec *iov,
+			   unsigned int nr);
+int uring_unregister_buffers(struct uring *ur);
+int uring_register_file(struct uring *ur, int fd);
+int uring_prep_read(struct uring *ur, int fd, void *buf, unsigned int len,
+		    uint64_t off, int buf_index, uint64_t user_data);
+int uring_prep_cmd(struct uring *ur, int fd, unsigned int cmd_op,
+		   const void *cmd, size_t cmd_len, uint64_t user_data);
+int uring_submit_and_wait(struct uring *ur, unsigned int wait_nr);
+int uring_reap(struct uring *ur, struct io_uring_cqe *cqe);
+// One look for completions without blocking: with IOPOLL a pass over
+// the device's poll queues. Returns the cqes ready or a negated errno
+int uring_poll(struct uring *ur);
+
+#endif /* URING_H_ */
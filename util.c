@@ -49,7 +49,7 @@
 
 #include "common.h"
 
-static unsigned int crc32_tab[] = {
+static const unsigned int crc32_tab[] = {
 	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
 	0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
 	0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
@@ -95,56 +95,2348 @@ static unsigned int crc32_tab[] = {
 	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
+unsigned int
+xor128(void)
+{
+	static unsigned int x = 123456789;
+	static unsigned int y = 362436069;
+	static unsigned int z = 521288629;
+	static unsigned int w = 88675123;
+	unsigned int t;
+	t = x ^ (x << 11);
+	x = y; y = z; z = w;
+	return w = w ^ (w >> 19) ^ (t ^ (t >> 8));
+}
+
+//=============================================================================
+//=  CPU features: probed once, what every kernel below is chosen by         =
+//=============================================================================
+// The selectors of the kernels go by cpu_isa() alone, so --force-isa caps
+// them all at once. It is probed on first use; cpu_dispatch() binds all
+// the kernels up front, before the threads that use them start.
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+static unsigned int cpu_have;      // ISA_* of this CPU
+static unsigned int cpu_cap = ~0u; // of them, those --force-isa leaves
+static pthread_once_t cpu_once = PTHREAD_ONCE_INIT;
+
+static const struct
+{
+	const char *name;
+	unsigned int isa;
+} cpu_levels[] = {
+	// in order, each a superset of those before it of its architecture
+	{"scalar", 0},
+	{"sse2", ISA_SSE2},
+	{"sse4.2", ISA_SSE2 | ISA_SSE41 | ISA_SSE42 | ISA_PCLMUL},
+	{"avx2", ISA_SSE2 | ISA_SSE41 | ISA_SSE42 | ISA_PCLMUL | ISA_AVX2},
+	{"avx512", ISA_SSE2 | ISA_SSE41 | ISA_SSE42 | ISA_PCLMUL | ISA_AVX2 |
+		       ISA_AVX512F | ISA_AVX512BW},
+	{"neon", ISA_NEON},
+	{"armv8-crc", ISA_NEON | ISA_CRC32},
+};
+
+static void
+cpu_probe(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		cpu_have |= ISA_SSE2;
+	if (__builtin_cpu_supports("sse4.1"))
+		cpu_have |= ISA_SSE41;
+	if (__builtin_cpu_supports("sse4.2"))
+		cpu_have |= ISA_SSE42;
+	if (__builtin_cpu_supports("pclmul"))
+		cpu_have |= ISA_PCLMUL;
+	if (__builtin_cpu_supports("avx2"))
+		cpu_have |= ISA_AVX2;
+	if (__builtin_cpu_supports("avx512f"))
+		cpu_have |= ISA_AVX512F;
+	if (__builtin_cpu_supports("avx512bw"))
+		cpu_have |= ISA_AVX512BW;
+#elif defined(__aarch64__)
+	cpu_have = ISA_NEON; // part of ARMv8-A
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+		cpu_have |= ISA_CRC32;
+#endif
+}
+
+unsigned int
+cpu_isa(void)
+{
+	pthread_once(&cpu_once, cpu_probe);
+	return cpu_have & cpu_cap;
+}
+
+int
+cpu_force_isa(const char *name)
+{
+	size_t k;
+
+	if (0 == strcmp(name, "native"))
+	{
+		cpu_cap = ~0u;
+		return 0;
+	}
+	for (k = 0; k < sizeof(cpu_levels) / sizeof(cpu_levels[0]); ++k)
+		if (0 == strcmp(name, cpu_levels[k].name))
+		{
+			cpu_cap = cpu_levels[k].isa;
+			return ((cpu_isa() & cpu_cap) == cpu_cap) ? 0 : 1;
+		}
+	return -1;
+}
+
+const char *
+cpu_isa_name(void)
+{
+	unsigned int isa = cpu_isa();
+	const char *name = cpu_levels[0].name;
+	size_t k;
+
+	for (k = 1; k < sizeof(cpu_levels) / sizeof(cpu_levels[0]); ++k)
+		if ((isa & cpu_levels[k].isa) == cpu_levels[k].isa)
+			name = cpu_levels[k].name;
+	return name;
+}
+
+//=============================================================================
+//=  Pattern check: does a buffer hold nothing but a repeated pattern word?   =
+//=============================================================================
+// The pattern is passed pre-expanded to PATTERN_WORD_SZ bytes (a single
+// byte pattern is that byte 64 times) so every kernel compares whole
+// vector registers against it without a reference buffer. The buffer is
+// assumed to start at phase 0 of the pattern. Each kernel returns the
+// offset of the first byte that differs, or len if none does.
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+static size_t
+pattern_tail(const BYTE *buf, size_t off, size_t len, const BYTE *pat)
+{
+	for (; off < len; ++off)
+		if (buf[off] != pat[off % PATTERN_WORD_SZ])
+			return off;
+	return len;
+}
+
+static size_t
+pattern_check_scalar(const BYTE *buf, size_t len, const BYTE *pat)
+{
+	uint64_t w[PATTERN_WORD_SZ / 8];
+	size_t off = 0;
+	int k;
+
+	memcpy(w, pat, PATTERN_WORD_SZ);
+	for (; off + PATTERN_WORD_SZ <= len; off += PATTERN_WORD_SZ)
+	{
+		for (k = 0; k < PATTERN_WORD_SZ / 8; ++k)
+		{
+			uint64_t v;
+
+			memcpy(&v, buf + off + 8 * k, 8);
+			if (v != w[k])
+				return pattern_tail(buf, off, len, pat);
+		}
+	}
+	return pattern_tail(buf, off, len, pat);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2"))) static size_t
+pattern_check_sse2(const BYTE *buf, size_t len, const BYTE *pat)
+{
+	const __m128i p0 = _mm_loadu_si128((const __m128i *)pat);
+	const __m128i p1 = _mm_loadu_si128((const __m128i *)(pat + 16));
+	const __m128i p2 = _mm_loadu_si128((const __m128i *)(pat + 32));
+	const __m128i p3 = _mm_loadu_si128((const __m128i *)(pat + 48));
+	size_t off = 0;
+
+	for (; off + 64 <= len; off += 64)
+	{
+		const __m128i *v = (const __m128i *)(buf + off);
+		__m128i e = _mm_and_si128(
+		    _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(v), p0),
+				  _mm_cmpeq_epi8(_mm_loadu_si128(v + 1), p1)),
+		    _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(v + 2), p2),
+				  _mm_cmpeq_epi8(_mm_loadu_si128(v + 3), p3)));
+
+		if (0xffff != _mm_movemask_epi8(e))
+			return pattern_tail(buf, off, len, pat);
+	}
+	return pattern_tail(buf, off, len, pat);
+}
+
+__attribute__((target("avx2"))) static size_t
+pattern_check_avx2(const BYTE *buf, size_t len, const BYTE *pat)
+{
+	const __m256i p0 = _mm256_loadu_si256((const __m256i *)pat);
+	const __m256i p1 = _mm256_loadu_si256((const __m256i *)(pat + 32));
+	size_t off = 0;
+
+	for (; off + 128 <= len; off += 128)
+	{
+		const __m256i *v = (const __m256i *)(buf + off);
+		__m256i e = _mm256_and_si256(
+		    _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(v), p0),
+				     _mm256_cmpeq_epi8(_mm256_loadu_si256(v + 1), p1)),
+		    _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(v + 2), p0),
+				     _mm256_cmpeq_epi8(_mm256_loadu_si256(v + 3), p1)));
+
+		if (-1 != _mm256_movemask_epi8(e))
+			return pattern_tail(buf, off, len, pat);
+	}
+	return pattern_tail(buf, off, len, pat);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static size_t
+pattern_check_avx512(const BYTE *buf, size_t len, const BYTE *pat)
+{
+	const __m512i p = _mm512_loadu_si512((const void *)pat);
+	size_t off = 0;
+
+	for (; off + 128 <= len; off += 128)
+	{
+		__mmask64 m = _mm512_cmpneq_epi8_mask(
+				  _mm512_loadu_si512((const void *)(buf + off)), p) |
+			      _mm512_cmpneq_epi8_mask(
+				  _mm512_loadu_si512((const void *)(buf + off + 64)), p);
+
+		if (m)
+			return pattern_tail(buf, off, len, pat);
+	}
+	return pattern_tail(buf, off, len, pat);
+}
+#endif
+
+#if defined(__aarch64__)
+static size_t
+pattern_check_neon(const BYTE *buf, size_t len, const BYTE *pat)
+{
+	const uint8x16_t p0 = vld1q_u8(pat);
+	const uint8x16_t p1 = vld1q_u8(pat + 16);
+	const uint8x16_t p2 = vld1q_u8(pat + 32);
+	const uint8x16_t p3 = vld1q_u8(pat + 48);
+	size_t off = 0;
+
+	for (; off + 64 <= len; off += 64)
+	{
+		uint8x16_t e = vandq_u8(
+		    vandq_u8(vceqq_u8(vld1q_u8(buf + off), p0),
+			     vceqq_u8(vld1q_u8(buf + off + 16), p1)),
+		    vandq_u8(vceqq_u8(vld1q_u8(buf + off + 32), p2),
+			     vceqq_u8(vld1q_u8(buf + off + 48), p3)));
+
+		if (0xff != vminvq_u8(e))
+			return pattern_tail(buf, off, len, pat);
+	}
+	return pattern_tail(buf, off, len, pat);
+}
+#endif
+
+typedef size_t (*pattern_check_fn)(const BYTE *, size_t, const BYTE *);
+
+static pattern_check_fn pattern_check_impl;
+static const char *pattern_check_name = "scalar";
+
+static pattern_check_fn
+pattern_check_select(void)
+{
+	pattern_check_fn fn = pattern_check_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (cpu_isa() & ISA_AVX512BW)
+	{
+		fn = pattern_check_avx512;
+		pattern_check_name = "avx512bw";
+	}
+	else if (cpu_isa() & ISA_AVX2)
+	{
+		fn = pattern_check_avx2;
+		pattern_check_name = "avx2";
+	}
+	else if (cpu_isa() & ISA_SSE2)
+	{
+		fn = pattern_check_sse2;
+		pattern_check_name = "sse2";
+	}
+#elif defined(__aarch64__)
+	if (cpu_isa() & ISA_NEON)
+	{
+		fn = pattern_check_neon;
+		pattern_check_name = "neon";
+	}
+#endif
+	return fn;
+}
+
+size_t
+pattern_check(const BYTE *buf, size_t len, const BYTE *pat)
+{
+	pattern_check_fn fn = __atomic_load_n(&pattern_check_impl, __ATOMIC_RELAXED);
+
+	if (NULL == fn)
+	{
+		fn = pattern_check_select();
+		__atomic_store_n(&pattern_check_impl, fn, __ATOMIC_RELAXED);
+	}
+	return fn(buf, len, pat);
+}
+
+const char *
+pattern_check_isa(void)
+{
+	if (NULL == pattern_check_impl)
+		pattern_check_impl = pattern_check_select();
+	return pattern_check_name;
+}
+
+int
+buf_uniform(const BYTE *buf, size_t len)
+{
+	BYTE word[PATTERN_WORD_SZ];
+
+	if ((0 == len) || ((0x00 != buf[0]) && (0xff != buf[0])))
+		return -1;
+	memset(word, buf[0], sizeof(word));
+	return (pattern_check(buf, len, word) == len) ? buf[0] : -1;
+}
+
+//=============================================================================
+//=  Buffer compare: the first byte where two buffers differ                  =
+//=============================================================================
+// memcmp() answers which buffer is the greater, which a compare of two
+// copies does not need; these only find the first difference, a whole
+// cache line per step. Each kernel returns its offset, or len if the
+// buffers are the same.
+
+static size_t
+buf_tail(const BYTE *a, const BYTE *b, size_t off, size_t len)
+{
+	for (; off < len; ++off)
+		if (a[off] != b[off])
+			return off;
+	return len;
+}
+
+static size_t
+buf_compare_scalar(const BYTE *a, const BYTE *b, size_t len)
+{
+	size_t off = 0;
+
+	for (; off + 64 <= len; off += 64)
+		if (memcmp(a + off, b + off, 64))
+			return buf_tail(a, b, off, len);
+	return buf_tail(a, b, off, len);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2"))) static size_t
+buf_compare_sse2(const BYTE *a, const BYTE *b, size_t len)
+{
+	size_t off = 0;
+
+	for (; off + 64 <= len; off += 64)
+	{
+		const __m128i *x = (const __m128i *)(a + off);
+		const __m128i *y = (const __m128i *)(b + off);
+		__m128i e = _mm_and_si128(
+		    _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(x),
+						 _mm_loadu_si128(y)),
+				  _mm_cmpeq_epi8(_mm_loadu_si128(x + 1),
+						 _mm_loadu_si128(y + 1))),
+		    _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(x + 2),
+						 _mm_loadu_si128(y + 2)),
+				  _mm_cmpeq_epi8(_mm_loadu_si128(x + 3),
+						 _mm_loadu_si128(y + 3))));
+
+		if (0xffff != _mm_movemask_epi8(e))
+			return buf_tail(a, b, off, len);
+	}
+	return buf_tail(a, b, off, len);
+}
+
+__attribute__((target("avx2"))) static size_t
+buf_compare_avx2(const BYTE *a, const BYTE *b, size_t len)
+{
+	size_t off = 0;
+
+	for (; off + 128 <= len; off += 128)
+	{
+		const __m256i *x = (const __m256i *)(a + off);
+		const __m256i *y = (const __m256i *)(b + off);
+		__m256i d = _mm256_or_si256(
+		    _mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(x),
+						     _mm256_loadu_si256(y)),
+				    _mm256_xor_si256(_mm256_loadu_si256(x + 1),
+						     _mm256_loadu_si256(y + 1))),
+		    _mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(x + 2),
+						     _mm256_loadu_si256(y + 2)),
+				    _mm256_xor_si256(_mm256_loadu_si256(x + 3),
+						     _mm256_loadu_si256(y + 3))));
+
+		if (!_mm256_testz_si256(d, d))
+			return buf_tail(a, b, off, len);
+	}
+	return buf_tail(a, b, off, len);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static size_t
+buf_compare_avx512(const BYTE *a, const BYTE *b, size_t len)
+{
+	size_t off = 0;
+
+	for (; off + 128 <= len; off += 128)
+	{
+		__mmask64 m = _mm512_cmpneq_epi8_mask(
+				  _mm512_loadu_si512((const void *)(a + off)),
+				  _mm512_loadu_si512((const void *)(b + off))) |
+			      _mm512_cmpneq_epi8_mask(
+				  _mm512_loadu_si512((const void *)(a + off + 64)),
+				  _mm512_loadu_si512((const void *)(b + off + 64)));
+
+		if (m)
+			return buf_tail(a, b, off, len);
+	}
+	return buf_tail(a, b, off, len);
+}
+#endif
+
+#if defined(__aarch64__)
+static size_t
+buf_compare_neon(const BYTE *a, const BYTE *b, size_t len)
+{
+	size_t off = 0;
+
+	for (; off + 64 <= len; off += 64)
+	{
+		uint8x16_t e = vandq_u8(
+		    vandq_u8(vceqq_u8(vld1q_u8(a + off), vld1q_u8(b + off)),
+			     vceqq_u8(vld1q_u8(a + off + 16), vld1q_u8(b + off + 16))),
+		    vandq_u8(vceqq_u8(vld1q_u8(a + off + 32), vld1q_u8(b + off + 32)),
+			     vceqq_u8(vld1q_u8(a + off + 48), vld1q_u8(b + off + 48))));
+
+		if (0xff != vminvq_u8(e))
+			return buf_tail(a, b, off, len);
+	}
+	return buf_tail(a, b, off, len);
+}
+#endif
+
+typedef size_t (*buf_compare_fn)(const BYTE *, const BYTE *, size_t);
+
+static buf_compare_fn buf_compare_impl;
+
+static buf_compare_fn
+buf_compare_select(void)
+{
+	buf_compare_fn fn = buf_compare_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (cpu_isa() & ISA_AVX512BW)
+		fn = buf_compare_avx512;
+	else if (cpu_isa() & ISA_AVX2)
+		fn = buf_compare_avx2;
+	else if (cpu_isa() & ISA_SSE2)
+		fn = buf_compare_sse2;
+#elif defined(__aarch64__)
+	if (cpu_isa() & ISA_NEON)
+		fn = buf_compare_neon;
+#endif
+	return fn;
+}
+
+size_t
+buf_compare(const BYTE *a, const BYTE *b, size_t len)
+{
+	buf_compare_fn fn = __atomic_load_n(&buf_compare_impl, __ATOMIC_RELAXED);
+
+	if (NULL == fn)
+	{
+		fn = buf_compare_select();
+		__atomic_store_n(&buf_compare_impl, fn, __ATOMIC_RELAXED);
+	}
+	return fn(a, b, len);
+}
+
+//=============================================================================
+//=  Streaming checks: data read once, kept out of the cache                  =
+//=============================================================================
+// A check touches each byte of a READ once. At the rate of many streams
+// its loads fill the last level cache with lines never used again, and
+// evict those that are. These run the same kernels a step at a time with
+// the lines a distance ahead prefetched non-temporally: prefetchnta on
+// x86 fills one way of the cache only, PLDL1STRM on arm64 marks them to
+// go first. A MOVNTDQA load bypasses the cache on write-combining memory
+// only, not on that of the page cache or of a READ buffer, so it is not
+// used.
+
+#define STREAM_STEP 4096 // bytes checked a prefetch, a multiple of 64
+#define STREAM_DIST_DEF 2048
+
+static size_t stream_dist = STREAM_DIST_DEF;
+
+void
+stream_prefetch_set(size_t dist)
+{
+	stream_dist = dist ? (dist + 63) & ~(size_t)63 : STREAM_DIST_DEF;
+}
+
+size_t
+stream_prefetch_dist(void)
+{
+	return stream_dist;
+}
+
+// Prefetches the lines of [p, p + n) short of end
+static inline void
+stream_prefetch(const BYTE *p, size_t n, const BYTE *end)
+{
+	const BYTE *q;
+
+	for (q = p; (q < p + n) && (q < end); q += 64)
+		__builtin_prefetch(q, 0, 0);
+}
+
+size_t
+pattern_check_stream(const BYTE *buf, size_t len, const BYTE *pat)
+{
+	const BYTE *end = buf + len;
+	size_t off, n, d;
+
+	stream_prefetch(buf, stream_dist, end);
+	for (off = 0; off < len; off += n)
+	{
+		n = (len - off < STREAM_STEP) ? len - off : STREAM_STEP;
+		stream_prefetch(buf + off + stream_dist, STREAM_STEP, end);
+		d = pattern_check(buf + off, n, pat);
+		if (d < n)
+			return off + d;
+	}
+	return len;
+}
+
+size_t
+buf_compare_stream(const BYTE *a, const BYTE *b, size_t len)
+{
+	size_t off, n, d;
+
+	stream_prefetch(a, stream_dist, a + len);
+	stream_prefetch(b, stream_dist, b + len);
+	for (off = 0; off < len; off += n)
+	{
+		n = (len - off < STREAM_STEP) ? len - off : STREAM_STEP;
+		stream_prefetch(a + off + stream_dist, STREAM_STEP, a + len);
+		stream_prefetch(b + off + stream_dist, STREAM_STEP, b + len);
+		d = buf_compare(a + off, b + off, n);
+		if (d < n)
+			return off + d;
+	}
+	return len;
+}
+
+//=============================================================================
+//=  Bit flips: the bits of a block read that differ from those expected     =
+//=============================================================================
+// Counted apart by direction, a stuck bit flipping one way only. The
+// vector kernels count the set bits of each byte by a nibble table
+// lookup and sum the bytes with psadbw, a 64 bit lane per 8 bytes.
+
+static void
+bit_flips_scalar(const BYTE *got, const BYTE *exp, size_t len, uint64_t *up,
+		 uint64_t *down)
+{
+	uint64_t g, e, u = 0, d = 0;
+	size_t off = 0;
+
+	for (; off + 8 <= len; off += 8)
+	{
+		memcpy(&g, got + off, 8);
+		memcpy(&e, exp + off, 8);
+		u += (uint64_t)__builtin_popcountll(g & ~e);
+		d += (uint64_t)__builtin_popcountll(e & ~g);
+	}
+	for (; off < len; ++off)
+	{
+		u += (uint64_t)__builtin_popcount(got[off] & ~exp[off] & 0xff);
+		d += (uint64_t)__builtin_popcount(exp[off] & ~got[off] & 0xff);
+	}
+	*up += u;
+	*down += d;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static inline __m256i
+popcnt_avx2(__m256i v)
+{
+	const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3,
+					     2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3,
+					     1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0f);
+	__m256i n = _mm256_add_epi8(
+	    _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low)),
+	    _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4),
+						      low)));
+
+	return _mm256_sad_epu8(n, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2"))) static uint64_t
+sum_avx2(__m256i v)
+{
+	__m128i s = _mm_add_epi64(_mm256_castsi256_si128(v),
+				  _mm256_extracti128_si256(v, 1));
+
+	return (uint64_t)_mm_cvtsi128_si64(s) +
+	       (uint64_t)_mm_extract_epi64(s, 1);
+}
+
+__attribute__((target("avx2"))) static void
+bit_flips_avx2(const BYTE *got, const BYTE *exp, size_t len, uint64_t *up,
+	       uint64_t *down)
+{
+	__m256i u = _mm256_setzero_si256(), d = _mm256_setzero_si256();
+	size_t off = 0;
+
+	for (; off + 32 <= len; off += 32)
+	{
+		__m256i g = _mm256_loadu_si256((const __m256i *)(got + off));
+		__m256i e = _mm256_loadu_si256((const __m256i *)(exp + off));
+
+		u = _mm256_add_epi64(u, popcnt_avx2(_mm256_andnot_si256(e, g)));
+		d = _mm256_add_epi64(d, popcnt_avx2(_mm256_andnot_si256(g, e)));
+	}
+	*up += sum_avx2(u);
+	*down += sum_avx2(d);
+	bit_flips_scalar(got + off, exp + off, len - off, up, down);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static inline __m512i
+popcnt_avx512(__m512i v)
+{
+	const __m512i lut = _mm512_broadcast_i32x4(_mm_setr_epi8(
+	    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+	const __m512i low = _mm512_set1_epi8(0x0f);
+	__m512i n = _mm512_add_epi8(
+	    _mm512_shuffle_epi8(lut, _mm512_and_si512(v, low)),
+	    _mm512_shuffle_epi8(lut, _mm512_and_si512(_mm512_srli_epi16(v, 4),
+						      low)));
+
+	return _mm512_sad_epu8(n, _mm512_setzero_si512());
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void
+bit_flips_avx512(const BYTE *got, const BYTE *exp, size_t len, uint64_t *up,
+		 uint64_t *down)
+{
+	__m512i u = _mm512_setzero_si512(), d = _mm512_setzero_si512();
+	size_t off = 0;
+
+	for (; off + 64 <= len; off += 64)
+	{
+		__m512i g = _mm512_loadu_si512((const void *)(got + off));
+		__m512i e = _mm512_loadu_si512((const void *)(exp + off));
+
+		u = _mm512_add_epi64(u, popcnt_avx512(_mm512_andnot_si512(e, g)));
+		d = _mm512_add_epi64(d, popcnt_avx512(_mm512_andnot_si512(g, e)));
+	}
+	*up += (uint64_t)_mm512_reduce_add_epi64(u);
+	*down += (uint64_t)_mm512_reduce_add_epi64(d);
+	bit_flips_scalar(got + off, exp + off, len - off, up, down);
+}
+#endif
+
+#if defined(__aarch64__)
+static void
+bit_flips_neon(const BYTE *got, const BYTE *exp, size_t len, uint64_t *up,
+	       uint64_t *down)
+{
+	uint64x2_t u = vdupq_n_u64(0), d = vdupq_n_u64(0);
+	size_t off = 0;
+
+	for (; off + 16 <= len; off += 16)
+	{
+		uint8x16_t g = vld1q_u8(got + off), e = vld1q_u8(exp + off);
+
+		u = vpadalq_u32(u, vpaddlq_u16(vpaddlq_u8(vcntq_u8(vbicq_u8(g, e)))));
+		d = vpadalq_u32(d, vpaddlq_u16(vpaddlq_u8(vcntq_u8(vbicq_u8(e, g)))));
+	}
+	*up += vaddvq_u64(u);
+	*down += vaddvq_u64(d);
+	bit_flips_scalar(got + off, exp + off, len - off, up, down);
+}
+#endif
+
+typedef void (*bit_flips_fn)(const BYTE *, const BYTE *, size_t, uint64_t *,
+			     uint64_t *);
+
+static bit_flips_fn bit_flips_impl;
+
+static bit_flips_fn
+bit_flips_select(void)
+{
+	bit_flips_fn fn = bit_flips_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (cpu_isa() & ISA_AVX512BW)
+		fn = bit_flips_avx512;
+	else if (cpu_isa() & ISA_AVX2)
+		fn = bit_flips_avx2;
+#elif defined(__aarch64__)
+	if (cpu_isa() & ISA_NEON)
+		fn = bit_flips_neon;
+#endif
+	return fn;
+}
+
+void
+bit_flips(const BYTE *got, const BYTE *exp, size_t len, uint64_t *up,
+	  uint64_t *down)
+{
+	bit_flips_fn fn = __atomic_load_n(&bit_flips_impl, __ATOMIC_RELAXED);
+
+	*up = *down = 0;
+	if (NULL == fn)
+	{
+		fn = bit_flips_select();
+		__atomic_store_n(&bit_flips_impl, fn, __ATOMIC_RELAXED);
+	}
+	fn(got, exp, len, up, down);
+}
+
+//=============================================================================
+//=  Random pattern: counter-based, so any LBA can be generated directly      =
+//=============================================================================
+// A pass key is derived from (seed, pass) and every block gets its own key
+// from (pass key, LBA). The 32-bit word i of a block is the murmur3
+// finalizer of i spread by the golden ratio and mixed with the block key,
+// so blocks are independent of each other: passes can be verified by any
+// number of threads, in any completion order, starting at any LBA. The
+// finalizer only needs 32-bit multiplies, which every vector ISA has.
+
+#define RAND_PHI32 0x9E3779B9U
+
+static inline uint64_t
+splitmix64(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+static inline uint32_t
+fmix32(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x85EBCA6BU;
+	x ^= x >> 13;
+	x *= 0xC2B2AE35U;
+	return x ^ (x >> 16);
+}
+
+static inline uint32_t
+rand_word(uint64_t bkey, uint32_t i)
+{
+	return fmix32((i * RAND_PHI32 + (uint32_t)bkey) ^ (uint32_t)(bkey >> 32));
+}
+
+uint64_t
+rand_pattern_key(uint64_t seed, unsigned int pass)
+{
+	return splitmix64(seed ^ splitmix64(pass));
+}
+
+static inline uint64_t
+rand_block_key(uint64_t key, uint64_t lba)
+{
+	return splitmix64(key ^ (lba * 0xD1B54A32D192ED03ULL));
+}
+
+// Locates the first differing byte of a block known to mismatch, from
+// byte from on
+static size_t
+rand_block_tail(const BYTE *buf, size_t blk_sz, uint64_t bkey, size_t from)
+{
+	uint32_t i;
+	int k;
+
+	for (i = from / 4; i < blk_sz / 4; ++i)
+	{
+		uint32_t w = rand_word(bkey, i);
+
+		for (k = 0; k < 4; ++k)
+			if (buf[4 * i + k] != ((w >> (8 * k)) & 0xff))
+				return 4 * i + k;
+	}
+	return blk_sz;
+}
+
+// The kernels generate or compare the words of one block from byte from
+// (a multiple of 32) to its end; compare returns whether any differs
+static void
+rand_fill_scalar(BYTE *buf, size_t blk_sz, uint64_t bkey, size_t from)
+{
+	uint32_t i;
+
+	for (i = from / 4; i < blk_sz / 4; ++i)
+	{
+		uint32_t w = rand_word(bkey, i);
+
+		memcpy(buf + 4 * i, &w, 4);
+	}
+}
+
+static int
+rand_block_scalar(const BYTE *buf, size_t blk_sz, uint64_t bkey, size_t from)
+{
+	uint32_t i, d = 0;
+
+	for (i = from / 4; i < blk_sz / 4; ++i)
+	{
+		uint32_t v;
+
+		memcpy(&v, buf + 4 * i, 4);
+		d |= v ^ rand_word(bkey, i);
+	}
+	return 0 != d;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static inline __m256i
+fmix32_avx2(__m256i x)
+{
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+	x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)0x85EBCA6BU));
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 13));
+	x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)0xC2B2AE35U));
+	return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+
+// i * phi for the 8 words at byte from
+__attribute__((target("avx2"))) static inline __m256i
+rand_ctr_avx2(size_t from)
+{
+	return _mm256_mullo_epi32(_mm256_add_epi32(
+		_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+		_mm256_set1_epi32((int)(from / 4))),
+		_mm256_set1_epi32((int)RAND_PHI32));
+}
+
+__attribute__((target("avx2"))) static void
+rand_fill_avx2(BYTE *buf, size_t blk_sz, uint64_t bkey, size_t from)
+{
+	const __m256i lo = _mm256_set1_epi32((int)(uint32_t)bkey);
+	const __m256i hi = _mm256_set1_epi32((int)(uint32_t)(bkey >> 32));
+	const __m256i step = _mm256_set1_epi32((int)(8 * RAND_PHI32));
+	__m256i c = rand_ctr_avx2(from);
+	size_t off;
+
+	for (off = from; off + 32 <= blk_sz; off += 32)
+	{
+		_mm256_storeu_si256((__m256i *)(buf + off),
+			fmix32_avx2(_mm256_xor_si256(_mm256_add_epi32(c, lo), hi)));
+		c = _mm256_add_epi32(c, step);
+	}
+	if (off < blk_sz)
+		rand_fill_scalar(buf, blk_sz, bkey, off);
+}
+
+__attribute__((target("avx2"))) static int
+rand_block_avx2(const BYTE *buf, size_t blk_sz, uint64_t bkey, size_t from)
+{
+	const __m256i lo = _mm256_set1_epi32((int)(uint32_t)bkey);
+	const __m256i hi = _mm256_set1_epi32((int)(uint32_t)(bkey >> 32));
+	const __m256i step = _mm256_set1_epi32((int)(8 * RAND_PHI32));
+	__m256i c = rand_ctr_avx2(from);
+	__m256i d = _mm256_setzero_si256();
+	size_t off;
+
+	// c holds i * phi for the 8 lanes, advanced by 8 * phi per step
+	for (off = from; off + 32 <= blk_sz; off += 32)
+	{
+		__m256i w = fmix32_avx2(_mm256_xor_si256(_mm256_add_epi32(c, lo), hi));
+
+		d = _mm256_or_si256(d, _mm256_xor_si256(w,
+			_mm256_loadu_si256((const __m256i *)(buf + off))));
+		c = _mm256_add_epi32(c, step);
+	}
+	if (!_mm256_testz_si256(d, d))
+		return 1;
+	return (off < blk_sz) ? (rand_block_tail(buf, blk_sz, bkey, off) < blk_sz)
+			      : 0;
+}
+
+__attribute__((target("avx512f"))) static inline __m512i
+fmix32_avx512(__m512i x)
+{
+	x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+	x = _mm512_mullo_epi32(x, _mm512_set1_epi32((int)0x85EBCA6BU));
+	x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 13));
+	x = _mm512_mullo_epi32(x, _mm512_set1_epi32((int)0xC2B2AE35U));
+	return _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+}
+
+__attribute__((target("avx512f"))) static inline __m512i
+rand_ctr_avx512(size_t from)
+{
+	return _mm512_mullo_epi32(_mm512_add_epi32(
+		_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+				  8, 9, 10, 11, 12, 13, 14, 15),
+		_mm512_set1_epi32((int)(from / 4))),
+		_mm512_set1_epi32((int)RAND_PHI32));
+}
+
+__attribute__((target("avx512f"))) static void
+rand_fill_avx512(BYTE *buf, size_t blk_sz, uint64_t bkey, size_t from)
+{
+	const __m512i lo = _mm512_set1_epi32((int)(uint32_t)bkey);
+	const __m512i hi = _mm512_set1_epi32((int)(uint32_t)(bkey >> 32));
+	const __m512i step = _mm512_set1_epi32((int)(16 * RAND_PHI32));
+	__m512i c = rand_ctr_avx512(from);
+	size_t off;
+
+	for (off = from; off + 64 <= blk_sz; off += 64)
+	{
+		_mm512_storeu_si512((void *)(buf + off),
+			fmix32_avx512(_mm512_xor_si512(_mm512_add_epi32(c, lo), hi)));
+		c = _mm512_add_epi32(c, step);
+	}
+	if (off < blk_sz)
+		rand_fill_scalar(buf, blk_sz, bkey, off);
+}
+
+__attribute__((target("avx512f"))) static int
+rand_block_avx512(const BYTE *buf, size_t blk_sz, uint64_t bkey, size_t from)
+{
+	const __m512i lo = _mm512_set1_epi32((int)(uint32_t)bkey);
+	const __m512i hi = _mm512_set1_epi32((int)(uint32_t)(bkey >> 32));
+	const __m512i step = _mm512_set1_epi32((int)(16 * RAND_PHI32));
+	__m512i c = rand_ctr_avx512(from);
+	__m512i d = _mm512_setzero_si512();
+	size_t off;
+
+	for (off = from; off + 64 <= blk_sz; off += 64)
+	{
+		__m512i w = fmix32_avx512(_mm512_xor_si512(_mm512_add_epi32(c, lo), hi));
+
+		d = _mm512_or_si512(d, _mm512_xor_si512(w,
+			_mm512_loadu_si512((const void *)(buf + off))));
+		c = _mm512_add_epi32(c, step);
+	}
+	if (_mm512_test_epi32_mask(d, d))
+		return 1;
+	return (off < blk_sz) ? (rand_block_tail(buf, blk_sz, bkey, off) < blk_sz)
+			      : 0;
+}
+#endif
+
+#if defined(__aarch64__)
+static inline uint32x4_t
+fmix32_neon(uint32x4_t x)
+{
+	x = veorq_u32(x, vshrq_n_u32(x, 16));
+	x = vmulq_u32(x, vdupq_n_u32(0x85EBCA6BU));
+	x = veorq_u32(x, vshrq_n_u32(x, 13));
+	x = vmulq_u32(x, vdupq_n_u32(0xC2B2AE35U));
+	return veorq_u32(x, vshrq_n_u32(x, 16));
+}
+
+static inline uint32x4_t
+rand_ctr_neon(size_t from)
+{
+	static const uint32_t lanes[4] = {0, 1, 2, 3};
+
+	return vmulq_u32(vaddq_u32(vld1q_u32(lanes),
+				   vdupq_n_u32((uint32_t)(from / 4))),
+			 vdupq_n_u32(RAND_PHI32));
+}
+
+static void
+rand_fill_neon(BYTE *buf, size_t blk_sz, uint64_t bkey, size_t from)
+{
+	const uint32x4_t lo = vdupq_n_u32((uint32_t)bkey);
+	const uint32x4_t hi = vdupq_n_u32((uint32_t)(bkey >> 32));
+	const uint32x4_t step = vdupq_n_u32(4 * RAND_PHI32);
+	uint32x4_t c = rand_ctr_neon(from);
+	size_t off;
+
+	for (off = from; off + 16 <= blk_sz; off += 16)
+	{
+		vst1q_u8(buf + off, vreinterpretq_u8_u32(
+			fmix32_neon(veorq_u32(vaddq_u32(c, lo), hi))));
+		c = vaddq_u32(c, step);
+	}
+	if (off < blk_sz)
+		rand_fill_scalar(buf, blk_sz, bkey, off);
+}
+
+static int
+rand_block_neon(const BYTE *buf, size_t blk_sz, uint64_t bkey, size_t from)
+{
+	const uint32x4_t lo = vdupq_n_u32((uint32_t)bkey);
+	const uint32x4_t hi = vdupq_n_u32((uint32_t)(bkey >> 32));
+	const uint32x4_t step = vdupq_n_u32(4 * RAND_PHI32);
+	uint32x4_t c = rand_ctr_neon(from);
+	uint32x4_t d = vdupq_n_u32(0);
+	size_t off;
+
+	for (off = from; off + 16 <= blk_sz; off += 16)
+	{
+		uint32x4_t w = fmix32_neon(veorq_u32(vaddq_u32(c, lo), hi));
+
+		d = vorrq_u32(d, veorq_u32(w, vreinterpretq_u32_u8(vld1q_u8(buf + off))));
+		c = vaddq_u32(c, step);
+	}
+	if (vmaxvq_u32(d))
+		return 1;
+	return (off < blk_sz) ? (rand_block_tail(buf, blk_sz, bkey, off) < blk_sz)
+			      : 0;
+}
+#endif
+
+typedef int (*rand_block_fn)(const BYTE *, size_t, uint64_t, size_t);
+typedef void (*rand_fill_fn)(BYTE *, size_t, uint64_t, size_t);
+
+static struct
+{
+	rand_block_fn check;
+	rand_fill_fn fill;
+} rand_impl;
+static pthread_once_t rand_once = PTHREAD_ONCE_INIT;
+
+static void
+rand_select(void)
+{
+	rand_impl.check = rand_block_scalar;
+	rand_impl.fill = rand_fill_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+	if (cpu_isa() & ISA_AVX512F)
+	{
+		rand_impl.check = rand_block_avx512;
+		rand_impl.fill = rand_fill_avx512;
+	}
+	else if (cpu_isa() & ISA_AVX2)
+	{
+		rand_impl.check = rand_block_avx2;
+		rand_impl.fill = rand_fill_avx2;
+	}
+#elif defined(__aarch64__)
+	if (cpu_isa() & ISA_NEON)
+	{
+		rand_impl.check = rand_block_neon;
+		rand_impl.fill = rand_fill_neon;
+	}
+#endif
+}
+
+void
+rand_pattern_fill(BYTE *buf, size_t blk_sz, int blocks, uint64_t key, uint64_t lba)
+{
+	int b;
+
+	pthread_once(&rand_once, rand_select);
+	for (b = 0; b < blocks; ++b, buf += blk_sz)
+		rand_impl.fill(buf, blk_sz, rand_block_key(key, lba + b), 0);
+}
+
+size_t
+rand_pattern_check(const BYTE *buf, size_t blk_sz, int blocks, uint64_t key, uint64_t lba)
+{
+	int b;
+
+	pthread_once(&rand_once, rand_select);
+	for (b = 0; b < blocks; ++b, buf += blk_sz)
+	{
+		uint64_t bkey = rand_block_key(key, lba + b);
+
+		if (rand_impl.check(buf, blk_sz, bkey, 0))
+			return b * blk_sz + rand_block_tail(buf, blk_sz, bkey, 0);
+	}
+	return (size_t)blocks * blk_sz;
+}
+
+//=============================================================================
+//=  LBA stamped pattern: the random pattern under a header naming the block  =
+//=============================================================================
+// The first STAMP_HDR_SZ bytes of a block are replaced by its stamp, the
+// rest is the random pattern of the pass, so a block read back from the
+// wrong LBA, from an older pass or from another run says which it is.
+// The header is compared as one 32 byte word, the payload by the kernels
+// of the random pattern from word 8 on, in the same pass over the block.
+
+static void
+stamp_header(BYTE *hdr, uint64_t run, unsigned int pass, uint64_t lba)
+{
+	uint64_t v[4];
+	int k;
+
+	v[0] = (uint64_t)STAMP_MAGIC | ((uint64_t)pass << 32);
+	v[1] = lba;
+	v[2] = run;
+	v[3] = splitmix64(v[0] ^ splitmix64(v[1] ^ splitmix64(v[2])));
+	for (k = 0; k < 4; ++k)
+	{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+		v[k] = __builtin_bswap64(v[k]);
+#endif
+		memcpy(hdr + 8 * k, v + k, 8);
+	}
+}
+
+void
+stamp_pattern_fill(BYTE *buf, size_t blk_sz, int blocks, uint64_t key,
+		   uint64_t run, unsigned int pass, uint64_t lba)
+{
+	int b;
+
+	pthread_once(&rand_once, rand_select);
+	for (b = 0; b < blocks; ++b, buf += blk_sz)
+	{
+		stamp_header(buf, run, pass, lba + b);
+		rand_impl.fill(buf, blk_sz, rand_block_key(key, lba + b),
+			       STAMP_HDR_SZ);
+	}
+}
+
+size_t
+stamp_pattern_check(const BYTE *buf, size_t blk_sz, int blocks, uint64_t key,
+		    uint64_t run, unsigned int pass, uint64_t lba)
+{
+	BYTE hdr[STAMP_HDR_SZ];
+	uint64_t bkey;
+	size_t k;
+	int b;
+
+	pthread_once(&rand_once, rand_select);
+	for (b = 0; b < blocks; ++b, buf += blk_sz)
+	{
+		stamp_header(hdr, run, pass, lba + b);
+		bkey = rand_block_key(key, lba + b);
+		if (memcmp(buf, hdr, STAMP_HDR_SZ))
+		{
+			for (k = 0; buf[k] == hdr[k]; ++k)
+				;
+			return b * blk_sz + k;
+		}
+		if (rand_impl.check(buf, blk_sz, bkey, STAMP_HDR_SZ))
+			return b * blk_sz +
+			       rand_block_tail(buf, blk_sz, bkey, STAMP_HDR_SZ);
+	}
+	return (size_t)blocks * blk_sz;
+}
+
+int
+stamp_decode(const BYTE *blk, struct stamp *st)
+{
+	uint64_t v[4];
+	int k;
+
+	for (k = 0; k < 4; ++k)
+	{
+		memcpy(v + k, blk + 8 * k, 8);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+		v[k] = __builtin_bswap64(v[k]);
+#endif
+	}
+	if (((uint32_t)v[0] != STAMP_MAGIC) ||
+	    (v[3] != splitmix64(v[0] ^ splitmix64(v[1] ^ splitmix64(v[2])))))
+		return -1;
+	st->pass = (unsigned int)(v[0] >> 32);
+	st->lba = v[1];
+	st->run = v[2];
+	return 0;
+}
+
+//=============================================================================
+//=  CRC32 and CRC32C: slicing-by-16, PCLMULQDQ, SSE4.2 and ARMv8 kernels     =
+//=============================================================================
+// Both are reflected with initial value and final xor ~0: crc32() is the
+// CRC of zlib, crc32c() that of iSCSI and ext4. A CRC is carried on by
+// passing it back, crc32(crc32(0, a), b) is that of a then b. The kernels
+// work on the register, the CRC inverted. The tables are made once, on
+// first use, crc32_tab the first of those of CRC32.
+
+#if defined(__aarch64__)
+#include <arm_acle.h>
+#endif
+
+#define CRC32_POLY 0xedb88320U
+#define CRC32C_POLY 0x82f63b78U
+#define CRC_X2N 67 // x^(2^k) for the 64 bits of a length 2^3 bytes up
+
+static uint32_t crc32_slice[16][256];
+static uint32_t crc32c_slice[16][256];
+static uint32_t crc32_x2n[CRC_X2N];
+static uint32_t crc32c_x2n[CRC_X2N];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+typedef uint32_t (*crc_fn)(uint32_t, const BYTE *, size_t);
+
+static crc_fn crc32_impl;
+static crc_fn crc32c_impl;
+
+// a * b modulo poly, a not 0
+static uint32_t
+crc_multmodp(uint32_t a, uint32_t b, uint32_t poly)
+{
+	uint32_t m = 1U << 31, p = 0;
+
+	for (;;)
+	{
+		if (a & m)
+		{
+			p ^= b;
+			if (0 == (a & (m - 1)))
+				break;
+		}
+		m >>= 1;
+		b = (b & 1) ? (b >> 1) ^ poly : b >> 1;
+	}
+	return p;
+}
+
+// x^(n * 2^k) modulo poly
+static uint32_t
+crc_x2nmodp(const uint32_t *x2n, uint64_t n, int k, uint32_t poly)
+{
+	uint32_t p = 1U << 31; // x^0
+
+	for (; n; n >>= 1, ++k)
+		if (n & 1)
+			p = crc_multmodp(x2n[k], p, poly);
+	return p;
+}
+
+static void
+crc_tables(uint32_t t[16][256], uint32_t *x2n, uint32_t poly,
+	   const unsigned int *first)
+{
+	uint32_t c;
+	int k, n;
+
+	for (n = 0; n < 256; ++n)
+	{
+		c = n;
+		for (k = 0; k < 8; ++k)
+			c = (c & 1) ? (c >> 1) ^ poly : c >> 1;
+		t[0][n] = first ? first[n] : c;
+	}
+	for (n = 0; n < 256; ++n)
+		for (k = 1; k < 16; ++k)
+			t[k][n] = (t[k - 1][n] >> 8) ^ t[0][t[k - 1][n] & 0xff];
+	x2n[0] = 1U << 30; // x^1
+	for (n = 1; n < CRC_X2N; ++n)
+		x2n[n] = crc_multmodp(x2n[n - 1], x2n[n - 1], poly);
+}
+
+static uint32_t
+crc_slice16(uint32_t t[16][256], uint32_t crc, const BYTE *p, size_t len)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint32_t w[4];
+
+	for (; len >= 16; len -= 16, p += 16)
+	{
+		memcpy(w, p, 16);
+		w[0] ^= crc;
+		crc = t[15][w[0] & 0xff] ^ t[14][(w[0] >> 8) & 0xff] ^
+		      t[13][(w[0] >> 16) & 0xff] ^ t[12][w[0] >> 24] ^
+		      t[11][w[1] & 0xff] ^ t[10][(w[1] >> 8) & 0xff] ^
+		      t[9][(w[1] >> 16) & 0xff] ^ t[8][w[1] >> 24] ^
+		      t[7][w[2] & 0xff] ^ t[6][(w[2] >> 8) & 0xff] ^
+		      t[5][(w[2] >> 16) & 0xff] ^ t[4][w[2] >> 24] ^
+		      t[3][w[3] & 0xff] ^ t[2][(w[3] >> 8) & 0xff] ^
+		      t[1][(w[3] >> 16) & 0xff] ^ t[0][w[3] >> 24];
+	}
+#endif
+	while (len--)
+		crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static uint32_t
+crc32_slicing(uint32_t crc, const BYTE *p, size_t len)
+{
+	return crc_slice16(crc32_slice, crc, p, len);
+}
+
+static uint32_t
+crc32c_slicing(uint32_t crc, const BYTE *p, size_t len)
+{
+	return crc_slice16(crc32c_slice, crc, p, len);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("pclmul,sse4.1"))) static inline __m128i
+crc_fold(__m128i x, __m128i k, const BYTE *p)
+{
+	return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+					   _mm_clmulepi64_si128(x, k, 0x11)),
+			     _mm_loadu_si128((const __m128i *)p));
+}
+
+// Folds four 128 bit lanes by carry-less multiplies, 64 bytes a step,
+// then into one lane and reduces it (Barrett) to the CRC. The constants
+// are x^n modulo the polynomial, as in "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ" (Intel, 2009)
+__attribute__((target("pclmul,sse4.1"))) static uint32_t
+crc32_pclmul(uint32_t crc, const BYTE *p, size_t len)
+{
+	const __m128i k1k2 = _mm_set_epi64x(0x1c6e41596LL, 0x154442bd4LL);
+	const __m128i k3k4 = _mm_set_epi64x(0x0ccaa009eLL, 0x1751997d0LL);
+	const __m128i k5 = _mm_set_epi64x(0, 0x163cd6124LL);
+	const __m128i poly = _mm_set_epi64x(0x1f7011641LL, 0x1db710641LL);
+	const __m128i mask32 = _mm_set_epi32(0, 0, 0, -1);
+	__m128i x0, x1, x2, x3, t;
+
+	if (len < 64)
+		return crc32_slicing(crc, p, len);
+	x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)p),
+			   _mm_cvtsi32_si128((int)crc));
+	x1 = _mm_loadu_si128((const __m128i *)(p + 16));
+	x2 = _mm_loadu_si128((const __m128i *)(p + 32));
+	x3 = _mm_loadu_si128((const __m128i *)(p + 48));
+	for (p += 64, len -= 64; len >= 64; p += 64, len -= 64)
+	{
+		x0 = crc_fold(x0, k1k2, p);
+		x1 = crc_fold(x1, k1k2, p + 16);
+		x2 = crc_fold(x2, k1k2, p + 32);
+		x3 = crc_fold(x3, k1k2, p + 48);
+	}
+	x0 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x0, k3k4, 0x00),
+					 _mm_clmulepi64_si128(x0, k3k4, 0x11)), x1);
+	x0 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x0, k3k4, 0x00),
+					 _mm_clmulepi64_si128(x0, k3k4, 0x11)), x2);
+	x0 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x0, k3k4, 0x00),
+					 _mm_clmulepi64_si128(x0, k3k4, 0x11)), x3);
+	for (; len >= 16; p += 16, len -= 16)
+		x0 = crc_fold(x0, k3k4, p);
+	// 128 bits to 64, to 32, then the Barrett reduction
+	t = _mm_clmulepi64_si128(k3k4, x0, 0x01);
+	x0 = _mm_xor_si128(_mm_srli_si128(x0, 8), t);
+	t = _mm_clmulepi64_si128(_mm_and_si128(x0, mask32), k5, 0x00);
+	x0 = _mm_xor_si128(_mm_srli_si128(x0, 4), t);
+	t = _mm_clmulepi64_si128(_mm_and_si128(x0, mask32), poly, 0x10);
+	t = _mm_clmulepi64_si128(_mm_and_si128(t, mask32), poly, 0x00);
+	crc = (uint32_t)_mm_extract_epi32(_mm_xor_si128(x0, t), 1);
+	return crc32_slicing(crc, p, len);
+}
+
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_sse42(uint32_t crc, const BYTE *p, size_t len)
+{
+#if defined(__x86_64__)
+	uint64_t c = crc, w;
+
+	for (; len >= 8; len -= 8, p += 8)
+	{
+		memcpy(&w, p, 8);
+		c = _mm_crc32_u64(c, w);
+	}
+	crc = (uint32_t)c;
+#else
+	uint32_t w;
+
+	for (; len >= 4; len -= 4, p += 4)
+	{
+		memcpy(&w, p, 4);
+		crc = _mm_crc32_u32(crc, w);
+	}
+#endif
+	while (len--)
+		crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+#endif
+
+#if defined(__aarch64__)
+__attribute__((target("+crc"))) static uint32_t
+crc32_armv8(uint32_t crc, const BYTE *p, size_t len)
+{
+	uint64_t w;
+
+	for (; len >= 8; len -= 8, p += 8)
+	{
+		memcpy(&w, p, 8);
+		crc = __crc32d(crc, w);
+	}
+	while (len--)
+		crc = __crc32b(crc, *p++);
+	return crc;
+}
+
+__attribute__((target("+crc"))) static uint32_t
+crc32c_armv8(uint32_t crc, const BYTE *p, size_t len)
+{
+	uint64_t w;
+
+	for (; len >= 8; len -= 8, p += 8)
+	{
+		memcpy(&w, p, 8);
+		crc = __crc32cd(crc, w);
+	}
+	while (len--)
+		crc = __crc32cb(crc, *p++);
+	return crc;
+}
+#endif
+
+static void
+crc_init(void)
+{
+	crc_tables(crc32_slice, crc32_x2n, CRC32_POLY, crc32_tab);
+	crc_tables(crc32c_slice, crc32c_x2n, CRC32C_POLY, NULL);
+	crc32_impl = crc32_slicing;
+	crc32c_impl = crc32c_slicing;
+#if defined(__x86_64__) || defined(__i386__)
+	if ((cpu_isa() & (ISA_PCLMUL | ISA_SSE41)) == (ISA_PCLMUL | ISA_SSE41))
+		crc32_impl = crc32_pclmul;
+	if (cpu_isa() & ISA_SSE42)
+		crc32c_impl = crc32c_sse42;
+#elif defined(__aarch64__)
+	if (cpu_isa() & ISA_CRC32)
+	{
+		crc32_impl = crc32_armv8;
+		crc32c_impl = crc32c_armv8;
+	}
+#endif
+}
+
 unsigned int
 crc32(unsigned int crc, const void *buf, int size)
 {
-	const unsigned char *p;
+	pthread_once(&crc_once, crc_init);
+	return ~crc32_impl(~crc, (const BYTE *)buf, (size > 0) ? size : 0);
+}
+
+unsigned int
+crc32c(unsigned int crc, const void *buf, size_t size)
+{
+	pthread_once(&crc_once, crc_init);
+	return ~crc32c_impl(~crc, (const BYTE *)buf, size);
+}
+
+unsigned int
+crc32_combine(unsigned int crc1, unsigned int crc2, uint64_t len2)
+{
+	pthread_once(&crc_once, crc_init);
+	return crc_multmodp(crc_x2nmodp(crc32_x2n, len2, 3, CRC32_POLY), crc1,
+			    CRC32_POLY) ^ crc2;
+}
+
+unsigned int
+crc32c_combine(unsigned int crc1, unsigned int crc2, uint64_t len2)
+{
+	pthread_once(&crc_once, crc_init);
+	return crc_multmodp(crc_x2nmodp(crc32c_x2n, len2, 3, CRC32C_POLY), crc1,
+			    CRC32C_POLY) ^ crc2;
+}
+
+//=============================================================================
+//=  CRC16 T10-DIF: the guard tag of SCSI protection information            =
+//=============================================================================
+// Polynomial 0x8bb7, not reflected, initial value 0 and no final xor.
+// Most significant bit first, so the PCLMULQDQ kernel byte reverses each
+// 16 bytes read and folds them as polynomials of degree 127 down: the
+// 64 bit halves of a lane times x^(n + 64) and x^n modulo P, n the bits
+// folded over. What is left, congruent to the data, is run through the
+// table, which also takes the tail.
+
+#define T10DIF_POLY 0x8bb7U
+
+static uint16_t t10dif_slice[8][256];
+static uint64_t t10dif_k[4]; // x^576, x^512, x^192, x^128 modulo P
+static pthread_once_t t10dif_once = PTHREAD_ONCE_INIT;
+
+static uint16_t (*t10dif_impl)(uint16_t, const BYTE *, size_t);
+
+// x^n modulo P
+static uint64_t
+t10dif_xnmodp(unsigned int n)
+{
+	uint32_t r = 1;
+
+	while (n--)
+		r = (r & 0x8000) ? ((r << 1) ^ T10DIF_POLY) & 0xffff : r << 1;
+	return r;
+}
+
+static uint16_t
+t10dif_slicing(uint16_t crc, const BYTE *p, size_t len)
+{
+	for (; len >= 8; len -= 8, p += 8)
+		crc = t10dif_slice[7][(p[0] ^ (crc >> 8)) & 0xff] ^
+		      t10dif_slice[6][(p[1] ^ crc) & 0xff] ^
+		      t10dif_slice[5][p[2]] ^ t10dif_slice[4][p[3]] ^
+		      t10dif_slice[3][p[4]] ^ t10dif_slice[2][p[5]] ^
+		      t10dif_slice[1][p[6]] ^ t10dif_slice[0][p[7]];
+	while (len--)
+		crc = (uint16_t)(crc << 8) ^
+		      t10dif_slice[0][((crc >> 8) ^ *p++) & 0xff];
+	return crc;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("pclmul,sse4.1"))) static inline __m128i
+t10dif_load(const BYTE *p)
+{
+	const __m128i rev = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+					 12, 13, 14, 15);
+
+	return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p), rev);
+}
+
+__attribute__((target("pclmul,sse4.1"))) static inline __m128i
+t10dif_fold(__m128i x, __m128i k, __m128i y)
+{
+	return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+					   _mm_clmulepi64_si128(x, k, 0x11)), y);
+}
+
+__attribute__((target("pclmul,sse4.1"))) static uint16_t
+t10dif_pclmul(uint16_t crc, const BYTE *p, size_t len)
+{
+	const __m128i k512 = _mm_set_epi64x((long long)t10dif_k[0],
+					    (long long)t10dif_k[1]);
+	const __m128i k128 = _mm_set_epi64x((long long)t10dif_k[2],
+					    (long long)t10dif_k[3]);
+	__m128i x0, x1, x2, x3;
+	BYTE rest[16];
+
+	if (len < 64)
+		return t10dif_slicing(crc, p, len);
+	x0 = _mm_xor_si128(t10dif_load(p),
+			   _mm_slli_si128(_mm_cvtsi32_si128(crc), 14));
+	x1 = t10dif_load(p + 16);
+	x2 = t10dif_load(p + 32);
+	x3 = t10dif_load(p + 48);
+	for (p += 64, len -= 64; len >= 64; p += 64, len -= 64)
+	{
+		x0 = t10dif_fold(x0, k512, t10dif_load(p));
+		x1 = t10dif_fold(x1, k512, t10dif_load(p + 16));
+		x2 = t10dif_fold(x2, k512, t10dif_load(p + 32));
+		x3 = t10dif_fold(x3, k512, t10dif_load(p + 48));
+	}
+	x0 = t10dif_fold(x0, k128, x1);
+	x0 = t10dif_fold(x0, k128, x2);
+	x0 = t10dif_fold(x0, k128, x3);
+	for (; len >= 16; p += 16, len -= 16)
+		x0 = t10dif_fold(x0, k128, t10dif_load(p));
+	// back to bytes in data order, then the table
+	_mm_storeu_si128((__m128i *)rest,
+			 _mm_shuffle_epi8(x0, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6,
+							   7, 8, 9, 10, 11, 12,
+							   13, 14, 15)));
+	crc = t10dif_slicing(0, rest, sizeof(rest));
+	return t10dif_slicing(crc, p, len);
+}
+#endif
+
+static void
+t10dif_init(void)
+{
+	uint16_t c;
+	int k, n;
+
+	for (n = 0; n < 256; ++n)
+	{
+		c = (uint16_t)(n << 8);
+		for (k = 0; k < 8; ++k)
+			c = (c & 0x8000) ? (uint16_t)(c << 1) ^ T10DIF_POLY
+					 : (uint16_t)(c << 1);
+		t10dif_slice[0][n] = c;
+	}
+	for (n = 0; n < 256; ++n)
+		for (k = 1; k < 8; ++k)
+			t10dif_slice[k][n] =
+			    (uint16_t)(t10dif_slice[k - 1][n] << 8) ^
+			    t10dif_slice[0][t10dif_slice[k - 1][n] >> 8];
+	t10dif_k[0] = t10dif_xnmodp(576);
+	t10dif_k[1] = t10dif_xnmodp(512);
+	t10dif_k[2] = t10dif_xnmodp(192);
+	t10dif_k[3] = t10dif_xnmodp(128);
+	t10dif_impl = t10dif_slicing;
+#if defined(__x86_64__) || defined(__i386__)
+	if ((cpu_isa() & (ISA_PCLMUL | ISA_SSE41)) == (ISA_PCLMUL | ISA_SSE41))
+		t10dif_impl = t10dif_pclmul;
+#endif
+}
+
+uint16_t
+crc16_t10dif(uint16_t crc, const void *buf, size_t size)
+{
+	pthread_once(&t10dif_once, t10dif_init);
+	return t10dif_impl(crc, (const BYTE *)buf, size);
+}
+
+//=============================================================================
+//=  CRC64 NVMe: the 64 bit guard of NVMe protection information             =
+//=============================================================================
+// Polynomial 0xad93d23594c93659, reflected, initial value and final xor
+// ~0 (CRC-64/NVME, Rocksoft). The PCLMULQDQ kernel folds 128 bit lanes
+// as crc32_pclmul() does. A lane bit j is x^(127 - j), so the product of
+// two 64 bit halves comes out times x^-1: folding a half over n bits
+// multiplies it by x^(n - 1) modulo P, bit reversed, for the half of the
+// lower degrees and x^(n + 63) for the other. The lane left is run
+// through the table like t10dif_pclmul() does.
+
+#define CRC64_NVME_POLY 0x9a6c9329ac4bc9b5ULL // reflected
+
+static uint64_t crc64_slice[8][256];
+static uint64_t crc64_k[4]; // x^575, x^511, x^191, x^127 modulo P, reflected
+static pthread_once_t crc64_once = PTHREAD_ONCE_INIT;
+
+static uint64_t (*crc64_impl)(uint64_t, const BYTE *, size_t);
+
+// x^n modulo P, bit reversed
+static uint64_t
+crc64_xnmodp(unsigned int n)
+{
+	uint64_t r = 1ULL << 63; // x^0
+
+	while (n--)
+		r = (r & 1) ? (r >> 1) ^ CRC64_NVME_POLY : r >> 1;
+	return r;
+}
+
+static uint64_t
+crc64_slicing(uint64_t crc, const BYTE *p, size_t len)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t w;
+
+	for (; len >= 8; len -= 8, p += 8)
+	{
+		memcpy(&w, p, 8);
+		w ^= crc;
+		crc = crc64_slice[7][w & 0xff] ^ crc64_slice[6][(w >> 8) & 0xff] ^
+		      crc64_slice[5][(w >> 16) & 0xff] ^
+		      crc64_slice[4][(w >> 24) & 0xff] ^
+		      crc64_slice[3][(w >> 32) & 0xff] ^
+		      crc64_slice[2][(w >> 40) & 0xff] ^
+		      crc64_slice[1][(w >> 48) & 0xff] ^ crc64_slice[0][w >> 56];
+	}
+#endif
+	while (len--)
+		crc = crc64_slice[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("pclmul,sse4.1"))) static uint64_t
+crc64_pclmul(uint64_t crc, const BYTE *p, size_t len)
+{
+	const __m128i k512 = _mm_set_epi64x((long long)crc64_k[1],
+					    (long long)crc64_k[0]);
+	const __m128i k128 = _mm_set_epi64x((long long)crc64_k[3],
+					    (long long)crc64_k[2]);
+	__m128i x0, x1, x2, x3;
+	BYTE rest[16];
+
+	if (len < 64)
+		return crc64_slicing(crc, p, len);
+	x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)p),
+			   _mm_cvtsi64_si128((long long)crc));
+	x1 = _mm_loadu_si128((const __m128i *)(p + 16));
+	x2 = _mm_loadu_si128((const __m128i *)(p + 32));
+	x3 = _mm_loadu_si128((const __m128i *)(p + 48));
+	for (p += 64, len -= 64; len >= 64; p += 64, len -= 64)
+	{
+		x0 = crc_fold(x0, k512, p);
+		x1 = crc_fold(x1, k512, p + 16);
+		x2 = crc_fold(x2, k512, p + 32);
+		x3 = crc_fold(x3, k512, p + 48);
+	}
+	x0 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x0, k128, 0x00),
+					 _mm_clmulepi64_si128(x0, k128, 0x11)), x1);
+	x0 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x0, k128, 0x00),
+					 _mm_clmulepi64_si128(x0, k128, 0x11)), x2);
+	x0 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x0, k128, 0x00),
+					 _mm_clmulepi64_si128(x0, k128, 0x11)), x3);
+	for (; len >= 16; p += 16, len -= 16)
+		x0 = crc_fold(x0, k128, p);
+	_mm_storeu_si128((__m128i *)rest, x0);
+	crc = crc64_slicing(0, rest, sizeof(rest));
+	return crc64_slicing(crc, p, len);
+}
+#endif
 
-	p = (unsigned char *)buf;
-	crc = crc ^ ~0U;
+static void
+crc64_init(void)
+{
+	uint64_t c;
+	int k, n;
 
-	while (size--)
-		crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	for (n = 0; n < 256; ++n)
+	{
+		c = n;
+		for (k = 0; k < 8; ++k)
+			c = (c & 1) ? (c >> 1) ^ CRC64_NVME_POLY : c >> 1;
+		crc64_slice[0][n] = c;
+	}
+	for (n = 0; n < 256; ++n)
+		for (k = 1; k < 8; ++k)
+			crc64_slice[k][n] = (crc64_slice[k - 1][n] >> 8) ^
+					    crc64_slice[0][crc64_slice[k - 1][n] & 0xff];
+	crc64_k[0] = crc64_xnmodp(575);
+	crc64_k[1] = crc64_xnmodp(511);
+	crc64_k[2] = crc64_xnmodp(191);
+	crc64_k[3] = crc64_xnmodp(127);
+	crc64_impl = crc64_slicing;
+#if defined(__x86_64__) || defined(__i386__)
+	if ((cpu_isa() & (ISA_PCLMUL | ISA_SSE41)) == (ISA_PCLMUL | ISA_SSE41))
+		crc64_impl = crc64_pclmul;
+#endif
+}
 
-	return crc ^ ~0U;
+uint64_t
+crc64_nvme(uint64_t crc, const void *buf, size_t size)
+{
+	pthread_once(&crc64_once, crc64_init);
+	return ~crc64_impl(~crc, (const BYTE *)buf, size);
 }
 
 //=============================================================================
-//=  Compute Internet Checksum for count bytes beginning at location addr     =
+//=  Internet checksum: the ones' complement sum of RFC 1071                  =
 //=============================================================================
+// The sum is of the 16 bit words of the buffer in host order, as it lies
+// in memory, so the checksum can be stored there as is. 32 bit words are
+// added into 64 bit sums, 2^16 being 1 modulo 0xffff, and folded at the
+// end. A piece that starts at an odd offset of the whole has its bytes
+// in the other halves of the words, its folded sum byte swapped.
+
+#define CSUM_STEP (1ULL << 30) // bytes a kernel sums without overflow
+
+static uint64_t
+csum_add(uint64_t a, uint64_t b)
+{
+	a += b;
+	return a + (a < b); // end around carry
+}
+
+static word16
+csum_fold(uint64_t s)
+{
+	s = (s & 0xffffffffULL) + (s >> 32);
+	s = (s & 0xffffffffULL) + (s >> 32);
+	s = (s & 0xffff) + (s >> 16);
+	s = (s & 0xffff) + (s >> 16);
+	return (word16)((s & 0xffff) + (s >> 16));
+}
+
+// The words after off of the len bytes at p, the last byte of an odd
+// len the first half of a word
+static uint64_t
+csum_tail(const BYTE *p, size_t off, size_t len)
+{
+	uint64_t s = 0;
+	uint32_t w;
+	word16 h;
+
+	for (; off + 4 <= len; off += 4)
+	{
+		memcpy(&w, p + off, 4);
+		s += w;
+	}
+	if (off + 2 <= len)
+	{
+		memcpy(&h, p + off, 2);
+		s += h;
+		off += 2;
+	}
+	if (off < len)
+	{
+		BYTE last[2] = {p[off], 0};
+
+		memcpy(&h, last, 2);
+		s += h;
+	}
+	return s;
+}
+
+static uint64_t
+csum_scalar(const BYTE *p, size_t len)
+{
+	return csum_tail(p, 0, len);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static uint64_t
+csum_avx2(const BYTE *p, size_t len)
+{
+	const __m256i lo32 = _mm256_set1_epi64x(0xffffffffLL);
+	__m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+	uint64_t lane[4];
+	size_t off = 0;
+
+	// the 32 bit words of 64 bit lanes, each half into a 64 bit sum
+	for (; off + 64 <= len; off += 64)
+	{
+		__m256i v0 = _mm256_loadu_si256((const __m256i *)(p + off));
+		__m256i v1 = _mm256_loadu_si256((const __m256i *)(p + off + 32));
+
+		a0 = _mm256_add_epi64(a0, _mm256_add_epi64(_mm256_and_si256(v0, lo32),
+							   _mm256_srli_epi64(v0, 32)));
+		a1 = _mm256_add_epi64(a1, _mm256_add_epi64(_mm256_and_si256(v1, lo32),
+							   _mm256_srli_epi64(v1, 32)));
+	}
+	_mm256_storeu_si256((__m256i *)lane, _mm256_add_epi64(a0, a1));
+	return lane[0] + lane[1] + lane[2] + lane[3] + csum_tail(p, off, len);
+}
+#endif
+
+#if defined(__aarch64__)
+static uint64_t
+csum_neon(const BYTE *p, size_t len)
+{
+	uint64x2_t a0 = vdupq_n_u64(0), a1 = vdupq_n_u64(0);
+	size_t off = 0;
+
+	for (; off + 32 <= len; off += 32)
+	{
+		a0 = vpadalq_u32(a0, vreinterpretq_u32_u8(vld1q_u8(p + off)));
+		a1 = vpadalq_u32(a1, vreinterpretq_u32_u8(vld1q_u8(p + off + 16)));
+	}
+	return vaddvq_u64(vaddq_u64(a0, a1)) + csum_tail(p, off, len);
+}
+#endif
+
+typedef uint64_t (*csum_fn)(const BYTE *, size_t);
+
+static csum_fn csum_impl;
+
+static csum_fn
+csum_select(void)
+{
+	csum_fn fn = csum_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (cpu_isa() & ISA_AVX2)
+		fn = csum_avx2;
+#elif defined(__aarch64__)
+	if (cpu_isa() & ISA_NEON)
+		fn = csum_neon;
+#endif
+	return fn;
+}
+
+void
+checksum_update(struct csum *st, const void *buf, size_t len)
+{
+	csum_fn fn = __atomic_load_n(&csum_impl, __ATOMIC_RELAXED);
+	const BYTE *p = (const BYTE *)buf;
+	uint64_t s = 0;
+	size_t n;
+	word16 f;
+
+	if (NULL == fn)
+	{
+		fn = csum_select();
+		__atomic_store_n(&csum_impl, fn, __ATOMIC_RELAXED);
+	}
+	for (; len > 0; len -= n, p += n)
+	{
+		n = (len > CSUM_STEP) ? CSUM_STEP : len;
+		s = csum_add(s, fn(p, n));
+	}
+	f = csum_fold(s);
+	if (st->len & 1)
+		f = (word16)((f >> 8) | (f << 8));
+	st->sum = csum_add(st->sum, f);
+	st->len += (uint64_t)(p - (const BYTE *)buf);
+}
+
+word16
+checksum_final(const struct csum *st)
+{
+	return (word16)~csum_fold(st->sum);
+}
+
 word16
-checksum(BYTE *addr, unsigned int count)
+checksum(const BYTE *addr, unsigned int count)
+{
+	struct csum st = {0, 0};
+
+	checksum_update(&st, addr, count);
+	return checksum_final(&st);
+}
+
+//=============================================================================
+//=  XXH3-128: the 128 bit hash of xxHash, streamed                          =
+//=============================================================================
+// XXH3 0.8 with the default secret, the digest of XXH3_128bits() of the
+// xxHash library for any length. Up to 240 bytes are kept whole and
+// hashed by the short paths at the end, 16, 128 or 240 bytes at most.
+// Past that it is the long path: 64 byte stripes folded into eight 64
+// bit lanes, the lanes scrambled every 16 stripes, then merged into two
+// halves. A stripe is folded only once a byte after it came, the last
+// 64 bytes being folded apart at the end.
+
+#define XXH_STRIPE 64
+#define XXH_SECRET_SZ 192
+#define XXH_STRIPES_PER_BLOCK ((XXH_SECRET_SZ - XXH_STRIPE) / 8)
+#define XXH_MIDSIZE_MAX 240
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static const BYTE xxh_secret[XXH_SECRET_SZ] = {
+	0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+	0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+	0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+	0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+	0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+	0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+	0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+	0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+	0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+	0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+	0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+	0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static uint32_t
+xxh_read32(const BYTE *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static uint64_t
+xxh_read64(const BYTE *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+// Folds n stripes at in into the lanes, stripe k with the secret at
+// sec + 8 * k
+static void
+xxh_stripes_scalar(uint64_t *acc, const BYTE *in, const BYTE *sec, size_t n)
+{
+	uint64_t v, dk;
+	int i;
+
+	for (; n > 0; --n, in += XXH_STRIPE, sec += 8)
+		for (i = 0; i < 8; ++i)
+		{
+			v = xxh_read64(in + 8 * i);
+			dk = v ^ xxh_read64(sec + 8 * i);
+			acc[i ^ 1] += v;
+			acc[i] += (dk & 0xffffffffULL) * (dk >> 32);
+		}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static void
+xxh_stripes_avx2(uint64_t *acc, const BYTE *in, const BYTE *sec, size_t n)
+{
+	__m256i a[2];
+	int i;
+
+	a[0] = _mm256_loadu_si256((const __m256i *)acc);
+	a[1] = _mm256_loadu_si256((const __m256i *)(acc + 4));
+	for (; n > 0; --n, in += XXH_STRIPE, sec += 8)
+		for (i = 0; i < 2; ++i)
+		{
+			__m256i v = _mm256_loadu_si256((const __m256i *)(in + 32 * i));
+			__m256i k = _mm256_loadu_si256((const __m256i *)(sec + 32 * i));
+			__m256i dk = _mm256_xor_si256(v, k);
+			__m256i hi = _mm256_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1));
+			__m256i sw = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+
+			a[i] = _mm256_add_epi64(_mm256_add_epi64(a[i], sw),
+						_mm256_mul_epu32(dk, hi));
+		}
+	_mm256_storeu_si256((__m256i *)acc, a[0]);
+	_mm256_storeu_si256((__m256i *)(acc + 4), a[1]);
+}
+#endif
+
+#if defined(__aarch64__)
+static void
+xxh_stripes_neon(uint64_t *acc, const BYTE *in, const BYTE *sec, size_t n)
+{
+	uint64x2_t a[4];
+	int i;
+
+	for (i = 0; i < 4; ++i)
+		a[i] = vld1q_u64(acc + 2 * i);
+	for (; n > 0; --n, in += XXH_STRIPE, sec += 8)
+		for (i = 0; i < 4; ++i)
+		{
+			uint64x2_t v = vreinterpretq_u64_u8(vld1q_u8(in + 16 * i));
+			uint64x2_t k = vreinterpretq_u64_u8(vld1q_u8(sec + 16 * i));
+			uint64x2_t dk = veorq_u64(v, k);
+
+			a[i] = vaddq_u64(a[i], vextq_u64(v, v, 1));
+			a[i] = vmlal_u32(a[i], vmovn_u64(dk), vshrn_n_u64(dk, 32));
+		}
+	for (i = 0; i < 4; ++i)
+		vst1q_u64(acc + 2 * i, a[i]);
+}
+#endif
+
+typedef void (*xxh_stripes_fn)(uint64_t *, const BYTE *, const BYTE *,
+			       size_t);
+
+static xxh_stripes_fn xxh_stripes_impl;
+
+static xxh_stripes_fn
+xxh_select(void)
+{
+	xxh_stripes_fn fn = xxh_stripes_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (cpu_isa() & ISA_AVX2)
+		fn = xxh_stripes_avx2;
+#elif defined(__aarch64__)
+	if (cpu_isa() & ISA_NEON)
+		fn = xxh_stripes_neon;
+#endif
+	return fn;
+}
+
+static void
+xxh_scramble(uint64_t *acc)
 {
-	register word32 sum = 0;
+	const BYTE *sec = xxh_secret + XXH_SECRET_SZ - XXH_STRIPE;
+	int i;
 
-	// Main summing loop
-	while (count > 1)
+	for (i = 0; i < 8; ++i)
 	{
-		word16 dd = ((word16)(*((word16 *)addr)));
-		sum = sum + (dd++);
-		count = count - 2;
+		acc[i] ^= acc[i] >> 47;
+		acc[i] ^= xxh_read64(sec + 8 * i);
+		acc[i] *= XXH_PRIME32_1;
 	}
+}
+
+// Folds n stripes, scrambling at the end of each block of them
+static void
+xxh_consume(struct xxh3 *st, xxh_stripes_fn fn, const BYTE *in, size_t n)
+{
+	size_t k;
 
-	// Add left-over byte, if any
-	if (count > 0)
-		sum = sum + *((BYTE *)addr);
+	while (n > 0)
+	{
+		k = XXH_STRIPES_PER_BLOCK - st->stripes;
+		if (k > n)
+			k = n;
+		fn(st->acc, in, xxh_secret + 8 * st->stripes, k);
+		st->stripes += k;
+		if (XXH_STRIPES_PER_BLOCK == st->stripes)
+		{
+			xxh_scramble(st->acc);
+			st->stripes = 0;
+		}
+		in += k * XXH_STRIPE;
+		n -= k;
+	}
+}
 
-	// Fold 32-bit sum to 16 bits
-	while (sum >> 16)
-		sum = (sum & 0xFFFF) + (sum >> 16);
+void
+xxh3_init(struct xxh3 *st)
+{
+	static const uint64_t acc0[8] = {
+		XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3,
+		XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1};
 
-	return(~sum);
+	memcpy(st->acc, acc0, sizeof(acc0));
+	st->total = 0;
+	st->stripes = 0;
+	st->nbuf = 0;
+	memset(st->last, 0, sizeof(st->last));
 }
 
-unsigned int
-xor128(void)
+// Feeds the long path len bytes at p
+static void
+xxh_feed(struct xxh3 *st, xxh_stripes_fn fn, const BYTE *p, size_t len)
 {
-	static unsigned int x = 123456789;
-	static unsigned int y = 362436069;
-	static unsigned int z = 521288629;
-	static unsigned int w = 88675123;
-	unsigned int t;
-	t = x ^ (x << 11);
-	x = y; y = z; z = w;
-	return w = w ^ (w >> 19) ^ (t ^ (t >> 8));
+	size_t k;
+
+	if (st->nbuf)
+	{
+		k = XXH_STRIPE - st->nbuf;
+		if (k > len)
+			k = len;
+		memcpy(st->buf + st->nbuf, p, k);
+		st->nbuf += k;
+		p += k;
+		len -= k;
+		if (0 == len)
+			return;
+		xxh_consume(st, fn, st->buf, 1);
+		memcpy(st->last, st->buf, XXH_STRIPE);
+		st->nbuf = 0;
+	}
+	if (len > XXH_STRIPE)
+	{
+		k = (len - 1) / XXH_STRIPE; // a byte at least left over
+		xxh_consume(st, fn, p, k);
+		p += k * XXH_STRIPE;
+		len -= k * XXH_STRIPE;
+		memcpy(st->last, p - XXH_STRIPE, XXH_STRIPE);
+	}
+	memcpy(st->buf, p, len);
+	st->nbuf = len;
+}
+
+void
+xxh3_update(struct xxh3 *st, const void *buf, size_t len)
+{
+	xxh_stripes_fn fn = __atomic_load_n(&xxh_stripes_impl, __ATOMIC_RELAXED);
+	const BYTE *p = (const BYTE *)buf;
+
+	if (st->total + len <= XXH_MIDSIZE_MAX)
+	{
+		memcpy(st->head + st->total, p, len);
+		st->total += len;
+		return;
+	}
+	if (NULL == fn)
+	{
+		fn = xxh_select();
+		__atomic_store_n(&xxh_stripes_impl, fn, __ATOMIC_RELAXED);
+	}
+	// past 240 bytes, what was kept goes to the long path first
+	if (st->total <= XXH_MIDSIZE_MAX)
+		xxh_feed(st, fn, st->head, (size_t)st->total);
+	st->total += len;
+	xxh_feed(st, fn, p, len);
+}
+
+static uint64_t
+xxh_mul128_fold64(uint64_t a, uint64_t b)
+{
+	unsigned __int128 m = (unsigned __int128)a * b;
+
+	return (uint64_t)m ^ (uint64_t)(m >> 64);
+}
+
+// XXH3_avalanche()
+static uint64_t
+xxh_avalanche(uint64_t h)
+{
+	h ^= h >> 37;
+	h *= 0x165667919E3779F9ULL;
+	return h ^ (h >> 32);
+}
+
+// XXH64_avalanche()
+static uint64_t
+xxh64_avalanche(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	return h ^ (h >> 32);
+}
+
+static uint64_t
+xxh_merge(const uint64_t *acc, const BYTE *sec, uint64_t h)
+{
+	int i;
+
+	for (i = 0; i < 4; ++i)
+		h += xxh_mul128_fold64(acc[2 * i] ^ xxh_read64(sec + 16 * i),
+				       acc[2 * i + 1] ^ xxh_read64(sec + 16 * i + 8));
+	return xxh_avalanche(h);
+}
+
+// XXH3_len_0to16_128b(): inputs of up to 16 bytes
+static void
+xxh_len_0to16(const BYTE *in, size_t len, uint64_t hash[2])
+{
+	const BYTE *sec = xxh_secret;
+	unsigned __int128 m;
+	uint64_t lo, hi;
+
+	if (len > 8)
+	{
+		lo = xxh_read64(in);
+		hi = xxh_read64(in + len - 8);
+		m = (unsigned __int128)(lo ^ hi ^ xxh_read64(sec + 32) ^
+					xxh_read64(sec + 40)) * XXH_PRIME64_1;
+		lo = (uint64_t)m + ((uint64_t)(len - 1) << 54);
+		hi ^= xxh_read64(sec + 48) ^ xxh_read64(sec + 56);
+		hi = (uint64_t)(m >> 64) + hi +
+		     (uint64_t)(uint32_t)hi * (XXH_PRIME32_2 - 1);
+		lo ^= __builtin_bswap64(hi);
+		m = (unsigned __int128)lo * XXH_PRIME64_2;
+		hash[0] = xxh_avalanche((uint64_t)m);
+		hash[1] = xxh_avalanche((uint64_t)(m >> 64) + hi * XXH_PRIME64_2);
+	}
+	else if (len >= 4)
+	{
+		lo = xxh_read32(in) + ((uint64_t)xxh_read32(in + len - 4) << 32);
+		lo ^= xxh_read64(sec + 16) ^ xxh_read64(sec + 24);
+		m = (unsigned __int128)lo * (XXH_PRIME64_1 + (len << 2));
+		hi = (uint64_t)(m >> 64) + ((uint64_t)m << 1);
+		lo = (uint64_t)m ^ (hi >> 3);
+		lo ^= lo >> 35;
+		lo *= 0x9FB21C651E98DF25ULL;
+		hash[0] = lo ^ (lo >> 28);
+		hash[1] = xxh_avalanche(hi);
+	}
+	else if (len > 0)
+	{
+		uint32_t c = ((uint32_t)in[0] << 16) | ((uint32_t)in[len >> 1] << 24) |
+			     in[len - 1] | ((uint32_t)len << 8);
+		uint32_t ch = __builtin_bswap32(c);
+
+		ch = (ch << 13) | (ch >> 19);
+		hash[0] = xxh64_avalanche(c ^ (uint64_t)(xxh_read32(sec) ^
+							 xxh_read32(sec + 4)));
+		hash[1] = xxh64_avalanche(ch ^ (uint64_t)(xxh_read32(sec + 8) ^
+							  xxh_read32(sec + 12)));
+	}
+	else
+	{
+		hash[0] = xxh64_avalanche(xxh_read64(sec + 64) ^ xxh_read64(sec + 72));
+		hash[1] = xxh64_avalanche(xxh_read64(sec + 80) ^ xxh_read64(sec + 88));
+	}
+}
+
+// XXH128_mix32B(): 16 bytes at a and at b into acc, with 32 of the secret
+static void
+xxh_mix32(uint64_t acc[2], const BYTE *a, const BYTE *b, const BYTE *sec)
+{
+	acc[0] += xxh_mul128_fold64(xxh_read64(a) ^ xxh_read64(sec),
+				    xxh_read64(a + 8) ^ xxh_read64(sec + 8));
+	acc[0] ^= xxh_read64(b) + xxh_read64(b + 8);
+	acc[1] += xxh_mul128_fold64(xxh_read64(b) ^ xxh_read64(sec + 16),
+				    xxh_read64(b + 8) ^ xxh_read64(sec + 24));
+	acc[1] ^= xxh_read64(a) + xxh_read64(a + 8);
+}
+
+// XXH3_len_17to128_128b() and XXH3_len_129to240_128b(): 17 to 240 bytes
+static void
+xxh_len_17to240(const BYTE *in, size_t len, uint64_t hash[2])
+{
+	uint64_t acc[2] = {len * XXH_PRIME64_1, 0};
+	size_t i;
+
+	if (len <= 128)
+	{
+		if (len > 96)
+			xxh_mix32(acc, in + 48, in + len - 64, xxh_secret + 96);
+		if (len > 64)
+			xxh_mix32(acc, in + 32, in + len - 48, xxh_secret + 64);
+		if (len > 32)
+			xxh_mix32(acc, in + 16, in + len - 32, xxh_secret + 32);
+		xxh_mix32(acc, in, in + len - 16, xxh_secret);
+	}
+	else
+	{
+		for (i = 0; i < 128; i += 32)
+			xxh_mix32(acc, in + i, in + i + 16, xxh_secret + i);
+		acc[0] = xxh_avalanche(acc[0]);
+		acc[1] = xxh_avalanche(acc[1]);
+		// all 32 bytes after the first 128, the secret from 3 on
+		for (i = 160; i <= len; i += 32)
+			xxh_mix32(acc, in + i - 32, in + i - 16, xxh_secret + 3 + i - 160);
+		xxh_mix32(acc, in + len - 16, in + len - 32, xxh_secret + 103);
+	}
+	hash[0] = xxh_avalanche(acc[0] + acc[1]);
+	hash[1] = 0 - xxh_avalanche(acc[0] * XXH_PRIME64_1 +
+				    acc[1] * XXH_PRIME64_4 +
+				    len * XXH_PRIME64_2);
+}
+
+void
+xxh3_final(const struct xxh3 *st, uint64_t hash[2])
+{
+	BYTE last[XXH_STRIPE];
+	uint64_t acc[8];
+	size_t n = st->nbuf;
+
+	if (st->total <= 16)
+	{
+		xxh_len_0to16(st->head, (size_t)st->total, hash);
+		return;
+	}
+	if (st->total <= XXH_MIDSIZE_MAX)
+	{
+		xxh_len_17to240(st->head, (size_t)st->total, hash);
+		return;
+	}
+
+	// the last 64 bytes, those before the buffered ones from the last
+	// stripe folded
+	memcpy(last, st->last + n, XXH_STRIPE - n);
+	memcpy(last + XXH_STRIPE - n, st->buf, n);
+	memcpy(acc, st->acc, sizeof(acc));
+	xxh_stripes_scalar(acc, last, xxh_secret + XXH_SECRET_SZ - XXH_STRIPE - 7,
+			   1);
+	hash[0] = xxh_merge(acc, xxh_secret + 11, st->total * XXH_PRIME64_1);
+	hash[1] = xxh_merge(acc, xxh_secret + XXH_SECRET_SZ - XXH_STRIPE - 11,
+			    ~(st->total * XXH_PRIME64_2));
+}
+
+void
+xxh3_128(const void *buf, size_t len, uint64_t hash[2])
+{
+	struct xxh3 st;
+
+	xxh3_init(&st);
+	xxh3_update(&st, buf, len);
+	xxh3_final(&st, hash);
+}
+
+//=============================================================================
+//=  Dispatch: every kernel bound at once                                     =
+//=============================================================================
+
+void
+cpu_dispatch(void)
+{
+	__atomic_store_n(&pattern_check_impl, pattern_check_select(),
+			 __ATOMIC_RELAXED);
+	__atomic_store_n(&buf_compare_impl, buf_compare_select(),
+			 __ATOMIC_RELAXED);
+	__atomic_store_n(&bit_flips_impl, bit_flips_select(), __ATOMIC_RELAXED);
+	__atomic_store_n(&csum_impl, csum_select(), __ATOMIC_RELAXED);
+	__atomic_store_n(&xxh_stripes_impl, xxh_select(), __ATOMIC_RELAXED);
+	pthread_once(&rand_once, rand_select);
+	pthread_once(&crc_once, crc_init);
+	pthread_once(&t10dif_once, t10dif_init);
+	pthread_once(&crc64_once, crc64_init);
 }